@@ -0,0 +1,646 @@
+/*
+Operating Systems Spring 2024
+Final Project
+
+Archive: the pages fetched in compressed WARC segments and the link graph in columnar files, written by a
+background thread.
+
+Each worker collects its pages and links in a batch of its own, with no lock, as records holding the
+strings and the body bytes. A full batch is handed to the writer under a short lock that only links it
+to the queue and never waits for the disk. While more than 'queueBytes' are waiting, new batches are
+dropped and counted instead, so a slow disk loses pages from the archive rather than slowing the crawl.
+
+The writer thread takes every queued batch at once. Pages become WARC records, each compressed as a
+gzip member of its own so a reader can seek to any record, appended to the current segment until it
+reaches 'segmentBytes'. Links have their two URLs interned in a URL table of the archive (see
+urltable.h); a URL seen for the first time gets the next ID and is appended to the string table, and
+the two IDs of the link are appended to the two columns of the graph. See archive.h for the files.
+
+Batch record: [BatchRecord][url bytes][body or target bytes].
+*/
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <zlib.h>
+
+#include "archive.h"
+#include "hash.h"
+#include "urltable.h"
+
+#define PATH_BYTES 4096
+
+// Compressed bytes the writer collects before an fwrite() to the segment
+#define OUT_BYTES (256 * 1024)
+
+// Buffers of the writer's files
+#define FILE_BUFFER_BYTES (256 * 1024)
+
+// Kinds of batch records
+#define RECORD_PAGE 1
+#define RECORD_LINK 2
+
+// Fixed part of a batch record
+typedef struct
+{
+    uint32_t kind;
+    uint32_t urlLen;            // Bytes of the page URL, or of the page the link is on
+    uint64_t dataLen;           // Bytes of the body kept, or of the URL the link points to
+    uint64_t size;              // Bytes of the whole body, more than dataLen if it was truncated
+    int64_t time;               // Seconds since the epoch the page was fetched
+    int32_t status;             // HTTP status of the page
+    uint32_t reserved;
+} BatchRecord;
+
+// Records of a batch on their way to the writer
+typedef struct Chunk
+{
+    char *data;
+    size_t len, cap;
+    long pages, links;          // Records of each kind, counted as dropped if the chunk is
+    struct Chunk *next;
+} Chunk;
+
+struct ArchiveBatch
+{
+    Archive *archive;
+    Chunk *chunk;               // Records not handed over yet, NULL for none
+};
+
+struct Archive
+{
+    ArchiveConfig config;
+    char dir[PATH_BYTES];
+
+    // Queue of the batches handed over, under 'lock'
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    Chunk *head;
+    Chunk **tail;
+    size_t queued;              // Bytes in the queue and being written
+    int stop;
+    pthread_t writer;
+
+    // Writer thread only
+    FILE *segment;              // Current WARC segment, NULL until the next page
+    long segmentIndex;          // Number of the next segment
+    size_t segmentLen;
+    z_stream zs;
+    unsigned char *out;
+    FILE *strings, *offsets, *from, *to;
+    uint64_t stringsLen;
+    UrlTable *urls;             // URLs of the link graph
+    uint32_t *ids;              // ID in the graph of each URL table ID
+    size_t idsCap;
+    uint32_t urlCount;
+    uint64_t idSeed;            // Makes the WARC record IDs of this archive unique
+    uint64_t records;
+    int failed;                 // 1 once a write failed
+
+    atomic_long pages, links, urlTotal, segments, droppedPages, droppedLinks;
+    atomic_llong rawBytes, compressedBytes;
+};
+
+/*
+    Fill an ArchiveConfig with the crawler's default settings.
+
+    Preconditions:  'config' points to a valid ArchiveConfig structure.
+    Postcondition:  Every field is set, 'dir' to "crawler.archive".
+*/
+void archiveConfigDefaults(ArchiveConfig *config)
+{
+    config->dir = "crawler.archive";
+    config->segmentBytes = 1024 * 1024 * 1024;  // The usual size of a WARC file
+    config->maxBodyBytes = 8 * 1024 * 1024;
+    config->batchBytes = 256 * 1024;
+    config->queueBytes = 256 * 1024 * 1024;
+    config->level = 6;
+}
+
+// Reason phrase of the status line of a record
+static const char *reasonPhrase(long status)
+{
+    switch (status)
+    {
+    case 200: return "OK";
+    case 301: return "Moved Permanently";
+    case 302: return "Found";
+    case 304: return "Not Modified";
+    case 404: return "Not Found";
+    case 500: return "Internal Server Error";
+    case 503: return "Service Unavailable";
+    default:  return "";
+    }
+}
+
+// Compress 'len' bytes into the current gzip member, 'flush' Z_FINISH for its last bytes
+static void deflateOut(Archive *archive, const void *data, size_t len, int flush)
+{
+    archive->zs.next_in = (unsigned char *)data;
+    archive->zs.avail_in = (uInt)len;
+    do
+    {
+        archive->zs.next_out = archive->out;
+        archive->zs.avail_out = OUT_BYTES;
+        deflate(&archive->zs, flush);
+        size_t have = OUT_BYTES - archive->zs.avail_out;
+        if (have > 0 && fwrite(archive->out, 1, have, archive->segment) != have && !archive->failed)
+        {
+            perror("archive");
+            archive->failed = 1;
+        }
+        archive->segmentLen += have;
+        atomic_fetch_add(&archive->compressedBytes, (long long)have);
+    } while (archive->zs.avail_out == 0);
+}
+
+// Write one WARC record as a gzip member: 'head' then 'len' bytes of 'body' and the record's end
+static void writeMember(Archive *archive, const char *head, size_t headLen, const char *body, size_t len)
+{
+    deflateReset(&archive->zs);
+    deflateOut(archive, head, headLen, Z_NO_FLUSH);
+    if (len > 0)
+        deflateOut(archive, body, len, Z_NO_FLUSH);
+    deflateOut(archive, "\r\n\r\n", 4, Z_FINISH);
+    atomic_fetch_add(&archive->rawBytes, (long long)(headLen + len + 4));
+}
+
+// Fill in the WARC-Record-ID and WARC-Date of the next record
+static void recordId(Archive *archive, int64_t time, char *id, size_t idSize, char *date, size_t dateSize)
+{
+    uint64_t a = mix64(archive->idSeed + 2 * archive->records);
+    uint64_t b = mix64(archive->idSeed + 2 * archive->records + 1);
+    archive->records++;
+    snprintf(id, idSize, "<urn:uuid:%08x-%04x-4%03x-%04x-%012llx>", (unsigned)(a >> 32), (unsigned)(a >> 16) & 0xffff,
+             (unsigned)a & 0xfff, 0x8000 | ((unsigned)(b >> 48) & 0x3fff), (unsigned long long)b & 0xffffffffffffULL);
+    time_t seconds = (time_t)time;
+    struct tm tm;
+    gmtime_r(&seconds, &tm);
+    strftime(date, dateSize, "%Y-%m-%dT%H:%M:%SZ", &tm);
+}
+
+// Start the next segment with its warcinfo record
+static int openSegment(Archive *archive)
+{
+    char name[64], path[PATH_BYTES + 64];
+    snprintf(name, sizeof(name), "pages-%05ld.warc.gz", archive->segmentIndex++);
+    snprintf(path, sizeof(path), "%s/%s", archive->dir, name);
+    archive->segment = fopen(path, "w");
+    if (archive->segment == NULL)
+    {
+        if (!archive->failed)
+            perror(path);
+        archive->failed = 1;
+        return -1;
+    }
+    archive->segmentLen = 0;
+    atomic_fetch_add(&archive->segments, 1);
+
+    static const char fields[] = "software: WebCrawler\r\nformat: WARC File Format 1.0\r\n";
+    char id[64], date[32], head[512];
+    recordId(archive, (int64_t)time(NULL), id, sizeof(id), date, sizeof(date));
+    int len = snprintf(head, sizeof(head),
+                       "WARC/1.0\r\nWARC-Type: warcinfo\r\nWARC-Date: %s\r\nWARC-Filename: %s\r\nWARC-Record-ID: %s\r\n"
+                       "Content-Type: application/warc-fields\r\nContent-Length: %zu\r\n\r\n%s",
+                       date, name, id, sizeof(fields) - 1, fields);
+    writeMember(archive, head, (size_t)len, NULL, 0);
+    return 0;
+}
+
+static void closeSegment(Archive *archive)
+{
+    if (archive->segment == NULL)
+        return;
+    if (fclose(archive->segment) != 0 && !archive->failed)
+    {
+        perror("archive");
+        archive->failed = 1;
+    }
+    archive->segment = NULL;
+}
+
+// Write a page as a response record, or a revisit record if the server answered 304
+static void writePage(Archive *archive, const BatchRecord *record, const char *url, const char *body)
+{
+    if (archive->segment != NULL && archive->segmentLen >= archive->config.segmentBytes)
+        closeSegment(archive);
+    if (archive->segment == NULL && openSegment(archive) != 0)
+        return;
+
+    char http[128];
+    int notModified = record->status == 304;
+    int httpLen = notModified ? snprintf(http, sizeof(http), "HTTP/1.1 304 Not Modified\r\n\r\n")
+                              : snprintf(http, sizeof(http), "HTTP/1.1 %d %s\r\nContent-Length: %llu\r\n\r\n",
+                                         (int)record->status, reasonPhrase(record->status),
+                                         (unsigned long long)record->dataLen);
+    size_t bodyLen = notModified ? 0 : record->dataLen;
+
+    char id[64], date[32];
+    recordId(archive, record->time, id, sizeof(id), date, sizeof(date));
+    size_t headCap = 512 + record->urlLen;
+    char *head = malloc(headCap);
+    if (head == NULL)
+        return;
+    int len = snprintf(head, headCap,
+                       "WARC/1.0\r\nWARC-Type: %s\r\nWARC-Target-URI: %.*s\r\nWARC-Date: %s\r\nWARC-Record-ID: %s\r\n%s%s"
+                       "Content-Type: application/http; msgtype=response\r\nContent-Length: %llu\r\n\r\n%s",
+                       notModified ? "revisit" : "response", (int)record->urlLen, url, date, id,
+                       notModified ? "WARC-Profile: http://netpreserve.org/warc/1.0/revisit/server-not-modified\r\n" : "",
+                       record->dataLen < record->size ? "WARC-Truncated: length\r\n" : "",
+                       (unsigned long long)(httpLen + bodyLen), http);
+    writeMember(archive, head, (size_t)len, body, bodyLen);
+    free(head);
+    atomic_fetch_add(&archive->pages, 1);
+}
+
+static void writeFile(Archive *archive, FILE *file, const void *data, size_t len)
+{
+    if (fwrite(data, 1, len, file) != len && !archive->failed)
+    {
+        perror("archive");
+        archive->failed = 1;
+    }
+}
+
+// ID of a URL in the link graph, adding it to the string table the first time; UINT32_MAX if it cannot be kept
+static uint32_t urlId(Archive *archive, const char *url, size_t len)
+{
+    uint32_t tableId;
+    int added = urlTableIntern(archive->urls, url, len, &tableId);
+    if (added < 0)
+        return UINT32_MAX;
+    if (added == 0)
+        return archive->ids[tableId];
+
+    if (tableId >= archive->idsCap)
+    {
+        size_t cap = archive->idsCap ? archive->idsCap : 1024;
+        while (cap <= tableId)
+            cap *= 2;
+        uint32_t *ids = realloc(archive->ids, cap * sizeof(uint32_t));
+        if (ids == NULL)
+            return UINT32_MAX;                  // Stays in the table with no ID: its links are lost
+        archive->ids = ids;
+        archive->idsCap = cap;
+    }
+    uint32_t id = archive->urlCount++;
+    archive->ids[tableId] = id;
+    writeFile(archive, archive->offsets, &archive->stringsLen, sizeof(uint64_t));
+    writeFile(archive, archive->strings, url, len);
+    writeFile(archive, archive->strings, "\n", 1);
+    archive->stringsLen += len + 1;
+    atomic_fetch_add(&archive->urlTotal, 1);
+    return id;
+}
+
+// Write the records of a batch
+static void writeChunk(Archive *archive, const Chunk *chunk)
+{
+    for (size_t off = 0; off < chunk->len;)
+    {
+        BatchRecord record;
+        memcpy(&record, chunk->data + off, sizeof(record));
+        const char *url = chunk->data + off + sizeof(record);
+        const char *data = url + record.urlLen;
+        off += sizeof(record) + record.urlLen + record.dataLen;
+
+        if (record.kind == RECORD_PAGE)
+        {
+            writePage(archive, &record, url, data);
+            continue;
+        }
+        uint32_t from = urlId(archive, url, record.urlLen);
+        uint32_t to = urlId(archive, data, record.dataLen);
+        if (from == UINT32_MAX || to == UINT32_MAX)
+            continue;
+        writeFile(archive, archive->from, &from, sizeof(from));
+        writeFile(archive, archive->to, &to, sizeof(to));
+        atomic_fetch_add(&archive->links, 1);
+    }
+}
+
+static void flushFiles(Archive *archive)
+{
+    FILE *files[] = { archive->segment, archive->strings, archive->offsets, archive->from, archive->to };
+    for (size_t i = 0; i < sizeof(files) / sizeof(files[0]); i++)
+        if (files[i] != NULL && fflush(files[i]) != 0 && !archive->failed)
+        {
+            perror("archive");
+            archive->failed = 1;
+        }
+}
+
+static void *writerThread(void *arg)
+{
+    Archive *archive = (Archive *)arg;
+
+    pthread_mutex_lock(&archive->lock);
+    while (1)
+    {
+        while (archive->head == NULL && !archive->stop)
+            pthread_cond_wait(&archive->wake, &archive->lock);
+        Chunk *list = archive->head;            // Take every batch, the workers go on queueing
+        archive->head = NULL;
+        archive->tail = &archive->head;
+        int stop = archive->stop;
+        pthread_mutex_unlock(&archive->lock);
+
+        size_t written = 0;
+        while (list != NULL)
+        {
+            Chunk *chunk = list;
+            list = chunk->next;
+            writeChunk(archive, chunk);
+            written += chunk->len;
+            free(chunk->data);
+            free(chunk);
+        }
+        flushFiles(archive);                    // What was handed over can be read from the files
+
+        pthread_mutex_lock(&archive->lock);
+        archive->queued -= written;
+        if (stop && archive->head == NULL)
+            break;
+    }
+    pthread_mutex_unlock(&archive->lock);
+    return NULL;
+}
+
+// Open a file of the archive directory for writing, with a large buffer
+static FILE *openFile(Archive *archive, const char *name)
+{
+    char path[PATH_BYTES + 64];
+    snprintf(path, sizeof(path), "%s/%s", archive->dir, name);
+    FILE *file = fopen(path, "w");
+    if (file == NULL)
+        perror(path);
+    else
+        setvbuf(file, NULL, _IOFBF, FILE_BUFFER_BYTES);
+    return file;
+}
+
+static void closeFile(Archive *archive, FILE *file)
+{
+    if (file != NULL && fclose(file) != 0 && !archive->failed)
+    {
+        perror("archive");
+        archive->failed = 1;
+    }
+}
+
+/*
+    Open an archive and start its writer thread.
+
+    Preconditions:  'config' holds the settings, see archiveConfigDefaults().
+    Postcondition:  Returns the archive, with its directory created and its files started over; or NULL if the
+                    directory or a file cannot be created, or memory allocation failed.
+*/
+Archive *archiveOpen(const ArchiveConfig *config)
+{
+    if (strlen(config->dir) >= PATH_BYTES || (mkdir(config->dir, 0755) != 0 && errno != EEXIST))
+        return NULL;
+    Archive *archive = calloc(1, sizeof(Archive));
+    if (archive == NULL)
+        return NULL;
+    archive->config = *config;
+    if (archive->config.level < 1 || archive->config.level > 9)
+        archive->config.level = 6;
+    strcpy(archive->dir, config->dir);
+    archive->tail = &archive->head;
+    archive->idSeed = mix64((uint64_t)time(NULL) ^ (uint64_t)getpid() << 32);
+
+    // Remove the segments of an earlier archive in the directory
+    for (long i = 0;; i++)
+    {
+        char path[PATH_BYTES + 64];
+        snprintf(path, sizeof(path), "%s/pages-%05ld.warc.gz", archive->dir, i);
+        if (unlink(path) != 0)
+            break;
+    }
+
+    archive->strings = openFile(archive, ARCHIVE_STRINGS_FILE);
+    archive->offsets = openFile(archive, ARCHIVE_OFFSETS_FILE);
+    archive->from = openFile(archive, ARCHIVE_FROM_FILE);
+    archive->to = openFile(archive, ARCHIVE_TO_FILE);
+    archive->urls = urlTableCreate(0);
+    archive->out = malloc(OUT_BYTES);
+    int zok = deflateInit2(&archive->zs, archive->config.level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) == Z_OK;
+    pthread_mutex_init(&archive->lock, NULL);
+    pthread_cond_init(&archive->wake, NULL);
+
+    if (archive->strings == NULL || archive->offsets == NULL || archive->from == NULL || archive->to == NULL ||
+        archive->urls == NULL || archive->out == NULL || !zok ||
+        pthread_create(&archive->writer, NULL, writerThread, archive) != 0)
+    {
+        closeFile(archive, archive->strings);
+        closeFile(archive, archive->offsets);
+        closeFile(archive, archive->from);
+        closeFile(archive, archive->to);
+        urlTableDestroy(archive->urls);
+        free(archive->out);
+        if (zok)
+            deflateEnd(&archive->zs);
+        pthread_mutex_destroy(&archive->lock);
+        pthread_cond_destroy(&archive->wake);
+        free(archive);
+        return NULL;
+    }
+    return archive;
+}
+
+// Longest body archivePage() keeps of a page, for the caller collecting it
+size_t archiveMaxBody(const Archive *archive)
+{
+    return archive->config.maxBodyBytes;
+}
+
+/*
+    Start collecting the records of a worker.
+
+    Preconditions:  'archive' was returned by archiveOpen(); the batch is used by one thread at a time.
+    Postcondition:  Returns an empty batch, or NULL if memory allocation failed.
+*/
+ArchiveBatch *archiveBatchCreate(Archive *archive)
+{
+    ArchiveBatch *batch = calloc(1, sizeof(ArchiveBatch));
+    if (batch != NULL)
+        batch->archive = archive;
+    return batch;
+}
+
+/*
+    Hand the records of a batch to the writer.
+
+    Preconditions:  'batch' was returned by archiveBatchCreate(), or is NULL.
+    Postcondition:  The records are queued for the writer, or dropped and counted if the queue is full. Returns
+                    without waiting for the disk either way.
+*/
+void archiveFlush(ArchiveBatch *batch)
+{
+    if (batch == NULL || batch->chunk == NULL)
+        return;
+    Archive *archive = batch->archive;
+    Chunk *chunk = batch->chunk;
+    batch->chunk = NULL;
+
+    pthread_mutex_lock(&archive->lock);
+    int fits = archive->queued + chunk->len <= archive->config.queueBytes;
+    if (fits)
+    {
+        chunk->next = NULL;
+        *archive->tail = chunk;
+        archive->tail = &chunk->next;
+        archive->queued += chunk->len;
+        pthread_cond_signal(&archive->wake);
+    }
+    pthread_mutex_unlock(&archive->lock);
+
+    if (!fits)
+    {
+        atomic_fetch_add(&archive->droppedPages, chunk->pages);
+        atomic_fetch_add(&archive->droppedLinks, chunk->links);
+        free(chunk->data);
+        free(chunk);
+    }
+}
+
+// Append a record to a batch, handing the batch over once it holds 'batchBytes'
+static void addRecord(ArchiveBatch *batch, const BatchRecord *record, const char *url, const char *data)
+{
+    size_t need = sizeof(*record) + record->urlLen + record->dataLen;
+    if (batch->chunk != NULL && batch->chunk->len + need > batch->chunk->cap)
+        archiveFlush(batch);
+    if (batch->chunk == NULL)
+    {
+        size_t cap = batch->archive->config.batchBytes > need ? batch->archive->config.batchBytes : need;
+        Chunk *chunk = calloc(1, sizeof(Chunk));
+        char *bytes = malloc(cap);
+        if (chunk == NULL || bytes == NULL)
+        {
+            free(chunk);
+            free(bytes);
+            atomic_fetch_add(record->kind == RECORD_PAGE ? &batch->archive->droppedPages : &batch->archive->droppedLinks, 1);
+            return;
+        }
+        chunk->data = bytes;
+        chunk->cap = cap;
+        batch->chunk = chunk;
+    }
+
+    Chunk *chunk = batch->chunk;
+    memcpy(chunk->data + chunk->len, record, sizeof(*record));
+    memcpy(chunk->data + chunk->len + sizeof(*record), url, record->urlLen);
+    memcpy(chunk->data + chunk->len + sizeof(*record) + record->urlLen, data, record->dataLen);
+    chunk->len += need;
+    if (record->kind == RECORD_PAGE)
+        chunk->pages++;
+    else
+        chunk->links++;
+    if (chunk->len >= batch->archive->config.batchBytes)
+        archiveFlush(batch);
+}
+
+/*
+    Add a page fetched to a batch.
+
+    Preconditions:  'batch' was returned by archiveBatchCreate(), or is NULL. 'body' holds the first 'len' bytes of
+                    a body of 'size' bytes; 'len' is at most archiveMaxBody().
+    Postcondition:  The page is in the batch, stamped with the current time; the batch may have been handed over.
+*/
+void archivePage(ArchiveBatch *batch, const char *url, long status, const char *body, size_t len, size_t size)
+{
+    if (batch == NULL)
+        return;
+    BatchRecord record = { .kind = RECORD_PAGE, .urlLen = (uint32_t)strlen(url), .dataLen = len, .size = size,
+                           .time = (int64_t)time(NULL), .status = (int32_t)status };
+    addRecord(batch, &record, url, body);
+}
+
+/*
+    Add a link to a batch.
+
+    Preconditions:  'batch' was returned by archiveBatchCreate(), or is NULL. 'from' is the URL of the page the link
+                    is on, 'to' the normalized URL it points to.
+    Postcondition:  The link is in the batch; the batch may have been handed over.
+*/
+void archiveLink(ArchiveBatch *batch, const char *from, const char *to)
+{
+    if (batch == NULL)
+        return;
+    BatchRecord record = { .kind = RECORD_LINK, .urlLen = (uint32_t)strlen(from), .dataLen = strlen(to) };
+    addRecord(batch, &record, from, to);
+}
+
+/*
+    Hand over what is left in a batch and free it.
+
+    Preconditions:  'batch' was returned by archiveBatchCreate(), or is NULL.
+    Postcondition:  The records are queued for the writer (or dropped if it is behind), the batch is freed.
+*/
+void archiveBatchDestroy(ArchiveBatch *batch)
+{
+    if (batch == NULL)
+        return;
+    archiveFlush(batch);
+    free(batch);
+}
+
+/*
+    Read the counters of an archive.
+
+    Preconditions:  'archive' was returned by archiveOpen(), 'stats' points to an ArchiveStats.
+    Postcondition:  'stats' holds what the writer has written so far.
+*/
+void archiveStats(const Archive *archive, ArchiveStats *stats)
+{
+    Archive *a = (Archive *)archive;
+    stats->pages = atomic_load(&a->pages);
+    stats->links = atomic_load(&a->links);
+    stats->urls = atomic_load(&a->urlTotal);
+    stats->segments = atomic_load(&a->segments);
+    stats->rawBytes = atomic_load(&a->rawBytes);
+    stats->compressedBytes = atomic_load(&a->compressedBytes);
+    stats->droppedPages = atomic_load(&a->droppedPages);
+    stats->droppedLinks = atomic_load(&a->droppedLinks);
+}
+
+/*
+    Write what is queued, close the files and free the archive.
+
+    Preconditions:  'archive' was returned by archiveOpen(), or is NULL; every batch has been destroyed.
+    Postcondition:  Returns 0 with the final counters in 'stats' (unless NULL), or -1 if a write failed.
+*/
+int archiveClose(Archive *archive, ArchiveStats *stats)
+{
+    if (archive == NULL)
+        return 0;
+    pthread_mutex_lock(&archive->lock);
+    archive->stop = 1;
+    pthread_cond_signal(&archive->wake);
+    pthread_mutex_unlock(&archive->lock);
+    pthread_join(archive->writer, NULL);
+
+    closeSegment(archive);
+    closeFile(archive, archive->strings);
+    closeFile(archive, archive->offsets);
+    closeFile(archive, archive->from);
+    closeFile(archive, archive->to);
+    if (stats != NULL)
+        archiveStats(archive, stats);
+    int result = archive->failed ? -1 : 0;
+
+    deflateEnd(&archive->zs);
+    urlTableDestroy(archive->urls);
+    free(archive->ids);
+    free(archive->out);
+    pthread_mutex_destroy(&archive->lock);
+    pthread_cond_destroy(&archive->wake);
+    free(archive);
+    return result;
+}
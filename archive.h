@@ -0,0 +1,76 @@
+/*
+Operating Systems Spring 2024
+Final Project
+
+Archive: the pages fetched in compressed WARC segments and the link graph in columnar files, written by a
+background thread.
+*/
+
+#ifndef ARCHIVE_H
+#define ARCHIVE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+    Files of an archive directory, all started over by archiveOpen():
+
+      pages-NNNNN.warc.gz   WARC 1.0 records, each its own gzip member: a warcinfo record, then a response record
+                            per page (a revisit record for 304 Not Modified). Only the status line of the HTTP
+                            response is kept, with the body.
+      urls.strings          every URL of the link graph once, each followed by '\n', in order of their IDs
+      urls.offsets          uint64 offset of each URL in urls.strings, indexed by ID
+      links.from            uint32 ID of the page of each link
+      links.to              uint32 ID of the URL each link points to, at the same index as in links.from
+
+    Integers are in native byte order with no header, so every file but the segments can be mapped and used as
+    an array. URL IDs count from 0 in the order the URLs were first seen. Links are kept as found, a page linking
+    twice to a URL gives two links.
+*/
+#define ARCHIVE_STRINGS_FILE "urls.strings"
+#define ARCHIVE_OFFSETS_FILE "urls.offsets"
+#define ARCHIVE_FROM_FILE "links.from"
+#define ARCHIVE_TO_FILE "links.to"
+
+// Settings for archiveOpen()
+typedef struct
+{
+    const char *dir;            // Directory of the archive, created if needed
+    size_t segmentBytes;        // Compressed size at which a WARC segment is closed and a new one started
+    size_t maxBodyBytes;        // Longest body kept of a page, longer ones are truncated
+    size_t batchBytes;          // Records a worker collects before handing them to the writer
+    size_t queueBytes;          // Records waiting for the writer at most; batches beyond are dropped
+    int level;                  // zlib compression level, 1 to 9
+} ArchiveConfig;
+
+// Counters of an archive since archiveOpen()
+typedef struct
+{
+    long pages;                 // Pages written to the segments
+    long links;                 // Links written to the link graph
+    long urls;                  // URLs in the link graph
+    long segments;              // WARC segments started
+    long long rawBytes;         // Bytes of the records before compression
+    long long compressedBytes;  // Bytes written to the segments
+    long droppedPages;          // Pages of batches dropped because the writer was behind
+    long droppedLinks;          // Links of batches dropped because the writer was behind
+} ArchiveStats;
+
+typedef struct Archive Archive;
+
+// Records collected by one worker, handed to the writer in batches
+typedef struct ArchiveBatch ArchiveBatch;
+
+// Function prototypes
+void archiveConfigDefaults(ArchiveConfig *config);
+Archive *archiveOpen(const ArchiveConfig *config);
+ArchiveBatch *archiveBatchCreate(Archive *archive);
+size_t archiveMaxBody(const Archive *archive);
+void archivePage(ArchiveBatch *batch, const char *url, long status, const char *body, size_t len, size_t size);
+void archiveLink(ArchiveBatch *batch, const char *from, const char *to);
+void archiveFlush(ArchiveBatch *batch);
+void archiveBatchDestroy(ArchiveBatch *batch);
+void archiveStats(const Archive *archive, ArchiveStats *stats);
+int archiveClose(Archive *archive, ArchiveStats *stats);
+
+#endif
@@ -0,0 +1,349 @@
+/*
+Operating Systems Spring 2024
+Final Project
+
+Benchmark: heap allocations per page on the fetch and crawl paths.
+
+malloc(), calloc(), realloc() and free() are replaced in this program by counting wrappers around
+glibc's, and curl's allocator is set with curl_global_init_mem(), so every allocation is counted
+and curl's own are told apart from the rest. The stand-in server runs in a child process so its
+allocations are not counted. Each path fetches pages of 'pageSize' bytes from a synthetic site
+graph (see sitegraph.h):
+  realloc/chunk  the old WriteHTMLCallback, one realloc() per chunk curl hands over
+  GetRequest     the blocking path, one buffer sized from Content-Length, freed by the caller
+  engine         the fetch engine buffering bodies, buffers recycled through its BufferPool
+  crawl          the crawler, streaming every page through its link scanner
+The first pages of each path warm the pools up and are not counted.
+
+Usage: bench_alloc [pageSize] [pages]
+*/
+
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <curl/curl.h>
+
+#include "crawler.h"
+#include "httpserver.h"
+#include "sitegraph.h"
+
+// Pages fetched before counting starts
+#define WARMUP_PAGES 64
+
+// glibc's allocator, wrapped below
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t count, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void __libc_free(void *ptr);
+
+// Allocation counters of one path
+typedef struct
+{
+    atomic_long calls;          // malloc(), calloc() and realloc() calls
+    atomic_long bytes;          // Bytes requested by them
+} Counter;
+
+static atomic_int counting;     // Count only while a path is measured
+static Counter own, curlOwn;    // Everything but curl, and curl
+
+static void count(Counter *counter, size_t size)
+{
+    if (atomic_load_explicit(&counting, memory_order_relaxed))
+    {
+        atomic_fetch_add_explicit(&counter->calls, 1, memory_order_relaxed);
+        atomic_fetch_add_explicit(&counter->bytes, (long)size, memory_order_relaxed);
+    }
+}
+
+void *malloc(size_t size)
+{
+    count(&own, size);
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count_, size_t size)
+{
+    count(&own, count_ * size);
+    return __libc_calloc(count_, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    count(&own, size);
+    return __libc_realloc(ptr, size);
+}
+
+void free(void *ptr)
+{
+    __libc_free(ptr);
+}
+
+// curl's allocator, counted on its own
+static void *curlMalloc(size_t size)
+{
+    count(&curlOwn, size);
+    return __libc_malloc(size);
+}
+
+static void *curlCalloc(size_t count_, size_t size)
+{
+    count(&curlOwn, count_ * size);
+    return __libc_calloc(count_, size);
+}
+
+static void *curlRealloc(void *ptr, size_t size)
+{
+    count(&curlOwn, size);
+    return __libc_realloc(ptr, size);
+}
+
+static char *curlStrdup(const char *s)
+{
+    size_t len = strlen(s) + 1;
+    count(&curlOwn, len);
+    char *copy = __libc_malloc(len);
+    return copy ? memcpy(copy, s, len) : NULL;
+}
+
+static void startCounting(void)
+{
+    atomic_store(&own.calls, 0);
+    atomic_store(&own.bytes, 0);
+    atomic_store(&curlOwn.calls, 0);
+    atomic_store(&curlOwn.bytes, 0);
+    atomic_store(&counting, 1);
+}
+
+static void report(const char *path, long pages)
+{
+    atomic_store(&counting, 0);
+    long ownCalls = atomic_load(&own.calls), curlCalls = atomic_load(&curlOwn.calls);
+    printf("%-14s %7ld %12.2f %12.2f %12.2f %14.0f\n", path, pages, (ownCalls + curlCalls) / (double)pages,
+           curlCalls / (double)pages, ownCalls / (double)pages, atomic_load(&own.bytes) / (double)pages);
+    fflush(stdout);
+}
+
+static void pageUrl(char *buf, size_t len, int port, long page)
+{
+    snprintf(buf, len, "http://127.0.0.1:%d/n/%ld", port, page);
+}
+
+// The WriteHTMLCallback the fetch paths used before, kept here as the baseline
+static size_t reallocPerChunk(void *contents, size_t size, size_t nmemb, void *userp)
+{
+    size_t realsize = size * nmemb;
+    struct CURLResponse *mem = (struct CURLResponse *)userp;
+    char *ptr = realloc(mem->html, mem->size + realsize + 1);
+    if (!ptr)
+        return 0;
+    mem->html = ptr;
+    memcpy(&(mem->html[mem->size]), contents, realsize);
+    mem->size += realsize;
+    mem->html[mem->size] = 0;
+    return realsize;
+}
+
+static void runReallocPerChunk(int port, long pages)
+{
+    CURL *curl = curl_easy_init();
+    char url[128];
+    for (long page = 0; page < WARMUP_PAGES + pages; page++)
+    {
+        if (page == WARMUP_PAGES)
+            startCounting();
+        struct CURLResponse response = { malloc(1), 0 };
+        pageUrl(url, sizeof(url), port, page);
+        curl_easy_setopt(curl, CURLOPT_URL, url);
+        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, reallocPerChunk);
+        curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void *)&response);
+        curl_easy_perform(curl);
+        free(response.html);
+    }
+    report("realloc/chunk", pages);
+    curl_easy_cleanup(curl);
+}
+
+static void runGetRequest(int port, long pages)
+{
+    CURL *curl = curl_easy_init();
+    char url[128];
+    for (long page = 0; page < WARMUP_PAGES + pages; page++)
+    {
+        if (page == WARMUP_PAGES)
+            startCounting();
+        pageUrl(url, sizeof(url), port, page);
+        struct CURLResponse response = GetRequest(curl, url);
+        free(response.html);
+    }
+    report("GetRequest", pages);
+    curl_easy_cleanup(curl);
+}
+
+static void engineDone(FetchEngine *engine, const char *url, struct CURLResponse *response,
+                       CURLcode result, long status, void *userdata)
+{
+    long *done = (long *)fetchEngineContext(engine);
+    (void)url; (void)response; (void)result; (void)status; (void)userdata;
+    (*done)++;
+}
+
+static void runEngine(int port, long pages)
+{
+    long done = 0, next = 0;
+    FetchConfig config;
+    fetchConfigDefaults(&config);
+    config.maxInFlight = 32;
+    config.maxHostConnections = 0;
+    config.onDone = engineDone;
+    config.context = &done;
+    FetchEngine *engine = fetchEngineCreate(&config);
+    char url[128];
+
+    while (done < WARMUP_PAGES + pages)
+    {
+        while (next < WARMUP_PAGES + pages && fetchEngineHasCapacity(engine))
+        {
+            pageUrl(url, sizeof(url), port, next++);
+            fetchEngineSubmit(engine, url, NULL);
+        }
+        if (done >= WARMUP_PAGES && !atomic_load(&counting))
+            startCounting();
+        fetchEngineRun(engine, 50);
+    }
+    report("engine", done - WARMUP_PAGES);
+
+    AllocStats stats;
+    fetchEngineAllocStats(engine, &stats);
+    printf("%14s buffers and URLs: %ld malloc() calls (%.1f KB), %ld reuses\n", "", stats.mallocs,
+           stats.bytes / 1024.0, stats.reuses);
+    fetchEngineDestroy(engine);
+}
+
+// Crawl the whole graph from its root with 'workers' workers
+static void runCrawl(int port, int depth, int workers)
+{
+    char seed[128];
+    pageUrl(seed, sizeof(seed), port, 0);
+
+    visited_urls = visitedCreate(0);
+    SchedulerConfig schedulerConfig;
+    schedulerConfigDefaults(&schedulerConfig);
+    schedulerConfig.maxDepth = depth;
+    ThreadData data = { .frontier = frontierCreate(depth, NULL), .scheduler = schedulerCreate(&schedulerConfig), .links = stdout };
+    atomic_init(&data.pagesFetched, 0);
+    atomic_init(&data.pagesFailed, 0);
+    frontierPush(data.frontier, seed, 0);
+
+    // The crawler prints every link it finds; keep that out of the report
+    fflush(stdout);
+    int saved = dup(STDOUT_FILENO);
+    int devnull = open("/dev/null", O_WRONLY);
+    dup2(devnull, STDOUT_FILENO);
+
+    startCounting();
+    crawl(&data, workers);
+    atomic_store(&counting, 0);
+
+    fflush(stdout);
+    dup2(saved, STDOUT_FILENO);
+    close(saved);
+    close(devnull);
+
+    char path[32];
+    snprintf(path, sizeof(path), "crawl (%d)", workers);
+    report(path, atomic_load(&data.pagesFetched));
+    schedulerDestroy(data.scheduler);
+    frontierDestroy(data.frontier);
+    visitedDestroy(visited_urls);
+}
+
+// Run the stand-in server in a child process until 'stopFd' is closed; return its port
+static int startServer(SiteGraph *graph, int *stopFd, pid_t *child)
+{
+    int portPipe[2], stopPipe[2];
+    if (pipe(portPipe) != 0 || pipe(stopPipe) != 0)
+        return -1;
+
+    *child = fork();
+    if (*child == 0)
+    {
+        close(portPipe[0]);
+        close(stopPipe[1]);
+        HttpServerConfig serverConfig = { 0, 0, siteGraphHandler, graph };
+        HttpServer *server = httpServerStart(&serverConfig);
+        int port = server ? httpServerPort(server) : -1;
+        if (write(portPipe[1], &port, sizeof(port)) != sizeof(port) || server == NULL)
+            _exit(1);
+        char byte;
+        while (read(stopPipe[0], &byte, 1) > 0)
+            ;
+        httpServerStop(server);
+        _exit(0);
+    }
+
+    close(portPipe[1]);
+    close(stopPipe[0]);
+    int port = -1;
+    if (*child < 0 || read(portPipe[0], &port, sizeof(port)) != sizeof(port))
+        port = -1;
+    close(portPipe[0]);
+    *stopFd = stopPipe[1];
+    return port;
+}
+
+int main(int argc, char *argv[])
+{
+    SiteGraph graph = { 8, 4, 64 * 1024 };
+    if (argc > 1)
+        graph.pageSize = (size_t)atol(argv[1]);
+    long pages = argc > 2 ? atol(argv[2]) : 1000;
+    if (pages > siteGraphPages(&graph, graph.depth) - WARMUP_PAGES)
+        pages = siteGraphPages(&graph, graph.depth) - WARMUP_PAGES;
+
+    struct rlimit rl;
+    getrlimit(RLIMIT_NOFILE, &rl);
+    rl.rlim_cur = rl.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &rl);
+
+    int stopFd;
+    pid_t child;
+    int port = startServer(&graph, &stopFd, &child);
+    if (port < 0)
+        return 1;
+
+    // The crawler writes crawler.log into the working directory
+    char dir[] = "/tmp/bench_alloc.XXXXXX";
+    if (mkdtemp(dir) == NULL || chdir(dir) != 0)
+        return 1;
+
+    LogConfig logConfig;
+    logConfigDefaults(&logConfig);
+    logConfig.truncate = 1;
+    if (logOpen(&logConfig) != 0)
+        return 1;
+
+    curl_global_init_mem(CURL_GLOBAL_ALL, curlMalloc, free, curlRealloc, curlStrdup, curlCalloc);
+
+    printf("site graph: fanout %d, depth %d, pages of %zu bytes\n\n", graph.fanout, graph.depth, graph.pageSize);
+    printf("%-14s %7s %12s %12s %12s %14s\n", "path", "pages", "allocs/page", "curl", "other", "bytes/page");
+
+    runReallocPerChunk(port, pages);
+    runGetRequest(port, pages);
+    runEngine(port, pages);
+    runCrawl(port, graph.depth, 1);
+    runCrawl(port, graph.depth, 2);
+
+    curl_global_cleanup();
+    close(stopFd);
+    waitpid(child, NULL, 0);
+    logClose();
+    unlink("crawler.log");
+    if (chdir("/") == 0)
+        rmdir(dir);
+    return 0;
+}
@@ -0,0 +1,304 @@
+/*
+Operating Systems Spring 2024
+Final Project
+
+Benchmark: cost and size of the crawl archive (archive.c).
+
+The stand-in server serves a complete tree (see sitegraph.h). The site is crawled without an archive,
+then with one at zlib levels 1, 6 and 9. Each row reports pages/sec and CPU per page, the bytes of
+the WARC records before and after compression, and the links and URLs of the link graph. CPU is the
+whole process's, server and writer thread included, so the difference to the first row is what the
+archive costs; the best of 'repeats' runs is shown.
+
+The check reads the archive back: every WARC segment through zlib, counting the response records
+against the pages fetched, and the link graph through a mapping of its files, checking that there
+is a link for every link the crawl found (metrics.c), that the graph has every page of the site
+once, and that every link of /n/i points to a child, the parent or the root of page i.
+
+Usage: bench_archive [pageSize] [latencyMs] [repeats]
+*/
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <curl/curl.h>
+#include <zlib.h>
+
+#include "crawler.h"
+#include "httpserver.h"
+#include "sitegraph.h"
+
+// Outcome of one crawl
+typedef struct
+{
+    long pages;
+    double seconds;
+    double cpu;                 // Seconds of CPU of the whole process
+    long found;                 // Links the crawl found
+    ArchiveStats archived;
+} RunResult;
+
+// What was read back from an archive
+typedef struct
+{
+    long responses;             // Response records in the segments
+    long links;                 // Links in the graph
+    long urls;                  // URLs in the string table
+    long badLinks;              // Links that are not in the site graph, or URLs that are not pages
+} ArchiveCheck;
+
+static double nowSeconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double cpuSeconds(void)
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+// Crawl the whole site with two workers, archiving at zlib level 'level' (0 for no archive)
+static void runCrawl(HttpServer *server, const SiteGraph *graph, int level, RunResult *result)
+{
+    char seed[128];
+    snprintf(seed, sizeof(seed), "http://127.0.0.1:%d/n/0", httpServerPort(server));
+
+    Archive *archive = NULL;
+    if (level > 0)
+    {
+        ArchiveConfig archiveConfig;
+        archiveConfigDefaults(&archiveConfig);
+        archiveConfig.dir = "archive";
+        archiveConfig.level = level;
+        archive = archiveOpen(&archiveConfig);
+    }
+    visited_urls = visitedCreate(0);
+    UrlTable *urls = urlTableCreate(0);
+    SchedulerConfig schedulerConfig;
+    schedulerConfigDefaults(&schedulerConfig);
+    schedulerConfig.maxDepth = graph->depth;
+    schedulerConfig.maxPerHost = 0;
+    ThreadData data = { .frontier = frontierCreate(graph->depth, urls), .scheduler = schedulerCreate(&schedulerConfig),
+                        .archive = archive };
+    atomic_init(&data.pagesFetched, 0);
+    atomic_init(&data.pagesFailed, 0);
+    frontierPush(data.frontier, seed, 0);
+
+    long found = metricsTotal(METRIC_LINKS);
+    double cpu = cpuSeconds();
+    double start = nowSeconds();
+    crawl(&data, 2);
+    archiveClose(archive, &result->archived);           // Everything written, the writer's CPU included
+    result->seconds = nowSeconds() - start;
+    result->cpu = cpuSeconds() - cpu;
+    result->pages = atomic_load(&data.pagesFetched);
+    result->found = metricsTotal(METRIC_LINKS) - found;
+
+    schedulerDestroy(data.scheduler);
+    frontierDestroy(data.frontier);
+    urlTableDestroy(urls);
+    visitedDestroy(visited_urls);
+}
+
+// Count the response records of the segments in the archive directory
+static long countResponses(void)
+{
+    static const char needle[] = "\r\nWARC-Type: response\r\n";
+    long count = 0;
+    for (int i = 0;; i++)
+    {
+        char path[64];
+        snprintf(path, sizeof(path), "archive/pages-%05d.warc.gz", i);
+        gzFile in = gzopen(path, "rb");                 // Reads every gzip member of the file in turn
+        if (in == NULL)
+            break;
+        char buf[64 * 1024 + sizeof(needle)];
+        size_t kept = 0;                                // Tail of the last read, for a needle cut in two
+        int n;
+        while ((n = gzread(in, buf + kept, 64 * 1024)) > 0)
+        {
+            size_t len = kept + (size_t)n;
+            for (char *p = buf; (p = memmem(p, len - (size_t)(p - buf), needle, sizeof(needle) - 1)) != NULL; p++)
+                count++;
+            kept = len < sizeof(needle) - 1 ? len : sizeof(needle) - 2;
+            memmove(buf, buf + len - kept, kept);
+        }
+        gzclose(in);
+    }
+    return count;
+}
+
+// Map a file of the archive directory; returns its bytes and size, or NULL
+static void *mapFile(const char *name, size_t *size)
+{
+    char path[64];
+    snprintf(path, sizeof(path), "archive/%s", name);
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0 || st.st_size == 0)
+    {
+        if (fd >= 0)
+            close(fd);
+        return NULL;
+    }
+    void *p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    *size = (size_t)st.st_size;
+    return p == MAP_FAILED ? NULL : p;
+}
+
+// Page number of the URL with ID 'id', -1 if it is not a page of the site
+static long pageOf(const char *strings, const uint64_t *offsets, long urls, size_t stringsSize, long id)
+{
+    if (id < 0 || id >= urls)
+        return -1;
+    uint64_t end = id + 1 < urls ? offsets[id + 1] : stringsSize;
+    const char *path = memmem(strings + offsets[id], end - offsets[id], "/n/", 3);
+    return path != NULL ? atol(path + 3) : -1;
+}
+
+// Read the archive back, see the description above
+static void checkArchive(const SiteGraph *graph, ArchiveCheck *check)
+{
+    memset(check, 0, sizeof(*check));
+    check->responses = countResponses();
+
+    size_t stringsSize = 0, offsetsSize = 0, fromSize = 0, toSize = 0;
+    const char *strings = mapFile(ARCHIVE_STRINGS_FILE, &stringsSize);
+    const uint64_t *offsets = mapFile(ARCHIVE_OFFSETS_FILE, &offsetsSize);
+    const uint32_t *from = mapFile(ARCHIVE_FROM_FILE, &fromSize);
+    const uint32_t *to = mapFile(ARCHIVE_TO_FILE, &toSize);
+    if (strings == NULL || offsets == NULL || from == NULL || to == NULL || fromSize != toSize)
+    {
+        check->badLinks = -1;
+        return;
+    }
+    check->urls = (long)(offsetsSize / sizeof(uint64_t));
+    check->links = (long)(fromSize / sizeof(uint32_t));
+
+    char *seen = calloc((size_t)siteGraphPages(graph, graph->depth), 1);
+    for (long id = 0; id < check->urls; id++)
+    {
+        long page = pageOf(strings, offsets, check->urls, stringsSize, id);
+        if (page < 0 || siteGraphDepthOf(graph, page) < 0 || seen[page]++)
+            check->badLinks++;                          // Not a page, or in the string table twice
+    }
+    for (long i = 0; i < check->links; i++)
+    {
+        long a = pageOf(strings, offsets, check->urls, stringsSize, from[i]);
+        long b = pageOf(strings, offsets, check->urls, stringsSize, to[i]);
+        int child = b > a * graph->fanout && b <= a * graph->fanout + graph->fanout;
+        if (a < 0 || b < 0 || !(child || b == 0 || (a > 0 && b == (a - 1) / graph->fanout)))
+            check->badLinks++;
+    }
+    free(seen);
+    munmap((void *)strings, stringsSize);
+    munmap((void *)offsets, offsetsSize);
+    munmap((void *)from, fromSize);
+    munmap((void *)to, toSize);
+}
+
+int main(int argc, char *argv[])
+{
+    SiteGraph graph = { 10, 3, 16 * 1024 };
+    int latencyMs = 1;
+    int repeats = 3;
+    if (argc > 1)
+        graph.pageSize = (size_t)atol(argv[1]);
+    if (argc > 2)
+        latencyMs = atoi(argv[2]);
+    if (argc > 3)
+        repeats = atoi(argv[3]);
+    if (latencyMs < 0 || repeats < 1)
+    {
+        fprintf(stderr, "Usage: %s [pageSize] [latencyMs] [repeats]\n", argv[0]);
+        return 2;
+    }
+
+    // The crawler writes crawler.log and the archive into the working directory
+    char dir[] = "/tmp/bench_archive.XXXXXX";
+    if (mkdtemp(dir) == NULL || chdir(dir) != 0)
+        return 1;
+
+    LogConfig logConfig;
+    logConfigDefaults(&logConfig);
+    logConfig.truncate = 1;
+    logConfig.level = LOG_ERROR;                        // The log is not what is measured here
+    MetricsConfig metricsConfig;
+    metricsConfigDefaults(&metricsConfig);
+    if (logOpen(&logConfig) != 0 || metricsOpen(&metricsConfig) != 0)
+        return 1;
+    curl_global_init(CURL_GLOBAL_ALL);
+    HttpServerConfig serverConfig = { 0, latencyMs, siteGraphHandler, &graph };
+    HttpServer *server = httpServerStart(&serverConfig);
+    if (server == NULL)
+        return 1;
+
+    long expected = siteGraphPages(&graph, graph.depth);
+    printf("site graph: fanout %d, depth %d (%ld pages of %zu bytes), latency %d ms, 2 workers, best of %d\n\n",
+           graph.fanout, graph.depth, expected, graph.pageSize, latencyMs, repeats);
+    printf("%-8s %6s %8s %10s %14s %9s %9s %6s %7s %6s %7s %6s\n", "archive", "pages", "seconds", "pages/sec",
+           "CPU us/page", "raw MB", "gzip MB", "ratio", "links", "URLs", "dropped", "check");
+
+    int failures = 0;
+    double baseline = 0;
+    static const int LEVELS[] = { 0, 1, 6, 9 };
+    for (int row = 0; row < 4; row++)
+    {
+        int level = LEVELS[row];
+        RunResult best = { 0 };
+        int ok = 1;
+        for (int r = 0; r < repeats; r++)
+        {
+            RunResult result;
+            runCrawl(server, &graph, level, &result);
+            ok = ok && result.pages == expected;
+            if (level > 0)
+            {
+                ArchiveCheck check;
+                checkArchive(&graph, &check);
+                ok = ok && check.responses == expected && check.links == result.found &&
+                     check.urls == expected && check.badLinks == 0 && result.archived.pages == expected &&
+                     result.archived.droppedPages == 0 && result.archived.droppedLinks == 0;
+            }
+            if (r == 0 || result.cpu < best.cpu)
+                best = result;
+        }
+        failures += !ok;
+
+        char label[16];
+        snprintf(label, sizeof(label), level > 0 ? "level %d" : "none", level);
+        double cpuPerPage = best.cpu * 1e6 / (best.pages > 0 ? best.pages : 1);
+        if (level == 0)
+            baseline = cpuPerPage;
+        const ArchiveStats *a = &best.archived;
+        printf("%-8s %6ld %8.2f %10.1f %8.1f %+4.0f%% %9.2f %9.2f %5.1fx %7ld %6ld %7ld %6s\n", label, best.pages,
+               best.seconds, best.pages / best.seconds, cpuPerPage,
+               baseline > 0 ? 100 * (cpuPerPage / baseline - 1) : 0.0, level > 0 ? a->rawBytes / 1e6 : 0.0,
+               level > 0 ? a->compressedBytes / 1e6 : 0.0,
+               level > 0 && a->compressedBytes > 0 ? (double)a->rawBytes / a->compressedBytes : 0.0,
+               level > 0 ? a->links : 0, level > 0 ? a->urls : 0, level > 0 ? a->droppedPages + a->droppedLinks : 0,
+               ok ? "ok" : "FAILED");
+        fflush(stdout);
+    }
+
+    httpServerStop(server);
+    curl_global_cleanup();
+    metricsClose();
+    logClose();
+    char command[64];
+    snprintf(command, sizeof(command), "rm -rf %s", dir);
+    if (chdir("/") == 0 && system(command) != 0)
+        fprintf(stderr, "Cannot remove %s\n", dir);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,382 @@
+/*
+Operating Systems Spring 2024
+Final Project
+
+Benchmark: a crawl split over several crawler processes (cluster.c) against one process.
+
+The site graph is a complete tree (see sitegraph.h) spread over many hosts, each a stand-in server
+on its own port of 127.0.0.1: page i is served by host i % hosts and every page links to its
+children, its parent and the root, so most links lead to another host. All servers run in one
+child process, which counts the requests for each page in shared memory.
+
+  single    one crawler process, no cluster
+  N shards  N crawler processes, each owning the hosts the hash ring gives it, exchanging links
+            over Unix sockets (and once over TCP on 127.0.0.1)
+
+Every configuration must fetch every page exactly once across all processes. The table shows the
+aggregate pages/sec and, per run, the links sent between shards, the batches they went in and the
+links not sent again because they had been sent before. Throughput only grows with the number of
+shards when there are cores to run them on: the processes share this machine's CPUs.
+
+The ring section checks the spread of 100000 host names over 4 shards, and how many of them move
+when a fifth shard joins, against placing hosts by their hash modulo the number of shards.
+
+Usage: bench_cluster [hosts] [latencyMs] [workersPerShard]
+*/
+
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <curl/curl.h>
+
+#include "crawler.h"
+#include "hash.h"
+#include "httpserver.h"
+#include "sitegraph.h"
+
+// Most hosts and shards of a run
+#define MAX_HOSTS 64
+#define MAX_SHARDS 8
+
+// Seconds a shard may take before it is considered hung
+#define SHARD_TIMEOUT 120
+
+// What a shard process reports back, in shared memory
+typedef struct
+{
+    long fetched;
+    long failed;
+    double seconds;
+    ClusterStats stats;
+    int done;                   // 1 once the shard finished its crawl
+} ShardResult;
+
+// The site, its hosts and the requests they answered, shared with the server process
+typedef struct
+{
+    SiteGraph graph;
+    int hosts;
+    int ports[MAX_HOSTS];
+    atomic_int *served;         // Requests per page
+} Site;
+
+static double nowSeconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Request handler: page i of the tree, its links pointing at the hosts serving them
+static void siteHandler(const char *method, const char *path, const char *headers,
+                        HttpResponse *response, void *userdata)
+{
+    Site *site = (Site *)userdata;
+    const SiteGraph *graph = &site->graph;
+    (void)method;
+    (void)headers;
+
+    long page = -1;
+    int depth = sscanf(path, "/n/%ld", &page) == 1 ? siteGraphDepthOf(graph, page) : -1;
+    if (depth < 0)
+    {
+        response->status = 404;
+        response->body = strdup("<html><body>not found</body></html>");
+        response->size = strlen(response->body);
+        return;
+    }
+    atomic_fetch_add(&site->served[page], 1);
+
+    size_t cap = graph->pageSize + 256 * (size_t)(graph->fanout + 3), len = 0;
+    char *body = malloc(cap);
+    len += (size_t)snprintf(body + len, cap - len, "<html><head><title>page %ld</title></head><body>\n", page);
+    long parent = page > 0 ? (page - 1) / graph->fanout : 0;
+    len += (size_t)snprintf(body + len, cap - len, "<p><a href=\"http://127.0.0.1:%d/n/0\">root</a> "
+                            "<a href=\"http://127.0.0.1:%d/n/%ld\">up</a></p>\n", site->ports[0],
+                            site->ports[parent % site->hosts], parent);
+    for (int i = 1; depth < graph->depth && i <= graph->fanout; i++)
+    {
+        long child = page * graph->fanout + i;
+        len += (size_t)snprintf(body + len, cap - len, "<p><a href=\"http://127.0.0.1:%d/n/%ld\">child</a></p>\n",
+                                site->ports[child % site->hosts], child);
+    }
+    while (len + 80 < graph->pageSize)
+        len += (size_t)snprintf(body + len, cap - len, "<p>Lorem ipsum dolor sit amet, consectetur adipiscing.</p>\n");
+    len += (size_t)snprintf(body + len, cap - len, "</body></html>\n");
+    response->body = body;
+    response->size = len;
+}
+
+// Crawl as shard 'index' of 'peers' (NULL: alone) in this process; the outcome goes to 'result'
+static void runShard(const Site *site, const char *peers, int index, int workers, ShardResult *result)
+{
+    char seed[128];
+    snprintf(seed, sizeof(seed), "http://127.0.0.1:%d/n/0", site->ports[0]);
+
+    curl_global_init(CURL_GLOBAL_ALL);
+    visited_urls = visitedCreate(0);
+    UrlTable *urls = urlTableCreate(0);
+    SchedulerConfig schedulerConfig;
+    schedulerConfigDefaults(&schedulerConfig);
+    schedulerConfig.maxDepth = site->graph.depth;
+    FetchConfig fetchConfig;
+    fetchConfigDefaults(&fetchConfig);
+    fetchConfig.maxInFlight = 64;
+    ThreadData data = { .frontier = frontierCreate(site->graph.depth, urls), .scheduler = schedulerCreate(&schedulerConfig),
+                        .fetch = &fetchConfig };
+    atomic_init(&data.pagesFetched, 0);
+    atomic_init(&data.pagesFailed, 0);
+
+    if (peers != NULL)
+    {
+        ClusterConfig config;
+        clusterConfigDefaults(&config);
+        config.index = index;
+        config.peers = peers;
+        config.onUrl = crawlReceive;
+        config.isIdle = crawlIdle;
+        data.cluster = clusterCreate(&config);
+        if (data.cluster == NULL)
+            _exit(1);
+    }
+    if (data.cluster == NULL || clusterOwner(data.cluster, seed) == index)   // Every shard knows the seed
+        frontierPush(data.frontier, seed, 0);
+
+    double start = nowSeconds();
+    crawl(&data, workers);
+    result->seconds = nowSeconds() - start;
+    result->fetched = atomic_load(&data.pagesFetched);
+    result->failed = atomic_load(&data.pagesFailed);
+    if (data.cluster != NULL)
+    {
+        clusterStats(data.cluster, &result->stats);
+        clusterDestroy(data.cluster);
+    }
+    result->done = 1;
+
+    schedulerDestroy(data.scheduler);
+    frontierDestroy(data.frontier);
+    urlTableDestroy(urls);
+    visitedDestroy(visited_urls);
+    curl_global_cleanup();
+}
+
+// A free TCP port of 127.0.0.1 (free when asked, which is good enough on a quiet machine)
+static int freePort(void)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK) };
+    socklen_t len = sizeof(addr);
+    int port = -1;
+    if (fd >= 0 && bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0 &&
+        getsockname(fd, (struct sockaddr *)&addr, &len) == 0)
+        port = ntohs(addr.sin_port);
+    if (fd >= 0)
+        close(fd);
+    return port;
+}
+
+// Run the servers of every host in a child process until 'stopFd' is closed; returns 0 once they all listen
+static int startServers(Site *site, int latencyMs, int *stopFd, pid_t *child)
+{
+    int readyPipe[2], stopPipe[2];
+    if (pipe(readyPipe) != 0 || pipe(stopPipe) != 0)
+        return -1;
+    for (int i = 0; i < site->hosts; i++)               // Every port is known before a handler links to it
+        site->ports[i] = freePort();
+
+    *child = fork();
+    if (*child == 0)
+    {
+        close(readyPipe[0]);
+        close(stopPipe[1]);
+        HttpServer *servers[MAX_HOSTS];
+        int ready = 1;
+        for (int i = 0; i < site->hosts; i++)
+        {
+            HttpServerConfig config = { site->ports[i], latencyMs, siteHandler, site };
+            servers[i] = httpServerStart(&config);
+            ready = ready && servers[i] != NULL;
+        }
+        if (write(readyPipe[1], &ready, sizeof(ready)) < 0 || !ready)
+            _exit(1);
+        char byte;
+        while (read(stopPipe[0], &byte, 1) > 0)
+            ;
+        for (int i = 0; i < site->hosts; i++)
+            httpServerStop(servers[i]);
+        _exit(0);
+    }
+
+    close(readyPipe[1]);
+    close(stopPipe[0]);
+    int ready = 0;
+    if (*child < 0 || read(readyPipe[0], &ready, sizeof(ready)) != sizeof(ready))
+        ready = 0;
+    close(readyPipe[0]);
+    *stopFd = stopPipe[1];
+    return ready ? 0 : -1;
+}
+
+// Crawl with 'shards' processes (0: one process without a cluster); prints a row and returns 1 if the check failed
+static int runCluster(Site *site, long pages, int shards, int tcp, int workers, double *single)
+{
+    char peers[MAX_SHARDS * CLUSTER_MAX_ADDRESS] = "";
+    for (int i = 0; i < shards; i++)
+    {
+        size_t len = strlen(peers);
+        if (tcp)
+            snprintf(peers + len, sizeof(peers) - len, "%s127.0.0.1:%d", i ? "," : "", freePort());
+        else
+            snprintf(peers + len, sizeof(peers) - len, "%s./shard%d.sock", i ? "," : "", i);
+    }
+    for (long i = 0; i < pages; i++)
+        atomic_store(&site->served[i], 0);
+
+    int processes = shards > 0 ? shards : 1;
+    ShardResult *results = mmap(NULL, sizeof(ShardResult) * MAX_SHARDS, PROT_READ | PROT_WRITE,
+                                MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (results == MAP_FAILED)
+        return 1;
+    memset(results, 0, sizeof(ShardResult) * MAX_SHARDS);
+
+    fflush(stdout);
+    pid_t children[MAX_SHARDS];
+    double start = nowSeconds();
+    for (int i = 0; i < processes; i++)
+    {
+        children[i] = fork();
+        if (children[i] == 0)
+        {
+            alarm(SHARD_TIMEOUT);
+            runShard(site, shards > 0 ? peers : NULL, i, workers, &results[i]);
+            _exit(0);
+        }
+    }
+    for (int i = 0; i < processes; i++)
+        waitpid(children[i], NULL, 0);
+    double seconds = nowSeconds() - start;
+
+    long fetched = 0, failed = 0, once = 0, forwarded = 0, batches = 0, duplicates = 0;
+    long long bytes = 0;
+    int done = 1;
+    for (int i = 0; i < processes; i++)
+    {
+        fetched += results[i].fetched;
+        failed += results[i].failed;
+        forwarded += results[i].stats.forwarded;
+        batches += results[i].stats.batches;
+        duplicates += results[i].stats.duplicates;
+        bytes += results[i].stats.bytesSent;
+        done = done && results[i].done;
+    }
+    for (long i = 0; i < pages; i++)
+        once += atomic_load(&site->served[i]) == 1;
+    munmap(results, sizeof(ShardResult) * MAX_SHARDS);
+
+    if (shards == 0)
+        *single = seconds;
+    char name[32];
+    snprintf(name, sizeof(name), shards == 0 ? "single" : "%d shards%s", shards, tcp ? ", TCP" : "");
+    int ok = done && once == pages && fetched == pages && failed == 0;
+    printf("%-16s %7ld %8.2f %10.1f %8.2fx %10ld %8ld %8.1f %10ld %8.1f %6s\n", name, fetched, seconds,
+           fetched / seconds, *single / seconds, forwarded, batches, batches > 0 ? (double)forwarded / batches : 0.0,
+           duplicates, bytes / 1024.0, ok ? "ok" : "FAIL");
+    fflush(stdout);
+    return !ok;
+}
+
+// Spread of host names over the shards, and hosts moving when a shard is added
+static void ringBalance(void)
+{
+    enum { HOSTS = 100000, SHARDS = 4 };
+    HashRing *ring = hashRingCreate(SHARDS, 160), *grown = hashRingCreate(SHARDS + 1, 160);
+    if (ring == NULL || grown == NULL)
+        return;
+    long counts[SHARDS] = { 0 };
+    long moved = 0, movedModulo = 0;
+    char host[64];
+    for (int i = 0; i < HOSTS; i++)
+    {
+        int len = snprintf(host, sizeof(host), "www.site%d.example.com", i);
+        int owner = hashRingOwner(ring, host, (size_t)len);
+        counts[owner]++;
+        moved += hashRingOwner(grown, host, (size_t)len) != owner;
+        uint64_t h = hash64(host, (size_t)len);
+        movedModulo += h % SHARDS != h % (SHARDS + 1);
+    }
+    long least = counts[0], most = counts[0];
+    for (int i = 1; i < SHARDS; i++)
+    {
+        least = counts[i] < least ? counts[i] : least;
+        most = counts[i] > most ? counts[i] : most;
+    }
+    printf("\nhash ring: %d hosts over %d shards, 160 points each: fewest %.1f%%, most %.1f%% (even: %.1f%%)\n",
+           HOSTS, SHARDS, 100.0 * least / HOSTS, 100.0 * most / HOSTS, 100.0 / SHARDS);
+    printf("a fifth shard moves %.1f%% of the hosts (ideal %.1f%%); hash modulo shards would move %.1f%%\n",
+           100.0 * moved / HOSTS, 100.0 / (SHARDS + 1), 100.0 * movedModulo / HOSTS);
+    hashRingDestroy(ring);
+    hashRingDestroy(grown);
+}
+
+int main(int argc, char *argv[])
+{
+    int hosts = argc > 1 ? atoi(argv[1]) : 16;
+    int latencyMs = argc > 2 ? atoi(argv[2]) : 5;
+    int workers = argc > 3 ? atoi(argv[3]) : 2;
+    if (hosts < 1 || hosts > MAX_HOSTS || workers < 1)
+        return 1;
+
+    struct rlimit rl;
+    getrlimit(RLIMIT_NOFILE, &rl);
+    rl.rlim_cur = rl.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &rl);
+
+    // The shards' Unix sockets go into a directory of their own
+    char dir[] = "/tmp/bench_cluster.XXXXXX";
+    if (mkdtemp(dir) == NULL || chdir(dir) != 0)
+        return 1;
+
+    Site *site = mmap(NULL, sizeof(Site), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (site == MAP_FAILED)
+        return 1;
+    site->graph = (SiteGraph){ 10, 4, 8192 };
+    site->hosts = hosts;
+    long pages = siteGraphPages(&site->graph, site->graph.depth);
+    site->served = mmap(NULL, sizeof(atomic_int) * (size_t)pages, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    int stopFd;
+    pid_t server;
+    if (site->served == MAP_FAILED || startServers(site, latencyMs, &stopFd, &server) != 0)
+        return 1;
+
+    printf("site graph: fanout %d, depth %d (%ld pages of %zu bytes) over %d hosts, latency %d ms;\n"
+           "%d workers per process, %ld CPUs\n\n", site->graph.fanout, site->graph.depth, pages, site->graph.pageSize,
+           hosts, latencyMs, workers, sysconf(_SC_NPROCESSORS_ONLN));
+    printf("%-16s %7s %8s %10s %9s %10s %8s %8s %10s %8s %6s\n", "processes", "pages", "seconds", "pages/sec",
+           "speedup", "links sent", "batches", "per batch", "not resent", "KB sent", "check");
+
+    int failures = 0;
+    double single = 0;
+    failures += runCluster(site, pages, 0, 0, workers, &single);
+    for (int shards = 1; shards <= 4; shards *= 2)
+        failures += runCluster(site, pages, shards, 0, workers, &single);
+    failures += runCluster(site, pages, 4, 1, workers, &single);
+
+    ringBalance();
+
+    close(stopFd);
+    waitpid(server, NULL, 0);
+    if (chdir("/") == 0)
+        rmdir(dir);
+    return failures ? 1 : 0;
+}
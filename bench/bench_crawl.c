@@ -0,0 +1,362 @@
+/*
+Operating Systems Spring 2024
+Final Project
+
+Benchmark: end-to-end crawl of a synthetic site graph, for catching performance regressions.
+
+The stand-in server runs in a process of its own and serves a complete tree (see sitegraph.h)
+with the given fan-out, depth and page size. Every response waits the server's latency plus a
+fixed per-page share of the same latency again, and errorPercent of the pages answer 500 with no
+links, so their subtrees are never reached. Everything is derived from the page numbers: the same
+arguments always give the same site, the same errors and the same delays, with no network access.
+
+Each crawl runs in a freshly forked process with the metrics (metrics.c) open, so its CPU time
+and peak RSS are its own and not the server's nor an earlier run's. A row reports pages/sec,
+the p50/p99 time to first byte, the p99 of the whole transfer (which includes the time a transfer
+waits in curl for one of the host's connections), the p99 of parsing and link extraction per page
+as the metrics histograms give them, CPU per page and peak RSS. The check column compares the pages
+fetched and failed and the requests the server answered against the pages reachable in the graph:
+the reachable error pages must all count as failed, every other reachable page as fetched.
+
+With a baseline file, the first run writes the results to it and later runs compare against
+them: a row that lost more than REGRESSION_PERCENT of its pages/sec, or grew its CPU per page or
+peak RSS by more than that, is flagged and the benchmark exits with 1.
+
+Usage: bench_crawl [fanout] [depth] [pageSize] [latencyMs] [errorPercent] [baseline]
+*/
+
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <curl/curl.h>
+
+#include "crawler.h"
+#include "httpserver.h"
+#include "sitegraph.h"
+
+// Largest change against the baseline that is still taken for noise
+#define REGRESSION_PERCENT 20
+
+// Worker counts of the rows
+static const int workerCounts[] = { 1, 2, 4 };
+#define ROWS (int)(sizeof(workerCounts) / sizeof(workerCounts[0]))
+
+// Site served by the server process, with its request count in shared memory
+typedef struct
+{
+    SiteGraph graph;
+    atomic_ulong *requests;
+} Site;
+
+// Outcome of one crawl, written back by the crawl process
+typedef struct
+{
+    long pages;
+    long failed;
+    unsigned long requests;     // Requests the server answered during the crawl
+    double seconds;
+    double cpu;                 // Seconds of CPU of the crawl process
+    long peakKb;                // Peak RSS of the crawl process
+    double ttfbP50, ttfbP99;    // Milliseconds
+    double fetchP99;            // Milliseconds
+    double parseP99, extractP99;    // Microseconds
+} RunResult;
+
+// A row of the baseline file
+typedef struct
+{
+    int workers;
+    double rate;                // Pages/sec
+    double cpuPerPage;          // Microseconds
+    long peakKb;
+} Baseline;
+
+static double nowSeconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void siteHandler(const char *method, const char *path, const char *headers,
+                        HttpResponse *response, void *userdata)
+{
+    Site *site = (Site *)userdata;
+    atomic_fetch_add(site->requests, 1);
+    siteGraphHandler(method, path, headers, response, &site->graph);
+}
+
+// Run the server in a child process until 'stopFd' is closed; returns its port, or -1
+static int startServer(Site *site, int latencyMs, int *stopFd, pid_t *child)
+{
+    int readyPipe[2], stopPipe[2];
+    if (pipe(readyPipe) != 0 || pipe(stopPipe) != 0)
+        return -1;
+
+    *child = fork();
+    if (*child == 0)
+    {
+        close(readyPipe[0]);
+        close(stopPipe[1]);
+        HttpServerConfig config = { 0, latencyMs, siteHandler, site };
+        HttpServer *server = httpServerStart(&config);
+        int port = server != NULL ? httpServerPort(server) : -1;
+        if (write(readyPipe[1], &port, sizeof(port)) < 0 || port < 0)
+            _exit(1);
+        char byte;
+        while (read(stopPipe[0], &byte, 1) > 0)
+            ;
+        httpServerStop(server);
+        _exit(0);
+    }
+
+    close(readyPipe[1]);
+    close(stopPipe[0]);
+    int port = -1;
+    if (*child < 0 || read(readyPipe[0], &port, sizeof(port)) != sizeof(port))
+        port = -1;
+    close(readyPipe[0]);
+    *stopFd = stopPipe[1];
+    return port;
+}
+
+// Body of the crawl process: crawl the whole site with 'workers' workers and fill in 'result'
+static int crawlProcess(int port, const SiteGraph *graph, int workers, RunResult *result)
+{
+    LogConfig logConfig;
+    logConfigDefaults(&logConfig);
+    logConfig.truncate = 1;
+    MetricsConfig metricsConfig;
+    metricsConfigDefaults(&metricsConfig);
+    if (logOpen(&logConfig) != 0 || metricsOpen(&metricsConfig) != 0)
+        return 1;
+    curl_global_init(CURL_GLOBAL_ALL);
+
+    char seed[128];
+    snprintf(seed, sizeof(seed), "http://127.0.0.1:%d/n/0", port);
+    visited_urls = visitedCreate(0);
+    UrlTable *urls = urlTableCreate(0);
+    SchedulerConfig schedulerConfig;
+    schedulerConfigDefaults(&schedulerConfig);
+    schedulerConfig.maxDepth = graph->depth;
+    schedulerConfig.maxPerHost = 0;                     // One host: only the workers limit the transfers
+    FetchConfig fetchConfig;
+    fetchConfigDefaults(&fetchConfig);
+    ThreadData data = { .frontier = frontierCreate(graph->depth, urls), .scheduler = schedulerCreate(&schedulerConfig),
+                        .fetch = &fetchConfig };
+    atomic_init(&data.pagesFetched, 0);
+    atomic_init(&data.pagesFailed, 0);
+    frontierPush(data.frontier, seed, 0);
+
+    double start = nowSeconds();
+    crawl(&data, workers);
+    result->seconds = nowSeconds() - start;
+    result->pages = atomic_load(&data.pagesFetched);
+    result->failed = atomic_load(&data.pagesFailed);
+    result->ttfbP50 = metricsQuantile(METRIC_TTFB, 0.50) / 1e6;
+    result->ttfbP99 = metricsQuantile(METRIC_TTFB, 0.99) / 1e6;
+    result->fetchP99 = metricsQuantile(METRIC_FETCH, 0.99) / 1e6;
+    result->parseP99 = metricsQuantile(METRIC_PARSE, 0.99) / 1e3;
+    result->extractP99 = metricsQuantile(METRIC_EXTRACT, 0.99) / 1e3;
+
+    schedulerDestroy(data.scheduler);
+    frontierDestroy(data.frontier);
+    urlTableDestroy(urls);
+    visitedDestroy(visited_urls);
+    curl_global_cleanup();
+    metricsClose();
+    logClose();
+    return 0;
+}
+
+// Run one crawl in a child process; returns 0 with 'result' filled in, -1 if the child failed
+static int runCrawl(int port, Site *site, int workers, RunResult *result)
+{
+    int fds[2];
+    if (pipe(fds) != 0)
+        return -1;
+
+    unsigned long requests = atomic_load(site->requests);
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        close(fds[0]);
+        RunResult r;
+        memset(&r, 0, sizeof(r));
+        if (crawlProcess(port, &site->graph, workers, &r) != 0)
+            _exit(1);
+        _exit(write(fds[1], &r, sizeof(r)) == sizeof(r) ? 0 : 1);
+    }
+
+    close(fds[1]);
+    ssize_t got = read(fds[0], result, sizeof(*result));
+    close(fds[0]);
+    int status;
+    struct rusage usage;
+    if (pid < 0 || wait4(pid, &status, 0, &usage) < 0 || got != sizeof(*result))
+        return -1;
+    result->requests = atomic_load(site->requests) - requests;
+    result->cpu = usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+    result->peakKb = usage.ru_maxrss;
+    return 0;
+}
+
+// Read the rows of a baseline file; returns how many, 0 if there is no such file
+static int readBaseline(const char *path, Baseline *rows)
+{
+    FILE *in = fopen(path, "r");
+    if (in == NULL)
+        return 0;
+    char line[256];
+    int count = 0;
+    while (count < ROWS && fgets(line, sizeof(line), in) != NULL)
+    {
+        Baseline b;
+        if (line[0] != '#' && sscanf(line, "%d %lf %lf %ld", &b.workers, &b.rate, &b.cpuPerPage, &b.peakKb) == 4)
+            rows[count++] = b;
+    }
+    fclose(in);
+    return count;
+}
+
+// Percent change from 'base' to 'value'
+static double change(double value, double base)
+{
+    return base > 0 ? 100.0 * (value - base) / base : 0;
+}
+
+int main(int argc, char *argv[])
+{
+    SiteGraph graph = { 10, 3, 16 * 1024, 2, 0 };
+    int latencyMs = 20;
+    const char *baselinePath = NULL;
+    if (argc > 1)
+        graph.fanout = atoi(argv[1]);
+    if (argc > 2)
+        graph.depth = atoi(argv[2]);
+    if (argc > 3)
+        graph.pageSize = (size_t)atol(argv[3]);
+    if (argc > 4)
+        latencyMs = atoi(argv[4]);
+    if (argc > 5)
+        graph.errorPercent = atoi(argv[5]);
+    if (argc > 6)
+        baselinePath = argv[6];
+    if (graph.fanout < 1 || graph.depth < 0 || latencyMs < 0 || graph.errorPercent < 0 || graph.errorPercent > 100)
+    {
+        fprintf(stderr, "Usage: %s [fanout] [depth] [pageSize] [latencyMs] [errorPercent] [baseline]\n", argv[0]);
+        return 2;
+    }
+    graph.jitterMs = latencyMs;
+
+    struct rlimit rl;
+    getrlimit(RLIMIT_NOFILE, &rl);
+    rl.rlim_cur = rl.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &rl);
+
+    Baseline baseline[ROWS];
+    int baselineRows = baselinePath != NULL ? readBaseline(baselinePath, baseline) : 0;
+    FILE *baselineOut = NULL;
+    if (baselinePath != NULL && baselineRows == 0)
+    {
+        baselineOut = fopen(baselinePath, "w");
+        if (baselineOut == NULL)
+        {
+            perror(baselinePath);
+            return 1;
+        }
+    }
+
+    // The crawler writes crawler.log into the working directory
+    char dir[] = "/tmp/bench_crawl.XXXXXX";
+    if (mkdtemp(dir) == NULL || chdir(dir) != 0)
+        return 1;
+
+    // The server process is forked before any thread is started, and counts its requests in shared memory
+    Site site = { .graph = graph };
+    site.requests = mmap(NULL, sizeof(atomic_ulong), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (site.requests == MAP_FAILED)
+        return 1;
+    atomic_init(site.requests, 0);
+    int stopFd;
+    pid_t server;
+    int port = startServer(&site, latencyMs, &stopFd, &server);
+    if (port < 0)
+        return 1;
+
+    long total = siteGraphPages(&graph, graph.depth);
+    long reachable = siteGraphReachable(&graph);
+    long errors = siteGraphReachableErrors(&graph);
+    printf("site graph: fanout %d, depth %d, %ld pages of %zu bytes, %ld reachable of which %ld answer 500 (%d%% of "
+           "all), latency %d + 0..%d ms, %ld CPUs\n",
+           graph.fanout, graph.depth, total, graph.pageSize, reachable, errors, graph.errorPercent, latencyMs,
+           graph.jitterMs, sysconf(_SC_NPROCESSORS_ONLN));
+    if (baselineRows > 0)
+        printf("baseline: %s, regression beyond %d%%\n", baselinePath, REGRESSION_PERCENT);
+    else if (baselineOut != NULL)
+        printf("baseline: writing %s\n", baselinePath);
+    printf("\n%-7s %6s %8s %10s %8s %8s %9s %9s %9s %9s %9s %6s", "workers", "pages", "seconds", "pages/sec",
+           "ttfb p50", "ttfb p99", "fetch p99", "parse p99", "extr p99", "CPU/page", "peak RSS", "check");
+    printf(baselineRows > 0 ? " %31s\n" : "\n", "rate, CPU, RSS vs baseline");
+    printf("%-7s %6s %8s %10s %8s %8s %9s %9s %9s %9s %9s %6s\n", "", "", "", "", "ms", "ms", "ms", "us", "us", "us",
+           "MB", "");
+    if (baselineOut != NULL)
+        fprintf(baselineOut, "# workers pages/sec CPU-us/page peak-RSS-KB, fanout %d depth %d pageSize %zu latency %d "
+                "errors %d%%\n", graph.fanout, graph.depth, graph.pageSize, latencyMs, graph.errorPercent);
+
+    int failures = 0;
+    for (int row = 0; row < ROWS; row++)
+    {
+        int workers = workerCounts[row];
+        RunResult result;
+        if (runCrawl(port, &site, workers, &result) != 0)
+        {
+            printf("%-7d crawl process failed\n", workers);
+            failures++;
+            continue;
+        }
+
+        double rate = result.pages / result.seconds;
+        double cpuPerPage = result.pages > 0 ? result.cpu * 1e6 / result.pages : 0;
+        int ok = result.pages == reachable - errors && result.failed == errors &&
+                 result.requests == (unsigned long)reachable;
+        failures += !ok;
+        printf("%-7d %6ld %8.2f %10.1f %8.1f %8.1f %9.1f %9.1f %9.1f %9.1f %9.1f %6s", workers, result.pages,
+               result.seconds, rate, result.ttfbP50, result.ttfbP99, result.fetchP99, result.parseP99,
+               result.extractP99, cpuPerPage, result.peakKb / 1024.0, ok ? "ok" : "FAILED");
+
+        const Baseline *base = NULL;
+        for (int i = 0; i < baselineRows; i++)
+            if (baseline[i].workers == workers)
+                base = &baseline[i];
+        if (base != NULL)
+        {
+            double rateChange = change(rate, base->rate);
+            double cpuChange = change(cpuPerPage, base->cpuPerPage);
+            double rssChange = change(result.peakKb, base->peakKb);
+            int regressed = rateChange < -REGRESSION_PERCENT || cpuChange > REGRESSION_PERCENT ||
+                            rssChange > REGRESSION_PERCENT;
+            failures += regressed;
+            printf(" %+5.0f%% %+5.0f%% %+5.0f%% %9s", rateChange, cpuChange, rssChange, regressed ? "REGRESSED" : "ok");
+        }
+        printf("\n");
+        fflush(stdout);
+        if (baselineOut != NULL)
+            fprintf(baselineOut, "%d %.1f %.1f %ld\n", workers, rate, cpuPerPage, result.peakKb);
+    }
+
+    if (baselineOut != NULL)
+        fclose(baselineOut);
+    close(stopFd);
+    waitpid(server, NULL, 0);
+    unlink("crawler.log");
+    if (chdir("/") == 0)
+        rmdir(dir);
+    return failures ? 1 : 0;
+}
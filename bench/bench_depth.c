@@ -0,0 +1,132 @@
+/*
+Operating Systems Spring 2024
+Final Project
+
+Benchmark: crawl throughput on a synthetic site graph with known link depths.
+
+The stand-in server serves a complete tree (see sitegraph.h). For each depth limit the crawl
+must fetch exactly the pages above that limit, whatever the number of workers, which checks
+that depth is tracked per URL rather than per worker. Pages/sec is reported for every run.
+
+Usage: bench_depth [fanout] [depth] [latencyMs]
+*/
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <curl/curl.h>
+
+#include "crawler.h"
+#include "httpserver.h"
+#include "sitegraph.h"
+
+static double nowSeconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Crawl from the root with a depth limit, return pages fetched
+static long runCrawl(int port, int maxDepth, int workers, double *seconds)
+{
+    char seed[128];
+    snprintf(seed, sizeof(seed), "http://127.0.0.1:%d/n/0", port);
+
+    visited_urls = visitedCreate(0);
+    UrlTable *urls = urlTableCreate(0);                 // Interned like in the crawler
+    SchedulerConfig schedulerConfig;
+    schedulerConfigDefaults(&schedulerConfig);
+    schedulerConfig.maxDepth = maxDepth - 1;
+    ThreadData data = { .frontier = frontierCreate(maxDepth - 1, urls), .scheduler = schedulerCreate(&schedulerConfig), .links = stdout };
+    atomic_init(&data.pagesFetched, 0);
+    atomic_init(&data.pagesFailed, 0);
+    frontierPush(data.frontier, seed, 0);
+
+    // The crawler prints every link it finds; keep that out of the report
+    fflush(stdout);
+    int saved = dup(STDOUT_FILENO);
+    int devnull = open("/dev/null", O_WRONLY);
+    dup2(devnull, STDOUT_FILENO);
+
+    double start = nowSeconds();
+    crawl(&data, workers);
+    *seconds = nowSeconds() - start;
+
+    fflush(stdout);
+    dup2(saved, STDOUT_FILENO);
+    close(saved);
+    close(devnull);
+
+    schedulerDestroy(data.scheduler);
+    frontierDestroy(data.frontier);
+    urlTableDestroy(urls);
+    visitedDestroy(visited_urls);
+    return atomic_load(&data.pagesFetched);
+}
+
+int main(int argc, char *argv[])
+{
+    SiteGraph graph = { 8, 4, 4096 };
+    int latencyMs = 2;
+    if (argc > 1)
+        graph.fanout = atoi(argv[1]);
+    if (argc > 2)
+        graph.depth = atoi(argv[2]);
+    if (argc > 3)
+        latencyMs = atoi(argv[3]);
+
+    struct rlimit rl;
+    getrlimit(RLIMIT_NOFILE, &rl);
+    rl.rlim_cur = rl.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &rl);
+
+    // The crawler writes crawler.log into the working directory
+    char dir[] = "/tmp/bench_depth.XXXXXX";
+    if (mkdtemp(dir) == NULL || chdir(dir) != 0)
+        return 1;
+
+    LogConfig logConfig;
+    logConfigDefaults(&logConfig);
+    logConfig.truncate = 1;
+    if (logOpen(&logConfig) != 0)
+        return 1;
+
+    curl_global_init(CURL_GLOBAL_ALL);
+    HttpServerConfig serverConfig = { 0, latencyMs, siteGraphHandler, &graph };
+    HttpServer *server = httpServerStart(&serverConfig);
+    if (server == NULL)
+        return 1;
+    int port = httpServerPort(server);
+
+    printf("site graph: fanout %d, depth %d (%ld pages), latency %d ms\n\n", graph.fanout, graph.depth,
+           siteGraphPages(&graph, graph.depth), latencyMs);
+    printf("%9s %7s %8s %8s %10s %9s\n", "max depth", "workers", "pages", "expected", "pages/sec", "check");
+
+    int failures = 0;
+    for (int maxDepth = 1; maxDepth <= graph.depth + 1; maxDepth++)
+    {
+        for (int workers = 1; workers <= 4; workers *= 2)
+        {
+            double seconds;
+            long pages = runCrawl(port, maxDepth, workers, &seconds);
+            long expected = siteGraphPages(&graph, maxDepth - 1);
+            failures += pages != expected;
+            printf("%9d %7d %8ld %8ld %10.1f %9s\n", maxDepth, workers, pages, expected, pages / seconds,
+                   pages == expected ? "ok" : "MISMATCH");
+            fflush(stdout);
+        }
+    }
+
+    httpServerStop(server);
+    curl_global_cleanup();
+    logClose();
+    unlink("crawler.log");
+    if (chdir("/") == 0)
+        rmdir(dir);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,344 @@
+/*
+Operating Systems Spring 2024
+Final Project
+
+Benchmark: the shared DNS cache against a stand-in DNS server with real lookup latency.
+
+Pages are spread round-robin over many host names under a test domain, all served by the local HTTP
+stand-in. Names only resolve through the stand-in DNS server, which answers after a fixed latency, so
+every lookup the cache does not save costs a round trip, as it does against a real resolver.
+
+    uncached    one resolver that keeps no answers (lookups in flight are still shared)
+    per-worker  one resolver per worker, as curl's per-handle DNS cache did before
+    shared      one resolver and one curl share for every worker
+
+The shared resolver then crawls the same hosts again right away (every host cached) and once more
+after the TTL of the records ran out (every host looked up again). Last, one engine fetches pages
+while another host never gets an answer, and a third host does not exist: the engine keeps fetching
+while the lookup hangs, and both hosts are reported as failed. Finally a host answering three
+addresses, one a prefix of another (127.0.0.12 and 127.0.0.1), must resolve to all three.
+
+Usage: bench_dns [dnsLatencyMs] [hosts] [pagesPerHost]
+*/
+
+#include <fcntl.h>
+#include <poll.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/resource.h>
+#include <curl/curl.h>
+
+#include "dnsserver.h"
+#include "fetch.h"
+#include "httpserver.h"
+#include "resolver.h"
+
+// Number of worker threads, each with its own fetch engine
+#define WORKERS 2
+
+// TTL the stand-in DNS server gives its records, in seconds
+#define RECORD_TTL 2
+
+// Settings and shared counters of one run
+typedef struct
+{
+    int httpPort;
+    int hosts;
+    int pages;                  // Pages to fetch in total
+    Resolver *resolvers[WORKERS];   // Resolver of each worker
+    FetchShare *share;          // NULL for none
+    atomic_int next;            // Next page index to hand out
+    atomic_int failed;          // Failed transfers
+    FetchNetStats net[WORKERS]; // Counters of each worker's engine
+} Run;
+
+// Every path gets a small page
+static void pageHandler(const char *method, const char *path, const char *headers,
+                        HttpResponse *response, void *userdata)
+{
+    (void)method; (void)path; (void)headers; (void)userdata;
+    response->body = strdup("<html><body>page</body></html>");
+    response->size = strlen(response->body);
+}
+
+static double nowSeconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void engineDone(FetchEngine *engine, const char *url, struct CURLResponse *response,
+                       CURLcode result, long status, void *userdata)
+{
+    Run *run = (Run *)fetchEngineContext(engine);
+    (void)url; (void)response; (void)userdata;
+    if (result != CURLE_OK || status != 200)
+        atomic_fetch_add(&run->failed, 1);
+}
+
+// Worker: one engine fetching pages round-robin over the hosts
+static void *workerThread(void *arg)
+{
+    Run *run = (Run *)arg;
+    static atomic_int workerIds;
+    int id = atomic_fetch_add(&workerIds, 1) % WORKERS;
+
+    FetchConfig config;
+    fetchConfigDefaults(&config);
+    config.maxInFlight = 64;
+    config.onDone = engineDone;
+    config.context = run;
+    config.resolver = run->resolvers[id];
+    config.share = run->share;
+    FetchEngine *engine = fetchEngineCreate(&config);
+    if (engine == NULL)
+        return NULL;
+
+    char url[128];
+    int exhausted = 0;
+    while (!exhausted || fetchEngineInFlight(engine) > 0)
+    {
+        while (!exhausted && fetchEngineHasCapacity(engine))
+        {
+            int page = atomic_fetch_add(&run->next, 1);
+            if (page >= run->pages)
+            {
+                exhausted = 1;
+                break;
+            }
+            snprintf(url, sizeof(url), "http://h%d.crawl.test:%d/p/%d", page % run->hosts, run->httpPort, page);
+            if (fetchEngineSubmit(engine, url, NULL) != 0)
+                atomic_fetch_add(&run->failed, 1);
+        }
+        fetchEngineRun(engine, 50);
+    }
+    fetchEngineNetStats(engine, &run->net[id]);
+    fetchEngineDestroy(engine);
+    return NULL;
+}
+
+// Add up the counters of the distinct resolvers of a run
+static void sumStats(Run *run, ResolverStats *sum)
+{
+    memset(sum, 0, sizeof(*sum));
+    for (int i = 0; i < WORKERS; i++)
+    {
+        if (i > 0 && run->resolvers[i] == run->resolvers[0])
+            break;
+        ResolverStats stats;
+        resolverStats(run->resolvers[i], &stats);
+        sum->lookups += stats.lookups;
+        sum->hits += stats.hits;
+        sum->joined += stats.joined;
+        sum->queries += stats.queries;
+        sum->expired += stats.expired;
+        sum->failures += stats.failures;
+        sum->savedMicros += stats.savedMicros;
+    }
+}
+
+// Crawl the pages once and print a row; the counters are the difference to 'before'
+static void runRound(const char *name, Run *run, DnsServer *dns, ResolverStats *before)
+{
+    atomic_store(&run->next, 0);
+    atomic_store(&run->failed, 0);
+    unsigned long queries = dnsServerQueries(dns);
+
+    pthread_t tids[WORKERS];
+    double start = nowSeconds();
+    for (int i = 0; i < WORKERS; i++)
+        pthread_create(&tids[i], NULL, workerThread, run);
+    for (int i = 0; i < WORKERS; i++)
+        pthread_join(tids[i], NULL);
+    double seconds = nowSeconds() - start;
+
+    ResolverStats after;
+    sumStats(run, &after);
+    long lookups = after.lookups - before->lookups;
+    long hits = after.hits - before->hits;
+    long waits = 0;
+    for (int i = 0; i < WORKERS; i++)
+        waits += run->net[i].resolveWaits;
+    printf("%-18s %6d %10.1f %8lu %8ld %7.1f%% %7ld %8ld %10.1f %6d\n", name, run->pages, run->pages / seconds,
+           dnsServerQueries(dns) - queries, lookups, lookups > 0 ? 100.0 * hits / lookups : 0.0,
+           after.joined - before->joined, waits, (after.savedMicros - before->savedMicros) / 1000.0,
+           atomic_load(&run->failed));
+    fflush(stdout);
+    *before = after;
+}
+
+// Resolver settings of the benchmark: the stand-in server, its TTL honoured as given
+static Resolver *createResolver(int dnsPort, long maxTtl)
+{
+    char servers[64];
+    snprintf(servers, sizeof(servers), "127.0.0.1:%d", dnsPort);
+    ResolverConfig config;
+    resolverConfigDefaults(&config);
+    config.servers = servers;
+    config.family = AF_INET;
+    config.timeoutMs = 500;
+    config.tries = 1;
+    config.minTtl = 0;
+    config.maxTtl = maxTtl;
+    return resolverCreate(&config);
+}
+
+// One engine fetching pages while one host never answers and another does not exist
+static void blackHole(int httpPort, int dnsPort, int pages)
+{
+    Resolver *resolver = createResolver(dnsPort, 3600);
+    Run run;
+    memset(&run, 0, sizeof(run));
+    FetchConfig config;
+    fetchConfigDefaults(&config);
+    config.maxInFlight = 64;
+    config.onDone = engineDone;
+    config.context = &run;
+    config.resolver = resolver;
+    FetchEngine *engine = fetchEngineCreate(&config);
+
+    char url[128];
+    double start = nowSeconds();
+    fetchEngineSubmit(engine, "http://blackhole.crawl.test/", NULL);
+    fetchEngineSubmit(engine, "http://missing.example/", NULL);
+    int submitted = 0, pagesDone = -1;
+    double pagesSeconds = 0;
+    while (fetchEngineInFlight(engine) > 0)
+    {
+        while (submitted < pages && fetchEngineHasCapacity(engine))
+        {
+            snprintf(url, sizeof(url), "http://h%d.crawl.test:%d/q/%d", submitted % 10, httpPort, submitted);
+            fetchEngineSubmit(engine, url, NULL);
+            submitted++;
+        }
+        fetchEngineRun(engine, 50);
+        if (pagesDone < 0 && submitted == pages && fetchEngineInFlight(engine) <= 1)
+        {
+            pagesDone = pages;
+            pagesSeconds = nowSeconds() - start;
+        }
+    }
+    double seconds = nowSeconds() - start;
+
+    FetchNetStats net;
+    fetchEngineNetStats(engine, &net);
+    printf("\n%d pages on 10 hosts done after %.3f s while the lookup of blackhole.crawl.test hung;\n"
+           "it failed after %.3f s. Failed transfers: %d (expected 2), %ld of them did not resolve.\n",
+           pages, pagesSeconds, seconds, atomic_load(&run.failed), net.resolveFailures);
+    fetchEngineDestroy(engine);
+    resolverDestroy(resolver);
+}
+
+// A host with several addresses, one the prefix of another, keeps every one; returns 0 if it does
+static int multiAddress(int dnsPort)
+{
+    static const char *const expected[] = { "127.0.0.12", "127.0.0.1", "127.0.0.2" };
+    Resolver *resolver = createResolver(dnsPort, 3600);
+    int fds[2];
+    if (resolver == NULL || pipe(fds) != 0)
+        return 1;
+    fcntl(fds[0], F_SETFL, O_NONBLOCK);
+    fcntl(fds[1], F_SETFL, O_NONBLOCK);
+    int waiter = resolverWatch(resolver, fds[1]);
+
+    char addresses[RESOLVER_MAX_ADDRESSES] = "";
+    int status = resolverLookup(resolver, "multi.crawl.test", addresses, sizeof(addresses), waiter);
+    if (status == RESOLVER_PENDING)
+    {
+        struct pollfd pfd = { fds[0], POLLIN, 0 };
+        poll(&pfd, 1, 2000);
+        status = resolverLookup(resolver, "multi.crawl.test", addresses, sizeof(addresses), waiter);
+    }
+
+    // Every expected address must be a whole entry of the list, and nothing else in it
+    int found = 0, entries = 0;
+    for (char *entry = addresses; status == RESOLVER_FOUND && *entry != '\0'; entries++)
+    {
+        size_t len = strcspn(entry, ",");
+        for (int i = 0; i < 3; i++)
+            found += strlen(expected[i]) == len && strncmp(entry, expected[i], len) == 0;
+        entry += len + (entry[len] == ',');
+    }
+    int ok = found == 3 && entries == 3;
+    printf("\nmulti.crawl.test answers %s, %s and %s: resolved to \"%s\" %s\n", expected[0], expected[1],
+           expected[2], addresses, ok ? "ok" : "FAILED");
+
+    resolverUnwatch(resolver, waiter);
+    resolverDestroy(resolver);
+    close(fds[0]);
+    close(fds[1]);
+    return !ok;
+}
+
+int main(int argc, char *argv[])
+{
+    int latencyMs = argc > 1 ? atoi(argv[1]) : 20;
+    int hosts = argc > 2 ? atoi(argv[2]) : 200;
+    int perHost = argc > 3 ? atoi(argv[3]) : 10;
+
+    struct rlimit rl;
+    getrlimit(RLIMIT_NOFILE, &rl);
+    rl.rlim_cur = rl.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &rl);
+
+    curl_global_init(CURL_GLOBAL_ALL);
+    HttpServerConfig httpConfig = { 0, 1, pageHandler, NULL };
+    HttpServer *http = httpServerStart(&httpConfig);
+    DnsServerConfig dnsConfig = { 0, latencyMs, RECORD_TTL, ".crawl.test", "blackhole", "multi" };
+    DnsServer *dns = dnsServerStart(&dnsConfig);
+    if (http == NULL || dns == NULL)
+        return 1;
+    int httpPort = httpServerPort(http), dnsPort = dnsServerPort(dns);
+
+    printf("stand-in DNS: latency %d ms, TTL %d s; %d hosts x %d pages, %d workers\n\n", latencyMs, RECORD_TTL,
+           hosts, perHost, WORKERS);
+    printf("%-18s %6s %10s %8s %8s %8s %7s %8s %10s %6s\n", "resolver", "pages", "pages/sec", "queries",
+           "lookups", "hit rate", "joined", "waited", "saved ms", "failed");
+
+    Run run;
+    ResolverStats before;
+
+    // Nothing kept: every page waits for a lookup
+    memset(&run, 0, sizeof(run));
+    run.httpPort = httpPort;
+    run.hosts = hosts;
+    run.pages = hosts * perHost;
+    run.resolvers[0] = run.resolvers[1] = createResolver(dnsPort, 0);
+    memset(&before, 0, sizeof(before));
+    runRound("uncached", &run, dns, &before);
+    resolverDestroy(run.resolvers[0]);
+
+    // A cache per worker: each worker looks every host up once
+    for (int i = 0; i < WORKERS; i++)
+        run.resolvers[i] = createResolver(dnsPort, 3600);
+    memset(&before, 0, sizeof(before));
+    runRound("per-worker", &run, dns, &before);
+    for (int i = 0; i < WORKERS; i++)
+        resolverDestroy(run.resolvers[i]);
+
+    // One cache and one curl share for every worker
+    for (int i = 0; i < WORKERS; i++)
+        run.resolvers[i] = i == 0 ? createResolver(dnsPort, 3600) : run.resolvers[0];
+    run.share = fetchShareCreate();
+    memset(&before, 0, sizeof(before));
+    runRound("shared", &run, dns, &before);
+    runRound("shared, warm", &run, dns, &before);
+    usleep((RECORD_TTL * 1000 + 200) * 1000);
+    runRound("shared, TTL over", &run, dns, &before);
+    resolverDestroy(run.resolvers[0]);
+    fetchShareDestroy(run.share);
+
+    blackHole(httpPort, dnsPort, 500);
+    int failures = multiAddress(dnsPort);
+
+    dnsServerStop(dns);
+    httpServerStop(http);
+    curl_global_cleanup();
+    return failures > 0;
+}
@@ -0,0 +1,492 @@
+/*
+Operating Systems Spring 2024
+Final Project
+
+Benchmark: retries, adaptive concurrency limits and circuit breakers against hosts that fail.
+
+Three fault-injecting stand-in hosts, each crawled twice:
+
+  flaky      Every page of the site answers 503 for a while after it is first asked for: page i
+             for 0, 200 or 600 ms as i % 3. Crawled by a single worker with the concurrency limits
+             fixed, retrying at once and then with the default backoff. The server records when
+             every attempt arrives, so the waits before the 2nd and 3rd attempt can be checked
+             against the backoff (base/2 .. base, then base .. 2 base), and their sum against the
+             crawl's time: had the worker slept through them, the crawl would take at least as long.
+  overload   The host serves 'capacity' requests at a time (50 ms each) and answers every request
+             beyond that with 503 at once. Crawled with --per-host 16 and --retries 5, the limit kept
+             fixed, then adapted. Reported are the requests turned away, the pages still failing
+             after their retries and the host's limit at the end, which should have come down towards
+             the capacity. Adapted, every page must be served with less than half the 503s per page
+             served of the fixed limit.
+  dead       A live site plus 'deadUrls' seeds on a host that accepts and resets every connection.
+             Crawled with the breaker off, then on. Reported are the connections the dead host saw,
+             the time the crawl took in all and the live site's pages, which must all be fetched.
+
+Every row also checks the crawler's own counters against what the host saw: a page counts as
+fetched only if the host answered it 200, and as failed if it was asked for but never answered
+200, e.g. a 503 left after the last retry.
+
+Usage: bench_faults [capacity] [deadUrls]
+*/
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <curl/curl.h>
+
+#include "crawler.h"
+#include "httpserver.h"
+#include "sitegraph.h"
+
+// Attempts of a page recorded by the flaky host, as many as the crawler makes by default
+#define MAX_ATTEMPTS 3
+
+// Longest a 503 of the flaky host lasts for one page, by page number modulo 3
+static const int downMs[] = { 0, 200, 600 };
+
+// Slack on the upper bound of a backoff, for the server's latency and the time to notice a failure
+#define BACKOFF_SLACK_MS 60
+
+// Time the overloaded host takes for a request it accepts
+#define SERVICE_MS 50
+
+// Attempts per page on the overloaded host: even adapted, the limit probes above the capacity now and then,
+// and with the default 3 a page is now and then turned away every time
+#define OVERLOAD_ATTEMPTS 5
+
+// Largest capacity of the overloaded host
+#define MAX_CAPACITY 64
+
+// State of a fault-injecting host, only touched on its server thread until the crawl is over
+typedef struct
+{
+    SiteGraph graph;
+    long pages;                 // Pages of the graph
+    int capacity;               // Requests served at once by the overloaded host, 0 for the flaky host
+    int attempts[1024];         // Requests per page
+    double times[1024][MAX_ATTEMPTS];   // When they arrived, in ms
+    char served[1024];          // 1 once the page was answered 200
+    long requests, rejected;    // Requests in all, and those answered 503
+    double busyUntil[MAX_CAPACITY];     // When each accepted request of the overloaded host is answered
+} FaultSite;
+
+// Crawl of a row: its settings, seeds and outcome
+typedef struct
+{
+    const char **seeds;
+    int seedCount;
+    int maxDepth;
+    int workers;
+    FetchConfig fetch;
+    SchedulerConfig scheduler;
+    long fetched, failed;       // Out: pages of the crawl
+    double seconds;             // Out: time of the crawl
+    SchedulerStats stats;       // Out: the scheduler's counters
+    int limit;                  // Out: limit of the host of the first seed at the end
+} Crawl;
+
+static double nowMsDouble(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+// Answer 503 with a short body
+static void busy(HttpResponse *response, FaultSite *site)
+{
+    static const char text[] = "<html><body>Busy, try again later</body></html>";
+    response->status = 503;
+    response->body = malloc(sizeof(text) - 1);
+    response->size = response->body != NULL ? sizeof(text) - 1 : 0;
+    if (response->body != NULL)
+        memcpy(response->body, text, sizeof(text) - 1);
+    site->rejected++;
+}
+
+static void faultHandler(const char *method, const char *path, const char *headers,
+                         HttpResponse *response, void *userdata)
+{
+    FaultSite *site = (FaultSite *)userdata;
+    double now = nowMsDouble();
+    long page = -1;
+    site->requests++;
+    if (sscanf(path, "/n/%ld", &page) != 1 || page < 0 || page >= site->pages)
+    {
+        siteGraphHandler(method, path, headers, response, &site->graph);   // 404
+        return;
+    }
+    if (site->attempts[page] < MAX_ATTEMPTS)
+        site->times[page][site->attempts[page]] = now;
+    site->attempts[page]++;
+
+    if (site->capacity == 0)                        // Flaky: busy for a while after the first request
+    {
+        if (now - site->times[page][0] < downMs[page % 3])
+        {
+            busy(response, site);
+            return;
+        }
+    }
+    else                                            // Overloaded: busy beyond 'capacity' requests at once
+    {
+        int slot = -1;
+        for (int i = 0; i < site->capacity && slot < 0; i++)
+            if (site->busyUntil[i] <= now)
+                slot = i;
+        if (slot < 0)
+        {
+            busy(response, site);
+            return;
+        }
+        site->busyUntil[slot] = now + SERVICE_MS;
+        response->delayMs = SERVICE_MS;
+    }
+    site->served[page] = 1;
+    siteGraphHandler(method, path, headers, response, &site->graph);
+}
+
+// Dead host: accept every connection and reset it at once, counting them
+typedef struct
+{
+    int fd;
+    int port;
+    atomic_long connections;
+    pthread_t thread;
+} DeadHost;
+
+static void *deadHostLoop(void *arg)
+{
+    DeadHost *host = (DeadHost *)arg;
+    while (1)
+    {
+        int client = accept(host->fd, NULL, NULL);
+        if (client < 0)
+            break;                                  // Shut down
+        struct linger reset = { 1, 0 };             // Close with a RST
+        setsockopt(client, SOL_SOCKET, SO_LINGER, &reset, sizeof(reset));
+        close(client);
+        atomic_fetch_add(&host->connections, 1);
+    }
+    return NULL;
+}
+
+static int deadHostStart(DeadHost *host)
+{
+    struct sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    host->fd = socket(AF_INET, SOCK_STREAM, 0);
+    atomic_init(&host->connections, 0);
+    if (host->fd < 0 || bind(host->fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(host->fd, 1024) != 0 ||
+        getsockname(host->fd, (struct sockaddr *)&addr, &len) != 0)
+        return -1;
+    host->port = ntohs(addr.sin_port);
+    return pthread_create(&host->thread, NULL, deadHostLoop, host) == 0 ? 0 : -1;
+}
+
+static void deadHostStop(DeadHost *host)
+{
+    shutdown(host->fd, SHUT_RDWR);                  // Wakes accept() up
+    pthread_join(host->thread, NULL);
+    close(host->fd);
+}
+
+// Crawl the seeds of 'c' with its settings and fill in its outcome
+static void runCrawl(Crawl *c)
+{
+    visited_urls = visitedCreate(0);
+    UrlTable *urls = urlTableCreate(0);
+    c->scheduler.maxDepth = c->maxDepth;
+    ThreadData data = { .frontier = frontierCreate(c->maxDepth, urls), .scheduler = schedulerCreate(&c->scheduler),
+                        .fetch = &c->fetch };
+    atomic_init(&data.pagesFetched, 0);
+    atomic_init(&data.pagesFailed, 0);
+    for (int i = 0; i < c->seedCount; i++)
+        frontierPush(data.frontier, c->seeds[i], 0);
+
+    // The engine reports every failed attempt on stderr; keep that out of the report
+    fflush(stderr);
+    int saved = dup(STDERR_FILENO);
+    int devnull = open("/dev/null", O_WRONLY);
+    dup2(devnull, STDERR_FILENO);
+
+    double start = nowMsDouble();
+    crawl(&data, c->workers);
+    c->seconds = (nowMsDouble() - start) / 1e3;
+
+    fflush(stderr);
+    dup2(saved, STDERR_FILENO);
+    close(saved);
+    close(devnull);
+
+    c->fetched = atomic_load(&data.pagesFetched);
+    c->failed = atomic_load(&data.pagesFailed);
+    schedulerStats(data.scheduler, &c->stats);
+    c->limit = schedulerLimit(data.scheduler, c->seeds[0]);
+    schedulerDestroy(data.scheduler);
+    frontierDestroy(data.frontier);
+    urlTableDestroy(urls);
+    visitedDestroy(visited_urls);
+}
+
+// Settings of a row: the crawler's defaults, with the adaptive limits on or off
+static void rowDefaults(Crawl *c, int adaptive)
+{
+    memset(c, 0, sizeof(*c));
+    c->workers = 1;
+    fetchConfigDefaults(&c->fetch);
+    schedulerConfigDefaults(&c->scheduler);
+    c->scheduler.adaptive = adaptive;
+}
+
+static HttpServer *startSite(FaultSite *site, int latencyMs, char *seed, size_t size)
+{
+    HttpServerConfig config = { 0, latencyMs, faultHandler, site };
+    HttpServer *server = httpServerStart(&config);
+    if (server != NULL)
+        snprintf(seed, size, "http://127.0.0.1:%d/n/0", httpServerPort(server));
+    return server;
+}
+
+// 1 if the crawl counted as fetched the pages the host answered 200, and as failed those it was asked
+// for but never answered 200, plus 'otherFailed' pages of other hosts
+static int countersMatch(const FaultSite *site, const Crawl *c, long otherFailed)
+{
+    long served = 0, unserved = 0;
+    for (long p = 0; p < site->pages; p++)
+    {
+        served += site->served[p];
+        unserved += site->attempts[p] > 0 && !site->served[p];
+    }
+    return c->fetched == served && c->failed == unserved + otherFailed;
+}
+
+// Flaky host: retry at once against the backoff; returns the number of failed checks
+static int benchFlaky(void)
+{
+    static FaultSite site;
+    int failures = 0;
+    printf("flaky: 73 pages answering 503 for 0, 200 or 600 ms after the first request, 1 worker, limits fixed\n");
+    printf("%-10s %6s %9s %8s %8s %15s %15s %10s %6s\n", "retry", "pages", "recovered", "retries", "seconds",
+           "2nd after ms", "3rd after ms", "waits sum", "check");
+
+    for (int row = 0; row < 2; row++)
+    {
+        memset(&site, 0, sizeof(site));
+        site.graph = (SiteGraph){ 8, 2, 4096, 0, 0 };
+        site.pages = siteGraphPages(&site.graph, site.graph.depth);
+        char seed[128];
+        HttpServer *server = startSite(&site, 5, seed, sizeof(seed));
+        if (server == NULL)
+            return 1;
+
+        Crawl c;
+        rowDefaults(&c, 0);
+        const char *seeds[] = { seed };
+        c.seeds = seeds;
+        c.seedCount = 1;
+        c.maxDepth = site.graph.depth;
+        long base = c.fetch.retryBaseMs;
+        if (row == 0)
+            c.fetch.retryBaseMs = 0;
+        runCrawl(&c);
+        httpServerStop(server);
+
+        long recovered = 0, retries = 0;
+        double min[2] = { 1e9, 1e9 }, max[2] = { 0, 0 }, waits = 0;
+        for (long p = 0; p < site.pages; p++)
+        {
+            recovered += site.served[p];
+            retries += site.attempts[p] > 0 ? site.attempts[p] - 1 : 0;
+            for (int a = 1; a < site.attempts[p] && a < MAX_ATTEMPTS; a++)
+            {
+                double gap = site.times[p][a] - site.times[p][a - 1];
+                min[a - 1] = gap < min[a - 1] ? gap : min[a - 1];
+                max[a - 1] = gap > max[a - 1] ? gap : max[a - 1];
+                waits += gap;
+            }
+        }
+        int ok = countersMatch(&site, &c, 0);
+        if (row == 1)                               // Everything recovered, within the backoff, without blocking
+            ok = ok && c.failed == 0 && recovered == site.pages && min[0] >= base / 2.0 && max[0] <= base + BACKOFF_SLACK_MS &&
+                 min[1] >= base && max[1] <= 2.0 * base + BACKOFF_SLACK_MS && c.seconds * 1e3 < waits / 2;
+        failures += !ok;
+        char gaps[2][32];
+        for (int a = 0; a < 2; a++)
+        {
+            if (max[a] > 0)
+                snprintf(gaps[a], sizeof(gaps[a]), "%.0f..%.0f", min[a], max[a]);
+            else
+                snprintf(gaps[a], sizeof(gaps[a]), "-");
+        }
+        printf("%-10s %6ld %9ld %8ld %8.2f %15s %15s %9.1fs %6s\n", row == 0 ? "at once" : "backoff", site.pages,
+               recovered, retries, c.seconds, gaps[0], gaps[1], waits / 1e3, ok ? "ok" : "FAILED");
+    }
+    return failures;
+}
+
+// Overloaded host: fixed limit against the adaptive one; returns the number of failed checks
+static int benchOverload(int capacity)
+{
+    static FaultSite site;
+    double fixedPerPage = 0;
+    int failures = 0;
+    printf("\noverload: 421 pages, %d requests served at once (%d ms each), beyond that 503, 2 workers, per-host 16, "
+           "%d attempts\n", capacity, SERVICE_MS, OVERLOAD_ATTEMPTS);
+    printf("%-10s %6s %7s %9s %10s %8s %10s %6s %6s %6s\n", "limits", "pages", "failed", "requests", "turned away",
+           "seconds", "pages/sec", "cuts", "limit", "check");
+
+    for (int row = 0; row < 2; row++)
+    {
+        memset(&site, 0, sizeof(site));
+        site.graph = (SiteGraph){ 20, 2, 4096, 0, 0 };
+        site.pages = siteGraphPages(&site.graph, site.graph.depth);
+        site.capacity = capacity;
+        char seed[128];
+        HttpServer *server = startSite(&site, 0, seed, sizeof(seed));
+        if (server == NULL)
+            return 1;
+
+        Crawl c;
+        rowDefaults(&c, row);
+        const char *seeds[] = { seed };
+        c.seeds = seeds;
+        c.seedCount = 1;
+        c.maxDepth = site.graph.depth;
+        c.workers = 2;
+        c.fetch.retries = OVERLOAD_ATTEMPTS;
+        c.scheduler.maxPerHost = 16;
+        runCrawl(&c);
+        httpServerStop(server);
+
+        long served = 0;
+        for (long p = 0; p < site.pages; p++)
+            served += site.served[p];
+        double rejected = site.requests > 0 ? 100.0 * site.rejected / site.requests : 0;
+        double perPage = served > 0 ? (double)site.rejected / served : 0;   // The fixed limit serves fewer pages
+        int ok = countersMatch(&site, &c, 0);
+        if (row == 0)
+            fixedPerPage = perPage;
+        else                                        // Far fewer requests turned away, and every page served
+            ok = ok && served == site.pages && perPage < fixedPerPage / 2;
+        failures += !ok;
+        printf("%-10s %6ld %7ld %9ld %10.1f%% %8.2f %10.1f %6ld %6d %6s\n", row == 0 ? "fixed" : "adaptive",
+               site.pages, site.pages - served, site.requests, rejected, c.seconds, served / c.seconds, c.stats.cuts,
+               c.limit, ok ? "ok" : "FAILED");
+    }
+    return failures;
+}
+
+// Dead host next to a live site: breaker off against on; returns the number of failed checks
+static int benchDead(int deadUrls)
+{
+    static FaultSite site;
+    long fixedConnections = 0;
+    int failures = 0;
+    printf("\ndead: 73 live pages and %d seeds on a host resetting every connection, 2 workers\n", deadUrls);
+    printf("%-10s %6s %7s %8s %11s %6s %9s %6s\n", "breaker", "live", "failed", "seconds", "connections", "trips",
+           "given up", "check");
+
+    char **seeds = malloc(sizeof(char *) * (size_t)(deadUrls + 1));
+    if (seeds == NULL)
+        return 1;
+    for (int row = 0; row < 2; row++)
+    {
+        memset(&site, 0, sizeof(site));
+        site.graph = (SiteGraph){ 8, 2, 4096, 0, 0 };
+        site.pages = siteGraphPages(&site.graph, site.graph.depth);
+        DeadHost dead;
+        char seed[128];
+        HttpServer *server = startSite(&site, 5, seed, sizeof(seed));
+        if (server == NULL || deadHostStart(&dead) != 0)
+            return 1;
+        seeds[0] = seed;
+        for (int i = 0; i < deadUrls; i++)
+        {
+            seeds[i + 1] = malloc(64);
+            if (seeds[i + 1] == NULL)
+                return 1;
+            snprintf(seeds[i + 1], 64, "http://127.0.0.1:%d/n/%d", dead.port, i);
+        }
+
+        Crawl c;
+        rowDefaults(&c, row);
+        c.seeds = (const char **)seeds;
+        c.seedCount = deadUrls + 1;
+        c.maxDepth = site.graph.depth;
+        c.workers = 2;
+        runCrawl(&c);
+        httpServerStop(server);
+        deadHostStop(&dead);
+        for (int i = 0; i < deadUrls; i++)
+            free(seeds[i + 1]);
+
+        long live = 0;
+        for (long p = 0; p < site.pages; p++)
+            live += site.served[p];
+        long connections = atomic_load(&dead.connections);
+        int ok = live == site.pages && countersMatch(&site, &c, deadUrls);
+        if (row == 0)
+            fixedConnections = connections;
+        else                                        // The breaker spared the dead host most of the connections
+            ok = ok && connections < fixedConnections / 4;
+        failures += !ok;
+        printf("%-10s %6ld %7ld %8.2f %11ld %6ld %9ld %6s\n", row == 0 ? "off" : "on", live, c.failed, c.seconds,
+               connections, c.stats.trips, c.stats.urlsGivenUp, ok ? "ok" : "FAILED");
+    }
+    free(seeds);
+    return failures;
+}
+
+int main(int argc, char *argv[])
+{
+    int capacity = 4;
+    int deadUrls = 200;
+    if (argc > 1)
+        capacity = atoi(argv[1]);
+    if (argc > 2)
+        deadUrls = atoi(argv[2]);
+    if (capacity < 1 || capacity > MAX_CAPACITY || deadUrls < 1)
+    {
+        fprintf(stderr, "Usage: %s [capacity] [deadUrls]\n", argv[0]);
+        return 2;
+    }
+
+    struct rlimit rl;
+    getrlimit(RLIMIT_NOFILE, &rl);
+    rl.rlim_cur = rl.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &rl);
+
+    // The crawler writes crawler.log into the working directory
+    char dir[] = "/tmp/bench_faults.XXXXXX";
+    if (mkdtemp(dir) == NULL || chdir(dir) != 0)
+        return 1;
+    LogConfig logConfig;
+    logConfigDefaults(&logConfig);
+    logConfig.truncate = 1;
+    if (logOpen(&logConfig) != 0)
+        return 1;
+    curl_global_init(CURL_GLOBAL_ALL);
+
+    int failures = benchFlaky();
+    failures += benchOverload(capacity);
+    failures += benchDead(deadUrls);
+
+    curl_global_cleanup();
+    logClose();
+    unlink("crawler.log");
+    if (chdir("/") == 0)
+        rmdir(dir);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,197 @@
+/*
+Operating Systems Spring 2024
+Final Project
+
+Benchmark: pages/sec of the blocking GetRequest path against the curl multi fetch engine.
+
+A local stand-in server answers every request after a fixed latency, standing in for the
+round trip to a real site. The blocking path can only have one transfer per thread in flight,
+the fetch engine keeps up to 'maxInFlight' transfers per thread in flight.
+
+Usage: bench_fetch [latencyMs] [pageSize]
+*/
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/resource.h>
+#include <curl/curl.h>
+
+#include "fetch.h"
+#include "httpserver.h"
+
+// Settings and shared counters of one benchmark run
+typedef struct
+{
+    int port;
+    int pages;                  // Pages to fetch in total
+    int maxInFlight;            // Transfers per thread (fetch engine only)
+    atomic_int next;            // Next page index to hand out
+    atomic_int done;            // Pages finished
+    atomic_ulong bytes;         // Body bytes received
+    atomic_int failed;          // Failed transfers
+} Run;
+
+static size_t pageSize = 16 * 1024;
+
+// Every path gets a page of 'pageSize' bytes
+static void pageHandler(const char *method, const char *path, const char *headers,
+                        HttpResponse *response, void *userdata)
+{
+    (void)method; (void)path; (void)headers; (void)userdata;
+    response->body = malloc(pageSize);
+    memset(response->body, 'x', pageSize);
+    response->size = pageSize;
+}
+
+static double nowSeconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void pageUrl(char *buf, size_t len, int port, int page)
+{
+    snprintf(buf, len, "http://127.0.0.1:%d/p/%d", port, page);
+}
+
+// Blocking path: one easy handle per thread, one transfer at a time
+static void *blockingThread(void *arg)
+{
+    Run *run = (Run *)arg;
+    CURL *curl_handle = curl_easy_init();
+    char url[128];
+    int page;
+
+    while ((page = atomic_fetch_add(&run->next, 1)) < run->pages)
+    {
+        pageUrl(url, sizeof(url), run->port, page);
+        struct CURLResponse response = GetRequest(curl_handle, url);
+        if (response.html)
+            atomic_fetch_add(&run->bytes, response.size);
+        else
+            atomic_fetch_add(&run->failed, 1);
+        free(response.html);
+        atomic_fetch_add(&run->done, 1);
+    }
+    curl_easy_cleanup(curl_handle);
+    return NULL;
+}
+
+static void engineDone(FetchEngine *engine, const char *url, struct CURLResponse *response,
+                       CURLcode result, long status, void *userdata)
+{
+    Run *run = (Run *)fetchEngineContext(engine);
+    (void)url; (void)result; (void)status; (void)userdata;
+    if (response->html)
+        atomic_fetch_add(&run->bytes, response->size);
+    else
+        atomic_fetch_add(&run->failed, 1);
+    atomic_fetch_add(&run->done, 1);
+}
+
+// Fetch engine path: one event loop per thread
+static void *engineThread(void *arg)
+{
+    Run *run = (Run *)arg;
+    FetchConfig config;
+    fetchConfigDefaults(&config);
+    config.maxInFlight = run->maxInFlight;
+    config.maxHostConnections = 0;      // Every URL goes to the same local host
+    config.onDone = engineDone;
+    config.context = run;
+
+    FetchEngine *engine = fetchEngineCreate(&config);
+    char url[128];
+    int exhausted = 0;
+
+    while (!exhausted || fetchEngineInFlight(engine) > 0)
+    {
+        while (!exhausted && fetchEngineHasCapacity(engine))
+        {
+            int page = atomic_fetch_add(&run->next, 1);
+            if (page >= run->pages)
+            {
+                exhausted = 1;
+                break;
+            }
+            pageUrl(url, sizeof(url), run->port, page);
+            fetchEngineSubmit(engine, url, NULL);
+        }
+        fetchEngineRun(engine, 50);
+    }
+    fetchEngineDestroy(engine);
+    return NULL;
+}
+
+static void report(const char *path, int threads, int inFlight, Run *run, double seconds)
+{
+    printf("%-12s %7d %9d %7d %12.1f %10.1f %6d\n", path, threads, inFlight, run->pages,
+           run->pages / seconds, atomic_load(&run->bytes) / seconds / (1024 * 1024),
+           atomic_load(&run->failed));
+    fflush(stdout);
+}
+
+static void runBench(int port, int threads, int inFlight, int blocking, int pages)
+{
+    Run run;
+    memset(&run, 0, sizeof(run));
+    run.port = port;
+    run.pages = pages;
+    run.maxInFlight = inFlight;
+
+    pthread_t tids[64];
+    double start = nowSeconds();
+    for (int i = 0; i < threads; i++)
+        pthread_create(&tids[i], NULL, blocking ? blockingThread : engineThread, &run);
+    for (int i = 0; i < threads; i++)
+        pthread_join(tids[i], NULL);
+    report(blocking ? "GetRequest" : "FetchEngine", threads, blocking ? 1 : inFlight, &run, nowSeconds() - start);
+}
+
+int main(int argc, char *argv[])
+{
+    int latencyMs = argc > 1 ? atoi(argv[1]) : 20;
+    if (argc > 2)
+        pageSize = (size_t)atol(argv[2]);
+
+    // Thousands of sockets on both ends of the loopback
+    struct rlimit rl;
+    getrlimit(RLIMIT_NOFILE, &rl);
+    rl.rlim_cur = rl.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &rl);
+
+    curl_global_init(CURL_GLOBAL_ALL);
+
+    HttpServerConfig serverConfig = { 0, latencyMs, pageHandler, NULL };
+    HttpServer *server = httpServerStart(&serverConfig);
+    if (server == NULL)
+        return 1;
+    int port = httpServerPort(server);
+
+    printf("stand-in server: 127.0.0.1:%d, latency %d ms, page %zu bytes\n\n", port, latencyMs, pageSize);
+    printf("%-12s %7s %9s %7s %12s %10s %6s\n", "path", "threads", "in-flight", "pages", "pages/sec", "MB/sec", "failed");
+
+    // Current crawler: GetRequest, one transfer at a time per thread
+    runBench(port, 1, 1, 1, 100);
+    runBench(port, 2, 1, 1, 200);
+    runBench(port, 8, 1, 1, 800);
+
+    // Fetch engine: few threads, many transfers
+    int inFlight[] = { 1, 16, 64, 256, 1024 };
+    for (size_t i = 0; i < sizeof(inFlight) / sizeof(inFlight[0]); i++)
+    {
+        int pages = inFlight[i] * 20 < 100 ? 100 : inFlight[i] * 20;
+        runBench(port, 1, inFlight[i], 0, pages > 20000 ? 20000 : pages);
+    }
+    runBench(port, 2, 512, 0, 20000);
+
+    httpServerStop(server);
+    curl_global_cleanup();
+    return 0;
+}
@@ -0,0 +1,165 @@
+/*
+Operating Systems Spring 2024
+Final Project
+
+Benchmark: frontier throughput under contention, 1 to 64 threads.
+
+Every thread alternates a push and a pop on one shared queue. The lock-free frontier is
+compared with a queue behind one global mutex that strdup()s every entry, which is how the
+crawler's old Queue worked (minus its 1024-entry limit).
+
+Usage: bench_frontier [operations]
+*/
+
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "frontier.h"
+
+#define URL_VARIANTS 256
+
+// Mutex-protected growable ring of strdup()'d URLs
+typedef struct
+{
+    pthread_mutex_t mutex;
+    char **urls;
+    long head, count, cap;
+} LockedQueue;
+
+typedef struct
+{
+    Frontier *frontier;     // Queue under test (NULL for the locked queue)
+    LockedQueue *locked;
+    long ops;               // Push/pop pairs per thread
+    atomic_long pushed, popped;
+} Run;
+
+static char urls[URL_VARIANTS][96];
+
+static double nowSeconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void lockedPush(LockedQueue *q, const char *url)
+{
+    char *copy = strdup(url);
+    pthread_mutex_lock(&q->mutex);
+    if (q->count == q->cap)
+    {
+        long cap = q->cap ? q->cap * 2 : 1024;
+        char **grown = malloc(sizeof(char *) * cap);
+        for (long i = 0; i < q->count; i++)
+            grown[i] = q->urls[(q->head + i) % q->cap];
+        free(q->urls);
+        q->urls = grown;
+        q->head = 0;
+        q->cap = cap;
+    }
+    q->urls[(q->head + q->count++) % q->cap] = copy;
+    pthread_mutex_unlock(&q->mutex);
+}
+
+static int lockedPop(LockedQueue *q, char *url, size_t size)
+{
+    pthread_mutex_lock(&q->mutex);
+    if (q->count == 0)
+    {
+        pthread_mutex_unlock(&q->mutex);
+        return 0;
+    }
+    char *entry = q->urls[q->head];
+    q->head = (q->head + 1) % q->cap;
+    q->count--;
+    pthread_mutex_unlock(&q->mutex);
+    snprintf(url, size, "%s", entry);
+    free(entry);
+    return 1;
+}
+
+static void *benchThread(void *arg)
+{
+    Run *run = (Run *)arg;
+    char url[FRONTIER_MAX_URL];
+    int depth;
+    long pushed = 0, popped = 0;
+
+    for (long i = 0; i < run->ops; i++)
+    {
+        const char *next = urls[i % URL_VARIANTS];
+        if (run->frontier)
+        {
+            pushed += frontierPush(run->frontier, next, 0) == 0;
+            popped += frontierPop(run->frontier, url, sizeof(url), &depth);
+        }
+        else
+        {
+            lockedPush(run->locked, next);
+            pushed++;
+            popped += lockedPop(run->locked, url, sizeof(url));
+        }
+    }
+    atomic_fetch_add(&run->pushed, pushed);
+    atomic_fetch_add(&run->popped, popped);
+    return NULL;
+}
+
+static double runBench(int threads, long totalOps, int lockFree, long *lost)
+{
+    Run run;
+    memset(&run, 0, sizeof(run));
+    LockedQueue locked;
+    memset(&locked, 0, sizeof(locked));
+    pthread_mutex_init(&locked.mutex, NULL);
+    run.ops = totalOps / threads;
+    if (lockFree)
+        run.frontier = frontierCreate(0, NULL);   // Single level: measure the queue itself
+    else
+        run.locked = &locked;
+
+    pthread_t tids[64];
+    double start = nowSeconds();
+    for (int i = 0; i < threads; i++)
+        pthread_create(&tids[i], NULL, benchThread, &run);
+    for (int i = 0; i < threads; i++)
+        pthread_join(tids[i], NULL);
+    double seconds = nowSeconds() - start;
+
+    // Every pushed URL must come out again
+    char url[FRONTIER_MAX_URL];
+    int depth;
+    long drained = 0;
+    while (lockFree ? frontierPop(run.frontier, url, sizeof(url), &depth) : lockedPop(&locked, url, sizeof(url)))
+        drained++;
+    *lost = atomic_load(&run.pushed) - atomic_load(&run.popped) - drained;
+
+    frontierDestroy(run.frontier);
+    free(locked.urls);
+    pthread_mutex_destroy(&locked.mutex);
+    return 2.0 * run.ops * threads / seconds / 1e6;
+}
+
+int main(int argc, char *argv[])
+{
+    long totalOps = argc > 1 ? atol(argv[1]) : 4000000;
+    for (int i = 0; i < URL_VARIANTS; i++)
+        snprintf(urls[i], sizeof(urls[i]), "https://www.example%d.com/section/%d/page-%d.html", i % 17, i, i * 7);
+
+    printf("%ld push/pop pairs per run\n\n", totalOps);
+    printf("%7s %16s %16s %8s\n", "threads", "lock-free Mops/s", "mutex Mops/s", "lost");
+    for (int threads = 1; threads <= 64; threads *= 2)
+    {
+        long lostFree = 0, lostLocked = 0;
+        double lockFree = runBench(threads, totalOps, 1, &lostFree);
+        double mutex = runBench(threads, totalOps, 0, &lostLocked);
+        printf("%7d %16.2f %16.2f %8ld\n", threads, lockFree, mutex, lostFree + lostLocked);
+        fflush(stdout);
+    }
+    return 0;
+}
@@ -0,0 +1,404 @@
+/*
+Operating Systems Spring 2024
+Final Project
+
+Benchmark: cost and recovery of the crawl journal.
+
+  overhead  pages/sec of a crawl of a synthetic site graph (see sitegraph.h) without a journal and
+            with each sync policy, the median of three runs each, with the bytes and fdatasync()
+            calls of the log.
+  crash     a crawler process is killed with SIGKILL once the server has answered half of the
+            pages; a new crawl resumes from its journal. The check: every page was served. Pages
+            served twice are those the killed crawl had in flight or had not written to the log
+            yet (its last 'flushMs' of records).
+  resume    a journal of 'pending' queued URLs (plus a quarter as many finished ones) is loaded
+            into a fresh visited set and frontier, once from the log segments and once from the
+            snapshot journalCompact() makes of them.
+
+The stand-in server runs in a child process and counts the requests for each page in shared
+memory.
+
+Usage: bench_journal [pending]
+*/
+
+#include <fcntl.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <curl/curl.h>
+
+#include "crawler.h"
+#include "httpserver.h"
+#include "sitegraph.h"
+
+// Runs per configuration of the overhead table
+#define ROUNDS 3
+
+// Site graph and the requests the server answered for each of its pages
+typedef struct
+{
+    SiteGraph graph;
+    atomic_int *served;         // Shared with the server process
+} CountingGraph;
+
+static double nowSeconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void countingHandler(const char *method, const char *path, const char *headers,
+                            HttpResponse *response, void *userdata)
+{
+    CountingGraph *counting = (CountingGraph *)userdata;
+    long page;
+    if (sscanf(path, "/n/%ld", &page) == 1 && siteGraphDepthOf(&counting->graph, page) >= 0)
+        atomic_fetch_add(&counting->served[page], 1);
+    siteGraphHandler(method, path, headers, response, &counting->graph);
+}
+
+// Run the stand-in server in a child process until 'stopFd' is closed; return its port
+static int startServer(CountingGraph *counting, int latencyMs, int *stopFd, pid_t *child)
+{
+    int portPipe[2], stopPipe[2];
+    if (pipe(portPipe) != 0 || pipe(stopPipe) != 0)
+        return -1;
+
+    *child = fork();
+    if (*child == 0)
+    {
+        close(portPipe[0]);
+        close(stopPipe[1]);
+        HttpServerConfig serverConfig = { 0, latencyMs, countingHandler, counting };
+        HttpServer *server = httpServerStart(&serverConfig);
+        int port = server ? httpServerPort(server) : -1;
+        if (write(portPipe[1], &port, sizeof(port)) != sizeof(port) || server == NULL)
+            _exit(1);
+        char byte;
+        while (read(stopPipe[0], &byte, 1) > 0)
+            ;
+        httpServerStop(server);
+        _exit(0);
+    }
+
+    close(portPipe[1]);
+    close(stopPipe[0]);
+    int port = -1;
+    if (*child < 0 || read(portPipe[0], &port, sizeof(port)) != sizeof(port))
+        port = -1;
+    close(portPipe[0]);
+    *stopFd = stopPipe[1];
+    return port;
+}
+
+static long servedTotal(const CountingGraph *counting, long pages)
+{
+    long total = 0;
+    for (long i = 0; i < pages; i++)
+        total += atomic_load(&counting->served[i]);
+    return total;
+}
+
+static void resetServed(CountingGraph *counting, long pages)
+{
+    for (long i = 0; i < pages; i++)
+        atomic_store(&counting->served[i], 0);
+}
+
+/*
+    Crawl the graph from its root, with a journal opened with 'journalConfig' (NULL for none). With
+    'resume' the crawl starts from the journal's state instead. Returns the pages fetched.
+*/
+static long runCrawl(int port, int depth, const JournalConfig *journalConfig, int resume, double *seconds,
+                     JournalStats *stats, double *loadSeconds, long *pending)
+{
+    char seed[128];
+    snprintf(seed, sizeof(seed), "http://127.0.0.1:%d/n/0", port);
+
+    visited_urls = visitedCreate(0);
+    SchedulerConfig schedulerConfig;
+    schedulerConfigDefaults(&schedulerConfig);
+    schedulerConfig.maxDepth = depth;
+    ThreadData data = { .frontier = frontierCreate(depth, NULL), .scheduler = schedulerCreate(&schedulerConfig), .links = stdout };
+    atomic_init(&data.pagesFetched, 0);
+    atomic_init(&data.pagesFailed, 0);
+
+    if (journalConfig != NULL)
+    {
+        data.journal = journalOpen(journalConfig);
+        if (data.journal == NULL)
+            return -1;
+        if (!resume)
+            journalReset(data.journal);
+    }
+    if (resume)
+    {
+        long done;
+        double start = nowSeconds();
+        journalLoad(data.journal, visited_urls, data.frontier, &done, pending);
+        *loadSeconds = nowSeconds() - start;
+    }
+    else
+    {
+        frontierPush(data.frontier, seed, 0);
+        journalQueued(data.journal, seed, 0);
+    }
+
+    // The crawler prints every link it finds; keep that out of the report
+    fflush(stdout);
+    int saved = dup(STDOUT_FILENO);
+    int devnull = open("/dev/null", O_WRONLY);
+    dup2(devnull, STDOUT_FILENO);
+
+    double start = nowSeconds();
+    crawl(&data, 2);
+    if (stats != NULL && data.journal != NULL)
+        journalStats(data.journal, stats);          // Taken before the last batch is written
+    journalClose(data.journal);                     // Timed: a crawl is over once its state is written
+    *seconds = nowSeconds() - start;
+
+    fflush(stdout);
+    dup2(saved, STDOUT_FILENO);
+    close(saved);
+    close(devnull);
+
+    schedulerDestroy(data.scheduler);
+    frontierDestroy(data.frontier);
+    visitedDestroy(visited_urls);
+    return atomic_load(&data.pagesFetched);
+}
+
+// Crawl in a child process and kill it once the server has answered 'killAt' requests
+static int crashCrawl(int port, int depth, const JournalConfig *journalConfig, CountingGraph *counting,
+                      long pages, long killAt)
+{
+    fflush(stdout);
+    pid_t child = fork();
+    if (child == 0)
+    {
+        LogConfig logConfig;
+        logConfigDefaults(&logConfig);
+        logConfig.truncate = 1;
+        logOpen(&logConfig);
+        curl_global_init(CURL_GLOBAL_ALL);
+        double seconds;
+        runCrawl(port, depth, journalConfig, 0, &seconds, NULL, NULL, NULL);
+        _exit(0);                                   // Finished before it was killed
+    }
+    if (child < 0)
+        return -1;
+    while (servedTotal(counting, pages) < killAt && waitpid(child, NULL, WNOHANG) == 0)
+        usleep(200);
+    kill(child, SIGKILL);
+    waitpid(child, NULL, 0);
+    return 0;
+}
+
+static int compareDoubles(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+// Log 'pending' queued URLs and 'done' finished ones, then load them back from the log and from a snapshot
+static int runResume(long pending, long done)
+{
+    JournalConfig config;
+    journalConfigDefaults(&config);
+    config.dir = "resume";
+    config.autoCompact = 0;
+    Journal *journal = journalOpen(&config);
+    if (journal == NULL)
+        return 1;
+    journalReset(journal);
+
+    char url[128];
+    double start = nowSeconds();
+    for (long i = 0; i < pending + done; i++)
+    {
+        snprintf(url, sizeof(url), "https://host%ld.example.com/articles/%ld/page.html", i % 1000, i);
+        journalQueued(journal, url, (int)(i % 4));
+        if (i < done)
+            journalDone(journal, url);
+    }
+    journalClose(journal);
+    double writeSeconds = nowSeconds() - start;
+    printf("logged %ld queued and %ld finished URLs in %.2f s\n\n", pending + done, done, writeSeconds);
+    printf("%-14s %10s %10s %10s %12s %10s %6s\n", "resume from", "done", "pending", "seconds", "URLs/sec", "MB", "check");
+
+    int failures = 0;
+    for (int fromSnapshot = 0; fromSnapshot <= 1; fromSnapshot++)
+    {
+        journal = journalOpen(&config);
+        if (journal == NULL)
+            return 1;
+        double compactSeconds = 0;
+        if (fromSnapshot)
+        {
+            start = nowSeconds();
+            journalCompact(journal);
+            compactSeconds = nowSeconds() - start;
+            journalClose(journal);
+            journal = journalOpen(&config);
+        }
+
+        // Size of the state on disk
+        long bytes = 0;
+        char cmd[64];
+        snprintf(cmd, sizeof(cmd), "du -sk %s", config.dir);
+        FILE *du = popen(cmd, "r");
+        if (du != NULL)
+        {
+            if (fscanf(du, "%ld", &bytes) != 1)
+                bytes = 0;
+            pclose(du);
+        }
+
+        VisitedSet *visited = visitedCreate(0);
+        Frontier *frontier = frontierCreate(3, NULL);
+        long loadedDone, loadedPending;
+        start = nowSeconds();
+        int result = journalLoad(journal, visited, frontier, &loadedDone, &loadedPending);
+        double seconds = nowSeconds() - start;
+        int ok = result == 0 && loadedDone == done && loadedPending == pending &&
+                 frontierSize(frontier) == pending;
+        failures += !ok;
+        printf("%-14s %10ld %10ld %10.2f %12.0f %10.1f %6s\n", fromSnapshot ? "snapshot" : "log segments",
+               loadedDone, loadedPending, seconds, (loadedDone + loadedPending) / seconds, bytes / 1024.0,
+               ok ? "ok" : "FAIL");
+        if (fromSnapshot)
+            printf("(the snapshot took %.2f s to write)\n", compactSeconds);
+        fflush(stdout);
+        frontierDestroy(frontier);
+        visitedDestroy(visited);
+        if (fromSnapshot)
+            journalReset(journal);
+        journalClose(journal);
+    }
+    rmdir(config.dir);
+    return failures;
+}
+
+int main(int argc, char *argv[])
+{
+    long pending = argc > 1 ? atol(argv[1]) : 2000000;
+
+    struct rlimit rl;
+    getrlimit(RLIMIT_NOFILE, &rl);
+    rl.rlim_cur = rl.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &rl);
+
+    // The crawler writes crawler.log and the journal into the working directory
+    char dir[] = "/tmp/bench_journal.XXXXXX";
+    if (mkdtemp(dir) == NULL || chdir(dir) != 0)
+        return 1;
+
+    CountingGraph counting = { { 8, 4, 4096 }, NULL };
+    long pages = siteGraphPages(&counting.graph, counting.graph.depth);
+    counting.served = mmap(NULL, sizeof(atomic_int) * (size_t)pages, PROT_READ | PROT_WRITE,
+                           MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (counting.served == MAP_FAILED)
+        return 1;
+    int stopFd;
+    pid_t server;
+    int port = startServer(&counting, 2, &stopFd, &server);
+    if (port < 0)
+        return 1;
+
+    JournalConfig journalConfig;
+    journalConfigDefaults(&journalConfig);
+    journalConfig.dir = "state";
+    int failures = 0;
+
+    // Crash and resume first: the crawler process is forked before this one starts any thread
+    printf("crash: site graph fanout %d, depth %d (%ld pages), latency 2 ms, killed after %ld pages\n\n",
+           counting.graph.fanout, counting.graph.depth, pages, pages / 2);
+    if (crashCrawl(port, counting.graph.depth, &journalConfig, &counting, pages, pages / 2) != 0)
+        return 1;
+    long beforeCrash = servedTotal(&counting, pages);
+
+    LogConfig logConfig;
+    logConfigDefaults(&logConfig);
+    logConfig.truncate = 1;
+    if (logOpen(&logConfig) != 0)
+        return 1;
+    curl_global_init(CURL_GLOBAL_ALL);
+
+    double seconds, loadSeconds = 0;
+    long resumedPending = 0;
+    long resumed = runCrawl(port, counting.graph.depth, &journalConfig, 1, &seconds, NULL, &loadSeconds,
+                            &resumedPending);
+    long missing = 0, twice = 0;
+    for (long i = 0; i < pages; i++)
+    {
+        missing += atomic_load(&counting.served[i]) == 0;
+        twice += atomic_load(&counting.served[i]) > 1;
+    }
+    int crashOk = resumed > 0 && missing == 0;
+    printf("%-34s %ld\n", "pages served before the kill", beforeCrash);
+    printf("%-34s %ld URLs in %.3f s\n", "state loaded on resume", resumedPending, loadSeconds);
+    printf("%-34s %ld in %.2f s\n", "pages fetched by the resumed crawl", resumed, seconds);
+    printf("%-34s %ld\n", "pages never served", missing);
+    printf("%-34s %ld\n", "pages served twice", twice);
+    printf("%-34s %s\n\n", "check", crashOk ? "ok" : "FAIL");
+    failures += !crashOk;
+
+    // Overhead of each sync policy
+    printf("overhead: site graph fanout %d, depth %d (%ld pages), latency 2 ms, median of %d runs\n\n",
+           counting.graph.fanout, counting.graph.depth, pages, ROUNDS);
+    printf("%-16s %10s %10s %10s %8s\n", "journal", "pages/sec", "overhead", "log KB", "syncs");
+    const char *names[] = { "none", "sync none", "sync 1 s", "sync batch" };
+    double rates[4][ROUNDS];
+    JournalStats stats[4];
+    memset(stats, 0, sizeof(stats));
+    for (int round = 0; round < ROUNDS; round++)
+    {
+        for (int mode = 0; mode < 4; mode++)
+        {
+            JournalConfig config = journalConfig;
+            config.sync = mode == 1 ? JOURNAL_SYNC_NONE : mode == 2 ? JOURNAL_SYNC_INTERVAL : JOURNAL_SYNC_BATCH;
+            resetServed(&counting, pages);
+            long fetched = runCrawl(port, counting.graph.depth, mode ? &config : NULL, 0, &seconds, &stats[mode],
+                                    NULL, NULL);
+            rates[mode][round] = fetched / seconds;
+            failures += fetched != pages;
+        }
+    }
+    double base = 0;
+    for (int mode = 0; mode < 4; mode++)
+    {
+        qsort(rates[mode], ROUNDS, sizeof(double), compareDoubles);
+        double rate = rates[mode][ROUNDS / 2];
+        if (mode == 0)
+            base = rate;
+        printf("%-16s %10.1f %9.1f%% %10.1f %8ld\n", names[mode], rate, (base - rate) / base * 100,
+               stats[mode].bytes / 1024.0, stats[mode].syncs);
+    }
+    fflush(stdout);
+
+    // Resume time at scale
+    printf("\nresume: %ld pending URLs\n", pending);
+    failures += runResume(pending, pending / 4);
+
+    close(stopFd);
+    waitpid(server, NULL, 0);
+    curl_global_cleanup();
+    logClose();
+    unlink("crawler.log");
+    if (chdir("/") == 0)
+    {
+        char cmd[64];
+        snprintf(cmd, sizeof(cmd), "rm -rf %s", dir);
+        if (system(cmd) != 0)
+            fprintf(stderr, "could not remove %s\n", dir);
+    }
+    return failures ? 1 : 0;
+}
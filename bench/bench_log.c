@@ -0,0 +1,216 @@
+/*
+Operating Systems Spring 2024
+Final Project
+
+Benchmark: cost of a log call on a worker thread, the logger against the old logEvent.
+
+The old logEvent opened the log file twice, formatted the time and closed the file for every
+event. The logger copies the event into a per-thread ring and leaves the file to its writer
+thread. Each run logs the three events a page produces from 1 to 4 threads as fast as they can,
+which is far more than a crawl does, so the rings can fill up and drop records. The paced run
+logs a page every 20 us per thread, still faster than the crawler fetches pages, and should not
+drop any; only the calls are timed, not the pauses. The check at the end of every run: records
+written plus records dropped is the number of calls, and a binary log holds exactly the records
+written.
+
+Usage: bench_log [callsPerThread]
+*/
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "logger.h"
+
+#define URL "https://www.example.com/articles/2024/04/25/some-article-title?ref=frontpage"
+
+static double nowSeconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// The logEvent the crawler used before the logger, kept here as the baseline
+static void logEventOld(const char *event, const char *url, const char *status, int depth)
+{
+    FILE *logFile = fopen("crawler.log", "r");
+    if (logFile == NULL || depth == -2)
+    {
+        logFile = fopen("crawler.log", "w");
+    }
+    else
+    {
+        fclose(logFile);
+        logFile = fopen("crawler.log", "a");
+    }
+    if (logFile == NULL)
+        return;
+
+    time_t currentTime = time(NULL);
+    struct tm *localTime = localtime(&currentTime);
+    char timeString[20];
+    strftime(timeString, sizeof(timeString), "%Y-%m-%d %H:%M:%S", localTime);
+    fprintf(logFile, "[%s] %s: %s\n", timeString, event, url);
+    if (status != NULL)
+        fprintf(logFile, "\tStatus: %s\n", status);
+    if (depth >= 0)
+        fprintf(logFile, "\tDepth: %d\n", depth);
+    fclose(logFile);
+}
+
+typedef struct
+{
+    long calls;         // Calls per thread
+    int old;            // 1 for logEventOld
+    long paceUs;        // Pause after the events of each page, 0 for none
+    LogLevel level;     // Level of the events
+    double seconds;     // Time this thread spent logging
+} Job;
+
+static void *logThread(void *arg)
+{
+    Job *job = (Job *)arg;
+    double start = nowSeconds();
+    job->seconds = 0;
+    for (long i = 0; i < job->calls; i += 3)
+    {
+        int depth = (int)(i & 7);
+        if (job->paceUs > 0)
+            start = nowSeconds();
+        if (job->old)
+        {
+            logEventOld("Processing URL", URL, NULL, depth);
+            logEventOld("HTML content retrieved", URL, NULL, depth);
+            logEventOld("Finished processing URL", URL, NULL, depth);
+        }
+        else
+        {
+            logEvent(job->level, "Processing URL", URL, NULL, depth);
+            logEvent(job->level, "HTML content retrieved", URL, NULL, depth);
+            logEvent(job->level, "Finished processing URL", URL, NULL, depth);
+        }
+        if (job->paceUs > 0)
+        {
+            job->seconds += nowSeconds() - start;
+            struct timespec pause = { 0, job->paceUs * 1000 };
+            nanosleep(&pause, NULL);
+        }
+    }
+    if (job->paceUs == 0)
+        job->seconds = nowSeconds() - start;
+    return NULL;
+}
+
+// Log 'calls' events from each of 'threads' threads; returns the mean ns per call
+static double runThreads(int threads, long calls, int old, long paceUs, LogLevel level, double *wall)
+{
+    pthread_t tids[16];
+    Job jobs[16];
+    double start = nowSeconds();
+    for (int i = 0; i < threads; i++)
+    {
+        jobs[i] = (Job){ calls, old, paceUs, level, 0 };
+        pthread_create(&tids[i], NULL, logThread, &jobs[i]);
+    }
+    double busy = 0;
+    for (int i = 0; i < threads; i++)
+    {
+        pthread_join(tids[i], NULL);
+        busy += jobs[i].seconds;
+    }
+    *wall = nowSeconds() - start;
+    return busy / ((double)threads * (double)(calls / 3 * 3)) * 1e9;
+}
+
+// Count the records of a binary log, -1 if it is malformed
+static long countBinaryRecords(const char *path)
+{
+    FILE *in = fopen(path, "rb");
+    if (in == NULL)
+        return -1;
+    char magic[8];
+    long count = 0;
+    if (fread(magic, 1, 8, in) != 8 || memcmp(magic, LOG_BINARY_MAGIC, 8) != 0)
+        count = -1;
+    unsigned char header[20];
+    while (count >= 0 && fread(header, 1, sizeof(header), in) == sizeof(header))
+    {
+        long skip = (header[14] | header[15] << 8) + (header[16] | header[17] << 8) + (header[18] | header[19] << 8);
+        if (header[12] > LOG_DEBUG || fseek(in, skip, SEEK_CUR) != 0)
+            count = -1;
+        else
+            count++;
+    }
+    fclose(in);
+    return count;
+}
+
+static int runLogger(const char *name, LogFormat format, LogLevel level, int threads, long calls, long paceUs)
+{
+    LogConfig config;
+    logConfigDefaults(&config);
+    config.path = "crawler.log";
+    config.truncate = 1;
+    config.level = LOG_INFO;
+    config.format = format;
+    if (logOpen(&config) != 0)
+        return 1;
+
+    double wall;
+    double ns = runThreads(threads, calls, 0, paceUs, level, &wall);
+    logClose();
+
+    LogStats stats;
+    logStats(&stats);
+    long total = (long)threads * (calls / 3 * 3);
+    long expected = level <= LOG_INFO ? total : 0;
+    int ok = stats.records + stats.dropped == expected;
+    if (format == LOG_FORMAT_BINARY)
+        ok = ok && countBinaryRecords("crawler.log") == stats.records;
+
+    printf("%-16s %7d %10.1f %12ld %10ld %8ld %10.1f %6s\n", name, threads, ns, stats.records, stats.dropped,
+           stats.writes, stats.writes ? stats.bytes / (double)stats.writes / 1024 : 0.0, ok ? "ok" : "FAIL");
+    fflush(stdout);
+    return !ok;
+}
+
+int main(int argc, char *argv[])
+{
+    long calls = argc > 1 ? atol(argv[1]) : 300000;
+
+    char dir[] = "/tmp/bench_log.XXXXXX";
+    if (mkdtemp(dir) == NULL || chdir(dir) != 0)
+        return 1;
+
+    printf("%-16s %7s %10s %12s %10s %8s %10s %6s\n", "logger", "threads", "ns/call", "written", "dropped",
+           "writes", "KB/write", "check");
+
+    // The baseline is slow enough that a few thousand calls tell the story
+    double wall;
+    for (int threads = 1; threads <= 4; threads *= 2)
+    {
+        double ns = runThreads(threads, 3000, 1, 0, LOG_INFO, &wall);
+        printf("%-16s %7d %10.1f %12s %10s %8s %10s %6s\n", "open/close", threads, ns, "-", "-", "-", "-", "-");
+        fflush(stdout);
+    }
+
+    int failures = 0;
+    for (int threads = 1; threads <= 4; threads *= 2)
+        failures += runLogger("ring, text", LOG_FORMAT_TEXT, LOG_INFO, threads, calls, 0);
+    for (int threads = 1; threads <= 4; threads *= 2)
+        failures += runLogger("ring, binary", LOG_FORMAT_BINARY, LOG_INFO, threads, calls, 0);
+    failures += runLogger("ring, paced", LOG_FORMAT_TEXT, LOG_INFO, 4, 30000, 20);
+    failures += runLogger("level filtered", LOG_FORMAT_TEXT, LOG_DEBUG, 4, calls, 0);
+
+    unlink("crawler.log");
+    if (chdir("/") == 0)
+        rmdir(dir);
+    return failures ? 1 : 0;
+}
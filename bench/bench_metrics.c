@@ -0,0 +1,389 @@
+/*
+Operating Systems Spring 2024
+Final Project
+
+Benchmark: cost of the metrics (metrics.c), closed and open.
+
+The first table gives the CPU time of the calls the crawl makes on its hot paths, from 1 to 8
+threads at once: a counter, a histogram value, an uncontended lock taken through metricsLock()
+against a plain pthread_mutex_lock(), and the clock reads around a timed stage. Closed, each call
+should cost about a function call; open, every thread records into a shard of its own, so the cost
+per call should not grow with the number of threads.
+
+The second table crawls a complete tree from the stand-in server (see sitegraph.h) with the metrics
+closed, open with the endpoint, and open with a trace as well, keeping the best of a few runs each.
+While the metrics are open a thread scrapes /metrics every 10 ms, as Prometheus would, only much more
+often. CPU is that of the whole process, server included, per page fetched. Every run must fetch
+every page; with the metrics open, the counters served once the crawl is over must match it and the
+trace must hold a transfer per page.
+
+Usage: bench_metrics [callsPerThread] [latencyMs] [repeats]
+*/
+
+#include <arpa/inet.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <curl/curl.h>
+
+#include "crawler.h"
+#include "httpserver.h"
+#include "sitegraph.h"
+
+// What the threads of the first table call
+typedef enum
+{
+    CALL_COUNT,
+    CALL_RECORD,
+    CALL_MUTEX,
+    CALL_LOCK,
+    CALL_TIMED,
+    CALL_KINDS
+} CallKind;
+
+static const char *CALL_NAMES[CALL_KINDS] = {
+    "metricsCount", "metricsRecord", "pthread_mutex_lock", "metricsLock", "timed stage"
+};
+
+// Work of one calling thread
+typedef struct
+{
+    CallKind kind;
+    long calls;
+    pthread_mutex_t lock;       // Taken by this thread only, so never contended
+    pthread_barrier_t *start;
+    double seconds;             // CPU time the thread took
+} CallThread;
+
+// Outcome of one crawl
+typedef struct
+{
+    long pages;
+    double seconds;
+    double cpu;                 // Seconds of CPU of the whole process
+    long scrapes;               // Scrapes of /metrics answered during the crawl
+    long served;                // crawler_pages_fetched_total served after the crawl, -1 without metrics
+    long traced;                // Transfers in the trace, -1 without a trace
+} RunResult;
+
+static double nowSeconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double cpuSeconds(void)
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+static double threadSeconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void *callThread(void *arg)
+{
+    CallThread *t = (CallThread *)arg;
+    pthread_barrier_wait(t->start);
+    double start = threadSeconds();
+    for (long i = 0; i < t->calls; i++)
+    {
+        switch (t->kind)
+        {
+        case CALL_COUNT:
+            metricsCount(METRIC_LINKS, 1);
+            break;
+        case CALL_RECORD:
+            metricsRecord(METRIC_PARSE, (uint64_t)i * 97);
+            break;
+        case CALL_MUTEX:
+            pthread_mutex_lock(&t->lock);
+            pthread_mutex_unlock(&t->lock);
+            break;
+        case CALL_LOCK:
+            metricsLock(&t->lock, METRIC_LOCK_SCHEDULER);
+            pthread_mutex_unlock(&t->lock);
+            break;
+        default:                                // As pageChunk() times a chunk
+            if (metricsEnabled())
+            {
+                uint64_t begin = metricsNow();
+                metricsRecord(METRIC_PARSE, metricsNow() - begin);
+            }
+            break;
+        }
+    }
+    t->seconds = threadSeconds() - start;
+    return NULL;
+}
+
+// Nanoseconds of CPU per call with 'threads' threads calling at once
+static double timeCalls(CallKind kind, int threads, long calls)
+{
+    CallThread t[8];
+    pthread_t ids[8];
+    pthread_barrier_t start;
+    pthread_barrier_init(&start, NULL, (unsigned)threads);
+    for (int i = 0; i < threads; i++)
+    {
+        t[i] = (CallThread){ .kind = kind, .calls = calls, .start = &start };
+        pthread_mutex_init(&t[i].lock, NULL);
+        pthread_create(&ids[i], NULL, callThread, &t[i]);
+    }
+    double cpu = 0;
+    for (int i = 0; i < threads; i++)
+    {
+        pthread_join(ids[i], NULL);
+        pthread_mutex_destroy(&t[i].lock);
+        cpu += t[i].seconds;
+    }
+    pthread_barrier_destroy(&start);
+    return cpu * 1e9 / ((double)calls * threads);
+}
+
+// GET a path from 127.0.0.1:'port' into 'buf'; returns the bytes read, -1 on error
+static long httpGet(int port, const char *path, char *buf, size_t size)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0)
+        return -1;
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons((uint16_t)port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (connect(fd, (struct sockaddr *)&address, sizeof(address)) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+    char request[256];
+    int len = snprintf(request, sizeof(request), "GET %s HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n", path);
+    if (write(fd, request, (size_t)len) != len)
+    {
+        close(fd);
+        return -1;
+    }
+    size_t got = 0;
+    ssize_t n;
+    while (got < size - 1 && (n = read(fd, buf + got, size - 1 - got)) > 0)
+        got += (size_t)n;
+    buf[got] = '\0';
+    close(fd);
+    return (long)got;
+}
+
+// Value of the metric line starting with 'name ' in a scrape, -1 if absent
+static long scrapedValue(const char *scrape, const char *name)
+{
+    size_t len = strlen(name);
+    for (const char *line = scrape; line != NULL && *line != '\0'; line = strchr(line, '\n'), line += line != NULL)
+        if (strncmp(line, name, len) == 0 && line[len] == ' ')
+            return atol(line + len + 1);
+    return -1;
+}
+
+// Scraper: GET /metrics every 10 ms until told to stop
+typedef struct
+{
+    int port;
+    atomic_int stop;
+    long scrapes;
+} Scraper;
+
+static void *scrapeThread(void *arg)
+{
+    Scraper *s = (Scraper *)arg;
+    static char buf[1 << 20];
+    while (!atomic_load(&s->stop))
+    {
+        if (httpGet(s->port, "/metrics", buf, sizeof(buf)) > 0 && strncmp(buf, "HTTP/1.1 200", 12) == 0)
+            s->scrapes++;
+        struct timespec pause = { 0, 10 * 1000000L };
+        nanosleep(&pause, NULL);
+    }
+    return NULL;
+}
+
+// Transfers in a trace file: the "fetch" begin events
+static long countTraced(const char *path)
+{
+    FILE *file = fopen(path, "r");
+    if (file == NULL)
+        return -1;
+    long count = 0;
+    char *line = NULL;
+    size_t cap = 0;
+    while (getline(&line, &cap, file) > 0)
+        if (strstr(line, "\"name\":\"fetch\"") != NULL && strstr(line, "\"ph\":\"b\"") != NULL)
+            count++;
+    free(line);
+    fclose(file);
+    return count;
+}
+
+// Crawl the whole site, with the metrics closed (mode 0), open (1) or open with a trace (2)
+static void runCrawl(HttpServer *server, const SiteGraph *graph, int mode, RunResult *result)
+{
+    char seed[128];
+    snprintf(seed, sizeof(seed), "http://127.0.0.1:%d/n/0", httpServerPort(server));
+
+    MetricsConfig metricsConfig;
+    metricsConfigDefaults(&metricsConfig);
+    metricsConfig.port = 0;
+    metricsConfig.tracePath = mode == 2 ? "trace.json" : NULL;
+    if (mode > 0 && metricsOpen(&metricsConfig) != 0)
+        mode = -1;
+
+    visited_urls = visitedCreate(0);
+    UrlTable *urls = urlTableCreate(0);
+    SchedulerConfig schedulerConfig;
+    schedulerConfigDefaults(&schedulerConfig);
+    schedulerConfig.maxDepth = graph->depth;
+    schedulerConfig.maxPerHost = 0;
+    ThreadData data = { .frontier = frontierCreate(graph->depth, urls), .scheduler = schedulerCreate(&schedulerConfig) };
+    atomic_init(&data.pagesFetched, 0);
+    atomic_init(&data.pagesFailed, 0);
+    frontierPush(data.frontier, seed, 0);
+
+    Scraper scraper = { .port = metricsPort() };
+    atomic_init(&scraper.stop, 0);
+    pthread_t scraperThread;
+    int scraping = mode > 0 && pthread_create(&scraperThread, NULL, scrapeThread, &scraper) == 0;
+
+    double start = nowSeconds(), cpu = cpuSeconds();
+    crawl(&data, 2);
+    result->seconds = nowSeconds() - start;
+    result->cpu = cpuSeconds() - cpu;
+    result->pages = atomic_load(&data.pagesFetched);
+
+    if (scraping)
+    {
+        atomic_store(&scraper.stop, 1);
+        pthread_join(scraperThread, NULL);
+    }
+    result->scrapes = scraper.scrapes;
+    result->served = result->traced = -1;
+    if (mode > 0)
+    {
+        static char scrape[1 << 20];
+        if (httpGet(metricsPort(), "/metrics", scrape, sizeof(scrape)) > 0)
+            result->served = scrapedValue(scrape, "crawler_pages_fetched_total");
+        metricsClose();
+        if (mode == 2)
+        {
+            result->traced = countTraced("trace.json");
+            unlink("trace.json");
+        }
+    }
+
+    schedulerDestroy(data.scheduler);
+    frontierDestroy(data.frontier);
+    urlTableDestroy(urls);
+    visitedDestroy(visited_urls);
+}
+
+int main(int argc, char *argv[])
+{
+    long calls = 5000000;
+    int latencyMs = 1;
+    int repeats = 3;
+    if (argc > 1)
+        calls = atol(argv[1]);
+    if (argc > 2)
+        latencyMs = atoi(argv[2]);
+    if (argc > 3)
+        repeats = atoi(argv[3]);
+    if (calls < 1 || latencyMs < 0 || repeats < 1)
+    {
+        fprintf(stderr, "Usage: %s [callsPerThread] [latencyMs] [repeats]\n", argv[0]);
+        return 2;
+    }
+
+    // The crawler writes crawler.log into the working directory
+    char dir[] = "/tmp/bench_metrics.XXXXXX";
+    if (mkdtemp(dir) == NULL || chdir(dir) != 0)
+        return 1;
+
+    printf("ns of CPU per call, %ld calls per thread, %ld CPUs\n\n", calls, sysconf(_SC_NPROCESSORS_ONLN));
+    printf("%-20s %7s %10s %10s\n", "call", "threads", "closed", "open");
+    MetricsConfig metricsConfig;
+    metricsConfigDefaults(&metricsConfig);
+    for (int kind = 0; kind < CALL_KINDS; kind++)
+    {
+        for (int threads = 1; threads <= 8; threads *= 2)
+        {
+            double closed = timeCalls((CallKind)kind, threads, calls);
+            metricsOpen(&metricsConfig);
+            double open = timeCalls((CallKind)kind, threads, calls);
+            metricsClose();
+            printf("%-20s %7d %10.1f %10.1f\n", CALL_NAMES[kind], threads, closed, open);
+            fflush(stdout);
+        }
+    }
+
+    LogConfig logConfig;
+    logConfigDefaults(&logConfig);
+    logConfig.truncate = 1;
+    logConfig.level = LOG_ERROR;                        // The log is not what is measured here
+    if (logOpen(&logConfig) != 0)
+        return 1;
+    curl_global_init(CURL_GLOBAL_ALL);
+    SiteGraph graph = { 10, 3, 4096 };
+    HttpServerConfig serverConfig = { 0, latencyMs, siteGraphHandler, &graph };
+    HttpServer *server = httpServerStart(&serverConfig);
+    if (server == NULL)
+        return 1;
+
+    long expected = siteGraphPages(&graph, graph.depth);
+    printf("\nsite graph: fanout %d, depth %d (%ld pages), latency %d ms, 2 workers, best of %d\n\n", graph.fanout,
+           graph.depth, expected, latencyMs, repeats);
+    printf("%-18s %6s %8s %10s %12s %8s %7s %6s %6s\n", "metrics", "pages", "seconds", "pages/sec", "CPU us/page",
+           "scrapes", "served", "traced", "check");
+
+    static const char *MODES[] = { "closed", "open + endpoint", "open + trace" };
+    int failures = 0;
+    double baseline = 0;
+    for (int mode = 0; mode < 3; mode++)
+    {
+        RunResult best = { 0 };
+        int ok = 1;
+        for (int r = 0; r < repeats; r++)
+        {
+            RunResult result;
+            runCrawl(server, &graph, mode, &result);
+            ok = ok && result.pages == expected && (mode == 0 || result.served == expected) &&
+                 (mode < 2 || result.traced == expected);
+            if (r == 0 || result.cpu < best.cpu)
+                best = result;
+        }
+        failures += !ok;
+        double cpuPerPage = best.cpu * 1e6 / (best.pages > 0 ? best.pages : 1);
+        if (mode == 0)
+            baseline = cpuPerPage;
+        printf("%-18s %6ld %8.2f %10.1f %7.1f %+3.0f%% %8ld %7ld %6ld %6s\n", MODES[mode], best.pages, best.seconds,
+               best.pages / best.seconds, cpuPerPage, baseline > 0 ? 100 * (cpuPerPage / baseline - 1) : 0.0,
+               best.scrapes, best.served, best.traced, ok ? "ok" : "FAILED");
+        fflush(stdout);
+    }
+
+    httpServerStop(server);
+    curl_global_cleanup();
+    logClose();
+    unlink("crawler.log");
+    if (chdir("/") == 0)
+        rmdir(dir);
+    return failures ? 1 : 0;
+}
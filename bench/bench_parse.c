@@ -0,0 +1,225 @@
+/*
+Operating Systems Spring 2024
+Final Project
+
+Benchmark: link extraction speed and memory, streaming scanner against the libxml2 DOM.
+
+Every page of a corpus is read in 16 KB chunks, the size curl hands to its write callback, and
+its links are extracted in one of three ways:
+  read only   chunks are read and dropped, the floor for the other two
+  DOM         chunks are appended to a realloc()'d buffer like the old WriteHTMLCallback, then
+              parsed with htmlReadMemory() and walked like extractUrls()
+  streaming   chunks are fed straight to the HtmlScanner, as the crawler does now
+Each method runs in its own child process so its peak RSS can be read from wait4(). The http(s)
+anchor counts of the DOM and streaming runs must agree.
+
+Without a directory, or with "-", a synthetic corpus (see htmlcorpus.h) is generated in /tmp and
+removed afterwards.
+
+Usage: bench_parse [corpus-dir] [passes]
+*/
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <libxml/HTMLparser.h>
+
+#include "htmlcorpus.h"
+#include "htmlscan.h"
+
+#define CHUNK_SIZE 16384
+
+enum { METHOD_READ, METHOD_DOM, METHOD_STREAM };
+
+typedef struct
+{
+    double seconds;     // Time spent on all passes
+    long bytes;         // Bytes read
+    long links;         // http(s) links found on the last pass
+} Result;
+
+static double nowSeconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int isHttp(const char *href)
+{
+    return strncmp(href, "http://", 7) == 0 || strncmp(href, "https://", 8) == 0;
+}
+
+// Same walk as extractUrls(), counting instead of enqueuing
+static void countDomLinks(xmlNode *node, long *links)
+{
+    for (; node; node = node->next)
+    {
+        if (node->type == XML_ELEMENT_NODE && !xmlStrcmp(node->name, (const xmlChar *)"a"))
+        {
+            xmlChar *href = xmlGetProp(node, (const xmlChar *)"href");
+            if (href)
+            {
+                *links += isHttp((const char *)href);
+                xmlFree(href);
+            }
+        }
+        countDomLinks(node->children, links);
+    }
+}
+
+static void countStreamLink(HtmlLinkKind kind, const char *href, size_t len, void *userdata)
+{
+    (void)len;
+    if (kind == HTML_LINK_A && isHttp(href))
+        (*(long *)userdata)++;
+}
+
+// Extract the links of one page with 'method', return the number of bytes read
+static long processPage(const char *path, int method, long *links)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return 0;
+
+    char chunk[CHUNK_SIZE];
+    char *body = NULL;
+    size_t size = 0;
+    HtmlScanner scanner;
+    if (method == METHOD_STREAM)
+        htmlScannerInit(&scanner, countStreamLink, links);
+
+    ssize_t n;
+    long total = 0;
+    while ((n = read(fd, chunk, sizeof(chunk))) > 0)
+    {
+        total += n;
+        if (method == METHOD_DOM)
+        {
+            body = realloc(body, size + (size_t)n + 1);
+            memcpy(body + size, chunk, (size_t)n);
+            size += (size_t)n;
+            body[size] = '\0';
+        }
+        else if (method == METHOD_STREAM)
+        {
+            htmlScannerFeed(&scanner, chunk, (size_t)n);
+        }
+    }
+    close(fd);
+
+    if (method == METHOD_STREAM)
+        htmlScannerFinish(&scanner);
+    if (method == METHOD_DOM && body != NULL)
+    {
+        htmlDocPtr doc = htmlReadMemory(body, (int)size, NULL, NULL, HTML_PARSE_NOERROR | HTML_PARSE_NOWARNING);
+        if (doc)
+        {
+            countDomLinks(doc->children, links);
+            xmlFreeDoc(doc);
+        }
+    }
+    free(body);
+    return total;
+}
+
+// Run one method in a child process; return its result and peak RSS in KB
+static int runMethod(char **files, int count, int passes, int method, Result *result, long *peakKb)
+{
+    int fds[2];
+    if (pipe(fds) != 0)
+        return -1;
+
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        Result r = { 0, 0, 0 };
+        double start = nowSeconds();
+        for (int pass = 0; pass < passes; pass++)
+        {
+            r.links = 0;
+            for (int i = 0; i < count; i++)
+                r.bytes += processPage(files[i], method, &r.links);
+        }
+        r.seconds = nowSeconds() - start;
+        _exit(write(fds[1], &r, sizeof(r)) == sizeof(r) ? 0 : 1);
+    }
+
+    close(fds[1]);
+    ssize_t got = read(fds[0], result, sizeof(*result));
+    close(fds[0]);
+    int status;
+    struct rusage usage;
+    if (pid < 0 || wait4(pid, &status, 0, &usage) < 0 || got != sizeof(*result))
+        return -1;
+    *peakKb = usage.ru_maxrss;
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *dir = argc > 1 && strcmp(argv[1], "-") != 0 ? argv[1] : NULL;
+    int passes = argc > 2 ? atoi(argv[2]) : 5;
+    char tmpdir[] = "/tmp/bench_parse.XXXXXX";
+
+    if (dir == NULL)
+    {
+        if (mkdtemp(tmpdir) == NULL)
+            return 1;
+        dir = tmpdir;
+        long bytes = htmlCorpusGenerate(dir, 200, 2024);
+        if (bytes < 0)
+            return 1;
+    }
+
+    int count = 0;
+    char **files = htmlCorpusFiles(dir, &count);
+    if (files == NULL || count == 0)
+    {
+        fprintf(stderr, "No pages in %s\n", dir);
+        return 1;
+    }
+
+    // Warm the page cache so the first method is not charged for disk reads
+    long corpusBytes = 0, ignored = 0;
+    for (int i = 0; i < count; i++)
+        corpusBytes += processPage(files[i], METHOD_READ, &ignored);
+
+    printf("corpus: %d pages, %.1f MB, %d passes, %d KB chunks\n\n", count, corpusBytes / 1e6, passes, CHUNK_SIZE / 1024);
+    printf("%-10s %10s %14s %10s\n", "method", "MB/s", "peak RSS (KB)", "links");
+
+    static const char *names[] = { "read only", "DOM", "streaming" };
+    long links[3] = { 0, 0, 0 };
+    int failures = 0;
+    for (int method = METHOD_READ; method <= METHOD_STREAM; method++)
+    {
+        Result r;
+        long peakKb = 0;
+        if (runMethod(files, count, passes, method, &r, &peakKb) != 0)
+        {
+            printf("%-10s failed\n", names[method]);
+            failures++;
+            continue;
+        }
+        links[method] = r.links;
+        printf("%-10s %10.1f %14ld %10ld\n", names[method], r.bytes / r.seconds / 1e6, peakKb, r.links);
+        fflush(stdout);
+    }
+
+    int agree = links[METHOD_DOM] == links[METHOD_STREAM];
+    printf("\nlink counts %s\n", agree ? "agree" : "DIFFER");
+
+    if (dir == tmpdir)
+    {
+        for (int i = 0; i < count; i++)
+            unlink(files[i]);
+        rmdir(tmpdir);
+    }
+    htmlCorpusFree(files, count);
+    return failures || !agree ? 1 : 0;
+}
@@ -0,0 +1,288 @@
+/*
+Operating Systems Spring 2024
+Final Project
+
+Benchmark: politeness limits of the crawler on a site spread over several hosts.
+
+A stand-in server is started per host, each on its own port of 127.0.0.1, which the scheduler
+treats as different hosts. The site graph is a complete tree (see sitegraph.h) whose page i is
+served by host i % hosts, so every page links to pages on the other hosts. Every server answers
+after the same latency, so with a limit of maxPerHost transfers per host the crawl can go no
+faster than hosts * maxPerHost / latency pages per second: pages/sec should grow with the number
+of hosts while no server ever works on more than maxPerHost requests at once. The unlimited row
+shows the same crawl without the limit.
+
+The crawl-delay run gives every host a delay and one host a longer one set with
+schedulerSetDelay(); the requests each server received must be at least that far apart (with 10%
+slack for the time between the start of a transfer and its request reaching the server).
+
+Usage: bench_polite [latencyMs] [maxPerHost]
+*/
+
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <curl/curl.h>
+
+#include "crawler.h"
+#include "httpserver.h"
+#include "sitegraph.h"
+
+// Most hosts of a run
+#define MAX_HOSTS 8
+
+// Requests one server records the arrival time of
+#define MAX_ARRIVALS 4096
+
+// One host of the site and what its server saw
+typedef struct
+{
+    const SiteGraph *graph;
+    const int *ports;               // Ports of all hosts of the run
+    int hosts;                      // Number of hosts of the run
+    HttpServer *server;
+    long long arrivals[MAX_ARRIVALS];   // Arrival times of the requests, in microseconds
+    int arrivalCount;
+} Host;
+
+static long long nowUs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// Append formatted text to a growing buffer
+static void append(char **buf, size_t *len, size_t *cap, const char *fmt, ...)
+{
+    char piece[256];
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(piece, sizeof(piece), fmt, args);
+    va_end(args);
+    if (*len + (size_t)n + 1 > *cap)
+    {
+        *cap = (*len + (size_t)n + 1) * 2;
+        *buf = realloc(*buf, *cap);
+    }
+    memcpy(*buf + *len, piece, (size_t)n + 1);
+    *len += (size_t)n;
+}
+
+// Request handler: the site graph, with page i linked on the host that serves it
+static void hostHandler(const char *method, const char *path, const char *headers,
+                        HttpResponse *response, void *userdata)
+{
+    Host *host = (Host *)userdata;
+    const SiteGraph *graph = host->graph;
+    (void)method;
+    (void)headers;
+
+    if (host->arrivalCount < MAX_ARRIVALS)
+        host->arrivals[host->arrivalCount++] = nowUs();
+
+    long page = -1;
+    int depth = sscanf(path, "/n/%ld", &page) == 1 ? siteGraphDepthOf(graph, page) : -1;
+    if (depth < 0)
+    {
+        response->status = 404;
+        response->body = strdup("<html><body>not found</body></html>");
+        response->size = strlen(response->body);
+        return;
+    }
+
+    size_t len = 0, cap = 1024;
+    char *body = malloc(cap);
+    append(&body, &len, &cap, "<html><head><title>page %ld</title></head><body>\n", page);
+    if (depth < graph->depth)
+    {
+        for (int i = 1; i <= graph->fanout; i++)
+        {
+            long child = page * graph->fanout + i;
+            append(&body, &len, &cap, "<p><a href=\"http://127.0.0.1:%d/n/%ld\">child</a></p>\n",
+                   host->ports[child % host->hosts], child);
+        }
+    }
+    while (len < graph->pageSize)
+        append(&body, &len, &cap, "<p>Lorem ipsum dolor sit amet, consectetur adipiscing elit %ld.</p>\n", page);
+    append(&body, &len, &cap, "</body></html>\n");
+    response->body = body;
+    response->size = len;
+}
+
+// Start one server per host; returns 0, or -1 if a server could not be started
+static int startHosts(Host *hosts, int *ports, int count, const SiteGraph *graph, int latencyMs)
+{
+    for (int i = 0; i < count; i++)
+    {
+        hosts[i] = (Host){ .graph = graph, .ports = ports, .hosts = count };
+        HttpServerConfig config = { 0, latencyMs, hostHandler, &hosts[i] };
+        hosts[i].server = httpServerStart(&config);
+        if (hosts[i].server == NULL)
+            return -1;
+        ports[i] = httpServerPort(hosts[i].server);
+    }
+    return 0;
+}
+
+// Crawl the site from page 0 on the first host; returns the pages fetched
+static long runCrawl(const SchedulerConfig *schedulerConfig, const int *ports, long slowDelayMs, double *seconds)
+{
+    char seed[128];
+    snprintf(seed, sizeof(seed), "http://127.0.0.1:%d/n/0", ports[0]);
+
+    visited_urls = visitedCreate(0);
+    ThreadData data = { .frontier = frontierCreate(schedulerConfig->maxDepth, NULL),
+                        .scheduler = schedulerCreate(schedulerConfig), .links = stdout };
+    atomic_init(&data.pagesFetched, 0);
+    atomic_init(&data.pagesFailed, 0);
+    frontierPush(data.frontier, seed, 0);
+    if (slowDelayMs >= 0)
+        schedulerSetDelay(data.scheduler, seed, slowDelayMs);   // The first host gets its own crawl delay
+
+    // The crawler prints every link it finds; keep that out of the report
+    fflush(stdout);
+    int saved = dup(STDOUT_FILENO);
+    int devnull = open("/dev/null", O_WRONLY);
+    dup2(devnull, STDOUT_FILENO);
+
+    long long start = nowUs();
+    crawl(&data, 2);
+    *seconds = (nowUs() - start) / 1e6;
+
+    fflush(stdout);
+    dup2(saved, STDOUT_FILENO);
+    close(saved);
+    close(devnull);
+
+    schedulerDestroy(data.scheduler);
+    frontierDestroy(data.frontier);
+    visitedDestroy(visited_urls);
+    return atomic_load(&data.pagesFetched);
+}
+
+// Scaling run: pages/sec and the most requests any server worked on at once
+static int runScaling(const SiteGraph *graph, int hostCount, int latencyMs, int maxPerHost)
+{
+    Host *hosts = calloc(MAX_HOSTS, sizeof(Host));
+    int ports[MAX_HOSTS];
+    if (hosts == NULL || startHosts(hosts, ports, hostCount, graph, latencyMs) != 0)
+        return 1;
+
+    SchedulerConfig config;
+    schedulerConfigDefaults(&config);
+    config.maxDepth = graph->depth;
+    config.maxPerHost = maxPerHost;
+    double seconds;
+    long pages = runCrawl(&config, ports, -1, &seconds);
+
+    int maxPending = 0;
+    for (int i = 0; i < hostCount; i++)
+    {
+        if (httpServerMaxPending(hosts[i].server) > maxPending)
+            maxPending = httpServerMaxPending(hosts[i].server);
+        httpServerStop(hosts[i].server);
+    }
+    free(hosts);
+
+    long expected = siteGraphPages(graph, graph->depth);
+    int ok = pages == expected && (maxPerHost == 0 || maxPending <= maxPerHost);
+    char limit[16] = "unlimited", bound[16] = "-";
+    if (maxPerHost > 0)
+    {
+        snprintf(limit, sizeof(limit), "%d", maxPerHost);
+        snprintf(bound, sizeof(bound), "%.0f", hostCount * maxPerHost * 1000.0 / latencyMs);
+    }
+    printf("%5d %10s %7ld %10.1f %10s %12d %6s\n", hostCount, limit, pages, pages / seconds, bound, maxPending,
+           ok ? "ok" : "FAIL");
+    fflush(stdout);
+    return !ok;
+}
+
+// Crawl-delay run: the smallest gap between two requests to each server
+static int runDelay(const SiteGraph *graph, int hostCount, int latencyMs, long delayMs, long slowDelayMs)
+{
+    Host *hosts = calloc(MAX_HOSTS, sizeof(Host));
+    int ports[MAX_HOSTS];
+    if (hosts == NULL || startHosts(hosts, ports, hostCount, graph, latencyMs) != 0)
+        return 1;
+
+    SchedulerConfig config;
+    schedulerConfigDefaults(&config);
+    config.maxDepth = graph->depth;
+    config.delayMs = delayMs;
+    double seconds;
+    long pages = runCrawl(&config, ports, slowDelayMs, &seconds);
+
+    int failures = pages != siteGraphPages(graph, graph->depth);
+    for (int i = 0; i < hostCount; i++)
+    {
+        httpServerStop(hosts[i].server);
+        long long minGap = -1;
+        for (int k = 1; k < hosts[i].arrivalCount; k++)
+            if (minGap < 0 || hosts[i].arrivals[k] - hosts[i].arrivals[k - 1] < minGap)
+                minGap = hosts[i].arrivals[k] - hosts[i].arrivals[k - 1];
+        long delay = i == 0 ? slowDelayMs : delayMs;
+        int ok = pages == siteGraphPages(graph, graph->depth) && minGap >= delay * 900;
+        failures += !ok;
+        printf("%5d %9ld %9d %13.1f %6s\n", i, delay, hosts[i].arrivalCount, minGap / 1000.0, ok ? "ok" : "FAIL");
+    }
+    printf("%ld pages in %.2f s\n", pages, seconds);
+    fflush(stdout);
+    free(hosts);
+    return failures != 0;
+}
+
+int main(int argc, char *argv[])
+{
+    int latencyMs = argc > 1 ? atoi(argv[1]) : 20;
+    int maxPerHost = argc > 2 ? atoi(argv[2]) : 4;
+    if (latencyMs <= 0)
+        latencyMs = 1;
+
+    struct rlimit rl;
+    getrlimit(RLIMIT_NOFILE, &rl);
+    rl.rlim_cur = rl.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &rl);
+
+    // The crawler writes crawler.log into the working directory
+    char dir[] = "/tmp/bench_polite.XXXXXX";
+    if (mkdtemp(dir) == NULL || chdir(dir) != 0)
+        return 1;
+
+    LogConfig logConfig;
+    logConfigDefaults(&logConfig);
+    logConfig.truncate = 1;
+    if (logOpen(&logConfig) != 0)
+        return 1;
+    curl_global_init(CURL_GLOBAL_ALL);
+
+    SiteGraph graph = { 8, 3, 2048 };
+    printf("site graph: fanout %d, depth %d (%ld pages), latency %d ms, 2 workers\n\n", graph.fanout, graph.depth,
+           siteGraphPages(&graph, graph.depth), latencyMs);
+    printf("%5s %10s %7s %10s %10s %12s %6s\n", "hosts", "per host", "pages", "pages/sec", "bound", "max pending",
+           "check");
+
+    int failures = 0;
+    for (int hosts = 1; hosts <= MAX_HOSTS; hosts *= 2)
+        failures += runScaling(&graph, hosts, latencyMs, maxPerHost);
+    failures += runScaling(&graph, 4, latencyMs, 0);
+
+    SiteGraph small = { 4, 2, 2048 };
+    printf("\ncrawl delay: fanout %d, depth %d (%ld pages) over 4 hosts, latency %d ms\n\n", small.fanout,
+           small.depth, siteGraphPages(&small, small.depth), latencyMs);
+    printf("%5s %9s %9s %13s %6s\n", "host", "delay ms", "requests", "min gap ms", "check");
+    failures += runDelay(&small, 4, latencyMs, 50, 100);
+
+    curl_global_cleanup();
+    logClose();
+    unlink("crawler.log");
+    if (chdir("/") == 0)
+        rmdir(dir);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,169 @@
+/*
+Operating Systems Spring 2024
+Final Project
+
+Benchmark: scaling of the crawl with the number of workers (pool.c).
+
+The stand-in server serves a complete tree (see sitegraph.h) with a fixed latency. Every worker
+may only keep a few transfers in flight, so one worker fetches at most connections / latency
+pages per second and the crawl can only go faster by running more workers: with enough of them
+to go around, pages/sec should grow in step with the worker count. The bound column is that
+ideal rate, and efficiency is the speedup over one worker divided by the number of workers.
+
+The last row starts a single worker and lets the pool grow while the workers are saturated,
+up to the largest worker count of the table; it reports the most workers it ran at once.
+
+Every run must fetch every page exactly once. Steals counts URLs a worker took from another
+worker's frontier lane, parks the times a worker out of work went to sleep and wakeups those
+ended because new work arrived.
+
+Usage: bench_pool [latencyMs] [connections] [maxWorkers]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <curl/curl.h>
+
+#include "crawler.h"
+#include "httpserver.h"
+#include "sitegraph.h"
+
+// Outcome of one crawl
+typedef struct
+{
+    long pages;
+    unsigned long requests;     // Requests the server answered during the crawl
+    double seconds;
+    long steals;
+    PoolStats pool;
+} RunResult;
+
+static double nowSeconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Crawl the whole site with 'workers' workers, growing to 'maxWorkers'
+static void runCrawl(HttpServer *server, const SiteGraph *graph, int connections, int workers, int maxWorkers,
+                     RunResult *result)
+{
+    char seed[128];
+    snprintf(seed, sizeof(seed), "http://127.0.0.1:%d/n/0", httpServerPort(server));
+
+    visited_urls = visitedCreate(0);
+    UrlTable *urls = urlTableCreate(0);                 // Interned like in the crawler
+    SchedulerConfig schedulerConfig;
+    schedulerConfigDefaults(&schedulerConfig);
+    schedulerConfig.maxDepth = graph->depth;
+    schedulerConfig.maxPerHost = 0;                     // One host: only the workers limit the transfers
+    FetchConfig fetchConfig;
+    fetchConfigDefaults(&fetchConfig);
+    fetchConfig.maxInFlight = connections;
+    ThreadData data = { .frontier = frontierCreate(graph->depth, urls), .scheduler = schedulerCreate(&schedulerConfig),
+                        .fetch = &fetchConfig, .maxWorkers = maxWorkers };
+    atomic_init(&data.pagesFetched, 0);
+    atomic_init(&data.pagesFailed, 0);
+    frontierPush(data.frontier, seed, 0);
+
+    unsigned long requests = httpServerRequests(server);
+    double start = nowSeconds();
+    crawl(&data, workers);
+    result->seconds = nowSeconds() - start;
+    result->requests = httpServerRequests(server) - requests;
+    result->pages = atomic_load(&data.pagesFetched);
+    result->steals = frontierSteals(data.frontier);
+    result->pool = data.poolStats;
+
+    schedulerDestroy(data.scheduler);
+    frontierDestroy(data.frontier);
+    urlTableDestroy(urls);
+    visitedDestroy(visited_urls);
+}
+
+int main(int argc, char *argv[])
+{
+    SiteGraph graph = { 12, 3, 4096 };
+    int latencyMs = 20;
+    int connections = 2;
+    int maxWorkers = 8;
+    if (argc > 1)
+        latencyMs = atoi(argv[1]);
+    if (argc > 2)
+        connections = atoi(argv[2]);
+    if (argc > 3)
+        maxWorkers = atoi(argv[3]);
+    if (latencyMs < 1 || connections < 1 || maxWorkers < 1)
+    {
+        fprintf(stderr, "Usage: %s [latencyMs] [connections] [maxWorkers]\n", argv[0]);
+        return 2;
+    }
+
+    struct rlimit rl;
+    getrlimit(RLIMIT_NOFILE, &rl);
+    rl.rlim_cur = rl.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &rl);
+
+    // The crawler writes crawler.log into the working directory
+    char dir[] = "/tmp/bench_pool.XXXXXX";
+    if (mkdtemp(dir) == NULL || chdir(dir) != 0)
+        return 1;
+
+    LogConfig logConfig;
+    logConfigDefaults(&logConfig);
+    logConfig.truncate = 1;
+    if (logOpen(&logConfig) != 0)
+        return 1;
+
+    curl_global_init(CURL_GLOBAL_ALL);
+    HttpServerConfig serverConfig = { 0, latencyMs, siteGraphHandler, &graph };
+    HttpServer *server = httpServerStart(&serverConfig);
+    if (server == NULL)
+        return 1;
+
+    long expected = siteGraphPages(&graph, graph.depth);
+    printf("site graph: fanout %d, depth %d (%ld pages), latency %d ms, %d transfers per worker, %ld CPUs\n\n",
+           graph.fanout, graph.depth, expected, latencyMs, connections, sysconf(_SC_NPROCESSORS_ONLN));
+    printf("%-14s %6s %8s %10s %8s %8s %10s %7s %6s %8s %6s\n", "workers", "pages", "seconds", "pages/sec", "bound",
+           "speedup", "efficiency", "steals", "parks", "wakeups", "check");
+
+    int failures = 0;
+    double single = 0;                                  // Pages/sec of one worker
+    for (int workers = 1; workers <= 2 * maxWorkers; workers *= 2)
+    {
+        int adaptive = workers > maxWorkers;            // Last row: start one worker, grow up to maxWorkers
+        RunResult result;
+        runCrawl(server, &graph, connections, adaptive ? 1 : workers, adaptive ? maxWorkers : 0, &result);
+
+        double rate = result.pages / result.seconds;
+        if (workers == 1)
+            single = rate;
+        int running = adaptive ? result.pool.peak : workers;
+        int ok = result.pages == expected && result.requests == (unsigned long)expected;
+        failures += !ok;
+
+        char label[32];
+        if (adaptive)
+            snprintf(label, sizeof(label), "1..%d (peak %d)", maxWorkers, result.pool.peak);
+        else
+            snprintf(label, sizeof(label), "%d", workers);
+        double speedup = rate / single;
+        printf("%-14s %6ld %8.2f %10.1f %8.0f %7.2fx %9.0f%% %7ld %6ld %8ld %6s\n", label, result.pages,
+               result.seconds, rate, running * connections * 1000.0 / latencyMs, speedup, 100.0 * speedup / running,
+               result.steals, result.pool.parks, result.pool.wakeups, ok ? "ok" : "FAILED");
+        fflush(stdout);
+    }
+
+    httpServerStop(server);
+    curl_global_cleanup();
+    logClose();
+    unlink("crawler.log");
+    if (chdir("/") == 0)
+        rmdir(dir);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,454 @@
+/*
+Operating Systems Spring 2024
+Final Project
+
+Benchmark: bandwidth and CPU of a re-crawl with the page store (pagestore.c, simhash.c).
+
+The stand-in server serves a tree of pages like sitegraph.h, with text drawn from a word list so
+that every page reads differently, an ETag and a Last-Modified header per page version, and 304
+Not Modified for a request whose If-None-Match is the current ETag. The root also links to a
+mirror of the site under /m/: the same pages with the same text, whose links stay in the mirror.
+
+Three crawls of the site are compared:
+
+    no store    every page is downloaded and parsed, the mirror is crawled like the site
+    cold        an empty page store: the mirror's root is a near-duplicate of the site's root,
+                so its links are not followed
+    re-crawl    a page store read back from the file the cold crawl saved; between the crawls a
+                share of the pages changed, and each changed page links to a new page
+
+For the re-crawl, the unchanged pages must come back as 304s and every page must still be
+fetched: the links of unchanged pages come from the store. Bytes are the body bytes the server
+sent, parses the bodies the crawler scanned. The server runs in a child process, so CPU is the
+time of the crawler alone: its workers, curl and the kernel's share of the transfers.
+
+Usage: bench_recrawl [changedPercent] [latencyMs] [workers]
+*/
+
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <curl/curl.h>
+
+#include "crawler.h"
+#include "httpserver.h"
+#include "sitegraph.h"
+
+// Words the page text is drawn from
+static const char *WORDS[] = {
+    "crawler", "thread", "queue", "socket", "buffer", "kernel", "page", "link", "host", "frontier",
+    "process", "signal", "memory", "cache", "disk", "network", "packet", "server", "client", "request",
+    "response", "header", "body", "token", "parser", "lexer", "tree", "graph", "node", "edge",
+    "depth", "breadth", "search", "index", "table", "hash", "shard", "lock", "mutex", "atomic",
+    "worker", "pool", "scheduler", "delay", "timeout", "retry", "error", "status", "journal", "snapshot",
+    "river", "mountain", "forest", "ocean", "valley", "desert", "island", "harbor", "bridge", "castle",
+    "market", "garden", "library", "museum", "theater", "station", "airport", "village", "city", "county",
+    "winter", "summer", "autumn", "spring", "morning", "evening", "midnight", "weekend", "holiday", "season",
+    "apple", "orange", "lemon", "cherry", "grape", "melon", "peach", "plum", "berry", "banana",
+    "quickly", "slowly", "softly", "loudly", "gently", "boldly", "calmly", "warmly", "keenly", "barely"
+};
+#define WORD_COUNT (sizeof(WORDS) / sizeof(WORDS[0]))
+
+// The site: the tree, its mirror and the pages added by changes, with every body prepared in advance;
+// versions and counters are in memory shared with the server process
+typedef struct
+{
+    SiteGraph graph;
+    long pages;                 // Pages of the tree, and of the mirror
+    int *version;               // Per page: 1, or 2 once it changed
+    char **bodies[2];           // Per version and page: body of /n/<page>
+    char **mirrors;             // Per page: body of /m/<page>, version 1
+    char **added;               // Per page: body of /x/<page>, the page a change links to
+    atomic_long *hits;          // Per page: requests for /n/<page> since the last reset
+    atomic_long mirrorHits;     // Requests for /m/ pages
+    atomic_long addedHits;      // Requests for /x/ pages
+    atomic_long notModified;    // 304s sent
+    atomic_long bytes;          // Body bytes sent
+} Site;
+
+// Append formatted text to a growing buffer
+static void append(char **buf, size_t *len, size_t *cap, const char *fmt, ...)
+    __attribute__((format(printf, 4, 5)));
+static void append(char **buf, size_t *len, size_t *cap, const char *fmt, ...)
+{
+    char piece[512];
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(piece, sizeof(piece), fmt, args);
+    va_end(args);
+    if (*len + (size_t)n + 1 > *cap)
+    {
+        *cap = (*len + (size_t)n + 1) * 2;
+        *buf = realloc(*buf, *cap);
+    }
+    memcpy(*buf + *len, piece, (size_t)n + 1);
+    *len += (size_t)n;
+}
+
+// Next number of a xorshift generator
+static unsigned long nextRandom(unsigned long *state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+// Body of page 'page' at 'version', its links under 'prefix' ("n" or "m")
+static char *makePage(const Site *site, long page, int version, const char *prefix)
+{
+    size_t len = 0, cap = site->graph.pageSize + 4096;
+    char *body = malloc(cap);
+    body[0] = '\0';
+    append(&body, &len, &cap, "<html><head><title>Page %ld</title></head><body>\n<ul class=\"nav\">"
+           "<li><a href=\"/n/0\">home</a></li><li>about</li><li>contact</li></ul>\n", page);
+
+    int depth = siteGraphDepthOf(&site->graph, page);
+    if (depth < site->graph.depth)
+        for (int i = 1; i <= site->graph.fanout; i++)
+            append(&body, &len, &cap, "<p><a href=\"/%s/%ld\">child %d</a></p>\n", prefix,
+                   page * site->graph.fanout + i, i);
+    if (page == 0 && prefix[0] == 'n')
+        append(&body, &len, &cap, "<p><a href=\"/m/0\">mirror</a></p>\n");
+    if (version == 2)
+        append(&body, &len, &cap, "<p><a href=\"/x/%ld\">news</a></p>\n", page);
+
+    // Text of its own: a changed page gets a new first half
+    unsigned long state = 0x9e3779b97f4a7c15UL ^ (unsigned long)(page + 1) * 0xbf58476d1ce4e5b9UL;
+    unsigned long changed = state ^ 0x94d049bb133111ebUL;
+    size_t half = site->graph.pageSize / 2;
+    append(&body, &len, &cap, "<p>");
+    while (len < site->graph.pageSize)
+    {
+        unsigned long *words = version == 2 && len < half ? &changed : &state;
+        append(&body, &len, &cap, "%s ", WORDS[nextRandom(words) % WORD_COUNT]);
+        if (nextRandom(words) % 16 == 0)
+            append(&body, &len, &cap, "</p>\n<p>");
+    }
+    append(&body, &len, &cap, "</p></body></html>\n");
+    return body;
+}
+
+// Request handler: the tree, its mirror and the added pages, with validators
+static void siteHandler(const char *method, const char *path, const char *headers, HttpResponse *response,
+                        void *userdata)
+{
+    Site *site = (Site *)userdata;
+    (void)method;
+
+    long page = -1;
+    char kind = 0;
+    if (sscanf(path, "/%c/%ld", &kind, &page) != 2 || page < 0 || page >= site->pages ||
+        (kind != 'n' && kind != 'm' && kind != 'x') || (kind == 'x' && site->version[page] != 2))
+    {
+        response->status = 404;
+        response->body = strdup("<html><body>not found</body></html>");
+        response->size = strlen(response->body);
+        return;
+    }
+
+    int version = kind == 'n' ? site->version[page] : 1;
+    static _Thread_local char extra[256];
+    char etag[64];
+    snprintf(etag, sizeof(etag), "\"%c%ld-v%d\"", kind, page, version);
+    snprintf(extra, sizeof(extra), "ETag: %s\r\nLast-Modified: %s\r\n", etag,
+             version == 1 ? "Mon, 01 Jan 2024 00:00:00 GMT" : "Sat, 01 Jun 2024 00:00:00 GMT");
+    response->extraHeaders = extra;
+
+    if (kind == 'n')
+        atomic_fetch_add(&site->hits[page], 1);
+    else
+        atomic_fetch_add(kind == 'm' ? &site->mirrorHits : &site->addedHits, 1);
+
+    const char *match = strcasestr(headers, "If-None-Match:");
+    if (match != NULL && strncmp(match + 14 + strspn(match + 14, " "), etag, strlen(etag)) == 0)
+    {
+        response->status = 304;
+        atomic_fetch_add(&site->notModified, 1);
+        return;
+    }
+
+    const char *body = kind == 'n' ? site->bodies[version - 1][page] : kind == 'm' ? site->mirrors[page]
+                                                                                    : site->added[page];
+    response->body = strdup(body);
+    response->size = strlen(body);
+    atomic_fetch_add(&site->bytes, (long)response->size);
+}
+
+// Outcome of one crawl
+typedef struct
+{
+    long pages;
+    long requests;
+    long notModified;
+    long bytes;
+    long parses;
+    long nearDuplicates;
+    double seconds;
+    double cpu;
+    int ok;
+} RunResult;
+
+static double nowSeconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Shared memory for 'count' items of 'size' bytes, zeroed
+static void *sharedAlloc(size_t count, size_t size)
+{
+    void *p = mmap(NULL, count * size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    return p == MAP_FAILED ? NULL : p;
+}
+
+// Run the server in a child process until 'stopFd' is closed; returns its port, or -1
+static int startServer(Site *site, int latencyMs, int *stopFd, pid_t *child)
+{
+    int readyPipe[2], stopPipe[2];
+    if (pipe(readyPipe) != 0 || pipe(stopPipe) != 0)
+        return -1;
+
+    *child = fork();
+    if (*child == 0)
+    {
+        close(readyPipe[0]);
+        close(stopPipe[1]);
+        HttpServerConfig config = { 0, latencyMs, siteHandler, site };
+        HttpServer *server = httpServerStart(&config);
+        int port = server != NULL ? httpServerPort(server) : -1;
+        if (write(readyPipe[1], &port, sizeof(port)) < 0 || port < 0)
+            _exit(1);
+        char byte;
+        while (read(stopPipe[0], &byte, 1) > 0)
+            ;
+        httpServerStop(server);
+        _exit(0);
+    }
+
+    close(readyPipe[1]);
+    close(stopPipe[0]);
+    int port = -1;
+    if (*child < 0 || read(readyPipe[0], &port, sizeof(port)) != sizeof(port))
+        port = -1;
+    close(readyPipe[0]);
+    *stopFd = stopPipe[1];
+    return port;
+}
+
+static double cpuSeconds(void)
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+// Crawl the whole site with 'workers' workers and the page store 'pages' (NULL for none)
+static void runCrawl(int port, Site *site, PageStore *pages, int workers, RunResult *result)
+{
+    char seed[128];
+    snprintf(seed, sizeof(seed), "http://127.0.0.1:%d/n/0", port);
+    for (long i = 0; i < site->pages; i++)
+        atomic_store(&site->hits[i], 0);
+    atomic_store(&site->mirrorHits, 0);
+    atomic_store(&site->addedHits, 0);
+    atomic_store(&site->notModified, 0);
+    atomic_store(&site->bytes, 0);
+
+    visited_urls = visitedCreate(0);
+    UrlTable *urls = urlTableCreate(0);
+    SchedulerConfig schedulerConfig;
+    schedulerConfigDefaults(&schedulerConfig);
+    schedulerConfig.maxDepth = site->graph.depth + 1;   // The added pages are one level below the deepest
+    schedulerConfig.maxPerHost = 0;
+    FetchConfig fetchConfig;
+    fetchConfigDefaults(&fetchConfig);
+    fetchConfig.maxInFlight = 16;
+    ThreadData data = { .frontier = frontierCreate(site->graph.depth + 1, urls),
+                        .scheduler = schedulerCreate(&schedulerConfig), .fetch = &fetchConfig, .pages = pages };
+    atomic_init(&data.pagesFetched, 0);
+    atomic_init(&data.pagesFailed, 0);
+    frontierPush(data.frontier, seed, 0);
+
+    PageStoreStats before = { 0 };
+    if (pages != NULL)
+        pageStoreStats(pages, &before);
+    double cpu = cpuSeconds();
+    double start = nowSeconds();
+    crawl(&data, workers);
+    result->seconds = nowSeconds() - start;
+    result->cpu = cpuSeconds() - cpu;
+    result->requests = atomic_load(&site->mirrorHits) + atomic_load(&site->addedHits);
+    result->pages = atomic_load(&data.pagesFetched);
+    result->notModified = atomic_load(&site->notModified);
+    result->bytes = atomic_load(&site->bytes);
+    result->parses = result->pages - result->notModified;
+    result->nearDuplicates = 0;
+    if (pages != NULL)
+    {
+        PageStoreStats after;
+        pageStoreStats(pages, &after);
+        result->nearDuplicates = after.nearDuplicates - before.nearDuplicates;
+    }
+
+    // Every page of the tree exactly once, and the added pages of the changed ones
+    long changed = 0;
+    result->ok = atomic_load(&data.pagesFailed) == 0;
+    for (long i = 0; i < site->pages; i++)
+    {
+        result->requests += atomic_load(&site->hits[i]);
+        result->ok = result->ok && atomic_load(&site->hits[i]) == 1;
+        changed += site->version[i] == 2;
+    }
+    result->ok = result->ok && atomic_load(&site->addedHits) == changed;
+
+    schedulerDestroy(data.scheduler);
+    frontierDestroy(data.frontier);
+    urlTableDestroy(urls);
+    visitedDestroy(visited_urls);
+}
+
+static void printRow(const char *label, const RunResult *r)
+{
+    printf("%-10s %6ld %8ld %6ld %9.2f %7ld %9ld %8.2f %8.3f %6s\n", label, r->pages, r->requests, r->notModified,
+           r->bytes / 1e6, r->parses, r->nearDuplicates, r->seconds, r->cpu, r->ok ? "ok" : "FAILED");
+    fflush(stdout);
+}
+
+int main(int argc, char *argv[])
+{
+    int changedPercent = 5;
+    int latencyMs = 5;
+    int workers = 2;
+    if (argc > 1)
+        changedPercent = atoi(argv[1]);
+    if (argc > 2)
+        latencyMs = atoi(argv[2]);
+    if (argc > 3)
+        workers = atoi(argv[3]);
+    if (changedPercent < 0 || changedPercent > 100 || latencyMs < 0 || workers < 1)
+    {
+        fprintf(stderr, "Usage: %s [changedPercent] [latencyMs] [workers]\n", argv[0]);
+        return 2;
+    }
+
+    // The crawler writes crawler.log into the working directory, the page store goes there too
+    char dir[] = "/tmp/bench_recrawl.XXXXXX";
+    if (mkdtemp(dir) == NULL || chdir(dir) != 0)
+        return 1;
+
+    LogConfig logConfig;
+    logConfigDefaults(&logConfig);
+    logConfig.truncate = 1;
+    if (logOpen(&logConfig) != 0)
+        return 1;
+
+    Site *shared = sharedAlloc(1, sizeof(Site));
+    if (shared == NULL)
+        return 1;
+    Site site = { .graph = { 10, 3, 16 * 1024 } };
+    site.pages = siteGraphPages(&site.graph, site.graph.depth);
+    site.version = sharedAlloc((size_t)site.pages, sizeof(int));
+    site.hits = sharedAlloc((size_t)site.pages, sizeof(atomic_long));
+    if (site.version == NULL || site.hits == NULL)
+        return 1;
+    site.mirrors = calloc((size_t)site.pages, sizeof(char *));
+    site.added = calloc((size_t)site.pages, sizeof(char *));
+    for (int v = 0; v < 2; v++)
+        site.bodies[v] = calloc((size_t)site.pages, sizeof(char *));
+
+    for (long i = 0; i < site.pages; i++)
+    {
+        site.version[i] = 1;
+        for (int v = 0; v < 2; v++)
+            site.bodies[v][i] = makePage(&site, i, v + 1, "n");
+        site.mirrors[i] = makePage(&site, i, 1, "m");
+        site.added[i] = strdup("<html><body><p>news</p><p><a href=\"/n/0\">home</a></p></body></html>\n");
+    }
+
+    // The server process gets the bodies when it is forked, and sees the versions change through shared memory
+    *shared = site;
+    int stopFd;
+    pid_t server;
+    int port = startServer(shared, latencyMs, &stopFd, &server);
+    if (port < 0)
+        return 1;
+    Site *live = shared;
+    curl_global_init(CURL_GLOBAL_ALL);
+
+    printf("site: fanout %d, depth %d (%ld pages of %zu KB and a mirror of them), latency %d ms, %d workers\n\n",
+           site.graph.fanout, site.graph.depth, site.pages, site.graph.pageSize / 1024, latencyMs, workers);
+    printf("%-10s %6s %8s %6s %9s %7s %9s %8s %8s %6s\n", "crawl", "pages", "requests", "304s", "MB sent",
+           "parses", "near-dup", "seconds", "CPU s", "check");
+
+    // Without a store the mirror is crawled too
+    RunResult full;
+    runCrawl(port, live, NULL, workers, &full);
+    full.ok = full.ok && atomic_load(&live->mirrorHits) == site.pages;
+    printRow("no store", &full);
+
+    // Cold: the mirror's root is a near-duplicate, its links are not followed
+    RunResult cold;
+    PageStore *store = pageStoreCreate();
+    runCrawl(port, live, store, workers, &cold);
+    int saved = pageStoreSave(store, "pages") == 0;
+    cold.ok = cold.ok && saved && atomic_load(&live->mirrorHits) == 1 && cold.nearDuplicates >= 1;
+    pageStoreDestroy(store);
+    printRow("cold", &cold);
+
+    // Change some pages, the root aside, then crawl again with the store read back from disk
+    long changed = 0;
+    unsigned long state = 42;
+    for (long i = 1; i < site.pages; i++)
+    {
+        if ((long)(nextRandom(&state) % 100) < changedPercent)
+        {
+            site.version[i] = 2;
+            changed++;
+        }
+    }
+    RunResult again;
+    store = pageStoreCreate();
+    int loaded = pageStoreLoad(store, "pages") == 0;
+    PageStoreStats stored;
+    pageStoreStats(store, &stored);
+    runCrawl(port, live, store, workers, &again);
+    again.ok = again.ok && loaded && stored.pages == cold.pages && atomic_load(&live->mirrorHits) == 1 &&
+               again.notModified == site.pages - changed + 1;   // The mirror's root is unchanged too
+    pageStoreDestroy(store);
+    printRow("re-crawl", &again);
+
+    printf("\n%ld of %ld pages changed; the re-crawl sent %.1fx fewer bytes, parsed %.1fx fewer pages and took %.1fx "
+           "less CPU than the cold crawl\n", changed, site.pages, (double)cold.bytes / (again.bytes > 0 ? again.bytes : 1),
+           (double)cold.parses / (again.parses > 0 ? again.parses : 1), again.cpu > 0 ? cold.cpu / again.cpu : 0.0);
+
+    close(stopFd);
+    waitpid(server, NULL, 0);
+    curl_global_cleanup();
+    for (long i = 0; i < site.pages; i++)
+    {
+        free(site.bodies[0][i]);
+        free(site.bodies[1][i]);
+        free(site.mirrors[i]);
+        free(site.added[i]);
+    }
+    free(site.bodies[0]);
+    free(site.bodies[1]);
+    free(site.mirrors);
+    free(site.added);
+    logClose();
+    unlink("crawler.log");
+    unlink("pages");
+    if (chdir("/") == 0)
+        rmdir(dir);
+    return full.ok && cold.ok && again.ok ? 0 : 1;
+}
@@ -0,0 +1,512 @@
+/*
+Operating Systems Spring 2024
+Final Project
+
+Benchmark: cost of the robots.txt check per URL, and a crawl that obeys robots.txt.
+
+  check     Three robots.txt files are generated, small (10 rules), medium (200) and large (5000), a tenth
+            of their rules with a '*' inside and some ending in '$', over paths like /d3/s17/p42.html?q=7.
+            A URL is checked against each with the compiled rules (robotsParse() and robotsAllowed()) and
+            with a scan of every rule in turn, matched with a plain recursive glob, the longest match
+            winning: ns per URL of both, and the time to compile the file. Both must give the same
+            verdict for every URL. Last, ns per URL of robotsCheck() through the cache, the host's rules
+            in, which adds the hash lookup and the shard lock. Then robots.txt bodies ending on a line with
+            no newline are parsed from right before an unreadable page, as a body comes in: not terminated.
+  crawl     A site graph (see sitegraph.h) is crawled from a stand-in server that also serves robots.txt:
+            one whose group for the crawler disallows part of the site (while its "*" group disallows all
+            of it), then robots.txt answering 404 and 503, then one setting a Crawl-delay. Checked: the
+            robots.txt is asked for once, no disallowed page is ever requested and exactly the pages that
+            are allowed, with every page above them, are fetched; a 404 lets the whole site through and a
+            503 none of it; and requests come at least the Crawl-delay apart (with 10% slack).
+
+Usage: bench_robots [checks]
+*/
+
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <curl/curl.h>
+
+#include "crawler.h"
+#include "httpserver.h"
+#include "sitegraph.h"
+
+// Paths the checks go through, a power of two
+#define PATHS 4096
+
+// Requests whose arrival time a site records
+#define MAX_ARRIVALS 1024
+
+// A rule as the scan keeps it
+typedef struct
+{
+    char pattern[64];
+    int allow;
+} Rule;
+
+// A site served with its robots.txt, and what its server saw
+typedef struct
+{
+    SiteGraph graph;
+    int robotsStatus;               // Status of /robots.txt
+    const char *robots;             // Body of /robots.txt
+    const Rule *rules;              // The rules of the group for the crawler, to spot disallowed requests
+    int ruleCount;
+    int robotsRequests;
+    int disallowedRequests;         // Requests for pages the rules disallow
+    long long arrivals[MAX_ARRIVALS];   // Arrival times of the page requests, in microseconds
+    int arrivalCount;
+} Site;
+
+static long long nowNs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// Append formatted text to a growing buffer
+static void append(char **buf, size_t *len, size_t *cap, const char *fmt, ...)
+{
+    char piece[256];
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(piece, sizeof(piece), fmt, args);
+    va_end(args);
+    if (*len + (size_t)n + 1 > *cap)
+    {
+        *cap = (*len + (size_t)n + 1) * 2;
+        *buf = realloc(*buf, *cap);
+    }
+    memcpy(*buf + *len, piece, (size_t)n + 1);
+    *len += (size_t)n;
+}
+
+// Deterministic pseudo-random numbers
+static unsigned long nextRandom(unsigned long *state)
+{
+    *state = *state * 6364136223846793005UL + 1442695040888963407UL;
+    return *state >> 33;
+}
+
+// Whether 'pattern' ('*' any bytes, a final '$' the end) matches the start of 's'
+static int globMatch(const char *pattern, const char *s)
+{
+    if (*pattern == '\0')
+        return 1;
+    if (pattern[0] == '$' && pattern[1] == '\0')
+        return *s == '\0';
+    if (*pattern == '*')
+    {
+        for (;; s++)
+        {
+            if (globMatch(pattern + 1, s))
+                return 1;
+            if (*s == '\0')
+                return 0;
+        }
+    }
+    return *s != '\0' && *s == *pattern && globMatch(pattern + 1, s + 1);
+}
+
+// The scan: every rule in turn, the longest match wins and Allow wins a tie
+static int scanAllowed(const Rule *rules, int count, const char *path)
+{
+    if (strcmp(path, "/robots.txt") == 0)
+        return 1;
+    int found = 0, allowed = 1;
+    size_t best = 0;
+    for (int i = 0; i < count; i++)
+    {
+        size_t len = strlen(rules[i].pattern);
+        if (globMatch(rules[i].pattern, path) && (!found || len > best || (len == best && rules[i].allow)))
+        {
+            found = 1;
+            best = len;
+            allowed = rules[i].allow;
+        }
+    }
+    return allowed;
+}
+
+// A random rule over the generated paths
+static void randomRule(Rule *rule, unsigned long *state)
+{
+    unsigned d = nextRandom(state) % 20, s = nextRandom(state) % 20, p = nextRandom(state) % 50;
+    unsigned kind = nextRandom(state) % 20;
+    rule->allow = nextRandom(state) % 3 == 0;
+    if (kind == 0)
+        snprintf(rule->pattern, sizeof(rule->pattern), "/d%u/*/p%u", d, p);
+    else if (kind == 1)
+        snprintf(rule->pattern, sizeof(rule->pattern), "/*/s%u/*.html$", s);
+    else if (kind < 6)
+        snprintf(rule->pattern, sizeof(rule->pattern), "/d%u", d);
+    else if (kind < 12)
+        snprintf(rule->pattern, sizeof(rule->pattern), "/d%u/s%u", d, s);
+    else if (kind < 18)
+        snprintf(rule->pattern, sizeof(rule->pattern), "/d%u/s%u/p%u", d, s, p);
+    else
+        snprintf(rule->pattern, sizeof(rule->pattern), "/d%u/s%u/p%u.html$", d, s, p);
+}
+
+// robots.txt text of 'rules' in a group for the crawler, after a "*" group disallowing everything
+static char *robotsText(const Rule *rules, int count, long delayMs, size_t *len)
+{
+    size_t cap = 1024;
+    char *text = malloc(cap);
+    *len = 0;
+    append(&text, len, &cap, "# generated\nUser-agent: *\nDisallow: /\n\n");
+    append(&text, len, &cap, "User-agent: OtherBot\nUser-agent: WebCrawler/1.0\n");
+    if (delayMs > 0)
+        append(&text, len, &cap, "Crawl-delay: %ld.%03ld\n", delayMs / 1000, delayMs % 1000);
+    for (int i = 0; i < count; i++)
+        append(&text, len, &cap, "%s: %s\n", rules[i].allow ? "Allow" : "Disallow", rules[i].pattern);
+    append(&text, len, &cap, "\nSitemap: http://example.com/sitemap.xml\n");
+    return text;
+}
+
+// One row of the check table; returns the number of verdicts that differ
+static int runChecks(const char *name, int ruleCount, long checks, char paths[][64], int *verdicts)
+{
+    unsigned long state = (unsigned long)ruleCount;
+    Rule *rules = malloc(sizeof(Rule) * (size_t)ruleCount);
+    for (int i = 0; i < ruleCount; i++)
+        randomRule(&rules[i], &state);
+    size_t len;
+    char *text = robotsText(rules, ruleCount, 0, &len);
+
+    long long start = nowNs();
+    RobotsRules *compiled = robotsParse(text, len, "WebCrawler");
+    double compileUs = (nowNs() - start) / 1e3;
+    if (compiled == NULL || robotsRuleCount(compiled) != ruleCount)
+    {
+        printf("%-8s FAIL: %d rules compiled of %d\n", name, compiled != NULL ? robotsRuleCount(compiled) : 0,
+               ruleCount);
+        return 1;
+    }
+
+    size_t pathLens[PATHS];
+    for (int i = 0; i < PATHS; i++)
+        pathLens[i] = strlen(paths[i]);
+    volatile long sink = 0;
+    start = nowNs();
+    for (long i = 0; i < checks; i++)
+        sink += robotsAllowed(compiled, paths[i & (PATHS - 1)], pathLens[i & (PATHS - 1)]);
+    double compiledNs = (double)(nowNs() - start) / checks;
+
+    long scans = checks / (1 + ruleCount / 50);         // The scan is slow on long files
+    if (scans < PATHS)
+        scans = PATHS;
+    start = nowNs();
+    for (long i = 0; i < scans; i++)
+        sink += scanAllowed(rules, ruleCount, paths[i & (PATHS - 1)]);
+    double scanNs = (double)(nowNs() - start) / scans;
+
+    int differ = 0, allowed = 0;
+    for (int i = 0; i < PATHS; i++)
+    {
+        verdicts[i] = robotsAllowed(compiled, paths[i], pathLens[i]);
+        allowed += verdicts[i];
+        differ += verdicts[i] != scanAllowed(rules, ruleCount, paths[i]);
+    }
+    printf("%-8s %6d %8zu %11.1f %12.1f %10.1f %8.1fx %8.1f%% %6s\n", name, ruleCount, len, compileUs, compiledNs,
+           scanNs, scanNs / compiledNs, 100.0 * allowed / PATHS, differ == 0 ? "ok" : "FAIL");
+    fflush(stdout);
+    robotsFree(compiled);
+    free(text);
+    free(rules);
+    return differ;
+}
+
+/*
+    Parse robots.txt bodies that end on a line with no newline, the way they arrive from a server: not
+    null-terminated, with their last byte right before a page that may not be read. Returns 1 if a check failed;
+    a read past the body crashes the bench.
+*/
+static int runUnterminated(void)
+{
+    static const struct
+    {
+        const char *text;
+        int rules;                      // Rules compiled for the crawler
+        int privateAllowed;             // Verdict for /private
+    } cases[] = {
+        { "User-agent: *\nDisallow: /private\n\nUser-agent: WebCrawler", 0, 1 },
+        { "User-agent: WebCrawler\nDisallow: /private", 1, 0 },
+        { "User-agent: *\nDisallow: /private\nUser-agent:", 1, 0 },
+    };
+    long page = sysconf(_SC_PAGESIZE);
+    char *map = mmap(NULL, (size_t)page * 2, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (map == MAP_FAILED || mprotect(map + page, (size_t)page, PROT_NONE) != 0)
+        return 1;
+
+    int failures = 0;
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+    {
+        size_t len = strlen(cases[i].text);
+        char *body = map + page - len;  // Ends against the guard page
+        memcpy(body, cases[i].text, len);
+        RobotsRules *rules = robotsParse(body, len, "WebCrawler");
+        int ok = rules != NULL && robotsRuleCount(rules) == cases[i].rules &&
+                 robotsAllowed(rules, "/private", 8) == cases[i].privateAllowed;
+        failures += !ok;
+        robotsFree(rules);
+    }
+    printf("\nunterminated: %zu bodies ending without a newline against a guard page  %s\n",
+           sizeof(cases) / sizeof(cases[0]), failures == 0 ? "ok" : "FAIL");
+    munmap(map, (size_t)page * 2);
+    return failures != 0;
+}
+
+// Request handler: robots.txt as the site is set up, the site graph otherwise
+static void siteHandler(const char *method, const char *path, const char *headers, HttpResponse *response,
+                        void *userdata)
+{
+    Site *site = (Site *)userdata;
+    if (strcmp(path, "/robots.txt") == 0)
+    {
+        site->robotsRequests++;
+        response->status = site->robotsStatus;
+        response->contentType = "text/plain";
+        response->body = strdup(site->robots);
+        response->size = strlen(response->body);
+        return;
+    }
+    if (site->arrivalCount < MAX_ARRIVALS)
+        site->arrivals[site->arrivalCount++] = nowNs() / 1000;
+    if (site->rules != NULL && !scanAllowed(site->rules, site->ruleCount, path))
+        site->disallowedRequests++;
+    siteGraphHandler(method, path, headers, response, &site->graph);
+}
+
+// Cache row of the check table: ns per robotsCheck() of URLs of a host whose rules are in
+static int runCacheChecks(long checks, char paths[][64], const int *verdicts)
+{
+    unsigned long state = 5000;
+    Rule *rules = malloc(sizeof(Rule) * 5000);
+    for (int i = 0; i < 5000; i++)
+        randomRule(&rules[i], &state);
+    size_t len;
+    char *text = robotsText(rules, 5000, 0, &len);
+    Site *site = calloc(1, sizeof(Site));
+    site->robotsStatus = 200;
+    site->robots = text;
+    HttpServerConfig serverConfig = { 0, 0, siteHandler, site };
+    HttpServer *server = httpServerStart(&serverConfig);
+    if (server == NULL)
+        return 1;
+
+    char (*urls)[96] = malloc(sizeof(*urls) * PATHS);
+    for (int i = 0; i < PATHS; i++)
+        snprintf(urls[i], sizeof(urls[i]), "http://127.0.0.1:%d%s", httpServerPort(server), paths[i]);
+
+    RobotsConfig config;
+    robotsConfigDefaults(&config);
+    config.onRelease = NULL;                            // robotsCheck() never parks a URL
+    RobotsCache *cache = robotsCreate(&config);
+    long long start = nowNs();
+    while (robotsCheck(cache, urls[0]) == ROBOTS_PENDING)
+        usleep(1000);
+    double fetchMs = (nowNs() - start) / 1e6;
+
+    volatile long sink = 0;
+    start = nowNs();
+    for (long i = 0; i < checks; i++)
+        sink += robotsCheck(cache, urls[i & (PATHS - 1)]);
+    double cachedNs = (double)(nowNs() - start) / checks;
+    int differ = 0;
+    for (int i = 0; i < PATHS; i++)
+        differ += (robotsCheck(cache, urls[i]) == ROBOTS_ALLOWED) != verdicts[i];
+    RobotsStats stats;
+    robotsStats(cache, &stats);
+    printf("\ncache:  %.1f ns per robotsCheck() with the large file in (fetched in %.1f ms), %ld checks, %ld hits, "
+           "%ld fetches  %s\n", cachedNs, fetchMs, stats.checks, stats.hits, stats.fetches,
+           differ == 0 && stats.fetches == 1 ? "ok" : "FAIL");
+    fflush(stdout);
+    robotsDestroy(cache);
+    httpServerStop(server);
+    free(urls);
+    free(site);
+    free(text);
+    free(rules);
+    return differ != 0 || stats.fetches != 1;
+}
+
+// 1 if page 'page' and every page above it are allowed by 'rules'
+static int reachable(const Site *site, long page)
+{
+    for (;; page = (page - 1) / site->graph.fanout)
+    {
+        char path[64];
+        snprintf(path, sizeof(path), "/n/%ld", page);
+        if (site->rules != NULL && !scanAllowed(site->rules, site->ruleCount, path))
+            return 0;
+        if (page == 0)
+            return 1;
+    }
+}
+
+// Crawl a site with the robots.txt cache on; returns the pages fetched
+static long crawlSite(Site *site, RobotsStats *stats, double *seconds)
+{
+    HttpServerConfig serverConfig = { 0, 2, siteHandler, site };
+    HttpServer *server = httpServerStart(&serverConfig);
+    if (server == NULL)
+        return -1;
+    char seed[128];
+    snprintf(seed, sizeof(seed), "http://127.0.0.1:%d/n/0", httpServerPort(server));
+
+    FetchConfig fetchConfig;
+    fetchConfigDefaults(&fetchConfig);
+    fetchConfig.retryBaseMs = 50;
+    SchedulerConfig schedulerConfig;
+    schedulerConfigDefaults(&schedulerConfig);
+    schedulerConfig.maxDepth = site->graph.depth;
+    visited_urls = visitedCreate(0);
+    UrlTable *urls = urlTableCreate(0);                 // Interned like in the crawler
+    ThreadData data = { .frontier = frontierCreate(site->graph.depth, urls),
+                        .scheduler = schedulerCreate(&schedulerConfig), .fetch = &fetchConfig, .links = stdout };
+    atomic_init(&data.pagesFetched, 0);
+    atomic_init(&data.pagesFailed, 0);
+    RobotsConfig robotsConfig;
+    robotsConfigDefaults(&robotsConfig);
+    robotsConfig.fetch = &fetchConfig;
+    robotsConfig.onRelease = crawlRobotsRelease;
+    robotsConfig.onDelay = crawlRobotsDelay;
+    robotsConfig.arg = &data;
+    data.robots = robotsCreate(&robotsConfig);
+    frontierPush(data.frontier, seed, 0);
+
+    // The crawler prints every link it finds; keep that out of the report
+    fflush(stdout);
+    int saved = dup(STDOUT_FILENO);
+    int devnull = open("/dev/null", O_WRONLY);
+    dup2(devnull, STDOUT_FILENO);
+
+    long long start = nowNs();
+    crawl(&data, 2);
+    *seconds = (nowNs() - start) / 1e9;
+
+    fflush(stdout);
+    dup2(saved, STDOUT_FILENO);
+    close(saved);
+    close(devnull);
+
+    robotsStats(data.robots, stats);
+    robotsDestroy(data.robots);
+    schedulerDestroy(data.scheduler);
+    frontierDestroy(data.frontier);
+    urlTableDestroy(urls);
+    visitedDestroy(visited_urls);
+    httpServerStop(server);
+    return atomic_load(&data.pagesFetched);
+}
+
+// One row of the crawl table; returns 1 if a check failed
+static int runSite(const char *name, Site *site, long delayMs)
+{
+    RobotsStats stats;
+    double seconds;
+    long pages = crawlSite(site, &stats, &seconds);
+    long total = siteGraphPages(&site->graph, site->graph.depth);
+    long expected = 0;
+    if (site->robotsStatus < 500)
+    {
+        for (long page = 0; page < total; page++)
+            expected += reachable(site, page);
+    }
+
+    long long minGapUs = -1;
+    for (int k = 1; k < site->arrivalCount; k++)
+        if (minGapUs < 0 || site->arrivals[k] - site->arrivals[k - 1] < minGapUs)
+            minGapUs = site->arrivals[k] - site->arrivals[k - 1];
+    int ok = pages == expected && site->robotsRequests >= 1 && site->disallowedRequests == 0 &&
+             (site->robotsStatus >= 500 || site->robotsRequests == 1) &&
+             (delayMs == 0 || minGapUs >= delayMs * 900);
+    printf("%-10s %6ld %8ld %8ld %8d %10d %8ld %10.1f %7.2f %6s\n", name, total, expected, pages,
+           site->robotsRequests, site->disallowedRequests, stats.disallowed,
+           minGapUs > 0 ? minGapUs / 1000.0 : 0.0, seconds, ok ? "ok" : "FAIL");
+    fflush(stdout);
+    return !ok;
+}
+
+int main(int argc, char *argv[])
+{
+    long checks = argc > 1 ? atol(argv[1]) : 4000000;
+    if (checks < PATHS)
+        checks = PATHS;
+
+    // The crawler writes crawler.log into the working directory
+    char dir[] = "/tmp/bench_robots.XXXXXX";
+    if (mkdtemp(dir) == NULL || chdir(dir) != 0)
+        return 1;
+    LogConfig logConfig;
+    logConfigDefaults(&logConfig);
+    logConfig.truncate = 1;
+    if (logOpen(&logConfig) != 0)
+        return 1;
+    curl_global_init(CURL_GLOBAL_ALL);
+
+    static char paths[PATHS][64];
+    static int verdicts[PATHS];
+    unsigned long state = 1;
+    for (int i = 0; i < PATHS; i++)
+    {
+        unsigned d = nextRandom(&state) % 20, s = nextRandom(&state) % 20, p = nextRandom(&state) % 50;
+        if (nextRandom(&state) % 4 == 0)
+            snprintf(paths[i], sizeof(paths[i]), "/d%u/s%u/p%u.html?q=%lu", d, s, p, nextRandom(&state) % 100);
+        else
+            snprintf(paths[i], sizeof(paths[i]), "/d%u/s%u/p%u.html", d, s, p);
+    }
+
+    printf("check: %ld URLs against each robots.txt\n\n", checks);
+    printf("%-8s %6s %8s %11s %12s %10s %9s %9s %6s\n", "file", "rules", "bytes", "compile us", "compiled ns",
+           "scan ns", "speedup", "allowed", "check");
+    int failures = 0;
+    failures += runChecks("small", 10, checks, paths, verdicts);
+    failures += runChecks("medium", 200, checks, paths, verdicts);
+    failures += runChecks("large", 5000, checks, paths, verdicts);
+    failures += runCacheChecks(checks, paths, verdicts);
+    failures += runUnterminated();
+
+    // Disallowed for the crawler: a subtree with a page in it allowed again, any page ending in 7 and a subtree
+    // named with an escape; /n/1 stays allowed although the "*" group disallows everything
+    static const char partialText[] = "User-agent: *\nDisallow: /\n\n"
+                                      "User-agent: webcrawler\nDisallow: /n/2\nAllow: /n/21$ # but this one\n"
+                                      "disallow: /*7$\nDisallow: /n/1%30\n";
+    static const Rule partial[] = {
+        { "/n/2", 0 }, { "/n/21$", 1 }, { "/*7$", 0 }, { "/n/10", 0 },
+    };
+    static const Rule everything[] = { { "/", 0 } };
+    size_t len;
+    char *delayText = robotsText(NULL, 0, 200, &len);
+
+    printf("\ncrawl: 2 workers, latency 2 ms\n\n");
+    printf("%-10s %6s %8s %8s %8s %10s %8s %10s %7s %6s\n", "robots.txt", "pages", "expected", "fetched", "robots",
+           "disallowed", "dropped", "min gap ms", "seconds", "check");
+    Site *site = calloc(1, sizeof(Site));
+    *site = (Site){ .graph = { 4, 3, 1024 }, .robotsStatus = 200, .robots = partialText, .rules = partial,
+                    .ruleCount = 4 };
+    failures += runSite("partial", site, 0);
+    *site = (Site){ .graph = { 4, 3, 1024 }, .robotsStatus = 404, .robots = "not found" };
+    failures += runSite("404", site, 0);
+    *site = (Site){ .graph = { 4, 3, 1024 }, .robotsStatus = 503, .robots = "busy", .rules = everything,
+                    .ruleCount = 1 };
+    failures += runSite("503", site, 0);
+    *site = (Site){ .graph = { 4, 2, 1024 }, .robotsStatus = 200, .robots = delayText };
+    failures += runSite("delay 200", site, 200);
+    free(site);
+    free(delayText);
+
+    curl_global_cleanup();
+    logClose();
+    unlink("crawler.log");
+    if (chdir("/") == 0)
+        rmdir(dir);
+    return failures ? 1 : 0;
+}
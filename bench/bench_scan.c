@@ -0,0 +1,307 @@
+/*
+Operating Systems Spring 2024
+Final Project
+
+Benchmark: href scanner throughput, and a differential check against libxml2.
+
+The corpus is loaded into memory first, so only scanning is timed. It reports:
+  text        GB/s over text without markup, bound by memchr()
+  whole page  GB/s of the scanner fed one page at a time
+  16 KB       GB/s of the scanner fed the way curl delivers a body
+
+The differential check parses every page with htmlReadMemory() and lists the href of every <a>
+element in document order. The scanner must produce exactly the same list with the page cut into
+chunks of 1 byte, 16 KB and random sizes, so no link is lost or invented at a chunk boundary. Besides the corpus, a set of hand-written pages covers the
+corner cases: case, quoting, references, comments, scripts and attributes without values.
+
+Without a directory, or with "-", a synthetic corpus (see htmlcorpus.h) is generated in /tmp and
+removed afterwards.
+
+Usage: bench_scan [corpus-dir] [passes]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <libxml/HTMLparser.h>
+
+#include "htmlcorpus.h"
+#include "htmlscan.h"
+
+// Hand-written corner cases, checked against libxml2 like the corpus
+static const char *cornerCases[] = {
+    "<a href=\"http://a.example/1\">x</a><A HREF='http://a.example/2'>y</A><a hReF=http://a.example/3>z</a>",
+    "<a\nhref\n=\n\"http://b.example/spaced\"\n>x</a><a\thref=http://b.example/tab\t>y</a>",
+    "<a href=\"http://c.example/?a=1&amp;b=2&lt;&gt;&quot;&#65;&#x42;&nbsp;\">refs</a>",
+    "<a href=\"http://c.example/&unknown;&amp\">kept verbatim</a>",
+    "<a name=x>no href</a><a href>empty</a><a href=\"\">empty string</a><a download href=\"/d\">flag first</a>",
+    "<abbr href=\"http://d.example/no\">not a</abbr><area href=\"http://d.example/area\"><ab href=x>no</ab>",
+    "<!-- <a href=\"http://e.example/comment\"> -- still comment --><a href=\"http://e.example/after\">ok</a>",
+    "<!DOCTYPE html><?xml version=\"1.0\"?><a href=\"http://f.example/pi\">ok</a>",
+    "<script>document.write('<a href=\"http://g.example/script\">');</script ><a href=/after-script>ok</a>",
+    "<style>a > b { content: \"<a href='http://g.example/style'>\"; }</STYLE><a href=/after-style>ok</a>",
+    "<p title=\"x > y\" data-x='<a href=\"http://h.example/in-attr\">'>text</p><a href=/after-attr>ok</a>",
+    "<a href=\"http://i.example/first\" href=\"http://i.example/second\">dup</a>",
+    "<a href='http://j.example/quote\"inside'>q</a><a href=\"http://j.example/it's\">q</a>",
+    "1 < 2 and 3 > 2 <a href=http://k.example/after-lt>ok</a> <<a href=http://k.example/double>ok</a>",
+    "<a href=\"http://l.example/a\"/><a/href=\"http://l.example/slash\">s</a><br/><a href=x/>",
+    "<div><a href=\"/n1\"><span><a href=\"/n2\">nested</a></span></a></div>",
+};
+
+typedef struct
+{
+    char **items;
+    int count, cap;
+} LinkList;
+
+static double nowSeconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void listAdd(LinkList *list, const char *href)
+{
+    if (list->count == list->cap)
+    {
+        list->cap = list->cap ? list->cap * 2 : 64;
+        list->items = realloc(list->items, sizeof(char *) * list->cap);
+    }
+    list->items[list->count++] = strdup(href);
+}
+
+static void listClear(LinkList *list)
+{
+    for (int i = 0; i < list->count; i++)
+        free(list->items[i]);
+    list->count = 0;
+}
+
+// Every <a href> of the DOM, in document order
+static void domLinks(xmlNode *node, LinkList *list)
+{
+    for (; node; node = node->next)
+    {
+        if (node->type == XML_ELEMENT_NODE && !xmlStrcmp(node->name, (const xmlChar *)"a"))
+        {
+            xmlChar *href = xmlGetProp(node, (const xmlChar *)"href");
+            if (href)
+            {
+                listAdd(list, (const char *)href);
+                xmlFree(href);
+            }
+        }
+        domLinks(node->children, list);
+    }
+}
+
+static void collectLink(HtmlLinkKind kind, const char *href, size_t len, void *userdata)
+{
+    (void)len;
+    if (kind == HTML_LINK_A)
+        listAdd((LinkList *)userdata, href);
+}
+
+static void countLink(HtmlLinkKind kind, const char *href, size_t len, void *userdata)
+{
+    (void)kind;
+    (void)href;
+    (void)len;
+    (*(long *)userdata)++;
+}
+
+// Scan 'page' in chunks of 'chunk' bytes (0 = random sizes) into 'list'
+static void scanLinks(const char *page, size_t size, size_t chunk, LinkList *list)
+{
+    HtmlScanner scanner;
+    unsigned rng = 12345;
+    htmlScannerInit(&scanner, collectLink, list);
+    for (size_t off = 0; off < size;)
+    {
+        size_t n = chunk;
+        if (n == 0)
+        {
+            rng = rng * 1103515245 + 12345;
+            n = 1 + (rng >> 16) % 97;
+        }
+        if (n > size - off)
+            n = size - off;
+        htmlScannerFeed(&scanner, page + off, n);
+        off += n;
+    }
+    htmlScannerFinish(&scanner);
+}
+
+// Compare the scanner with libxml2 on one page, print the first difference
+static int checkPage(const char *name, const char *page, size_t size)
+{
+    static const size_t chunks[] = { 1, 16384, 0, (size_t)-1 };
+    LinkList expected = { 0 }, got = { 0 };
+    int failures = 0;
+
+    htmlDocPtr doc = htmlReadMemory(page, (int)size, NULL, NULL,
+                                    HTML_PARSE_NOERROR | HTML_PARSE_NOWARNING | HTML_PARSE_NONET);
+    if (doc)
+    {
+        domLinks(doc->children, &expected);
+        xmlFreeDoc(doc);
+    }
+
+    for (size_t c = 0; c < sizeof(chunks) / sizeof(chunks[0]); c++)
+    {
+        listClear(&got);
+        scanLinks(page, size, chunks[c], &got);
+        int i = 0;
+        while (i < got.count && i < expected.count && strcmp(got.items[i], expected.items[i]) == 0)
+            i++;
+        if (i < got.count || i < expected.count)
+        {
+            printf("MISMATCH %s, chunk %s: %d links, libxml2 %d; first difference at %d: \"%s\" vs \"%s\"\n",
+                   name, chunks[c] == 0 ? "random" : chunks[c] == (size_t)-1 ? "whole" : chunks[c] == 1 ? "1" : "16K",
+                   got.count, expected.count, i, i < got.count ? got.items[i] : "(none)",
+                   i < expected.count ? expected.items[i] : "(none)");
+            failures++;
+        }
+    }
+
+    listClear(&expected);
+    listClear(&got);
+    free(expected.items);
+    free(got.items);
+    return failures;
+}
+
+static char *readFile(const char *path, size_t *size)
+{
+    FILE *in = fopen(path, "rb");
+    if (in == NULL)
+        return NULL;
+    fseek(in, 0, SEEK_END);
+    long len = ftell(in);
+    fseek(in, 0, SEEK_SET);
+    char *data = malloc((size_t)len + 1);
+    if (data == NULL || fread(data, 1, (size_t)len, in) != (size_t)len)
+    {
+        free(data);
+        fclose(in);
+        return NULL;
+    }
+    fclose(in);
+    data[len] = '\0';
+    *size = (size_t)len;
+    return data;
+}
+
+// GB/s of the scanner over every page, fed in chunks of 'chunk' bytes (0 = whole pages)
+static double scanSpeed(char **pages, size_t *sizes, int count, int passes, size_t chunk, long *links)
+{
+    double start = nowSeconds();
+    size_t bytes = 0;
+    *links = 0;
+    for (int pass = 0; pass < passes; pass++)
+    {
+        for (int i = 0; i < count; i++)
+        {
+            HtmlScanner scanner;
+            htmlScannerInit(&scanner, countLink, links);
+            size_t step = chunk ? chunk : sizes[i];
+            for (size_t off = 0; off < sizes[i]; off += step)
+                htmlScannerFeed(&scanner, pages[i] + off, sizes[i] - off < step ? sizes[i] - off : step);
+            htmlScannerFinish(&scanner);
+            bytes += sizes[i];
+        }
+    }
+    return bytes / (nowSeconds() - start) / 1e9;
+}
+
+// GB/s over text with no markup, where the scanner does nothing but look for '<'
+static double textSpeed(int passes)
+{
+    size_t size = 1 << 20;
+    char *text = malloc(size);
+    for (size_t i = 0; i < size; i++)
+        text[i] = "lorem ipsum dolor sit amet "[i % 27];
+    long links = 0;
+    double start = nowSeconds();
+    for (int pass = 0; pass < passes * 20; pass++)
+    {
+        HtmlScanner scanner;
+        htmlScannerInit(&scanner, countLink, &links);
+        htmlScannerFeed(&scanner, text, size);
+    }
+    double speed = (double)size * passes * 20 / (nowSeconds() - start) / 1e9;
+    free(text);
+    return speed;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *dir = argc > 1 && strcmp(argv[1], "-") != 0 ? argv[1] : NULL;
+    int passes = argc > 2 ? atoi(argv[2]) : 10;
+    char tmpdir[] = "/tmp/bench_scan.XXXXXX";
+
+    if (dir == NULL)
+    {
+        if (mkdtemp(tmpdir) == NULL || htmlCorpusGenerate(tmpdir, 200, 2024) < 0)
+            return 1;
+        dir = tmpdir;
+    }
+
+    int count = 0;
+    char **files = htmlCorpusFiles(dir, &count);
+    if (files == NULL || count == 0)
+    {
+        fprintf(stderr, "No pages in %s\n", dir);
+        return 1;
+    }
+
+    char **pages = malloc(sizeof(char *) * count);
+    size_t *sizes = malloc(sizeof(size_t) * count);
+    size_t total = 0;
+    for (int i = 0; i < count; i++)
+    {
+        pages[i] = readFile(files[i], &sizes[i]);
+        if (pages[i] == NULL)
+        {
+            pages[i] = strdup("");
+            sizes[i] = 0;
+        }
+        total += sizes[i];
+    }
+    printf("corpus: %d pages, %.1f MB in memory, %d passes\n\n", count, total / 1e6, passes);
+    printf("%10s %16s %12s %10s %12s\n", "text GB/s", "whole page GB/s", "16 KB GB/s", "links", "differential");
+
+    int failures = 0;
+    for (size_t i = 0; i < sizeof(cornerCases) / sizeof(cornerCases[0]); i++)
+    {
+        char label[32];
+        snprintf(label, sizeof(label), "corner case %zu", i);
+        failures += checkPage(label, cornerCases[i], strlen(cornerCases[i]));
+    }
+    for (int i = 0; i < count; i++)
+        failures += checkPage(files[i], pages[i], sizes[i]);
+
+    long links = 0, chunkLinks = 0;
+    double text = textSpeed(passes);
+    double whole = scanSpeed(pages, sizes, count, passes, 0, &links);
+    double chunked = scanSpeed(pages, sizes, count, passes, 16384, &chunkLinks);
+    printf("%10.2f %16.2f %12.2f %10ld %12s\n", text, whole, chunked, links / passes,
+           failures == 0 && links == chunkLinks ? "ok" : "MISMATCH");
+    failures += links != chunkLinks;
+
+    for (int i = 0; i < count; i++)
+        free(pages[i]);
+    free(pages);
+    free(sizes);
+    if (dir == tmpdir)
+    {
+        for (int i = 0; i < count; i++)
+            unlink(files[i]);
+        rmdir(tmpdir);
+    }
+    htmlCorpusFree(files, count);
+    return failures ? 1 : 0;
+}
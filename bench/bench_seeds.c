@@ -0,0 +1,438 @@
+/*
+Operating Systems Spring 2024
+Final Project
+
+Benchmark: loading a large seed file into the frontier, and how soon the crawl starts.
+
+A seed file of 'lines' lines (10 million by default) is written to a temporary directory, plain and gzip
+(level 1), with URLs of the local stand-in server: a distinct path per line, plus a line in 50 repeating
+an earlier URL, one in 1000 a comment, one in 5000 blank and one in 10007 an ftp:// URL.
+
+  load      The file is queued into an empty frontier with its URL table and visited set, each row in a
+            child process of its own so its peak memory is its own: by the getline() loop the crawler
+            used before (one thread, a line at a time), and by the seed loader from the mapped file and
+            from the gzip file, with 1 and 4 threads. Every row queues a URL the way the crawler does:
+            normalized, checked against the visited set and pushed at depth 0. Reported are the URLs
+            queued, the time to the first one and to the last, the rate in URLs/sec and the peak RSS;
+            every row must queue and skip the same URLs.
+  first     Time to first fetch: a child process loads the plain file and crawls it with 4 workers, and
+            the stand-in server notes when the first request arrives; the child is then killed. Loading
+            every line before crawling, as the crawler did, against crawling while the loader goes on.
+            The streamed start must come in under a tenth of the time.
+
+Usage: bench_seeds [lines]
+*/
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <curl/curl.h>
+#include <zlib.h>
+
+#include "crawler.h"
+#include "httpserver.h"
+
+// Ways of loading a row of the load table
+typedef enum
+{
+    LOAD_GETLINE,
+    LOAD_MAPPED,
+    LOAD_GZIP
+} LoadMode;
+
+// Outcome of a load, written by the child process of the row
+typedef struct
+{
+    long queued, skipped, invalid;
+    double firstMs;             // Time to the first URL queued
+    double seconds;             // Time to the last
+    long rssMb;                 // Peak resident memory of the child
+} LoadResult;
+
+// Where the URLs of a load go, as with the crawler's queueSeed()
+typedef struct
+{
+    Frontier *frontier;
+    atomic_long queued, skipped, invalid;
+    double start;
+    double firstMs;             // Set by the first URL queued, 0 before
+    atomic_int first;
+} LoadTarget;
+
+// Time the stand-in server saw its first request, in ms of the monotonic clock, 0 for none yet
+static _Atomic double firstRequest;
+
+static double nowMsDouble(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+// A small page with no links, noting the first request
+static void pageHandler(const char *method, const char *path, const char *headers, HttpResponse *response,
+                        void *userdata)
+{
+    static const char text[] = "<html><body>Seed</body></html>";
+    double none = 0;
+    (void)method;
+    (void)path;
+    (void)headers;
+    (void)userdata;
+    atomic_compare_exchange_strong(&firstRequest, &none, nowMsDouble());
+    response->body = malloc(sizeof(text) - 1);
+    response->size = response->body != NULL ? sizeof(text) - 1 : 0;
+    if (response->body != NULL)
+        memcpy(response->body, text, sizeof(text) - 1);
+}
+
+// Counts of the seed file the loads must find
+typedef struct
+{
+    long lines, urls, repeats, invalid;
+} SeedFile;
+
+// Write the seed file, plain to 'plain' and gzip to 'gzip'; 0 or -1
+static int writeSeeds(const char *plain, const char *gzip, int port, long lines, SeedFile *file)
+{
+    FILE *out = fopen(plain, "w");
+    gzFile zout = gzopen(gzip, "wb1");
+    if (out == NULL || zout == NULL)
+        return -1;
+    gzbuffer(zout, 1024 * 1024);
+    memset(file, 0, sizeof(*file));
+    char line[256];
+    for (long i = 0; i < lines; i++)
+    {
+        int len;
+        if (i % 5000 == 4999)
+            len = snprintf(line, sizeof(line), "\n");
+        else if (i % 1000 == 999)
+            len = snprintf(line, sizeof(line), "# line %ld\n", i);
+        else if (i % 10007 == 10006)
+        {
+            len = snprintf(line, sizeof(line), "ftp://127.0.0.1/%ld\n", i);
+            file->invalid++;
+        }
+        else if (i % 50 == 49 && (i - 25) % 10007 != 10006)
+        {
+            len = snprintf(line, sizeof(line), "http://127.0.0.1:%d/s/%ld\n", port, i - 25);
+            file->repeats++;
+        }
+        else
+        {
+            len = snprintf(line, sizeof(line), "http://127.0.0.1:%d/s/%ld\n", port, i);
+            file->urls++;
+        }
+        fwrite(line, 1, (size_t)len, out);
+        gzwrite(zout, line, (unsigned)len);
+    }
+    file->lines = lines;
+    int failed = fclose(out) != 0;
+    failed |= gzclose(zout) != Z_OK;
+    return failed ? -1 : 0;
+}
+
+// Queue a URL as the crawler's queueSeed() does, without a journal or a cluster
+static int queueUrl(LoadTarget *target, const char *text, size_t len)
+{
+    char given[FRONTIER_MAX_URL];
+    char seed[FRONTIER_MAX_URL];
+    const char *scheme = memmem(text, len, "://", 3) != NULL ? "" : "http://";
+    size_t schemeLen = strlen(scheme);
+    int result = SEED_INVALID;
+    if (len < sizeof(given) - schemeLen)
+    {
+        memcpy(given, scheme, schemeLen);
+        memcpy(given + schemeLen, text, len);
+        if (urlNormalize(NULL, given, schemeLen + len, seed, sizeof(seed)) >= 0)
+        {
+            if (isVisited(seed))
+                result = SEED_SKIPPED;
+            else
+            {
+                int pushed = frontierPush(target->frontier, seed, 0);
+                result = pushed == 0 ? SEED_QUEUED : pushed > 0 ? SEED_SKIPPED : SEED_INVALID;
+            }
+        }
+    }
+
+    if (result == SEED_QUEUED)
+    {
+        atomic_fetch_add(&target->queued, 1);
+        int none = 0;
+        if (atomic_compare_exchange_strong(&target->first, &none, 1))
+            target->firstMs = nowMsDouble() - target->start;
+    }
+    else if (result == SEED_SKIPPED)
+        atomic_fetch_add(&target->skipped, 1);
+    else
+        atomic_fetch_add(&target->invalid, 1);
+    return result;
+}
+
+// onUrl callback of the seed loader
+static int loadUrl(const char *url, size_t len, void *arg)
+{
+    return queueUrl((LoadTarget *)arg, url, len);
+}
+
+// onDone callback of the seed loader in the crawls of the first table: the crawl may end now
+static void loadDone(void *arg)
+{
+    frontierDone(((LoadTarget *)arg)->frontier, 1);
+}
+
+// The crawler's loop before the seed loader: getline(), strip, queue
+static void loadGetline(LoadTarget *target, const char *path)
+{
+    FILE *file = fopen(path, "r");
+    if (file == NULL)
+        return;
+    char *line = NULL;
+    size_t cap = 0;
+    ssize_t len;
+    while ((len = getline(&line, &cap, file)) >= 0)
+    {
+        while (len > 0 && (unsigned char)line[len - 1] <= ' ')
+            line[--len] = '\0';
+        char *url = line;
+        while (*url == ' ' || *url == '\t')
+            url++;
+        if (*url == '\0' || *url == '#')
+            continue;
+        queueUrl(target, url, strlen(url));
+    }
+    free(line);
+    fclose(file);
+}
+
+// Load 'path' into a fresh frontier in this process and return the outcome
+static LoadResult loadRow(LoadMode mode, int threads, const char *path)
+{
+    visited_urls = visitedCreate(0);
+    UrlTable *urls = urlTableCreate(0);
+    LoadTarget target = { .frontier = frontierCreate(0, urls) };
+    atomic_init(&target.queued, 0);
+    atomic_init(&target.skipped, 0);
+    atomic_init(&target.invalid, 0);
+    atomic_init(&target.first, 0);
+    target.start = nowMsDouble();
+    if (mode == LOAD_GETLINE)
+    {
+        loadGetline(&target, path);
+    }
+    else
+    {
+        SeedConfig config;
+        seedConfigDefaults(&config);
+        config.threads = threads;
+        config.onUrl = loadUrl;
+        config.arg = &target;
+        const char *paths[] = { path };
+        SeedLoader *loader = seedLoadStart(paths, 1, &config);
+        if (loader != NULL)
+            seedLoadWait(loader, NULL);
+    }
+
+    LoadResult result;
+    result.seconds = (nowMsDouble() - target.start) / 1e3;
+    result.firstMs = target.firstMs;
+    result.queued = atomic_load(&target.queued);
+    result.skipped = atomic_load(&target.skipped);
+    result.invalid = atomic_load(&target.invalid);
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    result.rssMb = usage.ru_maxrss / 1024;
+    frontierDestroy(target.frontier);
+    urlTableDestroy(urls);
+    visitedDestroy(visited_urls);
+    return result;
+}
+
+// Run a load in a child process; 0, or -1 if the child failed
+static int forkLoad(LoadMode mode, int threads, const char *path, LoadResult *result)
+{
+    int fds[2];
+    if (pipe(fds) != 0)
+        return -1;
+    fflush(stdout);
+    pid_t child = fork();
+    if (child < 0)
+        return -1;
+    if (child == 0)
+    {
+        close(fds[0]);
+        LoadResult row = loadRow(mode, threads, path);
+        _exit(write(fds[1], &row, sizeof(row)) == (ssize_t)sizeof(row) ? 0 : 1);
+    }
+    close(fds[1]);
+    ssize_t got = read(fds[0], result, sizeof(*result));
+    close(fds[0]);
+    int status;
+    waitpid(child, &status, 0);
+    return got == (ssize_t)sizeof(*result) && WIFEXITED(status) && WEXITSTATUS(status) == 0 ? 0 : -1;
+}
+
+// Load rates of the ways of loading; returns the number of failed checks
+static int benchLoad(const char *plain, const char *gzip, const SeedFile *file)
+{
+    static const struct
+    {
+        const char *name;
+        LoadMode mode;
+        int threads;
+        int gzip;
+    } rows[] = {
+        { "getline", LOAD_GETLINE, 1, 0 },
+        { "mapped", LOAD_MAPPED, 1, 0 },
+        { "mapped", LOAD_MAPPED, 4, 0 },
+        { "gzip", LOAD_GZIP, 1, 1 },
+        { "gzip", LOAD_GZIP, 4, 1 },
+    };
+    int failures = 0;
+    printf("load: %ld lines, %ld distinct URLs, %ld repeated, %ld invalid\n", file->lines, file->urls,
+           file->repeats, file->invalid);
+    printf("%-8s %7s %10s %8s %9s %8s %12s %7s %6s\n", "file", "threads", "queued", "skipped", "first ms",
+           "seconds", "URLs/sec", "RSS MB", "check");
+    for (size_t i = 0; i < sizeof(rows) / sizeof(rows[0]); i++)
+    {
+        LoadResult r;
+        int ok = forkLoad(rows[i].mode, rows[i].threads, rows[i].gzip ? gzip : plain, &r) == 0 &&
+                 r.queued == file->urls && r.skipped == file->repeats && r.invalid == file->invalid;
+        failures += !ok;
+        printf("%-8s %7d %10ld %8ld %9.1f %8.2f %12.0f %7ld %6s\n", rows[i].name, rows[i].threads, r.queued,
+               r.skipped, r.firstMs, r.seconds, r.seconds > 0 ? r.queued / r.seconds : 0.0, r.rssMb,
+               ok ? "ok" : "FAILED");
+    }
+    return failures;
+}
+
+// In a child process: load the seed file and crawl it, all lines first or while loading, until killed
+static void crawlChild(const char *path, int streamed)
+{
+    visited_urls = visitedCreate(0);
+    UrlTable *urls = urlTableCreate(0);
+    SchedulerConfig schedulerConfig;
+    schedulerConfigDefaults(&schedulerConfig);
+    schedulerConfig.maxDepth = 0;
+    FetchConfig fetchConfig;
+    fetchConfigDefaults(&fetchConfig);
+    ThreadData data = { .frontier = frontierCreate(0, urls), .scheduler = schedulerCreate(&schedulerConfig),
+                        .fetch = &fetchConfig };
+    atomic_init(&data.pagesFetched, 0);
+    atomic_init(&data.pagesFailed, 0);
+
+    LoadTarget target = { .frontier = data.frontier };
+    atomic_init(&target.queued, 0);
+    atomic_init(&target.skipped, 0);
+    atomic_init(&target.invalid, 0);
+    atomic_init(&target.first, 0);
+    target.start = nowMsDouble();
+    SeedConfig config;
+    seedConfigDefaults(&config);
+    config.onUrl = loadUrl;
+    config.onDone = loadDone;
+    config.arg = &target;
+    const char *paths[] = { path };
+    frontierHold(data.frontier);
+    SeedLoader *loader = seedLoadStart(paths, 1, &config);
+    if (loader == NULL)
+        _exit(1);
+    if (streamed)
+        seedLoadFirst(loader);
+    else
+        seedLoadWait(loader, NULL);
+    crawl(&data, 4);
+    _exit(0);
+}
+
+// Time to first fetch, loading everything first against streaming; returns the number of failed checks
+static int benchFirst(const char *plain, long lines)
+{
+    double loadFirst = 0;
+    int failures = 0;
+    printf("\nfirst: time to the first request of a crawl of the %ld-line file, 4 workers\n", lines);
+    printf("%-14s %14s %6s\n", "start", "first fetch ms", "check");
+    for (int streamed = 0; streamed < 2; streamed++)
+    {
+        atomic_store(&firstRequest, 0);
+        fflush(stdout);
+        double start = nowMsDouble();
+        pid_t child = fork();
+        if (child < 0)
+            return failures + 1;
+        if (child == 0)
+        {
+            // The crawl logs every page; keep that out of the report
+            freopen("/dev/null", "w", stderr);
+            crawlChild(plain, streamed);
+        }
+        while (atomic_load(&firstRequest) == 0 && nowMsDouble() - start < 600e3 && waitpid(child, NULL, WNOHANG) == 0)
+            usleep(1000);
+        double first = atomic_load(&firstRequest);
+        kill(child, SIGKILL);
+        waitpid(child, NULL, 0);
+
+        double ms = first > 0 ? first - start : -1;
+        int ok = ms >= 0;
+        if (streamed == 0)
+            loadFirst = ms;
+        else
+            ok = ok && ms < loadFirst / 10;
+        failures += !ok;
+        printf("%-14s %14.1f %6s\n", streamed ? "while loading" : "after loading", ms, ok ? "ok" : "FAILED");
+    }
+    return failures;
+}
+
+int main(int argc, char *argv[])
+{
+    long lines = 10000000;
+    if (argc > 1)
+        lines = atol(argv[1]);
+    if (lines < 20000)
+    {
+        fprintf(stderr, "Usage: %s [lines]   (at least 20000)\n", argv[0]);
+        return 2;
+    }
+
+    // The crawler writes crawler.log into the working directory
+    char dir[] = "/tmp/bench_seeds.XXXXXX";
+    if (mkdtemp(dir) == NULL || chdir(dir) != 0)
+        return 1;
+    LogConfig logConfig;
+    logConfigDefaults(&logConfig);
+    logConfig.truncate = 1;
+    if (logOpen(&logConfig) != 0)
+        return 1;
+    curl_global_init(CURL_GLOBAL_ALL);
+
+    HttpServerConfig serverConfig = { 0, 0, pageHandler, NULL };
+    HttpServer *server = httpServerStart(&serverConfig);
+    SeedFile file;
+    int failures = 1;
+    if (server != NULL && writeSeeds("seeds.txt", "seeds.txt.gz", httpServerPort(server), lines, &file) == 0)
+    {
+        failures = benchLoad("seeds.txt", "seeds.txt.gz", &file);
+        failures += benchFirst("seeds.txt", lines);
+    }
+    if (server != NULL)
+        httpServerStop(server);
+
+    unlink("seeds.txt");
+    unlink("seeds.txt.gz");
+    curl_global_cleanup();
+    logClose();
+    unlink("crawler.log");
+    if (chdir("/") == 0)
+        rmdir(dir);
+    return failures ? 1 : 0;
+}
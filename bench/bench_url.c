@@ -0,0 +1,373 @@
+/*
+Operating Systems Spring 2024
+Final Project
+
+Benchmark: URL normalization throughput and the memory interning saves the frontier.
+
+First a list of links with known results is resolved and normalized (the examples of RFC 3986,
+section 5.4, plus case, port, escape and scheme cases); every result must match.
+
+Then a synthetic link stream is generated the way a crawl sees it: pages of a few sites, each
+linking to the site's navigation pages and to its articles (popular ones more often), plus a few
+other sites, spelled as absolute, root-relative, relative, scheme-relative or upper-case links
+with default ports, dot segments and fragments. The stream is normalized against each link's
+page to give URLs/sec, and every result is normalized again, which must give it back unchanged.
+
+Last, the normalized stream is pushed into a frontier that keeps a copy of every URL, and into
+one that interns them in a URL table; the heap in use after the pushes (from mallinfo2()) gives
+the memory each takes, and popping the interned frontier must give every distinct URL once.
+
+Usage: bench_url [links]   (default: 2000000)
+*/
+
+#include <malloc.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "frontier.h"
+#include "hash.h"
+#include "url.h"
+#include "urltable.h"
+
+// Shape of the synthetic crawl
+#define SITES 20
+#define SECTIONS 10
+#define ARTICLES 1000
+#define LINKS_PER_PAGE 50
+
+// A link with the URL it must normalize to, NULL if it must be rejected
+typedef struct
+{
+    const char *base;
+    const char *href;
+    const char *expected;
+} Case;
+
+static const Case CASES[] = {
+    // RFC 3986, section 5.4.1 and 5.4.2, on an http base
+    { "http://a/b/c/d;p?q", "g", "http://a/b/c/g" },
+    { "http://a/b/c/d;p?q", "./g", "http://a/b/c/g" },
+    { "http://a/b/c/d;p?q", "g/", "http://a/b/c/g/" },
+    { "http://a/b/c/d;p?q", "/g", "http://a/g" },
+    { "http://a/b/c/d;p?q", "//g", "http://g/" },
+    { "http://a/b/c/d;p?q", "?y", "http://a/b/c/d;p?y" },
+    { "http://a/b/c/d;p?q", "g?y", "http://a/b/c/g?y" },
+    { "http://a/b/c/d;p?q", "#s", "http://a/b/c/d;p?q" },
+    { "http://a/b/c/d;p?q", "g#s", "http://a/b/c/g" },
+    { "http://a/b/c/d;p?q", "g?y#s", "http://a/b/c/g?y" },
+    { "http://a/b/c/d;p?q", ";x", "http://a/b/c/;x" },
+    { "http://a/b/c/d;p?q", "", "http://a/b/c/d;p?q" },
+    { "http://a/b/c/d;p?q", ".", "http://a/b/c/" },
+    { "http://a/b/c/d;p?q", "./", "http://a/b/c/" },
+    { "http://a/b/c/d;p?q", "..", "http://a/b/" },
+    { "http://a/b/c/d;p?q", "../", "http://a/b/" },
+    { "http://a/b/c/d;p?q", "../g", "http://a/b/g" },
+    { "http://a/b/c/d;p?q", "../..", "http://a/" },
+    { "http://a/b/c/d;p?q", "../../g", "http://a/g" },
+    { "http://a/b/c/d;p?q", "../../../g", "http://a/g" },
+    { "http://a/b/c/d;p?q", "/./g", "http://a/g" },
+    { "http://a/b/c/d;p?q", "/../g", "http://a/g" },
+    { "http://a/b/c/d;p?q", "g.", "http://a/b/c/g." },
+    { "http://a/b/c/d;p?q", ".g", "http://a/b/c/.g" },
+    { "http://a/b/c/d;p?q", "g..", "http://a/b/c/g.." },
+    { "http://a/b/c/d;p?q", "..g", "http://a/b/c/..g" },
+    { "http://a/b/c/d;p?q", "./../g", "http://a/b/g" },
+    { "http://a/b/c/d;p?q", "./g/.", "http://a/b/c/g/" },
+    { "http://a/b/c/d;p?q", "g/./h", "http://a/b/c/g/h" },
+    { "http://a/b/c/d;p?q", "g/../h", "http://a/b/c/h" },
+    { "http://a/b/c/d;p?q", "g;x=1/./y", "http://a/b/c/g;x=1/y" },
+    { "http://a/b/c/d;p?q", "g;x=1/../y", "http://a/b/c/y" },
+    { "http://a/b/c/d;p?q", "g?y/./x", "http://a/b/c/g?y/./x" },
+    { "http://a/b/c/d;p?q", "http:g", "http://a/b/c/g" },
+    // Canonical form
+    { NULL, "HTTP://Example.COM:80/a/%7euser/%2f%41?x=%3d#frag", "http://example.com/a/~user/%2FA?x=%3D" },
+    { NULL, "https://example.com:443", "https://example.com/" },
+    { NULL, "https://example.com:8443/", "https://example.com:8443/" },
+    { NULL, "http://example.com:0080/", "http://example.com/" },
+    { NULL, "http://example.com/a b\"c", "http://example.com/a%20b%22c" },
+    { NULL, " \thttp://example.com/x\n/y ", "http://example.com/x/y" },
+    { NULL, "http://example.com/caf\xc3\xa9", "http://example.com/caf%C3%A9" },
+    { NULL, "http://example.com/100%", "http://example.com/100%25" },
+    { NULL, "http://example.com/?", "http://example.com/" },
+    { NULL, "http://user:pw@Example.com/", "http://user:pw@example.com/" },
+    { NULL, "http://[::1]:8080/x", "http://[::1]:8080/x" },
+    { "http://h/a/", "\\\\other\\path", "http://other/path" },
+    { "https://h/x", "//cdn.example/lib.js", "https://cdn.example/lib.js" },
+    { "https://h/x", "http://h/x", "http://h/x" },
+    // Rejected
+    { NULL, "mailto:someone@example.com", NULL },
+    { "http://h/", "javascript:void(0)", NULL },
+    { "http://h/", "ftp://h/file", NULL },
+    { NULL, "/relative", NULL },
+    { NULL, "http://exa mple.com/", NULL },
+    { NULL, "http://example.com:99999/", NULL },
+    { NULL, "http://example.com:8o/", NULL },
+    { NULL, "http:///", NULL },
+};
+
+static double nowSeconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Bytes of heap in use
+static size_t heapInUse(void)
+{
+    struct mallinfo2 info = mallinfo2();
+    return info.uordblks + info.hblkhd;
+}
+
+static uint64_t nextRandom(uint64_t *state)
+{
+    *state += 0x9e3779b97f4a7c15ULL;
+    return mix64(*state);
+}
+
+// Run the known cases; returns the number that failed
+static int runCases(void)
+{
+    int count = (int)(sizeof(CASES) / sizeof(CASES[0])), failed = 0;
+    for (int i = 0; i < count; i++)
+    {
+        char out[URL_MAX_INPUT];
+        int len = urlNormalize(CASES[i].base, CASES[i].href, strlen(CASES[i].href), out, sizeof(out));
+        const char *got = len < 0 ? NULL : out;
+        int ok = (got == NULL && CASES[i].expected == NULL) ||
+                 (got != NULL && CASES[i].expected != NULL && strcmp(got, CASES[i].expected) == 0);
+        if (!ok)
+        {
+            printf("FAIL: base %s, link \"%s\": got %s, expected %s\n", CASES[i].base ? CASES[i].base : "(none)",
+                   CASES[i].href, got ? got : "(rejected)", CASES[i].expected ? CASES[i].expected : "(rejected)");
+            failed++;
+        }
+    }
+    printf("normalization cases                %d, %d failed\n", count, failed);
+    return failed;
+}
+
+// Stream of links as they are found, each with the URL of its page
+typedef struct
+{
+    char *bases;        // Page URLs, null-terminated one after another
+    char *hrefs;        // Links, null-terminated one after another
+    size_t *baseOff;    // Per link: offset of its page's URL in 'bases'
+    size_t *hrefOff;    // Per link: offset of the link in 'hrefs'
+    long count;
+} LinkStream;
+
+// Append a string to a growing buffer; returns its offset
+static size_t appendString(char **buf, size_t *len, size_t *cap, const char *s)
+{
+    size_t n = strlen(s) + 1;
+    if (*len + n > *cap)
+    {
+        *cap = (*len + n) * 2;
+        *buf = realloc(*buf, *cap);
+    }
+    memcpy(*buf + *len, s, n);
+    *len += n;
+    return *len - n;
+}
+
+// Generate 'count' links found on pages of the synthetic sites
+static void makeStream(LinkStream *stream, long count)
+{
+    size_t basesLen = 0, basesCap = 1 << 20, hrefsLen = 0, hrefsCap = 1 << 24;
+    stream->bases = malloc(basesCap);
+    stream->hrefs = malloc(hrefsCap);
+    stream->baseOff = malloc(sizeof(size_t) * (size_t)count);
+    stream->hrefOff = malloc(sizeof(size_t) * (size_t)count);
+    stream->count = count;
+
+    uint64_t rng = 42;
+    size_t base = 0;
+    int site = 0, section = 0;
+    for (long i = 0; i < count; i++)
+    {
+        if (i % LINKS_PER_PAGE == 0)                        // Next page
+        {
+            char page[128];
+            site = (int)(nextRandom(&rng) % SITES);
+            section = (int)(nextRandom(&rng) % SECTIONS);
+            snprintf(page, sizeof(page), "http://site%d.example/section%d/article-%d.html", site, section,
+                     (int)(nextRandom(&rng) % ARTICLES));
+            base = appendString(&stream->bases, &basesLen, &basesCap, page);
+        }
+
+        // Target: navigation page, article of this site (popular ones more often) or another site
+        int targetSite = site, targetSection, article = -1;
+        uint64_t r = nextRandom(&rng);
+        if (r % 100 < 40)
+        {
+            targetSection = (int)(r / 100 % (SECTIONS + 2));
+        }
+        else
+        {
+            if (r % 100 >= 90)
+                targetSite = (int)(r / 100 % SITES);
+            targetSection = (int)(r / 1000 % SECTIONS);
+            uint64_t a = nextRandom(&rng);
+            article = (int)((a % ARTICLES) * (a / ARTICLES % ARTICLES) / ARTICLES);
+        }
+        char path[96];
+        if (targetSection >= SECTIONS)
+            snprintf(path, sizeof(path), "%s", targetSection == SECTIONS ? "" : "about/");
+        else if (article < 0)
+            snprintf(path, sizeof(path), "section%d/", targetSection);
+        else
+            snprintf(path, sizeof(path), "section%d/article-%d.html", targetSection, article);
+
+        // Spelling of the link
+        char href[192];
+        int form = targetSite != site ? (int)(r / 10000 % 3) * 3 : (int)(r / 10000 % 7);
+        switch (form)
+        {
+        case 0:
+            snprintf(href, sizeof(href), "http://site%d.example/%s", targetSite, path);
+            break;
+        case 1:
+            snprintf(href, sizeof(href), "/%s", path);
+            break;
+        case 2:
+            if (article >= 0 && targetSection == section)
+                snprintf(href, sizeof(href), "article-%d.html", article);
+            else
+                snprintf(href, sizeof(href), "../%s", path);
+            break;
+        case 3:
+            snprintf(href, sizeof(href), "HTTP://Site%d.Example:80/./%s", targetSite, path);
+            break;
+        case 4:
+            snprintf(href, sizeof(href), "/%s#comments", path);
+            break;
+        case 5:
+            snprintf(href, sizeof(href), "./../%s", path);
+            break;
+        default:
+            snprintf(href, sizeof(href), "//site%d.example/%s", targetSite, path);
+            break;
+        }
+        stream->baseOff[i] = base;
+        stream->hrefOff[i] = appendString(&stream->hrefs, &hrefsLen, &hrefsCap, href);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    long count = argc > 1 ? atol(argv[1]) : 2000000;
+    if (count <= 0)
+        count = 2000000;
+
+    int failures = runCases();
+
+    LinkStream stream;
+    makeStream(&stream, count);
+
+    // Time the normalization of the stream alone
+    long totalLen = 0;
+    double start = nowSeconds();
+    for (long i = 0; i < count; i++)
+    {
+        const char *href = stream.hrefs + stream.hrefOff[i];
+        char out[FRONTIER_MAX_URL];
+        totalLen += urlNormalize(stream.bases + stream.baseOff[i], href, strlen(href), out, sizeof(out));
+    }
+    double seconds = nowSeconds() - start;
+
+    // Normalize it again, keeping the results for the frontier runs
+    char *urls = malloc((size_t)totalLen + (size_t)count);
+    size_t *urlOff = malloc(sizeof(size_t) * (size_t)count);
+    size_t urlsLen = 0, urlsCap = (size_t)totalLen + (size_t)count;
+    long valid = 0;
+    for (long i = 0; i < count; i++)
+    {
+        const char *href = stream.hrefs + stream.hrefOff[i];
+        char out[FRONTIER_MAX_URL];
+        int len = urlNormalize(stream.bases + stream.baseOff[i], href, strlen(href), out, sizeof(out));
+        if (len < 0 || urlsLen + (size_t)len + 1 > urlsCap)
+            continue;
+        memcpy(urls + urlsLen, out, (size_t)len + 1);
+        urlOff[valid++] = urlsLen;
+        urlsLen += (size_t)len + 1;
+    }
+
+    // Every result normalizes to itself; count the distinct spellings and URLs on the way
+    UrlTable *spellings = urlTableCreate(0);
+    UrlTable *distinct = urlTableCreate(0);
+    long unstable = 0;
+    for (long i = 0; i < count; i++)
+    {
+        const char *href = stream.hrefs + stream.hrefOff[i];
+        uint32_t id;
+        urlTableIntern(spellings, href, strlen(href), &id);
+    }
+    for (long i = 0; i < valid; i++)
+    {
+        const char *url = urls + urlOff[i];
+        char again[FRONTIER_MAX_URL];
+        size_t len = strlen(url);
+        uint32_t id;
+        if (urlNormalize(NULL, url, len, again, sizeof(again)) != (int)len || strcmp(again, url) != 0)
+            unstable++;
+        urlTableIntern(distinct, url, len, &id);
+    }
+    long distinctUrls = (long)urlTableCount(distinct);
+    failures += valid != count || unstable != 0;
+
+    printf("links                              %ld from %ld pages of %d sites\n", count,
+           (count + LINKS_PER_PAGE - 1) / LINKS_PER_PAGE, SITES);
+    printf("distinct spellings                 %zu\n", urlTableCount(spellings));
+    printf("distinct URLs after normalization  %ld\n", distinctUrls);
+    printf("normalized                         %.0f URLs/sec (%.0f ns per link)\n", count / seconds,
+           seconds * 1e9 / count);
+    printf("normalized twice, changed          %ld\n", unstable);
+    urlTableDestroy(spellings);
+    urlTableDestroy(distinct);
+
+    // Frontier memory with copies and with interned URLs
+    printf("\nfrontier holding the %ld normalized links\n\n", valid);
+    printf("%-10s %12s %10s %12s %14s %6s\n", "frontier", "pushes/sec", "queued", "heap MB", "bytes per link",
+           "check");
+    double heapMb[2];
+    for (int interned = 0; interned <= 1; interned++)
+    {
+        size_t before = heapInUse();
+        UrlTable *table = interned ? urlTableCreate(0) : NULL;
+        Frontier *frontier = frontierCreate(0, table);
+        long queued = 0;
+        start = nowSeconds();
+        for (long i = 0; i < valid; i++)
+            queued += frontierPush(frontier, urls + urlOff[i], 0) == 0;
+        seconds = nowSeconds() - start;
+        size_t bytes = heapInUse() - before;
+
+        // Every queued URL comes back out
+        char url[FRONTIER_MAX_URL];
+        int depth;
+        long popped = 0;
+        while (frontierPop(frontier, url, sizeof(url), &depth))
+            popped++;
+        int ok = popped == queued && queued == (interned ? distinctUrls : valid);
+        failures += !ok;
+
+        heapMb[interned] = bytes / 1048576.0;
+        printf("%-10s %12.0f %10ld %12.1f %14.1f %6s\n", interned ? "interned" : "copies", valid / seconds, queued,
+               heapMb[interned], (double)bytes / valid, ok ? "ok" : "FAIL");
+        frontierDestroy(frontier);
+        urlTableDestroy(table);
+    }
+    printf("\nsaved %.1f MB (%.0f%%)\n", heapMb[0] - heapMb[1], 100.0 * (heapMb[0] - heapMb[1]) / heapMb[0]);
+
+    free(urls);
+    free(urlOff);
+    free(stream.bases);
+    free(stream.hrefs);
+    free(stream.baseOff);
+    free(stream.hrefOff);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,167 @@
+/*
+Operating Systems Spring 2024
+Final Project
+
+Benchmark: visited set lookups/sec and bytes per URL at growing sizes.
+
+For every size the set is filled with that many fingerprints, then probed with present and
+absent fingerprints from several threads. Fingerprints are generated rather than hashed from
+strings so the set itself is measured; the fingerprint hash is timed separately. At 10K the
+old linear strcmp() scan over a URL array is measured for comparison.
+
+Usage: bench_visited [size ...]   (default: 10000 1000000 100000000)
+*/
+
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "hash.h"
+#include "visited.h"
+
+#define THREADS 4
+
+typedef struct
+{
+    VisitedSet *set;
+    long begin, end;        // Range of keys for this thread
+    int insert;             // 1: test-and-insert, 0: lookup
+    atomic_long *hits;
+} Job;
+
+static double nowSeconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Fingerprint of synthetic URL number 'i'
+static uint64_t key(long i)
+{
+    return mix64((uint64_t)i + 1);
+}
+
+static void *job(void *arg)
+{
+    Job *j = (Job *)arg;
+    long hits = 0;
+    for (long i = j->begin; i < j->end; i++)
+    {
+        if (j->insert)
+            hits += visitedTestAndInsert(j->set, key(i)) == 1;
+        else
+            hits += visitedContains(j->set, key(i));
+    }
+    atomic_fetch_add(j->hits, hits);
+    return NULL;
+}
+
+// Run keys [begin, end) over 'threads' threads, return operations/sec
+static double runJobs(VisitedSet *set, long begin, long end, int insert, int threads, long *hits)
+{
+    pthread_t tids[THREADS];
+    Job jobs[THREADS];
+    atomic_long total = 0;
+    long per = (end - begin) / threads;
+    double start = nowSeconds();
+    for (int t = 0; t < threads; t++)
+    {
+        jobs[t].set = set;
+        jobs[t].begin = begin + per * t;
+        jobs[t].end = t == threads - 1 ? end : begin + per * (t + 1);
+        jobs[t].insert = insert;
+        jobs[t].hits = &total;
+        pthread_create(&tids[t], NULL, job, &jobs[t]);
+    }
+    for (int t = 0; t < threads; t++)
+        pthread_join(tids[t], NULL);
+    double seconds = nowSeconds() - start;
+    *hits = atomic_load(&total);
+    return (end - begin) / seconds;
+}
+
+static void benchSize(long n)
+{
+    long hits;
+    VisitedSet *set = visitedCreate(0);     // Start small so growth is part of the measurement
+
+    double insertRate = runJobs(set, 0, n, 1, THREADS, &hits);
+    long inserted = hits;
+    long probes = n < 10000000 ? n : 10000000;
+    double hitRate = runJobs(set, 0, probes, 0, THREADS, &hits);
+    long found = hits;
+    double missRate = runJobs(set, n, n + probes, 0, THREADS, &hits);
+    long falseHits = hits;
+    double dupRate = runJobs(set, 0, probes, 1, THREADS, &hits);
+    long reinserted = hits;
+
+    printf("%11ld %12.2f %12.2f %12.2f %12.2f %10.1f   %s\n", n, insertRate / 1e6, hitRate / 1e6,
+           missRate / 1e6, dupRate / 1e6, (double)visitedBytes(set) / n,
+           inserted == n && found == probes && falseHits == 0 && reinserted == 0 ? "ok" : "MISMATCH");
+    fflush(stdout);
+    visitedDestroy(set);
+}
+
+// The crawler's old visited check: strcmp() over every visited URL
+static void benchLinear(long n)
+{
+    char **urls = malloc(sizeof(char *) * n);
+    char url[128];
+    for (long i = 0; i < n; i++)
+    {
+        snprintf(url, sizeof(url), "https://www.example.com/section/%ld/page.html", i);
+        urls[i] = strdup(url);
+    }
+    long lookups = 2000, found = 0;
+    double start = nowSeconds();
+    for (long l = 0; l < lookups; l++)
+    {
+        snprintf(url, sizeof(url), "https://www.example.com/section/%ld/page.html", (l * 7919) % (2 * n));
+        for (long i = 0; i < n; i++)
+            if (strcmp(urls[i], url) == 0)
+            {
+                found++;
+                break;
+            }
+    }
+    double seconds = nowSeconds() - start;
+    printf("\nold linear isVisited() at %ld URLs: %.3f M lookups/sec (%ld found)\n", n, lookups / seconds / 1e6, found);
+    for (long i = 0; i < n; i++)
+        free(urls[i]);
+    free(urls);
+}
+
+// Cost of turning URL strings into fingerprints
+static void benchFingerprint(void)
+{
+    char url[128];
+    long n = 2000000;
+    uint64_t sink = 0;
+    double start = nowSeconds();
+    for (long i = 0; i < n; i++)
+    {
+        int len = snprintf(url, sizeof(url), "https://www.example.com/section/%ld/page.html", i);
+        sink ^= hash64(url, (size_t)len);
+    }
+    double seconds = nowSeconds() - start;
+    printf("urlFingerprint (incl. snprintf): %.2f M URLs/sec (%llx)\n", n / seconds / 1e6, (unsigned long long)(sink & 0xff));
+}
+
+int main(int argc, char *argv[])
+{
+    long defaults[] = { 10000, 1000000, 100000000 };
+    int count = argc > 1 ? argc - 1 : 3;
+
+    printf("%d threads, rates in millions of operations per second\n\n", THREADS);
+    printf("%11s %12s %12s %12s %12s %10s\n", "URLs", "insert", "lookup hit", "lookup miss", "re-insert", "bytes/URL");
+    for (int i = 0; i < count; i++)
+        benchSize(argc > 1 ? atol(argv[i + 1]) : defaults[i]);
+
+    benchLinear(10000);
+    benchFingerprint();
+    return 0;
+}
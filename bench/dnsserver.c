@@ -0,0 +1,259 @@
+/*
+Operating Systems Spring 2024
+Final Project
+
+Local DNS stand-in server used by the benchmarks.
+
+A single background thread answers UDP queries on 127.0.0.1. A queries for names under the
+configured suffix get 127.0.0.1 with the configured TTL (those also starting with the multi
+prefix 127.0.0.12, 127.0.0.1 and 127.0.0.2, in that order), AAAA queries for them an empty answer,
+and every other name NXDOMAIN. Answers are held back for a fixed latency on a FIFO (every answer
+waits the same time, so the oldest is always due first), standing in for the round trip to a real
+recursive resolver.
+*/
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <poll.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+#include "dnsserver.h"
+
+// Largest DNS message over UDP
+#define DNS_MAX_MESSAGE 512
+
+// DNS record types and response codes used here
+#define TYPE_A 1
+#define TYPE_AAAA 28
+#define RCODE_NXDOMAIN 3
+
+// An answer waiting for its latency to pass
+typedef struct
+{
+    long long due;              // Monotonic time in microseconds
+    struct sockaddr_in to;      // Client address
+    size_t len;
+    unsigned char message[DNS_MAX_MESSAGE];
+} Answer;
+
+struct DnsServer
+{
+    DnsServerConfig config;
+    int fd;
+    int port;
+    pthread_t thread;
+    atomic_int stop;
+    atomic_ulong queries;       // Queries received so far
+    Answer *answers;            // FIFO of delayed answers
+    size_t head, count, cap;
+};
+
+// Current monotonic time in microseconds
+static long long nowUs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// Decode the question name starting at 'off' into 'name'; returns the offset after it, or 0 if malformed
+static size_t readName(const unsigned char *msg, size_t len, size_t off, char *name, size_t size)
+{
+    size_t used = 0;
+    while (off < len && msg[off] != 0)
+    {
+        size_t label = msg[off++];
+        if (label > 63 || off + label > len || used + label + 2 > size)
+            return 0;
+        if (used > 0)
+            name[used++] = '.';
+        memcpy(name + used, msg + off, label);
+        used += label;
+        off += label;
+    }
+    name[used] = '\0';
+    return off < len ? off + 1 : 0;
+}
+
+// Build the answer to the query in 'msg'; returns its length, or 0 to drop the query
+static size_t buildAnswer(const DnsServer *server, const unsigned char *msg, size_t len, unsigned char *out)
+{
+    char name[256];
+    if (len < 12 || (msg[2] & 0x80) != 0)           // Too short, or a response
+        return 0;
+    size_t end = readName(msg, len, 12, name, sizeof(name));
+    if (end == 0 || end + 4 > len)
+        return 0;
+    int type = msg[end] << 8 | msg[end + 1];
+    end += 4;                                       // Type and class
+
+    const char *silent = server->config.silentPrefix;
+    if (silent != NULL && strncasecmp(name, silent, strlen(silent)) == 0)
+        return 0;                                   // Never answered: the client times out
+
+    size_t nameLen = strlen(name), suffixLen = strlen(server->config.suffix);
+    int known = nameLen >= suffixLen && strcasecmp(name + nameLen - suffixLen, server->config.suffix) == 0;
+    const char *multi = server->config.multiPrefix;
+    static const unsigned char one[] = { 1 }, three[] = { 12, 1, 2 };     // Last byte of each 127.0.0.x answered
+    const unsigned char *hosts = one;
+    int records = known && type == TYPE_A;
+    if (records && multi != NULL && strncasecmp(name, multi, strlen(multi)) == 0)
+    {
+        hosts = three;
+        records = 3;
+    }
+
+    memcpy(out, msg, end);                          // Header and question
+    out[2] = 0x80 | (msg[2] & 0x01);                // Response, recursion desired as asked
+    out[3] = 0x80 | (known ? 0 : RCODE_NXDOMAIN);   // Recursion available
+    out[4] = 0; out[5] = 1;                         // One question
+    out[6] = 0; out[7] = (unsigned char)records;
+    memset(out + 8, 0, 4);                          // No authority or additional records
+
+    uint32_t ttl = (uint32_t)server->config.ttl;
+    for (int i = 0; i < records; i++)
+    {
+        const unsigned char record[] = {
+            0xc0, 0x0c,                             // Name: pointer to the question
+            0, TYPE_A, 0, 1,                        // Type A, class IN
+            (unsigned char)(ttl >> 24), (unsigned char)(ttl >> 16), (unsigned char)(ttl >> 8), (unsigned char)ttl,
+            0, 4, 127, 0, 0, hosts[i]               // 127.0.0.x
+        };
+        memcpy(out + end, record, sizeof(record));
+        end += sizeof(record);
+    }
+    return end;
+}
+
+// Server thread: read queries, queue their answers and send the ones that are due
+static void *serverThread(void *arg)
+{
+    DnsServer *server = (DnsServer *)arg;
+    unsigned char msg[DNS_MAX_MESSAGE];
+
+    while (!atomic_load(&server->stop))
+    {
+        int timeoutMs = 50;                         // Look at the stop flag now and then
+        if (server->count > 0)
+        {
+            long long left = server->answers[server->head].due - nowUs();
+            timeoutMs = left <= 0 ? 0 : (int)((left + 999) / 1000);
+        }
+        struct pollfd pfd = { server->fd, POLLIN, 0 };
+        poll(&pfd, 1, timeoutMs);
+
+        while (1)                                   // Every query that arrived
+        {
+            struct sockaddr_in from;
+            socklen_t fromLen = sizeof(from);
+            ssize_t n = recvfrom(server->fd, msg, sizeof(msg), MSG_DONTWAIT, (struct sockaddr *)&from, &fromLen);
+            if (n <= 0)
+                break;
+            atomic_fetch_add(&server->queries, 1);
+            if (server->count == server->cap)       // Grow the FIFO, unwrapping it
+            {
+                size_t cap = server->cap ? server->cap * 2 : 64;
+                Answer *answers = malloc(cap * sizeof(Answer));
+                if (answers == NULL)
+                    continue;
+                for (size_t i = 0; i < server->count; i++)
+                    answers[i] = server->answers[(server->head + i) % server->cap];
+                free(server->answers);
+                server->answers = answers;
+                server->head = 0;
+                server->cap = cap;
+            }
+            Answer *answer = &server->answers[(server->head + server->count) % server->cap];
+            answer->len = buildAnswer(server, msg, (size_t)n, answer->message);
+            if (answer->len == 0)
+                continue;
+            answer->due = nowUs() + (long long)server->config.latencyMs * 1000;
+            answer->to = from;
+            server->count++;
+        }
+
+        long long now = nowUs();
+        while (server->count > 0 && server->answers[server->head].due <= now)
+        {
+            Answer *answer = &server->answers[server->head];
+            sendto(server->fd, answer->message, answer->len, 0, (struct sockaddr *)&answer->to, sizeof(answer->to));
+            server->head = (server->head + 1) % server->cap;
+            server->count--;
+        }
+    }
+    return NULL;
+}
+
+/*
+    Start a stand-in DNS server on its own thread.
+
+    Preconditions:  'config' points to a valid DnsServerConfig with 'suffix' set.
+    Postcondition:  Returns the running server, or NULL if the socket could not be bound.
+*/
+DnsServer *dnsServerStart(const DnsServerConfig *config)
+{
+    DnsServer *server = calloc(1, sizeof(DnsServer));
+    if (server == NULL)
+        return NULL;
+    server->config = *config;
+    atomic_init(&server->stop, 0);
+    atomic_init(&server->queries, 0);
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons((uint16_t)config->port);
+    socklen_t addrLen = sizeof(addr);
+
+    server->fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (server->fd < 0 || bind(server->fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+        getsockname(server->fd, (struct sockaddr *)&addr, &addrLen) != 0)
+    {
+        if (server->fd >= 0)
+            close(server->fd);
+        free(server);
+        return NULL;
+    }
+    server->port = ntohs(addr.sin_port);
+
+    if (pthread_create(&server->thread, NULL, serverThread, server) != 0)
+    {
+        close(server->fd);
+        free(server);
+        return NULL;
+    }
+    return server;
+}
+
+// Port the server listens on
+int dnsServerPort(const DnsServer *server)
+{
+    return server->port;
+}
+
+// Number of queries received so far
+unsigned long dnsServerQueries(const DnsServer *server)
+{
+    return atomic_load(&((DnsServer *)server)->queries);
+}
+
+// Stop the server thread and release everything
+void dnsServerStop(DnsServer *server)
+{
+    if (server == NULL)
+        return;
+    atomic_store(&server->stop, 1);
+    pthread_join(server->thread, NULL);
+    close(server->fd);
+    free(server->answers);
+    free(server);
+}
@@ -0,0 +1,30 @@
+/*
+Operating Systems Spring 2024
+Final Project
+
+Local DNS stand-in server used by the benchmarks.
+*/
+
+#ifndef DNSSERVER_H
+#define DNSSERVER_H
+
+// Settings for a stand-in DNS server
+typedef struct
+{
+    int port;                   // UDP port on 127.0.0.1, 0 to pick a free one
+    int latencyMs;              // Delay before every answer
+    int ttl;                    // TTL of the records, in seconds
+    const char *suffix;         // Names ending in it resolve to 127.0.0.1, all others are NXDOMAIN
+    const char *silentPrefix;   // Names starting with it are never answered (NULL for none)
+    const char *multiPrefix;    // Names starting with it resolve to three addresses (NULL for none)
+} DnsServerConfig;
+
+typedef struct DnsServer DnsServer;
+
+// Function prototypes
+DnsServer *dnsServerStart(const DnsServerConfig *config);
+int dnsServerPort(const DnsServer *server);
+unsigned long dnsServerQueries(const DnsServer *server);
+void dnsServerStop(DnsServer *server);
+
+#endif
@@ -0,0 +1,209 @@
+/*
+Operating Systems Spring 2024
+Final Project
+
+Corpus of HTML pages for the parser benchmarks.
+*/
+
+#include <dirent.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "htmlcorpus.h"
+
+// Small deterministic generator, the corpus is the same on every run
+static unsigned nextRandom(unsigned *state)
+{
+    unsigned x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *state = x;
+}
+
+static void put(FILE *out, long *written, const char *fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    int n = vfprintf(out, fmt, args);
+    va_end(args);
+    if (n > 0)
+        *written += n;
+}
+
+// One link in one of the spellings found in the wild
+static void putLink(FILE *out, long *written, unsigned *rng, int page)
+{
+    int n = (int)(nextRandom(rng) % 100000);
+    switch (nextRandom(rng) % 8)
+    {
+    case 0:
+        put(out, written, "<a href=\"https://www.example%d.com/articles/%d\">Article %d</a>", n % 50, n, n);
+        break;
+    case 1:
+        put(out, written, "<a class=\"nav-link\" href='http://news.example.org/item?id=%d&amp;ref=%d' title=\"Item\">Item</a>", n, page);
+        break;
+    case 2:
+        put(out, written, "<A HREF=http://static.example.net/docs/%d.html>Docs</A>", n);
+        break;
+    case 3:
+        put(out, written, "<a href=\"/relative/path/%d\">relative</a>", n);
+        break;
+    case 4:
+        put(out, written, "<a href=\"#section-%d\">jump</a>", n % 20);
+        break;
+    case 5:
+        put(out, written, "<a\n   data-id=\"%d\"\n   href=\"https://cdn.example.com/%d/%d?q=a%%20b\"\n   rel=\"nofollow\">wrapped</a>", n, page, n);
+        break;
+    case 6:
+        put(out, written, "<a href=\"https://shop.example.com/p/%d?&#99;olor=red&#x26;size=m\">Shop</a>", n);
+        break;
+    default:
+        put(out, written, "<a id=\"anchor-%d\" name=\"anchor\">no href</a>", n);
+        break;
+    }
+}
+
+static void putParagraph(FILE *out, long *written, unsigned *rng, int page)
+{
+    static const char *words[] = { "lorem", "ipsum", "dolor", "sit", "amet", "consectetur", "adipiscing",
+                                   "elit", "sed", "do", "eiusmod", "tempor", "incididunt", "labore" };
+    put(out, written, "<p>");
+    int count = 20 + (int)(nextRandom(rng) % 120);
+    for (int i = 0; i < count; i++)
+    {
+        if (nextRandom(rng) % 24 == 0)
+            putLink(out, written, rng, page);
+        else if (nextRandom(rng) % 40 == 0)
+            put(out, written, "<b>%s</b> ", words[nextRandom(rng) % 14]);
+        else
+            put(out, written, "%s ", words[nextRandom(rng) % 14]);
+    }
+    put(out, written, "</p>\n");
+}
+
+static void putPage(FILE *out, long *written, unsigned *rng, int page, long size)
+{
+    put(out, written, "<!DOCTYPE html>\n<html lang=\"en\">\n<head>\n<meta charset=\"utf-8\">\n");
+    put(out, written, "<title>Page %d</title>\n<link rel=\"stylesheet\" href=\"/css/site.css\">\n", page);
+    put(out, written, "<style>a[href^=\"http\"] { color: #333; } .x > a { margin: 0; }</style>\n");
+    put(out, written, "<script>var tpl = '<a href=\"http://decoy.example.com/script/%d\">'; if (a < b && c > d) {}</script>\n", page);
+    put(out, written, "</head>\n<body>\n<!-- <a href=\"http://decoy.example.com/comment/%d\">old</a> -->\n", page);
+
+    put(out, written, "<nav><ul>\n");
+    for (int i = 0; i < 10 + (int)(nextRandom(rng) % 30); i++)
+    {
+        put(out, written, "<li>");
+        putLink(out, written, rng, page);
+        put(out, written, "</li>\n");
+    }
+    put(out, written, "</ul></nav>\n<main>\n");
+
+    while (*written < size)
+    {
+        switch (nextRandom(rng) % 6)
+        {
+        case 0:
+            put(out, written, "<table><tr>");
+            for (int i = 0; i < 4; i++)
+            {
+                put(out, written, "<td>");
+                putLink(out, written, rng, page);
+                put(out, written, "</td>");
+            }
+            put(out, written, "</tr></table>\n");
+            break;
+        case 1:
+            put(out, written, "<div class=\"card\" data-json='{\"a\": \"<b>\"}'><img src=\"/img/%u.png\" alt=\"x > y\"></div>\n",
+                nextRandom(rng) % 1000);
+            break;
+        default:
+            putParagraph(out, written, rng, page);
+            break;
+        }
+    }
+    put(out, written, "</main>\n<footer><a href=\"https://www.example.com/about\">About</a></footer>\n</body>\n</html>\n");
+}
+
+/*
+    Generate 'pages' pages into the directory 'dir'.
+
+    Preconditions:  'dir' is an existing, writable directory.
+    Postcondition:  Returns the total number of bytes written, or -1 if a page could not be written.
+                    Page sizes vary from a few KB to about 250 KB, like pages on the web.
+*/
+long htmlCorpusGenerate(const char *dir, int pages, unsigned seed)
+{
+    unsigned rng = seed ? seed : 1;
+    long total = 0;
+
+    for (int page = 0; page < pages; page++)
+    {
+        char path[4096];
+        snprintf(path, sizeof(path), "%s/page%04d.html", dir, page);
+        FILE *out = fopen(path, "w");
+        if (out == NULL)
+            return -1;
+
+        long size = 4096L << (nextRandom(&rng) % 6);         // 4 KB to 128 KB ...
+        size += (long)(nextRandom(&rng) % (unsigned)size);   // ... spread up to twice that
+        long written = 0;
+        putPage(out, &written, &rng, page, size);
+        total += written;
+        if (fclose(out) != 0)
+            return -1;
+    }
+    return total;
+}
+
+static int comparePaths(const void *a, const void *b)
+{
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+/*
+    List the regular files of a corpus directory.
+
+    Preconditions:  'dir' is a directory of saved pages.
+    Postcondition:  Returns the sorted paths and sets 'count', or NULL if the directory cannot be read.
+                    Release the list with htmlCorpusFree().
+*/
+char **htmlCorpusFiles(const char *dir, int *count)
+{
+    DIR *d = opendir(dir);
+    if (d == NULL)
+        return NULL;
+
+    char **files = NULL;
+    int n = 0, cap = 0;
+    struct dirent *entry;
+    while ((entry = readdir(d)) != NULL)
+    {
+        char path[4096];
+        struct stat st;
+        snprintf(path, sizeof(path), "%s/%s", dir, entry->d_name);
+        if (stat(path, &st) != 0 || !S_ISREG(st.st_mode))
+            continue;
+        if (n == cap)
+        {
+            cap = cap ? cap * 2 : 64;
+            files = realloc(files, sizeof(char *) * cap);
+        }
+        files[n++] = strdup(path);
+    }
+    closedir(d);
+
+    qsort(files, n, sizeof(char *), comparePaths);
+    *count = n;
+    return files;
+}
+
+void htmlCorpusFree(char **files, int count)
+{
+    for (int i = 0; i < count; i++)
+        free(files[i]);
+    free(files);
+}
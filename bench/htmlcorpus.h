@@ -0,0 +1,24 @@
+/*
+Operating Systems Spring 2024
+Final Project
+
+Corpus of HTML pages for the parser benchmarks.
+*/
+
+#ifndef HTMLCORPUS_H
+#define HTMLCORPUS_H
+
+/*
+    Synthetic pages shaped like real ones: a head with scripts and styles, navigation lists,
+    article text with inline links, tables and comments. Links come in every spelling the parsers
+    have to cope with: absolute, relative and fragment URLs, single, double and no quotes,
+    upper-case tags and attributes, character references, and decoys inside scripts and comments
+    that are not links at all.
+*/
+
+// Function prototypes
+long htmlCorpusGenerate(const char *dir, int pages, unsigned seed);
+char **htmlCorpusFiles(const char *dir, int *count);
+void htmlCorpusFree(char **files, int count);
+
+#endif
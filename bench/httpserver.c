@@ -0,0 +1,434 @@
+/*
+Operating Systems Spring 2024
+Final Project
+
+Local HTTP stand-in server used by the benchmarks.
+
+A single background thread serves HTTP/1.1 with keep-alive from an epoll loop. Responses
+can be delayed to emulate network latency; delayed responses wait on a min-heap of timers,
+so thousands of connections can be waiting at the same time without extra threads.
+*/
+
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+
+#include "httpserver.h"
+
+// Maximum number of epoll events handled per loop iteration
+#define MAX_EVENTS 256
+
+// State of one client connection
+typedef struct
+{
+    int open;               // 1 while the descriptor belongs to a client
+    unsigned gen;           // Bumped on close so stale timers can be recognised
+    char *in;               // Bytes received and not yet consumed
+    size_t inLen, inCap;
+    char *out;              // Response being written
+    size_t outLen, outOff;
+    int busy;               // 1 while a response is delayed or being written
+    int closeAfter;         // Close once the response is written
+} Conn;
+
+// A delayed response waiting to be written
+typedef struct
+{
+    long long due;          // Monotonic time in microseconds
+    int fd;
+    unsigned gen;
+} Timer;
+
+struct HttpServer
+{
+    HttpServerConfig config;
+    int listenFd, epfd, wakeFd;
+    int port;
+    pthread_t thread;
+    atomic_int stop;
+    atomic_ulong requests;  // Requests answered so far
+    int pending;            // Requests received and not answered yet
+    atomic_int maxPending;  // Highest 'pending' seen
+    Conn *conns;            // Indexed by file descriptor
+    int connCap;
+    Timer *timers;          // Min-heap ordered by 'due'
+    int timerCount, timerCap;
+};
+
+// Current monotonic time in microseconds
+static long long nowUs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// Reason phrase for the status codes the handlers use
+static const char *reasonPhrase(int status)
+{
+    switch (status)
+    {
+    case 200: return "OK";
+    case 301: return "Moved Permanently";
+    case 302: return "Found";
+    case 304: return "Not Modified";
+    case 404: return "Not Found";
+    case 429: return "Too Many Requests";
+    case 500: return "Internal Server Error";
+    case 503: return "Service Unavailable";
+    default:  return "Unknown";
+    }
+}
+
+static void timerPush(HttpServer *server, Timer timer)
+{
+    if (server->timerCount == server->timerCap)
+    {
+        server->timerCap = server->timerCap ? server->timerCap * 2 : 256;
+        server->timers = realloc(server->timers, sizeof(Timer) * server->timerCap);
+    }
+    int i = server->timerCount++;
+    while (i > 0 && server->timers[(i - 1) / 2].due > timer.due)   // Sift up
+    {
+        server->timers[i] = server->timers[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    server->timers[i] = timer;
+}
+
+static Timer timerPop(HttpServer *server)
+{
+    Timer top = server->timers[0];
+    Timer last = server->timers[--server->timerCount];
+    int i = 0;
+    while (1)                                                      // Sift down
+    {
+        int child = 2 * i + 1;
+        if (child >= server->timerCount)
+            break;
+        if (child + 1 < server->timerCount && server->timers[child + 1].due < server->timers[child].due)
+            child++;
+        if (server->timers[child].due >= last.due)
+            break;
+        server->timers[i] = server->timers[child];
+        i = child;
+    }
+    if (server->timerCount > 0)
+        server->timers[i] = last;
+    return top;
+}
+
+static Conn *connFor(HttpServer *server, int fd)
+{
+    if (fd >= server->connCap)
+    {
+        int cap = server->connCap ? server->connCap : 1024;
+        while (cap <= fd)
+            cap *= 2;
+        server->conns = realloc(server->conns, sizeof(Conn) * cap);
+        memset(server->conns + server->connCap, 0, sizeof(Conn) * (cap - server->connCap));
+        server->connCap = cap;
+    }
+    return &server->conns[fd];
+}
+
+static void closeConn(HttpServer *server, int fd)
+{
+    Conn *c = &server->conns[fd];
+    epoll_ctl(server->epfd, EPOLL_CTL_DEL, fd, NULL);
+    close(fd);
+    free(c->in);
+    free(c->out);
+    if (c->busy)
+        server->pending--;
+    unsigned gen = c->gen + 1;
+    memset(c, 0, sizeof(Conn));
+    c->gen = gen;
+}
+
+static void tryRequest(HttpServer *server, int fd);
+
+// Response fully written: go back to reading or close
+static void finishResponse(HttpServer *server, int fd)
+{
+    Conn *c = &server->conns[fd];
+    free(c->out);
+    c->out = NULL;
+    c->outLen = c->outOff = 0;
+    c->busy = 0;
+    server->pending--;
+    atomic_fetch_add(&server->requests, 1);
+    if (c->closeAfter)
+    {
+        closeConn(server, fd);
+        return;
+    }
+    tryRequest(server, fd);                    // A further request may already be buffered
+}
+
+// Write as much of the pending response as the socket takes
+static void writeResponse(HttpServer *server, int fd)
+{
+    Conn *c = &server->conns[fd];
+    while (c->outOff < c->outLen)
+    {
+        ssize_t n = send(fd, c->out + c->outOff, c->outLen - c->outOff, MSG_NOSIGNAL);
+        if (n < 0)
+        {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                struct epoll_event ev = { .events = EPOLLIN | EPOLLOUT, .data.fd = fd };
+                epoll_ctl(server->epfd, EPOLL_CTL_MOD, fd, &ev);
+                return;
+            }
+            closeConn(server, fd);
+            return;
+        }
+        c->outOff += (size_t)n;
+    }
+    struct epoll_event ev = { .events = EPOLLIN, .data.fd = fd };
+    epoll_ctl(server->epfd, EPOLL_CTL_MOD, fd, &ev);
+    finishResponse(server, fd);
+}
+
+// Parse one complete request from the input buffer, if there is one, and schedule its response
+static void tryRequest(HttpServer *server, int fd)
+{
+    Conn *c = &server->conns[fd];
+    if (!c->open || c->busy || c->inLen == 0)
+        return;
+
+    c->in[c->inLen] = '\0';
+    char *end = strstr(c->in, "\r\n\r\n");
+    if (end == NULL)
+        return;                                // Header block not complete yet
+    size_t consumed = (size_t)(end - c->in) + 4;
+    *end = '\0';
+
+    char method[16] = "", path[2048] = "";
+    sscanf(c->in, "%15s %2047s", method, path);
+    char *headers = strstr(c->in, "\r\n");
+    headers = headers ? headers + 2 : end;
+
+    c->closeAfter = strcasestr(headers, "Connection: close") != NULL;
+
+    HttpResponse response;
+    memset(&response, 0, sizeof(response));
+    response.status = 200;
+    server->config.handler(method, path, headers, &response, server->config.userdata);
+
+    // Build the full response in one buffer
+    char head[1024];
+    int headLen = snprintf(head, sizeof(head),
+                           "HTTP/1.1 %d %s\r\nContent-Type: %s\r\nContent-Length: %zu\r\n%s%s\r\n",
+                           response.status, reasonPhrase(response.status),
+                           response.contentType ? response.contentType : "text/html",
+                           response.size, response.extraHeaders ? response.extraHeaders : "",
+                           c->closeAfter ? "Connection: close\r\n" : "");
+    int isHead = strcmp(method, "HEAD") == 0;
+    size_t bodyLen = isHead ? 0 : response.size;
+    c->out = malloc((size_t)headLen + bodyLen);
+    memcpy(c->out, head, (size_t)headLen);
+    if (bodyLen)
+        memcpy(c->out + headLen, response.body, bodyLen);
+    c->outLen = (size_t)headLen + bodyLen;
+    c->outOff = 0;
+    free(response.body);
+
+    memmove(c->in, c->in + consumed, c->inLen - consumed);
+    c->inLen -= consumed;
+    c->busy = 1;
+    if (++server->pending > atomic_load(&server->maxPending))
+        atomic_store(&server->maxPending, server->pending);
+
+    int delay = server->config.latencyMs + response.delayMs;
+    if (delay <= 0)
+    {
+        writeResponse(server, fd);
+        return;
+    }
+    Timer timer = { nowUs() + (long long)delay * 1000, fd, c->gen };
+    timerPush(server, timer);
+}
+
+static void readConn(HttpServer *server, int fd)
+{
+    Conn *c = &server->conns[fd];
+    while (1)
+    {
+        if (c->inCap - c->inLen < 4096)
+        {
+            c->inCap = c->inCap ? c->inCap * 2 : 8192;
+            c->in = realloc(c->in, c->inCap + 1);
+        }
+        ssize_t n = recv(fd, c->in + c->inLen, c->inCap - c->inLen, 0);
+        if (n > 0)
+        {
+            c->inLen += (size_t)n;
+            continue;
+        }
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            break;
+        closeConn(server, fd);                 // Peer closed or error
+        return;
+    }
+    tryRequest(server, fd);
+}
+
+static void acceptConns(HttpServer *server)
+{
+    while (1)
+    {
+        int fd = accept4(server->listenFd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0)
+            return;
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        Conn *c = connFor(server, fd);
+        c->open = 1;
+        struct epoll_event ev = { .events = EPOLLIN, .data.fd = fd };
+        epoll_ctl(server->epfd, EPOLL_CTL_ADD, fd, &ev);
+    }
+}
+
+static void *serverLoop(void *arg)
+{
+    HttpServer *server = (HttpServer *)arg;
+    struct epoll_event events[MAX_EVENTS];
+
+    while (!atomic_load(&server->stop))
+    {
+        int wait = -1;
+        if (server->timerCount > 0)
+        {
+            long long left = server->timers[0].due - nowUs();
+            wait = left <= 0 ? 0 : (int)((left + 999) / 1000);
+        }
+
+        int n = epoll_wait(server->epfd, events, MAX_EVENTS, wait);
+        for (int i = 0; i < n; i++)
+        {
+            int fd = events[i].data.fd;
+            if (fd == server->listenFd)
+                acceptConns(server);
+            else if (fd == server->wakeFd)
+                continue;
+            else if (server->conns[fd].open && (events[i].events & EPOLLOUT) && server->conns[fd].out)
+                writeResponse(server, fd);
+            else if (server->conns[fd].open)
+                readConn(server, fd);
+        }
+
+        long long now = nowUs();
+        while (server->timerCount > 0 && server->timers[0].due <= now)   // Release due responses
+        {
+            Timer timer = timerPop(server);
+            Conn *c = &server->conns[timer.fd];
+            if (c->open && c->gen == timer.gen && c->busy)
+                writeResponse(server, timer.fd);
+        }
+    }
+    return NULL;
+}
+
+/*
+    Start a stand-in server on 127.0.0.1.
+
+    Preconditions:  'config' points to a valid HttpServerConfig with 'handler' set.
+    Postcondition:  Returns a running server (see httpServerPort() for its port), or NULL on failure.
+*/
+HttpServer *httpServerStart(const HttpServerConfig *config)
+{
+    HttpServer *server = calloc(1, sizeof(HttpServer));
+    if (server == NULL)
+        return NULL;
+    server->config = *config;
+
+    server->listenFd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    int one = 1;
+    setsockopt(server->listenFd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons((unsigned short)config->port);
+    if (bind(server->listenFd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+        listen(server->listenFd, 4096) != 0)
+    {
+        perror("httpServerStart");
+        close(server->listenFd);
+        free(server);
+        return NULL;
+    }
+    socklen_t len = sizeof(addr);
+    getsockname(server->listenFd, (struct sockaddr *)&addr, &len);
+    server->port = ntohs(addr.sin_port);
+
+    server->epfd = epoll_create1(EPOLL_CLOEXEC);
+    server->wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    struct epoll_event ev = { .events = EPOLLIN, .data.fd = server->listenFd };
+    epoll_ctl(server->epfd, EPOLL_CTL_ADD, server->listenFd, &ev);
+    ev.data.fd = server->wakeFd;
+    epoll_ctl(server->epfd, EPOLL_CTL_ADD, server->wakeFd, &ev);
+
+    pthread_create(&server->thread, NULL, serverLoop, server);
+    return server;
+}
+
+// Port the server listens on
+int httpServerPort(const HttpServer *server)
+{
+    return server->port;
+}
+
+// Number of responses written so far
+unsigned long httpServerRequests(const HttpServer *server)
+{
+    return atomic_load(&((HttpServer *)server)->requests);
+}
+
+// Highest number of requests the server was working on at the same time
+int httpServerMaxPending(const HttpServer *server)
+{
+    return atomic_load(&((HttpServer *)server)->maxPending);
+}
+
+/*
+    Stop a stand-in server.
+
+    Preconditions:  'server' was returned by httpServerStart().
+    Postcondition:  The server thread has exited, every connection is closed and all memory is released.
+*/
+void httpServerStop(HttpServer *server)
+{
+    uint64_t one = 1;
+    atomic_store(&server->stop, 1);
+    if (write(server->wakeFd, &one, sizeof(one)) < 0)
+        perror("httpServerStop");
+    pthread_join(server->thread, NULL);
+
+    for (int fd = 0; fd < server->connCap; fd++)
+        if (server->conns[fd].open)
+            closeConn(server, fd);
+    close(server->listenFd);
+    close(server->wakeFd);
+    close(server->epfd);
+    free(server->conns);
+    free(server->timers);
+    free(server);
+}
@@ -0,0 +1,50 @@
+/*
+Operating Systems Spring 2024
+Final Project
+
+Local HTTP stand-in server used by the benchmarks.
+*/
+
+#ifndef HTTPSERVER_H
+#define HTTPSERVER_H
+
+#include <stddef.h>
+
+// Response filled in by a request handler
+typedef struct
+{
+    int status;                 // HTTP status code (defaults to 200)
+    const char *contentType;    // Content-Type header (defaults to text/html)
+    const char *extraHeaders;   // Extra header lines, each ending in "\r\n" (optional)
+    char *body;                 // Response body allocated with malloc(), freed by the server
+    size_t size;                // Size of the body
+    int delayMs;                // Extra delay on top of the server's latency
+} HttpResponse;
+
+/*
+    Request handler, called on the server thread for every request.
+
+    'headers' holds the raw request header block (without the request line).
+*/
+typedef void (*HttpHandler)(const char *method, const char *path, const char *headers,
+                            HttpResponse *response, void *userdata);
+
+// Settings for a stand-in server
+typedef struct
+{
+    int port;                   // Port to listen on, 0 to pick a free one
+    int latencyMs;              // Delay applied before every response
+    HttpHandler handler;        // Produces the responses
+    void *userdata;             // Passed to the handler
+} HttpServerConfig;
+
+typedef struct HttpServer HttpServer;
+
+// Function prototypes
+HttpServer *httpServerStart(const HttpServerConfig *config);
+int httpServerPort(const HttpServer *server);
+unsigned long httpServerRequests(const HttpServer *server);
+int httpServerMaxPending(const HttpServer *server);
+void httpServerStop(HttpServer *server);
+
+#endif
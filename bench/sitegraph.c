@@ -0,0 +1,153 @@
+/*
+Operating Systems Spring 2024
+Final Project
+
+Synthetic site graph served by the local stand-in server.
+*/
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "sitegraph.h"
+
+// Depth of page 'page' in the tree, -1 if it is deeper than the graph
+int siteGraphDepthOf(const SiteGraph *graph, long page)
+{
+    long levelStart = 0, levelSize = 1;
+    for (int d = 0; d <= graph->depth; d++)
+    {
+        if (page < levelStart + levelSize)
+            return page >= 0 ? d : -1;
+        levelStart += levelSize;
+        levelSize *= graph->fanout;
+    }
+    return -1;
+}
+
+// Number of pages at depth 0..maxDepth
+long siteGraphPages(const SiteGraph *graph, int maxDepth)
+{
+    long total = 0, levelSize = 1;
+    for (int d = 0; d <= maxDepth && d <= graph->depth; d++)
+    {
+        total += levelSize;
+        levelSize *= graph->fanout;
+    }
+    return total;
+}
+
+// Fixed pseudo-random number of page 'page', 'salt' telling the uses apart
+static unsigned long pageHash(long page, unsigned long salt)
+{
+    unsigned long long x = (unsigned long long)page * 0x9E3779B97F4A7C15ULL + salt;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return (unsigned long)(x ^ (x >> 31));
+}
+
+// 1 if page 'page' answers 500, never the root
+int siteGraphIsError(const SiteGraph *graph, long page)
+{
+    return page > 0 && (long)(pageHash(page, 1) % 100) < graph->errorPercent;
+}
+
+// 1 if a crawl reaches page 'page': all its ancestors answer 200
+static int reachable(const SiteGraph *graph, long page)
+{
+    while (page > 0 && !siteGraphIsError(graph, (page - 1) / graph->fanout))
+        page = (page - 1) / graph->fanout;
+    return page == 0;
+}
+
+// Number of pages a crawl reaches: the pages whose ancestors all answer 200, error pages included
+long siteGraphReachable(const SiteGraph *graph)
+{
+    long total = 0;
+    for (long page = 0; page < siteGraphPages(graph, graph->depth); page++)
+        total += reachable(graph, page);
+    return total;
+}
+
+// Number of the reachable pages that answer 500, which a crawl counts as failed
+long siteGraphReachableErrors(const SiteGraph *graph)
+{
+    long total = 0;
+    for (long page = 0; page < siteGraphPages(graph, graph->depth); page++)
+        total += siteGraphIsError(graph, page) && reachable(graph, page);
+    return total;
+}
+
+// Append formatted text to a growing buffer
+static void append(char **buf, size_t *len, size_t *cap, const char *fmt, ...)
+{
+    char piece[512];
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(piece, sizeof(piece), fmt, args);
+    va_end(args);
+    if (*len + (size_t)n + 1 > *cap)
+    {
+        *cap = (*len + (size_t)n + 1) * 2;
+        *buf = realloc(*buf, *cap);
+    }
+    memcpy(*buf + *len, piece, (size_t)n + 1);
+    *len += (size_t)n;
+}
+
+/*
+    Request handler for httpServerStart(); 'userdata' must point to a SiteGraph.
+
+    Links are absolute and use the Host header of the request, so they point back at the server.
+*/
+void siteGraphHandler(const char *method, const char *path, const char *headers,
+                      HttpResponse *response, void *userdata)
+{
+    const SiteGraph *graph = (const SiteGraph *)userdata;
+    (void)method;
+
+    char host[256] = "127.0.0.1";
+    const char *h = strcasestr(headers, "Host:");
+    if (h != NULL)
+        sscanf(h + 5, " %255[^\r\n]", host);
+
+    long page = -1;
+    if (sscanf(path, "/n/%ld", &page) != 1 || siteGraphDepthOf(graph, page) < 0)
+    {
+        response->status = 404;
+        response->body = strdup("<html><body>not found</body></html>");
+        response->size = strlen(response->body);
+        return;
+    }
+    if (graph->jitterMs > 0)
+        response->delayMs = (int)(pageHash(page, 2) % (unsigned long)(graph->jitterMs + 1));
+    if (siteGraphIsError(graph, page))
+    {
+        response->status = 500;
+        response->body = strdup("<html><body>internal error</body></html>");
+        response->size = strlen(response->body);
+        return;
+    }
+    int depth = siteGraphDepthOf(graph, page);
+
+    size_t len = 0, cap = 1024;
+    char *body = malloc(cap);
+    body[0] = '\0';
+    append(&body, &len, &cap, "<html><head><title>%s page %ld</title></head><body>\n", host, page);
+    if (depth < graph->depth)
+        for (int i = 1; i <= graph->fanout; i++)
+            append(&body, &len, &cap, "<p><a href=\"http://%s/n/%ld\">child</a></p>\n", host, page * graph->fanout + i);
+    if (page > 0)
+    {
+        append(&body, &len, &cap, "<p><a href=\"http://%s/n/%ld\">parent</a></p>\n", host, (page - 1) / graph->fanout);
+        append(&body, &len, &cap, "<p><a href=\"http://%s/n/0\">home</a></p>\n", host);
+    }
+    while (len < graph->pageSize)
+        append(&body, &len, &cap, "<p>Lorem ipsum dolor sit amet, consectetur adipiscing elit %ld.</p>\n", page);
+    append(&body, &len, &cap, "</body></html>\n");
+
+    response->body = body;
+    response->size = len;
+}
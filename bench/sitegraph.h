@@ -0,0 +1,44 @@
+/*
+Operating Systems Spring 2024
+Final Project
+
+Synthetic site graph served by the local stand-in server.
+*/
+
+#ifndef SITEGRAPH_H
+#define SITEGRAPH_H
+
+#include <stddef.h>
+
+#include "httpserver.h"
+
+/*
+    A complete tree of pages with known link depths.
+
+    Page /n/0 is the root at depth 0, page /n/i links to its children /n/(i*fanout+1) ..
+    /n/(i*fanout+fanout), to its parent and to the root. Links to the parent and the root
+    only point back up, so the link depth of every page is its depth in the tree.
+
+    A fixed set of pages, picked by a hash of the page number, answers 500 with no links, so the
+    pages below them cannot be reached; each page is also delayed by a fixed share of jitterMs.
+    The same graph always gives the same errors and delays.
+*/
+typedef struct
+{
+    int fanout;         // Links to child pages per page
+    int depth;          // Depth of the deepest pages
+    size_t pageSize;    // Pages are padded to at least this many bytes
+    int errorPercent;   // Share of the pages below the root that answer 500
+    int jitterMs;       // Pages are delayed by 0 .. jitterMs on top of the server's latency
+} SiteGraph;
+
+// Function prototypes
+void siteGraphHandler(const char *method, const char *path, const char *headers,
+                      HttpResponse *response, void *userdata);
+long siteGraphPages(const SiteGraph *graph, int maxDepth);
+int siteGraphDepthOf(const SiteGraph *graph, long page);
+int siteGraphIsError(const SiteGraph *graph, long page);
+long siteGraphReachable(const SiteGraph *graph);
+long siteGraphReachableErrors(const SiteGraph *graph);
+
+#endif
@@ -0,0 +1,1016 @@
+/*
+Operating Systems Spring 2024
+Final Project
+
+Cluster: a crawl split over several crawler processes, each the shard owning part of the hosts.
+
+Every host belongs to one shard, picked by consistent hashing: each shard has virtualNodes points
+on a 64-bit hash ring, and a host goes to the shard of the first point at or after the hash of its
+host[:port]. Every process builds the same ring from the same peer list, so they agree on the
+owner of every host without asking each other, and a shard added later takes over only about
+1/N of the hosts. A shard keeps its own frontier, visited set and politeness scheduler, and
+only ever fetches its own hosts.
+
+Links to another shard's hosts are handed to clusterForward(). They are collected per peer and
+sent as one message of up to batchUrls URLs, or after flushMs at the latest. A shard remembers the
+fingerprints of the URLs it sent, so a link found on many pages crosses the network once. The
+receiving shard queues them as if it had found them itself.
+
+Every shard connects to every other one over TCP or a Unix socket and sends on that connection
+only. A single cluster thread per process does all of the network work with poll(): accepting and
+connecting, reading and handling messages, and writing the batches, without ever blocking on a
+peer. Messages are a type byte and a 32-bit big-endian length, followed by the payload.
+
+The crawl is over when no shard has work left and no URL is on its way between shards. Shard 0
+checks this in waves: it asks every shard whether its crawl is idle and how many URLs it has sent
+and received so far. Once two waves in a row find every shard idle with the same counters, and
+the URLs sent add up to those received, nothing was sent or received between the waves and
+nothing is in flight, so shard 0 tells every shard to stop (the four-counter method).
+*/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "cluster.h"
+#include "hash.h"
+#include "visited.h"
+
+// Message types
+enum { MSG_HELLO = 1, MSG_URLS, MSG_ASK, MSG_STATUS, MSG_STOP };
+
+// Type byte and payload length in front of every message
+#define HEADER_SIZE 5
+
+// Longest URL sent between shards, in bytes
+#define MAX_URL 8192
+
+// Largest message taken from a peer; anything bigger means the stream is corrupt
+#define MAX_MESSAGE (16 << 20)
+
+// Time between two connection attempts to a shard that is not up yet
+#define RETRY_MS 50
+
+// Time the cluster thread keeps writing what is left when the cluster is destroyed
+#define DRAIN_MS 2000
+
+// Growing byte buffer
+typedef struct
+{
+    unsigned char *data;
+    size_t len, cap;
+} Buffer;
+
+// A point of a shard on the hash ring
+typedef struct
+{
+    uint64_t point;
+    int node;
+} RingPoint;
+
+struct HashRing
+{
+    int nodes;
+    size_t count;                   // Points on the ring
+    RingPoint points[];             // Sorted by point
+};
+
+// Another shard of the cluster
+typedef struct
+{
+    struct sockaddr_storage addr;   // Where it listens
+    socklen_t addrLen;
+    int out;                        // Connection this shard sends on, -1 while there is none
+    int connecting;                 // 1 while a non-blocking connect() is in progress
+    long long retryAt;              // Monotonic ms of the next connection attempt
+    Buffer output;                  // Framed messages not written yet, cluster thread only
+    pthread_mutex_t lock;           // Guards 'batch', 'batchCount' and 'batchStarted'
+    Buffer batch;                   // URL records waiting to be sent
+    int batchCount;
+    long long batchStarted;         // Monotonic ms the first URL of the batch was added
+    int answered;                   // Shard 0: answered the current wave
+    int idle;                       // Shard 0: its answers in the current and the previous wave
+    long sent, received;
+    int prevIdle;
+    long prevSent, prevReceived;
+} Peer;
+
+// A connection accepted from another shard
+typedef struct
+{
+    int fd;
+    int from;                       // Index of the shard, -1 until its hello arrived
+    Buffer input;                   // Bytes read, not handled yet
+} Incoming;
+
+struct Cluster
+{
+    ClusterConfig config;           // Settings given at creation ('peers' not kept)
+    HashRing *ring;
+    int count;                      // Shards in the cluster
+    Peer *peers;                    // Every shard, this one included (its entry only holds its wave answers)
+    int listenFd;
+    char unixPath[CLUSTER_MAX_ADDRESS]; // Socket file to remove at the end, "" for TCP
+    int wake[2];                    // Pipe waking the cluster thread for full batches and shutdown
+    pthread_t thread;
+    int threadStarted;
+    void *context;                  // Passed to the callbacks
+    Incoming *incoming;
+    int incomingCount, incomingCap;
+    VisitedSet *sentUrls;           // Fingerprints of the URLs forwarded so far
+    long long connectDeadline;      // Monotonic ms by which every shard must be connected
+    unsigned wave;                  // Shard 0: number of the current wave
+    int waveOpen;                   // Shard 0: a wave is waiting for answers
+    int havePrev;                   // Shard 0: a previous wave has been evaluated
+    long long nextWave;             // Shard 0: monotonic ms the next wave starts
+    atomic_int stop, finished, failed;
+    atomic_long forwarded, duplicates, received, batches, waves;
+    atomic_llong bytesSent;
+};
+
+// Current monotonic time in milliseconds
+static long long nowMs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// Append bytes to a buffer; returns 0, or -1 if memory allocation failed
+static int bufferAppend(Buffer *buffer, const void *data, size_t len)
+{
+    if (buffer->len + len > buffer->cap)
+    {
+        size_t cap = buffer->cap ? buffer->cap : 4096;
+        while (cap < buffer->len + len)
+            cap *= 2;
+        unsigned char *grown = realloc(buffer->data, cap);
+        if (grown == NULL)
+            return -1;
+        buffer->data = grown;
+        buffer->cap = cap;
+    }
+    memcpy(buffer->data + buffer->len, data, len);
+    buffer->len += len;
+    return 0;
+}
+
+// Drop the first 'len' bytes of a buffer
+static void bufferConsume(Buffer *buffer, size_t len)
+{
+    memmove(buffer->data, buffer->data + len, buffer->len - len);
+    buffer->len -= len;
+}
+
+static void putU32(unsigned char *p, uint32_t v)
+{
+    p[0] = (unsigned char)(v >> 24);
+    p[1] = (unsigned char)(v >> 16);
+    p[2] = (unsigned char)(v >> 8);
+    p[3] = (unsigned char)v;
+}
+
+static uint32_t getU32(const unsigned char *p)
+{
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+static void putU64(unsigned char *p, uint64_t v)
+{
+    putU32(p, (uint32_t)(v >> 32));
+    putU32(p + 4, (uint32_t)v);
+}
+
+static uint64_t getU64(const unsigned char *p)
+{
+    return (uint64_t)getU32(p) << 32 | getU32(p + 4);
+}
+
+// Append a framed message to a peer's output; returns 0, or -1 if memory allocation failed
+static int queueMessage(Peer *peer, int type, const void *payload, size_t len)
+{
+    unsigned char header[HEADER_SIZE];
+    header[0] = (unsigned char)type;
+    putU32(header + 1, (uint32_t)len);
+    if (bufferAppend(&peer->output, header, HEADER_SIZE) != 0)
+        return -1;
+    if (len > 0 && bufferAppend(&peer->output, payload, len) != 0)
+    {
+        peer->output.len -= HEADER_SIZE;
+        return -1;
+    }
+    return 0;
+}
+
+static int comparePoints(const void *a, const void *b)
+{
+    uint64_t x = ((const RingPoint *)a)->point, y = ((const RingPoint *)b)->point;
+    return (x > y) - (x < y);
+}
+
+/*
+    Build the hash ring of a cluster.
+
+    Preconditions:  'nodes' >= 1 and 'virtualNodes' >= 1.
+    Postcondition:  Returns a ring with 'virtualNodes' points per node, the same in every process for the same
+                    arguments, or NULL if memory allocation failed.
+*/
+HashRing *hashRingCreate(int nodes, int virtualNodes)
+{
+    size_t count = (size_t)nodes * (size_t)virtualNodes;
+    HashRing *ring = malloc(sizeof(HashRing) + count * sizeof(RingPoint));
+    if (ring == NULL)
+        return NULL;
+    ring->nodes = nodes;
+    ring->count = count;
+    for (int node = 0; node < nodes; node++)
+    {
+        for (int v = 0; v < virtualNodes; v++)
+        {
+            RingPoint *point = &ring->points[(size_t)node * (size_t)virtualNodes + (size_t)v];
+            point->point = mix64((uint64_t)node << 32 | (uint32_t)v);  // Depends on the node, not on the ring size
+            point->node = node;
+        }
+    }
+    qsort(ring->points, count, sizeof(RingPoint), comparePoints);
+    return ring;
+}
+
+/*
+    Find the node owning a key.
+
+    Preconditions:  'ring' was returned by hashRingCreate(), 'key' points to 'len' bytes.
+    Postcondition:  Returns the node of the first point at or after the hash of the key, wrapping around.
+*/
+int hashRingOwner(const HashRing *ring, const char *key, size_t len)
+{
+    uint64_t h = hash64(key, len);
+    size_t lo = 0, hi = ring->count;
+    while (lo < hi)                                     // First point >= h
+    {
+        size_t mid = lo + (hi - lo) / 2;
+        if (ring->points[mid].point < h)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return ring->points[lo == ring->count ? 0 : lo].node;
+}
+
+// Free a ring; NULL is ignored
+void hashRingDestroy(HashRing *ring)
+{
+    free(ring);
+}
+
+/*
+    Fill a ClusterConfig with the crawler's default settings.
+
+    Preconditions:  'config' points to a valid ClusterConfig structure.
+    Postcondition:  Every field is set except 'index' (0), 'peers' and the callbacks (NULL).
+*/
+void clusterConfigDefaults(ClusterConfig *config)
+{
+    config->index = 0;
+    config->peers = NULL;
+    config->virtualNodes = 160;         // Hosts spread within a few percent of evenly
+    config->batchUrls = 256;            // A message per 256 links, some 20 KB
+    config->flushMs = 10;
+    config->waveMs = 20;
+    config->connectTimeoutMs = 10000;
+    config->onUrl = NULL;
+    config->isIdle = NULL;
+}
+
+// Resolve "host:port" or a Unix socket path into 'addr'; returns 0, or -1 if it is invalid
+static int parseAddress(const char *text, size_t len, struct sockaddr_storage *addr, socklen_t *addrLen)
+{
+    char copy[CLUSTER_MAX_ADDRESS];
+    if (len == 0 || len >= sizeof(copy))
+        return -1;
+    memcpy(copy, text, len);
+    copy[len] = '\0';
+    memset(addr, 0, sizeof(*addr));
+
+    if (strchr(copy, '/') != NULL)                      // Unix socket
+    {
+        struct sockaddr_un *un = (struct sockaddr_un *)addr;
+        if (len >= sizeof(un->sun_path))
+            return -1;
+        un->sun_family = AF_UNIX;
+        memcpy(un->sun_path, copy, len + 1);
+        *addrLen = (socklen_t)sizeof(struct sockaddr_un);
+        return 0;
+    }
+
+    char *colon = strrchr(copy, ':');
+    if (colon == NULL || colon == copy || colon[1] == '\0')
+        return -1;
+    *colon = '\0';
+    char *host = copy;
+    size_t hostLen = strlen(host);
+    if (host[0] == '[' && host[hostLen - 1] == ']')     // [::1]:7000
+    {
+        host[hostLen - 1] = '\0';
+        host++;
+    }
+    struct addrinfo hints, *result;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(host, colon + 1, &hints, &result) != 0)
+        return -1;
+    memcpy(addr, result->ai_addr, result->ai_addrlen);
+    *addrLen = result->ai_addrlen;
+    freeaddrinfo(result);
+    return 0;
+}
+
+// Make a descriptor non-blocking and close-on-exec
+static void setNonBlocking(int fd)
+{
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+}
+
+// Mark the cluster as failed and stopped; the crawl of this shard ends with what it has
+static void failCluster(Cluster *cluster, const char *what, int shard)
+{
+    if (!atomic_load(&cluster->finished))
+        fprintf(stderr, "Shard %d: %s shard %d, the crawl stops.\n", cluster->config.index, what, shard);
+    atomic_store(&cluster->failed, 1);
+    atomic_store(&cluster->finished, 1);
+}
+
+// Start or finish the connections to the other shards
+static void connectPeers(Cluster *cluster, long long now)
+{
+    for (int i = 0; i < cluster->count; i++)
+    {
+        Peer *peer = &cluster->peers[i];
+        if (i == cluster->config.index || (peer->out >= 0 && !peer->connecting) || now < peer->retryAt)
+            continue;
+
+        if (peer->connecting)                           // Still in progress unless poll() said otherwise
+        {
+            int error = 0;
+            socklen_t len = sizeof(error);
+            struct pollfd pfd = { peer->out, POLLOUT, 0 };
+            if (poll(&pfd, 1, 0) == 0)
+                continue;
+            if (getsockopt(peer->out, SOL_SOCKET, SO_ERROR, &error, &len) == 0 && error == 0)
+            {
+                peer->connecting = 0;
+                continue;
+            }
+            close(peer->out);
+            peer->out = -1;
+            peer->connecting = 0;
+        }
+        else
+        {
+            peer->out = socket(peer->addr.ss_family, SOCK_STREAM, 0);
+            if (peer->out >= 0)
+            {
+                setNonBlocking(peer->out);
+                if (peer->addr.ss_family != AF_UNIX)
+                {
+                    int one = 1;                        // Batches are sent whole, do not hold them back
+                    setsockopt(peer->out, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+                }
+                if (connect(peer->out, (struct sockaddr *)&peer->addr, peer->addrLen) == 0)
+                    continue;
+                if (errno == EINPROGRESS)
+                {
+                    peer->connecting = 1;
+                    continue;
+                }
+                close(peer->out);
+                peer->out = -1;
+            }
+        }
+
+        // Not up yet: try again in a moment, unless it is too late
+        if (now >= cluster->connectDeadline)
+            failCluster(cluster, "cannot connect to", i);
+        peer->retryAt = now + RETRY_MS;
+    }
+}
+
+// Frame the batches that are full or due into the outputs; with 'all', every batch
+static void flushBatches(Cluster *cluster, long long now, int all)
+{
+    for (int i = 0; i < cluster->count; i++)
+    {
+        Peer *peer = &cluster->peers[i];
+        pthread_mutex_lock(&peer->lock);
+        if (peer->batchCount > 0 &&
+            (all || peer->batchCount >= cluster->config.batchUrls || now - peer->batchStarted >= cluster->config.flushMs))
+        {
+            if (queueMessage(peer, MSG_URLS, peer->batch.data, peer->batch.len) == 0)
+            {
+                atomic_fetch_add(&cluster->batches, 1);
+                peer->batch.len = 0;
+                peer->batchCount = 0;
+            }
+        }
+        pthread_mutex_unlock(&peer->lock);
+    }
+}
+
+// Write as much of every output as the connections take; returns 1 if anything is left
+static int writeOutputs(Cluster *cluster)
+{
+    int left = 0;
+    for (int i = 0; i < cluster->count; i++)
+    {
+        Peer *peer = &cluster->peers[i];
+        while (peer->output.len > 0 && peer->out >= 0 && !peer->connecting)
+        {
+            ssize_t n = send(peer->out, peer->output.data, peer->output.len, MSG_NOSIGNAL | MSG_DONTWAIT);
+            if (n > 0)
+            {
+                atomic_fetch_add(&cluster->bytesSent, n);
+                bufferConsume(&peer->output, (size_t)n);
+                continue;
+            }
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK)
+            {
+                close(peer->out);
+                peer->out = -1;
+                peer->output.len = 0;
+                failCluster(cluster, "lost the connection to", i);
+            }
+            break;
+        }
+        left = left || peer->output.len > 0;
+    }
+    return left;
+}
+
+// Shard 0: start a wave, or evaluate it once every shard has answered
+static void runWave(Cluster *cluster, long long now)
+{
+    if (atomic_load(&cluster->finished))
+        return;
+
+    if (!cluster->waveOpen)
+    {
+        if (now < cluster->nextWave)
+            return;
+        for (int i = 1; i < cluster->count; i++)        // Wait until every shard can be asked
+        {
+            if (cluster->peers[i].out < 0 || cluster->peers[i].connecting)
+                return;
+        }
+        cluster->wave++;
+        cluster->waveOpen = 1;
+        atomic_fetch_add(&cluster->waves, 1);
+        unsigned char ask[4];
+        putU32(ask, cluster->wave);
+        for (int i = 1; i < cluster->count; i++)
+        {
+            cluster->peers[i].answered = 0;
+            queueMessage(&cluster->peers[i], MSG_ASK, ask, sizeof(ask));
+        }
+
+        Peer *self = &cluster->peers[0];                // Counters first, then idle: see handleMessage()
+        self->sent = atomic_load(&cluster->forwarded);
+        self->received = atomic_load(&cluster->received);
+        self->idle = cluster->config.isIdle(cluster->context);
+        self->answered = 1;
+    }
+
+    long sent = 0, received = 0;
+    int allIdle = 1, same = cluster->havePrev;
+    for (int i = 0; i < cluster->count; i++)
+    {
+        Peer *peer = &cluster->peers[i];
+        if (!peer->answered)
+            return;
+        sent += peer->sent;
+        received += peer->received;
+        allIdle = allIdle && peer->idle;
+        same = same && peer->prevIdle && peer->sent == peer->prevSent && peer->received == peer->prevReceived;
+    }
+    cluster->waveOpen = 0;
+
+    if (allIdle && same && sent == received)            // Nothing happened between two idle waves
+    {
+        atomic_store(&cluster->finished, 1);
+        for (int i = 1; i < cluster->count; i++)
+            queueMessage(&cluster->peers[i], MSG_STOP, NULL, 0);
+        return;
+    }
+    for (int i = 0; i < cluster->count; i++)
+    {
+        Peer *peer = &cluster->peers[i];
+        peer->prevIdle = peer->idle;
+        peer->prevSent = peer->sent;
+        peer->prevReceived = peer->received;
+    }
+    cluster->havePrev = 1;
+    cluster->nextWave = now + cluster->config.waveMs;
+}
+
+// Handle one message from another shard; returns 0, or -1 if it is malformed
+static int handleMessage(Cluster *cluster, Incoming *in, int type, const unsigned char *payload, size_t len)
+{
+    if (type == MSG_HELLO)
+    {
+        if (len != 4 || getU32(payload) >= (uint32_t)cluster->count)
+            return -1;
+        in->from = (int)getU32(payload);
+        return 0;
+    }
+    if (in->from < 0 || atomic_load(&cluster->finished))   // Nothing is taken after the end of the crawl
+        return in->from < 0 ? -1 : 0;
+
+    if (type == MSG_URLS)
+    {
+        char url[MAX_URL + 1];
+        size_t off = 0;
+        while (off + 4 <= len)
+        {
+            int depth = payload[off] << 8 | payload[off + 1];
+            size_t urlLen = (size_t)(payload[off + 2] << 8 | payload[off + 3]);
+            off += 4;
+            if (urlLen > MAX_URL || off + urlLen > len)
+                return -1;
+            memcpy(url, payload + off, urlLen);
+            url[urlLen] = '\0';
+            off += urlLen;
+            cluster->config.onUrl(url, depth, cluster->context);
+            atomic_fetch_add(&cluster->received, 1);    // Counted once the URL is queued
+        }
+        return off == len ? 0 : -1;
+    }
+    if (type == MSG_ASK && len == 4)
+    {
+        // The counters are read before the crawl is asked whether it is idle: a URL received in between
+        // changes them by the next wave, so an answer is never idle with counters from before the URL
+        unsigned char status[21];
+        memcpy(status, payload, 4);
+        putU64(status + 5, (uint64_t)atomic_load(&cluster->forwarded));
+        putU64(status + 13, (uint64_t)atomic_load(&cluster->received));
+        status[4] = (unsigned char)(cluster->config.isIdle(cluster->context) != 0);
+        queueMessage(&cluster->peers[0], MSG_STATUS, status, sizeof(status));
+        return 0;
+    }
+    if (type == MSG_STATUS && len == 21 && cluster->config.index == 0)
+    {
+        Peer *peer = &cluster->peers[in->from];
+        if (cluster->waveOpen && getU32(payload) == cluster->wave)
+        {
+            peer->idle = payload[4];
+            peer->sent = (long)getU64(payload + 5);
+            peer->received = (long)getU64(payload + 13);
+            peer->answered = 1;
+        }
+        return 0;
+    }
+    if (type == MSG_STOP && len == 0)
+    {
+        atomic_store(&cluster->finished, 1);
+        return 0;
+    }
+    return -1;
+}
+
+// Read what a connection has and handle the complete messages; returns 0, or -1 if it is closed or broken
+static int readIncoming(Cluster *cluster, Incoming *in)
+{
+    unsigned char chunk[65536];
+    ssize_t n;
+    while ((n = read(in->fd, chunk, sizeof(chunk))) > 0)
+    {
+        if (bufferAppend(&in->input, chunk, (size_t)n) != 0)
+            return -1;
+    }
+    int closed = n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR);
+
+    size_t off = 0;
+    while (in->input.len - off >= HEADER_SIZE)
+    {
+        const unsigned char *message = in->input.data + off;
+        size_t len = getU32(message + 1);
+        if (len > MAX_MESSAGE)
+            return -1;
+        if (in->input.len - off < HEADER_SIZE + len)
+            break;
+        if (handleMessage(cluster, in, message[0], message + HEADER_SIZE, len) != 0)
+            return -1;
+        off += HEADER_SIZE + len;
+    }
+    bufferConsume(&in->input, off);
+    return closed ? -1 : 0;
+}
+
+// Take the connections waiting on the listening socket
+static void acceptIncoming(Cluster *cluster)
+{
+    int fd;
+    while ((fd = accept(cluster->listenFd, NULL, NULL)) >= 0)
+    {
+        if (cluster->incomingCount == cluster->incomingCap)
+        {
+            int cap = cluster->incomingCap ? cluster->incomingCap * 2 : 8;
+            Incoming *grown = realloc(cluster->incoming, sizeof(Incoming) * (size_t)cap);
+            if (grown == NULL)
+            {
+                close(fd);
+                continue;
+            }
+            cluster->incoming = grown;
+            cluster->incomingCap = cap;
+        }
+        setNonBlocking(fd);
+        cluster->incoming[cluster->incomingCount++] = (Incoming){ .fd = fd, .from = -1 };
+    }
+}
+
+/*
+    Cluster thread: connect to the other shards, exchange URLs and run the termination check until the
+    cluster is destroyed.
+
+    Waits in poll() on the connections, the listening socket and the wake pipe, for at most flushMs so
+    batches never wait longer than that.
+*/
+static void *clusterThread(void *arg)
+{
+    Cluster *cluster = (Cluster *)arg;
+    int coordinator = cluster->config.index == 0;
+    long long drainUntil = -1;                          // Set once the cluster is destroyed
+    int pollCap = 0;
+    struct pollfd *fds = NULL;
+
+    while (1)
+    {
+        long long now = nowMs();
+        int stop = atomic_load(&cluster->stop);
+        if (stop && drainUntil < 0)
+            drainUntil = now + DRAIN_MS;
+
+        if (!atomic_load(&cluster->failed))
+            connectPeers(cluster, now);
+        flushBatches(cluster, now, stop);
+        if (coordinator)
+            runWave(cluster, now);
+        int left = writeOutputs(cluster);
+        if (stop && (!left || now >= drainUntil || atomic_load(&cluster->failed)))
+            break;
+
+        // Wait for connections, messages, room to write, a full batch or the next flush
+        int need = 2 + cluster->incomingCount + cluster->count;
+        if (need > pollCap)
+        {
+            struct pollfd *grown = realloc(fds, sizeof(struct pollfd) * (size_t)need);
+            if (grown == NULL)
+            {
+                usleep(1000);
+                continue;
+            }
+            fds = grown;
+            pollCap = need;
+        }
+        int n = 0;
+        fds[n++] = (struct pollfd){ cluster->wake[0], POLLIN, 0 };
+        fds[n++] = (struct pollfd){ cluster->listenFd, POLLIN, 0 };
+        for (int i = 0; i < cluster->incomingCount; i++)
+            fds[n++] = (struct pollfd){ cluster->incoming[i].fd, POLLIN, 0 };
+        for (int i = 0; i < cluster->count; i++)
+        {
+            Peer *peer = &cluster->peers[i];
+            if (peer->out >= 0 && (peer->connecting || peer->output.len > 0))
+                fds[n++] = (struct pollfd){ peer->out, POLLOUT, 0 };
+        }
+        long timeoutMs = cluster->config.flushMs;
+        if (coordinator && timeoutMs > cluster->config.waveMs)
+            timeoutMs = cluster->config.waveMs;
+        if (poll(fds, (nfds_t)n, timeoutMs > 0 ? (int)timeoutMs : 1) < 0)
+            continue;                                   // Interrupted, look again
+
+        if (fds[0].revents & POLLIN)
+        {
+            char drain[64];
+            while (read(cluster->wake[0], drain, sizeof(drain)) > 0)
+                ;
+        }
+        if (fds[1].revents & POLLIN)
+            acceptIncoming(cluster);
+        for (int i = 0; i < cluster->incomingCount; i++)
+        {
+            Incoming *in = &cluster->incoming[i];
+            if (readIncoming(cluster, in) == 0)
+                continue;
+            if (!atomic_load(&cluster->finished) && !stop)
+                failCluster(cluster, "lost the connection from", in->from);
+            close(in->fd);
+            free(in->input.data);
+            cluster->incoming[i--] = cluster->incoming[--cluster->incomingCount];
+        }
+    }
+    free(fds);
+    return NULL;
+}
+
+// Free a cluster that is created in part or in full, its thread stopped
+static void releaseCluster(Cluster *cluster)
+{
+    for (int i = 0; cluster->peers != NULL && i < cluster->count; i++)
+    {
+        Peer *peer = &cluster->peers[i];
+        if (peer->out >= 0)
+            close(peer->out);
+        free(peer->output.data);
+        free(peer->batch.data);
+        pthread_mutex_destroy(&peer->lock);
+    }
+    for (int i = 0; i < cluster->incomingCount; i++)
+    {
+        close(cluster->incoming[i].fd);
+        free(cluster->incoming[i].input.data);
+    }
+    if (cluster->listenFd >= 0)
+        close(cluster->listenFd);
+    if (cluster->unixPath[0] != '\0')
+        unlink(cluster->unixPath);
+    if (cluster->wake[0] >= 0)
+    {
+        close(cluster->wake[0]);
+        close(cluster->wake[1]);
+    }
+    visitedDestroy(cluster->sentUrls);
+    hashRingDestroy(cluster->ring);
+    free(cluster->incoming);
+    free(cluster->peers);
+    free(cluster);
+}
+
+/*
+    Create this process's shard of a cluster and start listening for the other shards.
+
+    Preconditions:  'config' points to a valid ClusterConfig with 'peers', 'onUrl' and 'isIdle' set.
+    Postcondition:  Returns the shard, listening on its address in 'peers', or NULL after printing an error if the
+                    peer list or index is invalid, the address cannot be bound or memory allocation failed. URLs may
+                    be forwarded right away; they are sent once clusterStart() has started the cluster thread.
+*/
+Cluster *clusterCreate(const ClusterConfig *config)
+{
+    Cluster *cluster = calloc(1, sizeof(Cluster));
+    if (cluster == NULL)
+        return NULL;
+    cluster->config = *config;
+    cluster->config.peers = NULL;
+    cluster->listenFd = -1;
+    cluster->wake[0] = cluster->wake[1] = -1;
+    atomic_init(&cluster->stop, 0);
+    atomic_init(&cluster->finished, 0);
+    atomic_init(&cluster->failed, 0);
+
+    // Peer list: one address per shard, in index order
+    int count = 1;
+    for (const char *p = config->peers; *p != '\0'; p++)
+        count += *p == ',';
+    if (count > CLUSTER_MAX_SHARDS || config->index < 0 || config->index >= count)
+    {
+        fprintf(stderr, "Shard %d does not fit a cluster of %d shards.\n", config->index, count);
+        releaseCluster(cluster);
+        return NULL;
+    }
+    cluster->count = count;
+    cluster->peers = calloc((size_t)count, sizeof(Peer));
+    if (cluster->peers == NULL)
+    {
+        releaseCluster(cluster);
+        return NULL;
+    }
+    const char *p = config->peers;
+    for (int i = 0; i < count; i++)
+    {
+        Peer *peer = &cluster->peers[i];
+        pthread_mutex_init(&peer->lock, NULL);
+        peer->out = -1;
+        const char *end = strchr(p, ',');
+        size_t len = end != NULL ? (size_t)(end - p) : strlen(p);
+        if (parseAddress(p, len, &peer->addr, &peer->addrLen) != 0)
+        {
+            fprintf(stderr, "Invalid shard address: %.*s\n", (int)len, p);
+            cluster->count = i + 1;
+            releaseCluster(cluster);
+            return NULL;
+        }
+        p += len + 1;
+    }
+
+    // Listen on this shard's address
+    Peer *self = &cluster->peers[config->index];
+    if (self->addr.ss_family == AF_UNIX)
+    {
+        const char *path = ((struct sockaddr_un *)&self->addr)->sun_path;
+        unlink(path);                                   // Left over from an earlier run
+        snprintf(cluster->unixPath, sizeof(cluster->unixPath), "%s", path);
+    }
+    int one = 1;
+    cluster->listenFd = socket(self->addr.ss_family, SOCK_STREAM, 0);
+    if (cluster->listenFd >= 0 && self->addr.ss_family != AF_UNIX)
+        setsockopt(cluster->listenFd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (cluster->listenFd < 0 || bind(cluster->listenFd, (struct sockaddr *)&self->addr, self->addrLen) != 0 ||
+        listen(cluster->listenFd, SOMAXCONN) != 0)
+    {
+        perror("Cannot listen for the other shards");
+        releaseCluster(cluster);
+        return NULL;
+    }
+    setNonBlocking(cluster->listenFd);
+
+    cluster->ring = hashRingCreate(count, config->virtualNodes > 0 ? config->virtualNodes : 1);
+    cluster->sentUrls = visitedCreate(0);
+    if (cluster->ring == NULL || cluster->sentUrls == NULL || pipe(cluster->wake) != 0)
+    {
+        releaseCluster(cluster);
+        return NULL;
+    }
+    setNonBlocking(cluster->wake[0]);
+    setNonBlocking(cluster->wake[1]);
+
+    // Every connection starts with the sender's index
+    unsigned char hello[4];
+    putU32(hello, (uint32_t)config->index);
+    for (int i = 0; i < count; i++)
+    {
+        if (i != config->index && queueMessage(&cluster->peers[i], MSG_HELLO, hello, sizeof(hello)) != 0)
+        {
+            releaseCluster(cluster);
+            return NULL;
+        }
+    }
+    return cluster;
+}
+
+/*
+    Start the cluster thread.
+
+    Preconditions:  'cluster' was returned by clusterCreate(); 'context' is passed to the callbacks of its config,
+                    which may be called on the cluster thread from now on.
+    Postcondition:  Returns 0 with the thread connecting to the other shards, or -1 if it could not be started.
+*/
+int clusterStart(Cluster *cluster, void *context)
+{
+    cluster->context = context;
+    cluster->connectDeadline = nowMs() + cluster->config.connectTimeoutMs;
+    if (pthread_create(&cluster->thread, NULL, clusterThread, cluster) != 0)
+        return -1;
+    cluster->threadStarted = 1;
+    return 0;
+}
+
+// Number of shards of the cluster
+int clusterSize(const Cluster *cluster)
+{
+    return cluster->count;
+}
+
+// Index of this process's shard
+int clusterIndex(const Cluster *cluster)
+{
+    return cluster->config.index;
+}
+
+/*
+    Find the shard owning the host of a URL.
+
+    Preconditions:  'cluster' was returned by clusterCreate(), 'url' is a null-terminated absolute URL.
+    Postcondition:  Returns the index of the shard owning its host[:port], lowercased and without user info.
+*/
+int clusterOwner(const Cluster *cluster, const char *url)
+{
+    char key[256];
+    const char *p = strstr(url, "://");
+    p = p != NULL ? p + 3 : url;
+    size_t len = 0;
+    for (; p[len] != '\0' && p[len] != '/' && p[len] != '?' && p[len] != '#'; len++)
+    {
+        if (p[len] == '@')                              // user:password@host
+        {
+            p += len + 1;
+            len = (size_t)-1;
+        }
+    }
+    if (len >= sizeof(key))
+        len = sizeof(key) - 1;
+    for (size_t i = 0; i < len; i++)
+        key[i] = (char)(p[i] >= 'A' && p[i] <= 'Z' ? p[i] - 'A' + 'a' : p[i]);
+    return hashRingOwner(cluster->ring, key, len);
+}
+
+/*
+    Send a URL to the shard owning its host. Safe to call from any number of threads.
+
+    Preconditions:  'cluster' was returned by clusterCreate(), 'url' belongs to another shard (see clusterOwner()).
+    Postcondition:  Returns 0 with the URL added to the owner's next batch, 1 if it was sent before and is dropped,
+                    or -1 if it is too long or memory allocation failed.
+*/
+int clusterForward(Cluster *cluster, const char *url, int depth)
+{
+    size_t len = strlen(url);
+    if (len > MAX_URL || depth < 0 || depth > 0xffff)
+        return -1;
+    if (visitedTestAndInsert(cluster->sentUrls, urlFingerprint(url)) != 1)
+    {
+        atomic_fetch_add(&cluster->duplicates, 1);
+        return 1;
+    }
+
+    Peer *peer = &cluster->peers[clusterOwner(cluster, url)];
+    unsigned char record[4] = { (unsigned char)(depth >> 8), (unsigned char)depth,
+                                (unsigned char)(len >> 8), (unsigned char)len };
+    pthread_mutex_lock(&peer->lock);
+    int ok = bufferAppend(&peer->batch, record, sizeof(record)) == 0;
+    if (ok && bufferAppend(&peer->batch, url, len) != 0)
+    {
+        peer->batch.len -= sizeof(record);
+        ok = 0;
+    }
+    int full = 0;
+    if (ok)
+    {
+        if (peer->batchCount++ == 0)
+            peer->batchStarted = nowMs();
+        full = peer->batchCount == cluster->config.batchUrls;
+        atomic_fetch_add(&cluster->forwarded, 1);       // Counted before the batch can reach the owner
+    }
+    pthread_mutex_unlock(&peer->lock);
+
+    if (full)                                           // Send it now rather than at the next flush
+    {
+        ssize_t written = write(cluster->wake[1], "", 1);
+        (void)written;
+    }
+    return ok ? 0 : -1;
+}
+
+/*
+    Tell whether the crawl of the cluster is over.
+
+    Preconditions:  'cluster' was returned by clusterCreate().
+    Postcondition:  Returns 1 once every shard has run out of work with no URL left between shards, or the
+                    cluster failed; from then on no URL is received and the callbacks are not called again.
+*/
+int clusterFinished(Cluster *cluster)
+{
+    return atomic_load(&cluster->finished);
+}
+
+// 1 if the cluster stopped because a shard could not be reached or went away
+int clusterFailed(Cluster *cluster)
+{
+    return atomic_load(&cluster->failed);
+}
+
+// Read the counters of this shard
+void clusterStats(Cluster *cluster, ClusterStats *stats)
+{
+    stats->forwarded = atomic_load(&cluster->forwarded);
+    stats->duplicates = atomic_load(&cluster->duplicates);
+    stats->received = atomic_load(&cluster->received);
+    stats->batches = atomic_load(&cluster->batches);
+    stats->bytesSent = atomic_load(&cluster->bytesSent);
+    stats->waves = atomic_load(&cluster->waves);
+}
+
+/*
+    Leave the cluster.
+
+    Preconditions:  'cluster' was returned by clusterCreate() or is NULL, and no thread uses it any more.
+    Postcondition:  What is left to send (shard 0's stop messages) is written, for at most DRAIN_MS, the cluster
+                    thread is stopped and the connections and memory are released.
+*/
+void clusterDestroy(Cluster *cluster)
+{
+    if (cluster == NULL)
+        return;
+    atomic_store(&cluster->stop, 1);
+    if (cluster->threadStarted)
+    {
+        ssize_t written = write(cluster->wake[1], "", 1);
+        (void)written;
+        pthread_join(cluster->thread, NULL);
+    }
+    releaseCluster(cluster);
+}
@@ -0,0 +1,65 @@
+/*
+Operating Systems Spring 2024
+Final Project
+
+Cluster: a crawl split over several crawler processes, each the shard owning part of the hosts.
+*/
+
+#ifndef CLUSTER_H
+#define CLUSTER_H
+
+#include <stddef.h>
+
+// Most shards of a cluster
+#define CLUSTER_MAX_SHARDS 256
+
+// Longest peer address, including the terminating null byte
+#define CLUSTER_MAX_ADDRESS 108
+
+typedef struct Cluster Cluster;
+
+// Consistent-hash ring mapping host names to shards
+typedef struct HashRing HashRing;
+
+// Settings for clusterCreate()
+typedef struct
+{
+    int index;                  // This shard's position in 'peers'
+    const char *peers;          // Address of every shard, comma-separated: "host:port" for TCP, a path with a '/' for a Unix socket
+    int virtualNodes;           // Points of every shard on the hash ring
+    int batchUrls;              // URLs sent to a peer in one message at most
+    long flushMs;               // Longest a URL waits before its batch is sent
+    long waveMs;                // Time between two termination checks of shard 0
+    long connectTimeoutMs;      // Time the other shards have to come up
+    void (*onUrl)(const char *url, int depth, void *context);   // Called on the cluster thread for every URL received
+    int (*isIdle)(void *context);   // 1 if the local crawl has no work left, asked by the termination check
+} ClusterConfig;
+
+// Counters of a shard since it was created
+typedef struct
+{
+    long forwarded;             // URLs handed to clusterForward() and sent to their owner
+    long duplicates;            // URLs not sent because they were sent before
+    long received;              // URLs received from other shards
+    long batches;               // Messages of URLs sent
+    long long bytesSent;        // Bytes sent to other shards, URLs and control messages
+    long waves;                 // Termination checks run (shard 0 only)
+} ClusterStats;
+
+// Function prototypes
+HashRing *hashRingCreate(int nodes, int virtualNodes);
+int hashRingOwner(const HashRing *ring, const char *key, size_t len);
+void hashRingDestroy(HashRing *ring);
+void clusterConfigDefaults(ClusterConfig *config);
+Cluster *clusterCreate(const ClusterConfig *config);
+int clusterStart(Cluster *cluster, void *context);
+int clusterSize(const Cluster *cluster);
+int clusterIndex(const Cluster *cluster);
+int clusterOwner(const Cluster *cluster, const char *url);
+int clusterForward(Cluster *cluster, const char *url, int depth);
+int clusterFinished(Cluster *cluster);
+int clusterFailed(Cluster *cluster);
+void clusterStats(Cluster *cluster, ClusterStats *stats);
+void clusterDestroy(Cluster *cluster);
+
+#endif
@@ -5,195 +5,451 @@ Final Project
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <sys/types.h>
+#include <unistd.h>
 #include <curl/curl.h>
 #include <pthread.h>
 #include <libxml/HTMLparser.h>
 
-// Maximum length of the URL queue
-#define MAXLEN 1024
+#include "crawler.h"
 
-// Number of worker threads
-#define NUMWORKERS 2
+// URLs moved from the frontier to the scheduler at a time
+#define ADMIT_BATCH 64
 
-// Maximum length of the URL
-#define MAX_URL_LENGTH 256
+// Longest a worker with nothing to do parks before it looks for work again without being woken
+#define PARK_MS 100
 
-// Global set to store visited URLs
-#define MAX_VISITED_URLS 10000 // Adjust the size as needed
-char *visited_urls[MAX_VISITED_URLS];
-int visited_count = 0;
+// Wait in milliseconds between two looks of an idle shard's workers at whether the cluster is finished
+#define CLUSTER_POLL_MS 20
 
-// Struct to hold the URL queue
-typedef struct
-{
-    char* urls[MAXLEN]; // Array to store URLs`     ``
-    int front, rear;    // Front and rear pointers of the queue
-} Queue;
+// Maximum length of the URL typed in interactive mode, including the terminating null byte
+#define MAX_URL_LENGTH 256
 
-// Struct to hold CURL response
-struct CURLResponse
-{
-    char *html;         // Pointer to HTML content
-    size_t size;        // Size of HTML content
-};
+// Room for the log file and state directory names of a shard, including the terminating null byte
+#define MAX_PATH_LENGTH 4096
 
-// Struct to pass data to worker threads
-typedef struct
-{
-    Queue *queue;                   // Pointer to the URL queue
-    pthread_mutex_t *mutex;         // Pointer to mutex for thread safety
-    int maxdepth;                   // Maximum depth for URL traversal
-} ThreadData;
+// Page store in the state directory, see pagestore.h
+#define PAGES_FILE "pages"
 
-// Function prototypes
-struct CURLResponse GetRequest(CURL *curl_handle, const char *url);
-static size_t WriteHTMLCallback(void *contents, size_t size, size_t nmemb, void *userp);
-void extractUrls(htmlDocPtr doc, Queue* q, pthread_mutex_t *mutex);
-void *worker(void *arg);
-void logEvent(const char *event, const char *url, const char *status, int depth);
-int isVisited(const char *url);
-void markVisited(const char *url);
+// Global set to store the fingerprints of visited URLs
+#define EXPECTED_VISITED_URLS 10000 // Initial sizing, the set grows as needed
+VisitedSet *visited_urls;
 
 
+/* Function to check if a URL has been visited
 
-// QUEUE FUNCTIONS
+    Preconditions:  'url' points to a valid null-terminated string containing the URL to check.
+                    'visited_urls' has been created with visitedCreate().
+    Postconditions: Returns 1 if the fingerprint of the URL is present in 'visited_urls'; otherwise, returns 0.
+*/
+int isVisited(const char *url) {
+    return visitedContains(visited_urls, urlFingerprint(url)); // Hash lookup, independent of the number of visited URLs
+}
 
-/*
-    Initialize the URL queue.
+/* Function to mark a URL as visited
 
-    Preconditions:  'queue' points to a valid Queue structure.
-    Postcondition:  The front and rear pointers of the queue are set to -1, indicating an empty queue.
+    Preconditions:  'url' points to a valid null-terminated string containing the URL to mark as visited.
+                    'visited_urls' has been created with visitedCreate().
+    Postconditions: Atomically checks and records the fingerprint of the URL. Returns 1 if this call marked it,
+                    or 0 if it was already visited, so of several workers racing on one URL exactly one gets 1.
 */
-void initializeQueue(Queue* queue)
+int markVisited(const char *url) {
+    return visitedTestAndInsert(visited_urls, urlFingerprint(url)) == 1; // Test-and-insert in one step
+}
+
+// Current monotonic time in milliseconds
+static long long nowMs(void)
 {
-    queue->front = queue->rear = -1; // Set front and rear pointers to -1 for an empty queue
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
 }
 
-/*
-    Check if the URL queue is empty.
+// Report a URL taken from the frontier as finished; the last one wakes every parked worker to end the crawl
+static void urlFinished(ThreadData *data)
+{
+    if (frontierDone(data->frontier, 1) == 0)
+        poolWakeAll(data->pool);
+}
 
-    Preconditions:  'queue' points to a valid Queue structure.
-    Postcondition:  Returns 1 if the queue is empty, otherwise returns 0.
-*/
-int isQueueEmpty(Queue* queue)
+// Queue a URL taken from the frontier under its host, unless it was visited before
+static void scheduleUrl(ThreadData *data, const char *url, int depth)
 {
-    return queue->front == -1; // Return 1 if the queue is empty, otherwise return 0
+    // Mark URL as visited now so it is queued, and fetched, only once
+    if (!markVisited(url)) { // Check if URL has been visited
+        urlFinished(data);
+        return;              // Skip processing if URL has been visited
+    }
+
+    if (schedulerPush(data->scheduler, url, depth) < 0)   // No host or out of memory
+    {
+        logEvent(LOG_WARN, "Failed to retrieve HTML content", url, NULL, depth);
+        atomic_fetch_add(&data->pagesFailed, 1);
+        journalDone(data->journal, url);                  // Given up on, not to be resumed
+        urlFinished(data);
+    }
 }
 
 /*
-    Enqueue a URL into the URL queue.
-
-    Preconditions:  'queue' points to a valid Queue structure, 'url' points to a valid string containing the URL to be enqueued.
-    Postcondition:  If the queue is not full, the URL is enqueued at the rear of the queue.
+    Move URLs from the frontier to the politeness scheduler.
+
+    Preconditions:  'data' points to a ThreadData whose frontier and scheduler were created with the same maximum depth,
+                    'lane' is the frontier lane of the calling worker, 0 for the shared one.
+    Postcondition:  Up to 'max' URLs are taken from the frontier, those of 'lane' first and then those of other workers.
+                    Those not visited before are marked visited and queued under their host; a URL the scheduler cannot
+                    take counts as failed. With a robots.txt cache, a URL its host's robots.txt disallows is dropped,
+                    and one whose host's robots.txt is being fetched waits in the cache for crawlRobotsRelease().
+                    Returns the number of URLs taken.
 */
-void enqueue(Queue* queue, const char* url)
+int admitUrls(ThreadData *data, int lane, int max)
 {
-    if (queue->rear == MAXLEN - 1)          // Check if the queue is full
-    {
-        printf("Queue is full!\n");         // Print message indicating the queue is full
-        return;                             // Return without enqueuing
-    }
-    if (queue->front == -1)                 // Check if the queue is empty
+    char url[FRONTIER_MAX_URL];   // Variable to store URL
+    int depth;                    // Link depth of the URL
+    int taken = 0;
+
+    while (taken < max && frontierPopLane(data->frontier, lane, url, sizeof(url), &depth))
     {
-        queue->front = 0;                   // Set the front pointer to 0
+        taken++;
+        int robots = data->robots != NULL ? robotsAdmit(data->robots, url, depth) : ROBOTS_ALLOWED;
+        if (robots == ROBOTS_PENDING)
+            continue;                                     // Queued once its host's robots.txt is in
+        if (robots == ROBOTS_DISALLOWED)
+        {
+            logEvent(LOG_INFO, "Disallowed by robots.txt", url, NULL, depth);
+            journalDone(data->journal, url);              // Not to be fetched, resumed or not
+            urlFinished(data);
+            continue;
+        }
+        scheduleUrl(data, url, depth);
     }
-    queue->rear++;                          // Increment the rear pointer
-    queue->urls[queue->rear] = strdup(url); // Enqueue the URL by copying it into the queue array
+    return taken;
+}
+
+// Gauges of a running crawl, for the metrics
+static long frontierGauge(void *arg)
+{
+    return frontierSize(((ThreadData *)arg)->frontier);
 }
 
+static long schedulerGauge(void *arg)
+{
+    return schedulerSize(((ThreadData *)arg)->scheduler);
+}
 
-// Dequeue a URL from the queue
-char* dequeue(Queue* queue)
+static long hostsGauge(void *arg)
 {
-    if (isQueueEmpty(queue))               // Check if the queue is empty
-    {
-        printf("Queue is empty!\n");       // Print message indicating the queue is empty
-        return NULL;                       // Return NULL indicating no URL is dequeued
-    }
-    char* url = queue->urls[queue->front]; // Get the URL from the front of the queue
-    if (queue->front == queue->rear)       // If there's only one element in the queue
+    return schedulerHosts(((ThreadData *)arg)->scheduler);
+}
+
+static long workersGauge(void *arg)
+{
+    return poolThreads(((ThreadData *)arg)->pool);
+}
+
+/*
+    Run the worker threads until the crawl is complete.
+
+    Preconditions:  'data' points to a ThreadData whose frontier holds the seed URLs and whose scheduler was created with
+                    the frontier's maximum depth, 'visited_urls' has been created. With a cluster, the cluster was
+                    created with crawlReceive() and crawlIdle() as its callbacks and is not started yet.
+    Postcondition:  The pool starts 'numWorkers' workers, and adds more while they are saturated, up to data->maxWorkers.
+                    Returns 0 once no URL is queued or in flight and every worker has finished, with the pool's counters
+                    in data->poolStats; or -1 if a worker thread or the cluster thread could not be created. With a
+                    cluster, the crawl is complete once every shard has run out of work.
+*/
+int crawl(ThreadData *data, int numWorkers)
+{
+    PoolConfig poolConfig;
+    poolConfigDefaults(&poolConfig);
+    poolConfig.minThreads = numWorkers;
+    poolConfig.maxThreads = data->maxWorkers > numWorkers ? data->maxWorkers : numWorkers;
+    data->pool = poolCreate(&poolConfig, worker, data);
+    if (data->pool == NULL)
     {
-        queue->front = queue->rear = -1;   // Set front and rear pointers to indicate an empty queue
+        fprintf(stderr, "Memory allocation failed!\n");
+        return -1;
     }
-    else
+    if (data->cluster != NULL && clusterStart(data->cluster, data) != 0)   // Exchange URLs with the other shards
     {
-        queue->front++;                    // Move the front pointer to the next element
+        fprintf(stderr, "Error creating cluster thread\n");
+        poolDestroy(data->pool);
+        data->pool = NULL;
+        return -1;
     }
-    return url;                            // Return the dequeued URL
+
+    // Lengths of the queues and the pool, read whenever the metrics are served
+    metricsAddGauge("crawler_frontier_urls", "URLs queued in the frontier.", frontierGauge, data);
+    metricsAddGauge("crawler_scheduler_urls", "URLs queued in the politeness scheduler.", schedulerGauge, data);
+    metricsAddGauge("crawler_hosts", "Hosts the politeness scheduler has seen.", hostsGauge, data);
+    metricsAddGauge("crawler_workers", "Worker threads running.", workersGauge, data);
+
+    // Create worker threads; those that did start carry the crawl on their own
+    int started = poolStart(data->pool);
+    if (started < numWorkers)
+        perror("Error creating thread");
+
+    // Wait for worker threads to finish
+    poolJoin(data->pool);
+    metricsRemoveGauges(data);
+    poolStats(data->pool, &data->poolStats);
+    poolDestroy(data->pool);
+    data->pool = NULL;
+    return started == numWorkers ? 0 : -1;
 }
 
 /*
-    Display the contents of the URL queue.
+    Tell the cluster whether this shard's crawl has run out of work; the isIdle callback of the cluster.
 
-    Preconditions:  'queue' points to a valid Queue structure.
-    Postcondition:  The URLs in the queue are displayed on the console.
+    Preconditions:  'arg' points to the ThreadData of a running crawl().
+    Postcondition:  Returns 1 if no URL is queued, waiting in the scheduler or in flight. The frontier counts a URL
+                    from before it is queued until its page is done and its links are queued, so the answer cannot
+                    be 1 while any work is left; only a URL received from another shard can end it.
 */
-void display(Queue* queue)
+int crawlIdle(void *arg)
 {
-    if (queue->rear == -1)                                // If the queue is empty
-        printf("\nQueue is Empty!");                      // Print message indicating the queue is empty
-    else
-    {
-        printf("\nQueue elements are:\n");                // Print message indicating the queue elements will be displayed
-        for (int i = queue->front; i <= queue->rear; i++) // Iterate over the elements in the queue
-            printf("%s  ", queue->urls[i]);               // Print each URL in the queue
-    }
-    printf("\n");                                         // Print a newline character
+    ThreadData *data = (ThreadData *)arg;
+    return frontierPending(data->frontier) == 0;
 }
 
-// END QUEUE FUNCTIONS
+// Queue a link at link depth 'depth' on a frontier lane, and log it to the journal unless it was fetched already
+static void queueLink(ThreadData *data, int lane, const char *url, int depth)
+{
+    if (data->robots != NULL && robotsCheck(data->robots, url) == ROBOTS_DISALLOWED)
+        return;                                             // Never takes room in the frontier
+    if (frontierPushLane(data->frontier, lane, url, depth) != 0)   // Enqueue the URL
+        return;
+    poolWake(data->pool);                                   // A parked worker can take it
+    if (data->journal != NULL && !isVisited(url))           // and log it unless it was fetched already
+        journalQueued(data->journal, url, depth);
+}
 
-/* Function to check if a URL has been visited
+// Queue a URL another shard found on its pages; the onUrl callback of the cluster
+void crawlReceive(const char *url, int depth, void *arg)
+{
+    queueLink((ThreadData *)arg, 0, url, depth);
+}
 
-    Preconditions:  'url' points to a valid null-terminated string containing the URL to check.
-    Postconditions: Returns 1 if the URL has been visited and is present in the 'visited_urls'
-                    array; otherwise, returns 0.
+/*
+    Queue or drop a URL that waited for the robots.txt of its host; the onRelease callback of the robots.txt cache.
+
+    Preconditions:  'arg' points to the ThreadData of a running crawl(); the URL was taken from its frontier and
+                    parked by robotsAdmit(). Called on the cache's thread.
+    Postcondition:  An allowed URL is queued under its host as admitUrls() would have; a disallowed one is done with.
 */
-int isVisited(const char *url) {
-    for (int i = 0; i < visited_count; i++) {  // Loop through visited URLs
-        if (strcmp(visited_urls[i], url) == 0) {  // Check if the current URL matches the provided URL
-            return 1; // URL has been visited
-        }
+void crawlRobotsRelease(const char *url, int depth, int allowed, void *arg)
+{
+    ThreadData *data = (ThreadData *)arg;
+    if (!allowed)
+    {
+        logEvent(LOG_INFO, "Disallowed by robots.txt", url, NULL, depth);
+        journalDone(data->journal, url);
+        frontierDone(data->frontier, 1);                    // Parked workers see the end within PARK_MS
+        return;
     }
-    return 0; // URL has not been visited
+    scheduleUrl(data, url, depth);
+    if (data->pool != NULL)
+        poolWake(data->pool);                               // A parked worker can fetch it
 }
 
-/* Function to mark a URL as visited
+// Space the transfers of a host by the Crawl-delay of its robots.txt; the onDelay callback of the robots.txt cache
+void crawlRobotsDelay(const char *url, long delayMs, void *arg)
+{
+    schedulerSetDelay(((ThreadData *)arg)->scheduler, url, delayMs);
+}
 
-    Preconditions:  'url' points to a valid null-terminated string containing the URL to mark as visited.
-    Postconditions: If the number of visited URLs is less than 'MAX_VISITED_URLS', the provided URL is
-                    copied into the 'visited_urls' array, and 'visited_count' is incremented by 1.
+#ifndef CRAWLER_NO_MAIN
+/*
+    Queue a seed URL.
+
+    Preconditions:  'frontier' was created with the URL table of the crawl, 'text' points to the 'len' bytes of the
+                    URL as the user gave it; 'cluster' is the cluster of the crawl, or NULL. Safe to call from any
+                    number of threads.
+    Postcondition:  The URL is normalized, with http:// assumed if it has no scheme, queued at depth 0 and logged to
+                    the journal (if any), or sent to the shard owning its host. Returns SEED_QUEUED, SEED_SKIPPED if
+                    it was queued or fetched before, or SEED_INVALID if it is not a valid URL.
 */
-void markVisited(const char *url) {
-    if (visited_count < MAX_VISITED_URLS) {  // Check if there is space in the 'visited_urls' array
-        visited_urls[visited_count++] = strdup(url);  // Copy the provided URL into the 'visited_urls' array and increment 'visited_count'
-    }
+static int queueSeed(Frontier *frontier, Journal *journal, Cluster *cluster, const char *text, size_t len)
+{
+    char given[FRONTIER_MAX_URL];                       // URL with its scheme
+    char seed[FRONTIER_MAX_URL];                        // Normalized URL
+    const char *scheme = memmem(text, len, "://", 3) != NULL ? "" : "http://";
+    size_t schemeLen = strlen(scheme);
+    if (len >= sizeof(given) - schemeLen)
+        return SEED_INVALID;                            // Too long
+    memcpy(given, scheme, schemeLen);
+    memcpy(given + schemeLen, text, len);
+    if (urlNormalize(NULL, given, schemeLen + len, seed, sizeof(seed)) < 0)
+        return SEED_INVALID;                            // Not http or https, or too long
+
+    if (isVisited(seed))
+        return SEED_SKIPPED;                            // Fetched by the crawl being resumed
+    if (cluster != NULL && clusterOwner(cluster, seed) != clusterIndex(cluster))
+        return clusterForward(cluster, seed, 0) < 0 ? SEED_INVALID : SEED_QUEUED;   // Another shard crawls it
+
+    int pushed = frontierPush(frontier, seed, 0);       // Enqueue the seed at depth 0
+    if (pushed < 0)
+        return SEED_INVALID;
+    if (pushed != 0)
+        return SEED_SKIPPED;
+    journalQueued(journal, seed, 0);                    // Log it, a crash from here on can be resumed
+    return SEED_QUEUED;
 }
 
-// Create a mutex for the URL queue
-pthread_mutex_t queue_mutex = PTHREAD_MUTEX_INITIALIZER; // Initialize mutex for queue synchronization
+// Where the URLs of the seed files go
+typedef struct
+{
+    Frontier *frontier;
+    Journal *journal;
+    Cluster *cluster;
+} SeedTarget;
 
-// Global CURL handle
-CURL *curl_handle; // Global variable to hold the CURL handle
+// Queue a URL of a seed file; the onUrl callback of the seed loader
+static int queueSeedLine(const char *url, size_t len, void *arg)
+{
+    SeedTarget *target = (SeedTarget *)arg;
+    int result = queueSeed(target->frontier, target->journal, target->cluster, url, len);
+    if (result == SEED_INVALID)
+        fprintf(stderr, "Invalid seed URL: %.*s\n", (int)len, url);
+    return result;
+}
 
-// Main function
-int main()
+// Let the crawl end once the last seed is queued; the onDone callback of the seed loader
+static void seedsQueued(void *arg)
 {
-    // Initialize CURL
-    curl_global_init(CURL_GLOBAL_ALL); // Initialize CURL library
-    curl_handle = curl_easy_init();    // Initialize CURL handle
+    frontierDone(((SeedTarget *)arg)->frontier, 1);     // Parked workers see the end within PARK_MS
+}
 
-    //Initial entry in to the log file,
-    logEvent("Program initialization", "", NULL, -2);
+/*
+    Start queueing the seed URLs of the files given with -S.
+
+    Preconditions:  'target' stays valid until seedLoadWait(); the frontier has not been handed to a crawl yet.
+    Postcondition:  The files are read by a seed loader in the background (see seeds.h), one URL per line, blank
+                    lines and lines starting with '#' skipped, each URL queued with queueSeed(). The frontier counts
+                    one URL outstanding until the last line is done with, so a crawl started meanwhile waits for the
+                    rest. Returns once the first URL is queued (or all are done with); the loader, or NULL if a file
+                    cannot be read or out of memory, with nothing queued.
+*/
+static SeedLoader *queueSeedFiles(SeedTarget *target, const CrawlOptions *options)
+{
+    SeedConfig config;
+    seedConfigDefaults(&config);
+    config.onUrl = queueSeedLine;
+    config.onDone = seedsQueued;
+    config.arg = target;
+    frontierHold(target->frontier);                     // Released by seedsQueued()
+    SeedLoader *loader = seedLoadStart(options->seedFiles, options->seedFileCount, &config);
+    if (loader == NULL)
+    {
+        frontierDone(target->frontier, 1);
+        return NULL;
+    }
+    seedLoadFirst(loader);                              // The rest are queued while the crawl runs
+    return loader;
+}
 
-    // Setup URL queue
-    Queue *q = malloc(sizeof(Queue));                   // Allocate memory for the URL queue
-    if (q == NULL)                                      // If memory allocation fails
+/*
+    Run one crawl of the URLs in the frontier.
+
+    Preconditions:  'frontier' holds the seeds, 'pages' is the page store (NULL for none), 'options' the settings of
+                    the run and 'fetch' those of the workers' fetch engines, 'cluster' is the cluster of the crawl (NULL for none), not started yet, 'links' is
+                    where the links found are printed (NULL for nowhere) and 'archive' where the pages and links are
+                    archived (NULL for nowhere); 'visited_urls' has been created.
+    Postcondition:  Returns 0 once the crawl is complete, with the pages fetched and failed stored in 'fetched' and
+                    'failed'; or -1 if it could not be run.
+*/
+static int runCrawl(Frontier *frontier, Journal *journal, PageStore *pages, const CrawlOptions *options,
+                    const FetchConfig *fetch, Cluster *cluster, FILE *links, Archive *archive, long *fetched,
+                    long *failed)
+{
+    // Setup the per-host queues, a host never has more than options->perHost transfers running
+    SchedulerConfig schedulerConfig;
+    schedulerConfigDefaults(&schedulerConfig);
+    schedulerConfig.maxDepth = frontierMaxDepth(frontier);
+    schedulerConfig.maxPerHost = options->perHost;
+    schedulerConfig.delayMs = options->delayMs;
+    schedulerConfig.adaptive = options->adaptive;
+    schedulerConfig.slowMs = options->slowMs;
+    schedulerConfig.maxActive = options->maxActive;
+    HostScheduler *scheduler = schedulerCreate(&schedulerConfig);
+    if (scheduler == NULL)                              // If memory allocation fails
     {
         fprintf(stderr, "Memory allocation failed!\n"); // Print error message
+        return -1;
+    }
+
+    // Setup threads
+    ThreadData thread_data = { .frontier = frontier, .scheduler = scheduler, .journal = journal, .pages = pages,
+                               .fetch = fetch, .links = links, .archive = archive, .cluster = cluster,
+                               .maxWorkers = options->maxWorkers > 0 ? options->maxWorkers
+                                                                     : (int)sysconf(_SC_NPROCESSORS_ONLN) };   // Create thread data structure
+    atomic_init(&thread_data.pagesFetched, 0);
+    atomic_init(&thread_data.pagesFailed, 0);
+
+    // Setup the robots.txt cache, a host's robots.txt is fetched once whichever worker finds it first
+    if (options->robots)
+    {
+        RobotsConfig robotsConfig;
+        robotsConfigDefaults(&robotsConfig);
+        robotsConfig.agent = options->robotsAgent;
+        robotsConfig.minDelayMs = options->delayMs;
+        robotsConfig.fetch = fetch;
+        robotsConfig.onRelease = crawlRobotsRelease;
+        robotsConfig.onDelay = crawlRobotsDelay;
+        robotsConfig.arg = &thread_data;
+        thread_data.robots = robotsCreate(&robotsConfig);
+        if (thread_data.robots == NULL)
+        {
+            fprintf(stderr, "Memory allocation failed!\n");
+            schedulerDestroy(scheduler);
+            return -1;
+        }
+    }
+
+    int result = crawl(&thread_data, options->workers); // Run the worker threads until the crawl is done
+
+    *fetched = atomic_load(&thread_data.pagesFetched);
+    *failed = atomic_load(&thread_data.pagesFailed);
+    SchedulerStats stats;
+    schedulerStats(scheduler, &stats);
+    if (stats.trips > 0)                                // Hosts that kept failing
+        fprintf(stderr, "Circuit breakers opened %ld times, %ld hosts given up with %ld URLs.\n", stats.trips,
+                stats.hostsGivenUp, stats.urlsGivenUp);
+    if (thread_data.robots != NULL)
+    {
+        RobotsStats robots;
+        robotsStats(thread_data.robots, &robots);
+        if (robots.fetches > 0)
+            fprintf(stderr, "robots.txt: %ld fetched (%ld missing, %ld unreachable), %ld URLs disallowed.\n",
+                    robots.fetches, robots.missing, robots.unreachable, robots.disallowed);
+        robotsDestroy(thread_data.robots);              // Before the scheduler its Crawl-delays go to
+    }
+    schedulerDestroy(scheduler);                        // Free the per-host queues
+    return result;
+}
+
+/*
+    Interactive mode: ask for a depth and a seed URL and crawl from it, until the user enters -1.
+
+    Preconditions:  The crawl's URL table, journal, page store and archive (NULL for none) and settings are set up.
+    Postcondition:  Returns the exit status of the crawler.
+*/
+static int runInteractive(UrlTable *urls, Journal *journal, PageStore *pages, const CrawlOptions *options,
+                          const FetchConfig *fetch, FILE *links, Archive *archive)
+{
+    int resume = 0;                                     // 1 to continue the crawl an earlier run left unfinished
+    if (journalHasState(journal))
+    {
+        char answer = 'n';
+        printf("An interrupted crawl was found. Resume it? (y/n)\n");
+        if (scanf(" %c", &answer) == 1 && (answer == 'y' || answer == 'Y'))
+            resume = 1;
+        else
+            journalReset(journal);                      // Start over
     }
-    initializeQueue(q);                                 // Initialize the URL queue
 
     int MAX_DEPTH = 0;                                  // Variable to store maximum depth
 
@@ -212,146 +468,383 @@ int main()
             break; //exit the loop.
         }
 
-        // Set the initial URL to parse
-        char initialURL[MAX_URL_LENGTH];                     // Variable to store the user-inputted URL
-        printf("Enter the initial URL to parse: ");          // Prompt the user to enter the initial URL
-        scanf("%s", initialURL);                             // Read the user input for the initial URL
-
-        pthread_mutex_lock(&queue_mutex);                    // Acquire mutex lock
-        enqueue(q, initialURL);                              // Enqueue the initial URL provided by the user
-        pthread_mutex_unlock(&queue_mutex);                  // Release mutex lock
-
-        // Setup threads
-        pthread_t threads[NUMWORKERS];                          // Array to hold worker thread IDs
-        ThreadData thread_data = {q, &queue_mutex, MAX_DEPTH }; // Create thread data structure with queue, mutex, and max depth
+        // Setup URL frontier, pages at depth MAX_DEPTH and beyond are never queued
+        Frontier *frontier = frontierCreate(MAX_DEPTH - 1, urls);  // Create the lock-free URL frontier
+        if (frontier == NULL)                                // If memory allocation fails
+        {
+            fprintf(stderr, "Memory allocation failed!\n");  // Print error message
+            return EXIT_NOT_RUN;                             // Return with error code
+        }
 
-        // Create worker threads
-        for (int i = 0; i < NUMWORKERS; i++)                // Iterate over number of worker threads
+        long done = 0, pending = 0;                          // State restored from the journal
+        if (resume && journalLoad(journal, visited_urls, frontier, &done, &pending) == 0 && pending > 0)
         {
-            if (pthread_create(&threads[i], NULL, worker, &thread_data) != 0) // Create a worker thread
+            printf("Resuming the interrupted crawl: %ld pages done, %ld URLs to go.\n", done, pending);
+        }
+        else
+        {
+            // Set the initial URL to parse
+            char initialURL[MAX_URL_LENGTH];                     // Variable to store the user-inputted URL
+            printf("Enter the initial URL to parse: ");          // Prompt the user to enter the initial URL
+            if (scanf("%255s", initialURL) != 1 ||               // Read the user input, at most MAX_URL_LENGTH - 1 characters
+                queueSeed(frontier, journal, NULL, initialURL, strlen(initialURL)) == SEED_INVALID)   // Enqueue the initial URL provided by the user at depth 0
             {
-                perror("Error creating thread");            // Print error message if thread creation fails
-                return 0;                                   // Return from main with error code
+                printf("Invalid URL.\n");                        // Not http or https, or too long
+                frontierDestroy(frontier);
+                continue;                                        // Ask again
             }
         }
+        resume = 0;                                              // Only the first crawl picks up the old state
 
-        // Wait for worker threads to finish
-        for (int i = 0; i < NUMWORKERS; i++)                // Iterate over worker threads
+        long fetched, failed;                                    // Outcome of the crawl
+        if (runCrawl(frontier, journal, pages, options, fetch, NULL, links, archive, &fetched, &failed) != 0)
         {
-            pthread_join(threads[i], NULL);                 // Wait for a worker thread to finish
+            frontierDestroy(frontier);
+            return EXIT_NOT_RUN;                                 // Return with error code
         }
+        frontierDestroy(frontier);                               // Free the URL frontier
     }
-
-    // Cleanup CURL instance
-    curl_easy_cleanup(curl_handle);                     // Cleanup CURL handle
-    curl_global_cleanup();                              // Cleanup CURL library
-
-    //add log for end of program
-    logEvent("Program Terminated", "", NULL, -1);
-
-    return 0; // Return from main with success code
+    return EXIT_CRAWLED;
 }
 
 /*
-    Curl callback function for writing HTML content.
-
-    Description:
-    This function is called by libcurl when HTML content is received during a HTTP request. It reallocates memory
-    for the HTML content, copies the received data, and updates the size of the content.
-
-    Preconditions:
-    'contents' must point to the received data.
-    'size' and 'nmemb' specify the size of each data element and the number of elements.
-    'userp' must point to a valid struct CURLResponse containing the HTML content and its size.
+    Batch mode: crawl from the seeds of the command line and config files, unattended.
 
-    Postcondition:
-    The HTML content is reallocated with additional memory if needed, the received data is copied to the content buffer,
-    and the size of the content is updated accordingly. The function returns the size of the received data.
+    Preconditions:  The crawl's URL table, journal, page store and archive (NULL for none) and settings are set up.
+    Postcondition:  The crawl is complete and a summary printed to stderr. Returns the exit status of the crawler.
 */
-static size_t WriteHTMLCallback(void *contents, size_t size, size_t nmemb, void *userp)
+static int runBatch(UrlTable *urls, Journal *journal, PageStore *pages, const CrawlOptions *options,
+                    const FetchConfig *fetch, FILE *links, Archive *archive)
 {
-    size_t realsize = size * nmemb;                                        // Calculate the real size of the data
-    struct CURLResponse *mem = (struct CURLResponse *)userp;               // Cast user pointer to CURL response structure
-    char *ptr = realloc(mem->html, mem->size + realsize + 1);              // Reallocate memory for HTML content
-
-    if (!ptr)                                                              // If reallocation fails
+    // Setup URL frontier, pages at depth options->depth and beyond are never queued
+    Frontier *frontier = frontierCreate(options->depth - 1, urls);
+    if (frontier == NULL)
     {
-        printf("Not enough memory available (realloc returned NULL)\n");   // Print error message
-        return 0;                                                          // Return 0 indicating failure
+        fprintf(stderr, "Memory allocation failed!\n");
+        return EXIT_NOT_RUN;
     }
 
-    mem->html = ptr;                                                       // Update HTML pointer to the reallocated memory
-    memcpy(&(mem->html[mem->size]), contents, realsize);                   // Copy contents to HTML memory
-    mem->size += realsize;                                                 // Update the size of HTML content
-    mem->html[mem->size] = 0;                                              // Null-terminate the HTML content
+    long done = 0, pending = 0;                         // State restored from the journal
+    if (journalHasState(journal))
+    {
+        if (!options->resume)
+        {
+            fprintf(stderr, "Discarding the interrupted crawl in %s (--resume continues it).\n", options->stateDir);
+            journalReset(journal);
+        }
+        else if (journalLoad(journal, visited_urls, frontier, &done, &pending) == 0)
+        {
+            fprintf(stderr, "Resuming the interrupted crawl: %ld pages done, %ld URLs to go.\n", done, pending);
+        }
+        else
+        {
+            fprintf(stderr, "Cannot load the crawl state in %s.\n", options->stateDir);
+            frontierDestroy(frontier);
+            return EXIT_NOT_RUN;
+        }
+    }
 
-    return realsize;                                                       // Return the real size of the data
-}
+    // Join the other shards, if the crawl is split over several processes
+    Cluster *cluster = NULL;
+    if (options->peers != NULL)
+    {
+        ClusterConfig clusterConfig;
+        clusterConfigDefaults(&clusterConfig);
+        clusterConfig.index = options->shard;
+        clusterConfig.peers = options->peers;
+        clusterConfig.onUrl = crawlReceive;
+        clusterConfig.isIdle = crawlIdle;
+        cluster = clusterCreate(&clusterConfig);
+        if (cluster == NULL)
+        {
+            fprintf(stderr, "Cannot join the cluster of the shards given with --peers.\n");
+            frontierDestroy(frontier);
+            return EXIT_NOT_RUN;
+        }
+    }
 
-/*
-    Perform a GET request to retrieve an HTML document from a specified URL.
+    // Queue the seeds; with a cluster, those of other shards' hosts are sent to them
+    long invalid = 0;
+    for (int i = 0; i < options->seedCount; i++)
+    {
+        if (queueSeed(frontier, journal, cluster, options->seeds[i], strlen(options->seeds[i])) == SEED_INVALID)
+        {
+            fprintf(stderr, "Invalid seed URL: %s\n", options->seeds[i]);
+            invalid++;
+        }
+    }
+    SeedTarget seedTarget = { frontier, journal, cluster };
+    SeedLoader *seedLoader = NULL;                      // Seed files still being read while the crawl starts
+    if (options->seedFileCount > 0 && (seedLoader = queueSeedFiles(&seedTarget, options)) == NULL)
+    {
+        clusterDestroy(cluster);
+        frontierDestroy(frontier);
+        return EXIT_NOT_RUN;
+    }
+    if (frontierSize(frontier) == 0 && cluster == NULL) // A shard may get all of its seeds from the others
+    {
+        fprintf(stderr, "Nothing to crawl: no valid seed URL%s.\n", options->depth < 1 ? " within the depth" : "");
+        if (seedLoader != NULL)
+            seedLoadWait(seedLoader, NULL);             // Over already, seedLoadFirst() found no URL
+        frontierDestroy(frontier);
+        return EXIT_NOT_RUN;
+    }
 
-    Description:
-    This function sends a GET request to the provided URL using libcurl and retrieves the HTML content of the webpage.
-    The retrieved HTML content is stored in a struct CURLResponse.
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    long fetched, failed;                               // Outcome of the crawl
+    int result = runCrawl(frontier, journal, pages, options, fetch, cluster, links, archive, &fetched, &failed);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    if (seedLoader != NULL)
+    {
+        SeedStats seeds;
+        if (seedLoadWait(seedLoader, &seeds) != 0)      // Before the frontier goes, it may still be queueing
+            fprintf(stderr, "Some seed files could not be read to the end; their first lines were crawled.\n");
+        invalid += seeds.invalid;
+        fprintf(stderr, "Seeds: %ld lines read (%.1f MB%s), %ld URLs queued, %ld skipped as queued or fetched already.\n",
+                seeds.lines, seeds.bytes / 1e6, seeds.compressed > 0 ? " decompressed" : "", seeds.queued,
+                seeds.skipped);
+    }
+    frontierDestroy(frontier);
+    if (result != 0)
+    {
+        clusterDestroy(cluster);
+        return EXIT_NOT_RUN;
+    }
 
-    Preconditions:
-    'curl_handle' must point to a valid CURL handle initialized by curl_easy_init().
-    'url' must point to a valid null-terminated string containing the URL to retrieve.
-    Memory allocation for 'response.html' must be handled before calling this function.
+    double seconds = (double)(end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    fprintf(stderr, "Crawled %ld pages (%ld failed, %ld invalid seeds) in %.2f s, %.1f pages/sec.\n", fetched, failed,
+            invalid, seconds, seconds > 0 ? fetched / seconds : 0.0);
+    if (fetch->resolver != NULL)
+    {
+        ResolverStats dns;
+        resolverStats(fetch->resolver, &dns);
+        fprintf(stderr, "DNS: %ld hosts looked up, %ld of %ld lookups answered from the cache, %.1f s of waiting saved.\n",
+                dns.queries, dns.hits + dns.negativeHits, dns.lookups, dns.savedMicros / 1e6);
+    }
+    if (pages != NULL)
+    {
+        PageStoreStats recrawl;
+        pageStoreStats(pages, &recrawl);
+        fprintf(stderr, "Re-crawl: %ld of %ld pages asked for if changed, %ld not modified (%.1f MB not downloaded, "
+                        "%ld parses skipped), %.1f MB downloaded, %ld near-duplicates not expanded.\n",
+                recrawl.conditional, fetched, recrawl.notModified, recrawl.savedBytes / 1e6, recrawl.notModified,
+                recrawl.downloadedBytes / 1e6, recrawl.nearDuplicates);
+    }
+    if (metricsEnabled() && metricsSamples(METRIC_FETCH) > 0)
+    {
+        fprintf(stderr, "Latency p50/p99: transfer %.1f/%.1f ms, first byte %.1f/%.1f ms, parse %.0f/%.0f us, "
+                        "extract %.0f/%.0f us.\n", metricsQuantile(METRIC_FETCH, 0.5) / 1e6,
+                metricsQuantile(METRIC_FETCH, 0.99) / 1e6, metricsQuantile(METRIC_TTFB, 0.5) / 1e6,
+                metricsQuantile(METRIC_TTFB, 0.99) / 1e6, metricsQuantile(METRIC_PARSE, 0.5) / 1e3,
+                metricsQuantile(METRIC_PARSE, 0.99) / 1e3, metricsQuantile(METRIC_EXTRACT, 0.5) / 1e3,
+                metricsQuantile(METRIC_EXTRACT, 0.99) / 1e3);
+    }
+    if (cluster != NULL)
+    {
+        ClusterStats shards;
+        clusterStats(cluster, &shards);
+        fprintf(stderr, "Shard %d of %d: %ld URLs sent to other shards in %ld batches (%ld more sent before), "
+                        "%ld received.\n", clusterIndex(cluster), clusterSize(cluster), shards.forwarded,
+                shards.batches, shards.duplicates, shards.received);
+        int lost = clusterFailed(cluster);
+        clusterDestroy(cluster);                        // Shard 0 tells the others the crawl is over
+        if (lost)
+            return EXIT_NOT_RUN;
+    }
+    return fetched > 0 ? EXIT_CRAWLED : EXIT_NO_PAGES;
+}
 
-    Postcondition:
-    The function returns a struct CURLResponse containing the HTML content retrieved from the URL.
-    If the request fails, an error message is printed.
-*/
-struct CURLResponse GetRequest(CURL *curl_handle, const char *url)
+// Main function
+int main(int argc, char *argv[])
 {
-    CURLcode res;                   // Variable to store curl result
+    // Read the settings of the run; without arguments the crawler asks for them
+    CrawlOptions options;
+    optionsDefaults(&options);
+    int parsed = optionsParse(&options, argc, argv);
+    if (parsed != 0)
+    {
+        optionsFree(&options);
+        return parsed > 0 ? 0 : EXIT_USAGE;             // --help, or an invalid option
+    }
 
-    // Setup response
-    struct CURLResponse response;   // Create response structure
-    response.html = malloc(1);      // Allocate memory for HTML content
-    response.size = 0;              // Initialize size to 0
+    // The shards of a cluster on one machine keep their log, state and archive apart: crawler.log.0, crawler.state.0, ...
+    char shardLog[MAX_PATH_LENGTH], shardState[MAX_PATH_LENGTH], shardArchive[MAX_PATH_LENGTH];
+    if (options.peers != NULL)
+    {
+        snprintf(shardLog, sizeof(shardLog), "%s.%d", options.logPath, options.shard);
+        options.logPath = shardLog;
+        if (options.stateDir != NULL)
+        {
+            snprintf(shardState, sizeof(shardState), "%s.%d", options.stateDir, options.shard);
+            options.stateDir = shardState;
+        }
+        if (options.archiveDir != NULL)
+        {
+            snprintf(shardArchive, sizeof(shardArchive), "%s.%d", options.archiveDir, options.shard);
+            options.archiveDir = shardArchive;
+        }
+    }
 
-    int retry = 3;  // Number of retries
+    // Initialize CURL
+    curl_global_init(CURL_GLOBAL_ALL); // Initialize CURL library
 
-    // Set timeout options
-    curl_easy_setopt(curl_handle, CURLOPT_TIMEOUT, 30L);        // Maximum time allowed for the entire request (in seconds)
-    curl_easy_setopt(curl_handle, CURLOPT_CONNECTTIMEOUT, 10L); // Maximum time allowed for connection establishment (in seconds)
+    // Setup visited set
+    visited_urls = visitedCreate(EXPECTED_VISITED_URLS);
 
-    do {
-    // Initialize URL to GET
-    curl_easy_setopt(curl_handle, CURLOPT_URL, url);
+    // Setup the table the frontier interns the URLs in, shared by every crawl like the visited set
+    UrlTable *urls = urlTableCreate(EXPECTED_VISITED_URLS);
 
-    // Send data to callback
-    curl_easy_setopt(curl_handle, CURLOPT_WRITEFUNCTION, WriteHTMLCallback);
-    curl_easy_setopt(curl_handle, CURLOPT_WRITEDATA, (void *)&response);
+    // Start a new log file, written by the logger's background thread
+    LogConfig logConfig;
+    logConfigDefaults(&logConfig);
+    logConfig.path = options.logPath;
+    logConfig.level = options.logLevel;
+    logConfig.format = options.logFormat;
+    logConfig.truncate = 1;
+    if (logOpen(&logConfig) == 0)
+        atexit(logClose);                               // Queued events reach the file on every exit path
 
-    // Set headers (mimic user)
-    curl_easy_setopt(curl_handle, CURLOPT_USERAGENT, "Mozilla/5.0 (Windows NT 10.0; Win64; x64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/117.0.0.0 Safari/537.36");
+    //Initial entry in to the log file,
+    logEvent(LOG_INFO, "Program initialization", "", NULL, -1);
 
-    // Perform request
-    res = curl_easy_perform(curl_handle);   // Perform the curl request
+    // Metrics of the crawl, recorded only for the endpoint or trace asked for
+    if (options.metricsPort >= 0 || options.tracePath != NULL)
+    {
+        MetricsConfig metricsConfig;
+        metricsConfigDefaults(&metricsConfig);
+        metricsConfig.port = options.metricsPort;
+        metricsConfig.tracePath = options.tracePath;
+        if (metricsOpen(&metricsConfig) != 0)
+            fprintf(stderr, "Cannot serve the metrics on port %d, the crawl runs without them.\n", options.metricsPort);
+        else if (metricsPort() >= 0)
+            fprintf(stderr, "Metrics at http://127.0.0.1:%d/metrics\n", metricsPort());
+    }
 
-    if (res != CURLE_OK) {
-            fprintf(stderr, "GET request failed: %s\n", curl_easy_strerror(res));   // Print error message
-            retry--;
-            if (retry > 0) {
-                fprintf(stderr, "Retrying GET request for URL: %s\n", url);
-                usleep(1000000); // Sleep for 1 second before retrying
-            }
+    if (visited_urls == NULL || urls == NULL)           // If memory allocation fails
+    {
+        fprintf(stderr, "Memory allocation failed!\n"); // Print error message
+        return EXIT_NOT_RUN;                            // Return from main with error code
+    }
+
+    // Where the links found are printed
+    FILE *links = NULL;
+    if (options.linksPath != NULL)
+    {
+        links = strcmp(options.linksPath, "-") == 0 ? stdout : fopen(options.linksPath, "w");
+        if (links == NULL)
+        {
+            perror(options.linksPath);
+            return EXIT_NOT_RUN;
         }
-    } while (res != CURLE_OK && retry > 0);
+    }
+
+    // Pages fetched and links found, written to compressed files in the background
+    Archive *archive = NULL;
+    if (options.archiveDir != NULL)
+    {
+        ArchiveConfig archiveConfig;
+        archiveConfigDefaults(&archiveConfig);
+        archiveConfig.dir = options.archiveDir;
+        archive = archiveOpen(&archiveConfig);
+        if (archive == NULL)
+        {
+            fprintf(stderr, "Cannot write the archive to %s.\n", options.archiveDir);
+            return EXIT_NOT_RUN;
+        }
+    }
+
+    // Name lookups: one DNS cache for every worker, and curl's DNS cache and TLS sessions shared too
+    Resolver *resolver = NULL;
+    if (options.dnsCache)
+    {
+        ResolverConfig resolverConfig;
+        resolverConfigDefaults(&resolverConfig);
+        resolverConfig.servers = options.dnsServers;
+        resolver = resolverCreate(&resolverConfig);     // NULL: curl resolves on its own
+        if (resolver == NULL)
+            fprintf(stderr, "Cannot set up the DNS cache%s, curl resolves host names itself.\n",
+                    options.dnsServers != NULL ? " with the DNS servers given" : "");
+    }
+    FetchShare *share = fetchShareCreate();             // NULL: nothing shared
+
+    // Settings of the fetch engine of every worker
+    FetchConfig fetchConfig;
+    fetchConfigDefaults(&fetchConfig);
+    fetchConfig.maxInFlight = options.connections;
+    fetchConfig.maxHostConnections = options.perHost;
+    fetchConfig.timeout = options.timeout;
+    fetchConfig.connectTimeout = options.connectTimeout;
+    fetchConfig.retries = options.retries;
+    fetchConfig.retryBaseMs = options.retryWaitMs;
+    fetchConfig.resolver = resolver;
+    fetchConfig.share = share;
+
+    // Keep the crawl state on disk so an interrupted crawl can be resumed
+    Journal *journal = NULL;
+    if (options.stateDir != NULL)
+    {
+        JournalConfig journalConfig;
+        journalConfigDefaults(&journalConfig);
+        journalConfig.dir = options.stateDir;
+        journalConfig.sync = options.sync;
+        journal = journalOpen(&journalConfig);          // NULL: crawl without it
+        if (journal == NULL)
+            fprintf(stderr, "Cannot keep the crawl state in %s, an interrupted crawl cannot be resumed.\n", journalConfig.dir);
+    }
 
-    if (res != CURLE_OK) {
-        // Clean up and return empty response
-        free(response.html);
-        response.html = NULL;
-        response.size = 0;
+    // What earlier crawls learned of the pages: re-crawls ask for a page only if it changed
+    PageStore *pages = NULL;
+    char pagesPath[MAX_PATH_LENGTH];
+    if (journal != NULL)
+    {
+        snprintf(pagesPath, sizeof(pagesPath), "%s/%s", options.stateDir, PAGES_FILE);
+        pages = pageStoreCreate();                      // NULL: every page is fetched in full
+        if (pages != NULL && pageStoreLoad(pages, pagesPath) != 0)
+            fprintf(stderr, "Cannot read all of %s, pages it lost are fetched in full.\n", pagesPath);
     }
 
-    return response;   // Return the response structure
+    int status = options.interactive ? runInteractive(urls, journal, pages, &options, &fetchConfig, links, archive)
+                                     : runBatch(urls, journal, pages, &options, &fetchConfig, links, archive);
+
+    ArchiveStats archived;
+    if (archiveClose(archive, &archived) != 0)
+        fprintf(stderr, "Cannot write all of the archive in %s.\n", options.archiveDir);
+    else if (archive != NULL)
+        fprintf(stderr, "Archive: %ld pages in %ld segments (%.1f MB, %.1f MB compressed), %ld links between %ld URLs, "
+                "%ld pages and %ld links dropped.\n", archived.pages, archived.segments, archived.rawBytes / 1e6,
+                archived.compressedBytes / 1e6, archived.links, archived.urls, archived.droppedPages,
+                archived.droppedLinks);
+
+    if (pages != NULL && pageStoreSave(pages, pagesPath) != 0)
+        fprintf(stderr, "Cannot save %s, the pages of this crawl are fetched in full next time.\n", pagesPath);
+    pageStoreDestroy(pages);
+
+    // Every crawl is complete, there is nothing to resume
+    if (status == EXIT_CRAWLED || status == EXIT_NO_PAGES)
+        journalReset(journal);
+    journalClose(journal);
+
+    if (links != NULL && links != stdout)
+        fclose(links);
+    fetchShareDestroy(share);                           // Every engine is gone
+    resolverDestroy(resolver);
+    urlTableDestroy(urls);                              // Free the interned URLs
+    visitedDestroy(visited_urls);                       // Free the visited set
+
+    metricsClose();                                     // Writes the trace
+
+    // Cleanup CURL instance
+    curl_global_cleanup();                              // Cleanup CURL library
+
+    //add log for end of program
+    logEvent(LOG_INFO, "Program Terminated", "", NULL, -1);
+    logClose();
+
+    optionsFree(&options);
+    return status; // Return from main with the exit status of the crawl
 }
+#endif
 
 /*
     Extract URLs from the anchor tags within the HTML document.
@@ -359,18 +852,20 @@ struct CURLResponse GetRequest(CURL *curl_handle, const char *url)
     Description:
     This function traverses the XML document tree starting from the specified node (doc->children).
     For each node encountered, it checks if it represents an anchor tag (<a>) and extracts the URL from its href attribute.
-    If the URL starts with "http://" or "https://", it is considered a valid link and enqueued into the provided queue.
+    If the URL starts with "http://" or "https://", it is considered a valid link and pushed onto the provided frontier
+    at link depth 'depth'; the frontier drops it right away if that is beyond the depth limit.
     The function recursively explores child nodes to ensure all anchor tags within the document are processed.
+    The workers stream pages through linkFound() instead; this DOM path is kept as the reference it is measured against.
 
     Preconditions:
     'doc' must point to a valid htmlDocPtr representing the HTML document.
-    'q' must point to a valid Queue structure initialized with URLs to enqueue extracted URLs.
-    'mutex' must point to a valid pthread_mutex_t used for queue synchronization.
+    'frontier' must point to a valid Frontier created by frontierCreate(); it needs no external locking.
+    'depth' is the link depth of the extracted URLs, one more than the depth of the document.
 
     Postcondition:
-    The URLs extracted from the anchor tags within the HTML document are enqueued into the provided queue.
+    The URLs extracted from the anchor tags within the HTML document are pushed onto the provided frontier.
 */
-void extractUrls(htmlDocPtr doc, Queue* q, pthread_mutex_t *mutex)
+void extractUrls(htmlDocPtr doc, Frontier *frontier, int depth)
 {
     // Set anchor
     xmlNode *aNode = doc->children;   // Get the first child node of the HTML document
@@ -392,9 +887,7 @@ void extractUrls(htmlDocPtr doc, Queue* q, pthread_mutex_t *mutex)
                     if (href[0] != '#')   // If href doesn't start with '#'
                     {
                         printf("%s\n\n", href);   // Print the URL
-                        pthread_mutex_lock(mutex);   // Acquire mutex lock
-                        enqueue(q, href);   // Enqueue the URL
-                        pthread_mutex_unlock(mutex);   // Release mutex lock
+                        frontierPush(frontier, (const char *)href, depth);   // Enqueue the URL with its depth
                     }
                 }
                 xmlFree(href);   // Free the href memory
@@ -402,7 +895,7 @@ void extractUrls(htmlDocPtr doc, Queue* q, pthread_mutex_t *mutex)
         }
 
         // Search child's children nodes recursively
-        extractUrls(aNode, q, mutex);   // Recursively call extractUrls on child nodes
+        extractUrls((htmlDocPtr)aNode, frontier, depth);   // Recursively call extractUrls on child nodes
     }
 }
 
@@ -410,164 +903,575 @@ void extractUrls(htmlDocPtr doc, Queue* q, pthread_mutex_t *mutex)
     Worker function responsible for processing URLs.
 
     Description:
-    This function processes URLs by dequeuing them from the provided queue and fetching their HTML content.
-    It continues to process URLs until either the queue becomes empty or the maximum depth is reached.
-    For each URL, it retrieves the HTML content, parses it to extract URLs, and enqueues the extracted URLs for further processing.
-    The function operates within a loop, continuously dequeuing URLs and processing them until the termination condition is met.
+    Each worker runs its own fetch engine, an event loop that keeps up to maxInFlight transfers in flight
+    at once. The worker tops the engine up with URLs of the hosts the politeness scheduler lets start a
+    transfer now, and moves newly found URLs from the frontier to the scheduler whenever no host is ready:
+    first those of its own frontier lane, where the links of its pages go, then those it steals from the
+    lanes of other workers. Page bodies are never buffered: every chunk goes through pageChunk() into the
+    page's link scanner, which enqueues links as they arrive, and pageFetched() wraps the page up once it is complete.
+    Each URL carries its own link depth; the frontier prunes URLs beyond the depth limit when they are pushed.
+
+    A worker with nothing in flight and nothing to start parks in the pool until new URLs are queued, a host
+    is released or its crawl delay runs out. The crawl is over once the frontier counts no URL outstanding,
+    queued or in flight on any worker; in a cluster, once the cluster also finds every shard idle. A worker
+    whose engine is full while URLs are waiting asks the pool for another worker, and a worker idle for long
+    leaves the pool if it runs more than the workers it started with.
 
     Preconditions:
-    'arg' must point to a valid ThreadData structure containing the queue pointer, mutex pointer, and maximum depth.
-    'queue' must point to a valid Queue structure initialized with URLs to be processed.
-    'mutex' must point to a valid pthread_mutex_t used for queue synchronization.
-    'MAX_DEPTH' must be an integer representing the maximum depth of URL processing.
+    'arg' must point to a valid ThreadData structure containing the frontier and scheduler pointers, and the pool
+    running the worker.
+    'frontier' must point to a valid Frontier holding the URLs to be processed, created with the maximum depth,
+    'scheduler' to a HostScheduler created with the same maximum depth.
 
     Postcondition:
-    The function processes URLs from the queue, fetching their HTML content and enqueuing extracted URLs for further processing.
-    It terminates when either the queue becomes empty or the maximum depth is reached.
+    The function processes URLs from the frontier, fetching their HTML content and enqueuing extracted URLs for further processing.
+    It terminates when no URL is outstanding and every transfer of this worker has finished, with a cluster once the
+    cluster is finished, or when the pool lets it retire.
 */
 void *worker(void *arg)
 {
 
     // Setup data
     ThreadData *data = (ThreadData *) arg;      // Cast argument to thread data structure
-    Queue *queue = data->queue;                 // Get the queue pointer
-    pthread_mutex_t *mutex = data->mutex;       // Get the mutex pointer
-    int MAX_DEPTH = data->maxdepth;             // Get the maximum depth
-
-    int curdepth = 0;                           // Initialize current depth
+    Frontier *frontier = data->frontier;        // Get the frontier pointer
+    HostScheduler *scheduler = data->scheduler; // Get the scheduler pointer
+    WorkPool *pool = data->pool;                // Pool the worker parks in while it has nothing to do
+    WorkerContext context = { .data = data };   // Per-worker state, recycles page states and their memory
+    arenaPoolInit(&context.arenas);
+
+    // Setup the fetch engine of this worker
+    FetchConfig config;                         // Engine settings
+    if (data->fetch != NULL)
+        config = *data->fetch;                  // Settings of the run: transfers in flight, timeouts, retries
+    else
+        fetchConfigDefaults(&config);
+    config.onDone = pageFetched;                // Wrap-up stage for finished pages
+    config.onChunk = pageChunk;                 // Parse stage, fed as the body arrives
+    config.onRetry = pageRetry;                 // Failed attempts adapt the host's limits right away
+    if (data->pages != NULL)
+        config.onHeader = pageHeader;           // Validators of the page, for the next crawl
+    config.context = &context;                  // Gives the callbacks access to the frontier
+
+    FetchEngine *engine = fetchEngineCreate(&config);
+    if (engine == NULL)
+    {
+        fprintf(stderr, "Error creating fetch engine\n");
+        return NULL;                            // Takes no work, the other workers carry on
+    }
+    int lane = frontierAttach(frontier);        // Queue of the links found by this worker
+    metricsThreadName("worker");                // Its track in a trace
+    if (data->archive != NULL)
+        context.archive = archiveBatchCreate(data->archive);   // NULL: this worker's pages are not archived
 
-    // Loop through all documents given by URLs until there is an empty queue or depth limit is reached
+    // Loop until no URL is queued or in flight anywhere (with a cluster, on any shard)
+    long long idleSince = 0;                    // When this worker last ran out of work, 0 while it has some
     while (1)
     {
-        char *url;   // Variable to store URL
+        long waitMs = -1;                       // Time until the crawl delay of a host runs out
 
-        pthread_mutex_lock(mutex);      // Acquire mutex lock
-        url = dequeue(queue);           // Dequeue a URL
-        pthread_mutex_unlock(mutex);    // Release mutex lock
+        // Register for a wake-up before looking for work, so work queued from here on is not slept through
+        int parking = fetchEngineInFlight(engine) == 0;
+        unsigned long ticket = parking ? poolPrepare(pool) : 0;
 
-        if (url == NULL)    // Check if queue was empty
-        {
-            break;   // Exit the loop if the queue is empty
-        }
-        if(curdepth >= MAX_DEPTH)   // Check if current depth exceeds maximum depth
+        // Top the engine up with URLs of hosts that may start a transfer now
+        while (fetchEngineHasCapacity(engine))
         {
-            free(url);  // Free the URL string
-            continue;   // Skip processing the URL if depth limit is reached
-        }
+            char url[FRONTIER_MAX_URL];   // Variable to store URL
+            int depth;                    // Link depth of the URL
+            SchedulerHost *host;          // Host of the URL
+            char etag[PAGE_MAX_VALIDATOR], lastModified[PAGE_MAX_VALIDATOR];   // Validators of the copy fetched before
 
-        if (isVisited(url)) { // Check if URL has been visited
-            free(url);        // Free the URL string
-            continue;         // Skip processing if URL has been visited
-        }
+            int popped = schedulerPop(scheduler, url, sizeof(url), &depth, &host, &waitMs);
+            if (!popped)                  // Check if no host is ready
+            {
+                if (admitUrls(data, lane, ADMIT_BATCH) > 0)   // Bring newly found URLs over from the frontier
+                {
+                    continue;
+                }
+                break;   // Nothing to add right now
+            }
+            if (popped == SCHEDULER_GIVEN_UP)   // Its host kept failing, do not keep the crawl waiting on it
+            {
+                logEvent(LOG_WARN, "Host given up after repeated failures", url, NULL, depth);
+                metricsCount(METRIC_PAGES_FAILED, 1);
+                atomic_fetch_add(&data->pagesFailed, 1);
+                schedulerDone(scheduler, host, SCHEDULER_SKIPPED, 0);
+                journalDone(data->journal, url);
+                urlFinished(data);
+                continue;
+            }
+
+            // Log the start of processing for the URL
+            logEvent(LOG_DEBUG, "Processing URL", url, NULL, depth);
 
-        // Log the start of processing for the URL
-        logEvent("Processing URL", url, NULL, curdepth);
+            PageState *page = context.freePages;   // Reuse the state of a finished page if possible
+            if (page != NULL)
+                context.freePages = page->next;
+            else if ((page = malloc(sizeof(PageState))) != NULL)
+            {
+                page->body = NULL;                 // Allocated by the first page archived
+                page->bodyCap = 0;
+            }
+            if (page != NULL)
+            {
+                page->data = data;
+                page->depth = depth;
+                page->lane = lane;
+                page->host = host;
+                page->started = nowMs();
+                htmlScannerInit(&page->scanner, linkFound, page);
+                arenaInit(&page->strings, &context.arenas);
+                page->url = arenaStrndup(&page->strings, url, strlen(url));   // Base of its relative links
+                page->base = NULL;
+                page->record = UINT32_MAX;
+                page->etag = page->lastModified = NULL;
+                page->links = NULL;
+                page->linksEnd = &page->links;
+                simHashInit(&page->fingerprint);
+                page->parseNs = page->extractNs = 0;
+                page->archive = context.archive;
+                page->bodyLen = 0;
+            }
 
-        struct CURLResponse response = GetRequest(curl_handle, url);   // Get HTML response for the URL
+            // Ask for the page only if it changed since an earlier crawl fetched it
+            int known = page != NULL && data->pages != NULL &&
+                        pageStoreLookup(data->pages, url, &page->record, etag, lastModified) > 0;
+            if (page == NULL || fetchEngineSubmitIf(engine, url, known && etag[0] ? etag : NULL,
+                                                    known && lastModified[0] ? lastModified : NULL, page) != 0)   // Start the transfer
+            {
+                logEvent(LOG_WARN, "Failed to retrieve HTML content", url, NULL, depth);
+                atomic_fetch_add(&data->pagesFailed, 1);
+                schedulerDone(scheduler, host, SCHEDULER_SKIPPED, 0);
+                journalDone(data->journal, url);
+                urlFinished(data);
+                if (page != NULL)
+                {
+                    arenaReset(&page->strings);
+                    page->next = context.freePages;
+                    context.freePages = page;
+                }
+            }
+        }
 
-        // Check for response
-        if (response.html)   // If HTML content is received
+        metricsSet(METRIC_IN_FLIGHT, fetchEngineInFlight(engine));
+        if (fetchEngineInFlight(engine) > 0)
         {
-            htmlDocPtr doc = htmlReadMemory(response.html, (unsigned long)response.size, NULL, NULL, HTML_PARSE_NOERROR);   // Parse HTML document
-            if (doc)   // If document parsing is successful
-            {
-                // Log the successful retrieval of HTML content
-                logEvent("HTML content retrieved", url, NULL, curdepth);
+            if (parking)
+                poolCancel(pool);
+            idleSince = 0;
 
-                extractUrls(doc, queue, mutex);   // Extract URLs from the document
-                xmlFreeDoc(doc);   // Free parsed HTML document
+            // Saturated while URLs are waiting and no worker is free to take them: ask for one more
+            if (!fetchEngineHasCapacity(engine) && poolParked(pool) == 0 &&
+                (schedulerSize(scheduler) > 0 || frontierSize(frontier) > 0))
+            {
+                poolGrow(pool);
             }
-            free(response.html);   // Free HTML content memory
+
+            // Wait for network activity and handle finished pages, waking up when the next host is ready
+            int timeoutMs = 100;
+            if (waitMs >= 0 && waitMs < timeoutMs)
+                timeoutMs = (int)waitMs;
+            fetchEngineRun(engine, timeoutMs);
+            continue;
         }
-        else
+
+        // Nothing in flight and nothing to start: done once no URL is outstanding (with a cluster, on any shard)
+        int idleShard = frontierPending(frontier) == 0;
+        if (idleShard && (data->cluster == NULL || clusterFinished(data->cluster)))
         {
-            // Log failure to retrieve the HTML content
-            logEvent("Failed to retrieve HTML content", url, NULL, curdepth);
+            poolCancel(pool);
+            poolWakeAll(pool);                  // The parked workers stop too
+            break;   // Exit the loop
         }
 
-        // Mark URL as visited
-        markVisited(url);
+        long long now = nowMs();
+        if (idleSince == 0)
+            idleSince = now;
+        else if (poolRetire(pool, (long)(now - idleSince)))
+        {
+            poolCancel(pool);
+            break;                              // Not needed any more; its lane is left to the others
+        }
 
-        //Finished processing URLs, log to file.
-        logEvent("Finished processing URL", url, NULL, curdepth);
+        // Park until URLs are queued or a host is released, or the crawl delay of a host runs out
+        archiveFlush(context.archive);          // The records of the pages done do not wait for the next ones
+        long timeoutMs = idleShard ? CLUSTER_POLL_MS : PARK_MS;   // An idle shard's end is only seen by polling
+        if (waitMs >= 0 && waitMs < timeoutMs)
+            timeoutMs = waitMs;
+        poolPark(pool, ticket, timeoutMs);
+    }
 
-        free(url); // Free the URL string
-        curdepth++;   // Increment current depth
+    metricsSet(METRIC_IN_FLIGHT, 0);
+    frontierDetach(frontier, lane);
+    fetchEngineDestroy(engine);
+    archiveBatchDestroy(context.archive);       // Hands the last records over
+    while (context.freePages != NULL)           // Free the page states
+    {
+        PageState *page = context.freePages;
+        context.freePages = page->next;
+        free(page->body);
+        free(page);
     }
+    arenaPoolDestroy(&context.arenas);
     return NULL;   // Return from worker thread
 }
 
+// 1 if a page was retrieved: answered 2xx, or 304 Not Modified; any other answer is an error page
+static int pageSucceeded(CURLcode result, long status)
+{
+    return result == CURLE_OK && ((status >= 200 && status < 300) || status == 304);
+}
+
+// How the host of a transfer coped with an attempt, for the scheduler's adaptive limits
+static SchedulerOutcome transferOutcome(CURLcode result, long status)
+{
+    if (result == CURLE_OK)
+        return status == 429 || status == 502 || status == 503 || status == 504 ? SCHEDULER_OVERLOADED : SCHEDULER_OK;
+    if (result == CURLE_OPERATION_TIMEDOUT)
+        return SCHEDULER_TIMEOUT;
+    return SCHEDULER_FAILED;
+}
+
 /*
-    logEvent
+    Retry stage: an attempt of a page failed and the engine tries it again once its backoff runs out.
 
-    Description: this function logs information to a log file.
-    If the log file does not exist yet, it is created. Subsequent calls append
-    new log entries to the existing log file.
+    Preconditions:  'engine' must be the fetch engine of a worker, 'userdata' the PageState of the page.
+    Postcondition:  The scheduler has been told how the attempt went, and the page's next attempt is timed from now.
+*/
+void pageRetry(FetchEngine *engine, const char *url, CURLcode result, long status, void *userdata)
+{
+    PageState *page = (PageState *)userdata;
+    long long now = nowMs();
+    (void)engine;
+    (void)url;
+    schedulerReport(page->data->scheduler, page->host, transferOutcome(result, status), (long)(now - page->started));
+    page->started = now;
+}
+
+// Keep a chunk of a page's body for the archive, up to archiveMaxBody() bytes
+static void keepBody(PageState *page, const char *data, size_t len)
+{
+    size_t max = archiveMaxBody(page->data->archive);
+    if (page->bodyLen + len > max)
+        len = page->bodyLen < max ? max - page->bodyLen : 0;
+    if (page->bodyLen + len > page->bodyCap)
+    {
+        size_t cap = page->bodyCap ? page->bodyCap : 64 * 1024;
+        while (cap < page->bodyLen + len)
+            cap *= 2;
+        char *body = realloc(page->body, cap);
+        if (body == NULL)
+            return;                            // The archive gets the body cut short
+        page->body = body;
+        page->bodyCap = cap;
+    }
+    memcpy(page->body + page->bodyLen, data, len);
+    page->bodyLen += len;
+}
 
-    Preconditions/parameters.
-    - event: The event or action being logged.
-    - url: The URL associated with the event.
-    - status: The status of the event (optional).
-    - depth: The depth of the event in the URL traversal.
+/*
+    Parse stage for a chunk of a page body.
 
-    Postconditions:
-    - If the log file does not exist yet, it is created and the log entry is written.
-    - If the log file already exists, the log entry is appended to the existing file.
+    Description:
+    Called by the fetch engine of a worker for every chunk of a page as it comes off the network. The chunk is
+    fed to the page's link scanner, which calls linkFound() for every link it completes. A NULL chunk means
+    the transfer is retried from the start, so the scanner starts over and a <base> seen so far is forgotten.
+    With the metrics open, the time the chunk takes counts towards the page's parse stage, less the time of the links
+    it completes, and is traced.
+
+    Preconditions:
+    'userdata' must point to the PageState of the page, prepared by the worker.
+
+    Postcondition:
+    The links completed by this chunk are enqueued.
 */
-void logEvent(const char *event, const char *url, const char *status, int depth)
+void pageChunk(FetchEngine *engine, const char *data, size_t len, void *userdata)
 {
-    // Open the log file in read mode to check if it exists
-    FILE *logFile = fopen("crawler.log", "r");
-    //if depth == -2, we are on the initial run of the program
-    if (logFile == NULL || depth == -2)
+    PageState *page = (PageState *)userdata;   // Page receiving the chunk
+    (void)engine;
+
+    if (data == NULL)   // Retry: links already enqueued are deduplicated by the visited set
     {
-        // If the log file does not exist yet, create it in write mode
-        logFile = fopen("crawler.log", "w");
+        htmlScannerInit(&page->scanner, linkFound, page);
+        page->base = NULL;   // Its string stays in the arena with the page URL until the page is done
+        page->etag = page->lastModified = NULL;
+        page->links = NULL;
+        page->linksEnd = &page->links;
+        simHashInit(&page->fingerprint);
+        page->bodyLen = 0;
+        return;
     }
-    else
+    if (page->archive != NULL)
+        keepBody(page, data, len);
+    if (!metricsEnabled())
+    {
+        if (page->data->pages != NULL)
+            simHashFeed(&page->fingerprint, data, len);
+        htmlScannerFeed(&page->scanner, data, len);
+        return;
+    }
+
+    uint64_t start = metricsNow();             // Time the chunk, less the links it completes
+    uint64_t extracted = page->extractNs;
+    if (page->data->pages != NULL)
+        simHashFeed(&page->fingerprint, data, len);
+    htmlScannerFeed(&page->scanner, data, len);
+    uint64_t spent = metricsNow() - start;
+    page->parseNs += spent - (page->extractNs - extracted);
+    metricsTrace("parse", NULL, start, spent, 0);
+}
+
+/*
+    Keep the validators of a page from its response headers.
+
+    Preconditions:  'userdata' points to the PageState of the page.
+    Postcondition:  The ETag and Last-Modified values are copied to the page's string arena, for the page store.
+*/
+void pageHeader(FetchEngine *engine, const char *name, size_t nameLen, const char *value, size_t valueLen,
+                void *userdata)
+{
+    PageState *page = (PageState *)userdata;   // Page whose response this is
+    (void)engine;
+
+    if (nameLen == 4 && strncasecmp(name, "ETag", 4) == 0)
+        page->etag = arenaStrndup(&page->strings, value, valueLen);
+    else if (nameLen == 13 && strncasecmp(name, "Last-Modified", 13) == 0)
+        page->lastModified = arenaStrndup(&page->strings, value, valueLen);
+}
+
+// Print a link of a page and queue it one level deeper, or send it to the shard owning its host
+static void followLink(PageState *page, const char *url)
+{
+    ThreadData *data = page->data;
+    if (data->links != NULL)
+        fprintf(data->links, "%s\n\n", url);                        // Print the URL
+    archiveLink(page->archive, page->url, url);                     // Into the link graph, with an archive
+    if (data->cluster != NULL && clusterOwner(data->cluster, url) != clusterIndex(data->cluster))
     {
-        // If the log file already exists, close it and open it in append mode
-        fclose(logFile);
-        logFile = fopen("crawler.log", "a");
+        if (page->depth + 1 <= frontierMaxDepth(data->frontier))    // The owner would prune it too
+            clusterForward(data->cluster, url, page->depth + 1);     // Queued by the shard owning its host
+        return;
     }
+    queueLink(data, page->lane, url, page->depth + 1);              // Enqueue the URL on this worker's lane, one level deeper
+}
+
+// Follow a link the page store kept for an unchanged page
+static void storedLink(const char *url, size_t len, void *arg)
+{
+    (void)len;
+    followLink((PageState *)arg, url);
+}
+
+// Resolve a link of a page and follow it or keep it for the end of the page, see linkFound()
+static void takeLink(PageState *page, HtmlLinkKind kind, const char *href, size_t len)
+{
+    char url[FRONTIER_MAX_URL];                // Normalized absolute URL of the link
+
+    // Resolve it, filtering for actual URLs
+    int urlLen = urlNormalize(page->base != NULL ? page->base : page->url, href, len, url, sizeof(url));
+    if (urlLen < 0)   // Not http or https, or no URL to resolve it against
+        return;
+
+    if (kind == HTML_LINK_BASE)   // Only the first <base> of a page counts
+    {
+        if (page->base == NULL)
+            page->base = arenaStrndup(&page->strings, url, (size_t)urlLen);
+        return;
+    }
+
+    metricsCount(METRIC_LINKS, 1);
+    if (page->data->pages == NULL)
+    {
+        followLink(page, url);
+        return;
+    }
+
+    // With a page store the links wait for the end of the page, which may turn out to be a near-duplicate
+    PageLink *link = arenaAlloc(&page->strings, sizeof(PageLink));
+    if (link == NULL || (link->url = arenaStrndup(&page->strings, url, (size_t)urlLen)) == NULL)
+    {
+        followLink(page, url);                                      // Out of memory: not kept for the next crawl
+        return;
+    }
+    link->len = (size_t)urlLen;
+    link->next = NULL;
+    *page->linksEnd = link;
+    page->linksEnd = &link->next;
+}
 
-    if (logFile == NULL)
+/*
+    Handle a link found by the scanner of a page.
+
+    Description:
+    The href of an <a> tag is resolved against the page's <base>, or the page URL if it has none, and normalized
+    (see url.h). If the result is an http or https URL, it is considered a valid link and pushed onto the frontier
+    one level deeper than the page; the frontier drops it right away if that is beyond the depth limit, or if it
+    was queued before. With a journal, a queued link that is not visited yet is logged too, so a resumed crawl
+    still finds it. In a cluster, a link to a host of another shard is sent to that shard instead. The first <base>
+    tag is resolved the same way and kept in the page's string arena. With a page store, links are kept in the arena
+    as well, and pageFetched() follows them once the page is complete; they count towards the page's fingerprint only
+    if its text gives fewer than PAGE_MIN_FEATURES features (see pageLinks()). With the metrics open, the time it
+    takes counts towards the page's extract stage.
+
+    Preconditions:
+    'href' is the null-terminated, entity-decoded href of the tag, 'userdata' points to the PageState of the page.
+
+    Postcondition:
+    The normalized URL is printed and enqueued if it is a valid link, or sent to the shard owning its host; with a page
+    store, it is added to the page's links.
+*/
+void linkFound(HtmlLinkKind kind, const char *href, size_t len, void *userdata)
+{
+    PageState *page = (PageState *)userdata;   // Page the link was found in
+    if (!metricsEnabled())
     {
-        fprintf(stderr, "Error opening log file\n");
+        takeLink(page, kind, href, len);
         return;
     }
+    uint64_t start = metricsNow();
+    takeLink(page, kind, href, len);
+    page->extractNs += metricsNow() - start;
+}
+
+/*
+    Follow the links of a finished page with a page store, and keep what was learned of the page.
 
-    // Get the current time
-    // Declare a variable to hold the current time
-    time_t currentTime;
-    // Declare a variable to hold the local time structure
-    struct tm *localTime;
-    // Declare a string to store the formatted time
-    char timeString[20];
+    Description:
+    A page the server answered 304 Not Modified for has no body: its links are those stored when it was last
+    downloaded. The links of any other page were collected while it was parsed. Either way they are only followed if
+    the page's fingerprint is not within SIMHASH_NEAR_BITS of a page seen before in this crawl; another page with the
+    same content queued them already. The fingerprint is of the text; the links only count for a page with too
+    little text to go by, since a dozen absolute URLs among a thousand text features move it by a few bits already.
+    The store then gets the page's validators, fingerprint and links, or forgets the page if the server says it is
+    gone.
+
+    Preconditions:  'page' was fetched with a page store, 'result' and 'status' are the outcome of its transfer and
+                    'size' the bytes of its body.
+    Postcondition:  The page's links are queued, unless it is a near-duplicate, and the store is up to date.
+*/
+static void pageLinks(PageState *page, CURLcode result, long status, size_t size)
+{
+    PageStore *store = page->data->pages;
+    PageInfo info;
+    int stored = page->record != UINT32_MAX;
 
-    // Get the current time in seconds
-    currentTime = time(NULL);
-    // Convert the current time to the local time
-    localTime = localtime(&currentTime);
-    // Format the local time as a string in the format "YYYY-MM-DD HH:MM:SS"
-    strftime(timeString, sizeof(timeString), "%Y-%m-%d %H:%M:%S", localTime);
+    if (result == CURLE_OK && status == 304 && stored && pageStoreUnchanged(store, page->record, &info))
+    {
+        if (!pageStoreNearDuplicate(store, info.simhash, info.features))
+            pageStoreLinks(store, page->record, storedLink, page);
+        return;
+    }
 
+    if (!pageSucceeded(result, status))                 // An error page has no links to follow
+    {
+        if (result == CURLE_OK && stored && (status == 404 || status == 410))
+            pageStoreForget(store, page->record);
+        return;
+    }
 
-    // Write the log entry to the log file
-    fprintf(logFile, "[%s] %s: %s\n", timeString, event, url);
+    if (page->fingerprint.features < PAGE_MIN_FEATURES)   // Too little text to go by: the links tell it apart
+        for (PageLink *link = page->links; link != NULL; link = link->next)
+            simHashAdd(&page->fingerprint, link->url, link->len);
+    info.simhash = simHashFinish(&page->fingerprint);
+    info.features = page->fingerprint.features;
+    info.size = (long)size;
+    info.etag = page->etag;
+    info.lastModified = page->lastModified;
+    if (!pageStoreNearDuplicate(store, info.simhash, info.features))
+        for (PageLink *link = page->links; link != NULL; link = link->next)
+            followLink(page, link->url);
+    if (stored && status != 304)                        // A 304 with nothing usable stored has no body to keep
+        pageStoreUpdate(store, page->record, &info, page->links);
+}
 
-    // If status is provided, log it as well
-    if (status != NULL)
+// Count a finished page in the metrics, with the time its parse and extract stages took
+static void pageMetrics(const PageState *page, CURLcode result, long status, size_t size)
+{
+    if (!pageSucceeded(result, status))
     {
-        fprintf(logFile, "\tStatus: %s\n", status);
+        metricsCount(METRIC_PAGES_FAILED, 1);
+        return;
     }
+    metricsCount(METRIC_PAGES_FETCHED, 1);
+    metricsCount(METRIC_BYTES, (long)size);
+    if (status == 304)
+        metricsCount(METRIC_NOT_MODIFIED, 1);
+    else
+        metricsRecord(METRIC_PARSE, page->parseNs);
+    metricsRecord(METRIC_EXTRACT, page->extractNs);
+}
+
+
+/*
+    Wrap-up stage for a finished transfer.
+
+    Description:
+    Called by the fetch engine of a worker when the transfer of 'url' has finished. Its links have already been
+    enqueued while the body arrived, or with a page store are followed now (see pageLinks()); this gives the page's
+    host back to the scheduler with how it coped, logs the outcome, updates the counters and recycles the page state, giving the blocks
+    of its string arena back to the worker in one step. A page answered with anything but 2xx or 304 counts as failed;
+    the engine streams no body of such an answer, so none of its links were followed. One that failed for a reason
+    that may pass (see fetchRetryable()) is not journaled done, so a resumed crawl tries it again.
+
+    Preconditions:
+    'engine' must be the fetch engine of a worker, its context pointing to the worker's WorkerContext.
+    'result' is CURLE_OK if the page was retrieved.
+    'userdata' points to the PageState of the page.
 
-    // If depth is provided, log it as well
-    if (depth >= 0)
+    Postcondition:
+    The outcome is logged and the page state is back on the worker's free list.
+*/
+void pageFetched(FetchEngine *engine, const char *url, struct CURLResponse *response,
+                 CURLcode result, long status, void *userdata)
+{
+    WorkerContext *context = (WorkerContext *)fetchEngineContext(engine);   // Worker owning the page state
+    PageState *page = (PageState *)userdata;                                // Page that finished
+    ThreadData *data = page->data;
+    int curdepth = page->depth;                                             // Link depth of the URL
+
+    htmlScannerFinish(&page->scanner);   // A tag cut off at the end of the body is dropped
+    if (data->pages != NULL)
+    {
+        uint64_t start = metricsEnabled() ? metricsNow() : 0;
+        pageLinks(page, result, status, response->size);   // Links held back for the fingerprint, or stored ones
+        if (start != 0)
+            page->extractNs += metricsNow() - start;
+    }
+    if (metricsEnabled())
+        pageMetrics(page, result, status, response->size);
+    schedulerDone(data->scheduler, page->host, transferOutcome(result, status),
+                  (long)(nowMs() - page->started));   // The host may start its next transfer, maybe with a new limit
+    if (schedulerSize(data->scheduler) > 0)
+        poolWake(data->pool);            // Maybe with a parked worker
+
+    int succeeded = pageSucceeded(result, status);
+    if (succeeded || !fetchRetryable(result, status))
+        journalDone(data->journal, url); // Finished, a resumed crawl does not fetch it again; it tries a busy host again
+
+    // Check for response
+    if (succeeded)   // If HTML content is received
     {
-        fprintf(logFile, "\tDepth: %d\n", depth);
+        archivePage(page->archive, url, status, page->body, page->bodyLen, response->size);
+        // Log the successful retrieval of HTML content
+        logEvent(LOG_INFO, "HTML content retrieved", url, NULL, curdepth);
+        atomic_fetch_add(&data->pagesFetched, 1);
     }
+    else
+    {
+        // Log failure to retrieve the HTML content, with the error or the status of the error page
+        char code[16];
+        snprintf(code, sizeof(code), "%ld", status);
+        logEvent(LOG_WARN, "Failed to retrieve HTML content", url,
+                 result != CURLE_OK ? curl_easy_strerror(result) : code, curdepth);
+        atomic_fetch_add(&data->pagesFailed, 1);
+    }
+
+    arenaReset(&page->strings);          // Free the page's strings at once
+    page->base = NULL;
+    page->next = context->freePages;     // Keep the state for the next page
+    context->freePages = page;
 
-    // Close the log file
-    fclose(logFile);
+    //Finished processing URLs, log to file.
+    logEvent(LOG_DEBUG, "Finished processing URL", url, NULL, curdepth);
+    urlFinished(data);                   // Its links are all queued by now
 }
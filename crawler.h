@@ -0,0 +1,112 @@
+/*
+Operating Systems Spring 2024
+Final Project
+
+Crawl loop shared by the interactive crawler and the benchmarks.
+*/
+
+#ifndef CRAWLER_H
+#define CRAWLER_H
+
+#include <stdatomic.h>
+#include <stdio.h>
+#include <libxml/HTMLparser.h>
+
+#include "archive.h"
+#include "cluster.h"
+#include "fetch.h"
+#include "frontier.h"
+#include "htmlscan.h"
+#include "journal.h"
+#include "logger.h"
+#include "mempool.h"
+#include "metrics.h"
+#include "options.h"
+#include "pagestore.h"
+#include "pool.h"
+#include "resolver.h"
+#include "robots.h"
+#include "scheduler.h"
+#include "seeds.h"
+#include "simhash.h"
+#include "url.h"
+#include "urltable.h"
+#include "visited.h"
+
+// Struct to pass data to worker threads
+typedef struct
+{
+    Frontier *frontier;             // Pointer to the URL frontier
+    HostScheduler *scheduler;       // Per-host queues the workers fetch from, fed from the frontier
+    Journal *journal;               // Log of queued and finished URLs for resuming, NULL for none
+    const FetchConfig *fetch;       // Settings of the workers' fetch engines, NULL for the defaults
+    FILE *links;                    // Where the links found are printed, NULL for nowhere
+    Cluster *cluster;               // Shards of a crawl split over several processes, NULL for a crawl of its own
+    PageStore *pages;               // What earlier crawls learned of the pages, NULL to fetch every page in full
+    Archive *archive;               // Where the pages fetched and the links found are archived, NULL for none
+    RobotsCache *robots;            // robots.txt rules of the hosts, NULL to ignore robots.txt
+    int maxWorkers;                 // Most worker threads the pool grows to under load, 0 for a fixed-size pool
+    WorkPool *pool;                 // Pool running the worker threads, set by crawl()
+    PoolStats poolStats;            // Counters of the pool once crawl() has returned
+    atomic_long pagesFetched;       // Pages retrieved so far
+    atomic_long pagesFailed;        // Pages that could not be retrieved
+} ThreadData;
+
+// State of one page in flight: its link depth and the scanner fed with its body as it arrives
+typedef struct PageState
+{
+    ThreadData *data;               // Crawl the page belongs to
+    int depth;                      // Link depth of the page
+    int lane;                       // Frontier lane of the worker fetching it, where its links go
+    SchedulerHost *host;            // Host of the page, given back to the scheduler when it is done
+    long long started;              // When its transfer was submitted, in monotonic ms
+    HtmlScanner scanner;            // Link scanner, holds no more than the href being read
+    Arena strings;                  // Strings kept while the page is parsed, freed at once when it is done
+    const char *url;                // URL of the page, in 'strings'
+    const char *base;               // Normalized URL of the page's <base> tag, in 'strings', or NULL
+    uint32_t record;                // ID of the page in the page store, UINT32_MAX for none
+    const char *etag;               // ETag header of the response, in 'strings', or NULL
+    const char *lastModified;       // Last-Modified header of the response, in 'strings', or NULL
+    SimHash fingerprint;            // Fingerprint of the text and links, fed as the body arrives (with a page store)
+    PageLink *links;                // Links found, in 'strings', followed once the page is done (with a page store)
+    PageLink **linksEnd;            // Where the next link found is appended
+    uint64_t parseNs;               // Time spent scanning the body, links aside (with the metrics open)
+    uint64_t extractNs;             // Time spent resolving and queueing the links (with the metrics open)
+    ArchiveBatch *archive;          // Batch of the worker the page and its links are archived in, NULL for none
+    char *body;                     // Body kept for the archive, up to archiveMaxBody() bytes, reused by the next page
+    size_t bodyLen, bodyCap;
+    struct PageState *next;         // Next entry on the worker's free list
+} PageState;
+
+// Per-thread state of a worker, the context of its fetch engine
+typedef struct
+{
+    ThreadData *data;               // Shared crawl state
+    PageState *freePages;           // Page states ready for reuse
+    ArenaPool arenas;               // Blocks of the pages' string arenas
+    ArchiveBatch *archive;          // Records of the worker's pages and links not handed to the archive yet
+} WorkerContext;
+
+// Global set to store the fingerprints of visited URLs
+extern VisitedSet *visited_urls;
+
+// Function prototypes
+int crawl(ThreadData *data, int numWorkers);
+int crawlIdle(void *arg);
+void crawlReceive(const char *url, int depth, void *arg);
+void crawlRobotsRelease(const char *url, int depth, int allowed, void *arg);
+void crawlRobotsDelay(const char *url, long delayMs, void *arg);
+int admitUrls(ThreadData *data, int lane, int max);
+void extractUrls(htmlDocPtr doc, Frontier *frontier, int depth);
+void *worker(void *arg);
+void pageRetry(FetchEngine *engine, const char *url, CURLcode result, long status, void *userdata);
+void pageChunk(FetchEngine *engine, const char *data, size_t len, void *userdata);
+void pageHeader(FetchEngine *engine, const char *name, size_t nameLen, const char *value, size_t valueLen,
+                void *userdata);
+void linkFound(HtmlLinkKind kind, const char *href, size_t len, void *userdata);
+void pageFetched(FetchEngine *engine, const char *url, struct CURLResponse *response,
+                 CURLcode result, long status, void *userdata);
+int isVisited(const char *url);
+int markVisited(const char *url);
+
+#endif
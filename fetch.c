@@ -0,0 +1,1220 @@
+/*
+Operating Systems Spring 2024
+Final Project
+
+Fetch engine built on the curl multi interface.
+
+Every engine owns one curl multi handle. On Linux the multi handle is driven through
+curl_multi_socket_action() from an epoll set, so one thread can keep hundreds to thousands
+of transfers in flight. Finished easy handles are kept on a free list and reused, and the
+multi handle keeps idle connections open so later requests to the same host reuse them.
+With an onChunk callback bodies are passed on as they arrive and never buffered. Otherwise
+bodies go into buffers from the engine's BufferPool, sized from Content-Length when the server
+sends one and grown geometrically when it does not, and the buffers and URL copies of finished
+transfers are reused, so a warmed-up engine fetches pages without calling malloc().
+
+With a Resolver, the host of every URL is looked up in the crawl's shared DNS cache before the
+transfer starts and curl is handed the addresses through CURLOPT_RESOLVE, so it never resolves on
+its own. A host that is not cached yet does not hold the engine up: its transfers wait aside until
+the resolver writes to the engine's wake pipe, which is polled along with the curl sockets. With a
+FetchShare, curl's DNS cache and TLS sessions are shared by every engine, so a TLS session set up by
+one worker is resumed by the others. Connections themselves stay per engine: curl does not allow a
+connection cache to be used by several threads at the same time.
+
+A transfer submitted with fetchEngineSubmitIf() carries the validators of the copy fetched before as
+If-None-Match and If-Modified-Since headers, so an unchanged page comes back as a bodiless 304.
+
+With the metrics open, the time of every finished transfer is split into its stages from curl's timers
+(name lookup, connect, TLS handshake, waiting for the first byte, download) and recorded, and traced as
+a transfer with its stages nested in it.
+
+A failed attempt is not retried at once: the transfer waits aside for a backoff that doubles with every attempt,
+with jitter so transfers that failed together do not come back together, or for as long as the server asked with
+Retry-After. The engine keeps running its other transfers meanwhile and starts the retry once its time has come.
+*/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+#include <curl/curl.h>
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#endif
+
+#include "fetch.h"
+#include "metrics.h"
+
+// Maximum number of epoll events handled per call of fetchEngineRun()
+#define MAX_EVENTS 256
+
+// Smallest URL copy kept by a transfer, so most later URLs fit without reallocating
+#define MIN_URL_CAPACITY 256
+
+// User agent sent with every request (mimic user)
+#define USER_AGENT "Mozilla/5.0 (Windows NT 10.0; Win64; x64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/117.0.0.0 Safari/537.36"
+
+// Body being buffered: the response, the buffer behind it and where the buffer comes from
+typedef struct
+{
+    struct CURLResponse *response;  // Body received so far
+    size_t capacity;                // Size of the buffer behind response->html
+    BufferPool *pool;               // Source of the buffer, NULL for malloc() (the caller frees the body)
+    CURL *easy;                     // Transfer, to read Content-Length from
+} Body;
+
+// State of a single transfer
+typedef struct Transfer
+{
+    CURL *easy;                     // Easy handle, kept across reuses
+    FetchEngine *engine;            // Engine owning the transfer
+    char *url;                      // URL being fetched, the buffer is kept across reuses
+    size_t urlCapacity;             // Size of the buffer behind 'url'
+    struct CURLResponse response;   // Body received so far
+    Body body;                      // Buffer state of 'response' when not streaming
+    void *userdata;                 // Per-transfer pointer from the caller
+    int attempts;                   // Attempts made so far
+    int waiting;                    // 1 while the host is being looked up by the resolver
+    long long retryAt;              // Monotonic ms at which its next attempt starts, 0 unless waiting to retry
+    struct curl_slist *resolve;     // "host:port:addresses" given to curl, kept until it changes
+    struct curl_slist *headers;     // Conditional request headers of the URL, NULL for none
+    struct Transfer *prev;          // Previous entry on the active list
+    struct Transfer *next;          // Next entry on the active or free list
+} Transfer;
+
+struct FetchEngine
+{
+    CURLM *multi;                   // curl multi handle driving every transfer
+    FetchConfig config;             // Settings given at creation
+    int inFlight;                   // Number of transfers on the active list
+    Transfer *active;               // Transfers currently owned by the multi handle
+    Transfer *freeList;             // Finished transfers ready for reuse
+    BufferPool buffers;             // Response buffers of buffered transfers
+    AllocStats urlStats;            // Allocations made for URL copies
+    FetchNetStats net;              // Name lookup and connection counters
+    int wake[2];                    // Pipe the resolver writes to when a lookup is done, -1 without a resolver
+    int waiter;                     // Waiter ID of 'wake' with the resolver
+    int waiting;                    // Transfers on the active list waiting for the resolver
+    int recheck;                    // 1 when waiting transfers must look their host up again
+    int delayed;                    // Transfers on the active list waiting to retry
+    long long nextRetry;            // Earliest retryAt of those, in monotonic ms
+    uint64_t seed;                  // State of the jitter's random numbers
+#ifdef __linux__
+    int epfd;                       // epoll set with every socket curl asked us to watch
+    long long timerDeadline;        // Monotonic ms at which curl wants a timeout action, -1 if none
+#endif
+};
+
+static size_t WriteHTMLCallback(void *contents, size_t size, size_t nmemb, void *userp);
+static size_t StreamCallback(void *contents, size_t size, size_t nmemb, void *userp);
+static size_t HeaderCallback(char *buffer, size_t size, size_t nitems, void *userp);
+
+/*
+    Fill a FetchConfig with the crawler's default settings.
+
+    Preconditions:  'config' points to a valid FetchConfig structure.
+    Postcondition:  Every field is set; the callbacks, 'context', 'resolver' and 'share' are NULL.
+*/
+void fetchConfigDefaults(FetchConfig *config)
+{
+    config->maxInFlight = 256;          // Concurrent transfers per engine
+    config->maxHostConnections = 8;     // Stay polite with a single host
+    config->timeout = 30L;              // Maximum time allowed for the entire request (in seconds)
+    config->connectTimeout = 10L;       // Maximum time allowed for connection establishment (in seconds)
+    config->retries = 3;                // Number of attempts per URL
+    config->retryBaseMs = 500;          // 0.25-0.5 s before the 2nd attempt, 0.5-1 s before the 3rd, ...
+    config->retryMaxMs = 30000;
+    config->lowSpeedLimit = 100;        // A host trickling out less than 100 bytes/s for 15 s is given up on
+    config->lowSpeedTime = 15;
+    config->maxRedirects = 0;           // The crawl does not follow redirects
+    config->maxPooledBytes = 32 * 1024 * 1024;   // Idle response buffers kept per engine
+    config->resolver = NULL;            // curl's own threaded resolver
+    config->share = NULL;
+    config->onDone = NULL;
+    config->onChunk = NULL;
+    config->onHeader = NULL;
+    config->onRetry = NULL;
+    config->context = NULL;
+}
+
+// curl state shared between engines, with a lock per kind of data
+struct FetchShare
+{
+    CURLSH *share;                              // curl share handle
+    pthread_mutex_t locks[CURL_LOCK_DATA_LAST]; // Indexed by curl_lock_data
+};
+
+// curl share callbacks: one lock per kind of data, held for reading and writing alike
+static void shareLock(CURL *handle, curl_lock_data data, curl_lock_access access, void *userptr)
+{
+    (void)handle; (void)access;
+    pthread_mutex_lock(&((FetchShare *)userptr)->locks[data]);
+}
+
+static void shareUnlock(CURL *handle, curl_lock_data data, void *userptr)
+{
+    (void)handle;
+    pthread_mutex_unlock(&((FetchShare *)userptr)->locks[data]);
+}
+
+/*
+    Create the curl state shared by the engines of a crawl.
+
+    Preconditions:  curl_global_init() has been called.
+    Postcondition:  Returns a share of curl's DNS cache and TLS session cache to set as FetchConfig.share,
+                    or NULL if it could not be created.
+*/
+FetchShare *fetchShareCreate(void)
+{
+    FetchShare *share = malloc(sizeof(FetchShare));
+    if (share == NULL)
+        return NULL;
+    share->share = curl_share_init();
+    if (share->share == NULL)
+    {
+        free(share);
+        return NULL;
+    }
+    for (int i = 0; i < CURL_LOCK_DATA_LAST; i++)
+        pthread_mutex_init(&share->locks[i], NULL);
+
+    curl_share_setopt(share->share, CURLSHOPT_LOCKFUNC, shareLock);
+    curl_share_setopt(share->share, CURLSHOPT_UNLOCKFUNC, shareUnlock);
+    curl_share_setopt(share->share, CURLSHOPT_USERDATA, share);
+    curl_share_setopt(share->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+    curl_share_setopt(share->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+    return share;
+}
+
+/*
+    Destroy a FetchShare.
+
+    Preconditions:  'share' was returned by fetchShareCreate() or is NULL; every engine using it is destroyed.
+    Postcondition:  All memory is released.
+*/
+void fetchShareDestroy(FetchShare *share)
+{
+    if (share == NULL)
+        return;
+    curl_share_cleanup(share->share);
+    for (int i = 0; i < CURL_LOCK_DATA_LAST; i++)
+        pthread_mutex_destroy(&share->locks[i]);
+    free(share);
+}
+
+// Current monotonic time in milliseconds
+static long long nowMs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/*
+    Wait before attempt 'attempts' + 1 of a transfer that failed 'attempts' times: 'baseMs' doubled for every
+    attempt after the first, up to 'maxMs', with "equal jitter": a random wait in the upper half of that, so the
+    waits still grow while transfers that failed together are spread out. 'seed' is the state of the random numbers.
+*/
+static long backoffMs(long baseMs, long maxMs, int attempts, uint64_t *seed)
+{
+    if (baseMs <= 0)
+        return 0;
+    long cap = baseMs;
+    for (int i = 1; i < attempts && cap < maxMs; i++)
+        cap *= 2;
+    if (cap > maxMs)
+        cap = maxMs;
+
+    *seed ^= *seed << 13;                       // xorshift64
+    *seed ^= *seed >> 7;
+    *seed ^= *seed << 17;
+    return cap - cap / 2 + (long)(*seed % (uint64_t)(cap / 2 + 1));
+}
+
+// 1 if an attempt that ended with 'res' and 'status' may succeed when tried again
+int fetchRetryable(CURLcode res, long status)
+{
+    return res != CURLE_OK || status == 429 || status == 502 || status == 503 || status == 504;
+}
+
+#ifdef __linux__
+/*
+    curl socket callback: mirror the sockets curl wants watched into the epoll set.
+
+    Description:
+    curl calls this whenever the set of events it waits for on a socket changes. A socket is
+    added on first use, modified afterwards and removed when curl is done with it.
+*/
+static int socketCallback(CURL *easy, curl_socket_t s, int what, void *userp, void *socketp)
+{
+    FetchEngine *engine = (FetchEngine *)userp;   // Engine owning the multi handle
+    struct epoll_event ev;                        // Event registration for the socket
+    (void)easy;
+
+    if (what == CURL_POLL_REMOVE)                 // curl no longer needs the socket
+    {
+        epoll_ctl(engine->epfd, EPOLL_CTL_DEL, s, NULL);
+        curl_multi_assign(engine->multi, s, NULL);
+        return 0;
+    }
+
+    memset(&ev, 0, sizeof(ev));
+    ev.data.fd = s;
+    if (what & CURL_POLL_IN)
+        ev.events |= EPOLLIN;
+    if (what & CURL_POLL_OUT)
+        ev.events |= EPOLLOUT;
+
+    if (socketp == NULL)                          // First time we see this socket
+    {
+        if (epoll_ctl(engine->epfd, EPOLL_CTL_ADD, s, &ev) != 0)
+            epoll_ctl(engine->epfd, EPOLL_CTL_MOD, s, &ev);
+        curl_multi_assign(engine->multi, s, engine);   // Any non-NULL value marks it as registered
+    }
+    else
+    {
+        epoll_ctl(engine->epfd, EPOLL_CTL_MOD, s, &ev);
+    }
+    return 0;
+}
+
+// curl timer callback: remember when curl wants to be called back with CURL_SOCKET_TIMEOUT
+static int timerCallback(CURLM *multi, long timeout_ms, void *userp)
+{
+    FetchEngine *engine = (FetchEngine *)userp;
+    (void)multi;
+    engine->timerDeadline = timeout_ms < 0 ? -1 : nowMs() + timeout_ms;
+    return 0;
+}
+#endif
+
+/*
+    Create a fetch engine.
+
+    Preconditions:  'config' points to a valid FetchConfig with 'onDone' set.
+                    curl_global_init() has been called.
+    Postcondition:  Returns a new engine with no transfers, or NULL if it could not be created.
+*/
+FetchEngine *fetchEngineCreate(const FetchConfig *config)
+{
+    FetchEngine *engine = calloc(1, sizeof(FetchEngine));   // Allocate the engine
+    if (engine == NULL)
+    {
+        return NULL;
+    }
+    engine->config = *config;
+    engine->waiter = -1;
+    engine->seed = ((uint64_t)(uintptr_t)engine ^ (uint64_t)nowMs() << 20) | 1;   // Any non-zero state
+#ifdef __linux__
+    engine->epfd = -1;
+#endif
+    if (engine->config.maxInFlight < 1)
+        engine->config.maxInFlight = 1;
+    if (engine->config.retries < 1)
+        engine->config.retries = 1;
+    bufferPoolInit(&engine->buffers, engine->config.maxPooledBytes);
+
+    engine->multi = curl_multi_init();                      // One multi handle per engine
+    if (engine->multi == NULL)
+    {
+        free(engine);
+        return NULL;
+    }
+
+    // Connection reuse: keep up to maxInFlight idle connections and bound them per host
+    curl_multi_setopt(engine->multi, CURLMOPT_MAXCONNECTS, (long)engine->config.maxInFlight);
+    curl_multi_setopt(engine->multi, CURLMOPT_MAX_TOTAL_CONNECTIONS, (long)engine->config.maxInFlight);
+    curl_multi_setopt(engine->multi, CURLMOPT_MAX_HOST_CONNECTIONS, (long)engine->config.maxHostConnections);
+    curl_multi_setopt(engine->multi, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+
+    // Wake pipe the resolver writes to when a host this engine waits for is looked up
+    engine->wake[0] = engine->wake[1] = -1;
+    if (engine->config.resolver != NULL)
+    {
+        if (pipe(engine->wake) != 0)
+        {
+            curl_multi_cleanup(engine->multi);
+            free(engine);
+            return NULL;
+        }
+        for (int i = 0; i < 2; i++)
+        {
+            fcntl(engine->wake[i], F_SETFL, fcntl(engine->wake[i], F_GETFL) | O_NONBLOCK);
+            fcntl(engine->wake[i], F_SETFD, FD_CLOEXEC);
+        }
+        engine->waiter = resolverWatch(engine->config.resolver, engine->wake[1]);
+        if (engine->waiter < 0)
+        {
+            fetchEngineDestroy(engine);
+            return NULL;
+        }
+    }
+
+#ifdef __linux__
+    engine->timerDeadline = -1;
+    engine->epfd = epoll_create1(EPOLL_CLOEXEC);            // Event set for every curl socket
+    if (engine->epfd < 0)
+    {
+        fetchEngineDestroy(engine);
+        return NULL;
+    }
+    curl_multi_setopt(engine->multi, CURLMOPT_SOCKETFUNCTION, socketCallback);
+    curl_multi_setopt(engine->multi, CURLMOPT_SOCKETDATA, engine);
+    curl_multi_setopt(engine->multi, CURLMOPT_TIMERFUNCTION, timerCallback);
+    curl_multi_setopt(engine->multi, CURLMOPT_TIMERDATA, engine);
+    if (engine->wake[0] >= 0)
+    {
+        struct epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN;
+        ev.data.fd = engine->wake[0];
+        epoll_ctl(engine->epfd, EPOLL_CTL_ADD, engine->wake[0], &ev);
+    }
+#endif
+
+    return engine;
+}
+
+// Set the options that stay the same for every URL, once per easy handle (curl copies strings it is given)
+static void setupTransfer(FetchEngine *engine, Transfer *t)
+{
+    CURL *easy = t->easy;
+
+    if (engine->config.onChunk != NULL)                      // Streaming: pass chunks on as they arrive
+    {
+        curl_easy_setopt(easy, CURLOPT_WRITEFUNCTION, StreamCallback);
+        curl_easy_setopt(easy, CURLOPT_WRITEDATA, (void *)t);
+    }
+    else
+    {
+        curl_easy_setopt(easy, CURLOPT_WRITEFUNCTION, WriteHTMLCallback);
+        curl_easy_setopt(easy, CURLOPT_WRITEDATA, (void *)&t->body);
+    }
+    if (engine->config.onHeader != NULL)
+    {
+        curl_easy_setopt(easy, CURLOPT_HEADERFUNCTION, HeaderCallback);
+        curl_easy_setopt(easy, CURLOPT_HEADERDATA, (void *)t);
+    }
+    curl_easy_setopt(easy, CURLOPT_PRIVATE, (void *)t);
+    curl_easy_setopt(easy, CURLOPT_USERAGENT, USER_AGENT);
+    curl_easy_setopt(easy, CURLOPT_TIMEOUT, engine->config.timeout);
+    curl_easy_setopt(easy, CURLOPT_CONNECTTIMEOUT, engine->config.connectTimeout);
+    curl_easy_setopt(easy, CURLOPT_LOW_SPEED_LIMIT, engine->config.lowSpeedLimit);
+    curl_easy_setopt(easy, CURLOPT_LOW_SPEED_TIME, engine->config.lowSpeedTime);
+    if (engine->config.maxRedirects > 0)
+    {
+        curl_easy_setopt(easy, CURLOPT_FOLLOWLOCATION, 1L);
+        curl_easy_setopt(easy, CURLOPT_MAXREDIRS, engine->config.maxRedirects);
+    }
+    curl_easy_setopt(easy, CURLOPT_NOSIGNAL, 1L);            // Required when curl is used from several threads
+    if (engine->config.share != NULL)
+        curl_easy_setopt(easy, CURLOPT_SHARE, engine->config.share->share);
+}
+
+// Set the URL and hand the transfer to the multi handle
+static int startTransfer(FetchEngine *engine, Transfer *t)
+{
+    curl_easy_setopt(t->easy, CURLOPT_URL, t->url);
+    t->attempts++;
+    return curl_multi_add_handle(engine->multi, t->easy) == CURLM_OK ? 0 : -1;
+}
+
+// Host and port of a URL as curl matches them against CURLOPT_RESOLVE; returns -1 if the host is an IP address
+static int urlHostPort(const char *url, char *host, size_t size, int *port)
+{
+    const char *p = strstr(url, "://");
+    if (p == NULL)
+        return -1;
+    *port = p - url == 5 && strncasecmp(url, "https", 5) == 0 ? 443 : 80;
+    p += 3;
+
+    size_t authority = strcspn(p, "/?#");           // [user@]host[:port]
+    for (size_t i = 0; i < authority; i++)
+    {
+        if (p[i] == '@')                            // Skip the user info
+        {
+            p += i + 1;
+            authority -= i + 1;
+            i = (size_t)-1;
+        }
+    }
+    size_t len = strcspn(p, ":/?#");
+    if (len == 0 || len >= size || p[0] == '[' || len > authority)
+        return -1;                                  // No host, too long or an IPv6 address
+    memcpy(host, p, len);
+    host[len] = '\0';
+    if (p[len] == ':' && p[len + 1] >= '0' && p[len + 1] <= '9')
+        *port = atoi(p + len + 1);
+    return strspn(host, "0123456789.") == len ? -1 : 0;   // An IPv4 address needs no lookup
+}
+
+/*
+    Look up the host of a transfer in the engine's resolver.
+
+    Description:
+    When the addresses are cached they are handed to curl as a CURLOPT_RESOLVE entry, so curl connects
+    without resolving on its own. The entry is only replaced when the addresses change: curl keeps it in
+    its DNS cache once loaded.
+
+    Postcondition:  Returns RESOLVER_FOUND if the transfer can start, also when there is no resolver or the host
+                    is an IP address; RESOLVER_PENDING if the engine's wake pipe is written to once the lookup is
+                    done; RESOLVER_FAILED if the host does not resolve.
+*/
+static int lookupHost(FetchEngine *engine, Transfer *t)
+{
+    char host[RESOLVER_MAX_HOST + 1];
+    char addresses[RESOLVER_MAX_ADDRESSES];
+    int port;
+    if (engine->config.resolver == NULL || urlHostPort(t->url, host, sizeof(host), &port) != 0)
+        return RESOLVER_FOUND;
+
+    int found = resolverLookup(engine->config.resolver, host, addresses, sizeof(addresses), engine->waiter);
+    if (found != RESOLVER_FOUND)
+        return found;
+
+    char entry[RESOLVER_MAX_HOST + RESOLVER_MAX_ADDRESSES + 16];
+    snprintf(entry, sizeof(entry), "%s:%d:%s", host, port, addresses);
+    if (t->resolve == NULL || strcmp(t->resolve->data, entry) != 0)
+    {
+        struct curl_slist *resolve = curl_slist_append(NULL, entry);
+        if (resolve != NULL)                        // Otherwise curl resolves the host itself
+        {
+            curl_easy_setopt(t->easy, CURLOPT_RESOLVE, resolve);
+            curl_slist_free_all(t->resolve);
+            t->resolve = resolve;
+        }
+    }
+    return RESOLVER_FOUND;
+}
+
+/*
+    Queue a URL for fetching.
+
+    Preconditions:  'engine' was returned by fetchEngineCreate(), 'url' is a valid null-terminated string.
+    Postcondition:  Returns 0 and the transfer is started (the URL is copied), or -1 on failure.
+                    The completion callback receives 'userdata' once the transfer is finished.
+*/
+int fetchEngineSubmit(FetchEngine *engine, const char *url, void *userdata)
+{
+    return fetchEngineSubmitIf(engine, url, NULL, NULL, userdata);
+}
+
+// Set the conditional request headers of a transfer, none if both validators are NULL; returns -1 if out of memory
+static int setValidators(Transfer *t, const char *etag, const char *lastModified)
+{
+    struct curl_slist *headers = NULL;
+    char line[1024];
+    if (etag != NULL)
+    {
+        snprintf(line, sizeof(line), "If-None-Match: %s", etag);
+        if ((headers = curl_slist_append(headers, line)) == NULL)
+            return -1;
+    }
+    if (lastModified != NULL)
+    {
+        snprintf(line, sizeof(line), "If-Modified-Since: %s", lastModified);
+        struct curl_slist *more = curl_slist_append(headers, line);
+        if (more == NULL)
+        {
+            curl_slist_free_all(headers);
+            return -1;
+        }
+        headers = more;
+    }
+    if (headers != NULL || t->headers != NULL)
+        curl_easy_setopt(t->easy, CURLOPT_HTTPHEADER, headers);
+    curl_slist_free_all(t->headers);
+    t->headers = headers;
+    return 0;
+}
+
+/*
+    Queue a URL for fetching unless it is unchanged.
+
+    Preconditions:  As for fetchEngineSubmit(); 'etag' and 'lastModified' are the ETag and Last-Modified headers of
+                    the copy fetched before, or NULL.
+    Postcondition:  As for fetchEngineSubmit(). The request carries If-None-Match and If-Modified-Since for the
+                    validators given, so a server that finds the page unchanged answers 304 without a body.
+*/
+int fetchEngineSubmitIf(FetchEngine *engine, const char *url, const char *etag, const char *lastModified,
+                        void *userdata)
+{
+    Transfer *t = engine->freeList;               // Reuse a finished transfer if possible
+    if (t != NULL)
+    {
+        engine->freeList = t->next;
+    }
+    else
+    {
+        t = calloc(1, sizeof(Transfer));
+        if (t == NULL)
+            return -1;
+        t->easy = curl_easy_init();
+        if (t->easy == NULL)
+        {
+            free(t);
+            return -1;
+        }
+        setupTransfer(engine, t);
+    }
+
+    t->engine = engine;
+    t->response.html = NULL;                      // The body buffer is taken from the pool by the first chunk
+    t->response.size = 0;
+    t->body.response = &t->response;
+    t->body.capacity = 0;
+    t->body.pool = &engine->buffers;
+    t->body.easy = t->easy;
+    t->userdata = userdata;
+    t->attempts = 0;
+    t->waiting = 0;
+    t->retryAt = 0;
+    t->prev = NULL;
+    t->next = NULL;
+
+    size_t len = strlen(url) + 1;
+    if (len > t->urlCapacity)                     // Keep the old copy's buffer when the URL fits
+    {
+        size_t capacity = len > MIN_URL_CAPACITY ? len : MIN_URL_CAPACITY;
+        char *copy = malloc(capacity);
+        if (copy != NULL)
+        {
+            free(t->url);
+            t->url = copy;
+            t->urlCapacity = capacity;
+            engine->urlStats.mallocs++;
+            engine->urlStats.bytes += capacity;
+        }
+    }
+    else
+    {
+        engine->urlStats.reuses++;
+    }
+
+    int found = RESOLVER_FAILED;
+    int ready = len <= t->urlCapacity && setValidators(t, etag, lastModified) == 0;
+    if (ready)
+    {
+        memcpy(t->url, url, len);
+        found = lookupHost(engine, t);            // Addresses of the host, if the engine has a resolver
+    }
+
+    if (!ready || (found == RESOLVER_FOUND && startTransfer(engine, t) != 0))
+    {
+        t->next = engine->freeList;
+        engine->freeList = t;
+        return -1;
+    }
+
+    if (found != RESOLVER_FOUND)                  // Started by resumeWaiting() once the host is looked up
+    {
+        t->waiting = 1;
+        engine->waiting++;
+        if (found == RESOLVER_PENDING)
+            engine->net.resolveWaits++;
+        else
+            engine->recheck = 1;                  // Reported as failed by the next fetchEngineRun()
+    }
+
+    t->next = engine->active;                     // Track it on the active list
+    if (engine->active != NULL)
+        engine->active->prev = t;
+    engine->active = t;
+    engine->inFlight++;
+    return 0;
+}
+
+// Take a transfer off the active list, hand its outcome to the callback and keep it for reuse
+static void finishTransfer(FetchEngine *engine, Transfer *t, CURLcode res, long status)
+{
+    if (res != CURLE_OK)                          // Give the callback an empty response on failure
+    {
+        bufferPoolPut(&engine->buffers, t->response.html, t->body.capacity);
+        t->response.html = NULL;
+        t->response.size = 0;
+    }
+    else if (engine->config.onChunk == NULL && t->response.html == NULL)
+    {
+        t->response.html = bufferPoolGet(&engine->buffers, 1, &t->body.capacity);   // Empty body
+        if (t->response.html != NULL)
+            t->response.html[0] = '\0';
+    }
+
+    if (t->prev != NULL)                          // Unlink from the active list
+        t->prev->next = t->next;
+    else
+        engine->active = t->next;
+    if (t->next != NULL)
+        t->next->prev = t->prev;
+    engine->inFlight--;
+    engine->net.transfers++;
+    engine->config.onDone(engine, t->url, &t->response, res, status, t->userdata);
+
+    bufferPoolPut(&engine->buffers, t->response.html, t->body.capacity);   // Ready for the next body
+    t->response.html = NULL;
+    t->next = engine->freeList;                   // Keep the easy handle for the next URL
+    engine->freeList = t;
+}
+
+// Record the stages of a finished transfer in the metrics, and trace them
+static void recordStages(CURL *easy, const char *url, const Transfer *t, long connects)
+{
+    curl_off_t lookup = 0, connect = 0, handshake = 0, pretransfer = 0, firstByte = 0, total = 0;
+    curl_easy_getinfo(easy, CURLINFO_NAMELOOKUP_TIME_T, &lookup);
+    curl_easy_getinfo(easy, CURLINFO_CONNECT_TIME_T, &connect);
+    curl_easy_getinfo(easy, CURLINFO_APPCONNECT_TIME_T, &handshake);
+    curl_easy_getinfo(easy, CURLINFO_PRETRANSFER_TIME_T, &pretransfer);
+    curl_easy_getinfo(easy, CURLINFO_STARTTRANSFER_TIME_T, &firstByte);
+    curl_easy_getinfo(easy, CURLINFO_TOTAL_TIME_T, &total);
+
+    // curl's timers are microseconds since the transfer started, each stage ends where the next begins
+    uint64_t end = metricsNow();
+    uint64_t start = end - (uint64_t)total * 1000;
+    uint64_t id = (uint64_t)(uintptr_t)t;       // Unique among the transfers in flight
+    metricsRecord(METRIC_FETCH, (uint64_t)total * 1000);
+    metricsTrace("fetch", url, start, (uint64_t)total * 1000, id);
+    if (connects > 0)                           // A reused connection has no lookup, connect or handshake
+    {
+        metricsRecord(METRIC_DNS, (uint64_t)lookup * 1000);
+        metricsTrace("dns", NULL, start, (uint64_t)lookup * 1000, id);
+        if (connect >= lookup)
+        {
+            metricsRecord(METRIC_CONNECT, (uint64_t)(connect - lookup) * 1000);
+            metricsTrace("connect", NULL, start + (uint64_t)lookup * 1000, (uint64_t)(connect - lookup) * 1000, id);
+        }
+        if (handshake > 0 && handshake >= connect)
+        {
+            metricsRecord(METRIC_TLS, (uint64_t)(handshake - connect) * 1000);
+            metricsTrace("tls", NULL, start + (uint64_t)connect * 1000, (uint64_t)(handshake - connect) * 1000, id);
+        }
+    }
+    if (firstByte > 0 && firstByte >= pretransfer && total >= firstByte)   // A response arrived
+    {
+        metricsRecord(METRIC_TTFB, (uint64_t)(firstByte - pretransfer) * 1000);
+        metricsRecord(METRIC_DOWNLOAD, (uint64_t)(total - firstByte) * 1000);
+        metricsTrace("ttfb", NULL, start + (uint64_t)pretransfer * 1000, (uint64_t)(firstByte - pretransfer) * 1000, id);
+        metricsTrace("download", NULL, start + (uint64_t)firstByte * 1000, (uint64_t)(total - firstByte) * 1000, id);
+    }
+}
+
+/*
+    Set a failed attempt of a transfer aside until its retry is due, or start it again at once without a wait.
+    Returns 0, or -1 if it could not be started again.
+*/
+static int retryLater(FetchEngine *engine, Transfer *t, CURL *easy)
+{
+    long waitMs = backoffMs(engine->config.retryBaseMs, engine->config.retryMaxMs, t->attempts, &engine->seed);
+    curl_off_t retryAfter = 0;                                  // Seconds the server asked for, 0 if it did not
+    curl_easy_getinfo(easy, CURLINFO_RETRY_AFTER, &retryAfter);
+    if (retryAfter > 0 && engine->config.retryBaseMs > 0)
+    {
+        long askedMs = retryAfter < engine->config.retryMaxMs / 1000 ? (long)retryAfter * 1000 : engine->config.retryMaxMs;
+        if (askedMs > waitMs)
+            waitMs = askedMs;
+    }
+    if (waitMs <= 0)
+        return startTransfer(engine, t);
+
+    t->retryAt = nowMs() + waitMs;
+    if (engine->delayed++ == 0 || t->retryAt < engine->nextRetry)
+        engine->nextRetry = t->retryAt;
+    return 0;
+}
+
+// Drain curl's message queue: set failed attempts aside to retry, hand the finished transfers to the callback
+static int collectFinished(FetchEngine *engine)
+{
+    int finished = 0;
+    int pending;
+    CURLMsg *msg;
+
+    while ((msg = curl_multi_info_read(engine->multi, &pending)) != NULL)
+    {
+        if (msg->msg != CURLMSG_DONE)
+            continue;
+
+        CURL *easy = msg->easy_handle;
+        CURLcode res = msg->data.result;
+        Transfer *t = NULL;
+        curl_easy_getinfo(easy, CURLINFO_PRIVATE, (char **)&t);
+        curl_multi_remove_handle(engine->multi, easy);
+
+        long status = 0, connects = 0;
+        curl_easy_getinfo(easy, CURLINFO_RESPONSE_CODE, &status);
+        if (fetchRetryable(res, status))
+        {
+            if (res != CURLE_OK)
+                fprintf(stderr, "GET request failed: %s\n", curl_easy_strerror(res));   // Print error message
+            if (t->attempts < engine->config.retries)
+            {
+                fprintf(stderr, "Retrying GET request for URL: %s\n", t->url);
+                metricsCount(METRIC_RETRIES, 1);
+                if (engine->config.onRetry != NULL)
+                    engine->config.onRetry(engine, t->url, res, status, t->userdata);
+                t->response.size = 0;                                                // Drop any partial body
+                if (engine->config.onChunk != NULL)
+                    engine->config.onChunk(engine, NULL, 0, t->userdata);
+                if (retryLater(engine, t, easy) == 0)
+                    continue;
+            }
+        }
+
+        curl_off_t lookup = 0, connect = 0, handshake = 0;
+        curl_easy_getinfo(easy, CURLINFO_NUM_CONNECTS, &connects);
+        curl_easy_getinfo(easy, CURLINFO_NAMELOOKUP_TIME_T, &lookup);
+        curl_easy_getinfo(easy, CURLINFO_CONNECT_TIME_T, &connect);
+        curl_easy_getinfo(easy, CURLINFO_APPCONNECT_TIME_T, &handshake);
+        engine->net.newConnections += connects;
+        engine->net.lookupMicros += lookup;
+        if (connects > 0)
+            engine->net.connectMicros += (handshake > connect ? handshake : connect) - lookup;
+        if (metricsEnabled())
+        {
+            metricsCount(METRIC_CONNECTIONS, connects);
+            recordStages(easy, t->url, t, connects);
+        }
+
+        finishTransfer(engine, t, res, status);
+        finished++;
+    }
+    return finished;
+}
+
+// Look the hosts of waiting transfers up again: start the ones resolved, finish the ones that do not resolve
+static int resumeWaiting(FetchEngine *engine)
+{
+    int finished = 0;
+    engine->recheck = 0;
+    for (Transfer *t = engine->active, *next; t != NULL && engine->waiting > 0; t = next)
+    {
+        next = t->next;
+        if (!t->waiting)
+            continue;
+        int found = lookupHost(engine, t);
+        if (found == RESOLVER_PENDING)
+            continue;
+
+        t->waiting = 0;
+        engine->waiting--;
+        if (found == RESOLVER_FOUND && startTransfer(engine, t) == 0)
+            continue;
+        if (found == RESOLVER_FAILED)
+            engine->net.resolveFailures++;
+        finishTransfer(engine, t, found == RESOLVER_FAILED ? CURLE_COULDNT_RESOLVE_HOST : CURLE_FAILED_INIT, 0);
+        finished++;
+    }
+    return finished;
+}
+
+// Start the transfers whose retry is due and work out when the next one is
+static int startRetries(FetchEngine *engine)
+{
+    int finished = 0;
+    long long now = nowMs();
+    engine->nextRetry = 0;
+    for (Transfer *t = engine->active, *next; t != NULL; t = next)
+    {
+        next = t->next;
+        if (t->retryAt == 0)
+            continue;
+        if (t->retryAt > now)
+        {
+            if (engine->nextRetry == 0 || t->retryAt < engine->nextRetry)
+                engine->nextRetry = t->retryAt;
+            continue;
+        }
+
+        t->retryAt = 0;
+        engine->delayed--;
+        if (startTransfer(engine, t) != 0)
+        {
+            finishTransfer(engine, t, CURLE_FAILED_INIT, 0);
+            finished++;
+        }
+    }
+    return finished;
+}
+
+/*
+    Drive the engine once.
+
+    Description:
+    Waits up to 'timeoutMs' milliseconds for socket activity, curl's own timer, the resolver or the next retry,
+    lets curl progress every ready transfer, starts the transfers whose host has been looked up or whose retry
+    is due and invokes the completion callback for the ones that finished.
+
+    Preconditions:  'engine' was returned by fetchEngineCreate().
+    Postcondition:  Returns the number of completion callbacks made, or -1 on a polling error.
+*/
+int fetchEngineRun(FetchEngine *engine, int timeoutMs)
+{
+    int running = 0;
+    int wait = timeoutMs;
+
+    if (engine->recheck)                          // Waiting transfers to resume or fail right away
+        wait = 0;
+    if (engine->delayed > 0)                      // Do not sleep past the next retry
+    {
+        long long left = engine->nextRetry - nowMs();
+        if (left < 0)
+            left = 0;
+        if (left < wait)
+            wait = (int)left;
+    }
+
+#ifdef __linux__
+    struct epoll_event events[MAX_EVENTS];
+    if (engine->timerDeadline >= 0)               // Do not sleep past curl's timer
+    {
+        long long left = engine->timerDeadline - nowMs();
+        if (left < 0)
+            left = 0;
+        if (left < wait)
+            wait = (int)left;
+    }
+
+    int n = epoll_wait(engine->epfd, events, MAX_EVENTS, wait);
+    if (n < 0)
+    {
+        if (errno != EINTR)
+            return -1;
+        n = 0;                                    // Interrupted by a signal, just run the timer
+    }
+
+    for (int i = 0; i < n; i++)                   // Let curl handle every ready socket
+    {
+        if (events[i].data.fd == engine->wake[0]) // The resolver looked up a host transfers wait for
+        {
+            char drain[64];
+            while (read(engine->wake[0], drain, sizeof(drain)) > 0)
+                ;
+            engine->recheck = 1;
+            continue;
+        }
+        int flags = 0;
+        if (events[i].events & EPOLLIN)
+            flags |= CURL_CSELECT_IN;
+        if (events[i].events & EPOLLOUT)
+            flags |= CURL_CSELECT_OUT;
+        if (events[i].events & (EPOLLERR | EPOLLHUP))
+            flags |= CURL_CSELECT_ERR;
+        curl_multi_socket_action(engine->multi, events[i].data.fd, flags, &running);
+    }
+
+    if (engine->timerDeadline >= 0 && nowMs() >= engine->timerDeadline)
+    {
+        engine->timerDeadline = -1;               // curl sets a new deadline if it needs one
+        curl_multi_socket_action(engine->multi, CURL_SOCKET_TIMEOUT, 0, &running);
+    }
+#else
+    // Portable fallback: let curl poll its own sockets and the wake pipe
+    struct curl_waitfd wake = { engine->wake[0], CURL_WAIT_POLLIN, 0 };
+    if (curl_multi_poll(engine->multi, &wake, wake.fd >= 0 ? 1 : 0, wait, NULL) != CURLM_OK)
+        return -1;
+    if (wake.revents != 0)
+    {
+        char drain[64];
+        while (read(engine->wake[0], drain, sizeof(drain)) > 0)
+            ;
+        engine->recheck = 1;
+    }
+    curl_multi_perform(engine->multi, &running);
+#endif
+
+    int finished = engine->recheck ? resumeWaiting(engine) : 0;
+    if (engine->delayed > 0 && nowMs() >= engine->nextRetry)
+        finished += startRetries(engine);
+    return finished + collectFinished(engine);
+}
+
+// Number of transfers the engine currently owns
+int fetchEngineInFlight(const FetchEngine *engine)
+{
+    return engine->inFlight;
+}
+
+// 1 if another transfer can be submitted without exceeding maxInFlight
+int fetchEngineHasCapacity(const FetchEngine *engine)
+{
+    return engine->inFlight < engine->config.maxInFlight;
+}
+
+// Engine-wide pointer given in FetchConfig.context
+void *fetchEngineContext(const FetchEngine *engine)
+{
+    return engine->config.context;
+}
+
+/*
+    Report the allocations the engine made for bodies and URLs.
+
+    Preconditions:  'engine' was returned by fetchEngineCreate().
+    Postcondition:  'stats' holds the malloc() calls and bytes of the body buffers and URL copies so far,
+                    and the number of times a buffer or copy was reused instead. curl's own allocations
+                    are not included.
+*/
+void fetchEngineAllocStats(const FetchEngine *engine, AllocStats *stats)
+{
+    stats->mallocs = engine->buffers.stats.mallocs + engine->urlStats.mallocs;
+    stats->reuses = engine->buffers.stats.reuses + engine->urlStats.reuses;
+    stats->bytes = engine->buffers.stats.bytes + engine->urlStats.bytes;
+}
+
+// Name lookup and connection counters of the engine so far
+void fetchEngineNetStats(const FetchEngine *engine, FetchNetStats *stats)
+{
+    *stats = engine->net;
+}
+
+/*
+    Destroy a fetch engine.
+
+    Preconditions:  'engine' was returned by fetchEngineCreate() or is NULL.
+    Postcondition:  Every transfer still in flight is aborted without a callback and all memory is released.
+*/
+void fetchEngineDestroy(FetchEngine *engine)
+{
+    if (engine == NULL)
+        return;
+
+    // Abort transfers still owned by the multi handle
+    while (engine->active != NULL)
+    {
+        Transfer *t = engine->active;
+        engine->active = t->next;
+        if (!t->waiting && t->retryAt == 0)       // Not handed to curl while waiting
+            curl_multi_remove_handle(engine->multi, t->easy);
+        bufferPoolPut(&engine->buffers, t->response.html, t->body.capacity);
+        t->response.html = NULL;
+        t->next = engine->freeList;
+        engine->freeList = t;
+    }
+
+    while (engine->freeList != NULL)
+    {
+        Transfer *t = engine->freeList;
+        engine->freeList = t->next;
+        curl_easy_cleanup(t->easy);
+        curl_slist_free_all(t->resolve);
+        curl_slist_free_all(t->headers);
+        free(t->url);
+        free(t);
+    }
+
+    if (engine->wake[0] >= 0)
+    {
+        if (engine->waiter >= 0)
+            resolverUnwatch(engine->config.resolver, engine->waiter);
+        close(engine->wake[0]);
+        close(engine->wake[1]);
+    }
+    bufferPoolDestroy(&engine->buffers);
+    curl_multi_cleanup(engine->multi);
+#ifdef __linux__
+    if (engine->epfd >= 0)
+        close(engine->epfd);
+#endif
+    free(engine);
+}
+
+/*
+    Curl callback function for writing HTML content.
+
+    Description:
+    This function is called by libcurl when HTML content is received during a HTTP request. It makes room for the
+    received data, copies it, and updates the size of the content. The first chunk sizes the buffer from the
+    Content-Length of the response when the server sent one; later growth at least doubles the buffer, so a body
+    is copied a handful of times at most instead of once per chunk.
+
+    Preconditions:
+    'contents' must point to the received data.
+    'size' and 'nmemb' specify the size of each data element and the number of elements.
+    'userp' must point to a valid Body whose response holds the HTML content and its size.
+
+    Postcondition:
+    The buffer holds the received data after the content so far, the size of the content is updated accordingly
+    and the content is null-terminated. The function returns the size of the received data.
+*/
+static size_t WriteHTMLCallback(void *contents, size_t size, size_t nmemb, void *userp)
+{
+    size_t realsize = size * nmemb;                                        // Calculate the real size of the data
+    Body *body = (Body *)userp;                                            // Cast user pointer to the body being buffered
+    struct CURLResponse *mem = body->response;                             // Response holding the HTML content
+    size_t need = mem->size + realsize + 1;                                // Room for the content and its terminator
+
+    if (need > body->capacity)                                             // If the buffer is too small
+    {
+        curl_off_t length = -1;                                            // Announced size of the whole body
+        if (mem->html == NULL && curl_easy_getinfo(body->easy, CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, &length) == CURLE_OK &&
+            length > 0 && length < BUFFER_MAX_SIZE && (size_t)length + 1 > need)
+        {
+            need = (size_t)length + 1;                                     // Size the buffer for the whole body at once
+        }
+
+        char *ptr;
+        size_t capacity = body->capacity;
+        if (body->pool != NULL)
+        {
+            ptr = bufferPoolGrow(body->pool, mem->html, mem->size, need, &capacity);
+        }
+        else
+        {
+            capacity = capacity * 2 > need ? capacity * 2 : need;          // Grow geometrically
+            ptr = realloc(mem->html, capacity);
+        }
+
+        if (!ptr)                                                          // If allocation fails
+        {
+            printf("Not enough memory available (realloc returned NULL)\n");   // Print error message
+            return 0;                                                      // Return 0 indicating failure
+        }
+        mem->html = ptr;                                                   // Update HTML pointer to the bigger buffer
+        body->capacity = capacity;
+    }
+
+    memcpy(&(mem->html[mem->size]), contents, realsize);                   // Copy contents to HTML memory
+    mem->size += realsize;                                                 // Update the size of HTML content
+    mem->html[mem->size] = 0;                                              // Null-terminate the HTML content
+
+    return realsize;                                                       // Return the real size of the data
+}
+
+/*
+    Curl callback function for streaming transfers.
+
+    Description:
+    Hands every chunk of a 2xx answer straight to the engine's onChunk callback and only counts its size. The body
+    of any other answer, an error page, is counted but not passed on.
+
+    Preconditions:
+    'userp' must point to the Transfer receiving the data.
+
+    Postcondition:
+    The chunk has been passed on; the function returns the size of the received data.
+*/
+static size_t StreamCallback(void *contents, size_t size, size_t nmemb, void *userp)
+{
+    size_t realsize = size * nmemb;                                        // Calculate the real size of the data
+    Transfer *t = (Transfer *)userp;                                       // Transfer receiving the data
+
+    long status = 0;
+    curl_easy_getinfo(t->easy, CURLINFO_RESPONSE_CODE, &status);
+    if (status >= 200 && status < 300)
+        t->engine->config.onChunk(t->engine, (const char *)contents, realsize, t->userdata);
+    t->response.size += realsize;                                          // Bytes streamed so far
+    return realsize;
+}
+
+/*
+    Curl callback function for response headers.
+
+    Description:
+    Splits a header line into its name and value, without the spaces around the value and the line break, and hands
+    them to the engine's onHeader callback. The status line and the empty line ending the headers are skipped.
+
+    Preconditions:
+    'userp' must point to the Transfer receiving the headers.
+
+    Postcondition:
+    The header has been passed on; the function returns the size of the line.
+*/
+static size_t HeaderCallback(char *buffer, size_t size, size_t nitems, void *userp)
+{
+    size_t len = size * nitems;                                            // Size of the header line
+    Transfer *t = (Transfer *)userp;                                       // Transfer receiving the headers
+    const char *colon = memchr(buffer, ':', len);
+    if (colon == NULL || colon == buffer)
+        return len;                                                        // Status line or end of the headers
+
+    const char *value = colon + 1;
+    const char *end = buffer + len;
+    while (value < end && (*value == ' ' || *value == '\t'))
+        value++;
+    while (end > value && (end[-1] == '\r' || end[-1] == '\n' || end[-1] == ' ' || end[-1] == '\t'))
+        end--;
+    t->engine->config.onHeader(t->engine, buffer, (size_t)(colon - buffer), value, (size_t)(end - value), t->userdata);
+    return len;
+}
+
+/*
+    Perform a GET request to retrieve an HTML document from a specified URL.
+
+    Description:
+    This function sends a GET request to the provided URL using libcurl and retrieves the HTML content of the webpage.
+    The retrieved HTML content is stored in a struct CURLResponse. This is the blocking single-transfer path; the
+    crawler itself uses the fetch engine above. A failed attempt is retried up to twice, after the same growing,
+    jittered backoff as the engine's, which here the calling thread sleeps through.
+
+    Preconditions:
+    'curl_handle' must point to a valid CURL handle initialized by curl_easy_init().
+    'url' must point to a valid null-terminated string containing the URL to retrieve.
+
+    Postcondition:
+    The function returns a struct CURLResponse containing the HTML content retrieved from the URL, allocated with
+    malloc(); the caller frees it. If the request fails, an error message is printed and html is NULL.
+*/
+struct CURLResponse GetRequest(CURL *curl_handle, const char *url)
+{
+    CURLcode res;                   // Variable to store curl result
+
+    // Setup response
+    struct CURLResponse response;   // Create response structure
+    response.html = NULL;           // Allocated by the first chunk, sized from Content-Length
+    response.size = 0;              // Initialize size to 0
+    Body body = { &response, 0, NULL, curl_handle };   // Buffer state, plain malloc() so the caller can free it
+
+    int retry = 3;  // Number of retries
+    int attempts = 0;                           // Attempts made so far
+    uint64_t seed = (uint64_t)nowMs() | 1;      // Jitter of the waits between attempts
+
+    // Set timeout options
+    curl_easy_setopt(curl_handle, CURLOPT_TIMEOUT, 30L);        // Maximum time allowed for the entire request (in seconds)
+    curl_easy_setopt(curl_handle, CURLOPT_CONNECTTIMEOUT, 10L); // Maximum time allowed for connection establishment (in seconds)
+    curl_easy_setopt(curl_handle, CURLOPT_NOSIGNAL, 1L);        // Required when curl is used from several threads
+
+    do {
+    // Initialize URL to GET
+    curl_easy_setopt(curl_handle, CURLOPT_URL, url);
+
+    // Send data to callback
+    curl_easy_setopt(curl_handle, CURLOPT_WRITEFUNCTION, WriteHTMLCallback);
+    curl_easy_setopt(curl_handle, CURLOPT_WRITEDATA, (void *)&body);
+
+    // Set headers (mimic user)
+    curl_easy_setopt(curl_handle, CURLOPT_USERAGENT, USER_AGENT);
+
+    // Perform request
+    res = curl_easy_perform(curl_handle);   // Perform the curl request
+    attempts++;
+
+    long status = 0;
+    curl_easy_getinfo(curl_handle, CURLINFO_RESPONSE_CODE, &status);
+    if (!fetchRetryable(res, status))
+        break;
+    if (res != CURLE_OK)
+        fprintf(stderr, "GET request failed: %s\n", curl_easy_strerror(res));   // Print error message
+    retry--;
+    if (retry > 0) {
+        fprintf(stderr, "Retrying GET request for URL: %s\n", url);
+        response.size = 0;   // Drop any partial body before retrying
+        usleep((useconds_t)backoffMs(500, 30000, attempts, &seed) * 1000);   // 0.25-0.5 s, then 0.5-1 s
+    }
+    } while (retry > 0);
+
+    if (res != CURLE_OK) {
+        // Clean up and return empty response
+        free(response.html);
+        response.html = NULL;
+        response.size = 0;
+    } else if (response.html == NULL) {
+        response.html = calloc(1, 1);   // Empty body
+    }
+
+    return response;   // Return the response structure
+}
@@ -0,0 +1,124 @@
+/*
+Operating Systems Spring 2024
+Final Project
+
+Fetch engine: many concurrent HTTP transfers driven from a single thread.
+*/
+
+#ifndef FETCH_H
+#define FETCH_H
+
+#include <stddef.h>
+#include <curl/curl.h>
+
+#include "mempool.h"
+#include "resolver.h"
+
+// Struct to hold CURL response
+struct CURLResponse
+{
+    char *html;         // Pointer to HTML content
+    size_t size;        // Size of HTML content
+};
+
+// Opaque handle for one event loop (one curl multi handle)
+typedef struct FetchEngine FetchEngine;
+
+// curl state shared by every engine of a crawl: DNS cache and TLS sessions
+typedef struct FetchShare FetchShare;
+
+/*
+    Completion callback invoked on the engine's thread when a transfer is finished.
+
+    'response' holds the body on success, or html == NULL on failure. The body is only
+    borrowed: the engine takes the buffer back for the next transfer once the callback returns. Engines with an onChunk
+    callback never buffer bodies: html is always NULL and size counts the bytes streamed.
+    'result' is the curl result of the last attempt and 'status' the HTTP response code. Failed attempts
+    (curl errors and the statuses 429, 502, 503 and 504) are retried before the callback is made, after a wait
+    that grows with every attempt; a status still failing after the last attempt comes with CURLE_OK.
+    'userdata' is the per-transfer pointer given to fetchEngineSubmit().
+*/
+typedef void (*FetchDoneCallback)(FetchEngine *engine, const char *url, struct CURLResponse *response,
+                                  CURLcode result, long status, void *userdata);
+
+/*
+    Retry callback, invoked on the engine's thread for every failed attempt that is going to be retried.
+
+    'result' and 'status' are the outcome of the attempt, as for the completion callback. The next attempt starts
+    once its backoff has run out; no completion callback is made for the transfer until its last attempt.
+*/
+typedef void (*FetchRetryCallback)(FetchEngine *engine, const char *url, CURLcode result, long status, void *userdata);
+
+/*
+    Body callback for streaming engines, invoked on the engine's thread for every chunk received.
+
+    'data' holds the next 'len' bytes of the body of the transfer submitted with 'userdata'; only bodies of 2xx
+    answers are passed on, that of an error page is dropped.
+    A call with data == NULL means the transfer failed and is about to be retried from the
+    start: everything seen of that body so far must be dropped.
+*/
+typedef void (*FetchChunkCallback)(FetchEngine *engine, const char *data, size_t len, void *userdata);
+
+/*
+    Header callback, invoked on the engine's thread for every response header line "Name: value".
+
+    'name' and 'value' are not null-terminated; the value has its surrounding spaces removed. Headers of
+    an attempt that is retried are followed by a chunk callback with data == NULL, as for the body.
+*/
+typedef void (*FetchHeaderCallback)(FetchEngine *engine, const char *name, size_t nameLen,
+                                    const char *value, size_t valueLen, void *userdata);
+
+// Settings for a fetch engine
+typedef struct
+{
+    int maxInFlight;            // Maximum number of concurrent transfers
+    int maxHostConnections;     // Maximum open connections per host (0 = unlimited)
+    long timeout;               // Maximum time allowed for an entire request (in seconds)
+    long connectTimeout;        // Maximum time allowed for connection establishment (in seconds)
+    int retries;                // Number of attempts per URL before giving up
+    long retryBaseMs;           // Wait before the first retry, doubled for every later one (0 = retry at once)
+    long retryMaxMs;            // Longest wait before a retry, Retry-After included
+    long lowSpeedLimit;         // Bytes per second under which a transfer is too slow
+    long lowSpeedTime;          // Seconds a transfer may stay too slow before it is aborted (0 = never)
+    long maxRedirects;          // Redirects followed per transfer, the status is that of the last response (0 = none)
+    size_t maxPooledBytes;      // Idle response buffers kept for reuse, in bytes
+    Resolver *resolver;         // Shared DNS cache every host is looked up in first, NULL for curl's own resolver
+    FetchShare *share;          // curl DNS cache and TLS sessions shared with other engines, NULL for none
+    FetchDoneCallback onDone;   // Called for every finished URL
+    FetchChunkCallback onChunk; // Receives bodies as they arrive instead of buffering them (NULL = buffer)
+    FetchHeaderCallback onHeader;   // Receives the response headers, NULL to ignore them
+    FetchRetryCallback onRetry; // Told of every attempt that failed and is retried, NULL to ignore them
+    void *context;              // Engine-wide pointer, see fetchEngineContext()
+} FetchConfig;
+
+// Counters of an engine's name lookups and connections
+typedef struct
+{
+    long transfers;             // Transfers finished
+    long newConnections;        // Connections opened; the other transfers reused one
+    long resolveWaits;          // Transfers that waited for the resolver
+    long resolveFailures;       // Transfers given up because their host did not resolve
+    long long lookupMicros;     // Time curl spent resolving before connecting
+    long long connectMicros;    // Time spent opening connections, TLS handshakes included
+} FetchNetStats;
+
+// Function prototypes
+FetchShare *fetchShareCreate(void);
+void fetchShareDestroy(FetchShare *share);
+void fetchConfigDefaults(FetchConfig *config);
+int fetchRetryable(CURLcode res, long status);
+FetchEngine *fetchEngineCreate(const FetchConfig *config);
+int fetchEngineSubmit(FetchEngine *engine, const char *url, void *userdata);
+int fetchEngineSubmitIf(FetchEngine *engine, const char *url, const char *etag, const char *lastModified,
+                        void *userdata);
+int fetchEngineRun(FetchEngine *engine, int timeoutMs);
+int fetchEngineInFlight(const FetchEngine *engine);
+int fetchEngineHasCapacity(const FetchEngine *engine);
+void *fetchEngineContext(const FetchEngine *engine);
+void fetchEngineAllocStats(const FetchEngine *engine, AllocStats *stats);
+void fetchEngineNetStats(const FetchEngine *engine, FetchNetStats *stats);
+void fetchEngineDestroy(FetchEngine *engine);
+
+struct CURLResponse GetRequest(CURL *curl_handle, const char *url);
+
+#endif
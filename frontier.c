@@ -0,0 +1,625 @@
+/*
+Operating Systems Spring 2024
+Final Project
+
+URL frontier: unbounded lock-free multi-producer/multi-consumer queue of URLs, one per link depth.
+
+Every URL carries its link depth. The frontier keeps one queue per depth level, so all URLs of
+a level can be expanded in parallel and a pop always serves the shallowest non-empty level,
+which gives breadth-first order. URLs deeper than the depth limit are dropped by the push
+itself and never take up memory.
+
+Each level's queue is a linked list of fixed-size segments. Producers and consumers claim slots of a
+segment with a fetch-and-add on its enqueue/dequeue index, so neither side takes a lock. The
+URL strings are copied into a byte area inside the segment, and a slot only holds the offset
+and length of its string, so an entry costs no allocation of its own. When a segment runs out
+of slots or bytes a new one is appended.
+
+A consumer that claims a slot before its producer has filled it marks the slot as taken; the
+producer then retries with a later slot. Segments that every consumer has moved past are
+retired and freed two epochs later, once no thread can still be reading them.
+
+A frontier created with a URL table (see urltable.h) interns every URL it is given and its slots
+hold the 32-bit ID instead, so its segments have no byte area at all. The table remembers every
+URL ever pushed, so a URL is queued only the first time; later pushes of it cost no memory.
+
+The queues are split into lanes. Lane 0 is shared and takes the URLs pushed from outside the
+workers (seeds, the journal, other shards); every worker attaches a lane of its own and pushes the
+links it finds there, so workers do not all contend on the same queue ends. A pop serves the
+shallowest level over all lanes: it tries the worker's own lane first and otherwise steals from the
+others, so a worker never runs dry while another worker's lane holds URLs, and the crawl stays
+breadth-first. The lanes are FIFO on both sides, stealing included, for the same reason.
+
+The frontier also counts the URLs outstanding: queued, or taken and not yet reported finished
+with frontierDone(). The count goes up before a URL becomes visible to any pop and down only
+after everything the URL led to has been pushed, so it reaches zero exactly once the crawl has
+no work left anywhere, which is what the workers wait for before they stop.
+*/
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "frontier.h"
+#include "urltable.h"
+
+// Slots per segment
+#define SEGMENT_SLOTS 1024
+
+// Bytes of URL storage per segment
+#define SEGMENT_BYTES (64 * 1024)
+
+// Slot states; a filled slot holds encodeSlot(offset, length), or encodeSlot(id, 0) with a URL table
+#define SLOT_EMPTY 0
+#define SLOT_TAKEN UINT64_MAX
+
+// One segment of the queue
+typedef struct Segment
+{
+    _Alignas(64) atomic_ulong enqIdx;           // Next slot handed to a producer
+    _Alignas(64) atomic_ulong deqIdx;           // Next slot handed to a consumer
+    _Alignas(64) atomic_ulong bytesUsed;        // Bytes of 'data' reserved so far
+    _Atomic(struct Segment *) next;             // Segment appended after this one
+    struct Segment *retired;                    // Next entry on a retire list
+    _Alignas(64) _Atomic uint64_t slots[SEGMENT_SLOTS];
+    char data[];                                // URL strings, not null-terminated; none with a URL table
+} Segment;
+
+// Queue of a single depth level
+typedef struct
+{
+    _Alignas(64) _Atomic(Segment *) head;       // Segment consumers take from
+    _Alignas(64) _Atomic(Segment *) tail;       // Segment producers add to
+    _Alignas(64) atomic_long size;              // Number of URLs queued
+    _Alignas(64) atomic_ulong epoch;            // Reclamation epoch
+    atomic_long active[2];                      // Threads inside an operation, by epoch parity
+    _Atomic(Segment *) limbo[3];                // Retired segments, by epoch modulo 3
+    size_t dataBytes;                           // Size of the byte area of its segments
+} LevelQueue;
+
+// Queues of one lane, one per depth level
+typedef struct
+{
+    _Atomic(LevelQueue *) levels;               // One queue per depth 0..maxDepth, NULL until the lane is created
+    atomic_int owned;                           // 1 while a worker is attached to it
+} Lane;
+
+struct Frontier
+{
+    int maxDepth;                               // Deepest level kept
+    UrlTable *urls;                             // Table the URLs are interned in, NULL to copy them
+    _Alignas(64) atomic_long size;              // URLs queued over all levels and lanes
+    _Alignas(64) atomic_long pending;           // URLs queued or taken and not finished yet
+    _Alignas(64) atomic_int laneCount;          // Lanes created so far, lane 0 included
+    atomic_long steals;                         // URLs a pop took from another worker's lane
+    Lane lanes[FRONTIER_MAX_LANES];
+};
+
+static uint64_t encodeSlot(unsigned long offset, size_t length)
+{
+    return ((uint64_t)offset << 32) | ((uint64_t)length << 1) | 1;
+}
+
+static Segment *newSegment(size_t dataBytes)
+{
+    Segment *seg = aligned_alloc(64, (sizeof(Segment) + dataBytes + 63) / 64 * 64);
+    if (seg == NULL)
+        return NULL;
+    atomic_init(&seg->enqIdx, 0);
+    atomic_init(&seg->deqIdx, 0);
+    atomic_init(&seg->bytesUsed, 0);
+    atomic_init(&seg->next, NULL);
+    seg->retired = NULL;
+    for (int i = 0; i < SEGMENT_SLOTS; i++)
+        atomic_init(&seg->slots[i], SLOT_EMPTY);
+    return seg;
+}
+
+// Register the calling thread in the current epoch
+static unsigned long epochEnter(LevelQueue *queue)
+{
+    while (1)
+    {
+        unsigned long e = atomic_load(&queue->epoch);
+        atomic_fetch_add(&queue->active[e & 1], 1);
+        if (atomic_load(&queue->epoch) == e)             // The epoch did not move meanwhile
+            return e;
+        atomic_fetch_sub(&queue->active[e & 1], 1);
+    }
+}
+
+static void epochExit(LevelQueue *queue, unsigned long e)
+{
+    atomic_fetch_sub(&queue->active[e & 1], 1);
+}
+
+static void freeList(Segment *seg)
+{
+    while (seg != NULL)
+    {
+        Segment *next = seg->retired;
+        free(seg);
+        seg = next;
+    }
+}
+
+/*
+    Advance the epoch if every thread of the previous epoch has left.
+
+    A segment retired in epoch e was unlinked before e began for any thread entering in e + 1,
+    so once the epoch moves from e + 1 to e + 2 nobody can hold a pointer to it.
+*/
+static void epochAdvance(LevelQueue *queue)
+{
+    unsigned long e = atomic_load(&queue->epoch);
+    if (atomic_load(&queue->active[(e + 1) & 1]) != 0)  // Threads of epoch e - 1 still inside
+        return;
+    if (!atomic_compare_exchange_strong(&queue->epoch, &e, e + 1))
+        return;
+    freeList(atomic_exchange(&queue->limbo[(e + 2) % 3], NULL));   // Retired in epoch e - 1
+}
+
+// Queue an unlinked segment for freeing
+static void retire(LevelQueue *queue, Segment *seg)
+{
+    unsigned long e = atomic_load(&queue->epoch);
+    Segment *top = atomic_load(&queue->limbo[e % 3]);
+    do
+    {
+        seg->retired = top;
+    } while (!atomic_compare_exchange_weak(&queue->limbo[e % 3], &top, seg));
+    epochAdvance(queue);
+}
+
+// Set up an empty level queue
+static int queueInit(LevelQueue *queue, size_t dataBytes)
+{
+    Segment *seg = newSegment(dataBytes);
+    if (seg == NULL)
+        return -1;
+    atomic_init(&queue->head, seg);
+    atomic_init(&queue->tail, seg);
+    atomic_init(&queue->size, 0);
+    atomic_init(&queue->epoch, 0);
+    atomic_init(&queue->active[0], 0);
+    atomic_init(&queue->active[1], 0);
+    for (int i = 0; i < 3; i++)
+        atomic_init(&queue->limbo[i], NULL);
+    queue->dataBytes = dataBytes;
+    return 0;
+}
+
+// Free every segment of a level queue
+static void queueFree(LevelQueue *queue)
+{
+    Segment *seg = atomic_load(&queue->head);
+    while (seg != NULL)
+    {
+        Segment *next = atomic_load(&seg->next);
+        free(seg);
+        seg = next;
+    }
+    for (int i = 0; i < 3; i++)
+        freeList(atomic_load(&queue->limbo[i]));
+}
+
+// Add a URL at the back of one level queue; with 'url' NULL the slot holds the ID 'id' instead
+static int queuePush(LevelQueue *queue, const char *url, size_t len, uint32_t id)
+{
+    unsigned long e = epochEnter(queue);
+    while (1)
+    {
+        Segment *seg = atomic_load(&queue->tail);
+        unsigned long idx = atomic_fetch_add(&seg->enqIdx, 1);     // Claim a slot
+
+        if (idx < SEGMENT_SLOTS)
+        {
+            uint64_t value = encodeSlot(id, 0);
+            if (url != NULL)
+            {
+                unsigned long offset = atomic_fetch_add(&seg->bytesUsed, len);
+                if (offset + len > queue->dataBytes)               // No room for the string
+                {
+                    atomic_store(&seg->enqIdx, SEGMENT_SLOTS);     // Close the segment
+                    continue;
+                }
+                memcpy(seg->data + offset, url, len);
+                value = encodeSlot(offset, len);
+            }
+            uint64_t expected = SLOT_EMPTY;
+            if (atomic_compare_exchange_strong(&seg->slots[idx], &expected, value))
+            {
+                atomic_fetch_add(&queue->size, 1);
+                epochExit(queue, e);
+                return 0;
+            }
+            continue;                                              // A consumer gave up on this slot
+        }
+
+        // Segment full: append a new one holding the URL, or help whoever did
+        if (seg != atomic_load(&queue->tail))
+            continue;
+        Segment *next = atomic_load(&seg->next);
+        if (next == NULL)
+        {
+            Segment *fresh = newSegment(queue->dataBytes);
+            if (fresh == NULL)
+            {
+                epochExit(queue, e);
+                return -1;
+            }
+            if (url != NULL)
+            {
+                memcpy(fresh->data, url, len);
+                atomic_store(&fresh->bytesUsed, len);
+                atomic_store(&fresh->slots[0], encodeSlot(0, len));
+            }
+            else
+            {
+                atomic_store(&fresh->slots[0], encodeSlot(id, 0));
+            }
+            atomic_store(&fresh->enqIdx, 1);
+
+            if (atomic_compare_exchange_strong(&seg->next, &next, fresh))
+            {
+                atomic_compare_exchange_strong(&queue->tail, &seg, fresh);
+                atomic_fetch_add(&queue->size, 1);
+                epochExit(queue, e);
+                return 0;
+            }
+            free(fresh);                                           // Another producer won; 'next' is its segment
+        }
+        atomic_compare_exchange_strong(&queue->tail, &seg, next);
+    }
+}
+
+// Take the URL at the front of one level queue, 1 if there was one; an interned URL only sets 'id'
+static int queuePop(LevelQueue *queue, char *url, size_t size, uint32_t *id)
+{
+    unsigned long e = epochEnter(queue);
+    while (1)
+    {
+        Segment *seg = atomic_load(&queue->head);
+        if (atomic_load(&seg->deqIdx) >= atomic_load(&seg->enqIdx) && atomic_load(&seg->next) == NULL)
+            break;                                                 // Nothing queued
+
+        unsigned long idx = atomic_fetch_add(&seg->deqIdx, 1);     // Claim a slot
+        if (idx >= SEGMENT_SLOTS)
+        {
+            Segment *next = atomic_load(&seg->next);
+            if (next == NULL)
+                break;
+            if (atomic_compare_exchange_strong(&queue->head, &seg, next))
+            {
+                Segment *expected = seg;                           // Never leave the tail behind the head
+                atomic_compare_exchange_strong(&queue->tail, &expected, next);
+                retire(queue, seg);
+            }
+            continue;
+        }
+
+        uint64_t slot = atomic_exchange(&seg->slots[idx], SLOT_TAKEN);
+        if (slot == SLOT_EMPTY)
+            continue;                                              // Producer not there yet, it moves on
+
+        size_t offset = (size_t)(slot >> 32);
+        size_t len = (size_t)((slot & 0xffffffffu) >> 1);
+        if (len == 0)
+        {
+            *id = (uint32_t)offset;
+        }
+        else
+        {
+            if (len >= size)
+                len = size - 1;
+            memcpy(url, seg->data + offset, len);
+            url[len] = '\0';
+        }
+        atomic_fetch_sub(&queue->size, 1);
+        epochExit(queue, e);
+        return 1;
+    }
+    epochExit(queue, e);
+    return 0;
+}
+
+// Allocate the level queues of a lane; NULL if memory allocation failed
+static LevelQueue *levelsCreate(const Frontier *frontier)
+{
+    int count = frontier->maxDepth + 1;
+    LevelQueue *levels = aligned_alloc(64, sizeof(LevelQueue) * (size_t)(count > 0 ? count : 1));
+    if (levels == NULL)
+        return NULL;
+    for (int d = 0; d < count; d++)
+    {
+        if (queueInit(&levels[d], frontier->urls != NULL ? 0 : SEGMENT_BYTES) != 0)
+        {
+            while (--d >= 0)
+                queueFree(&levels[d]);
+            free(levels);
+            return NULL;
+        }
+    }
+    return levels;
+}
+
+/*
+    Create an empty frontier.
+
+    Preconditions:  'maxDepth' is the deepest link depth to keep (the seeds have depth 0). 'urls' is the table to
+                    intern the URLs in, which must outlive the frontier, or NULL to keep copies of them.
+    Postcondition:  Returns a new frontier with the shared lane's queue per level 0..maxDepth, or NULL if memory
+                    allocation failed.
+*/
+Frontier *frontierCreate(int maxDepth, UrlTable *urls)
+{
+    if (maxDepth < 0)
+        maxDepth = -1;                                             // Keeps nothing at all
+    Frontier *frontier = aligned_alloc(64, (sizeof(Frontier) + 63) / 64 * 64);
+    if (frontier == NULL)
+        return NULL;
+    frontier->maxDepth = maxDepth;
+    frontier->urls = urls;
+    atomic_init(&frontier->size, 0);
+    atomic_init(&frontier->pending, 0);
+    atomic_init(&frontier->laneCount, 1);
+    atomic_init(&frontier->steals, 0);
+    for (int i = 0; i < FRONTIER_MAX_LANES; i++)
+    {
+        atomic_init(&frontier->lanes[i].levels, NULL);
+        atomic_init(&frontier->lanes[i].owned, 0);
+    }
+    LevelQueue *shared = levelsCreate(frontier);
+    if (shared == NULL)
+    {
+        free(frontier);
+        return NULL;
+    }
+    atomic_store(&frontier->lanes[0].levels, shared);
+    atomic_store(&frontier->lanes[0].owned, 1);                    // Never handed to a worker
+    return frontier;
+}
+
+/*
+    Attach the calling worker to a lane of its own.
+
+    Preconditions:  'frontier' was returned by frontierCreate().
+    Postcondition:  Returns the lane to push the worker's links to and pop from: a lane left by a worker that detached,
+                    or a new one. Returns 0, the shared lane, if FRONTIER_MAX_LANES lanes are taken or memory
+                    allocation failed; the worker works just the same, only on the shared lane.
+*/
+int frontierAttach(Frontier *frontier)
+{
+    int count = atomic_load(&frontier->laneCount);
+    for (int i = 1; i < count; i++)
+    {
+        int unowned = 0;
+        if (atomic_load(&frontier->lanes[i].levels) != NULL &&
+            atomic_compare_exchange_strong(&frontier->lanes[i].owned, &unowned, 1))
+        {
+            return i;                                              // Reuse a lane, with whatever it still holds
+        }
+    }
+
+    do                                                             // Claim the next unused lane
+    {
+        if (count >= FRONTIER_MAX_LANES)
+            return 0;
+    } while (!atomic_compare_exchange_weak(&frontier->laneCount, &count, count + 1));
+
+    LevelQueue *levels = levelsCreate(frontier);
+    if (levels == NULL)
+        return 0;                                                  // The lane stays unused, pops skip it
+    atomic_store(&frontier->lanes[count].owned, 1);
+    atomic_store(&frontier->lanes[count].levels, levels);
+    return count;
+}
+
+/*
+    Detach a worker from its lane.
+
+    Preconditions:  'lane' was returned by frontierAttach() and the worker pushes no more URLs to it.
+    Postcondition:  The lane can be attached by another worker. URLs still queued on it stay there for the other
+                    workers to steal.
+*/
+void frontierDetach(Frontier *frontier, int lane)
+{
+    if (lane > 0 && lane < FRONTIER_MAX_LANES)
+        atomic_store(&frontier->lanes[lane].owned, 0);
+}
+
+/*
+    Add a URL found at link depth 'depth' to a lane. Safe to call from any number of threads.
+
+    Preconditions:  'frontier' was returned by frontierCreate(), 'lane' by frontierAttach() or 0 for the shared lane,
+                    'url' is a null-terminated string.
+    Postcondition:  Returns 0 and the URL is queued on its level and counted outstanding, 1 if it was pruned because
+                    'depth' is beyond the frontier's maximum depth, 2 if the frontier's URL table shows it was queued
+                    before, or -1 if it is empty, longer than FRONTIER_MAX_URL - 1 bytes or memory allocation failed.
+*/
+int frontierPushLane(Frontier *frontier, int lane, const char *url, int depth)
+{
+    if (depth < 0 || depth > frontier->maxDepth)
+        return 1;                                                  // Pruned before costing any memory
+
+    size_t len = strlen(url);
+    if (len == 0 || len >= FRONTIER_MAX_URL)
+        return -1;
+
+    uint32_t id = 0;
+    if (frontier->urls != NULL)
+    {
+        int added = urlTableIntern(frontier->urls, url, len, &id);
+        if (added <= 0)
+            return added == 0 ? 2 : -1;                            // Queued once already, or out of memory
+        url = NULL;                                                // Queue the ID
+    }
+    LevelQueue *levels = lane > 0 && lane < FRONTIER_MAX_LANES ? atomic_load(&frontier->lanes[lane].levels) : NULL;
+    if (levels == NULL)
+        levels = atomic_load(&frontier->lanes[0].levels);
+    atomic_fetch_add(&frontier->pending, 1);                       // Before any pop can take it and finish it
+    if (queuePush(&levels[depth], url, len, id) != 0)
+    {
+        atomic_fetch_sub(&frontier->pending, 1);
+        return -1;
+    }
+    atomic_fetch_add(&frontier->size, 1);
+    return 0;
+}
+
+// Add a URL to the shared lane; see frontierPushLane()
+int frontierPush(Frontier *frontier, const char *url, int depth)
+{
+    return frontierPushLane(frontier, 0, url, depth);
+}
+
+// Take the URL at the front of one lane's queue of level 'depth', 1 if there was one
+static int lanePop(Frontier *frontier, int lane, int depth, char *url, size_t size)
+{
+    LevelQueue *levels = atomic_load(&frontier->lanes[lane].levels);
+    uint32_t id = 0;
+    if (levels == NULL || atomic_load(&levels[depth].size) <= 0 || !queuePop(&levels[depth], url, size, &id))
+        return 0;
+
+    atomic_fetch_sub(&frontier->size, 1);
+    if (frontier->urls != NULL)                                    // Copy the interned URL out
+    {
+        size_t len;
+        const char *interned = urlTableGet(frontier->urls, id, &len);
+        if (len >= size)
+            len = size - 1;
+        memcpy(url, interned, len);
+        url[len] = '\0';
+    }
+    return 1;
+}
+
+/*
+    Take a URL from the shallowest non-empty level, from the given lane if it has one there and otherwise from
+    another lane. Safe to call from any number of threads.
+
+    Preconditions:  'frontier' was returned by frontierCreate(), 'lane' by frontierAttach() or 0 for the shared lane,
+                    'url' points to a buffer of 'size' bytes (FRONTIER_MAX_URL bytes always suffice), 'depth' to an int.
+    Postcondition:  Returns 1 with the URL copied into 'url' and its link depth stored in 'depth', or 0 if the frontier
+                    is empty. The URL stays outstanding until it is reported with frontierDone().
+*/
+int frontierPopLane(Frontier *frontier, int lane, char *url, size_t size, int *depth)
+{
+    if (atomic_load(&frontier->size) <= 0)
+        return 0;
+    if (lane < 0 || lane >= FRONTIER_MAX_LANES)
+        lane = 0;
+    int count = atomic_load(&frontier->laneCount);
+    for (int d = 0; d <= frontier->maxDepth; d++)
+    {
+        if (lanePop(frontier, lane, d, url, size))                 // Own lane first
+        {
+            *depth = d;
+            return 1;
+        }
+        for (int i = 1; i < count; i++)                           // Then the others, starting with the next one
+        {
+            int victim = (lane + i) % count;
+            if (victim != lane && lanePop(frontier, victim, d, url, size))
+            {
+                if (victim != 0)
+                    atomic_fetch_add(&frontier->steals, 1);
+                *depth = d;
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+// Take a URL, the shared lane first; see frontierPopLane()
+int frontierPop(Frontier *frontier, char *url, size_t size, int *depth)
+{
+    return frontierPopLane(frontier, 0, url, size, depth);
+}
+
+/*
+    Report URLs taken from the frontier as finished.
+
+    Preconditions:  'count' URLs returned by frontierPop() or frontierPopLane() are done with: fetched, failed or
+                    dropped, and every link of theirs has been pushed.
+    Postcondition:  Returns the number of URLs still outstanding; 0 means the crawl has no work left.
+*/
+long frontierDone(Frontier *frontier, long count)
+{
+    return atomic_fetch_sub(&frontier->pending, count) - count;
+}
+
+/*
+    Count one URL as outstanding that is not queued, so the crawl cannot end while URLs are still to come.
+
+    Preconditions:  'frontier' was returned by frontierCreate().
+    Postcondition:  frontierPending() counts one more URL until frontierDone(frontier, 1) is called.
+*/
+void frontierHold(Frontier *frontier)
+{
+    atomic_fetch_add(&frontier->pending, 1);
+}
+
+// Number of URLs queued or taken and not reported finished (0 once the crawl has no work left)
+long frontierPending(const Frontier *frontier)
+{
+    return atomic_load(&((Frontier *)frontier)->pending);
+}
+
+// Number of URLs popped from another worker's lane so far
+long frontierSteals(const Frontier *frontier)
+{
+    return atomic_load(&((Frontier *)frontier)->steals);
+}
+
+// Number of URLs currently queued over all levels (a snapshot while other threads are active)
+long frontierSize(const Frontier *frontier)
+{
+    return atomic_load(&((Frontier *)frontier)->size);
+}
+
+// Number of URLs currently queued at one depth level, over all lanes
+long frontierLevelSize(const Frontier *frontier, int depth)
+{
+    if (depth < 0 || depth > frontier->maxDepth)
+        return 0;
+    long size = 0;
+    int count = atomic_load(&((Frontier *)frontier)->laneCount);
+    for (int i = 0; i < count; i++)
+    {
+        LevelQueue *levels = atomic_load(&((Frontier *)frontier)->lanes[i].levels);
+        if (levels != NULL)
+            size += atomic_load(&levels[depth].size);
+    }
+    return size;
+}
+
+// Deepest level the frontier keeps
+int frontierMaxDepth(const Frontier *frontier)
+{
+    return frontier->maxDepth;
+}
+
+/*
+    Destroy a frontier.
+
+    Preconditions:  'frontier' was returned by frontierCreate() and no other thread uses it.
+    Postcondition:  Every queued URL and all memory is released.
+*/
+void frontierDestroy(Frontier *frontier)
+{
+    if (frontier == NULL)
+        return;
+    for (int i = 0; i < FRONTIER_MAX_LANES; i++)
+    {
+        LevelQueue *levels = atomic_load(&frontier->lanes[i].levels);
+        if (levels == NULL)
+            continue;
+        for (int d = 0; d <= frontier->maxDepth; d++)
+            queueFree(&levels[d]);
+        free(levels);
+    }
+    free(frontier);
+}
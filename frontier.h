@@ -0,0 +1,40 @@
+/*
+Operating Systems Spring 2024
+Final Project
+
+URL frontier: unbounded lock-free multi-producer/multi-consumer queues of URLs, one per link depth and worker lane.
+*/
+
+#ifndef FRONTIER_H
+#define FRONTIER_H
+
+#include <stddef.h>
+
+#include "urltable.h"
+
+// Maximum length of a URL kept in the frontier, including the terminating null byte
+#define FRONTIER_MAX_URL 2048
+
+// Most lanes of a frontier, the shared lane 0 included; further workers use the shared lane
+#define FRONTIER_MAX_LANES 64
+
+typedef struct Frontier Frontier;
+
+// Function prototypes
+Frontier *frontierCreate(int maxDepth, UrlTable *urls);
+int frontierAttach(Frontier *frontier);
+void frontierDetach(Frontier *frontier, int lane);
+int frontierPushLane(Frontier *frontier, int lane, const char *url, int depth);
+int frontierPush(Frontier *frontier, const char *url, int depth);
+int frontierPopLane(Frontier *frontier, int lane, char *url, size_t size, int *depth);
+int frontierPop(Frontier *frontier, char *url, size_t size, int *depth);
+long frontierDone(Frontier *frontier, long count);
+void frontierHold(Frontier *frontier);
+long frontierPending(const Frontier *frontier);
+long frontierSteals(const Frontier *frontier);
+long frontierSize(const Frontier *frontier);
+long frontierLevelSize(const Frontier *frontier, int depth);
+int frontierMaxDepth(const Frontier *frontier);
+void frontierDestroy(Frontier *frontier);
+
+#endif
@@ -0,0 +1,53 @@
+/*
+Operating Systems Spring 2024
+Final Project
+
+Fast 64-bit hashing shared by the URL fingerprint, the visited set and the host tables.
+*/
+
+#ifndef HASH_H
+#define HASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// Finalizer of splitmix64: spreads every input bit over the whole result
+static inline uint64_t mix64(uint64_t x)
+{
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+/*
+    Hash 'len' bytes at 'data' to 64 bits.
+
+    Reads eight bytes per step, so a typical URL costs a handful of multiplications.
+    Not cryptographic: only meant for hash tables and duplicate detection.
+*/
+static inline uint64_t hash64(const void *data, size_t len)
+{
+    const unsigned char *p = (const unsigned char *)data;
+    uint64_t h = 0x9e3779b97f4a7c15ULL ^ (len * 0xff51afd7ed558ccdULL);
+
+    while (len >= 8)
+    {
+        uint64_t k;
+        memcpy(&k, p, 8);
+        h = (h ^ mix64(k)) * 0x9e3779b97f4a7c15ULL;
+        h ^= h >> 29;
+        p += 8;
+        len -= 8;
+    }
+
+    uint64_t k = 0;                                    // Remaining 0-7 bytes
+    memcpy(&k, p, len);
+    h ^= mix64(k ^ ((uint64_t)len << 56));
+    return mix64(h);
+}
+
+#endif
@@ -0,0 +1,610 @@
+/*
+Operating Systems Spring 2024
+Final Project
+
+Streaming HTML link scanner.
+
+A small tokenizer that only understands as much HTML as link discovery needs: tags and their
+attributes, comments, declarations, and the raw text of <script> and <style>, whose contents are
+never markup. It keeps its whole state in an HtmlScanner, so a page can be fed in arbitrary chunks
+as they come off the network, and reports each href as soon as the closing '>' of its tag is seen.
+Nothing is allocated and nothing but the current href is copied.
+
+The bytes themselves are not walked one at a time: memchr() finds the next '<', '>' or quote,
+and a class lookup per byte the end of a name or value. End tags and start tags that cannot hold
+a link are skipped in one step from their '<' to their '>'. SSE4.2 and AVX2 kernels classifying
+the page into bitmasks of its structural characters, in the spirit of simdjson, did not beat
+this in bench_scan, whether they built every mask up front or only searched inside tags: glibc's
+memchr() is vectorized already, and inside tags the runs are too short for wide loads to pay.
+*/
+
+#include <string.h>
+
+#include "htmlscan.h"
+
+// Tokenizer states
+enum
+{
+    S_TEXT,             // Character data, looking for '<'
+    S_TAG_OPEN,         // Just after '<'
+    S_TAG_NAME,         // Reading the name of a start tag
+    S_BEFORE_ATTR,      // Between attributes
+    S_ATTR_NAME,        // Reading an attribute name
+    S_AFTER_ATTR_NAME,  // After an attribute name, '=' may follow
+    S_BEFORE_VALUE,     // After '=', before the value
+    S_VALUE_QUOTED,     // Inside a quoted value
+    S_VALUE_UNQUOTED,   // Inside an unquoted value
+    S_BOGUS_ATTR,       // Attribute not starting with a name character, dropped up to a blank or '>'
+    S_SKIP_TAG,         // End tag, declaration or processing instruction: skip to '>'
+    S_BANG,             // After "<!"
+    S_BANG_DASH,        // After "<!-"
+    S_COMMENT,          // Inside a comment, looking for "-->"
+    S_RAWTEXT           // Inside <script> or <style>, looking for the end tag
+};
+
+// Tags the scanner cares about
+enum
+{
+    TAG_OTHER,
+    TAG_A,
+    TAG_BASE,
+    TAG_SCRIPT,
+    TAG_STYLE
+};
+
+// Byte classes, one bit each; a byte's class is lowNibble[c & 15] & highNibble[c >> 4]
+enum
+{
+    C_WSC = 1,      // \t \n \f \r
+    C_SP = 2,       // ' '
+    C_DQ = 4,       // '"'
+    C_SQ = 8,       // '\''
+    C_SLASH = 16,   // '/'
+    C_LT = 32,      // '<'
+    C_EQ = 64,      // '='
+    C_GT = 128      // '>'
+};
+
+#define C_NAME_END (C_WSC | C_SP | C_SLASH | C_EQ | C_GT)   // Ends a tag or attribute name
+#define C_VALUE_END (C_WSC | C_SP | C_GT)                   // Ends an unquoted value
+#define C_TAG_END (C_DQ | C_SQ | C_GT)
+
+static const unsigned char lowNibble[16] = {
+    C_SP, 0, C_DQ, 0, 0, 0, 0, C_SQ, 0, C_WSC, C_WSC, 0, C_LT | C_WSC, C_EQ | C_WSC, C_GT, C_SLASH
+};
+static const unsigned char highNibble[16] = {
+    C_WSC, 0, C_SP | C_DQ | C_SQ | C_SLASH, C_LT | C_EQ | C_GT, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+};
+
+// What findNext() looks for
+enum
+{
+    F_LT,
+    F_GT,
+    F_DQ,
+    F_SQ,
+    F_NAME_END,
+    F_VALUE_END,
+    F_TAG_END,      // '>' or a quote: ends a tag unless it opens a quoted value
+    FIND_COUNT
+};
+
+static int isSpace(unsigned char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f';
+}
+
+static int isAlpha(unsigned char c)
+{
+    return (unsigned char)((c | 0x20) - 'a') < 26;
+}
+
+// Characters an attribute name may start with, as libxml2 has it
+static int isNameStart(unsigned char c)
+{
+    return isAlpha(c) || c == '_' || c == ':' || c == '.';
+}
+
+// First letters of the tags whose contents matter: a, base, script and style
+static int isLinkStart(unsigned char c)
+{
+    c |= 0x20;
+    return c == 'a' || c == 'b' || c == 's';
+}
+
+static char lower(unsigned char c)
+{
+    return (char)((unsigned char)(c - 'A') < 26 ? c | 0x20 : c);
+}
+
+// Position of the first byte in [p, end) that 'which' looks for, or 'end': memchr() for single
+// characters, a class lookup per byte otherwise
+static const char *findNext(const char *p, const char *end, int which)
+{
+    static const char single[] = { '<', '>', '"', '\'' };
+    static const unsigned char sets[FIND_COUNT] = { C_LT, C_GT, C_DQ, C_SQ, C_NAME_END, C_VALUE_END, C_TAG_END };
+
+    if (which <= F_SQ)
+    {
+        const char *q = memchr(p, single[which], (size_t)(end - p));
+        return q ? q : end;
+    }
+    for (; p < end; p++)
+    {
+        unsigned char c = (unsigned char)*p;
+        if (lowNibble[c & 15] & highNibble[c >> 4] & sets[which])
+            break;
+    }
+    return p;
+}
+
+// Append to the tag or attribute name; names longer than the buffer never match anything we want
+static void appendName(HtmlScanner *s, unsigned char c)
+{
+    if (s->nameLen < (int)sizeof(s->name) - 1)
+        s->name[s->nameLen] = lower(c);
+    s->nameLen++;
+}
+
+// Append the run [p, q) to the name; only the first bytes are kept
+static void appendNameRun(HtmlScanner *s, const char *p, const char *q)
+{
+    size_t len = (size_t)(q - p);
+    size_t room = sizeof(s->name) - 1 > (size_t)s->nameLen ? sizeof(s->name) - 1 - (size_t)s->nameLen : 0;
+    for (size_t i = 0; i < len && i < room; i++)
+        s->name[s->nameLen + i] = lower((unsigned char)p[i]);
+    s->nameLen += (int)len;
+}
+
+static int nameIs(const HtmlScanner *s, const char *name)
+{
+    size_t len = strlen(name);
+    return (size_t)s->nameLen == len && memcmp(s->name, name, len) == 0;
+}
+
+// The tag name is complete: decide whether its attributes matter
+static void classifyTag(HtmlScanner *s)
+{
+    if (nameIs(s, "a"))
+        s->tagKind = TAG_A;
+    else if (nameIs(s, "base"))
+        s->tagKind = TAG_BASE;
+    else if (nameIs(s, "script"))
+        s->tagKind = TAG_SCRIPT;
+    else if (nameIs(s, "style"))
+        s->tagKind = TAG_STYLE;
+    else
+        s->tagKind = TAG_OTHER;
+    s->haveHref = 0;
+}
+
+// The attribute name is complete: capture its value if it is the first href of a link tag
+static void classifyAttr(HtmlScanner *s)
+{
+    s->capturing = (s->tagKind == TAG_A || s->tagKind == TAG_BASE) && !s->haveHref && nameIs(s, "href");
+    if (s->capturing)
+    {
+        s->valueLen = 0;
+        s->overflow = 0;
+    }
+}
+
+static void appendValue(HtmlScanner *s, const char *data, size_t len)
+{
+    if (len > sizeof(s->value) - 1 - s->valueLen)
+    {
+        s->overflow = 1;
+        len = sizeof(s->value) - 1 - s->valueLen;
+    }
+    memcpy(s->value + s->valueLen, data, len);
+    s->valueLen += len;
+}
+
+static void endValue(HtmlScanner *s)
+{
+    if (s->capturing)
+        s->haveHref = 1;
+    s->capturing = 0;
+}
+
+// Encode code point 'cp' as UTF-8 at 'out', return the number of bytes written
+static size_t putUtf8(char *out, unsigned long cp)
+{
+    if (cp < 0x80)
+    {
+        out[0] = (char)cp;
+        return 1;
+    }
+    if (cp < 0x800)
+    {
+        out[0] = (char)(0xC0 | (cp >> 6));
+        out[1] = (char)(0x80 | (cp & 0x3F));
+        return 2;
+    }
+    if (cp < 0x10000)
+    {
+        out[0] = (char)(0xE0 | (cp >> 12));
+        out[1] = (char)(0x80 | ((cp >> 6) & 0x3F));
+        out[2] = (char)(0x80 | (cp & 0x3F));
+        return 3;
+    }
+    out[0] = (char)(0xF0 | (cp >> 18));
+    out[1] = (char)(0x80 | ((cp >> 12) & 0x3F));
+    out[2] = (char)(0x80 | ((cp >> 6) & 0x3F));
+    out[3] = (char)(0x80 | (cp & 0x3F));
+    return 4;
+}
+
+/*
+    Decode character references in 'value' in place and return the new length.
+
+    Numeric references and the named ones that show up in URLs are decoded; anything else is
+    kept verbatim. Decoding never makes the text longer, so it can be done in place.
+*/
+static size_t decodeEntities(char *value, size_t len)
+{
+    static const struct { const char *name; unsigned long cp; } named[] = {
+        { "amp", '&' }, { "lt", '<' }, { "gt", '>' }, { "quot", '"' }, { "apos", '\'' }, { "nbsp", 0xA0 }
+    };
+    size_t in = 0, out = 0;
+
+    while (in < len)
+    {
+        char *amp = memchr(value + in, '&', len - in);
+        size_t run = amp ? (size_t)(amp - (value + in)) : len - in;
+        memmove(value + out, value + in, run);
+        in += run;
+        out += run;
+        if (amp == NULL)
+            break;
+
+        char *semi = memchr(value + in, ';', len - in < 12 ? len - in : 12);
+        unsigned long cp = 0;
+        int ok = 0;
+        if (semi != NULL && value[in + 1] == '#')
+        {
+            const char *p = value + in + 2;
+            int hex = (*p == 'x' || *p == 'X');
+            p += hex;
+            for (; p < semi; p++)
+            {
+                unsigned char c = (unsigned char)*p;
+                int digit = c >= '0' && c <= '9' ? c - '0'
+                          : hex && (c | 0x20) >= 'a' && (c | 0x20) <= 'f' ? (c | 0x20) - 'a' + 10 : -1;
+                if (digit < 0)
+                    break;
+                cp = cp * (hex ? 16 : 10) + (unsigned long)digit;
+                ok = 1;
+            }
+            ok = ok && p == semi && cp > 0 && cp <= 0x10FFFF;
+        }
+        else if (semi != NULL)
+        {
+            size_t nameLen = (size_t)(semi - (value + in + 1));
+            for (size_t i = 0; i < sizeof(named) / sizeof(named[0]) && !ok; i++)
+            {
+                if (strlen(named[i].name) == nameLen && memcmp(named[i].name, value + in + 1, nameLen) == 0)
+                {
+                    cp = named[i].cp;
+                    ok = 1;
+                }
+            }
+        }
+
+        if (ok)
+        {
+            out += putUtf8(value + out, cp);
+            in = (size_t)(semi - value) + 1;
+        }
+        else
+        {
+            value[out++] = '&';
+            in++;
+        }
+    }
+    return out;
+}
+
+// The start tag is complete: report its href and pick the state for what follows
+static void endTag(HtmlScanner *s)
+{
+    if (s->haveHref && !s->overflow)
+    {
+        s->valueLen = decodeEntities(s->value, s->valueLen);
+        s->value[s->valueLen] = '\0';
+        s->onLink(s->tagKind == TAG_BASE ? HTML_LINK_BASE : HTML_LINK_A, s->value, s->valueLen, s->userdata);
+    }
+    s->haveHref = 0;
+    s->capturing = 0;
+
+    if (s->tagKind == TAG_SCRIPT || s->tagKind == TAG_STYLE)
+    {
+        s->rawEnd = s->tagKind == TAG_SCRIPT ? "</script" : "</style";
+        s->rawMatched = 0;
+        s->state = S_RAWTEXT;
+    }
+    else
+    {
+        s->state = S_TEXT;
+    }
+}
+
+/*
+    Prepare a scanner for a new document.
+
+    Preconditions:  'scanner' points to an HtmlScanner, 'onLink' is the function receiving the links.
+    Postcondition:  The scanner is at the start of a document; any previous state is discarded.
+*/
+void htmlScannerInit(HtmlScanner *scanner, HtmlLinkCallback onLink, void *userdata)
+{
+    scanner->onLink = onLink;
+    scanner->userdata = userdata;
+    scanner->state = S_TEXT;
+    scanner->tagKind = TAG_OTHER;
+    scanner->nameLen = 0;
+    scanner->capturing = 0;
+    scanner->haveHref = 0;
+    scanner->overflow = 0;
+    scanner->dashes = 0;
+    scanner->rawEnd = NULL;
+    scanner->rawMatched = 0;
+    scanner->valueLen = 0;
+}
+
+/*
+    Scan the next chunk of a document.
+
+    Description:
+    Chunks may split the document anywhere, even in the middle of a tag or an href; the scanner
+    picks up where the previous chunk ended. onLink is called for every <a> or <base> tag whose
+    href attribute is complete in the data seen so far.
+
+    Preconditions:  'scanner' was prepared with htmlScannerInit(), 'data' holds 'len' bytes of the document.
+    Postcondition:  Every link completed by this chunk has been reported.
+*/
+void htmlScannerFeed(HtmlScanner *s, const char *data, size_t len)
+{
+    const char *p = data;
+    const char *end = data + len;
+
+    while (p < end)
+    {
+        const char *q;
+        unsigned char c = (unsigned char)*p;
+
+        switch (s->state)
+        {
+        case S_TEXT:
+            p = findNext(p, end, F_LT);     // Text is skipped wholesale
+            if (p == end)
+                return;
+            s->state = S_TAG_OPEN;
+            if (end - p < 2)
+                break;
+
+            // Skip end tags, and start tags that cannot matter, in one step. Without a quote before
+            // the first '>' there is no quoted value that could hide a '>', so that '>' ends the tag.
+            c = (unsigned char)p[1];
+            if (c == '/' || (isAlpha(c) && !isLinkStart(c)))
+            {
+                q = findNext(p + 2, end, c == '/' ? F_GT : F_TAG_END);
+                if (q < end && *q == '>')
+                {
+                    p = q + 1;
+                    s->state = S_TEXT;
+                    continue;
+                }
+            }
+            break;
+
+        case S_TAG_OPEN:
+            if (isAlpha(c))
+            {
+                s->nameLen = 0;
+                s->state = S_TAG_NAME;
+                continue;                   // First character of the name
+            }
+            else if (c == '/' || c == '?')
+                s->state = S_SKIP_TAG;
+            else if (c == '!')
+                s->state = S_BANG;
+            else if (c != '<')
+                s->state = S_TEXT;          // A literal '<' in text
+            break;
+
+        case S_TAG_NAME:
+            q = findNext(p, end, F_NAME_END);
+            appendNameRun(s, p, q);
+            if (q == end)
+                return;
+            p = q;
+            c = (unsigned char)*p;
+            if (c == '=')
+                appendName(s, c);           // Not a delimiter in a tag name
+            else
+            {
+                classifyTag(s);
+                if (c == '>')
+                    endTag(s);
+                else
+                    s->state = c == '/' ? S_BOGUS_ATTR : S_BEFORE_ATTR;
+            }
+            break;
+
+        case S_BEFORE_ATTR:
+            if (c == '>')
+                endTag(s);
+            else if (isNameStart(c))
+            {
+                s->nameLen = 0;
+                appendName(s, c);
+                s->state = S_ATTR_NAME;
+            }
+            else if (!isSpace(c))
+                s->state = S_BOGUS_ATTR;    // Includes a stray '/', "/>" still ends the tag
+            break;
+
+        case S_BOGUS_ATTR:
+            q = findNext(p, end, F_VALUE_END);
+            if (q == end)
+                return;
+            p = q;
+            if (*p == '>')
+                endTag(s);
+            else
+                s->state = S_BEFORE_ATTR;
+            break;
+
+        case S_ATTR_NAME:
+            q = findNext(p, end, F_NAME_END);
+            appendNameRun(s, p, q);
+            if (q == end)
+                return;
+            p = q;
+            c = (unsigned char)*p;
+            classifyAttr(s);
+            if (c == '=')
+                s->state = S_BEFORE_VALUE;
+            else if (isSpace(c))
+                s->state = S_AFTER_ATTR_NAME;
+            else
+            {
+                endValue(s);                // Attribute without a value
+                if (c == '>')
+                    endTag(s);
+                else
+                    s->state = S_BOGUS_ATTR;
+            }
+            break;
+
+        case S_AFTER_ATTR_NAME:
+            if (c == '=')
+                s->state = S_BEFORE_VALUE;
+            else if (!isSpace(c))
+            {
+                endValue(s);                // The previous attribute had no value
+                s->state = S_BEFORE_ATTR;
+                continue;                   // Start of the next attribute
+            }
+            break;
+
+        case S_BEFORE_VALUE:
+            if (c == '"' || c == '\'')
+            {
+                s->quote = (char)c;
+                s->state = S_VALUE_QUOTED;
+            }
+            else if (c == '>')
+            {
+                endValue(s);
+                endTag(s);
+            }
+            else if (!isSpace(c))
+            {
+                s->state = S_VALUE_UNQUOTED;
+                continue;                   // First character of the value
+            }
+            break;
+
+        case S_VALUE_QUOTED:
+            q = findNext(p, end, s->quote == '"' ? F_DQ : F_SQ);
+            if (s->capturing)
+                appendValue(s, p, (size_t)(q - p));
+            if (q == end)
+                return;
+            endValue(s);
+            p = q;
+            s->state = S_BEFORE_ATTR;
+            break;
+
+        case S_VALUE_UNQUOTED:
+            q = findNext(p, end, F_VALUE_END);
+            if (s->capturing)
+                appendValue(s, p, (size_t)(q - p));
+            if (q == end)
+                return;
+            endValue(s);
+            p = q;
+            if (*p == '>')
+                endTag(s);
+            else
+                s->state = S_BEFORE_ATTR;
+            break;
+
+        case S_SKIP_TAG:
+            p = findNext(p, end, F_GT);
+            if (p == end)
+                return;
+            s->state = S_TEXT;
+            break;
+
+        case S_BANG:
+            s->state = c == '-' ? S_BANG_DASH : S_SKIP_TAG;
+            if (c == '>')
+                s->state = S_TEXT;
+            break;
+
+        case S_BANG_DASH:
+            if (c == '-')
+            {
+                s->dashes = 0;
+                s->state = S_COMMENT;
+            }
+            else
+                s->state = c == '>' ? S_TEXT : S_SKIP_TAG;
+            break;
+
+        case S_COMMENT:
+            if (c == '-')
+                s->dashes++;
+            else if (c == '>' && s->dashes >= 2)
+                s->state = S_TEXT;
+            else
+            {
+                s->dashes = 0;
+                q = memchr(p, '-', (size_t)(end - p));   // Comment text is skipped wholesale
+                if (q == NULL)
+                    return;
+                p = q;
+                continue;
+            }
+            break;
+
+        case S_RAWTEXT:
+            if (s->rawMatched == 0)
+            {
+                p = findNext(p, end, F_LT);  // Script bodies are skipped wholesale too
+                if (p == end)
+                    return;
+                s->rawMatched = 1;
+                break;
+            }
+            if (lower(c) == s->rawEnd[s->rawMatched])
+            {
+                if (s->rawEnd[++s->rawMatched] == '\0')
+                    s->state = S_SKIP_TAG;    // Found the end tag, skip its '>'
+            }
+            else
+            {
+                s->rawMatched = 0;
+                continue;                     // Look at this character again, it may be a '<'
+            }
+            break;
+        }
+        p++;
+    }
+}
+
+/*
+    Finish a document.
+
+    Preconditions:  'scanner' was prepared with htmlScannerInit().
+    Postcondition:  A tag cut off by the end of the document is dropped, like an unterminated tag in a
+                    browser, and the scanner is ready for another htmlScannerInit().
+*/
+void htmlScannerFinish(HtmlScanner *scanner)
+{
+    scanner->state = S_TEXT;
+    scanner->haveHref = 0;
+    scanner->capturing = 0;
+}
@@ -0,0 +1,51 @@
+/*
+Operating Systems Spring 2024
+Final Project
+
+Streaming HTML link scanner: finds <a href> and <base href> values without building a DOM.
+*/
+
+#ifndef HTMLSCAN_H
+#define HTMLSCAN_H
+
+#include <stddef.h>
+
+// Longest attribute value kept; longer hrefs are dropped
+#define HTML_SCAN_MAX_VALUE 2048
+
+// Tag a link was found in
+typedef enum
+{
+    HTML_LINK_A,        // <a href="...">
+    HTML_LINK_BASE      // <base href="...">
+} HtmlLinkKind;
+
+// Called for every href found; 'href' is null-terminated with entities decoded
+typedef void (*HtmlLinkCallback)(HtmlLinkKind kind, const char *href, size_t len, void *userdata);
+
+// Scanner state, kept between chunks; embed it anywhere, it needs no allocation
+typedef struct
+{
+    HtmlLinkCallback onLink;            // Receives the links
+    void *userdata;                     // Passed to onLink
+    int state;                          // Tokenizer state
+    int tagKind;                        // Kind of tag being read
+    char name[16];                      // Tag or attribute name, lowercase, truncated
+    int nameLen;
+    int capturing;                      // Current attribute value is an href we want
+    int haveHref;                       // The current tag already had an href
+    int overflow;                       // The href did not fit in 'value'
+    char quote;                         // Quote character of the current value
+    int dashes;                         // Dashes seen while looking for "-->"
+    const char *rawEnd;                 // "</script" or "</style" while skipping raw text
+    int rawMatched;                     // Characters of rawEnd matched so far
+    size_t valueLen;
+    char value[HTML_SCAN_MAX_VALUE];    // href being read
+} HtmlScanner;
+
+// Function prototypes
+void htmlScannerInit(HtmlScanner *scanner, HtmlLinkCallback onLink, void *userdata);
+void htmlScannerFeed(HtmlScanner *scanner, const char *data, size_t len);
+void htmlScannerFinish(HtmlScanner *scanner);
+
+#endif
@@ -0,0 +1,881 @@
+/*
+Operating Systems Spring 2024
+Final Project
+
+Journal: crawl state kept on disk, a write-ahead log of queued and finished URLs with snapshots.
+
+The crawl state is the set of finished URLs and the URLs still to fetch. Instead of writing out
+the frontier and the visited set, which change all the time and are spread over many threads, the
+journal logs two kinds of events: a URL was queued (with its link depth), and a URL was finished
+(by its fingerprint, successfully or not). The state is then: every finished fingerprint, and
+every queued URL that is not finished. Since this does not depend on the order of the records, a
+URL that was queued, taken by a worker and lost in a crash while in flight is simply fetched again
+on resume.
+
+Records are collected in a buffer under a short lock and a writer thread appends them to the
+current log segment, once 64 KB have piled up or the oldest record has waited 'flushMs', then
+calls fdatasync() as the sync policy says. Each record carries a checksum, so a record torn by a
+crash ends the segment on reading. A full buffer makes the caller wait for the writer; records are
+never dropped. Segments are closed at 'segmentBytes'.
+
+Closed segments are merged into a snapshot by a background thread once they add up to half the
+snapshot (at least a segment), so the work stays linear in the log. The snapshot is written
+to a temporary file, synced and renamed over the old one before the merged segments are deleted,
+so a crash at any point leaves either the old or the new snapshot and every segment it does not
+hold. The snapshot is laid out to be read straight from a mapping, in native byte order:
+
+    SnapshotHeader
+    uint64  finished fingerprints[doneCount]
+    pending URLs, each [uint16 length][uint16 depth][bytes], pendingBytes in all
+
+Resuming maps the snapshot, loads its fingerprints into the visited set and pushes its URLs onto
+the frontier, then does the same with the segments written after it.
+
+Log record: [uint32 check][uint16 length][uint16 depth][payload], check being the low half of
+hash64() of everything after it. A queued URL has its bytes as payload, a finished one has depth
+DONE_DEPTH and its 8-byte fingerprint.
+*/
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "hash.h"
+#include "journal.h"
+
+// Size of each of the two record buffers and the amount that wakes the writer up
+#define BUFFER_BYTES (1024 * 1024)
+#define FLUSH_BYTES (64 * 1024)
+
+// Bytes in front of the payload of a log record
+#define RECORD_HEADER 8
+
+// Depth field of a finished-URL record
+#define DONE_DEPTH 0xffff
+
+#define SNAPSHOT_MAGIC "WCSNAP01"
+#define SNAPSHOT_NAME "snapshot"
+#define SNAPSHOT_TMP "snapshot.tmp"
+
+// Longest path of a file of the journal, and of its directory: room is left for the longest file name
+#define PATH_BYTES 4096
+#define DIR_BYTES (PATH_BYTES - 32)
+
+// Header of a snapshot file
+typedef struct
+{
+    char magic[8];              // SNAPSHOT_MAGIC
+    uint64_t lastSegment;       // Highest log segment merged into the snapshot
+    uint64_t doneCount;         // Fingerprints of finished URLs following the header
+    uint64_t pendingCount;      // URLs to fetch following them
+    uint64_t pendingBytes;      // Bytes of those URL records
+    uint64_t check;             // hash64() of the fields above
+} SnapshotHeader;
+
+// A file mapped into memory
+typedef struct
+{
+    const unsigned char *data;  // NULL if there is no such file
+    size_t size;
+} Mapping;
+
+/*
+    Called for every record of the state: a finished URL (url NULL, fingerprint set) or a queued
+    URL (not null-terminated, fingerprint as urlFingerprint() computes it).
+*/
+typedef void (*RecordVisitor)(uint64_t fingerprint, const char *url, size_t len, int depth, void *context);
+
+struct Journal
+{
+    JournalConfig config;
+    char dir[DIR_BYTES];
+    long firstSegment;              // First segment of this process; older ones hold the state found on opening
+    long oldestSegment;             // Oldest segment that may still exist
+    int hasState;                   // 1 if a snapshot or segment was found on opening
+
+    pthread_mutex_t lock;           // Guards the buffers and the requests below
+    pthread_cond_t wake;            // Wakes the writer up
+    pthread_cond_t written;         // Broadcast by the writer after every batch
+    pthread_cond_t compactWake;     // Wakes the compactor up
+    char *buf;                      // Records being collected
+    char *spare;                    // Batch being written
+    size_t len;                     // Bytes in 'buf'
+    int stop;                       // Tells the writer to write everything and exit
+    int compactStop;                // Tells the compactor to exit
+    int compactPending;             // 1 if closed segments wait to be merged
+    long rotateRequested;           // Segment closes asked for by journalCompact() and journalReset()
+    long rotated;                   // Of those, the ones done
+    size_t closedBytes;             // Bytes of closed segments not in the snapshot
+
+    // Used by the writer thread only
+    int fd;                         // Open segment, -1 if none
+    size_t segmentLen;              // Bytes written to it
+    int dirty;                      // 1 if it was written since the last fdatasync()
+    long long lastSync;             // Time of the last fdatasync(), in milliseconds
+    int failed;                     // 1 once a write failed (reported once)
+    atomic_long segment;            // Number of the open segment, or of the next one if none is open
+
+    pthread_mutex_t compactLock;    // Serializes snapshots, loads and resets
+    long snapshotSegment;           // Last segment in the snapshot, 0 if none
+    size_t snapshotBytes;           // Size of the snapshot file, guarded by 'lock'
+
+    pthread_t writer, compactor;
+    int hasCompactor;               // 1 if the compactor thread was started
+    atomic_long queued, done, bytes, writes, syncs, waits, compactions, compactUs;
+};
+
+// Current monotonic time in milliseconds
+static long long nowMs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void segmentPath(const Journal *journal, long segment, char *path)
+{
+    snprintf(path, PATH_BYTES, "%s/wal.%010ld", journal->dir, segment);
+}
+
+static void filePath(const Journal *journal, const char *name, char *path)
+{
+    snprintf(path, PATH_BYTES, "%s/%s", journal->dir, name);
+}
+
+// Make a rename or a new file in the journal's directory durable
+static void syncDir(const Journal *journal)
+{
+    int fd = open(journal->dir, O_RDONLY | O_DIRECTORY);
+    if (fd >= 0)
+    {
+        fsync(fd);
+        close(fd);
+    }
+}
+
+// Map a file read-only; data is NULL if it is missing or empty
+static Mapping mapFile(const char *path)
+{
+    Mapping map = { NULL, 0 };
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0)
+        return map;
+    if (fstat(fd, &st) == 0 && st.st_size > 0)
+    {
+        void *data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED)
+        {
+            madvise(data, (size_t)st.st_size, MADV_SEQUENTIAL);
+            map.data = data;
+            map.size = (size_t)st.st_size;
+        }
+    }
+    close(fd);
+    return map;
+}
+
+static void unmapFile(Mapping *map)
+{
+    if (map->data != NULL)
+        munmap((void *)map->data, map->size);
+    map->data = NULL;
+}
+
+// Map the snapshot and check it; returns 0 (data NULL if there is none) or -1 if it is damaged
+static int mapSnapshot(const Journal *journal, Mapping *map, SnapshotHeader *header)
+{
+    char path[PATH_BYTES];
+    filePath(journal, SNAPSHOT_NAME, path);
+    *map = mapFile(path);
+    memset(header, 0, sizeof(SnapshotHeader));
+    if (map->data == NULL)
+        return 0;
+
+    if (map->size >= sizeof(SnapshotHeader))
+        memcpy(header, map->data, sizeof(SnapshotHeader));
+    if (map->size < sizeof(SnapshotHeader) || memcmp(header->magic, SNAPSHOT_MAGIC, 8) != 0 ||
+        header->check != hash64(header, offsetof(SnapshotHeader, check)) ||
+        map->size != sizeof(SnapshotHeader) + header->doneCount * 8 + header->pendingBytes)
+    {
+        unmapFile(map);
+        return -1;
+    }
+    return 0;
+}
+
+/*
+    Visit the finished URLs ('queued' 0) or the queued URLs ('queued' 1) of a snapshot and of the log
+    segments from..to. A segment ends at its first damaged record. Returns the bytes of segments read.
+*/
+static size_t walkState(const Journal *journal, const Mapping *snapshot, long from, long to, int queued,
+                        RecordVisitor visit, void *context)
+{
+    size_t segmentBytes = 0;
+    if (snapshot->data != NULL)
+    {
+        SnapshotHeader header;
+        memcpy(&header, snapshot->data, sizeof(header));
+        const unsigned char *p = snapshot->data + sizeof(header);
+        if (!queued)
+        {
+            for (uint64_t i = 0; i < header.doneCount; i++, p += 8)
+            {
+                uint64_t fingerprint;
+                memcpy(&fingerprint, p, 8);
+                visit(fingerprint, NULL, 0, -1, context);
+            }
+        }
+        else
+        {
+            p += header.doneCount * 8;
+            const unsigned char *end = p + header.pendingBytes;
+            while (p + 4 <= end)
+            {
+                uint16_t len, depth;
+                memcpy(&len, p, 2);
+                memcpy(&depth, p + 2, 2);
+                if (p + 4 + len > end)
+                    break;
+                visit(hash64(p + 4, len), (const char *)p + 4, len, depth, context);
+                p += 4 + len;
+            }
+        }
+    }
+
+    for (long segment = from; segment <= to; segment++)
+    {
+        char path[PATH_BYTES];
+        segmentPath(journal, segment, path);
+        Mapping map = mapFile(path);
+        if (map.data == NULL)
+            continue;
+        segmentBytes += map.size;
+
+        const unsigned char *p = map.data, *end = map.data + map.size;
+        while (p + RECORD_HEADER <= end)
+        {
+            uint32_t check;
+            uint16_t len, depth;
+            memcpy(&check, p, 4);
+            memcpy(&len, p + 4, 2);
+            memcpy(&depth, p + 6, 2);
+            if (p + RECORD_HEADER + len > end || check != (uint32_t)hash64(p + 4, 4 + (size_t)len))
+                break;                                  // Torn by a crash: the rest never made it
+            const unsigned char *payload = p + RECORD_HEADER;
+            if (depth == DONE_DEPTH && len == 8 && !queued)
+            {
+                uint64_t fingerprint;
+                memcpy(&fingerprint, payload, 8);
+                visit(fingerprint, NULL, 0, -1, context);
+            }
+            else if (depth != DONE_DEPTH && queued)
+            {
+                visit(hash64(payload, len), (const char *)payload, len, depth, context);
+            }
+            p += RECORD_HEADER + len;
+        }
+        unmapFile(&map);
+    }
+    return segmentBytes;
+}
+
+// State of a snapshot being written
+typedef struct
+{
+    FILE *out;
+    VisitedSet *done;               // Finished fingerprints written
+    VisitedSet *seen;               // Pending URLs written
+    uint64_t doneCount, pendingCount, pendingBytes;
+} SnapshotWriter;
+
+static void writeRecord(uint64_t fingerprint, const char *url, size_t len, int depth, void *context)
+{
+    SnapshotWriter *writer = (SnapshotWriter *)context;
+    if (url == NULL)
+    {
+        if (visitedTestAndInsert(writer->done, fingerprint) == 1)
+        {
+            fwrite(&fingerprint, 8, 1, writer->out);
+            writer->doneCount++;
+        }
+        return;
+    }
+    if (visitedContains(writer->done, fingerprint) || visitedTestAndInsert(writer->seen, fingerprint) != 1)
+        return;                                     // Finished, or already written
+    uint16_t length = (uint16_t)len, level = (uint16_t)depth;
+    fwrite(&length, 2, 1, writer->out);
+    fwrite(&level, 2, 1, writer->out);
+    fwrite(url, 1, len, writer->out);
+    writer->pendingCount++;
+    writer->pendingBytes += 4 + len;
+}
+
+/*
+    Merge the snapshot and every closed segment into a new snapshot. Called with compactLock held.
+    Returns 0, or -1 if the snapshot could not be written (the old state is left as it was).
+*/
+static int compact(Journal *journal)
+{
+    long upTo = atomic_load(&journal->segment) - 1;     // Segments the writer is done with
+    if (upTo <= journal->snapshotSegment)
+        return 0;
+    long long start = nowMs();
+
+    Mapping snapshot;
+    SnapshotHeader header;
+    if (mapSnapshot(journal, &snapshot, &header) != 0)
+        return -1;
+
+    char tmpPath[PATH_BYTES], path[PATH_BYTES];
+    filePath(journal, SNAPSHOT_TMP, tmpPath);
+    filePath(journal, SNAPSHOT_NAME, path);
+    SnapshotWriter writer = { fopen(tmpPath, "wb"), visitedCreate(header.doneCount),
+                              visitedCreate(header.pendingCount), 0, 0, 0 };
+    if (writer.out == NULL || writer.done == NULL || writer.seen == NULL)
+    {
+        if (writer.out != NULL)
+            fclose(writer.out);
+        visitedDestroy(writer.done);
+        visitedDestroy(writer.seen);
+        unmapFile(&snapshot);
+        return -1;
+    }
+    setvbuf(writer.out, NULL, _IOFBF, BUFFER_BYTES);
+
+    SnapshotHeader out = { SNAPSHOT_MAGIC, (uint64_t)upTo, 0, 0, 0, 0 };
+    fwrite(&out, sizeof(out), 1, writer.out);       // Filled in below
+    size_t merged = walkState(journal, &snapshot, journal->snapshotSegment + 1, upTo, 0, writeRecord, &writer);
+    walkState(journal, &snapshot, journal->snapshotSegment + 1, upTo, 1, writeRecord, &writer);
+    unmapFile(&snapshot);
+    visitedDestroy(writer.done);
+    visitedDestroy(writer.seen);
+
+    out.doneCount = writer.doneCount;
+    out.pendingCount = writer.pendingCount;
+    out.pendingBytes = writer.pendingBytes;
+    out.check = hash64(&out, offsetof(SnapshotHeader, check));
+    int ok = fseek(writer.out, 0, SEEK_SET) == 0 && fwrite(&out, sizeof(out), 1, writer.out) == 1 &&
+             fflush(writer.out) == 0 && fdatasync(fileno(writer.out)) == 0;
+    ok = fclose(writer.out) == 0 && ok;
+    if (!ok || rename(tmpPath, path) != 0)
+    {
+        unlink(tmpPath);
+        return -1;
+    }
+    syncDir(journal);                               // The new snapshot is durable, the segments can go
+
+    for (long segment = journal->snapshotSegment + 1; segment <= upTo; segment++)
+    {
+        char segPath[PATH_BYTES];
+        segmentPath(journal, segment, segPath);
+        unlink(segPath);
+    }
+    journal->snapshotSegment = upTo;
+    journal->oldestSegment = upTo + 1;
+
+    pthread_mutex_lock(&journal->lock);
+    journal->snapshotBytes = sizeof(out) + out.doneCount * 8 + out.pendingBytes;
+    journal->closedBytes = journal->closedBytes > merged ? journal->closedBytes - merged : 0;
+    pthread_mutex_unlock(&journal->lock);
+    atomic_fetch_add(&journal->compactions, 1);
+    atomic_fetch_add(&journal->compactUs, (nowMs() - start) * 1000);
+    return 0;
+}
+
+static void syncSegment(Journal *journal)
+{
+    if (journal->fd >= 0 && journal->dirty)
+    {
+        fdatasync(journal->fd);
+        atomic_fetch_add(&journal->syncs, 1);
+        journal->dirty = 0;
+    }
+    journal->lastSync = nowMs();
+}
+
+// Append a batch to the open segment, opening a new one if needed
+static void writeBatch(Journal *journal, const char *batch, size_t len)
+{
+    if (journal->fd < 0)
+    {
+        char path[PATH_BYTES];
+        segmentPath(journal, atomic_load(&journal->segment), path);
+        journal->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        journal->segmentLen = 0;
+        if (journal->fd >= 0 && journal->config.sync != JOURNAL_SYNC_NONE)
+            syncDir(journal);
+    }
+
+    size_t off = 0;
+    while (journal->fd >= 0 && off < len)
+    {
+        ssize_t n = write(journal->fd, batch + off, len - off);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+        off += (size_t)n;
+        atomic_fetch_add(&journal->writes, 1);
+    }
+    if (off < len && !journal->failed)
+    {
+        perror("journal");
+        journal->failed = 1;
+    }
+    journal->segmentLen += off;
+    journal->dirty = 1;
+    atomic_fetch_add(&journal->bytes, (long)off);
+
+    if (journal->config.sync == JOURNAL_SYNC_BATCH)
+        syncSegment(journal);
+}
+
+// Close the open segment; returns its size, 0 if none was open
+static size_t closeSegment(Journal *journal)
+{
+    if (journal->fd < 0)
+        return 0;
+    if (journal->config.sync != JOURNAL_SYNC_NONE)
+        syncSegment(journal);
+    close(journal->fd);
+    journal->fd = -1;
+    journal->dirty = 0;
+    atomic_fetch_add(&journal->segment, 1);
+    return journal->segmentLen;
+}
+
+static void *writerThread(void *arg)
+{
+    Journal *journal = (Journal *)arg;
+
+    pthread_mutex_lock(&journal->lock);
+    while (1)
+    {
+        if (journal->len < FLUSH_BYTES && !journal->stop && journal->rotateRequested == journal->rotated)
+        {
+            struct timespec deadline;
+            clock_gettime(CLOCK_MONOTONIC, &deadline);
+            deadline.tv_nsec += (long)journal->config.flushMs * 1000000;
+            deadline.tv_sec += deadline.tv_nsec / 1000000000;
+            deadline.tv_nsec %= 1000000000;
+            pthread_cond_timedwait(&journal->wake, &journal->lock, &deadline);
+        }
+
+        char *batch = journal->buf;                 // Take the records, the callers go on with the other buffer
+        size_t len = journal->len;
+        journal->buf = journal->spare;
+        journal->spare = batch;
+        journal->len = 0;
+        long rotate = journal->rotateRequested;
+        int stop = journal->stop;
+        pthread_mutex_unlock(&journal->lock);
+
+        if (len > 0)
+            writeBatch(journal, batch, len);
+        if (journal->config.sync == JOURNAL_SYNC_INTERVAL && journal->dirty &&
+            nowMs() - journal->lastSync >= journal->config.syncMs)
+            syncSegment(journal);
+        size_t closed = 0;
+        if (rotate != journal->rotated || stop || journal->segmentLen >= journal->config.segmentBytes)
+            closed = closeSegment(journal);
+
+        pthread_mutex_lock(&journal->lock);
+        journal->rotated = rotate;
+        journal->closedBytes += closed;
+        if (closed > 0 && journal->config.autoCompact &&
+            journal->closedBytes >= journal->config.segmentBytes && journal->closedBytes >= journal->snapshotBytes / 2)
+        {
+            journal->compactPending = 1;
+            pthread_cond_signal(&journal->compactWake);
+        }
+        pthread_cond_broadcast(&journal->written);
+        if (stop && journal->len == 0)
+            break;
+    }
+    pthread_mutex_unlock(&journal->lock);
+    return NULL;
+}
+
+static void *compactorThread(void *arg)
+{
+    Journal *journal = (Journal *)arg;
+
+    pthread_mutex_lock(&journal->lock);
+    while (1)
+    {
+        while (!journal->compactPending && !journal->compactStop)
+            pthread_cond_wait(&journal->compactWake, &journal->lock);
+        if (journal->compactStop)
+            break;
+        journal->compactPending = 0;
+        pthread_mutex_unlock(&journal->lock);
+
+        pthread_mutex_lock(&journal->compactLock);
+        compact(journal);
+        pthread_mutex_unlock(&journal->compactLock);
+
+        pthread_mutex_lock(&journal->lock);
+    }
+    pthread_mutex_unlock(&journal->lock);
+    return NULL;
+}
+
+// Have the writer write everything recorded so far and close the open segment
+static void rotateSegment(Journal *journal)
+{
+    pthread_mutex_lock(&journal->lock);
+    long ticket = ++journal->rotateRequested;
+    pthread_cond_signal(&journal->wake);
+    while (journal->rotated < ticket)
+        pthread_cond_wait(&journal->written, &journal->lock);
+    pthread_mutex_unlock(&journal->lock);
+}
+
+// Append one record, waiting for the writer if both buffers are full
+static void appendRecord(Journal *journal, int depth, const void *payload, size_t len)
+{
+    unsigned char record[RECORD_HEADER + FRONTIER_MAX_URL];
+    uint16_t length = (uint16_t)len, level = (uint16_t)depth;
+    memcpy(record + 4, &length, 2);
+    memcpy(record + 6, &level, 2);
+    memcpy(record + RECORD_HEADER, payload, len);
+    uint32_t check = (uint32_t)hash64(record + 4, 4 + len);
+    memcpy(record, &check, 4);
+    size_t size = RECORD_HEADER + len;
+
+    pthread_mutex_lock(&journal->lock);
+    if (journal->len + size > BUFFER_BYTES)
+    {
+        atomic_fetch_add(&journal->waits, 1);
+        while (journal->len + size > BUFFER_BYTES)
+        {
+            pthread_cond_signal(&journal->wake);
+            pthread_cond_wait(&journal->written, &journal->lock);
+        }
+    }
+    memcpy(journal->buf + journal->len, record, size);
+    journal->len += size;
+    if (journal->len >= FLUSH_BYTES && journal->len - size < FLUSH_BYTES)
+        pthread_cond_signal(&journal->wake);
+    pthread_mutex_unlock(&journal->lock);
+}
+
+// Settings used unless the caller changes them: fdatasync() once a second, 64 MB segments merged in the background
+void journalConfigDefaults(JournalConfig *config)
+{
+    config->dir = "crawler.state";
+    config->sync = JOURNAL_SYNC_INTERVAL;
+    config->syncMs = 1000;
+    config->flushMs = 50;
+    config->segmentBytes = 64 * 1024 * 1024;
+    config->autoCompact = 1;
+}
+
+/*
+    Open the journal in a directory and start its writer and compactor threads.
+
+    Preconditions:  'config' holds the settings, see journalConfigDefaults().
+    Postcondition:  Returns the journal, or NULL if the directory could not be created, its snapshot is damaged
+                    or memory allocation failed. State found in the directory is kept until journalLoad() or
+                    journalReset(); records go to new segments after it.
+*/
+Journal *journalOpen(const JournalConfig *config)
+{
+    if (mkdir(config->dir, 0755) != 0 && errno != EEXIST)
+        return NULL;
+    DIR *dir = opendir(config->dir);
+    Journal *journal = calloc(1, sizeof(Journal));
+    if (dir == NULL || journal == NULL || strlen(config->dir) >= DIR_BYTES)
+    {
+        if (dir != NULL)
+            closedir(dir);
+        free(journal);
+        return NULL;
+    }
+    journal->config = *config;
+    if (journal->config.flushMs <= 0)
+        journal->config.flushMs = 1;
+    strcpy(journal->dir, config->dir);
+    journal->config.dir = journal->dir;
+
+    // Find the state left by an earlier run
+    long lastSegment = 0, oldestSegment = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL)
+    {
+        long segment;
+        char tail;
+        if (sscanf(entry->d_name, "wal.%ld%c", &segment, &tail) == 1)
+        {
+            journal->hasState = 1;
+            if (segment > lastSegment)
+                lastSegment = segment;
+            if (oldestSegment == 0 || segment < oldestSegment)
+                oldestSegment = segment;
+        }
+    }
+    closedir(dir);
+
+    Mapping snapshot;
+    SnapshotHeader header;
+    if (mapSnapshot(journal, &snapshot, &header) != 0)
+    {
+        free(journal);
+        return NULL;
+    }
+    if (snapshot.data != NULL)
+    {
+        journal->hasState = 1;
+        journal->snapshotSegment = (long)header.lastSegment;
+        journal->snapshotBytes = snapshot.size;
+        if (journal->snapshotSegment > lastSegment)
+            lastSegment = journal->snapshotSegment;
+        unmapFile(&snapshot);
+
+        // Segments a crash kept from being deleted after they were merged
+        for (long segment = oldestSegment; segment > 0 && segment <= journal->snapshotSegment; segment++)
+        {
+            char path[PATH_BYTES];
+            segmentPath(journal, segment, path);
+            unlink(path);
+        }
+    }
+    journal->firstSegment = lastSegment + 1;
+    journal->oldestSegment = oldestSegment > 0 ? oldestSegment : journal->firstSegment;
+    atomic_init(&journal->segment, journal->firstSegment);
+    journal->fd = -1;
+    journal->lastSync = nowMs();
+
+    journal->buf = malloc(BUFFER_BYTES);
+    journal->spare = malloc(BUFFER_BYTES);
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_mutex_init(&journal->lock, NULL);
+    pthread_mutex_init(&journal->compactLock, NULL);
+    pthread_cond_init(&journal->wake, &attr);
+    pthread_cond_init(&journal->written, NULL);
+    pthread_cond_init(&journal->compactWake, NULL);
+    pthread_condattr_destroy(&attr);
+
+    if (journal->buf == NULL || journal->spare == NULL ||
+        pthread_create(&journal->writer, NULL, writerThread, journal) != 0)
+    {
+        free(journal->buf);
+        free(journal->spare);
+        free(journal);
+        return NULL;
+    }
+    journal->hasCompactor = pthread_create(&journal->compactor, NULL, compactorThread, journal) == 0;
+    return journal;
+}
+
+// 1 if the journal found the state of an earlier run when it was opened
+int journalHasState(const Journal *journal)
+{
+    return journal != NULL && journal->hasState;
+}
+
+typedef struct
+{
+    VisitedSet *visited;
+    Frontier *frontier;
+    long done, pending;
+} Loader;
+
+static void loadRecord(uint64_t fingerprint, const char *url, size_t len, int depth, void *context)
+{
+    Loader *loader = (Loader *)context;
+    if (url == NULL)
+    {
+        loader->done += visitedTestAndInsert(loader->visited, fingerprint) == 1;
+        return;
+    }
+    if (visitedContains(loader->visited, fingerprint))
+        return;
+    char copy[FRONTIER_MAX_URL];
+    if (len >= sizeof(copy))
+        return;
+    memcpy(copy, url, len);
+    copy[len] = '\0';
+    loader->pending += frontierPush(loader->frontier, copy, depth) == 0;
+}
+
+/*
+    Restore the state an earlier run left in the journal's directory.
+
+    Preconditions:  'journal' was returned by journalOpen() and nothing was recorded since; 'visited' and
+                    'frontier' are the crawl's visited set and frontier.
+    Postcondition:  The fingerprints of the finished URLs are in 'visited' and the URLs still to fetch are on
+                    'frontier' at their link depth (a URL queued twice in the log is pushed twice). 'done' and
+                    'pending' hold their numbers. Returns 0, or -1 if the snapshot is damaged.
+*/
+int journalLoad(Journal *journal, VisitedSet *visited, Frontier *frontier, long *done, long *pending)
+{
+    Loader loader = { visited, frontier, 0, 0 };
+    Mapping snapshot;
+    SnapshotHeader header;
+
+    pthread_mutex_lock(&journal->compactLock);
+    int result = mapSnapshot(journal, &snapshot, &header);
+    if (result == 0)
+    {
+        long from = journal->snapshotSegment + 1, to = journal->firstSegment - 1;
+        walkState(journal, &snapshot, from, to, 0, loadRecord, &loader);   // Finished URLs first
+        walkState(journal, &snapshot, from, to, 1, loadRecord, &loader);   // so none of them is queued again
+        unmapFile(&snapshot);
+    }
+    pthread_mutex_unlock(&journal->compactLock);
+
+    *done = loader.done;
+    *pending = loader.pending;
+    return result;
+}
+
+/*
+    Discard the state in the journal's directory, for a crawl that starts over.
+
+    Preconditions:  'journal' was returned by journalOpen(), or is NULL to do nothing.
+    Postcondition:  The snapshot and every segment are deleted, including what was recorded so far. Returns 0,
+                    or -1 if a file could not be deleted.
+*/
+int journalReset(Journal *journal)
+{
+    if (journal == NULL)
+        return 0;
+    rotateSegment(journal);
+    pthread_mutex_lock(&journal->compactLock);
+    int result = 0;
+    char path[PATH_BYTES];
+    filePath(journal, SNAPSHOT_NAME, path);
+    if (unlink(path) != 0 && errno != ENOENT)
+        result = -1;
+    long upTo = atomic_load(&journal->segment) - 1;
+    for (long segment = journal->oldestSegment; segment <= upTo; segment++)
+    {
+        segmentPath(journal, segment, path);
+        if (unlink(path) != 0 && errno != ENOENT)
+            result = -1;
+    }
+    syncDir(journal);
+    journal->snapshotSegment = upTo;
+    journal->oldestSegment = upTo + 1;
+    journal->hasState = 0;
+    pthread_mutex_unlock(&journal->compactLock);
+
+    pthread_mutex_lock(&journal->lock);
+    journal->snapshotBytes = 0;
+    journal->closedBytes = 0;
+    pthread_mutex_unlock(&journal->lock);
+    return result;
+}
+
+/*
+    Record that a URL was queued at link depth 'depth'. Safe to call from any number of threads.
+
+    Preconditions:  'journal' was returned by journalOpen(), or is NULL to record nothing.
+    Postcondition:  The record is on its way to the log; URLs that are empty, longer than FRONTIER_MAX_URL - 1
+                    bytes or deeper than 65534 are not recorded.
+*/
+void journalQueued(Journal *journal, const char *url, int depth)
+{
+    if (journal == NULL)
+        return;
+    size_t len = strlen(url);
+    if (len == 0 || len >= FRONTIER_MAX_URL || depth < 0 || depth >= DONE_DEPTH)
+        return;
+    appendRecord(journal, depth, url, len);
+    atomic_fetch_add(&journal->queued, 1);
+}
+
+/*
+    Record that a URL is finished, fetched or given up on. Safe to call from any number of threads.
+
+    Preconditions:  'journal' was returned by journalOpen(), or is NULL to record nothing.
+    Postcondition:  The record is on its way to the log.
+*/
+void journalDone(Journal *journal, const char *url)
+{
+    if (journal == NULL)
+        return;
+    uint64_t fingerprint = urlFingerprint(url);
+    appendRecord(journal, DONE_DEPTH, &fingerprint, 8);
+    atomic_fetch_add(&journal->done, 1);
+}
+
+/*
+    Write a snapshot now, holding everything recorded so far.
+
+    Preconditions:  'journal' was returned by journalOpen().
+    Postcondition:  Returns 0 and every segment written so far is merged into the snapshot and deleted, or -1
+                    if the snapshot could not be written.
+*/
+int journalCompact(Journal *journal)
+{
+    rotateSegment(journal);
+    pthread_mutex_lock(&journal->compactLock);
+    int result = compact(journal);
+    pthread_mutex_unlock(&journal->compactLock);
+    return result;
+}
+
+// Counters of the journal (a snapshot while other threads are active)
+void journalStats(const Journal *journal, JournalStats *stats)
+{
+    Journal *j = (Journal *)journal;
+    stats->queued = atomic_load(&j->queued);
+    stats->done = atomic_load(&j->done);
+    stats->bytes = atomic_load(&j->bytes);
+    stats->writes = atomic_load(&j->writes);
+    stats->syncs = atomic_load(&j->syncs);
+    stats->waits = atomic_load(&j->waits);
+    stats->compactions = atomic_load(&j->compactions);
+    stats->compactSeconds = atomic_load(&j->compactUs) / 1e6;
+}
+
+/*
+    Close the journal.
+
+    Preconditions:  'journal' was returned by journalOpen() and no other thread uses it, or is NULL.
+    Postcondition:  Every record is written, synced unless the policy is JOURNAL_SYNC_NONE, the threads have
+                    exited and all memory is released. The state stays in the directory for the next run.
+*/
+void journalClose(Journal *journal)
+{
+    if (journal == NULL)
+        return;
+
+    pthread_mutex_lock(&journal->lock);
+    journal->stop = 1;
+    pthread_cond_signal(&journal->wake);
+    pthread_mutex_unlock(&journal->lock);
+    pthread_join(journal->writer, NULL);
+
+    pthread_mutex_lock(&journal->lock);
+    journal->compactStop = 1;
+    pthread_cond_signal(&journal->compactWake);
+    pthread_mutex_unlock(&journal->lock);
+    if (journal->hasCompactor)
+        pthread_join(journal->compactor, NULL);
+
+    pthread_mutex_destroy(&journal->lock);
+    pthread_mutex_destroy(&journal->compactLock);
+    pthread_cond_destroy(&journal->wake);
+    pthread_cond_destroy(&journal->written);
+    pthread_cond_destroy(&journal->compactWake);
+    free(journal->buf);
+    free(journal->spare);
+    free(journal);
+}
@@ -0,0 +1,62 @@
+/*
+Operating Systems Spring 2024
+Final Project
+
+Journal: crawl state kept on disk, a write-ahead log of queued and finished URLs with snapshots.
+*/
+
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <stddef.h>
+
+#include "frontier.h"
+#include "visited.h"
+
+// When the log is forced to disk with fdatasync()
+typedef enum
+{
+    JOURNAL_SYNC_NONE,          // Never: the kernel writes it back, a process crash loses nothing, a power cut may
+    JOURNAL_SYNC_INTERVAL,      // At most every 'syncMs'
+    JOURNAL_SYNC_BATCH          // After every batch the writer thread writes
+} JournalSync;
+
+// Settings for journalOpen()
+typedef struct
+{
+    const char *dir;            // Directory of the snapshot and the log segments, created if needed
+    JournalSync sync;
+    int syncMs;                 // Interval of JOURNAL_SYNC_INTERVAL
+    int flushMs;                // Longest time a record waits in memory before it is written
+    size_t segmentBytes;        // Size at which a log segment is closed and a new one started
+    int autoCompact;            // 1 to merge closed segments into the snapshot in the background
+} JournalConfig;
+
+// Counters of a journal since journalOpen()
+typedef struct
+{
+    long queued;                // Queued-URL records
+    long done;                  // Finished-URL records
+    long bytes;                 // Bytes written to the log
+    long writes;                // write() calls
+    long syncs;                 // fdatasync() calls
+    long waits;                 // Records that waited for the writer because both buffers were full
+    long compactions;           // Snapshots written
+    double compactSeconds;      // Time spent writing them
+} JournalStats;
+
+typedef struct Journal Journal;
+
+// Function prototypes
+void journalConfigDefaults(JournalConfig *config);
+Journal *journalOpen(const JournalConfig *config);
+int journalHasState(const Journal *journal);
+int journalLoad(Journal *journal, VisitedSet *visited, Frontier *frontier, long *done, long *pending);
+int journalReset(Journal *journal);
+void journalQueued(Journal *journal, const char *url, int depth);
+void journalDone(Journal *journal, const char *url);
+int journalCompact(Journal *journal);
+void journalStats(const Journal *journal, JournalStats *stats);
+void journalClose(Journal *journal);
+
+#endif
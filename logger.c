@@ -0,0 +1,523 @@
+/*
+Operating Systems Spring 2024
+Final Project
+
+Logger: crawl events written to the log file by a background thread.
+
+Every thread that logs gets a ring buffer of its own, so logEvent() takes no lock and makes no
+system call: it copies the record into the ring and publishes it with one release store. A full
+ring drops the record and counts the drop rather than making the worker wait. One writer thread
+drains the rings, formats the records into a large buffer and hands it to write() on a descriptor
+that stays open, once 64 KB have piled up or the oldest record has waited 'flushMs'. Rings of
+threads that exit are taken over by the next threads that log.
+*/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "logger.h"
+
+// Output buffer of the writer thread and the amount that triggers a write()
+#define OUT_CAPACITY (1024 * 1024)
+#define OUT_FLUSH (64 * 1024)
+
+// Time the writer sleeps when every ring is empty, doubled while they stay empty
+#define IDLE_SLEEP_MS 1
+#define MAX_IDLE_SLEEP_MS 8
+
+// Set in Record.size for padding that skips to the start of the ring
+#define PAD_RECORD 0x80000000u
+
+// Record as stored in a ring, followed by the event, status and URL bytes
+typedef struct
+{
+    uint32_t size;              // Bytes taken in the ring, a multiple of 8, or PAD_RECORD | bytes to skip
+    int32_t depth;              // Link depth, -1 if none
+    uint64_t timeNs;            // Nanoseconds since the epoch
+    uint16_t eventLen;
+    uint16_t statusLen;
+    uint16_t urlLen;
+    uint8_t level;
+    uint8_t hasStatus;          // 1 if a status was given, even an empty one
+} Record;
+
+// Single-producer single-consumer ring of one logging thread
+typedef struct Ring
+{
+    _Alignas(64) atomic_size_t head;    // Bytes published by the producer, never wraps
+    _Alignas(64) atomic_size_t tail;    // Bytes consumed by the writer, never wraps
+    _Alignas(64) atomic_long dropped;   // Records that did not fit
+    atomic_int owned;                   // 1 while a thread logs into the ring
+    size_t size;                        // Bytes in 'data', a power of two
+    char *data;
+    struct Ring *next;                  // Next ring of the logger
+} Ring;
+
+static struct
+{
+    atomic_int open;            // 1 between logOpen() and logClose()
+    atomic_int level;           // Most verbose level written
+    LogConfig config;
+    int fd;                     // Log file
+    pthread_t thread;           // Writer thread
+    atomic_int stop;            // Tells the writer to drain the rings and exit
+    _Atomic(Ring *) rings;      // Every ring, newest first
+    atomic_long dropped;        // Drops of rings already freed, and records without a ring
+    atomic_long flushRequested; // Incremented by logFlush()
+    atomic_long flushDone;      // Highest request the writer has completed
+    atomic_long records, writes, bytes;
+    char *out;                  // Output buffer of the writer
+    size_t outLen;
+    time_t second;              // Second formatted in 'timeString'
+    char timeString[32];
+} logger;
+
+static pthread_key_t ringKey;
+static pthread_once_t keyOnce = PTHREAD_ONCE_INIT;
+static _Thread_local Ring *threadRing;
+
+/*
+    Fill a LogConfig with the crawler's default settings.
+
+    Preconditions:  'config' points to a valid LogConfig structure.
+    Postcondition:  Every event is written as text to crawler.log, appended to what is there.
+*/
+void logConfigDefaults(LogConfig *config)
+{
+    config->path = "crawler.log";
+    config->truncate = 0;
+    config->level = LOG_DEBUG;
+    config->format = LOG_FORMAT_TEXT;
+    config->ringSize = 256 * 1024;
+    config->flushMs = 100;
+}
+
+// Thread exit: leave the thread's ring to the next thread that logs; the writer still drains it
+static void releaseRing(void *ring)
+{
+    atomic_store_explicit(&((Ring *)ring)->owned, 0, memory_order_release);
+}
+
+static void createKey(void)
+{
+    pthread_key_create(&ringKey, releaseRing);
+}
+
+// Ring of the calling thread: take over one left by an exited thread, or add a new one
+static Ring *attachRing(void)
+{
+    Ring *ring;
+    for (ring = atomic_load(&logger.rings); ring != NULL; ring = ring->next)
+    {
+        int expected = 0;
+        if (atomic_compare_exchange_strong(&ring->owned, &expected, 1))
+            break;
+    }
+
+    if (ring == NULL)
+    {
+        size_t size = 4096;
+        while (size < logger.config.ringSize)
+            size <<= 1;
+        ring = calloc(1, sizeof(Ring));
+        char *data = malloc(size);
+        if (ring == NULL || data == NULL)
+        {
+            free(ring);
+            free(data);
+            return NULL;
+        }
+        ring->size = size;
+        ring->data = data;
+        atomic_init(&ring->owned, 1);
+        Ring *first = atomic_load(&logger.rings);
+        do
+            ring->next = first;
+        while (!atomic_compare_exchange_weak(&logger.rings, &first, ring));
+    }
+
+    pthread_setspecific(ringKey, ring);
+    threadRing = ring;
+    return ring;
+}
+
+// 1 if a record of 'level' would be written, so callers can skip building it
+int logEnabled(LogLevel level)
+{
+    return atomic_load_explicit(&logger.open, memory_order_relaxed) &&
+           (int)level <= atomic_load_explicit(&logger.level, memory_order_relaxed);
+}
+
+/*
+    Log an event.
+
+    Description:
+    Copies the event into the calling thread's ring buffer; the writer thread formats and writes it later.
+    Takes no lock and makes no system call. If the ring is full the event is dropped and counted.
+
+    Preconditions:
+    - level: verbosity of the event; it is ignored if the logger is not open or set less verbose.
+    - event: what happened. url: the URL concerned, "" if none.
+    - status: the status of the event (optional, NULL if none).
+    - depth: the link depth of the URL, -1 if none.
+
+    Postcondition:
+    The event is queued for the log file, or counted as dropped.
+*/
+void logEvent(LogLevel level, const char *event, const char *url, const char *status, int depth)
+{
+    if (!logEnabled(level))
+        return;
+
+    Ring *ring = threadRing;
+    if (ring == NULL && (ring = attachRing()) == NULL)
+    {
+        atomic_fetch_add_explicit(&logger.dropped, 1, memory_order_relaxed);
+        return;
+    }
+
+    size_t eventLen = strnlen(event, UINT16_MAX);
+    size_t statusLen = status ? strnlen(status, UINT16_MAX) : 0;
+    size_t urlLen = url ? strnlen(url, UINT16_MAX) : 0;
+    size_t need = (sizeof(Record) + eventLen + statusLen + urlLen + 7) & ~(size_t)7;
+
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    size_t offset = head & (ring->size - 1);
+    size_t contiguous = ring->size - offset;
+    size_t total = need <= contiguous ? need : contiguous + need;   // Wrapping wastes the end of the ring
+
+    if (ring->size - (head - tail) < total)   // Full: drop rather than wait for the writer
+    {
+        atomic_fetch_add_explicit(&ring->dropped, 1, memory_order_relaxed);
+        return;
+    }
+
+    if (need > contiguous)                    // Skip the end of the ring
+    {
+        uint32_t pad = PAD_RECORD | (uint32_t)contiguous;
+        memcpy(ring->data + offset, &pad, sizeof(pad));
+        offset = 0;
+    }
+
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+
+    Record record;
+    record.size = (uint32_t)need;
+    record.depth = depth;
+    record.timeNs = (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+    record.eventLen = (uint16_t)eventLen;
+    record.statusLen = (uint16_t)statusLen;
+    record.urlLen = (uint16_t)urlLen;
+    record.level = (uint8_t)level;
+    record.hasStatus = status != NULL;
+
+    char *p = ring->data + offset;
+    memcpy(p, &record, sizeof(record));
+    p += sizeof(record);
+    memcpy(p, event, eventLen);
+    memcpy(p + eventLen, status ? status : "", statusLen);
+    memcpy(p + eventLen + statusLen, url ? url : "", urlLen);
+
+    atomic_store_explicit(&ring->head, head + total, memory_order_release);   // Publish
+}
+
+// Hand the output buffer to the file
+static void writeOut(void)
+{
+    size_t done = 0;
+    while (done < logger.outLen)
+    {
+        ssize_t n = write(logger.fd, logger.out + done, logger.outLen - done);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+        {
+            fprintf(stderr, "Error writing log file\n");
+            break;
+        }
+        done += (size_t)n;
+        atomic_fetch_add_explicit(&logger.writes, 1, memory_order_relaxed);
+    }
+    atomic_fetch_add_explicit(&logger.bytes, (long)done, memory_order_relaxed);
+    logger.outLen = 0;
+}
+
+static void append(const void *data, size_t len)
+{
+    memcpy(logger.out + logger.outLen, data, len);
+    logger.outLen += len;
+}
+
+static void appendLe(uint64_t value, int bytes)
+{
+    for (int i = 0; i < bytes; i++)
+        logger.out[logger.outLen++] = (char)(value >> (8 * i));
+}
+
+// Format one record into the output buffer
+static void formatRecord(const Record *record, const char *strings)
+{
+    const char *event = strings;
+    const char *status = event + record->eventLen;
+    const char *url = status + record->statusLen;
+
+    size_t worst = 96 + record->eventLen + record->statusLen + record->urlLen;
+    if (logger.outLen + worst > OUT_CAPACITY)
+        writeOut();
+
+    if (logger.config.format == LOG_FORMAT_BINARY)
+    {
+        appendLe(record->timeNs, 8);
+        appendLe((uint32_t)record->depth, 4);
+        appendLe(record->level, 1);
+        appendLe(0, 1);
+        appendLe(record->eventLen, 2);
+        appendLe(record->statusLen, 2);
+        appendLe(record->urlLen, 2);
+        append(strings, (size_t)record->eventLen + record->statusLen + record->urlLen);
+        return;
+    }
+
+    // Same lines logEvent always wrote: "[time] event: url", then status and depth if given
+    time_t second = (time_t)(record->timeNs / 1000000000u);
+    if (second != logger.second || logger.timeString[0] == '\0')
+    {
+        struct tm localTime;
+        localtime_r(&second, &localTime);
+        strftime(logger.timeString, sizeof(logger.timeString), "%Y-%m-%d %H:%M:%S", &localTime);
+        logger.second = second;
+    }
+
+    append("[", 1);
+    append(logger.timeString, strlen(logger.timeString));
+    append("] ", 2);
+    append(event, record->eventLen);
+    append(": ", 2);
+    append(url, record->urlLen);
+    append("\n", 1);
+    if (record->hasStatus)
+    {
+        append("\tStatus: ", 9);
+        append(status, record->statusLen);
+        append("\n", 1);
+    }
+    if (record->depth >= 0)
+    {
+        char depth[32];
+        int n = snprintf(depth, sizeof(depth), "\tDepth: %d\n", record->depth);
+        append(depth, (size_t)n);
+    }
+}
+
+// Move every published record of every ring into the output buffer; returns the number of records
+static long drainRings(void)
+{
+    long count = 0;
+    for (Ring *ring = atomic_load(&logger.rings); ring != NULL; ring = ring->next)
+    {
+        size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+        size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+        while (tail != head)
+        {
+            const char *p = ring->data + (tail & (ring->size - 1));
+            uint32_t size;
+            memcpy(&size, p, sizeof(size));
+            if (size & PAD_RECORD)
+            {
+                tail += size & ~PAD_RECORD;
+                continue;
+            }
+            Record record;
+            memcpy(&record, p, sizeof(record));
+            formatRecord(&record, p + sizeof(record));
+            tail += size;
+            count++;
+        }
+        atomic_store_explicit(&ring->tail, tail, memory_order_release);   // Space is free for the producer again
+    }
+    atomic_fetch_add_explicit(&logger.records, count, memory_order_relaxed);
+    return count;
+}
+
+static long long nowMs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// Writer thread: drain, batch, write
+static void *writerThread(void *arg)
+{
+    (void)arg;
+    long long firstPending = 0;       // When the oldest unwritten output was formatted
+    long idleMs = IDLE_SLEEP_MS;      // Next sleep when the rings are empty
+
+    while (1)
+    {
+        int stopping = atomic_load(&logger.stop);
+        long flushRequest = atomic_load(&logger.flushRequested);
+        long drained = drainRings();
+
+        if (drained > 0 && firstPending == 0)
+            firstPending = nowMs();
+        if (logger.outLen > 0 && (stopping || logger.outLen >= OUT_FLUSH || flushRequest != atomic_load(&logger.flushDone) ||
+                                  nowMs() - firstPending >= logger.config.flushMs))
+        {
+            writeOut();
+            firstPending = 0;
+        }
+        atomic_store(&logger.flushDone, flushRequest);
+
+        if (stopping)
+            break;
+        if (drained == 0)
+        {
+            struct timespec idle = { 0, idleMs * 1000000L };
+            nanosleep(&idle, NULL);
+            if (idleMs < MAX_IDLE_SLEEP_MS)
+                idleMs *= 2;
+        }
+        else
+        {
+            idleMs = IDLE_SLEEP_MS;
+        }
+    }
+    return NULL;
+}
+
+/*
+    Open the log file and start the writer thread.
+
+    Preconditions:  'config' points to a valid LogConfig; the logger is not open.
+    Postcondition:  Returns 0 and logEvent() writes to the file, or -1 if the file or thread could not be created.
+                    A new or truncated binary log starts with LOG_BINARY_MAGIC.
+*/
+int logOpen(const LogConfig *config)
+{
+    if (atomic_load(&logger.open))
+        return -1;
+    pthread_once(&keyOnce, createKey);
+
+    logger.config = *config;
+    logger.fd = open(config->path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC | (config->truncate ? O_TRUNC : 0), 0644);
+    if (logger.fd < 0)
+    {
+        fprintf(stderr, "Error opening log file\n");
+        return -1;
+    }
+    logger.out = malloc(OUT_CAPACITY);
+    if (logger.out == NULL)
+    {
+        close(logger.fd);
+        return -1;
+    }
+    logger.outLen = 0;
+    logger.timeString[0] = '\0';
+    if (config->format == LOG_FORMAT_BINARY && lseek(logger.fd, 0, SEEK_END) == 0)
+        append(LOG_BINARY_MAGIC, 8);
+
+    atomic_store(&logger.stop, 0);
+    atomic_store(&logger.dropped, 0);
+    atomic_store(&logger.records, 0);
+    atomic_store(&logger.writes, 0);
+    atomic_store(&logger.bytes, 0);
+    for (Ring *ring = atomic_load(&logger.rings); ring != NULL; ring = ring->next)
+        atomic_store(&ring->dropped, 0);
+
+    if (pthread_create(&logger.thread, NULL, writerThread, NULL) != 0)
+    {
+        free(logger.out);
+        close(logger.fd);
+        return -1;
+    }
+    atomic_store(&logger.level, (int)config->level);
+    atomic_store(&logger.open, 1);
+    return 0;
+}
+
+/*
+    Wait until every event logged so far by the calling thread is in the file.
+
+    Preconditions:  None; does nothing if the logger is not open.
+    Postcondition:  The writer has drained the rings and written its buffer at least once since the call.
+*/
+void logFlush(void)
+{
+    if (!atomic_load(&logger.open))
+        return;
+    long request = atomic_fetch_add(&logger.flushRequested, 1) + 1;
+    while (atomic_load(&logger.flushDone) < request)
+    {
+        struct timespec wait = { 0, IDLE_SLEEP_MS * 1000000L };
+        nanosleep(&wait, NULL);
+    }
+}
+
+// Counters since the last logOpen(), still valid after logClose()
+void logStats(LogStats *stats)
+{
+    stats->records = atomic_load(&logger.records);
+    stats->writes = atomic_load(&logger.writes);
+    stats->bytes = atomic_load(&logger.bytes);
+    stats->dropped = atomic_load(&logger.dropped);
+    for (Ring *ring = atomic_load(&logger.rings); ring != NULL; ring = ring->next)
+        stats->dropped += atomic_load(&ring->dropped);
+}
+
+/*
+    Write what is left and close the log file.
+
+    Preconditions:  No other thread logs while the logger closes.
+    Postcondition:  Every queued event is in the file, the writer thread has exited and the rings of
+                    threads that have exited are released. Does nothing if the logger is not open.
+*/
+void logClose(void)
+{
+    if (!atomic_exchange(&logger.open, 0))
+        return;
+
+    atomic_store(&logger.stop, 1);
+    pthread_join(logger.thread, NULL);
+    close(logger.fd);
+    free(logger.out);
+    logger.out = NULL;
+
+    if (threadRing != NULL)                   // The calling thread is done with its ring too
+    {
+        releaseRing(threadRing);
+        pthread_setspecific(ringKey, NULL);
+        threadRing = NULL;
+    }
+
+    // Free the rings nobody owns; rings of threads still running stay for the next logOpen()
+    Ring *keep = NULL;
+    Ring *ring = atomic_exchange(&logger.rings, NULL);
+    while (ring != NULL)
+    {
+        Ring *next = ring->next;
+        if (atomic_load(&ring->owned))
+        {
+            ring->next = keep;
+            keep = ring;
+        }
+        else
+        {
+            atomic_fetch_add(&logger.dropped, atomic_load(&ring->dropped));   // Keep the count for logStats()
+            free(ring->data);
+            free(ring);
+        }
+        ring = next;
+    }
+    atomic_store(&logger.rings, keep);
+}
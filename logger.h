@@ -0,0 +1,70 @@
+/*
+Operating Systems Spring 2024
+Final Project
+
+Logger: crawl events written to the log file by a background thread.
+*/
+
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <stddef.h>
+
+// Verbosity levels, a record is kept if its level is at most the logger's level
+typedef enum
+{
+    LOG_ERROR,
+    LOG_WARN,
+    LOG_INFO,
+    LOG_DEBUG
+} LogLevel;
+
+// Record formats of the log file
+typedef enum
+{
+    LOG_FORMAT_TEXT,            // Readable lines, the format crawler.log always had
+    LOG_FORMAT_BINARY           // Compact records, see below
+} LogFormat;
+
+/*
+    Binary format: the file starts with the 8 bytes LOG_BINARY_MAGIC, then one record per event,
+    all integers little-endian:
+      uint64  time            nanoseconds since the epoch
+      int32   depth           link depth, -1 if none
+      uint8   level           LogLevel
+      uint8   reserved
+      uint16  eventLen, statusLen, urlLen
+      bytes   event, status, url (no terminators)
+*/
+#define LOG_BINARY_MAGIC "WCLOG01\n"
+
+// Settings for logOpen()
+typedef struct
+{
+    const char *path;           // Log file
+    int truncate;               // 1 to start a new file, 0 to append
+    LogLevel level;             // Most verbose level written
+    LogFormat format;
+    size_t ringSize;            // Bytes of the ring buffer of each logging thread
+    int flushMs;                // Longest time a record waits before it is written
+} LogConfig;
+
+// Counters of the logger since the last logOpen()
+typedef struct
+{
+    long records;               // Records written to the file
+    long dropped;               // Records dropped because a ring was full
+    long writes;                // write() calls
+    long bytes;                 // Bytes written
+} LogStats;
+
+// Function prototypes
+void logConfigDefaults(LogConfig *config);
+int logOpen(const LogConfig *config);
+void logEvent(LogLevel level, const char *event, const char *url, const char *status, int depth);
+int logEnabled(LogLevel level);
+void logFlush(void);
+void logStats(LogStats *stats);
+void logClose(void);
+
+#endif
@@ -0,0 +1,275 @@
+/*
+Operating Systems Spring 2024
+Final Project
+
+Memory pools: recycled response buffers and arenas for short-lived strings.
+
+A BufferPool keeps response buffers in power-of-two size classes. A body that outgrows its
+buffer moves to the next class, so a page of n bytes is copied O(log n) times instead of once
+per chunk, and the buffers handed back after a page serve the next pages without malloc().
+An Arena hands out memory by bumping a pointer through 4 KB blocks; resetting it gives all of
+its blocks back to the ArenaPool of its thread at once, so nothing is freed string by string.
+Pools belong to one thread and take no locks.
+*/
+
+#include <stdalign.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mempool.h"
+
+struct ArenaBlock
+{
+    ArenaBlock *next;               // Next block of the arena or of the pool's free list
+    size_t size;                    // Usable bytes in 'data'
+    size_t used;                    // Bytes handed out
+    max_align_t data[];             // Memory handed out, suitably aligned for any type
+};
+
+// Usable bytes of a standard block
+#define BLOCK_CAPACITY (ARENA_BLOCK_SIZE - sizeof(ArenaBlock))
+
+/*
+    Initialize an empty buffer pool.
+
+    Preconditions:  'pool' points to a BufferPool that is not in use.
+    Postcondition:  The pool holds no buffers and will retain at most 'maxRetained' bytes.
+*/
+void bufferPoolInit(BufferPool *pool, size_t maxRetained)
+{
+    memset(pool, 0, sizeof(*pool));
+    pool->maxRetained = maxRetained;
+}
+
+// Size class of a buffer of at least 'size' bytes, or -1 if it is larger than any class
+static int sizeClass(size_t size)
+{
+    int c = 0;
+    while (c < BUFFER_CLASSES && ((size_t)BUFFER_MIN_SIZE << c) < size)
+        c++;
+    return c < BUFFER_CLASSES ? c : -1;
+}
+
+/*
+    Take a buffer of at least 'size' bytes from the pool.
+
+    Preconditions:  'pool' was initialized with bufferPoolInit().
+    Postcondition:  Returns the buffer and stores its usable size in 'capacity', or NULL if memory
+                    ran out. The buffer goes back with bufferPoolPut() and that capacity.
+*/
+char *bufferPoolGet(BufferPool *pool, size_t size, size_t *capacity)
+{
+    int c = sizeClass(size);
+    size_t cap = c >= 0 ? (size_t)BUFFER_MIN_SIZE << c : size;   // Oversized buffers are exact
+
+    if (c >= 0 && pool->free[c] != NULL)                           // Reuse a returned buffer
+    {
+        char *buffer = pool->free[c];
+        memcpy(&pool->free[c], buffer, sizeof(void *));            // Unlink, the next pointer is stored in the buffer
+        pool->retained -= cap;
+        pool->stats.reuses++;
+        *capacity = cap;
+        return buffer;
+    }
+
+    char *buffer = malloc(cap);
+    if (buffer == NULL)
+        return NULL;
+    pool->stats.mallocs++;
+    pool->stats.bytes += cap;
+    *capacity = cap;
+    return buffer;
+}
+
+/*
+    Make room for 'size' bytes in a buffer holding 'used' bytes.
+
+    Preconditions:  'buffer' came from bufferPoolGet() with 'capacity', or is NULL with a capacity of 0.
+    Postcondition:  Returns a buffer of at least 'size' bytes holding the same first 'used' bytes and
+                    updates 'capacity'; the old buffer is back in the pool if it was replaced.
+                    Returns NULL if memory ran out, the old buffer is then left untouched.
+*/
+char *bufferPoolGrow(BufferPool *pool, char *buffer, size_t used, size_t size, size_t *capacity)
+{
+    if (buffer != NULL && size <= *capacity)
+        return buffer;
+
+    size_t want = *capacity * 2 > size ? *capacity * 2 : size;     // At least double, so growth is geometric
+    size_t cap;
+    char *bigger = bufferPoolGet(pool, want, &cap);
+    if (bigger == NULL)
+        return NULL;
+    if (buffer != NULL)
+    {
+        memcpy(bigger, buffer, used);
+        bufferPoolPut(pool, buffer, *capacity);
+    }
+    *capacity = cap;
+    return bigger;
+}
+
+/*
+    Hand a buffer back to the pool.
+
+    Preconditions:  'buffer' came from bufferPoolGet() or bufferPoolGrow() with 'capacity', or is NULL.
+    Postcondition:  The buffer is kept for reuse, or released if it is oversized or the pool is full.
+*/
+void bufferPoolPut(BufferPool *pool, char *buffer, size_t capacity)
+{
+    if (buffer == NULL)
+        return;
+
+    int c = sizeClass(capacity);
+    if (c < 0 || ((size_t)BUFFER_MIN_SIZE << c) != capacity || pool->retained + capacity > pool->maxRetained)
+    {
+        free(buffer);
+        return;
+    }
+    memcpy(buffer, &pool->free[c], sizeof(void *));                // Link through the buffer itself
+    pool->free[c] = buffer;
+    pool->retained += capacity;
+}
+
+/*
+    Release every buffer held by the pool.
+
+    Preconditions:  'pool' was initialized with bufferPoolInit().
+    Postcondition:  The free lists are empty; buffers still handed out are not affected.
+*/
+void bufferPoolDestroy(BufferPool *pool)
+{
+    for (int c = 0; c < BUFFER_CLASSES; c++)
+    {
+        while (pool->free[c] != NULL)
+        {
+            char *buffer = pool->free[c];
+            memcpy(&pool->free[c], buffer, sizeof(void *));
+            free(buffer);
+        }
+    }
+    pool->retained = 0;
+}
+
+// Initialize an empty arena pool
+void arenaPoolInit(ArenaPool *pool)
+{
+    memset(pool, 0, sizeof(*pool));
+}
+
+/*
+    Release every block held by an arena pool.
+
+    Preconditions:  Every arena using the pool has been reset.
+    Postcondition:  The pool holds no memory.
+*/
+void arenaPoolDestroy(ArenaPool *pool)
+{
+    while (pool->free != NULL)
+    {
+        ArenaBlock *block = pool->free;
+        pool->free = block->next;
+        free(block);
+    }
+}
+
+// Initialize an empty arena drawing its blocks from 'pool'
+void arenaInit(Arena *arena, ArenaPool *pool)
+{
+    arena->pool = pool;
+    arena->blocks = NULL;
+}
+
+/*
+    Allocate 'size' bytes from an arena.
+
+    Preconditions:  'arena' was initialized with arenaInit().
+    Postcondition:  Returns memory aligned for any type that stays valid until arenaReset(), or NULL
+                    if memory ran out. Requests larger than a block get a block of their own.
+*/
+void *arenaAlloc(Arena *arena, size_t size)
+{
+    size = (size + alignof(max_align_t) - 1) & ~(alignof(max_align_t) - 1);
+
+    ArenaBlock *block = arena->blocks;
+    if (block != NULL && block->size - block->used >= size)       // Fits in the current block
+    {
+        void *p = (char *)block->data + block->used;
+        block->used += size;
+        return p;
+    }
+
+    ArenaPool *pool = arena->pool;
+    if (size <= BLOCK_CAPACITY && pool->free != NULL)              // Reuse a block of the pool
+    {
+        block = pool->free;
+        pool->free = block->next;
+        pool->stats.reuses++;
+    }
+    else
+    {
+        size_t capacity = size <= BLOCK_CAPACITY ? BLOCK_CAPACITY : size;
+        block = malloc(sizeof(ArenaBlock) + capacity);
+        if (block == NULL)
+            return NULL;
+        block->size = capacity;
+        pool->stats.mallocs++;
+        pool->stats.bytes += sizeof(ArenaBlock) + capacity;
+    }
+    block->used = size;
+
+    if (arena->blocks != NULL && size > BLOCK_CAPACITY)            // Keep filling the current block
+    {
+        block->next = arena->blocks->next;
+        arena->blocks->next = block;
+    }
+    else
+    {
+        block->next = arena->blocks;
+        arena->blocks = block;
+    }
+    return block->data;
+}
+
+/*
+    Copy 'len' bytes of 's' into an arena as a null-terminated string.
+
+    Preconditions:  'arena' was initialized with arenaInit(), 's' holds at least 'len' bytes.
+    Postcondition:  Returns the copy, or NULL if memory ran out.
+*/
+char *arenaStrndup(Arena *arena, const char *s, size_t len)
+{
+    char *copy = arenaAlloc(arena, len + 1);
+    if (copy != NULL)
+    {
+        memcpy(copy, s, len);
+        copy[len] = '\0';
+    }
+    return copy;
+}
+
+/*
+    Free everything allocated from an arena.
+
+    Preconditions:  'arena' was initialized with arenaInit().
+    Postcondition:  The arena is empty; its standard blocks are back in the pool and blocks of
+                    oversized requests are released.
+*/
+void arenaReset(Arena *arena)
+{
+    ArenaPool *pool = arena->pool;
+    while (arena->blocks != NULL)
+    {
+        ArenaBlock *block = arena->blocks;
+        arena->blocks = block->next;
+        if (block->size == BLOCK_CAPACITY)
+        {
+            block->next = pool->free;
+            pool->free = block;
+        }
+        else
+        {
+            free(block);
+        }
+    }
+}
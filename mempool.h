@@ -0,0 +1,78 @@
+/*
+Operating Systems Spring 2024
+Final Project
+
+Memory pools: recycled response buffers and arenas for short-lived strings.
+*/
+
+#ifndef MEMPOOL_H
+#define MEMPOOL_H
+
+#include <stddef.h>
+
+// Smallest and largest buffer kept by a BufferPool; larger buffers are released when returned
+#define BUFFER_MIN_SIZE (4 * 1024)
+#define BUFFER_MAX_SIZE (32 * 1024 * 1024)
+#define BUFFER_CLASSES 14                   // Powers of two from BUFFER_MIN_SIZE to BUFFER_MAX_SIZE
+
+// Size of the blocks an arena allocates from
+#define ARENA_BLOCK_SIZE (4 * 1024)
+
+// What a pool asked the system allocator for, and how often it did not have to
+typedef struct
+{
+    long mallocs;           // Calls to malloc()
+    long reuses;            // Requests served from memory already owned
+    size_t bytes;           // Bytes obtained with malloc()
+} AllocStats;
+
+/*
+    Response buffers in power-of-two size classes, recycled between transfers.
+
+    A pool belongs to one thread and needs no locking. Buffers handed back are kept on the free
+    list of their class until 'maxRetained' bytes are held, then released.
+*/
+typedef struct
+{
+    void *free[BUFFER_CLASSES];     // Free list per size class, linked through the buffers
+    size_t retained;                // Bytes held on the free lists
+    size_t maxRetained;             // Limit on 'retained'
+    AllocStats stats;
+} BufferPool;
+
+typedef struct ArenaBlock ArenaBlock;
+
+/*
+    Blocks shared by the arenas of one thread.
+
+    Arenas take their blocks from here and give them all back when they are reset, so a thread
+    that keeps resetting arenas stops allocating once it holds as many blocks as it needs at once.
+*/
+typedef struct
+{
+    ArenaBlock *free;               // Blocks ready for reuse
+    AllocStats stats;
+} ArenaPool;
+
+// Bump allocator for strings that all die at the same time
+typedef struct
+{
+    ArenaPool *pool;                // Source of the blocks
+    ArenaBlock *blocks;             // Blocks in use, the current one first
+} Arena;
+
+// Function prototypes
+void bufferPoolInit(BufferPool *pool, size_t maxRetained);
+char *bufferPoolGet(BufferPool *pool, size_t size, size_t *capacity);
+char *bufferPoolGrow(BufferPool *pool, char *buffer, size_t used, size_t size, size_t *capacity);
+void bufferPoolPut(BufferPool *pool, char *buffer, size_t capacity);
+void bufferPoolDestroy(BufferPool *pool);
+
+void arenaPoolInit(ArenaPool *pool);
+void arenaPoolDestroy(ArenaPool *pool);
+void arenaInit(Arena *arena, ArenaPool *pool);
+void *arenaAlloc(Arena *arena, size_t size);
+char *arenaStrndup(Arena *arena, const char *s, size_t len);
+void arenaReset(Arena *arena);
+
+#endif
@@ -0,0 +1,843 @@
+/*
+Operating Systems Spring 2024
+Final Project
+
+Metrics: counters, latency histograms and a trace of the crawl, served in the Prometheus format and dumped for
+chrome://tracing.
+
+Every thread that records gets a shard of its own, like the rings of the logger: counters, gauges and
+histograms only its thread writes, so recording takes no lock and no atomic read-modify-write, just a
+relaxed load and store another thread may read at any time. Readers sum the shards. Shards of threads
+that exit are taken over by the next threads that record, so a long crawl with a growing and shrinking
+pool keeps a handful of them.
+
+Histograms are log-linear, as in HdrHistogram: values below 32 ns have a bucket each, and every power of
+two above is split into 32 buckets, so a value is counted within 1/32 (3%) of what it was, from
+nanoseconds up to 2^40 ns (18 minutes); longer values go to the last bucket. A histogram takes 9 KB per
+shard and recording into it costs a count-leading-zeros and two increments.
+
+With a port, a thread answers HTTP requests for /metrics on 127.0.0.1 with every metric in the Prometheus
+text format, the histograms with a fixed set of buckets from 10 us to 60 s. With a trace path, every shard
+also keeps up to 'traceEvents' events, written by metricsClose() as a Chrome trace (chrome://tracing or
+ui.perfetto.dev) with one track per thread; events with an ID are asynchronous, so the transfers a worker
+keeps in flight at once each get a row. While the metrics are not open, every call returns at once after
+one relaxed load.
+*/
+
+#include <errno.h>
+#include <poll.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include "metrics.h"
+
+// Histogram buckets: SUB_COUNT per power of two, up to 2^MAX_EXPONENT ns
+#define SUB_BITS 5
+#define SUB_COUNT (1 << SUB_BITS)
+#define MAX_EXPONENT 40
+#define BUCKETS ((MAX_EXPONENT - SUB_BITS + 1) * SUB_COUNT)
+
+// Gauges of the whole crawl registered at once at most
+#define MAX_GAUGES 16
+
+// Longest HTTP request read by the endpoint, and the time a client has to send it
+#define MAX_REQUEST 4096
+#define REQUEST_TIMEOUT_MS 1000
+
+// Upper bounds of the buckets served to Prometheus, in nanoseconds
+static const uint64_t EXPORT_BOUNDS[] = {
+    10000, 25000, 50000, 100000, 250000, 500000, 1000000, 2500000, 5000000, 10000000, 25000000, 50000000,
+    100000000, 250000000, 500000000, 1000000000, 2500000000ULL, 5000000000ULL, 10000000000ULL, 30000000000ULL,
+    60000000000ULL
+};
+#define EXPORT_BOUND_COUNT (sizeof(EXPORT_BOUNDS) / sizeof(EXPORT_BOUNDS[0]))
+
+// Names of the metrics in the Prometheus output
+static const struct
+{
+    const char *name;
+    const char *help;
+} COUNTER_NAMES[METRIC_COUNTERS] = {
+    { "crawler_pages_fetched_total", "Pages retrieved." },
+    { "crawler_pages_failed_total", "Pages that could not be retrieved." },
+    { "crawler_pages_not_modified_total", "Pages the server answered 304 Not Modified for." },
+    { "crawler_body_bytes_total", "Body bytes received." },
+    { "crawler_links_found_total", "Valid links found in the pages." },
+    { "crawler_fetch_retries_total", "Transfers started again after a failed attempt." },
+    { "crawler_connections_opened_total", "Connections opened." },
+    { "crawler_limit_cuts_total", "Halvings of a host's concurrency limit or the global one." },
+    { "crawler_breaker_trips_total", "Openings of a host's circuit breaker." },
+}, GAUGE_NAMES[METRIC_GAUGES] = {
+    { "crawler_fetches_in_flight", "Transfers in flight." },
+};
+
+// Histograms of one family follow each other; the help of a family is given with its first one
+static const struct
+{
+    const char *family;
+    const char *label;          // Label telling the family's histograms apart, NULL for none
+    const char *help;
+} HISTOGRAM_NAMES[METRIC_HISTOGRAMS] = {
+    { "crawler_fetch_stage_seconds", "stage=\"dns\"", "Time spent in each stage of a transfer." },
+    { "crawler_fetch_stage_seconds", "stage=\"connect\"", NULL },
+    { "crawler_fetch_stage_seconds", "stage=\"tls\"", NULL },
+    { "crawler_fetch_stage_seconds", "stage=\"ttfb\"", NULL },
+    { "crawler_fetch_stage_seconds", "stage=\"download\"", NULL },
+    { "crawler_fetch_seconds", NULL, "Time a transfer took in all." },
+    { "crawler_page_stage_seconds", "stage=\"parse\"", "Time spent on each stage of a page once it arrives." },
+    { "crawler_page_stage_seconds", "stage=\"extract\"", NULL },
+    { "crawler_lock_wait_seconds", "lock=\"scheduler\"", "Time spent waiting for a contended lock." },
+    { "crawler_lock_wait_seconds", "lock=\"pool\"", NULL },
+    { "crawler_lock_wait_seconds", "lock=\"pages\"", NULL },
+};
+
+// Latency histogram of one shard
+typedef struct
+{
+    _Atomic uint64_t count;     // Values recorded
+    _Atomic uint64_t sum;       // Their sum in nanoseconds
+    _Atomic uint64_t buckets[BUCKETS];
+} Histogram;
+
+// Trace event, with a name that outlives the trace and an optional URL in the shard's text
+typedef struct
+{
+    const char *name;
+    uint64_t start;             // Nanoseconds since metricsOpen()
+    uint64_t duration;
+    uint64_t id;                // Asynchronous event ID, 0 for an event of the thread itself
+    size_t url;                 // Offset of the URL in the shard's text, SIZE_MAX for none
+} TraceEvent;
+
+// Metrics of one recording thread
+typedef struct Shard
+{
+    _Atomic long counters[METRIC_COUNTERS];
+    _Atomic long gauges[METRIC_GAUGES];
+    Histogram histograms[METRIC_HISTOGRAMS];
+    TraceEvent *events;         // Trace events recorded, with tracing on
+    size_t eventCount, eventCapacity;
+    char *text;                 // URLs of the trace events, null-terminated one after the other
+    size_t textLen, textCapacity;
+    long dropped;               // Trace events not kept, the shard or memory being full
+    char name[32];              // Name of the thread's trace track
+    int index;                  // Number of the shard, its trace track
+    atomic_int owned;           // 1 while a thread records into the shard
+    struct Shard *next;         // Next shard of the metrics
+} Shard;
+
+// Gauge of the whole crawl
+typedef struct
+{
+    const char *name;
+    const char *help;
+    MetricsGaugeCallback read;
+    void *arg;
+} Gauge;
+
+static struct
+{
+    atomic_int open;            // 1 between metricsOpen() and metricsClose()
+    atomic_int tracing;         // 1 while trace events are kept
+    MetricsConfig config;
+    struct timespec started;    // Time of metricsOpen(), time 0 of the trace
+    _Atomic(Shard *) shards;    // Every shard, newest first
+    atomic_int shardCount;      // Shards created, numbering the next one
+    pthread_mutex_t gaugeLock;  // Guards 'gauges'
+    Gauge gauges[MAX_GAUGES];
+    int gaugeCount;
+    int listenFd;               // Socket of the endpoint, -1 for none
+    int stopPipe[2];            // Written by metricsClose() to stop the endpoint thread
+    int port;                   // Port the endpoint listens on
+    pthread_t thread;           // Endpoint thread
+} metrics = { .gaugeLock = PTHREAD_MUTEX_INITIALIZER, .listenFd = -1, .stopPipe = { -1, -1 } };
+
+static pthread_key_t shardKey;
+static pthread_once_t keyOnce = PTHREAD_ONCE_INIT;
+static _Thread_local Shard *threadShard;
+
+/*
+    Fill a MetricsConfig with the crawler's default settings.
+
+    Preconditions:  'config' points to a valid MetricsConfig structure.
+    Postcondition:  No endpoint and no trace; traces keep up to a million events per thread.
+*/
+void metricsConfigDefaults(MetricsConfig *config)
+{
+    config->port = -1;
+    config->tracePath = NULL;
+    config->traceEvents = 1 << 20;
+}
+
+// Thread exit: its gauges no longer count, and the shard goes to the next thread that records
+static void releaseShard(void *shard)
+{
+    Shard *s = (Shard *)shard;
+    for (int g = 0; g < METRIC_GAUGES; g++)
+        atomic_store_explicit(&s->gauges[g], 0, memory_order_relaxed);
+    atomic_store_explicit(&s->owned, 0, memory_order_release);
+}
+
+static void createKey(void)
+{
+    pthread_key_create(&shardKey, releaseShard);
+}
+
+// Shard of the calling thread: take over one left by an exited thread, or add a new one
+static Shard *attachShard(void)
+{
+    Shard *shard;
+    for (shard = atomic_load(&metrics.shards); shard != NULL; shard = shard->next)
+    {
+        int expected = 0;
+        if (atomic_compare_exchange_strong(&shard->owned, &expected, 1))
+            break;
+    }
+
+    if (shard == NULL)
+    {
+        shard = calloc(1, sizeof(Shard));
+        if (shard == NULL)
+            return NULL;
+        shard->index = atomic_fetch_add(&metrics.shardCount, 1);
+        snprintf(shard->name, sizeof(shard->name), "thread %d", shard->index);
+        atomic_init(&shard->owned, 1);
+        Shard *first = atomic_load(&metrics.shards);
+        do
+            shard->next = first;
+        while (!atomic_compare_exchange_weak(&metrics.shards, &first, shard));
+    }
+
+    pthread_setspecific(shardKey, shard);
+    threadShard = shard;
+    return shard;
+}
+
+// Shard of the calling thread, NULL if the metrics are not open or memory ran out
+static inline Shard *currentShard(void)
+{
+    if (!atomic_load_explicit(&metrics.open, memory_order_relaxed))
+        return NULL;
+    Shard *shard = threadShard;
+    return shard != NULL ? shard : attachShard();
+}
+
+// 1 between metricsOpen() and metricsClose(), so callers can skip timing what would not be recorded
+int metricsEnabled(void)
+{
+    return atomic_load_explicit(&metrics.open, memory_order_relaxed);
+}
+
+// 1 while trace events are kept
+int metricsTracing(void)
+{
+    return atomic_load_explicit(&metrics.tracing, memory_order_relaxed);
+}
+
+// Port of the Prometheus endpoint, -1 if there is none
+int metricsPort(void)
+{
+    return metrics.listenFd >= 0 ? metrics.port : -1;
+}
+
+// Monotonic time in nanoseconds, the clock of every duration and trace event
+uint64_t metricsNow(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+// Add 'n' to a counter of the calling thread
+void metricsCount(MetricCounter counter, long n)
+{
+    Shard *shard = currentShard();
+    if (shard == NULL)
+        return;
+    _Atomic long *c = &shard->counters[counter];
+    atomic_store_explicit(c, atomic_load_explicit(c, memory_order_relaxed) + n, memory_order_relaxed);
+}
+
+// Set the calling thread's value of a gauge
+void metricsSet(MetricGauge gauge, long value)
+{
+    Shard *shard = currentShard();
+    if (shard != NULL)
+        atomic_store_explicit(&shard->gauges[gauge], value, memory_order_relaxed);
+}
+
+// Bucket counting 'value'
+static int bucketOf(uint64_t value)
+{
+    if (value < SUB_COUNT)
+        return (int)value;
+    if (value >> MAX_EXPONENT)
+        return BUCKETS - 1;
+    int exponent = 63 - __builtin_clzll(value);
+    return (exponent - SUB_BITS + 1) * SUB_COUNT + (int)((value >> (exponent - SUB_BITS)) & (SUB_COUNT - 1));
+}
+
+// Largest value bucket 'bucket' counts
+static uint64_t bucketTop(int bucket)
+{
+    if (bucket < SUB_COUNT)
+        return (uint64_t)bucket;
+    int shift = bucket / SUB_COUNT - 1;
+    return (((uint64_t)(bucket % SUB_COUNT + SUB_COUNT) + 1) << shift) - 1;
+}
+
+static inline void bump(_Atomic uint64_t *value, uint64_t n)
+{
+    atomic_store_explicit(value, atomic_load_explicit(value, memory_order_relaxed) + n, memory_order_relaxed);
+}
+
+// Record a duration of 'ns' nanoseconds in a histogram of the calling thread
+void metricsRecord(MetricHistogram histogram, uint64_t ns)
+{
+    Shard *shard = currentShard();
+    if (shard == NULL)
+        return;
+    Histogram *h = &shard->histograms[histogram];
+    bump(&h->buckets[bucketOf(ns)], 1);
+    bump(&h->sum, ns);
+    bump(&h->count, 1);
+}
+
+/*
+    Lock a mutex, recording how long the calling thread waited if another thread held it.
+
+    Preconditions:  'mutex' is initialized and not held by the calling thread.
+    Postcondition:  The calling thread holds 'mutex'. An uncontended lock costs a trylock and records nothing.
+*/
+void metricsLock(pthread_mutex_t *mutex, MetricHistogram histogram)
+{
+    if (!atomic_load_explicit(&metrics.open, memory_order_relaxed))
+    {
+        pthread_mutex_lock(mutex);
+        return;
+    }
+    if (pthread_mutex_trylock(mutex) == 0)
+        return;
+    uint64_t start = metricsNow();
+    pthread_mutex_lock(mutex);
+    metricsRecord(histogram, metricsNow() - start);
+}
+
+// Copy a URL into the shard's text; its offset, or SIZE_MAX if memory ran out
+static size_t keepText(Shard *shard, const char *url)
+{
+    size_t len = strlen(url) + 1;
+    if (shard->textLen + len > shard->textCapacity)
+    {
+        size_t capacity = shard->textCapacity > 0 ? shard->textCapacity : 64 * 1024;
+        while (shard->textLen + len > capacity)
+            capacity *= 2;
+        char *text = realloc(shard->text, capacity);
+        if (text == NULL)
+            return SIZE_MAX;
+        shard->text = text;
+        shard->textCapacity = capacity;
+    }
+    memcpy(shard->text + shard->textLen, url, len);
+    shard->textLen += len;
+    return shard->textLen - len;
+}
+
+/*
+    Add an event to the trace of the calling thread.
+
+    Preconditions:  'name' outlives the metrics (a string literal); 'url' is NULL or a URL the event is about.
+                    'startNs' and 'durationNs' are on the clock of metricsNow(). 'id' is 0 for work of the thread
+                    itself, which must not overlap; events that overlap, such as transfers, need an ID each, and
+                    events with the same ID nest.
+    Postcondition:  The event is kept for the trace, or counted as dropped. Does nothing without a trace.
+*/
+void metricsTrace(const char *name, const char *url, uint64_t startNs, uint64_t durationNs, uint64_t id)
+{
+    if (!atomic_load_explicit(&metrics.tracing, memory_order_relaxed))
+        return;
+    Shard *shard = currentShard();
+    if (shard == NULL)
+        return;
+
+    if (shard->eventCount == shard->eventCapacity)
+    {
+        size_t capacity = shard->eventCapacity > 0 ? shard->eventCapacity * 2 : 4096;
+        if (capacity > metrics.config.traceEvents)
+            capacity = metrics.config.traceEvents;
+        TraceEvent *events = capacity > shard->eventCapacity ? realloc(shard->events, capacity * sizeof(TraceEvent))
+                                                             : NULL;
+        if (events == NULL)
+        {
+            shard->dropped++;
+            return;
+        }
+        shard->events = events;
+        shard->eventCapacity = capacity;
+    }
+
+    uint64_t origin = (uint64_t)metrics.started.tv_sec * 1000000000u + (uint64_t)metrics.started.tv_nsec;
+    TraceEvent *event = &shard->events[shard->eventCount++];
+    event->name = name;
+    event->start = startNs > origin ? startNs - origin : 0;
+    event->duration = durationNs;
+    event->id = id;
+    event->url = url != NULL ? keepText(shard, url) : SIZE_MAX;
+}
+
+// Name the trace track of the calling thread, e.g. "worker"; the shard number is appended
+void metricsThreadName(const char *name)
+{
+    Shard *shard = currentShard();
+    if (shard != NULL)
+        snprintf(shard->name, sizeof(shard->name), "%s %d", name, shard->index);
+}
+
+/*
+    Register a gauge of the whole crawl, read whenever the metrics are served.
+
+    Preconditions:  'name' and 'help' outlive the gauge; 'read' may be called from any thread until the gauge is
+                    removed with metricsRemoveGauges(arg).
+    Postcondition:  Returns 0, or -1 if MAX_GAUGES gauges are registered already.
+*/
+int metricsAddGauge(const char *name, const char *help, MetricsGaugeCallback read, void *arg)
+{
+    pthread_mutex_lock(&metrics.gaugeLock);
+    int added = metrics.gaugeCount < MAX_GAUGES;
+    if (added)
+        metrics.gauges[metrics.gaugeCount++] = (Gauge){ name, help, read, arg };
+    pthread_mutex_unlock(&metrics.gaugeLock);
+    return added ? 0 : -1;
+}
+
+// Remove every gauge registered with 'arg'; none of them is read once this returns
+void metricsRemoveGauges(void *arg)
+{
+    pthread_mutex_lock(&metrics.gaugeLock);
+    int kept = 0;
+    for (int i = 0; i < metrics.gaugeCount; i++)
+        if (metrics.gauges[i].arg != arg)
+            metrics.gauges[kept++] = metrics.gauges[i];
+    metrics.gaugeCount = kept;
+    pthread_mutex_unlock(&metrics.gaugeLock);
+}
+
+// Sum of a counter over every thread
+long metricsTotal(MetricCounter counter)
+{
+    long total = 0;
+    for (Shard *shard = atomic_load(&metrics.shards); shard != NULL; shard = shard->next)
+        total += atomic_load_explicit(&shard->counters[counter], memory_order_relaxed);
+    return total;
+}
+
+// Values recorded in a histogram by every thread
+long metricsSamples(MetricHistogram histogram)
+{
+    uint64_t count = 0;
+    for (Shard *shard = atomic_load(&metrics.shards); shard != NULL; shard = shard->next)
+        count += atomic_load_explicit(&shard->histograms[histogram].count, memory_order_relaxed);
+    return (long)count;
+}
+
+/*
+    Value below which a fraction of the durations recorded in a histogram fall, over every thread.
+
+    Preconditions:  0 <= 'quantile' <= 1.
+    Postcondition:  Returns the quantile in nanoseconds, within the 3% precision of the buckets, or 0 if nothing was
+                    recorded.
+*/
+uint64_t metricsQuantile(MetricHistogram histogram, double quantile)
+{
+    uint64_t merged[BUCKETS] = { 0 };
+    uint64_t total = 0;
+    for (Shard *shard = atomic_load(&metrics.shards); shard != NULL; shard = shard->next)
+    {
+        for (int b = 0; b < BUCKETS; b++)
+        {
+            uint64_t n = atomic_load_explicit(&shard->histograms[histogram].buckets[b], memory_order_relaxed);
+            merged[b] += n;
+            total += n;
+        }
+    }
+    if (total == 0)
+        return 0;
+
+    uint64_t rank = (uint64_t)(quantile * (double)total + 0.5);
+    if (rank < 1)
+        rank = 1;
+    uint64_t seen = 0;
+    for (int b = 0; b < BUCKETS; b++)
+    {
+        seen += merged[b];
+        if (seen >= rank)
+            return bucketTop(b);
+    }
+    return bucketTop(BUCKETS - 1);
+}
+
+// Write the metrics of one histogram family member: cumulative buckets, sum and count
+static void writeHistogram(FILE *out, MetricHistogram histogram)
+{
+    uint64_t cumulative[EXPORT_BOUND_COUNT] = { 0 };
+    uint64_t count = 0, sum = 0;
+    for (Shard *shard = atomic_load(&metrics.shards); shard != NULL; shard = shard->next)
+    {
+        const Histogram *h = &shard->histograms[histogram];
+        size_t bound = 0;
+        for (int b = 0; b < BUCKETS; b++)
+        {
+            uint64_t n = atomic_load_explicit(&h->buckets[b], memory_order_relaxed);
+            if (n == 0)
+                continue;
+            uint64_t top = bucketTop(b);
+            while (bound < EXPORT_BOUND_COUNT && EXPORT_BOUNDS[bound] < top)
+                bound++;
+            for (size_t i = bound; i < EXPORT_BOUND_COUNT; i++)
+                cumulative[i] += n;
+            count += n;
+        }
+        sum += atomic_load_explicit(&h->sum, memory_order_relaxed);
+    }
+
+    const char *family = HISTOGRAM_NAMES[histogram].family;
+    const char *label = HISTOGRAM_NAMES[histogram].label;
+    for (size_t i = 0; i < EXPORT_BOUND_COUNT; i++)
+        fprintf(out, "%s_bucket{%s%sle=\"%g\"} %llu\n", family, label != NULL ? label : "", label != NULL ? "," : "",
+                EXPORT_BOUNDS[i] / 1e9, (unsigned long long)cumulative[i]);
+    fprintf(out, "%s_bucket{%s%sle=\"+Inf\"} %llu\n", family, label != NULL ? label : "", label != NULL ? "," : "",
+            (unsigned long long)count);
+    fprintf(out, "%s_sum%s%s%s %.9f\n", family, label != NULL ? "{" : "", label != NULL ? label : "",
+            label != NULL ? "}" : "", sum / 1e9);
+    fprintf(out, "%s_count%s%s%s %llu\n", family, label != NULL ? "{" : "", label != NULL ? label : "",
+            label != NULL ? "}" : "", (unsigned long long)count);
+}
+
+/*
+    Write every metric in the Prometheus text format.
+
+    Preconditions:  'out' is open for writing.
+    Postcondition:  The counters and gauges summed over the threads, the gauges of the crawl and the histograms are
+                    written. May be called from any thread while others record.
+*/
+void metricsWrite(FILE *out)
+{
+    for (int c = 0; c < METRIC_COUNTERS; c++)
+        fprintf(out, "# HELP %s %s\n# TYPE %s counter\n%s %ld\n", COUNTER_NAMES[c].name, COUNTER_NAMES[c].help,
+                COUNTER_NAMES[c].name, COUNTER_NAMES[c].name, metricsTotal((MetricCounter)c));
+
+    for (int g = 0; g < METRIC_GAUGES; g++)
+    {
+        long total = 0;
+        for (Shard *shard = atomic_load(&metrics.shards); shard != NULL; shard = shard->next)
+            total += atomic_load_explicit(&shard->gauges[g], memory_order_relaxed);
+        fprintf(out, "# HELP %s %s\n# TYPE %s gauge\n%s %ld\n", GAUGE_NAMES[g].name, GAUGE_NAMES[g].help,
+                GAUGE_NAMES[g].name, GAUGE_NAMES[g].name, total);
+    }
+    pthread_mutex_lock(&metrics.gaugeLock);
+    for (int i = 0; i < metrics.gaugeCount; i++)
+    {
+        const Gauge *gauge = &metrics.gauges[i];
+        fprintf(out, "# HELP %s %s\n# TYPE %s gauge\n%s %ld\n", gauge->name, gauge->help, gauge->name, gauge->name,
+                gauge->read(gauge->arg));
+    }
+    pthread_mutex_unlock(&metrics.gaugeLock);
+
+    for (int h = 0; h < METRIC_HISTOGRAMS; h++)
+    {
+        if (HISTOGRAM_NAMES[h].help != NULL)
+            fprintf(out, "# HELP %s %s\n# TYPE %s histogram\n", HISTOGRAM_NAMES[h].family, HISTOGRAM_NAMES[h].help,
+                    HISTOGRAM_NAMES[h].family);
+        writeHistogram(out, (MetricHistogram)h);
+    }
+}
+
+// Send all of 'len' bytes to a socket; returns 0, or -1 on error
+static int sendAll(int fd, const char *data, size_t len)
+{
+    while (len > 0)
+    {
+        ssize_t n = send(fd, data, len, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return -1;
+        data += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+// Answer one HTTP request: the metrics for GET /metrics, 404 for anything else
+static void serveClient(int fd)
+{
+    char request[MAX_REQUEST];
+    size_t len = 0;
+    while (len < sizeof(request) - 1)           // Read up to the end of the headers
+    {
+        struct pollfd pfd = { fd, POLLIN, 0 };
+        if (poll(&pfd, 1, REQUEST_TIMEOUT_MS) <= 0)
+            return;
+        ssize_t n = recv(fd, request + len, sizeof(request) - 1 - len, 0);
+        if (n <= 0)
+            return;
+        len += (size_t)n;
+        request[len] = '\0';
+        if (strstr(request, "\r\n\r\n") != NULL || strstr(request, "\n\n") != NULL)
+            break;
+    }
+
+    char *body = NULL;
+    size_t bodyLen = 0;
+    int found = strncmp(request, "GET /metrics ", 13) == 0 || strncmp(request, "GET /metrics?", 13) == 0;
+    FILE *out = open_memstream(&body, &bodyLen);
+    if (out == NULL)
+        return;
+    if (found)
+        metricsWrite(out);
+    else
+        fputs("Not found, the metrics are at /metrics\n", out);
+    fclose(out);
+
+    char header[256];
+    int headerLen = snprintf(header, sizeof(header), "HTTP/1.1 %s\r\nContent-Type: text/plain; version=0.0.4; "
+                             "charset=utf-8\r\nContent-Length: %zu\r\nConnection: close\r\n\r\n",
+                             found ? "200 OK" : "404 Not Found", bodyLen);
+    if (sendAll(fd, header, (size_t)headerLen) == 0)
+        sendAll(fd, body, bodyLen);
+    free(body);
+}
+
+// Endpoint thread: answer one client at a time until metricsClose() writes to the stop pipe
+static void *endpointThread(void *arg)
+{
+    (void)arg;
+    struct pollfd fds[2] = { { metrics.listenFd, POLLIN, 0 }, { metrics.stopPipe[0], POLLIN, 0 } };
+    while (1)
+    {
+        if (poll(fds, 2, -1) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        if (fds[1].revents != 0)
+            break;
+        if (fds[0].revents & POLLIN)
+        {
+            int client = accept(metrics.listenFd, NULL, NULL);
+            if (client >= 0)
+            {
+                serveClient(client);
+                close(client);
+            }
+        }
+    }
+    return NULL;
+}
+
+// Listen on 127.0.0.1:'port' and start the endpoint thread; returns 0, or -1 after printing an error
+static int startEndpoint(int port)
+{
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+    {
+        perror("Metrics endpoint");
+        return -1;
+    }
+    int yes = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons((uint16_t)port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t size = sizeof(address);
+    if (bind(fd, (struct sockaddr *)&address, sizeof(address)) != 0 || listen(fd, 16) != 0 ||
+        getsockname(fd, (struct sockaddr *)&address, &size) != 0)
+    {
+        perror("Metrics endpoint");
+        close(fd);
+        return -1;
+    }
+    if (pipe(metrics.stopPipe) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+    metrics.listenFd = fd;
+    metrics.port = ntohs(address.sin_port);
+    if (pthread_create(&metrics.thread, NULL, endpointThread, NULL) != 0)
+    {
+        close(metrics.stopPipe[0]);
+        close(metrics.stopPipe[1]);
+        close(fd);
+        metrics.listenFd = -1;
+        return -1;
+    }
+    return 0;
+}
+
+/*
+    Start recording metrics.
+
+    Preconditions:  'config' points to a valid MetricsConfig; the metrics are not open.
+    Postcondition:  Returns 0 with every counter and histogram at zero and, with a port, the endpoint serving; or -1 if
+                    the endpoint could not be set up.
+*/
+int metricsOpen(const MetricsConfig *config)
+{
+    if (atomic_load(&metrics.open))
+        return -1;
+    pthread_once(&keyOnce, createKey);
+
+    metrics.config = *config;
+    clock_gettime(CLOCK_MONOTONIC, &metrics.started);
+    for (Shard *shard = atomic_load(&metrics.shards); shard != NULL; shard = shard->next)   // Left by running threads
+    {
+        for (int c = 0; c < METRIC_COUNTERS; c++)
+            atomic_store(&shard->counters[c], 0);
+        memset(shard->histograms, 0, sizeof(shard->histograms));
+        shard->eventCount = shard->textLen = 0;
+        shard->dropped = 0;
+    }
+    if (config->port >= 0 && startEndpoint(config->port) != 0)
+        return -1;
+    atomic_store(&metrics.tracing, config->tracePath != NULL && config->traceEvents > 0);
+    atomic_store(&metrics.open, 1);
+    return 0;
+}
+
+// Write a string as a JSON string
+static void writeJsonString(FILE *out, const char *s)
+{
+    fputc('"', out);
+    for (; *s != '\0'; s++)
+    {
+        unsigned char c = (unsigned char)*s;
+        if (c == '"' || c == '\\')
+            fprintf(out, "\\%c", c);
+        else if (c < 0x20)
+            fprintf(out, "\\u%04x", c);
+        else
+            fputc(c, out);
+    }
+    fputc('"', out);
+}
+
+// Write the trace events of every shard as a Chrome trace; returns 0, or -1 if the file could not be written
+static int writeTrace(const char *path)
+{
+    FILE *out = fopen(path, "w");
+    if (out == NULL)
+    {
+        perror(path);
+        return -1;
+    }
+
+    int pid = (int)getpid();
+    long dropped = 0;
+    const char *separator = "";
+    fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n", out);
+    for (Shard *shard = atomic_load(&metrics.shards); shard != NULL; shard = shard->next)
+    {
+        fprintf(out, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":", separator,
+                pid, shard->index);
+        writeJsonString(out, shard->name);
+        fputs("}}", out);
+        separator = ",\n";
+        for (size_t i = 0; i < shard->eventCount; i++)
+        {
+            const TraceEvent *event = &shard->events[i];
+            double start = event->start / 1e3, duration = event->duration / 1e3;   // Microseconds
+            if (event->id == 0)
+                fprintf(out, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f",
+                        event->name, pid, shard->index, start, duration);
+            else                                // Asynchronous: a begin and an end event
+                fprintf(out, ",\n{\"name\":\"%s\",\"cat\":\"fetch\",\"ph\":\"b\",\"id\":\"0x%llx\",\"pid\":%d,"
+                        "\"tid\":%d,\"ts\":%.3f", event->name, (unsigned long long)event->id, pid, shard->index, start);
+            if (event->url != SIZE_MAX)
+            {
+                fputs(",\"args\":{\"url\":", out);
+                writeJsonString(out, shard->text + event->url);
+                fputc('}', out);
+            }
+            fputc('}', out);
+            if (event->id != 0)
+                fprintf(out, ",\n{\"name\":\"%s\",\"cat\":\"fetch\",\"ph\":\"e\",\"id\":\"0x%llx\",\"pid\":%d,"
+                        "\"tid\":%d,\"ts\":%.3f}", event->name, (unsigned long long)event->id, pid, shard->index,
+                        start + duration);
+        }
+        dropped += shard->dropped;
+    }
+    fprintf(out, "\n],\"otherData\":{\"droppedEvents\":%ld}}\n", dropped);
+
+    int failed = ferror(out);
+    if (fclose(out) != 0 || failed)
+    {
+        fprintf(stderr, "Error writing trace file %s\n", path);
+        return -1;
+    }
+    return 0;
+}
+
+/*
+    Stop recording, stop the endpoint and write the trace.
+
+    Preconditions:  No other thread records while the metrics close.
+    Postcondition:  The endpoint thread has exited and the trace file is written; shards of threads that have exited
+                    are freed. Returns 0, or -1 if the trace could not be written. Does nothing if not open.
+*/
+int metricsClose(void)
+{
+    if (!atomic_exchange(&metrics.open, 0))
+        return 0;
+    atomic_store(&metrics.tracing, 0);
+
+    if (metrics.listenFd >= 0)
+    {
+        if (write(metrics.stopPipe[1], "", 1) != 1)
+            perror("Metrics endpoint");
+        pthread_join(metrics.thread, NULL);
+        close(metrics.listenFd);
+        close(metrics.stopPipe[0]);
+        close(metrics.stopPipe[1]);
+        metrics.listenFd = -1;
+    }
+    int result = metrics.config.tracePath != NULL ? writeTrace(metrics.config.tracePath) : 0;
+
+    if (threadShard != NULL)                    // The calling thread is done with its shard too
+    {
+        releaseShard(threadShard);
+        pthread_setspecific(shardKey, NULL);
+        threadShard = NULL;
+    }
+
+    // Free the shards nobody owns; shards of threads still running stay for the next metricsOpen()
+    Shard *keep = NULL;
+    Shard *shard = atomic_exchange(&metrics.shards, NULL);
+    while (shard != NULL)
+    {
+        Shard *next = shard->next;
+        if (atomic_load(&shard->owned))
+        {
+            shard->next = keep;
+            keep = shard;
+        }
+        else
+        {
+            free(shard->events);
+            free(shard->text);
+            free(shard);
+        }
+        shard = next;
+    }
+    atomic_store(&metrics.shards, keep);
+    return result;
+}
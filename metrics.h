@@ -0,0 +1,88 @@
+/*
+Operating Systems Spring 2024
+Final Project
+
+Metrics: counters, latency histograms and a trace of the crawl, served in the Prometheus format and dumped for
+chrome://tracing.
+*/
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Counters, kept per thread and summed when read
+typedef enum
+{
+    METRIC_PAGES_FETCHED,       // Pages retrieved
+    METRIC_PAGES_FAILED,        // Pages that could not be retrieved
+    METRIC_NOT_MODIFIED,        // Pages the server answered 304 Not Modified for
+    METRIC_BYTES,               // Body bytes received
+    METRIC_LINKS,               // Valid links found in the pages
+    METRIC_RETRIES,             // Transfers started again after a failed attempt
+    METRIC_CONNECTIONS,         // Connections opened
+    METRIC_LIMIT_CUTS,          // Halvings of a host's concurrency limit or the global one
+    METRIC_BREAKER_TRIPS,       // Openings of a host's circuit breaker
+    METRIC_COUNTERS
+} MetricCounter;
+
+// Gauges set by each thread and summed when read
+typedef enum
+{
+    METRIC_IN_FLIGHT,           // Transfers in flight
+    METRIC_GAUGES
+} MetricGauge;
+
+// Latency histograms, in nanoseconds
+typedef enum
+{
+    METRIC_DNS,                 // Name lookup of a transfer that opened a connection
+    METRIC_CONNECT,             // TCP connect of a new connection
+    METRIC_TLS,                 // TLS handshake of a new connection
+    METRIC_TTFB,                // Request sent to first response byte
+    METRIC_DOWNLOAD,            // First to last response byte
+    METRIC_FETCH,               // Whole transfer, as curl times it
+    METRIC_PARSE,               // Scanning a page's body, links aside
+    METRIC_EXTRACT,             // Resolving, normalizing and queueing a page's links
+    METRIC_LOCK_SCHEDULER,      // Wait for a contended lock of the politeness scheduler
+    METRIC_LOCK_POOL,           // Wait for the contended lock of the worker pool
+    METRIC_LOCK_PAGES,          // Wait for a contended lock of the page store
+    METRIC_HISTOGRAMS
+} MetricHistogram;
+
+// Reads a gauge of the whole crawl, such as the length of the frontier
+typedef long (*MetricsGaugeCallback)(void *arg);
+
+// Settings for metricsOpen()
+typedef struct
+{
+    int port;                   // Port of the Prometheus endpoint on 127.0.0.1, 0 for any free port, -1 for none
+    const char *tracePath;      // Chrome trace file written by metricsClose(), NULL for no trace
+    size_t traceEvents;         // Most trace events kept per thread
+} MetricsConfig;
+
+// Function prototypes
+void metricsConfigDefaults(MetricsConfig *config);
+int metricsOpen(const MetricsConfig *config);
+int metricsEnabled(void);
+int metricsTracing(void);
+int metricsPort(void);
+uint64_t metricsNow(void);
+void metricsCount(MetricCounter counter, long n);
+void metricsSet(MetricGauge gauge, long value);
+void metricsRecord(MetricHistogram histogram, uint64_t ns);
+void metricsLock(pthread_mutex_t *mutex, MetricHistogram histogram);
+void metricsTrace(const char *name, const char *url, uint64_t startNs, uint64_t durationNs, uint64_t id);
+void metricsThreadName(const char *name);
+int metricsAddGauge(const char *name, const char *help, MetricsGaugeCallback read, void *arg);
+void metricsRemoveGauges(void *arg);
+long metricsTotal(MetricCounter counter);
+long metricsSamples(MetricHistogram histogram);
+uint64_t metricsQuantile(MetricHistogram histogram, double quantile);
+void metricsWrite(FILE *out);
+int metricsClose(void);
+
+#endif
@@ -0,0 +1,440 @@
+/*
+Operating Systems Spring 2024
+Final Project
+
+Options: settings of a crawl run, read from the command line and from config files.
+
+Every option has a long name, which is also its key in a config file, and the common ones a
+short name. A config file holds one "name = value" per line ("name" alone for a flag); blank
+lines and lines starting with '#' are skipped. Options are applied in the order given, so an
+option after --config overrides the file, and seeds add up from every source. Arguments that
+are not options are seed URLs.
+
+Without any arguments the crawler keeps its old interactive mode: it asks for a depth and a
+seed URL on the terminal, round after round.
+*/
+
+#include <getopt.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "options.h"
+
+// Deepest nesting of config files that include each other
+#define MAX_CONFIG_NESTING 8
+
+// An option, on the command line and in config files
+typedef struct
+{
+    const char *name;           // Long option and config file key
+    char shortName;             // Single-letter option, 0 for none
+    const char *argName;        // Name of its value in the usage text, NULL for a flag
+    const char *help;
+} OptionInfo;
+
+static const OptionInfo OPTIONS[] = {
+    { "config", 'f', "FILE", "read options from FILE, one \"name = value\" per line" },
+    { "seed", 's', "URL", "crawl from URL (repeatable; arguments that are not options are seeds too)" },
+    { "seeds", 'S', "FILE", "crawl from the URLs in FILE, one per line, - for stdin (repeatable)" },
+    { "depth", 'd', "N", "fetch pages up to N links from a seed, 1 for the seeds only (default 3)" },
+    { "workers", 'w', "N", "worker threads to start with and keep (default 2)" },
+    { "max-workers", 0, "N", "worker threads to grow to while the others are saturated (default the number of CPUs)" },
+    { "connections", 'c', "N", "transfers in flight per worker (default 256)" },
+    { "per-host", 'p', "N", "transfers running at once per host, 0 for no limit (default 8)" },
+    { "delay", 0, "MS", "least time between two transfers to a host (default 0)" },
+    { "timeout", 't', "SECONDS", "time a transfer may take in all (default 30)" },
+    { "connect-timeout", 0, "SECONDS", "time a transfer may take to connect (default 10)" },
+    { "retries", 0, "N", "attempts per URL (default 3)" },
+    { "retry-wait", 0, "MS", "wait before the first retry, doubled for every later one, 0 to retry at once (default 500)" },
+    { "slow", 0, "MS", "transfers taking longer make their host's concurrency limit go down (default 5000)" },
+    { "max-active", 0, "N", "transfers running at once over all hosts, 0 for no limit (default 0)" },
+    { "no-adaptive", 0, NULL, "keep --per-host fixed and never give up on a failing host" },
+    { "robots-agent", 0, "NAME", "obey the robots.txt groups for NAME, those for * otherwise (default WebCrawler)" },
+    { "no-robots", 0, NULL, "fetch pages whatever the robots.txt of their hosts says" },
+    { "dns-servers", 0, "LIST", "DNS servers as ip[:port],... (default the system's)" },
+    { "no-dns-cache", 0, NULL, "let curl resolve host names instead of the shared DNS cache" },
+    { "shard", 0, "N", "crawl as shard N of the cluster given with --peers, counting from 0 (default 0)" },
+    { "peers", 0, "LIST", "split the crawl over processes: the address of every shard, host:port or a socket path" },
+    { "log", 'l', "FILE", "log file (default crawler.log)" },
+    { "log-level", 0, "LEVEL", "error, warn, info or debug (default debug)" },
+    { "log-format", 0, "FORMAT", "text or binary (default text)" },
+    { "links", 'o', "FILE", "print the links found to FILE, - for stdout (default -)" },
+    { "quiet", 'q', NULL, "do not print the links found" },
+    { "state", 0, "DIR", "keep the crawl state in DIR to resume an interrupted crawl (default crawler.state)" },
+    { "no-state", 0, NULL, "keep no crawl state" },
+    { "sync", 0, "POLICY", "force the crawl state to disk: none, interval (every second) or batch (default interval)" },
+    { "resume", 'r', NULL, "continue the crawl left unfinished in the state directory, if any" },
+    { "metrics-port", 0, "PORT", "serve Prometheus metrics on http://127.0.0.1:PORT/metrics, 0 for any free port" },
+    { "trace", 0, "FILE", "write a Chrome trace of the workers' transfers and parsing to FILE at the end" },
+    { "archive", 0, "DIR", "write the pages fetched as WARC and the link graph as ID columns to DIR" },
+    { "help", 'h', NULL, "print this help and exit" },
+};
+
+#define OPTION_COUNT ((int)(sizeof(OPTIONS) / sizeof(OPTIONS[0])))
+
+/*
+    Fill CrawlOptions with the crawler's default settings.
+
+    Preconditions:  'options' points to a CrawlOptions structure.
+    Postcondition:  Every field is set, with no seeds.
+*/
+void optionsDefaults(CrawlOptions *options)
+{
+    options->interactive = 0;
+    options->depth = 3;
+    options->workers = 2;
+    options->maxWorkers = 0;
+    options->connections = 256;
+    options->perHost = 8;
+    options->delayMs = 0;
+    options->timeout = 30;
+    options->connectTimeout = 10;
+    options->retries = 3;
+    options->retryWaitMs = 500;
+    options->slowMs = 5000;
+    options->maxActive = 0;
+    options->adaptive = 1;
+    options->robots = 1;
+    options->robotsAgent = "WebCrawler";
+    options->dnsServers = NULL;
+    options->dnsCache = 1;
+    options->shard = 0;
+    options->peers = NULL;
+    options->logPath = "crawler.log";
+    options->logLevel = LOG_DEBUG;
+    options->logFormat = LOG_FORMAT_TEXT;
+    options->linksPath = "-";
+    options->stateDir = "crawler.state";
+    options->sync = JOURNAL_SYNC_INTERVAL;
+    options->resume = 0;
+    options->metricsPort = -1;
+    options->tracePath = NULL;
+    options->archiveDir = NULL;
+    options->seeds = NULL;
+    options->seedCount = 0;
+    options->seedFiles = NULL;
+    options->seedFileCount = 0;
+    options->owned = NULL;
+    options->ownedCount = 0;
+}
+
+// Append a string to a growing list; returns 0, or -1 if memory allocation failed
+static int appendString(const char ***list, int *count, const char *s)
+{
+    const char **grown = realloc((void *)*list, sizeof(char *) * (size_t)(*count + 1));
+    if (grown == NULL)
+        return -1;
+    grown[(*count)++] = s;
+    *list = grown;
+    return 0;
+}
+
+// Parse a whole decimal number within [min, max]; returns 0, or -1 if it is not one
+static int parseNumber(const char *value, long min, long max, long *result)
+{
+    char *end;
+    long n = strtol(value, &end, 10);
+    if (end == value || *end != '\0' || n < min || n > max)
+        return -1;
+    *result = n;
+    return 0;
+}
+
+// Index of 'value' in 'names', or -1
+static int parseName(const char *value, const char *const *names, int count)
+{
+    for (int i = 0; i < count; i++)
+        if (strcmp(value, names[i]) == 0)
+            return i;
+    return -1;
+}
+
+// Set one option; 'where' names the source for error messages. Returns 0, or -1 after printing an error.
+static int applyOption(CrawlOptions *options, const char *name, const char *value, const char *where)
+{
+    static const char *const LEVELS[] = { "error", "warn", "info", "debug" };
+    static const char *const FORMATS[] = { "text", "binary" };
+    static const char *const SYNCS[] = { "none", "interval", "batch" };
+    long n = 0;
+    int ok = 1;
+
+    if (strcmp(name, "config") == 0)
+        return optionsLoadFile(options, value);
+    else if (strcmp(name, "seed") == 0)
+        ok = appendString(&options->seeds, &options->seedCount, value) == 0;
+    else if (strcmp(name, "seeds") == 0)
+        ok = appendString(&options->seedFiles, &options->seedFileCount, value) == 0;
+    else if (strcmp(name, "depth") == 0 && (ok = parseNumber(value, 0, 1000, &n) == 0))
+        options->depth = (int)n;
+    else if (strcmp(name, "workers") == 0 && (ok = parseNumber(value, 1, 1024, &n) == 0))
+        options->workers = (int)n;
+    else if (strcmp(name, "max-workers") == 0 && (ok = parseNumber(value, 1, 1024, &n) == 0))
+        options->maxWorkers = (int)n;
+    else if (strcmp(name, "connections") == 0 && (ok = parseNumber(value, 1, 65536, &n) == 0))
+        options->connections = (int)n;
+    else if (strcmp(name, "per-host") == 0 && (ok = parseNumber(value, 0, 65536, &n) == 0))
+        options->perHost = (int)n;
+    else if (strcmp(name, "delay") == 0 && (ok = parseNumber(value, 0, 86400000L, &n) == 0))
+        options->delayMs = n;
+    else if (strcmp(name, "timeout") == 0 && (ok = parseNumber(value, 1, 86400, &n) == 0))
+        options->timeout = n;
+    else if (strcmp(name, "connect-timeout") == 0 && (ok = parseNumber(value, 1, 86400, &n) == 0))
+        options->connectTimeout = n;
+    else if (strcmp(name, "retries") == 0 && (ok = parseNumber(value, 1, 100, &n) == 0))
+        options->retries = (int)n;
+    else if (strcmp(name, "retry-wait") == 0 && (ok = parseNumber(value, 0, 3600000L, &n) == 0))
+        options->retryWaitMs = n;
+    else if (strcmp(name, "slow") == 0 && (ok = parseNumber(value, 1, 86400000L, &n) == 0))
+        options->slowMs = n;
+    else if (strcmp(name, "max-active") == 0 && (ok = parseNumber(value, 0, 1 << 24, &n) == 0))
+        options->maxActive = (int)n;
+    else if (strcmp(name, "no-adaptive") == 0)
+        options->adaptive = 0;
+    else if (strcmp(name, "robots-agent") == 0)
+        options->robotsAgent = value;
+    else if (strcmp(name, "no-robots") == 0)
+        options->robots = 0;
+    else if (strcmp(name, "dns-servers") == 0)
+        options->dnsServers = value;
+    else if (strcmp(name, "no-dns-cache") == 0)
+        options->dnsCache = 0;
+    else if (strcmp(name, "shard") == 0 && (ok = parseNumber(value, 0, 255, &n) == 0))
+        options->shard = (int)n;
+    else if (strcmp(name, "peers") == 0)
+        options->peers = value;
+    else if (strcmp(name, "log") == 0)
+        options->logPath = value;
+    else if (strcmp(name, "log-level") == 0 && (ok = (n = parseName(value, LEVELS, 4)) >= 0))
+        options->logLevel = (LogLevel)n;
+    else if (strcmp(name, "log-format") == 0 && (ok = (n = parseName(value, FORMATS, 2)) >= 0))
+        options->logFormat = n == 0 ? LOG_FORMAT_TEXT : LOG_FORMAT_BINARY;
+    else if (strcmp(name, "links") == 0)
+        options->linksPath = value;
+    else if (strcmp(name, "quiet") == 0)
+        options->linksPath = NULL;
+    else if (strcmp(name, "state") == 0)
+        options->stateDir = value;
+    else if (strcmp(name, "no-state") == 0)
+        options->stateDir = NULL;
+    else if (strcmp(name, "sync") == 0 && (ok = (n = parseName(value, SYNCS, 3)) >= 0))
+        options->sync = n == 0 ? JOURNAL_SYNC_NONE : n == 1 ? JOURNAL_SYNC_INTERVAL : JOURNAL_SYNC_BATCH;
+    else if (strcmp(name, "resume") == 0)
+        options->resume = 1;
+    else if (strcmp(name, "metrics-port") == 0 && (ok = parseNumber(value, 0, 65535, &n) == 0))
+        options->metricsPort = (int)n;
+    else if (strcmp(name, "trace") == 0)
+        options->tracePath = value;
+    else if (strcmp(name, "archive") == 0)
+        options->archiveDir = value;
+
+    if (!ok)
+    {
+        fprintf(stderr, "%s: invalid value \"%s\" for %s\n", where, value, name);
+        return -1;
+    }
+    return 0;
+}
+
+// The option called 'name', or NULL
+static const OptionInfo *findOption(const char *name)
+{
+    for (int i = 0; i < OPTION_COUNT; i++)
+        if (strcmp(OPTIONS[i].name, name) == 0)
+            return &OPTIONS[i];
+    return NULL;
+}
+
+// Strip spaces at both ends of a string in place
+static char *trim(char *s)
+{
+    while (*s == ' ' || *s == '\t')
+        s++;
+    size_t len = strlen(s);
+    while (len > 0 && (s[len - 1] == ' ' || s[len - 1] == '\t' || s[len - 1] == '\n' || s[len - 1] == '\r'))
+        s[--len] = '\0';
+    return s;
+}
+
+/*
+    Apply the options of a config file.
+
+    Preconditions:  'options' has been filled by optionsDefaults(), 'path' names a config file.
+    Postcondition:  Returns 0 with every option of the file applied in order, or -1 after printing an error if
+                    the file cannot be read or holds an unknown option or invalid value.
+*/
+int optionsLoadFile(CrawlOptions *options, const char *path)
+{
+    static int nesting = 0;                             // Config files being read, to stop include loops
+    FILE *file = fopen(path, "r");
+    if (file == NULL)
+    {
+        perror(path);
+        return -1;
+    }
+    if (nesting == MAX_CONFIG_NESTING)
+    {
+        fprintf(stderr, "%s: config files nested too deeply\n", path);
+        fclose(file);
+        return -1;
+    }
+    nesting++;
+
+    int result = 0;
+    char *line = NULL;
+    size_t cap = 0;
+    for (long number = 1; result == 0 && getline(&line, &cap, file) >= 0; number++)
+    {
+        char where[512];
+        snprintf(where, sizeof(where), "%s:%ld", path, number);
+        char *name = trim(line);
+        if (*name == '\0' || *name == '#')
+            continue;
+
+        char *value = strchr(name, '=');
+        if (value != NULL)
+        {
+            *value = '\0';
+            value = trim(value + 1);
+            name = trim(name);
+        }
+
+        const OptionInfo *info = findOption(name);
+        if (info == NULL || strcmp(name, "help") == 0)
+        {
+            fprintf(stderr, "%s: unknown option \"%s\"\n", where, name);
+            result = -1;
+        }
+        else if (info->argName != NULL && (value == NULL || *value == '\0'))
+        {
+            fprintf(stderr, "%s: %s needs a value\n", where, name);
+            result = -1;
+        }
+        else if (info->argName == NULL)                 // A flag, optionally "= yes" or "= no"
+        {
+            if (value == NULL || strcmp(value, "yes") == 0 || strcmp(value, "true") == 0 || strcmp(value, "1") == 0)
+                result = applyOption(options, name, NULL, where);
+            else if (strcmp(value, "no") != 0 && strcmp(value, "false") != 0 && strcmp(value, "0") != 0)
+            {
+                fprintf(stderr, "%s: invalid value \"%s\" for %s\n", where, value, name);
+                result = -1;
+            }
+        }
+        else
+        {
+            char *copy = strdup(value);                 // Kept for as long as the options
+            char **owned = copy != NULL ? realloc(options->owned, sizeof(char *) * (size_t)(options->ownedCount + 1))
+                                        : NULL;
+            if (owned == NULL)
+            {
+                free(copy);
+                fprintf(stderr, "%s: out of memory\n", where);
+                result = -1;
+                continue;
+            }
+            owned[options->ownedCount++] = copy;
+            options->owned = owned;
+            result = applyOption(options, name, copy, where);
+        }
+    }
+    free(line);
+    fclose(file);
+    nesting--;
+    return result;
+}
+
+/*
+    Read the options of a run from the command line.
+
+    Preconditions:  'options' has been filled by optionsDefaults(), 'argc' and 'argv' are those given to main().
+    Postcondition:  Returns 0 with the options applied in order (with no arguments at all, 'interactive' is set),
+                    1 if the usage text was printed for --help, or -1 after printing an error.
+*/
+int optionsParse(CrawlOptions *options, int argc, char *argv[])
+{
+    if (argc <= 1)
+    {
+        options->interactive = 1;
+        return 0;
+    }
+
+    struct option longOptions[OPTION_COUNT + 1];
+    char shortOptions[2 * OPTION_COUNT + 1];
+    size_t shortLen = 0;
+    for (int i = 0; i < OPTION_COUNT; i++)
+    {
+        longOptions[i] = (struct option){ OPTIONS[i].name, OPTIONS[i].argName ? required_argument : no_argument,
+                                          NULL, OPTIONS[i].shortName };
+        if (OPTIONS[i].shortName != 0)
+        {
+            shortOptions[shortLen++] = OPTIONS[i].shortName;
+            if (OPTIONS[i].argName != NULL)
+                shortOptions[shortLen++] = ':';
+        }
+    }
+    longOptions[OPTION_COUNT] = (struct option){ NULL, 0, NULL, 0 };
+    shortOptions[shortLen] = '\0';
+
+    int c, index = -1;
+    while ((c = getopt_long(argc, argv, shortOptions, longOptions, &index)) != -1)
+    {
+        if (c == '?')
+        {
+            fprintf(stderr, "Try '%s --help' for more information.\n", argv[0]);
+            return -1;                                  // getopt_long() printed the error
+        }
+        const OptionInfo *info = index >= 0 ? &OPTIONS[index] : NULL;
+        for (int i = 0; info == NULL && i < OPTION_COUNT; i++)   // Short option: 'index' is not set
+        {
+            if (OPTIONS[i].shortName == c)
+                info = &OPTIONS[i];
+        }
+        index = -1;
+        if (strcmp(info->name, "help") == 0)
+        {
+            optionsUsage(stdout, argv[0]);
+            return 1;
+        }
+        if (applyOption(options, info->name, optarg, "command line") != 0)
+            return -1;
+    }
+
+    for (int i = optind; i < argc; i++)                 // The remaining arguments are seeds
+    {
+        if (appendString(&options->seeds, &options->seedCount, argv[i]) != 0)
+            return -1;
+    }
+    return 0;
+}
+
+// Print the usage text
+void optionsUsage(FILE *out, const char *program)
+{
+    fprintf(out, "Usage: %s [options] [seed URL ...]\n", program);
+    fprintf(out, "       %s    (no arguments: ask for the depth and seed URL on the terminal)\n\n", program);
+    fprintf(out, "Crawls the web from the seed URLs, breadth-first, and exits when the crawl is complete.\n\n");
+    fprintf(out, "Options:\n");
+    for (int i = 0; i < OPTION_COUNT; i++)
+    {
+        char left[64];
+        snprintf(left, sizeof(left), "%c%c%c --%s%s%s", OPTIONS[i].shortName ? '-' : ' ',
+                 OPTIONS[i].shortName ? OPTIONS[i].shortName : ' ', OPTIONS[i].shortName ? ',' : ' ', OPTIONS[i].name,
+                 OPTIONS[i].argName ? " " : "", OPTIONS[i].argName ? OPTIONS[i].argName : "");
+        fprintf(out, "  %-28s %s\n", left, OPTIONS[i].help);
+    }
+    fprintf(out, "\nExit status: %d the crawl finished, %d it could not be run (or lost a shard), %d invalid options,\n"
+                 "             %d the crawl finished without fetching any page.\n",
+            EXIT_CRAWLED, EXIT_NOT_RUN, EXIT_USAGE, EXIT_NO_PAGES);
+}
+
+// Free what the options hold; the strings they point to from config files are released too
+void optionsFree(CrawlOptions *options)
+{
+    for (int i = 0; i < options->ownedCount; i++)
+        free(options->owned[i]);
+    free(options->owned);
+    free((void *)options->seeds);
+    free((void *)options->seedFiles);
+    options->owned = NULL;
+    options->seeds = options->seedFiles = NULL;
+    options->ownedCount = options->seedCount = options->seedFileCount = 0;
+}
@@ -0,0 +1,70 @@
+/*
+Operating Systems Spring 2024
+Final Project
+
+Options: settings of a crawl run, read from the command line and from config files.
+*/
+
+#ifndef OPTIONS_H
+#define OPTIONS_H
+
+#include <stdio.h>
+
+#include "journal.h"
+#include "logger.h"
+
+// Exit statuses of the crawler
+#define EXIT_CRAWLED 0          // The crawl finished; some pages may have failed
+#define EXIT_NOT_RUN 1          // The crawl could not be set up or had nothing to start from, or lost its cluster
+#define EXIT_USAGE 2            // Invalid command line or config file
+#define EXIT_NO_PAGES 3         // The crawl finished without fetching a single page
+
+// Settings of a crawl run
+typedef struct
+{
+    int interactive;            // 1 to ask for the depth and seed URL on the terminal, round after round
+    int depth;                  // Pages are fetched up to this many links from a seed, 1 for the seeds only
+    int workers;                // Worker threads started, and kept however idle
+    int maxWorkers;             // Worker threads the pool may grow to, 0 for the number of CPUs
+    int connections;            // Transfers in flight per worker
+    int perHost;                // Transfers running at once per host (0 = unlimited)
+    long delayMs;               // Least time between the starts of two transfers of a host
+    long timeout;               // Seconds a transfer may take in all
+    long connectTimeout;        // Seconds a transfer may take to connect
+    int retries;                // Attempts per URL
+    long retryWaitMs;           // Wait before the first retry, doubled for every later one
+    long slowMs;                // Transfers taking longer lower their host's concurrency limit
+    int maxActive;              // Transfers running at once over all hosts (0 = unlimited)
+    int adaptive;               // 1 to adapt the concurrency limits to the hosts' answers and give up failing hosts
+    int robots;                 // 1 to fetch the robots.txt of every host and skip the URLs it disallows
+    const char *robotsAgent;    // Product token whose robots.txt groups apply
+    const char *dnsServers;     // DNS servers as "ip[:port],...", NULL for the system's
+    int dnsCache;               // 1 to look hosts up in the shared DNS cache, 0 to let curl resolve them
+    int shard;                  // This process's index in 'peers'
+    const char *peers;          // Addresses of the shards of a crawl split over processes, NULL to crawl alone
+    const char *logPath;        // Log file
+    LogLevel logLevel;          // Most verbose level logged
+    LogFormat logFormat;
+    const char *linksPath;      // File the links found are printed to, "-" for stdout, NULL for none
+    const char *stateDir;       // Directory of the crawl journal, NULL to crawl without one
+    JournalSync sync;           // When the journal is forced to disk
+    int resume;                 // 1 to continue a crawl left unfinished in 'stateDir'
+    int metricsPort;            // Port of the Prometheus endpoint on 127.0.0.1, 0 for any free port, -1 for none
+    const char *tracePath;      // Chrome trace written at the end, NULL for none
+    const char *archiveDir;     // Directory the pages and the link graph are archived to, NULL for none
+    const char **seeds;         // Seed URLs given directly
+    int seedCount;
+    const char **seedFiles;     // Files with one seed URL per line, "-" for stdin
+    int seedFileCount;
+    char **owned;               // Strings read from config files, freed by optionsFree()
+    int ownedCount;
+} CrawlOptions;
+
+// Function prototypes
+void optionsDefaults(CrawlOptions *options);
+int optionsParse(CrawlOptions *options, int argc, char *argv[]);
+int optionsLoadFile(CrawlOptions *options, const char *path);
+void optionsUsage(FILE *out, const char *program);
+void optionsFree(CrawlOptions *options);
+
+#endif
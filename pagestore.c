@@ -0,0 +1,654 @@
+/*
+Operating Systems Spring 2024
+Final Project
+
+Page store: what earlier crawls learned about every page, for conditional re-crawls and near-duplicate detection.
+
+For every page fetched the store keeps the validators the server sent with it (ETag and
+Last-Modified), the SimHash fingerprint of its content, the size of its body and its links. A
+re-crawl sends the validators along, and a page the server answers 304 Not Modified for is neither
+downloaded nor parsed: its stored links are queued instead, so the crawl still reaches everything
+behind it. The fingerprints of the pages of a run go into a near-duplicate index, and a page whose
+fingerprint is within SIMHASH_NEAR_BITS of one seen before has its links left alone, another page
+with the same content having queued them already.
+
+URLs are interned in a URL table of the store's own (see urltable.h), pages and links refer to
+each other by its IDs. The records live in SHARDS shards matching the shards of the table, each
+with its own lock and an array indexed by the position of the URL in its shard, so a URL's record
+is found from its ID without a second hash table.
+
+The near-duplicate index splits every fingerprint into BLOCKS blocks of 16 bits. Two fingerprints
+at most SIMHASH_NEAR_BITS < BLOCKS bits apart agree on at least one whole block, so only the
+fingerprints sharing a block with the new one are compared: each block has a table of chains,
+one per block value.
+
+The store is kept on disk between runs, written to a temporary file and renamed over the old one,
+in native byte order:
+
+    StoreHeader
+    URLs, each [uint16 length][bytes]
+    pages, each PageEntry, then the ETag, the Last-Modified value and uint32 link[linkCount]
+
+where URLs are referred to by their position in the file.
+*/
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "metrics.h"
+#include "pagestore.h"
+#include "simhash.h"
+#include "urltable.h"
+
+// Number of shards, as in the URL table: the low bits of an ID are its shard, the others its index there
+#define SHARD_BITS 6
+#define SHARDS (1 << SHARD_BITS)
+
+// Fingerprint blocks of the near-duplicate index
+#define BLOCKS 4
+#define BLOCK_BITS 16
+
+// "CRAWLPG1" read as a little-endian number
+#define STORE_MAGIC 0x3147504c57415243ULL
+
+// Everything known of a page, 'known' unset for a URL that is only linked to
+typedef struct
+{
+    uint64_t simhash;
+    uint32_t *links;                        // IDs of the linked URLs
+    uint32_t linkCount;
+    uint32_t features;
+    long size;
+    char *etag;                             // NULL for none
+    char *lastModified;                     // NULL for none
+    int known;                              // 1 once the page was fetched
+} PageRecord;
+
+typedef struct
+{
+    _Alignas(64) pthread_mutex_t lock;
+    PageRecord *records;                    // Indexed by the position of the URL in its shard of the table
+    size_t capacity;
+} Shard;
+
+// Fingerprint in the near-duplicate index, on the chain of each of its blocks
+typedef struct
+{
+    uint64_t fingerprint;
+    uint32_t next[BLOCKS];                  // Index + 1 of the next entry with the same block, 0 for none
+} NearEntry;
+
+struct PageStore
+{
+    Shard shards[SHARDS];
+    UrlTable *urls;                         // Every URL of a page or link
+    pthread_mutex_t nearLock;
+    uint32_t *heads[BLOCKS];                // Per block value: index + 1 of the latest entry, 0 for none
+    NearEntry *near;
+    size_t nearCount, nearCap;
+    atomic_long pages;
+    atomic_long conditional;
+    atomic_long notModified;
+    atomic_long savedBytes;
+    atomic_long downloadedBytes;
+    atomic_long nearDuplicates;
+};
+
+// Head of the store file
+typedef struct
+{
+    uint64_t magic;                         // STORE_MAGIC
+    uint64_t urlCount;
+    uint64_t pageCount;
+    uint64_t bytes;                         // Size of the whole file
+} StoreHeader;
+
+// Fixed part of a page in the store file
+typedef struct
+{
+    uint64_t simhash;
+    int64_t size;
+    uint32_t url;                           // Position of the page's URL in the file
+    uint32_t features;
+    uint32_t linkCount;
+    uint16_t etagLen;
+    uint16_t lastModifiedLen;
+} PageEntry;
+
+/*
+    Create an empty page store.
+
+    Postcondition:  Returns a new store, or NULL if memory allocation failed.
+*/
+PageStore *pageStoreCreate(void)
+{
+    PageStore *store = aligned_alloc(64, sizeof(PageStore));
+    if (store == NULL)
+        return NULL;
+    memset(store, 0, sizeof(PageStore));
+    store->urls = urlTableCreate(0);
+    int ok = store->urls != NULL;
+    for (int b = 0; b < BLOCKS; b++)
+    {
+        store->heads[b] = calloc((size_t)1 << BLOCK_BITS, sizeof(uint32_t));
+        ok = ok && store->heads[b] != NULL;
+    }
+    if (!ok)
+    {
+        urlTableDestroy(store->urls);
+        for (int b = 0; b < BLOCKS; b++)
+            free(store->heads[b]);
+        free(store);
+        return NULL;
+    }
+
+    for (int i = 0; i < SHARDS; i++)
+        pthread_mutex_init(&store->shards[i].lock, NULL);
+    pthread_mutex_init(&store->nearLock, NULL);
+    atomic_init(&store->pages, 0);
+    atomic_init(&store->conditional, 0);
+    atomic_init(&store->notModified, 0);
+    atomic_init(&store->savedBytes, 0);
+    atomic_init(&store->downloadedBytes, 0);
+    atomic_init(&store->nearDuplicates, 0);
+    return store;
+}
+
+// Record of the URL with ID 'id', made room for if 'grow' is set; the caller holds the lock of its shard
+static PageRecord *recordOf(Shard *shard, uint32_t id, int grow)
+{
+    size_t index = id >> SHARD_BITS;
+    if (index >= shard->capacity)
+    {
+        if (!grow)
+            return NULL;
+        size_t cap = shard->capacity ? shard->capacity : 64;
+        while (cap <= index)
+            cap *= 2;
+        PageRecord *records = realloc(shard->records, cap * sizeof(PageRecord));
+        if (records == NULL)
+            return NULL;
+        memset(records + shard->capacity, 0, (cap - shard->capacity) * sizeof(PageRecord));
+        shard->records = records;
+        shard->capacity = cap;
+    }
+    return &shard->records[index];
+}
+
+// Release what a record holds and mark it unknown
+static void clearRecord(PageRecord *record)
+{
+    free(record->links);
+    free(record->etag);
+    free(record->lastModified);
+    memset(record, 0, sizeof(PageRecord));
+}
+
+// Copy of a validator, NULL if there is none, it is too long or memory ran out
+static char *copyValidator(const char *value, size_t len)
+{
+    if (value == NULL || len == 0 || len >= PAGE_MAX_VALIDATOR)
+        return NULL;
+    return strndup(value, len);
+}
+
+/*
+    Look a page up before it is fetched. Safe to call from any number of threads.
+
+    Preconditions:  'url' is a null-terminated normalized URL; 'etag' and 'lastModified' point to PAGE_MAX_VALIDATOR
+                    bytes each.
+    Postcondition:  The URL's ID is stored in 'id'. Returns 1 if the page was fetched before with validators, which are
+                    copied to 'etag' and 'lastModified' (empty if the server sent no such header); 0 if not; or -1 if
+                    the URL cannot be stored.
+*/
+int pageStoreLookup(PageStore *store, const char *url, uint32_t *id, char *etag, char *lastModified)
+{
+    if (urlTableIntern(store->urls, url, strlen(url), id) < 0)
+        return -1;
+
+    Shard *shard = &store->shards[*id & (SHARDS - 1)];
+    int found = 0;
+    metricsLock(&shard->lock, METRIC_LOCK_PAGES);
+    PageRecord *record = recordOf(shard, *id, 0);
+    if (record != NULL && record->known && (record->etag != NULL || record->lastModified != NULL))
+    {
+        strcpy(etag, record->etag != NULL ? record->etag : "");
+        strcpy(lastModified, record->lastModified != NULL ? record->lastModified : "");
+        found = 1;
+    }
+    pthread_mutex_unlock(&shard->lock);
+
+    if (found)
+        atomic_fetch_add(&store->conditional, 1);
+    return found;
+}
+
+/*
+    Take note that the server found a page unchanged.
+
+    Preconditions:  'id' was given by pageStoreLookup().
+    Postcondition:  Returns 1 and fills 'info' from what was stored when the page was last downloaded, with etag and
+                    lastModified NULL, counting its body as saved; or returns 0 if the store does not know the page.
+*/
+int pageStoreUnchanged(PageStore *store, uint32_t id, PageInfo *info)
+{
+    Shard *shard = &store->shards[id & (SHARDS - 1)];
+    metricsLock(&shard->lock, METRIC_LOCK_PAGES);
+    PageRecord *record = recordOf(shard, id, 0);
+    int known = record != NULL && record->known;
+    if (known)
+    {
+        info->simhash = record->simhash;
+        info->features = record->features;
+        info->size = record->size;
+        info->etag = NULL;
+        info->lastModified = NULL;
+    }
+    pthread_mutex_unlock(&shard->lock);
+
+    if (known)
+    {
+        atomic_fetch_add(&store->notModified, 1);
+        atomic_fetch_add(&store->savedBytes, info->size);
+    }
+    return known;
+}
+
+/*
+    Hand the stored links of a page to a callback.
+
+    Preconditions:  'id' was given by pageStoreLookup(). 'onLink' does not call into the store: it runs with the lock
+                    of the page's shard held.
+    Postcondition:  'onLink' was called for every link of the page when it was last downloaded, in the order found.
+*/
+void pageStoreLinks(PageStore *store, uint32_t id, PageLinkCallback onLink, void *arg)
+{
+    Shard *shard = &store->shards[id & (SHARDS - 1)];
+    metricsLock(&shard->lock, METRIC_LOCK_PAGES);
+    PageRecord *record = recordOf(shard, id, 0);
+    for (uint32_t i = 0; record != NULL && i < record->linkCount; i++)
+    {
+        size_t len;
+        const char *url = urlTableGet(store->urls, record->links[i], &len);
+        if (url != NULL)
+            onLink(url, len, arg);
+    }
+    pthread_mutex_unlock(&shard->lock);
+}
+
+/*
+    Store what was learned from downloading a page.
+
+    Preconditions:  'id' was given by pageStoreLookup(); 'links' is the list of the page's links, or NULL.
+    Postcondition:  The page's record holds 'info' and the links, replacing what was stored before. Returns 0, or -1 if
+                    memory ran out (the old record is kept).
+*/
+int pageStoreUpdate(PageStore *store, uint32_t id, const PageInfo *info, const PageLink *links)
+{
+    uint32_t count = 0;
+    for (const PageLink *link = links; link != NULL; link = link->next)
+        count++;
+    uint32_t *ids = count > 0 ? malloc(count * sizeof(uint32_t)) : NULL;
+    if (count > 0 && ids == NULL)
+        return -1;
+    count = 0;
+    for (const PageLink *link = links; link != NULL; link = link->next)
+        if (urlTableIntern(store->urls, link->url, link->len, &ids[count]) >= 0)
+            count++;
+
+    char *etag = copyValidator(info->etag, info->etag != NULL ? strlen(info->etag) : 0);
+    char *lastModified = copyValidator(info->lastModified, info->lastModified != NULL ? strlen(info->lastModified) : 0);
+
+    Shard *shard = &store->shards[id & (SHARDS - 1)];
+    metricsLock(&shard->lock, METRIC_LOCK_PAGES);
+    PageRecord *record = recordOf(shard, id, 1);
+    if (record == NULL)
+    {
+        pthread_mutex_unlock(&shard->lock);
+        free(ids);
+        free(etag);
+        free(lastModified);
+        return -1;
+    }
+    int added = !record->known;
+    clearRecord(record);
+    record->simhash = info->simhash;
+    record->features = info->features;
+    record->size = info->size;
+    record->etag = etag;
+    record->lastModified = lastModified;
+    record->links = ids;
+    record->linkCount = count;
+    record->known = 1;
+    pthread_mutex_unlock(&shard->lock);
+
+    if (added)
+        atomic_fetch_add(&store->pages, 1);
+    atomic_fetch_add(&store->downloadedBytes, info->size);
+    return 0;
+}
+
+// Drop what is known of a page that is gone, so it is fetched unconditionally if it comes back
+void pageStoreForget(PageStore *store, uint32_t id)
+{
+    Shard *shard = &store->shards[id & (SHARDS - 1)];
+    metricsLock(&shard->lock, METRIC_LOCK_PAGES);
+    PageRecord *record = recordOf(shard, id, 0);
+    int removed = record != NULL && record->known;
+    if (record != NULL)
+        clearRecord(record);
+    pthread_mutex_unlock(&shard->lock);
+    if (removed)
+        atomic_fetch_sub(&store->pages, 1);
+}
+
+/*
+    Check a page's fingerprint against those of the pages seen before, and add it. Safe to call from any number of
+    threads.
+
+    Preconditions:  'simhash' is the fingerprint of the page, computed from 'features' features.
+    Postcondition:  Returns 1 if a fingerprint at most SIMHASH_NEAR_BITS bits away was added before, so the page is a
+                    near-duplicate; otherwise adds the fingerprint and returns 0. A fingerprint of fewer than
+                    PAGE_MIN_FEATURES features says too little about the page and is neither checked nor added.
+*/
+int pageStoreNearDuplicate(PageStore *store, uint64_t simhash, uint32_t features)
+{
+    if (features < PAGE_MIN_FEATURES)
+        return 0;
+
+    int duplicate = 0;
+    metricsLock(&store->nearLock, METRIC_LOCK_PAGES);
+    for (int b = 0; b < BLOCKS && !duplicate; b++)
+    {
+        uint32_t block = (uint32_t)(simhash >> (b * BLOCK_BITS)) & ((1u << BLOCK_BITS) - 1);
+        for (uint32_t i = store->heads[b][block]; i != 0 && !duplicate; i = store->near[i - 1].next[b])
+            duplicate = simHashDistance(store->near[i - 1].fingerprint, simhash) <= SIMHASH_NEAR_BITS;
+    }
+
+    if (!duplicate && store->nearCount < UINT32_MAX)
+    {
+        if (store->nearCount == store->nearCap)
+        {
+            size_t cap = store->nearCap ? store->nearCap * 2 : 1024;
+            NearEntry *near = realloc(store->near, cap * sizeof(NearEntry));
+            if (near != NULL)
+            {
+                store->near = near;
+                store->nearCap = cap;
+            }
+        }
+        if (store->nearCount < store->nearCap)      // Otherwise the page is just not remembered
+        {
+            NearEntry *entry = &store->near[store->nearCount++];
+            entry->fingerprint = simhash;
+            for (int b = 0; b < BLOCKS; b++)
+            {
+                uint32_t block = (uint32_t)(simhash >> (b * BLOCK_BITS)) & ((1u << BLOCK_BITS) - 1);
+                entry->next[b] = store->heads[b][block];
+                store->heads[b][block] = (uint32_t)store->nearCount;
+            }
+        }
+    }
+    pthread_mutex_unlock(&store->nearLock);
+
+    if (duplicate)
+        atomic_fetch_add(&store->nearDuplicates, 1);
+    return duplicate;
+}
+
+/*
+    Write the store to a file.
+
+    Preconditions:  No other thread uses the store; the directory of 'path' exists.
+    Postcondition:  The pages the store knows, and the URLs they and their links have, are written to 'path' through a
+                    temporary file renamed over it, so a crash leaves the old file or the new one. Returns 0, or -1 if it
+                    could not be written (the old file is left as it was).
+*/
+int pageStoreSave(PageStore *store, const char *path)
+{
+    // Number the URLs in use: positions in the file + 1 per ID, 0 for URLs no page needs any more
+    uint32_t *positions[SHARDS] = { NULL };
+    size_t counts[SHARDS];
+    int ok = 1;
+    for (int s = 0; s < SHARDS; s++)
+    {
+        size_t n = 0;
+        while (urlTableGet(store->urls, (uint32_t)(n << SHARD_BITS | s), NULL) != NULL)
+            n++;
+        counts[s] = n;
+        positions[s] = calloc(n + 1, sizeof(uint32_t));
+        ok = ok && positions[s] != NULL;
+    }
+    uint64_t urlCount = 0, pageCount = 0;
+    for (int s = 0; s < SHARDS && ok; s++)
+    {
+        Shard *shard = &store->shards[s];
+        for (size_t i = 0; i < shard->capacity && i < counts[s]; i++)
+        {
+            PageRecord *record = &shard->records[i];
+            if (!record->known)
+                continue;
+            pageCount++;
+            positions[s][i] = 1;
+            for (uint32_t k = 0; k < record->linkCount; k++)
+                positions[record->links[k] & (SHARDS - 1)][record->links[k] >> SHARD_BITS] = 1;
+        }
+    }
+
+    char tmpPath[4096];
+    snprintf(tmpPath, sizeof(tmpPath), "%s.tmp", path);
+    FILE *out = ok ? fopen(tmpPath, "wb") : NULL;
+    if (out != NULL)
+    {
+        StoreHeader header = { STORE_MAGIC, 0, pageCount, 0 };
+        ok = fwrite(&header, sizeof(header), 1, out) == 1;
+        for (int s = 0; s < SHARDS && ok; s++)
+        {
+            for (size_t i = 0; i < counts[s]; i++)
+            {
+                if (positions[s][i] == 0)
+                    continue;
+                positions[s][i] = (uint32_t)++urlCount;
+                size_t len;
+                const char *url = urlTableGet(store->urls, (uint32_t)(i << SHARD_BITS | s), &len);
+                uint16_t length = (uint16_t)len;
+                ok = ok && fwrite(&length, 2, 1, out) == 1 && fwrite(url, 1, len, out) == len;
+            }
+        }
+        for (int s = 0; s < SHARDS && ok; s++)
+        {
+            Shard *shard = &store->shards[s];
+            for (size_t i = 0; i < shard->capacity && i < counts[s]; i++)
+            {
+                PageRecord *record = &shard->records[i];
+                if (!record->known)
+                    continue;
+                PageEntry entry = { record->simhash, record->size, positions[s][i] - 1, record->features,
+                                    record->linkCount, (uint16_t)(record->etag ? strlen(record->etag) : 0),
+                                    (uint16_t)(record->lastModified ? strlen(record->lastModified) : 0) };
+                ok = ok && fwrite(&entry, sizeof(entry), 1, out) == 1 &&
+                     fwrite(record->etag ? record->etag : "", 1, entry.etagLen, out) == entry.etagLen &&
+                     fwrite(record->lastModified ? record->lastModified : "", 1, entry.lastModifiedLen, out) ==
+                         entry.lastModifiedLen;
+                for (uint32_t k = 0; k < record->linkCount && ok; k++)
+                {
+                    uint32_t link = record->links[k];
+                    uint32_t position = positions[link & (SHARDS - 1)][link >> SHARD_BITS] - 1;
+                    ok = fwrite(&position, sizeof(position), 1, out) == 1;
+                }
+            }
+        }
+
+        long bytes = ftell(out);
+        header.urlCount = urlCount;
+        header.bytes = bytes > 0 ? (uint64_t)bytes : 0;
+        ok = ok && bytes > 0 && fseek(out, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, out) == 1 &&
+             fflush(out) == 0 && fdatasync(fileno(out)) == 0;
+        ok = fclose(out) == 0 && ok;
+        if (!ok || rename(tmpPath, path) != 0)
+        {
+            unlink(tmpPath);
+            ok = 0;
+        }
+    }
+    else
+    {
+        ok = 0;
+    }
+    for (int s = 0; s < SHARDS; s++)
+        free(positions[s]);
+    return ok ? 0 : -1;
+}
+
+/*
+    Read a store written by pageStoreSave().
+
+    Preconditions:  No other thread uses the store.
+    Postcondition:  The pages of the file are added to the store, replacing what it knew of them. Returns 0, also if
+                    there is no such file, or -1 if the file is damaged (pages read before the damage are kept).
+*/
+int pageStoreLoad(PageStore *store, const char *path)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return 0;                                   // Nothing crawled before
+    struct stat st;
+    const unsigned char *data = NULL;
+    size_t size = 0;
+    if (fstat(fd, &st) == 0 && st.st_size > 0)
+    {
+        size = (size_t)st.st_size;
+        void *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED)
+        {
+            madvise(map, size, MADV_SEQUENTIAL);
+            data = map;
+        }
+    }
+    close(fd);
+
+    StoreHeader header;
+    if (data == NULL || size < sizeof(header))
+    {
+        if (data != NULL)
+            munmap((void *)data, size);
+        return -1;
+    }
+    memcpy(&header, data, sizeof(header));
+    long downloaded = atomic_load(&store->downloadedBytes);
+    uint32_t *ids = NULL;
+    int ok = header.magic == STORE_MAGIC && header.bytes == size && header.urlCount < UINT32_MAX &&
+             header.urlCount <= size / 2;
+    if (ok)
+    {
+        ids = malloc((header.urlCount + 1) * sizeof(uint32_t));
+        ok = ids != NULL;
+    }
+
+    // URLs, interned anew: IDs depend on the order URLs came in
+    size_t at = sizeof(header);
+    for (uint64_t i = 0; ok && i < header.urlCount; i++)
+    {
+        uint16_t len;
+        ok = at + 2 <= size;
+        if (ok)
+        {
+            memcpy(&len, data + at, 2);
+            ok = at + 2 + len <= size &&
+                 urlTableIntern(store->urls, (const char *)data + at + 2, len, &ids[i]) >= 0;
+            at += 2 + (size_t)len;
+        }
+    }
+
+    // Pages, with their links translated to the new IDs
+    char etag[PAGE_MAX_VALIDATOR], lastModified[PAGE_MAX_VALIDATOR];
+    for (uint64_t p = 0; ok && p < header.pageCount; p++)
+    {
+        PageEntry entry;
+        ok = at + sizeof(entry) <= size;
+        if (!ok)
+            break;
+        memcpy(&entry, data + at, sizeof(entry));
+        at += sizeof(entry);
+        ok = entry.url < header.urlCount && entry.etagLen < PAGE_MAX_VALIDATOR &&
+             entry.lastModifiedLen < PAGE_MAX_VALIDATOR &&
+             at + entry.etagLen + entry.lastModifiedLen + (size_t)entry.linkCount * 4 <= size;
+        if (!ok)
+            break;
+        memcpy(etag, data + at, entry.etagLen);
+        etag[entry.etagLen] = '\0';
+        at += entry.etagLen;
+        memcpy(lastModified, data + at, entry.lastModifiedLen);
+        lastModified[entry.lastModifiedLen] = '\0';
+        at += entry.lastModifiedLen;
+
+        PageLink *links = entry.linkCount > 0 ? malloc(entry.linkCount * sizeof(PageLink)) : NULL;
+        ok = entry.linkCount == 0 || links != NULL;
+        for (uint32_t k = 0; ok && k < entry.linkCount; k++)
+        {
+            uint32_t position;
+            memcpy(&position, data + at + (size_t)k * 4, 4);
+            ok = position < header.urlCount;
+            if (ok)
+            {
+                links[k].url = urlTableGet(store->urls, ids[position], &links[k].len);
+                links[k].next = k + 1 < entry.linkCount ? &links[k + 1] : NULL;
+            }
+        }
+        at += (size_t)entry.linkCount * 4;
+
+        PageInfo info = { entry.simhash, entry.features, (long)entry.size, entry.etagLen ? etag : NULL,
+                          entry.lastModifiedLen ? lastModified : NULL };
+        ok = ok && pageStoreUpdate(store, ids[entry.url], &info, links) == 0;
+        free(links);
+    }
+
+    free(ids);
+    munmap((void *)data, size);
+    atomic_store(&store->downloadedBytes, downloaded);   // Only pages downloaded by this process count
+    return ok ? 0 : -1;
+}
+
+// Counters of the store so far
+void pageStoreStats(PageStore *store, PageStoreStats *stats)
+{
+    stats->pages = atomic_load(&store->pages);
+    stats->conditional = atomic_load(&store->conditional);
+    stats->notModified = atomic_load(&store->notModified);
+    stats->savedBytes = atomic_load(&store->savedBytes);
+    stats->downloadedBytes = atomic_load(&store->downloadedBytes);
+    stats->nearDuplicates = atomic_load(&store->nearDuplicates);
+}
+
+/*
+    Destroy a page store.
+
+    Preconditions:  'store' was returned by pageStoreCreate() or is NULL; no other thread uses it.
+    Postcondition:  All memory is released.
+*/
+void pageStoreDestroy(PageStore *store)
+{
+    if (store == NULL)
+        return;
+    for (int i = 0; i < SHARDS; i++)
+    {
+        Shard *shard = &store->shards[i];
+        for (size_t k = 0; k < shard->capacity; k++)
+            clearRecord(&shard->records[k]);
+        free(shard->records);
+        pthread_mutex_destroy(&shard->lock);
+    }
+    for (int b = 0; b < BLOCKS; b++)
+        free(store->heads[b]);
+    free(store->near);
+    pthread_mutex_destroy(&store->nearLock);
+    urlTableDestroy(store->urls);
+    free(store);
+}
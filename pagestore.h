@@ -0,0 +1,67 @@
+/*
+Operating Systems Spring 2024
+Final Project
+
+Page store: what earlier crawls learned about every page, for conditional re-crawls and near-duplicate detection.
+*/
+
+#ifndef PAGESTORE_H
+#define PAGESTORE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Longest ETag or Last-Modified value kept, in bytes
+#define PAGE_MAX_VALIDATOR 256
+
+// Fewest features a fingerprint must stand for to take part in near-duplicate detection
+#define PAGE_MIN_FEATURES 8
+
+// What is known of a fetched page
+typedef struct
+{
+    uint64_t simhash;           // Fingerprint of the text, see simhash.h
+    uint32_t features;          // Features the fingerprint stands for
+    long size;                  // Bytes of the body
+    const char *etag;           // ETag header of the response, NULL for none
+    const char *lastModified;   // Last-Modified header of the response, NULL for none
+} PageInfo;
+
+// Link of a page, in the list collected while the page is parsed
+typedef struct PageLink
+{
+    struct PageLink *next;      // Next link of the page, in the order found
+    const char *url;            // Normalized absolute URL
+    size_t len;                 // Length of 'url'
+} PageLink;
+
+// Counters of a store since it was created
+typedef struct
+{
+    long pages;                 // Pages the store knows
+    long conditional;           // Requests sent with the validators of the copy fetched before
+    long notModified;           // Pages the server found unchanged, neither downloaded nor parsed
+    long savedBytes;            // Body bytes those pages had when they were last downloaded
+    long downloadedBytes;       // Body bytes of the pages downloaded
+    long nearDuplicates;        // Pages whose links were not followed, another page having the same content
+} PageStoreStats;
+
+// Called for every stored link of a page, 'url' is null-terminated
+typedef void (*PageLinkCallback)(const char *url, size_t len, void *arg);
+
+typedef struct PageStore PageStore;
+
+// Function prototypes
+PageStore *pageStoreCreate(void);
+int pageStoreLoad(PageStore *store, const char *path);
+int pageStoreSave(PageStore *store, const char *path);
+int pageStoreLookup(PageStore *store, const char *url, uint32_t *id, char *etag, char *lastModified);
+int pageStoreUnchanged(PageStore *store, uint32_t id, PageInfo *info);
+void pageStoreLinks(PageStore *store, uint32_t id, PageLinkCallback onLink, void *arg);
+int pageStoreUpdate(PageStore *store, uint32_t id, const PageInfo *info, const PageLink *links);
+void pageStoreForget(PageStore *store, uint32_t id);
+int pageStoreNearDuplicate(PageStore *store, uint64_t simhash, uint32_t features);
+void pageStoreStats(PageStore *store, PageStoreStats *stats);
+void pageStoreDestroy(PageStore *store);
+
+#endif
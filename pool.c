@@ -0,0 +1,398 @@
+/*
+Operating Systems Spring 2024
+Final Project
+
+Worker pool: threads that park while they have no work, are woken when some arrives, and come and go with the load.
+
+Every thread of the pool runs the same function, which loops over the work until it has none
+left. A thread out of work parks in poolPark() instead of spinning or exiting, and whoever makes
+new work available calls poolWake() to get one parked thread going again.
+
+Parking is an event count. A thread first registers as a waiter with poolPrepare(), which returns
+the current wake-up epoch, then looks for work once more, and only then parks; poolPark() returns
+at once if the epoch moved since. A waker publishes its work first and then checks for waiters,
+so either the parking thread sees the work or the waker sees the waiter and bumps the epoch:
+no wake-up is lost. While nobody is registered, poolWake() is a single atomic load.
+
+The pool starts minThreads threads. A thread that finds more work than it can take calls
+poolGrow(), which starts another one, at most every growMs and up to maxThreads. A thread idle
+for retireMs may leave through poolRetire() as long as more than minThreads are running. The
+slot of a thread that left is joined and reused by the next one started.
+*/
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "metrics.h"
+#include "pool.h"
+
+// States of a thread slot
+#define SLOT_FREE 0
+#define SLOT_RUNNING 1
+#define SLOT_EXITED 2               // Returned, not joined yet
+
+// A thread of the pool
+typedef struct
+{
+    struct WorkPool *pool;
+    pthread_t thread;
+    int state;                      // SLOT_*, guarded by the pool's lock
+    int retired;                    // 1 once poolRetire() let the thread go
+} PoolSlot;
+
+struct WorkPool
+{
+    PoolConfig config;
+    void *(*run)(void *);           // Function every thread runs
+    void *arg;                      // Its argument
+    pthread_mutex_t lock;           // Guards the slots, the thread count and the counters
+    pthread_cond_t wake;            // Parked threads wait on it
+    pthread_cond_t exited;          // Broadcast whenever a thread returns
+    _Alignas(64) atomic_int waiters;    // Threads between poolPrepare() and the end of poolPark()
+    atomic_ulong epoch;             // Bumped by every wake-up
+    _Alignas(64) atomic_int threads;    // Threads running, not counting the retired ones; written under 'lock'
+    atomic_llong lastGrow;          // Time of the last poolGrow() that started a thread, in milliseconds
+    long started, retired, parks, wakeups;
+    int peak;
+    PoolSlot *slots;                // maxThreads slots
+};
+
+// Slot of the calling thread, NULL outside the pool
+static _Thread_local PoolSlot *currentSlot;
+
+// Current monotonic time in milliseconds
+static long long nowMs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void *poolThread(void *arg)
+{
+    PoolSlot *slot = (PoolSlot *)arg;
+    WorkPool *pool = slot->pool;
+    currentSlot = slot;
+    pool->run(pool->arg);
+
+    metricsLock(&pool->lock, METRIC_LOCK_POOL);
+    if (!slot->retired)
+        atomic_fetch_sub(&pool->threads, 1);
+    slot->state = SLOT_EXITED;
+    pthread_cond_broadcast(&pool->exited);
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+// Start a thread in a free slot; the caller holds the lock. Returns 0, or -1 if none is free or it cannot be created
+static int startThread(WorkPool *pool)
+{
+    for (int i = 0; i < pool->config.maxThreads; i++)
+    {
+        PoolSlot *slot = &pool->slots[i];
+        if (slot->state == SLOT_RUNNING)
+            continue;
+        if (slot->state == SLOT_EXITED)
+        {
+            pthread_join(slot->thread, NULL);       // Gone already, it no longer needs the lock
+            slot->state = SLOT_FREE;
+        }
+        slot->retired = 0;
+        if (pthread_create(&slot->thread, NULL, poolThread, slot) != 0)
+            return -1;
+        slot->state = SLOT_RUNNING;
+        int threads = atomic_fetch_add(&pool->threads, 1) + 1;
+        if (threads > pool->peak)
+            pool->peak = threads;
+        pool->started++;
+        return 0;
+    }
+    return -1;
+}
+
+/*
+    Fill PoolConfig with the default settings.
+
+    Preconditions:  'config' points to a PoolConfig structure.
+    Postcondition:  Every field is set: two threads, a fixed-size pool.
+*/
+void poolConfigDefaults(PoolConfig *config)
+{
+    config->minThreads = 2;
+    config->maxThreads = 2;
+    config->growMs = 100;
+    config->retireMs = 2000;
+}
+
+/*
+    Create a pool, with no thread running yet.
+
+    Preconditions:  'config' holds the settings, 'run' is the function every thread runs with 'arg'.
+    Postcondition:  Returns the new pool, or NULL if memory allocation failed. maxThreads is raised to minThreads
+                    if it is lower.
+*/
+WorkPool *poolCreate(const PoolConfig *config, void *(*run)(void *), void *arg)
+{
+    WorkPool *pool = aligned_alloc(64, (sizeof(WorkPool) + 63) / 64 * 64);
+    if (pool == NULL)
+        return NULL;
+    pool->config = *config;
+    if (pool->config.minThreads < 1)
+        pool->config.minThreads = 1;
+    if (pool->config.maxThreads < pool->config.minThreads)
+        pool->config.maxThreads = pool->config.minThreads;
+    pool->slots = calloc((size_t)pool->config.maxThreads, sizeof(PoolSlot));
+    if (pool->slots == NULL)
+    {
+        free(pool);
+        return NULL;
+    }
+    for (int i = 0; i < pool->config.maxThreads; i++)
+        pool->slots[i].pool = pool;
+    pool->run = run;
+    pool->arg = arg;
+
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->wake, &attr);
+    pthread_cond_init(&pool->exited, NULL);
+    pthread_condattr_destroy(&attr);
+
+    atomic_init(&pool->waiters, 0);
+    atomic_init(&pool->epoch, 0);
+    atomic_init(&pool->threads, 0);
+    atomic_init(&pool->lastGrow, 0);
+    pool->started = pool->retired = pool->parks = pool->wakeups = 0;
+    pool->peak = 0;
+    return pool;
+}
+
+/*
+    Start the pool's first threads.
+
+    Preconditions:  'pool' was returned by poolCreate() and not started yet.
+    Postcondition:  Returns the number of threads started, minThreads unless thread creation failed.
+*/
+int poolStart(WorkPool *pool)
+{
+    int started = 0;
+    metricsLock(&pool->lock, METRIC_LOCK_POOL);
+    while (started < pool->config.minThreads && startThread(pool) == 0)
+        started++;
+    pthread_mutex_unlock(&pool->lock);
+    return started;
+}
+
+/*
+    Add a thread because there is more work than the running ones can take.
+
+    Preconditions:  'pool' was started with poolStart(). Safe to call from any thread, as often as the need is seen.
+    Postcondition:  Returns 1 if a thread was started, or 0 if maxThreads are running, the last one was added less than
+                    growMs ago or thread creation failed.
+*/
+int poolGrow(WorkPool *pool)
+{
+    if (atomic_load(&pool->threads) >= pool->config.maxThreads)
+        return 0;
+    long long now = nowMs();
+    long long last = atomic_load(&pool->lastGrow);
+    if (now - last < pool->config.growMs || !atomic_compare_exchange_strong(&pool->lastGrow, &last, now))
+        return 0;                                   // Too soon, or another thread is adding one
+
+    int grown = 0;
+    metricsLock(&pool->lock, METRIC_LOCK_POOL);
+    if (atomic_load(&pool->threads) < pool->config.maxThreads)
+        grown = startThread(pool) == 0;
+    pthread_mutex_unlock(&pool->lock);
+    return grown;
+}
+
+/*
+    Ask whether the calling thread, out of work for 'idleMs', may leave the pool.
+
+    Preconditions:  Called by a thread of the pool.
+    Postcondition:  Returns 1 if 'idleMs' is at least retireMs and more than minThreads are running; the thread no
+                    longer counts as running and must return from the pool's function. Returns 0 otherwise.
+*/
+int poolRetire(WorkPool *pool, long idleMs)
+{
+    PoolSlot *slot = currentSlot;
+    if (idleMs < pool->config.retireMs || slot == NULL || slot->pool != pool)
+        return 0;
+
+    int retire = 0;
+    metricsLock(&pool->lock, METRIC_LOCK_POOL);
+    if (atomic_load(&pool->threads) > pool->config.minThreads)
+    {
+        atomic_fetch_sub(&pool->threads, 1);
+        slot->retired = 1;
+        pool->retired++;
+        retire = 1;
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return retire;
+}
+
+/*
+    Register the calling thread as about to park.
+
+    Preconditions:  The thread has found no work, and looks for it once more after this call.
+    Postcondition:  Returns the ticket to pass to poolPark(). The thread must end the registration with either
+                    poolPark() or, if it found work after all, poolCancel().
+*/
+unsigned long poolPrepare(WorkPool *pool)
+{
+    atomic_fetch_add(&pool->waiters, 1);
+    return atomic_load(&pool->epoch);
+}
+
+// End a registration of poolPrepare() without parking
+void poolCancel(WorkPool *pool)
+{
+    atomic_fetch_sub(&pool->waiters, 1);
+}
+
+/*
+    Sleep until woken up or 'timeoutMs' have passed, -1 for no timeout.
+
+    Preconditions:  'ticket' was returned by the calling thread's last poolPrepare().
+    Postcondition:  Returns 1 if a wake-up came since poolPrepare() (at once if it came before this call), or 0 on
+                    the timeout. The registration is over.
+*/
+int poolPark(WorkPool *pool, unsigned long ticket, long timeoutMs)
+{
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += timeoutMs / 1000;
+    deadline.tv_nsec += (timeoutMs % 1000) * 1000000;
+    deadline.tv_sec += deadline.tv_nsec / 1000000000;
+    deadline.tv_nsec %= 1000000000;
+
+    metricsLock(&pool->lock, METRIC_LOCK_POOL);
+    pool->parks++;
+    while (atomic_load(&pool->epoch) == ticket)
+    {
+        if (timeoutMs < 0)
+            pthread_cond_wait(&pool->wake, &pool->lock);
+        else if (pthread_cond_timedwait(&pool->wake, &pool->lock, &deadline) == ETIMEDOUT)
+            break;
+    }
+    int woken = atomic_load(&pool->epoch) != ticket;
+    pool->wakeups += woken;
+    pthread_mutex_unlock(&pool->lock);
+    atomic_fetch_sub(&pool->waiters, 1);
+    return woken;
+}
+
+/*
+    Wake one parked thread, if any, after making new work available.
+
+    Preconditions:  The work can be found by the threads of the pool before this call.
+    Postcondition:  A thread parked or about to park returns from poolPark().
+*/
+void poolWake(WorkPool *pool)
+{
+    if (pool == NULL || atomic_load(&pool->waiters) == 0)
+        return;
+    atomic_fetch_add(&pool->epoch, 1);
+    metricsLock(&pool->lock, METRIC_LOCK_POOL);
+    pthread_cond_signal(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+// Wake every parked thread, e.g. when the work is over; see poolWake()
+void poolWakeAll(WorkPool *pool)
+{
+    if (pool == NULL || atomic_load(&pool->waiters) == 0)
+        return;
+    atomic_fetch_add(&pool->epoch, 1);
+    metricsLock(&pool->lock, METRIC_LOCK_POOL);
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+// Number of threads running (a snapshot while threads come and go)
+int poolThreads(WorkPool *pool)
+{
+    return atomic_load(&pool->threads);
+}
+
+// Number of threads parked or about to park (a snapshot)
+int poolParked(WorkPool *pool)
+{
+    return atomic_load(&pool->waiters);
+}
+
+/*
+    Wait until every thread of the pool has returned.
+
+    Preconditions:  'pool' was started, and its threads return once the work is over.
+    Postcondition:  Every thread, including any started meanwhile by poolGrow(), is joined.
+*/
+void poolJoin(WorkPool *pool)
+{
+    metricsLock(&pool->lock, METRIC_LOCK_POOL);
+    while (1)
+    {
+        int running = 0;
+        PoolSlot *exited = NULL;
+        for (int i = 0; i < pool->config.maxThreads && exited == NULL; i++)
+        {
+            if (pool->slots[i].state == SLOT_EXITED)
+                exited = &pool->slots[i];
+            else if (pool->slots[i].state == SLOT_RUNNING)
+                running = 1;
+        }
+        if (exited != NULL)
+        {
+            pthread_t thread = exited->thread;
+            exited->state = SLOT_FREE;              // Claimed, poolGrow() cannot join it too
+            pthread_mutex_unlock(&pool->lock);
+            pthread_join(thread, NULL);
+            metricsLock(&pool->lock, METRIC_LOCK_POOL);
+        }
+        else if (running)
+        {
+            pthread_cond_wait(&pool->exited, &pool->lock);
+        }
+        else
+        {
+            break;
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+// Copy the counters of a pool
+void poolStats(WorkPool *pool, PoolStats *stats)
+{
+    metricsLock(&pool->lock, METRIC_LOCK_POOL);
+    stats->started = pool->started;
+    stats->retired = pool->retired;
+    stats->parks = pool->parks;
+    stats->wakeups = pool->wakeups;
+    stats->peak = pool->peak;
+    pthread_mutex_unlock(&pool->lock);
+}
+
+/*
+    Destroy a pool.
+
+    Preconditions:  'pool' was returned by poolCreate(); its threads have been joined with poolJoin(), if started.
+    Postcondition:  All memory is released.
+*/
+void poolDestroy(WorkPool *pool)
+{
+    if (pool == NULL)
+        return;
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->wake);
+    pthread_cond_destroy(&pool->exited);
+    free(pool->slots);
+    free(pool);
+}
@@ -0,0 +1,49 @@
+/*
+Operating Systems Spring 2024
+Final Project
+
+Worker pool: threads that park while they have no work, are woken when some arrives, and come and go with the load.
+*/
+
+#ifndef POOL_H
+#define POOL_H
+
+// Settings for poolCreate()
+typedef struct
+{
+    int minThreads;             // Threads started by poolStart() and kept however idle
+    int maxThreads;             // Threads running at once at most
+    long growMs;                // Least time between two threads added by poolGrow()
+    long retireMs;              // Time a thread beyond minThreads may be idle before poolRetire() lets it go
+} PoolConfig;
+
+// Counters of a pool since it was created
+typedef struct
+{
+    long started;               // Threads started, by poolStart() and poolGrow()
+    long retired;               // Threads let go by poolRetire()
+    long parks;                 // Times a thread went to sleep in poolPark()
+    long wakeups;               // Parks ended by poolWake() or poolWakeAll() rather than the timeout
+    int peak;                   // Most threads running at once
+} PoolStats;
+
+typedef struct WorkPool WorkPool;
+
+// Function prototypes
+void poolConfigDefaults(PoolConfig *config);
+WorkPool *poolCreate(const PoolConfig *config, void *(*run)(void *), void *arg);
+int poolStart(WorkPool *pool);
+int poolGrow(WorkPool *pool);
+int poolRetire(WorkPool *pool, long idleMs);
+unsigned long poolPrepare(WorkPool *pool);
+void poolCancel(WorkPool *pool);
+int poolPark(WorkPool *pool, unsigned long ticket, long timeoutMs);
+void poolWake(WorkPool *pool);
+void poolWakeAll(WorkPool *pool);
+int poolThreads(WorkPool *pool);
+int poolParked(WorkPool *pool);
+void poolJoin(WorkPool *pool);
+void poolStats(WorkPool *pool, PoolStats *stats);
+void poolDestroy(WorkPool *pool);
+
+#endif
@@ -0,0 +1,755 @@
+/*
+Operating Systems Spring 2024
+Final Project
+
+Resolver: asynchronous DNS lookups behind a process-wide, TTL-aware cache.
+
+A lookup never blocks its caller. A host found in the cache is answered on the spot; any other host
+is entered as pending and handed to the resolver's thread, which runs every query through c-ares on
+its own event loop. Callers asking for a host that is pending join the lookup already running instead
+of sending another query. When the answer arrives, its addresses are cached for the TTL of the
+records (kept within minTtl..maxTtl) and a failure for negativeTtl, and every waiter of the host is
+notified by a byte written to the descriptor it registered with resolverWatch(). That descriptor is
+the wakeup a fetch engine polls along with its sockets. A waiter asking again gets the answer it was
+woken for even if its TTL has run out in the meantime, so lookups always make progress.
+
+The cache is spread over SHARDS shards by the top bits of the host's hash. Each shard has its own
+lock and chained hash table, so workers looking up different hosts do not contend.
+*/
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <ares.h>
+
+#include "hash.h"
+#include "resolver.h"
+
+// Number of shards, a power of two (top 4 bits of the hash)
+#define SHARD_BITS 4
+#define SHARDS (1 << SHARD_BITS)
+
+// Smallest hash table per shard
+#define MIN_BUCKETS 64
+
+// Most descriptors registered at once; a waiter ID is its slot plus a generation above bit 16
+#define MAX_WAITERS 65536
+
+// States of a cached host
+enum { ENTRY_PENDING, ENTRY_READY, ENTRY_FAILED };
+
+// A host in the cache
+typedef struct DnsEntry
+{
+    struct DnsEntry *next;                  // Next entry in the bucket
+    uint64_t hash;                          // Hash of the host name
+    int state;                              // ENTRY_PENDING, ENTRY_READY or ENTRY_FAILED
+    long long expires;                      // Monotonic ms after which the host is looked up again
+    int *waiters;                           // Waiters of the running lookup; once it is done, the ones yet to collect it
+    int waiterCount, waiterCap;
+    char addresses[RESOLVER_MAX_ADDRESSES]; // Addresses of the host, comma-separated
+    char host[];                            // Host name, the key
+} DnsEntry;
+
+typedef struct
+{
+    _Alignas(64) pthread_mutex_t lock;
+    DnsEntry **buckets;                     // Chained hash table
+    size_t mask;                            // Number of buckets - 1
+    size_t count;                           // Hosts in the shard
+    size_t cursor;                          // Bucket the next eviction starts at
+} Shard;
+
+// A host handed to the resolver thread
+typedef struct Query
+{
+    struct Query *next;                     // Next query in the queue
+    Resolver *resolver;                     // Resolver the answer goes to
+    uint64_t hash;                          // Hash of the host name
+    long long started;                      // Monotonic us the lookup was asked for
+    char host[];                            // Host name
+} Query;
+
+// A descriptor notified when lookups finish
+typedef struct
+{
+    int fd;                                 // -1 when the slot is free
+    unsigned gen;                           // Bumped when the slot is freed, so stale IDs are ignored
+} Waiter;
+
+struct Resolver
+{
+    Shard shards[SHARDS];
+    ResolverConfig config;                  // Settings given at creation
+    size_t shardCap;                        // Hosts per shard before the cache evicts
+    ares_channel channel;                   // c-ares channel, used by the resolver thread only
+    int channelReady;                       // 1 once 'channel' is initialized
+    pthread_t thread;                       // Runs the queries
+    int threadStarted;
+    int wake[2];                            // Pipe waking the thread for new queries and shutdown
+    pthread_mutex_t queueLock;              // Guards 'queue' and 'stop'
+    Query *queue;                           // Hosts to look up
+    int stop;                               // Set by resolverDestroy()
+    pthread_mutex_t waiterLock;             // Guards 'waiters'
+    Waiter *waiters;                        // Registered descriptors
+    int waiterCount, waiterCap;
+    atomic_long lookups, hits, negativeHits, joined, queries, expired, failures, entries;
+    atomic_llong queryMicros;
+};
+
+/*
+    Fill a ResolverConfig with the crawler's default settings.
+
+    Preconditions:  'config' points to a valid ResolverConfig structure.
+    Postcondition:  Every field is set; the system's DNS servers are used.
+*/
+void resolverConfigDefaults(ResolverConfig *config)
+{
+    config->servers = NULL;             // resolv.conf
+    config->family = AF_UNSPEC;         // IPv4 and IPv6 addresses, curl picks with happy eyeballs
+    config->timeoutMs = 2000;           // Per query, a lost answer costs two seconds
+    config->tries = 2;
+    config->minTtl = 30;                // Hosts with very short TTLs are not asked for again on every page
+    config->maxTtl = 3600;
+    config->negativeTtl = 60;           // Hosts that do not resolve are not asked for again for a minute
+    config->maxEntries = 65536;
+}
+
+// Current monotonic time in microseconds
+static long long nowUs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// Entry of 'host' in a shard, or NULL; the caller holds the shard's lock
+static DnsEntry *findEntry(const Shard *shard, const char *host, uint64_t hash)
+{
+    DnsEntry *entry = shard->buckets[hash & shard->mask];
+    while (entry != NULL && (entry->hash != hash || strcmp(entry->host, host) != 0))
+        entry = entry->next;
+    return entry;
+}
+
+// Double the hash table of a shard; the caller holds its lock
+static void growBuckets(Shard *shard)
+{
+    size_t buckets = (shard->mask + 1) * 2;
+    DnsEntry **fresh = calloc(buckets, sizeof(DnsEntry *));
+    if (fresh == NULL)
+        return;                                         // Longer chains, still correct
+    for (size_t i = 0; i <= shard->mask; i++)
+    {
+        DnsEntry *entry = shard->buckets[i];
+        while (entry != NULL)
+        {
+            DnsEntry *next = entry->next;
+            entry->next = fresh[entry->hash & (buckets - 1)];
+            fresh[entry->hash & (buckets - 1)] = entry;
+            entry = next;
+        }
+    }
+    free(shard->buckets);
+    shard->buckets = fresh;
+    shard->mask = buckets - 1;
+}
+
+/*
+    Make room in a full shard; the caller holds its lock.
+
+    Drops entries past their TTL until an eighth of the shard is free, and if there are not enough of
+    those, answered entries from a rotating bucket on. Entries with a lookup running are never dropped.
+*/
+static void evictEntries(Resolver *resolver, Shard *shard, long long now)
+{
+    size_t target = resolver->shardCap - resolver->shardCap / 8;
+    for (int pass = 0; pass < 2 && shard->count >= target; pass++)
+    {
+        for (size_t n = 0; n <= shard->mask && shard->count >= target; n++)
+        {
+            size_t bucket = (shard->cursor + n) & shard->mask;
+            DnsEntry **link = &shard->buckets[bucket];
+            while (*link != NULL)
+            {
+                DnsEntry *entry = *link;
+                if (entry->state != ENTRY_PENDING && (pass == 1 || entry->expires <= now))
+                {
+                    *link = entry->next;
+                    free(entry->waiters);
+                    free(entry);
+                    shard->count--;
+                    atomic_fetch_sub(&resolver->entries, 1);
+                }
+                else
+                {
+                    link = &entry->next;
+                }
+            }
+            if (pass == 1)
+                shard->cursor = bucket + 1;
+        }
+    }
+}
+
+/*
+    Remember to notify 'waiter' when the lookup of 'entry' is done; the caller holds the shard's lock.
+    Returns 1 if it was added, 0 if it waits already (or is -1) and -1 if memory allocation failed.
+*/
+static int addWaiter(DnsEntry *entry, int waiter)
+{
+    if (waiter < 0)
+        return 0;
+    for (int i = 0; i < entry->waiterCount; i++)
+    {
+        if (entry->waiters[i] == waiter)
+            return 0;
+    }
+    if (entry->waiterCount == entry->waiterCap)
+    {
+        int cap = entry->waiterCap ? entry->waiterCap * 2 : 4;
+        int *waiters = realloc(entry->waiters, (size_t)cap * sizeof(int));
+        if (waiters == NULL)
+            return -1;
+        entry->waiters = waiters;
+        entry->waiterCap = cap;
+    }
+    entry->waiters[entry->waiterCount++] = waiter;
+    return 1;
+}
+
+// Take 'waiter' off the waiters of 'entry'; returns 1 if it was there. The caller holds the shard's lock
+static int removeWaiter(DnsEntry *entry, int waiter)
+{
+    for (int i = 0; waiter >= 0 && i < entry->waiterCount; i++)
+    {
+        if (entry->waiters[i] == waiter)
+        {
+            entry->waiters[i] = entry->waiters[--entry->waiterCount];
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Wake the descriptor registered as 'waiter', if it still is
+static void notifyWaiter(Resolver *resolver, int waiter)
+{
+    int slot = waiter & 0xffff;
+    unsigned gen = (unsigned)waiter >> 16;
+
+    pthread_mutex_lock(&resolver->waiterLock);
+    if (slot < resolver->waiterCount && resolver->waiters[slot].fd >= 0 && (resolver->waiters[slot].gen & 0x7fff) == gen)
+    {
+        ssize_t written = write(resolver->waiters[slot].fd, "", 1);   // A full pipe is already woken
+        (void)written;
+    }
+    pthread_mutex_unlock(&resolver->waiterLock);
+}
+
+/*
+    Register a descriptor to be woken when lookups finish.
+
+    Preconditions:  'fd' is the non-blocking write end of a pipe (or an equivalent descriptor).
+    Postcondition:  Returns the waiter ID to pass to resolverLookup(), or -1 if no slot is free.
+                    A byte is written to 'fd' whenever a lookup the waiter asked for is done.
+*/
+int resolverWatch(Resolver *resolver, int fd)
+{
+    pthread_mutex_lock(&resolver->waiterLock);
+    int slot = 0;
+    while (slot < resolver->waiterCount && resolver->waiters[slot].fd >= 0)
+        slot++;
+    if (slot == resolver->waiterCount)
+    {
+        if (slot == MAX_WAITERS)
+        {
+            pthread_mutex_unlock(&resolver->waiterLock);
+            return -1;
+        }
+        if (resolver->waiterCount == resolver->waiterCap)
+        {
+            int cap = resolver->waiterCap ? resolver->waiterCap * 2 : 16;
+            Waiter *waiters = realloc(resolver->waiters, (size_t)cap * sizeof(Waiter));
+            if (waiters == NULL)
+            {
+                pthread_mutex_unlock(&resolver->waiterLock);
+                return -1;
+            }
+            resolver->waiters = waiters;
+            resolver->waiterCap = cap;
+        }
+        resolver->waiters[slot].gen = 0;
+        resolver->waiterCount++;
+    }
+    resolver->waiters[slot].fd = fd;
+    int waiter = (int)((resolver->waiters[slot].gen & 0x7fff) << 16) | slot;
+    pthread_mutex_unlock(&resolver->waiterLock);
+    return waiter;
+}
+
+/*
+    Stop notifying a waiter.
+
+    Preconditions:  'waiter' was returned by resolverWatch() on 'resolver'.
+    Postcondition:  Its descriptor is never written to again and may be closed.
+*/
+void resolverUnwatch(Resolver *resolver, int waiter)
+{
+    int slot = waiter & 0xffff;
+    pthread_mutex_lock(&resolver->waiterLock);
+    if (slot < resolver->waiterCount)
+    {
+        resolver->waiters[slot].fd = -1;
+        resolver->waiters[slot].gen++;
+    }
+    pthread_mutex_unlock(&resolver->waiterLock);
+}
+
+/*
+    Look up the addresses of a host. Safe to call from any number of threads, never blocks on DNS.
+
+    Preconditions:  'host' is a host name (not an IP address), 'addresses' has room for 'size' bytes, at least
+                    RESOLVER_MAX_ADDRESSES; 'waiter' was returned by resolverWatch() or is -1 for no notification.
+    Postcondition:  Returns RESOLVER_FOUND with the addresses stored in 'addresses' as "ip,ip,...";
+                    RESOLVER_PENDING if a lookup is running, 'waiter' is notified once it is done and the host
+                    should be looked up again then; or RESOLVER_FAILED if the host does not resolve.
+*/
+int resolverLookup(Resolver *resolver, const char *host, char *addresses, size_t size, int waiter)
+{
+    size_t len = strlen(host);
+    if (len == 0 || len > RESOLVER_MAX_HOST || size < RESOLVER_MAX_ADDRESSES)
+        return RESOLVER_FAILED;
+
+    uint64_t hash = hash64(host, len);
+    Shard *shard = &resolver->shards[hash >> (64 - SHARD_BITS)];
+    long long now = nowUs() / 1000;
+
+    pthread_mutex_lock(&shard->lock);
+    DnsEntry *entry = findEntry(shard, host, hash);
+    int collect = entry != NULL && entry->state != ENTRY_PENDING && removeWaiter(entry, waiter);
+    if (entry != NULL && entry->state != ENTRY_PENDING && (collect || now < entry->expires))
+    {
+        // Cached, or the answer a waiter was woken for: it gets it even if the TTL ran out since
+        int found = entry->state == ENTRY_READY;
+        if (found)
+            memcpy(addresses, entry->addresses, strlen(entry->addresses) + 1);
+        pthread_mutex_unlock(&shard->lock);
+        if (!collect)
+        {
+            atomic_fetch_add(&resolver->lookups, 1);
+            atomic_fetch_add(found ? &resolver->hits : &resolver->negativeHits, 1);
+        }
+        return found ? RESOLVER_FOUND : RESOLVER_FAILED;
+    }
+    if (entry != NULL && entry->state == ENTRY_PENDING)  // Join the lookup already running
+    {
+        int added = addWaiter(entry, waiter);
+        pthread_mutex_unlock(&shard->lock);
+        if (added > 0 || waiter < 0)                    // A waiter asking again is not counted twice
+        {
+            atomic_fetch_add(&resolver->lookups, 1);
+            atomic_fetch_add(&resolver->joined, 1);
+        }
+        return added >= 0 ? RESOLVER_PENDING : RESOLVER_FAILED;
+    }
+
+    // Not cached, or past its TTL: start a lookup
+    Query *query = malloc(sizeof(Query) + len + 1);
+    if (query == NULL)
+    {
+        pthread_mutex_unlock(&shard->lock);
+        return RESOLVER_FAILED;
+    }
+    if (entry == NULL)
+    {
+        if (shard->count >= resolver->shardCap)
+            evictEntries(resolver, shard, now);
+        entry = calloc(1, sizeof(DnsEntry) + len + 1);
+        if (entry == NULL)
+        {
+            pthread_mutex_unlock(&shard->lock);
+            free(query);
+            return RESOLVER_FAILED;
+        }
+        entry->hash = hash;
+        memcpy(entry->host, host, len + 1);
+        if (shard->count >= shard->mask + 1)
+            growBuckets(shard);
+        entry->next = shard->buckets[hash & shard->mask];
+        shard->buckets[hash & shard->mask] = entry;
+        shard->count++;
+        atomic_fetch_add(&resolver->entries, 1);
+    }
+    else
+    {
+        entry->waiterCount = 0;                         // Waiters that never collected the old answer
+        atomic_fetch_add(&resolver->expired, 1);
+    }
+    entry->state = ENTRY_PENDING;
+    if (addWaiter(entry, waiter) < 0)
+    {
+        entry->state = ENTRY_FAILED;                    // Asked for again on the next lookup
+        entry->expires = now;
+        pthread_mutex_unlock(&shard->lock);
+        free(query);
+        return RESOLVER_FAILED;
+    }
+    pthread_mutex_unlock(&shard->lock);
+
+    // Hand it to the resolver thread
+    query->resolver = resolver;
+    query->hash = hash;
+    query->started = nowUs();
+    memcpy(query->host, host, len + 1);
+    pthread_mutex_lock(&resolver->queueLock);
+    query->next = resolver->queue;
+    resolver->queue = query;
+    pthread_mutex_unlock(&resolver->queueLock);
+    ssize_t written = write(resolver->wake[1], "", 1);
+    (void)written;
+
+    atomic_fetch_add(&resolver->lookups, 1);
+    atomic_fetch_add(&resolver->queries, 1);
+    return RESOLVER_PENDING;
+}
+
+// The address of a node of an answer, NULL for a family other than IPv4 and IPv6; its length in 'len'
+static const void *nodeAddress(const struct ares_addrinfo_node *node, size_t *len)
+{
+    if (node->ai_family == AF_INET6)
+    {
+        *len = sizeof(struct in6_addr);
+        return &((const struct sockaddr_in6 *)node->ai_addr)->sin6_addr;
+    }
+    *len = sizeof(struct in_addr);
+    return node->ai_family == AF_INET ? &((const struct sockaddr_in *)node->ai_addr)->sin_addr : NULL;
+}
+
+// 1 if a node of the answer before 'node' has the same address, for another socket type
+static int seenAddress(const struct ares_addrinfo *result, const struct ares_addrinfo_node *node)
+{
+    size_t len, earlierLen;
+    const void *addr = nodeAddress(node, &len);
+    for (const struct ares_addrinfo_node *earlier = result->nodes; earlier != node; earlier = earlier->ai_next)
+    {
+        const void *earlierAddr = nodeAddress(earlier, &earlierLen);
+        if (earlier->ai_family == node->ai_family && earlierAddr != NULL && memcmp(earlierAddr, addr, len) == 0)
+            return 1;
+    }
+    return 0;
+}
+
+// Format the addresses of an answer as curl takes them; returns the smallest TTL of the records, -1 if there are none
+static long formatAddresses(const struct ares_addrinfo *result, char *out, size_t size)
+{
+    size_t used = 0;
+    long ttl = -1;
+    out[0] = '\0';
+    for (const struct ares_addrinfo_node *node = result != NULL ? result->nodes : NULL; node != NULL; node = node->ai_next)
+    {
+        char ip[INET6_ADDRSTRLEN];
+        size_t len;
+        const void *addr = nodeAddress(node, &len);
+        if (addr == NULL || inet_ntop(node->ai_family, addr, ip, sizeof(ip)) == NULL)
+            continue;
+        if (seenAddress(result, node))
+            continue;                                   // Same address for another socket type
+        size_t need = strlen(ip) + (node->ai_family == AF_INET6 ? 2 : 0) + (used > 0);
+        if (used + need + 1 > size)
+            break;                                      // Enough addresses to connect to
+        used += (size_t)sprintf(out + used, node->ai_family == AF_INET6 ? "%s[%s]" : "%s%s", used > 0 ? "," : "", ip);
+        if (ttl < 0 || node->ai_ttl < ttl)
+            ttl = node->ai_ttl;
+    }
+    return ttl;
+}
+
+// c-ares callback on the resolver thread: cache the answer and wake the waiters of the host
+static void lookupDone(void *arg, int status, int timeouts, struct ares_addrinfo *result)
+{
+    Query *query = (Query *)arg;
+    Resolver *resolver = query->resolver;
+    (void)timeouts;
+
+    if (status == ARES_EDESTRUCTION)                    // Resolver being destroyed
+    {
+        if (result != NULL)
+            ares_freeaddrinfo(result);
+        free(query);
+        return;
+    }
+
+    char addresses[RESOLVER_MAX_ADDRESSES] = "";
+    long ttl = status == ARES_SUCCESS ? formatAddresses(result, addresses, sizeof(addresses)) : -1;
+    if (result != NULL)
+        ares_freeaddrinfo(result);
+    int found = ttl >= 0;                               // At least one address
+    if (found)
+    {
+        if (ttl < resolver->config.minTtl)
+            ttl = resolver->config.minTtl;
+        if (ttl > resolver->config.maxTtl)
+            ttl = resolver->config.maxTtl;
+    }
+    else
+    {
+        ttl = resolver->config.negativeTtl;
+        atomic_fetch_add(&resolver->failures, 1);
+    }
+
+    long long now = nowUs();
+    atomic_fetch_add(&resolver->queryMicros, now - query->started);
+
+    Shard *shard = &resolver->shards[query->hash >> (64 - SHARD_BITS)];
+    pthread_mutex_lock(&shard->lock);
+    DnsEntry *entry = findEntry(shard, query->host, query->hash);   // Pending entries are never evicted
+    if (entry != NULL)
+    {
+        entry->state = found ? ENTRY_READY : ENTRY_FAILED;
+        entry->expires = now / 1000 + ttl * 1000;
+        memcpy(entry->addresses, addresses, strlen(addresses) + 1);
+        for (int i = 0; i < entry->waiterCount; i++)    // They stay listed until they collect the answer
+            notifyWaiter(resolver, entry->waiters[i]);
+    }
+    pthread_mutex_unlock(&shard->lock);
+    free(query);
+}
+
+/*
+    Resolver thread: start the queries handed over and drive c-ares until the resolver is destroyed.
+
+    Waits in poll() on the sockets c-ares uses and the wake pipe, up to the next query timeout.
+*/
+static void *resolverThread(void *arg)
+{
+    Resolver *resolver = (Resolver *)arg;
+
+    while (1)
+    {
+        pthread_mutex_lock(&resolver->queueLock);
+        Query *query = resolver->queue;
+        int stop = resolver->stop;
+        resolver->queue = NULL;
+        pthread_mutex_unlock(&resolver->queueLock);
+
+        while (query != NULL)
+        {
+            Query *next = query->next;
+            if (stop)
+            {
+                free(query);
+            }
+            else
+            {
+                struct ares_addrinfo_hints hints;
+                memset(&hints, 0, sizeof(hints));
+                hints.ai_flags = ARES_AI_NOSORT;        // curl orders the connection attempts itself
+                hints.ai_family = resolver->config.family;
+                hints.ai_socktype = SOCK_STREAM;
+                ares_getaddrinfo(resolver->channel, query->host, NULL, &hints, lookupDone, query);
+            }
+            query = next;
+        }
+        if (stop)
+            break;
+
+        // Wait for an answer, a timeout or more queries
+        ares_socket_t sockets[ARES_GETSOCK_MAXNUM];
+        int bits = ares_getsock(resolver->channel, sockets, ARES_GETSOCK_MAXNUM);
+        struct pollfd fds[ARES_GETSOCK_MAXNUM + 1];
+        int n = 0;
+        fds[n].fd = resolver->wake[0];
+        fds[n++].events = POLLIN;
+        for (int i = 0; i < ARES_GETSOCK_MAXNUM; i++)
+        {
+            short events = (short)((ARES_GETSOCK_READABLE(bits, i) ? POLLIN : 0) | (ARES_GETSOCK_WRITABLE(bits, i) ? POLLOUT : 0));
+            if (events == 0)
+                continue;
+            fds[n].fd = sockets[i];
+            fds[n++].events = events;
+        }
+        struct timeval tv;
+        int timeoutMs = -1;
+        if (ares_timeout(resolver->channel, NULL, &tv) != NULL)
+            timeoutMs = (int)(tv.tv_sec * 1000 + (tv.tv_usec + 999) / 1000);
+
+        if (poll(fds, (nfds_t)n, timeoutMs) < 0)
+            continue;                                   // Interrupted, look again
+
+        if (fds[0].revents & POLLIN)
+        {
+            char drain[64];
+            while (read(resolver->wake[0], drain, sizeof(drain)) > 0)
+                ;
+        }
+        for (int i = 1; i < n; i++)
+        {
+            if (fds[i].revents == 0)
+                continue;
+            ares_process_fd(resolver->channel,
+                            (fds[i].revents & (POLLIN | POLLERR | POLLHUP)) ? fds[i].fd : ARES_SOCKET_BAD,
+                            (fds[i].revents & POLLOUT) ? fds[i].fd : ARES_SOCKET_BAD);
+        }
+        ares_process_fd(resolver->channel, ARES_SOCKET_BAD, ARES_SOCKET_BAD);   // Queries that timed out
+    }
+    return NULL;
+}
+
+// Free a resolver that is created in part or in full, its thread stopped
+static void releaseResolver(Resolver *resolver)
+{
+    if (resolver->channelReady)
+    {
+        ares_destroy(resolver->channel);                // Abandons the lookups still running
+        ares_library_cleanup();
+    }
+    for (int i = 0; i < SHARDS; i++)
+    {
+        Shard *shard = &resolver->shards[i];
+        for (size_t k = 0; shard->buckets != NULL && k <= shard->mask; k++)
+        {
+            DnsEntry *entry = shard->buckets[k];
+            while (entry != NULL)
+            {
+                DnsEntry *next = entry->next;
+                free(entry->waiters);
+                free(entry);
+                entry = next;
+            }
+        }
+        free(shard->buckets);
+        pthread_mutex_destroy(&shard->lock);
+    }
+    while (resolver->queue != NULL)
+    {
+        Query *next = resolver->queue->next;
+        free(resolver->queue);
+        resolver->queue = next;
+    }
+    if (resolver->wake[0] >= 0)
+    {
+        close(resolver->wake[0]);
+        close(resolver->wake[1]);
+    }
+    free(resolver->waiters);
+    pthread_mutex_destroy(&resolver->queueLock);
+    pthread_mutex_destroy(&resolver->waiterLock);
+    free(resolver);
+}
+
+/*
+    Create a resolver and start its thread.
+
+    Preconditions:  'config' points to a valid ResolverConfig.
+    Postcondition:  Returns a new resolver with an empty cache, or NULL if c-ares could not be set up, the
+                    DNS servers are invalid or memory allocation failed.
+*/
+Resolver *resolverCreate(const ResolverConfig *config)
+{
+    Resolver *resolver = aligned_alloc(64, sizeof(Resolver));
+    if (resolver == NULL)
+        return NULL;
+    memset(resolver, 0, sizeof(Resolver));
+    resolver->config = *config;
+    resolver->shardCap = config->maxEntries / SHARDS > 0 ? config->maxEntries / SHARDS : 1;
+    resolver->wake[0] = resolver->wake[1] = -1;
+    pthread_mutex_init(&resolver->queueLock, NULL);
+    pthread_mutex_init(&resolver->waiterLock, NULL);
+
+    int ok = 1;
+    for (int i = 0; i < SHARDS; i++)
+    {
+        Shard *shard = &resolver->shards[i];
+        pthread_mutex_init(&shard->lock, NULL);
+        shard->buckets = calloc(MIN_BUCKETS, sizeof(DnsEntry *));
+        shard->mask = MIN_BUCKETS - 1;
+        ok = ok && shard->buckets != NULL;
+    }
+
+    // c-ares channel: per-query timeout and tries, the given servers instead of resolv.conf
+    struct ares_options options;
+    memset(&options, 0, sizeof(options));
+    options.timeout = (int)config->timeoutMs;
+    options.tries = config->tries > 0 ? config->tries : 1;
+    if (ok && ares_library_init(ARES_LIB_INIT_ALL) == ARES_SUCCESS)
+    {
+        if (ares_init_options(&resolver->channel, &options, ARES_OPT_TIMEOUTMS | ARES_OPT_TRIES) == ARES_SUCCESS)
+            resolver->channelReady = 1;
+        else
+            ares_library_cleanup();
+    }
+    ok = resolver->channelReady &&
+         (config->servers == NULL || ares_set_servers_ports_csv(resolver->channel, config->servers) == ARES_SUCCESS);
+
+    // Wake pipe, non-blocking on both ends
+    if (ok && pipe(resolver->wake) != 0)
+    {
+        resolver->wake[0] = resolver->wake[1] = -1;
+        ok = 0;
+    }
+    for (int i = 0; ok && i < 2; i++)
+    {
+        fcntl(resolver->wake[i], F_SETFL, fcntl(resolver->wake[i], F_GETFL) | O_NONBLOCK);
+        fcntl(resolver->wake[i], F_SETFD, FD_CLOEXEC);
+    }
+
+    if (!ok || pthread_create(&resolver->thread, NULL, resolverThread, resolver) != 0)
+    {
+        releaseResolver(resolver);
+        return NULL;
+    }
+    resolver->threadStarted = 1;
+    return resolver;
+}
+
+/*
+    Read the counters of a resolver.
+
+    Preconditions:  'resolver' was returned by resolverCreate(), 'stats' points to a ResolverStats.
+    Postcondition:  'stats' holds the counters so far; 'savedMicros' estimates the time the cache saved as the
+                    number of hits times the mean time of a lookup sent to DNS.
+*/
+void resolverStats(Resolver *resolver, ResolverStats *stats)
+{
+    stats->lookups = atomic_load(&resolver->lookups);
+    stats->hits = atomic_load(&resolver->hits);
+    stats->negativeHits = atomic_load(&resolver->negativeHits);
+    stats->joined = atomic_load(&resolver->joined);
+    stats->queries = atomic_load(&resolver->queries);
+    stats->expired = atomic_load(&resolver->expired);
+    stats->failures = atomic_load(&resolver->failures);
+    stats->queryMicros = atomic_load(&resolver->queryMicros);
+    stats->entries = atomic_load(&resolver->entries);
+    stats->savedMicros = stats->queries > 0 ? (stats->hits + stats->negativeHits) * (stats->queryMicros / stats->queries) : 0;
+}
+
+/*
+    Destroy a resolver.
+
+    Preconditions:  'resolver' was returned by resolverCreate() or is NULL, and no thread uses it any more.
+    Postcondition:  Its thread is stopped, lookups still running are abandoned and all memory is released.
+*/
+void resolverDestroy(Resolver *resolver)
+{
+    if (resolver == NULL)
+        return;
+    pthread_mutex_lock(&resolver->queueLock);
+    resolver->stop = 1;
+    pthread_mutex_unlock(&resolver->queueLock);
+    ssize_t written = write(resolver->wake[1], "", 1);
+    (void)written;
+    if (resolver->threadStarted)
+        pthread_join(resolver->thread, NULL);
+    releaseResolver(resolver);
+}
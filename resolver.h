@@ -0,0 +1,63 @@
+/*
+Operating Systems Spring 2024
+Final Project
+
+Resolver: asynchronous DNS lookups behind a process-wide, TTL-aware cache shared by every worker.
+*/
+
+#ifndef RESOLVER_H
+#define RESOLVER_H
+
+#include <stddef.h>
+
+// Longest host name looked up
+#define RESOLVER_MAX_HOST 255
+
+// Room for the addresses of a host, as curl's CURLOPT_RESOLVE takes them ("1.2.3.4,[::1]")
+#define RESOLVER_MAX_ADDRESSES 256
+
+// Outcomes of resolverLookup()
+#define RESOLVER_FOUND 0        // The addresses were in the cache
+#define RESOLVER_PENDING 1      // A lookup is running, the waiter is notified when it is done
+#define RESOLVER_FAILED -1      // The host does not resolve, or did not a moment ago
+
+typedef struct Resolver Resolver;
+
+// Settings for a resolver
+typedef struct
+{
+    const char *servers;        // DNS servers as "ip[:port],...", NULL for the system's (resolv.conf)
+    int family;                 // AF_INET, AF_INET6 or AF_UNSPEC for both
+    long timeoutMs;             // Time to wait for an answer before the query is tried again
+    int tries;                  // Queries sent per server before the lookup fails
+    long minTtl;                // Seconds an answer is kept at least, whatever its TTL
+    long maxTtl;                // Seconds an answer is kept at most (0 = never cached)
+    long negativeTtl;           // Seconds a failed lookup is remembered
+    size_t maxEntries;          // Hosts kept in the cache; expired ones are dropped first when it is full
+} ResolverConfig;
+
+// Counters of a resolver since it was created
+typedef struct
+{
+    long lookups;               // resolverLookup() calls, a waiter asking again for a pending host not counted
+    long hits;                  // Answered from the cache
+    long negativeHits;          // Answered from the cache with a remembered failure
+    long joined;                // Joined a lookup already running for the host
+    long queries;               // Lookups sent to DNS
+    long expired;               // Of those, refreshes of entries past their TTL
+    long failures;              // Lookups that failed
+    long long queryMicros;      // Time from sending to answering, over every lookup sent
+    long long savedMicros;      // Hits times the mean lookup time: the waiting the cache saved
+    long entries;               // Hosts in the cache
+} ResolverStats;
+
+// Function prototypes
+void resolverConfigDefaults(ResolverConfig *config);
+Resolver *resolverCreate(const ResolverConfig *config);
+int resolverWatch(Resolver *resolver, int fd);
+void resolverUnwatch(Resolver *resolver, int waiter);
+int resolverLookup(Resolver *resolver, const char *host, char *addresses, size_t size, int waiter);
+void resolverStats(Resolver *resolver, ResolverStats *stats);
+void resolverDestroy(Resolver *resolver);
+
+#endif
@@ -0,0 +1,1200 @@
+/*
+Operating Systems Spring 2024
+Final Project
+
+Robots: the robots.txt of every host fetched once, compiled into a matcher and kept in a shared cache.
+
+Parsing follows RFC 9309. Of the groups of a robots.txt, those naming the crawler's product token in a
+User-agent line apply, merged if there are several; otherwise those of "*"; with neither, every URL is
+allowed. Their Allow and Disallow rules are compiled into a byte trie of their paths:
+
+  plain      a rule with no '*' but at the end ends at the node of its path, which holds its verdict, and
+             that of the one ending there with '$'. Walking the path of a URL down the trie meets every
+             plain rule that is a prefix of it, the deepest being the longest.
+  wildcards  a rule with a '*' inside hangs off the node of the part before its first '*', in a list sorted
+             from the longest down. Only the lists of the nodes the walk passes are matched, with a glob
+             from that node on, and only while their rules are longer than the best match so far.
+
+The longest rule matching wins and Allow wins a tie, so checking a URL costs one step per byte of its path
+plus the few wildcard rules under that path that could beat the plain ones. A trailing '*' adds nothing
+and does not count towards the length of a rule. Patterns have their percent-escapes brought into the
+form urlNormalize() gives URLs, so the two compare byte for byte.
+
+The cache keeps the rules of every scheme://host:port, spread over SHARDS shards by the hash of the origin,
+each with its own lock, hash table and least-recently-used list. A host is entered as pending the first
+time one of its URLs is checked, and its robots.txt is queued for the cache's thread, which fetches them
+all through one fetch engine of its own. URLs of a pending host wait in its entry until the answer is in,
+then are handed back through the onRelease callback. Once its TTL has run out, a host's robots.txt is
+fetched again while the old rules keep answering. Beyond maxHosts, the hosts used least recently are
+dropped, except those being fetched.
+*/
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+
+#include "hash.h"
+#include "robots.h"
+
+// Number of shards, a power of two (top 4 bits of the hash)
+#define SHARD_BITS 4
+#define SHARDS (1 << SHARD_BITS)
+
+// Smallest hash table per shard
+#define MIN_BUCKETS 64
+
+// Longest pattern of a rule kept, after its escapes are normalized
+#define MAX_PATTERN 2048
+
+// Nodes with wildcard rules a check defers until the plain rules are matched
+#define MAX_WILD_NODES 32
+
+// Redirects followed to a robots.txt (RFC 9309 asks for at least five)
+#define MAX_REDIRECTS 5
+
+// Longest the cache's thread waits for transfers before it takes new robots.txt to fetch
+#define POLL_MS 20
+
+static const char ROBOTS_PATH[] = "/robots.txt";
+
+// A node of the trie; node 0 is the root, the empty path
+typedef struct
+{
+    uint32_t child;             // First child, 0 for none
+    uint32_t sibling;           // Next child of the same parent, 0 for none
+    unsigned char byte;         // Byte of the path leading here
+    signed char prefix;         // Verdict of the rule ending here: -1 none, 0 allow, 1 disallow
+    signed char exact;          // Verdict of the rule ending here with '$'
+    uint16_t depth;             // Length of the path leading here
+    int32_t wild;               // First wildcard rule whose part before the '*' ends here, -1 for none
+} RobotsNode;
+
+// A rule with a '*' inside
+typedef struct
+{
+    char *pattern;
+    size_t len;                 // Bytes of the pattern, without a final '$'
+    size_t priority;            // Length of the rule, '$' included
+    int anchored;               // 1 if the pattern ended with '$'
+    int allow;
+    int32_t next;               // Next rule of the same node, no longer, -1 for none
+} WildRule;
+
+struct RobotsRules
+{
+    RobotsNode *nodes;
+    uint32_t nodeCount, nodeCap;
+    WildRule *wild;
+    int wildCount, wildCap;
+    int ruleCount;
+    long delayMs;               // Crawl-delay, -1 for none
+};
+
+// A rule of the robots.txt text, before it is compiled
+typedef struct
+{
+    const char *value;
+    size_t len;
+    int allow;
+} RawRule;
+
+typedef struct
+{
+    RawRule *rules;
+    int count, cap;
+} RawRules;
+
+// States of a host in the cache
+enum { ENTRY_PENDING, ENTRY_READY };
+
+// A URL waiting for the robots.txt of its host
+typedef struct Parked
+{
+    struct Parked *next;
+    int depth;
+    int allowed;                // Set once the robots.txt is in
+    char url[];
+} Parked;
+
+// A host in the cache
+typedef struct RobotsEntry
+{
+    struct RobotsEntry *next;               // Next entry in the bucket
+    struct RobotsEntry *newer, *older;      // Neighbours in the shard's least-recently-used list
+    uint64_t hash;                          // Hash of the origin
+    int state;                              // ENTRY_PENDING or ENTRY_READY
+    int fetching;                           // 1 while its robots.txt is being fetched, a refresh too
+    int disallowAll;                        // 1 if the robots.txt could not be fetched
+    long long expires;                      // Monotonic ms after which the robots.txt is fetched again
+    RobotsRules *rules;                     // Rules of the host, NULL to allow every URL
+    Parked *parked;                         // URLs waiting for the rules
+    Parked **parkedEnd;
+    size_t originLen;
+    char origin[];                          // scheme://host:port, the key
+} RobotsEntry;
+
+typedef struct
+{
+    _Alignas(64) pthread_mutex_t lock;
+    RobotsEntry **buckets;                  // Chained hash table
+    size_t mask;                            // Number of buckets - 1
+    size_t count;                           // Hosts in the shard
+    RobotsEntry *newest, *oldest;           // Ends of the least-recently-used list
+} Shard;
+
+// A robots.txt being fetched
+typedef struct RobotsFetch
+{
+    struct RobotsFetch *next;               // Next in the queue, or in the list of those in flight
+    struct RobotsFetch *prev;               // Previous in the list of those in flight
+    uint64_t hash;                          // Hash of the origin
+    char *body;                             // Body received so far, up to ROBOTS_MAX_BYTES
+    size_t len, cap;
+    char url[];                             // origin + ROBOTS_PATH
+} RobotsFetch;
+
+struct RobotsCache
+{
+    RobotsConfig config;
+    Shard shards[SHARDS];
+    size_t shardCapacity;                   // Hosts per shard before the least recently used are dropped
+    FetchEngine *engine;                    // Used by the cache's thread only
+
+    // robots.txt to fetch, under 'lock'
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    RobotsFetch *queue;
+    RobotsFetch **queueEnd;
+    int stop;
+    pthread_t thread;
+    RobotsFetch *active;                    // Those in flight, the cache's thread only
+
+    atomic_long checks, hits, disallowed, parked, fetches, missing, unreachable, evictions, entries;
+};
+
+// Current monotonic time in milliseconds
+static long long nowMs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static int hexValue(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+// Bytes urlNormalize() leaves as they are rather than escaped
+static int isUnreserved(unsigned char c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '-' || c == '.' ||
+           c == '_' || c == '~';
+}
+
+// Bytes urlNormalize() escapes
+static int mustEscape(unsigned char c)
+{
+    return c <= 0x20 || c >= 0x7f || strchr("\"<>\\^`{|}", c) != NULL;
+}
+
+// Copy a pattern with its escapes in the form urlNormalize() gives URLs; the length, or -1 if it does not fit
+static long normalizePattern(const char *s, size_t len, char *out, size_t size)
+{
+    static const char hex[] = "0123456789ABCDEF";
+    size_t n = 0;
+    for (size_t i = 0; i < len; i++)
+    {
+        unsigned char c = (unsigned char)s[i];
+        if (n + 3 > size)
+            return -1;
+        if (c == '%' && i + 2 < len && hexValue(s[i + 1]) >= 0 && hexValue(s[i + 2]) >= 0)
+        {
+            c = (unsigned char)(hexValue(s[i + 1]) * 16 + hexValue(s[i + 2]));
+            i += 2;
+            if (isUnreserved(c))
+            {
+                out[n++] = (char)c;
+                continue;
+            }
+        }
+        else if (!mustEscape(c))
+        {
+            out[n++] = (char)c;
+            continue;
+        }
+        out[n++] = '%';
+        out[n++] = hex[c >> 4];
+        out[n++] = hex[c & 15];
+    }
+    return (long)n;
+}
+
+// Child of trie node 'node' for 'byte', created if 'create'; 0 for none or out of memory
+static uint32_t trieChild(RobotsRules *rules, uint32_t node, unsigned char byte, int create)
+{
+    for (uint32_t c = rules->nodes[node].child; c != 0; c = rules->nodes[c].sibling)
+    {
+        if (rules->nodes[c].byte == byte)
+            return c;
+    }
+    if (!create)
+        return 0;
+    if (rules->nodeCount == rules->nodeCap)
+    {
+        uint32_t cap = rules->nodeCap * 2;
+        RobotsNode *nodes = realloc(rules->nodes, sizeof(RobotsNode) * cap);
+        if (nodes == NULL)
+            return 0;
+        rules->nodes = nodes;
+        rules->nodeCap = cap;
+    }
+    uint32_t c = rules->nodeCount++;
+    rules->nodes[c] = (RobotsNode){ 0, rules->nodes[node].child, byte, -1, -1,
+                                    (uint16_t)(rules->nodes[node].depth + 1), -1 };
+    rules->nodes[node].child = c;
+    return c;
+}
+
+// Compile one Allow or Disallow rule into the rules; 0, or -1 if out of memory
+static int addRule(RobotsRules *rules, const char *value, size_t len, int allow)
+{
+    char pattern[MAX_PATTERN];
+    long n = normalizePattern(value, len, pattern, sizeof(pattern));
+    if (len == 0 || (value[0] != '/' && value[0] != '*') || n < 0)
+        return 0;                               // An empty Disallow allows everything; others are not paths
+    while (n > 0 && pattern[n - 1] == '*')      // "/a*" is "/a"
+        n--;
+    int anchored = n > 0 && pattern[n - 1] == '$';
+    size_t core = (size_t)n - (size_t)anchored;
+    size_t priority = (size_t)n;                // Length the rule is ranked by
+    signed char verdict = allow ? 0 : 1;
+    rules->ruleCount++;
+
+    // Down the trie to the end of the pattern, or to its first '*'
+    const char *star = memchr(pattern, '*', core);
+    size_t literal = star != NULL ? (size_t)(star - pattern) : core;
+    uint32_t node = 0;
+    for (size_t i = 0; i < literal; i++)
+    {
+        if ((node = trieChild(rules, node, (unsigned char)pattern[i], 1)) == 0)
+            return -1;
+    }
+    if (star == NULL)
+    {
+        signed char *slot = anchored ? &rules->nodes[node].exact : &rules->nodes[node].prefix;
+        if (*slot < 0 || allow)                 // Allow wins a tie
+            *slot = verdict;
+        return 0;
+    }
+
+    // Into the node's list, longest first and Allow first among rules as long; a repeated rule is kept once
+    int32_t *link = &rules->nodes[node].wild;
+    while (*link >= 0 && (rules->wild[*link].priority > priority ||
+                          (rules->wild[*link].priority == priority && rules->wild[*link].allow >= allow)))
+    {
+        WildRule *rule = &rules->wild[*link];
+        if (rule->priority == priority && rule->anchored == anchored && memcmp(rule->pattern, pattern, core) == 0)
+            return 0;                           // The same rule, or one that allows where this one disallows
+        link = &rule->next;
+    }
+    if (rules->wildCount == rules->wildCap)
+    {
+        int cap = rules->wildCap > 0 ? rules->wildCap * 2 : 8;
+        WildRule *wild = realloc(rules->wild, sizeof(WildRule) * (size_t)cap);
+        if (wild == NULL)
+            return -1;
+        rules->wild = wild;
+        rules->wildCap = cap;
+        link = &rules->nodes[node].wild;        // Find the place again, 'link' may point into the old array
+        while (*link >= 0 && (rules->wild[*link].priority > priority ||
+                              (rules->wild[*link].priority == priority && rules->wild[*link].allow >= allow)))
+            link = &rules->wild[*link].next;
+    }
+    char *copy = malloc(core + 1);
+    if (copy == NULL)
+        return -1;
+    memcpy(copy, pattern, core);
+    copy[core] = '\0';
+    int32_t index = rules->wildCount++;
+    rules->wild[index] = (WildRule){ copy, core, priority, anchored, allow, *link };
+    *link = index;
+    return 0;
+}
+
+// Append a rule of the text to a list; 0, or -1 if out of memory
+static int rawAdd(RawRules *list, const char *value, size_t len, int allow)
+{
+    if (list->count == list->cap)
+    {
+        int cap = list->cap > 0 ? list->cap * 2 : 16;
+        RawRule *rules = realloc(list->rules, sizeof(RawRule) * (size_t)cap);
+        if (rules == NULL)
+            return -1;
+        list->rules = rules;
+        list->cap = cap;
+    }
+    list->rules[list->count++] = (RawRule){ value, len, allow };
+    return 0;
+}
+
+// Crawl-delay value in ms, -1 if it is not a number of seconds
+static long parseDelay(const char *value, size_t len)
+{
+    char number[32];
+    if (len == 0 || len >= sizeof(number))
+        return -1;
+    memcpy(number, value, len);
+    number[len] = '\0';
+    char *end;
+    double seconds = strtod(number, &end);
+    if (end == number || seconds < 0 || seconds > 86400)
+        return -1;
+    return (long)(seconds * 1000);
+}
+
+/*
+    Compile the rules of a robots.txt that apply to a crawler.
+
+    Preconditions:  'text' holds 'len' bytes of a robots.txt, 'agent' is the crawler's product token.
+    Postcondition:  Returns the compiled rules of the groups for 'agent', or of the "*" groups if none names it
+                    (with neither, no rule: everything is allowed), with their Crawl-delay; NULL if out of memory.
+                    Free them with robotsFree().
+*/
+RobotsRules *robotsParse(const char *text, size_t len, const char *agent)
+{
+    RawRules specific = { 0 }, star = { 0 };    // Rules of the groups for 'agent' and of the "*" groups
+    int foundSpecific = 0;
+    long delaySpecific = -1, delayStar = -1;
+    int inAgents = 0;                           // 1 right after a User-agent line
+    int groupSpecific = 0, groupStar = 0;       // Whom the current group is for
+    size_t agentLen = strlen(agent);
+    int failed = 0;
+    if (len > ROBOTS_MAX_BYTES)
+        len = ROBOTS_MAX_BYTES;
+
+    size_t pos = 0;
+    while (pos < len && !failed)
+    {
+        size_t end = pos;
+        while (end < len && text[end] != '\n' && text[end] != '\r')
+            end++;
+        const char *line = text + pos;
+        size_t lineLen = end - pos;
+        pos = end + 1;
+        const char *comment = memchr(line, '#', lineLen);
+        if (comment != NULL)
+            lineLen = (size_t)(comment - line);
+        const char *colon = memchr(line, ':', lineLen);
+        if (colon == NULL)
+            continue;
+
+        // key: value, with the spaces around both stripped
+        const char *key = line;
+        size_t keyLen = (size_t)(colon - line);
+        while (keyLen > 0 && (*key == ' ' || *key == '\t'))
+        {
+            key++;
+            keyLen--;
+        }
+        while (keyLen > 0 && (key[keyLen - 1] == ' ' || key[keyLen - 1] == '\t'))
+            keyLen--;
+        const char *value = colon + 1;
+        size_t valueLen = lineLen - (size_t)(value - line);
+        while (valueLen > 0 && (*value == ' ' || *value == '\t'))
+        {
+            value++;
+            valueLen--;
+        }
+        while (valueLen > 0 && (value[valueLen - 1] == ' ' || value[valueLen - 1] == '\t'))
+            valueLen--;
+
+        if (keyLen == 10 && strncasecmp(key, "user-agent", 10) == 0)
+        {
+            if (!inAgents)                      // A new group starts
+                groupSpecific = groupStar = 0;
+            inAgents = 1;
+            size_t token = 0;                   // The product token, without a version; the text has no '\0'
+            while (token < valueLen && value[token] != ' ' && value[token] != '\t' && value[token] != '/')
+                token++;
+            if (token == 1 && value[0] == '*')
+                groupStar = 1;
+            else if (token == agentLen && strncasecmp(value, agent, agentLen) == 0)
+                groupSpecific = foundSpecific = 1;
+            continue;
+        }
+
+        int allow = keyLen == 5 && strncasecmp(key, "allow", 5) == 0;
+        int disallow = keyLen == 8 && strncasecmp(key, "disallow", 8) == 0;
+        int delay = keyLen == 11 && strncasecmp(key, "crawl-delay", 11) == 0;
+        if (!allow && !disallow && !delay)
+            continue;                           // Sitemap and the like belong to no group
+        inAgents = 0;
+        if (delay)
+        {
+            long ms = parseDelay(value, valueLen);
+            if (groupSpecific && ms >= 0)
+                delaySpecific = ms;
+            if (groupStar && ms >= 0)
+                delayStar = ms;
+            continue;
+        }
+        if (groupSpecific && rawAdd(&specific, value, valueLen, allow) != 0)
+            failed = 1;
+        if (groupStar && rawAdd(&star, value, valueLen, allow) != 0)
+            failed = 1;
+    }
+
+    RobotsRules *rules = calloc(1, sizeof(RobotsRules));
+    if (rules != NULL && !failed)
+    {
+        rules->nodeCap = 64;
+        rules->nodeCount = 1;
+        rules->nodes = malloc(sizeof(RobotsNode) * rules->nodeCap);
+        if (rules->nodes != NULL)
+        {
+            rules->nodes[0] = (RobotsNode){ 0, 0, 0, -1, -1, 0, -1 };
+            const RawRules *chosen = foundSpecific ? &specific : &star;
+            rules->delayMs = foundSpecific ? delaySpecific : delayStar;
+            for (int i = 0; i < chosen->count && !failed; i++)
+                failed = addRule(rules, chosen->rules[i].value, chosen->rules[i].len, chosen->rules[i].allow) != 0;
+        }
+        else
+            failed = 1;
+    }
+    free(specific.rules);
+    free(star.rules);
+    if (failed)
+    {
+        robotsFree(rules);
+        return NULL;
+    }
+    return rules;
+}
+
+/*
+    Whether 'pattern' with its '*' wildcards matches the start of 'path', or all of it if 'anchored'. The parts
+    between two '*' are each found at their first place after the part before, which cannot make a match fail
+    that another place would give; the last part of an anchored pattern has to end the path.
+*/
+static int globMatch(const char *pattern, size_t plen, int anchored, const char *path, size_t len)
+{
+    const char *star = memchr(pattern, '*', plen);
+    size_t head = star != NULL ? (size_t)(star - pattern) : plen;
+    if (head > len || memcmp(pattern, path, head) != 0)
+        return 0;
+    if (star == NULL)
+        return !anchored || head == len;
+
+    size_t p = head + 1, s = head;              // Next part of the pattern, and where it may start in the path
+    for (;;)
+    {
+        const char *next = memchr(pattern + p, '*', plen - p);
+        size_t part = next != NULL ? (size_t)(next - (pattern + p)) : plen - p;
+        if (next == NULL && anchored)
+            return part <= len - s && memcmp(pattern + p, path + len - part, part) == 0;
+        if (part > 0)
+        {
+            const char *found = memmem(path + s, len - s, pattern + p, part);
+            if (found == NULL)
+                return 0;
+            s = (size_t)(found - path) + part;
+        }
+        if (next == NULL)
+            return 1;
+        p += part + 1;
+    }
+}
+
+// Whether a rule of 'length' matching wins over the best so far: longer, or as long and Allow against Disallow
+static int beats(int verdict, size_t length, int best, size_t bestLength)
+{
+    return best < 0 || length > bestLength || (length == bestLength && verdict == 0 && best == 1);
+}
+
+// Match the wildcard rules from 'first' on, hanging off the node at 'depth', against the path beyond it
+static void matchWild(const RobotsRules *rules, int32_t first, size_t depth, const char *path, size_t len,
+                      int *verdict, size_t *matched)
+{
+    for (int32_t w = first; w >= 0; w = rules->wild[w].next)
+    {
+        const WildRule *rule = &rules->wild[w];
+        if (*verdict >= 0 && rule->priority < *matched)
+            break;                              // The rest are shorter
+        if (!beats(rule->allow ? 0 : 1, rule->priority, *verdict, *matched))
+            continue;
+        if (globMatch(rule->pattern + depth, rule->len - depth, rule->anchored, path + depth, len - depth))
+        {
+            *verdict = rule->allow ? 0 : 1;
+            *matched = rule->priority;
+            return;
+        }
+    }
+}
+
+/*
+    Check a path against compiled rules.
+
+    Preconditions:  'rules' was returned by robotsParse(); 'path' holds the 'len' bytes of the path and query of a
+                    normalized URL, starting with '/'.
+    Postcondition:  Returns 1 if the longest rule matching the path is an Allow rule, or no rule matches; 0 if it
+                    is a Disallow rule. /robots.txt is always allowed.
+*/
+int robotsAllowed(const RobotsRules *rules, const char *path, size_t len)
+{
+    if (len == sizeof(ROBOTS_PATH) - 1 && memcmp(path, ROBOTS_PATH, len) == 0)
+        return 1;
+
+    int verdict = -1;                           // Of the best rule so far: -1 none, 0 allow, 1 disallow
+    size_t matched = 0;                         // Its length
+    uint32_t wildNodes[MAX_WILD_NODES];         // Nodes passed with wildcard rules, matched after the plain rules
+    int wildCount = 0;
+    const RobotsNode *nodes = rules->nodes;
+    uint32_t node = 0;
+    for (size_t i = 0;; i++)
+    {
+        const RobotsNode *n = &nodes[node];
+        if (n->prefix >= 0 && beats(n->prefix, i, verdict, matched))   // Deeper is longer
+        {
+            verdict = n->prefix;
+            matched = i;
+        }
+        if (i == len && n->exact >= 0 && beats(n->exact, i + 1, verdict, matched))
+        {
+            verdict = n->exact;
+            matched = i + 1;
+        }
+        if (n->wild >= 0)
+        {
+            if (wildCount < MAX_WILD_NODES)
+                wildNodes[wildCount++] = node;
+            else                                // Rare: matched now, with a lower bar
+                matchWild(rules, n->wild, i, path, len, &verdict, &matched);
+        }
+
+        if (i == len)
+            break;
+        uint32_t c = n->child;
+        while (c != 0 && nodes[c].byte != (unsigned char)path[i])
+            c = nodes[c].sibling;
+        if (c == 0)
+            break;
+        node = c;
+    }
+
+    // Deepest first, where the rules are the longest and raise the bar the most
+    while (wildCount > 0)
+    {
+        const RobotsNode *n = &nodes[wildNodes[--wildCount]];
+        matchWild(rules, n->wild, n->depth, path, len, &verdict, &matched);
+    }
+    return verdict != 1;
+}
+
+// Crawl-delay of the rules in ms, -1 for none
+long robotsCrawlDelay(const RobotsRules *rules)
+{
+    return rules->delayMs;
+}
+
+// Allow and Disallow rules compiled
+int robotsRuleCount(const RobotsRules *rules)
+{
+    return rules->ruleCount;
+}
+
+// Free compiled rules, NULL doing nothing
+void robotsFree(RobotsRules *rules)
+{
+    if (rules == NULL)
+        return;
+    for (int i = 0; i < rules->wildCount; i++)
+        free(rules->wild[i].pattern);
+    free(rules->wild);
+    free(rules->nodes);
+    free(rules);
+}
+
+/*
+    Fill a RobotsConfig with the crawler's default settings.
+
+    Preconditions:  'config' points to a valid RobotsConfig structure.
+    Postcondition:  Every field is set; onRelease is NULL and must be set before robotsCreate().
+*/
+void robotsConfigDefaults(RobotsConfig *config)
+{
+    config->agent = "WebCrawler";
+    config->ttl = 24 * 3600;                    // RFC 9309: a robots.txt should not be used for longer
+    config->failTtl = 600;
+    config->maxHosts = 100000;
+    config->minDelayMs = 0;
+    config->maxDelayMs = 30000;
+    config->maxFetches = 32;
+    config->fetch = NULL;
+    config->onRelease = NULL;
+    config->onDelay = NULL;
+    config->arg = NULL;
+}
+
+/*
+    Split a URL into its origin and its path.
+
+    Postcondition:  Returns 0 with the length of scheme://host:port in 'originLen' and the path and query (no
+                    fragment) in 'path' and 'pathLen', "/" for none; -1 if the URL has no host or a long one.
+*/
+static int splitUrl(const char *url, size_t *originLen, const char **path, size_t *pathLen)
+{
+    const char *scheme = strstr(url, "://");
+    if (scheme == NULL || scheme == url)
+        return -1;
+    const char *host = scheme + 3;
+    size_t hostLen = strcspn(host, "/?#");
+    *originLen = (size_t)(host - url) + hostLen;
+    if (hostLen == 0 || *originLen >= ROBOTS_MAX_ORIGIN)
+        return -1;
+    const char *rest = host + hostLen;
+    if (*rest != '/')
+    {
+        *path = "/";
+        *pathLen = 1;
+        return 0;
+    }
+    *path = rest;
+    *pathLen = strcspn(rest, "#");
+    return 0;
+}
+
+// The entry of an origin, NULL for none; with the shard locked
+static RobotsEntry *findEntry(Shard *shard, uint64_t hash, const char *origin, size_t len)
+{
+    for (RobotsEntry *e = shard->buckets[hash & shard->mask]; e != NULL; e = e->next)
+    {
+        if (e->hash == hash && e->originLen == len && memcmp(e->origin, origin, len) == 0)
+            return e;
+    }
+    return NULL;
+}
+
+static void lruUnlink(Shard *shard, RobotsEntry *entry)
+{
+    if (entry->newer != NULL)
+        entry->newer->older = entry->older;
+    else
+        shard->newest = entry->older;
+    if (entry->older != NULL)
+        entry->older->newer = entry->newer;
+    else
+        shard->oldest = entry->newer;
+}
+
+static void lruPushNewest(Shard *shard, RobotsEntry *entry)
+{
+    entry->newer = NULL;
+    entry->older = shard->newest;
+    if (shard->newest != NULL)
+        shard->newest->newer = entry;
+    else
+        shard->oldest = entry;
+    shard->newest = entry;
+}
+
+// Drop the least recently used hosts beyond the shard's capacity, skipping those being fetched
+static void evict(RobotsCache *cache, Shard *shard)
+{
+    RobotsEntry *entry = shard->oldest;
+    while (shard->count > cache->shardCapacity && entry != NULL)
+    {
+        RobotsEntry *newer = entry->newer;
+        if (!entry->fetching && entry->parked == NULL)
+        {
+            RobotsEntry **link = &shard->buckets[entry->hash & shard->mask];
+            while (*link != entry)
+                link = &(*link)->next;
+            *link = entry->next;
+            lruUnlink(shard, entry);
+            shard->count--;
+            robotsFree(entry->rules);
+            free(entry);
+            atomic_fetch_add(&cache->evictions, 1);
+            atomic_fetch_sub(&cache->entries, 1);
+        }
+        entry = newer;
+    }
+}
+
+// ROBOTS_ALLOWED or ROBOTS_DISALLOWED for a path of a host whose robots.txt is in; with the shard locked
+static int verdictOf(const RobotsEntry *entry, const char *path, size_t len)
+{
+    if (entry->disallowAll)
+        return ROBOTS_DISALLOWED;
+    if (entry->rules == NULL || robotsAllowed(entry->rules, path, len))
+        return ROBOTS_ALLOWED;
+    return ROBOTS_DISALLOWED;
+}
+
+// Hand the robots.txt of an origin to the cache's thread; 0, or -1 if out of memory
+static int queueFetch(RobotsCache *cache, const char *origin, size_t len, uint64_t hash)
+{
+    RobotsFetch *fetch = calloc(1, sizeof(RobotsFetch) + len + sizeof(ROBOTS_PATH));
+    if (fetch == NULL)
+        return -1;
+    fetch->hash = hash;
+    memcpy(fetch->url, origin, len);
+    memcpy(fetch->url + len, ROBOTS_PATH, sizeof(ROBOTS_PATH));
+    pthread_mutex_lock(&cache->lock);
+    *cache->queueEnd = fetch;
+    cache->queueEnd = &fetch->next;
+    pthread_cond_signal(&cache->wake);
+    pthread_mutex_unlock(&cache->lock);
+    return 0;
+}
+
+/*
+    Install the outcome of a robots.txt fetch and release the URLs waiting for it.
+
+    Preconditions:  'fetch' holds the robots.txt URL of a host entered in the cache and its body; 'result' and
+                    'status' are the outcome of the transfer. Called on the cache's thread, or where a fetch could
+                    not be queued.
+    Postcondition:  The host's rules are those of the body (2xx), none (4xx, too many redirects) or everything
+                    disallowed for failTtl (5xx, no answer); its Crawl-delay is reported, its waiting URLs are
+                    handed to onRelease and 'fetch' is freed.
+*/
+static void finishFetch(RobotsCache *cache, RobotsFetch *fetch, CURLcode result, long status)
+{
+    RobotsRules *rules = NULL;
+    int disallowAll = 0;
+    long ttl = cache->config.ttl;
+    if (result == CURLE_OK && status >= 200 && status < 300)
+    {
+        rules = robotsParse(fetch->body != NULL ? fetch->body : "", fetch->len, cache->config.agent);
+    }
+    else if ((result == CURLE_OK && status >= 400 && status < 500) || result == CURLE_TOO_MANY_REDIRECTS)
+    {
+        atomic_fetch_add(&cache->missing, 1);   // Unavailable: no restrictions
+    }
+    else if (result != CURLE_OK || status >= 500)
+    {
+        atomic_fetch_add(&cache->unreachable, 1);   // Unreachable: complete disallow, for a while
+        disallowAll = 1;
+        ttl = cache->config.failTtl;
+    }
+
+    long delayMs = rules != NULL ? robotsCrawlDelay(rules) : -1;
+    if (delayMs < cache->config.minDelayMs)
+        delayMs = cache->config.minDelayMs;
+    if (delayMs > cache->config.maxDelayMs)
+        delayMs = cache->config.maxDelayMs;
+
+    size_t originLen = strlen(fetch->url) - (sizeof(ROBOTS_PATH) - 1);
+    Shard *shard = &cache->shards[fetch->hash >> (64 - SHARD_BITS)];
+    Parked *parked = NULL;
+    RobotsRules *old = NULL;
+    pthread_mutex_lock(&shard->lock);
+    RobotsEntry *entry = findEntry(shard, fetch->hash, fetch->url, originLen);
+    if (entry != NULL)                          // Never dropped while fetching
+    {
+        old = entry->rules;
+        entry->rules = rules;
+        entry->disallowAll = disallowAll;
+        entry->state = ENTRY_READY;
+        entry->fetching = 0;
+        entry->expires = nowMs() + ttl * 1000;
+        parked = entry->parked;
+        entry->parked = NULL;
+        entry->parkedEnd = &entry->parked;
+        for (Parked *p = parked; p != NULL; p = p->next)
+        {
+            size_t skip, pathLen;
+            const char *path;
+            splitUrl(p->url, &skip, &path, &pathLen);
+            p->allowed = verdictOf(entry, path, pathLen) == ROBOTS_ALLOWED;
+        }
+        rules = NULL;
+    }
+    pthread_mutex_unlock(&shard->lock);
+    robotsFree(old);                            // Only matched under the lock
+    robotsFree(rules);
+
+    if (cache->config.onDelay != NULL && entry != NULL)
+        cache->config.onDelay(fetch->url, delayMs, cache->config.arg);
+    while (parked != NULL)
+    {
+        Parked *next = parked->next;
+        if (!parked->allowed)
+            atomic_fetch_add(&cache->disallowed, 1);
+        cache->config.onRelease(parked->url, parked->depth, parked->allowed, cache->config.arg);
+        free(parked);
+        parked = next;
+    }
+    free(fetch->body);
+    free(fetch);
+}
+
+// Check a URL, parking it in the entry of its host if 'depth' >= 0 and the robots.txt is not in yet
+static int check(RobotsCache *cache, const char *url, int depth)
+{
+    size_t originLen, pathLen;
+    const char *path;
+    if (splitUrl(url, &originLen, &path, &pathLen) != 0)
+        return ROBOTS_ALLOWED;                  // Not a URL robots.txt has a say over
+    atomic_fetch_add(&cache->checks, 1);
+
+    uint64_t hash = hash64(url, originLen);
+    Shard *shard = &cache->shards[hash >> (64 - SHARD_BITS)];   // High bits pick the shard, low bits the bucket
+    int fetch = 0;                              // 1 to queue the robots.txt of the host
+    int answer;
+    pthread_mutex_lock(&shard->lock);
+    RobotsEntry *entry = findEntry(shard, hash, url, originLen);
+    if (entry == NULL)
+    {
+        entry = malloc(sizeof(RobotsEntry) + originLen + 1);
+        if (entry == NULL)
+        {
+            pthread_mutex_unlock(&shard->lock);
+            return ROBOTS_ALLOWED;              // Out of memory: do not hold the crawl up
+        }
+        memset(entry, 0, sizeof(RobotsEntry));
+        entry->hash = hash;
+        entry->state = ENTRY_PENDING;
+        entry->fetching = 1;
+        entry->parkedEnd = &entry->parked;
+        entry->originLen = originLen;
+        memcpy(entry->origin, url, originLen);
+        entry->origin[originLen] = '\0';
+        entry->next = shard->buckets[hash & shard->mask];
+        shard->buckets[hash & shard->mask] = entry;
+        lruPushNewest(shard, entry);
+        shard->count++;
+        atomic_fetch_add(&cache->entries, 1);
+        evict(cache, shard);
+        fetch = 1;
+    }
+    else if (entry != shard->newest)
+    {
+        lruUnlink(shard, entry);
+        lruPushNewest(shard, entry);
+    }
+
+    if (entry->state == ENTRY_READY)
+    {
+        atomic_fetch_add(&cache->hits, 1);
+        answer = verdictOf(entry, path, pathLen);
+        if (!entry->fetching && nowMs() >= entry->expires)
+            entry->fetching = fetch = 1;        // Fetched again, the old rules answer meanwhile
+    }
+    else
+    {
+        answer = ROBOTS_PENDING;
+        size_t len = strlen(url);
+        Parked *parked = depth >= 0 ? malloc(sizeof(Parked) + len + 1) : NULL;
+        if (parked != NULL)
+        {
+            parked->next = NULL;
+            parked->depth = depth;
+            parked->allowed = 0;
+            memcpy(parked->url, url, len + 1);
+            *entry->parkedEnd = parked;
+            entry->parkedEnd = &parked->next;
+            atomic_fetch_add(&cache->parked, 1);
+        }
+        else if (depth >= 0)
+            answer = ROBOTS_ALLOWED;            // Out of memory: let it through
+    }
+    pthread_mutex_unlock(&shard->lock);
+
+    if (fetch && queueFetch(cache, url, originLen, hash) != 0)
+    {
+        RobotsFetch *stub = malloc(sizeof(RobotsFetch) + originLen + sizeof(ROBOTS_PATH));
+        if (stub != NULL)
+        {
+            memset(stub, 0, sizeof(RobotsFetch));
+            stub->hash = hash;
+            memcpy(stub->url, url, originLen);
+            memcpy(stub->url + originLen, ROBOTS_PATH, sizeof(ROBOTS_PATH));
+            finishFetch(cache, stub, CURLE_OUT_OF_MEMORY, 0);   // Taken as unreachable for now
+        }
+    }
+    if (answer == ROBOTS_DISALLOWED)
+        atomic_fetch_add(&cache->disallowed, 1);
+    return answer;
+}
+
+/*
+    Check whether a URL may be fetched, before it is queued.
+
+    Preconditions:  'cache' was returned by robotsCreate(), 'url' is a normalized absolute URL.
+    Postcondition:  Returns ROBOTS_ALLOWED or ROBOTS_DISALLOWED if the robots.txt of its host is in the cache;
+                    ROBOTS_PENDING if it is being fetched, which this call starts for a host not seen before.
+*/
+int robotsCheck(RobotsCache *cache, const char *url)
+{
+    return check(cache, url, -1);
+}
+
+/*
+    Check whether a URL may be fetched, before it is fetched.
+
+    Preconditions:  'cache' was returned by robotsCreate(), 'url' is a normalized absolute URL found at link depth
+                    'depth'.
+    Postcondition:  As robotsCheck(); but a URL answered ROBOTS_PENDING waits in the cache for the robots.txt of
+                    its host and is handed to onRelease once it is in.
+*/
+int robotsAdmit(RobotsCache *cache, const char *url, int depth)
+{
+    return check(cache, url, depth < 0 ? 0 : depth);
+}
+
+// Streaming body callback of the cache's fetch engine: keep the first ROBOTS_MAX_BYTES
+static void robotsChunk(FetchEngine *engine, const char *data, size_t len, void *userdata)
+{
+    RobotsFetch *fetch = (RobotsFetch *)userdata;
+    (void)engine;
+    if (data == NULL)                           // Retried from the start
+    {
+        fetch->len = 0;
+        return;
+    }
+    if (len > ROBOTS_MAX_BYTES - fetch->len)
+        len = ROBOTS_MAX_BYTES - fetch->len;
+    if (len == 0)
+        return;
+    if (fetch->len + len > fetch->cap)
+    {
+        size_t cap = fetch->cap > 0 ? fetch->cap : 4096;
+        while (cap < fetch->len + len)
+            cap *= 2;
+        char *body = realloc(fetch->body, cap);
+        if (body == NULL)
+            return;                             // The rest is dropped, as beyond the limit
+        fetch->body = body;
+        fetch->cap = cap;
+    }
+    memcpy(fetch->body + fetch->len, data, len);
+    fetch->len += len;
+}
+
+// Unlink a fetch from the list of those in flight; the cache's thread only
+static void activeUnlink(RobotsCache *cache, RobotsFetch *fetch)
+{
+    if (fetch->prev != NULL)
+        fetch->prev->next = fetch->next;
+    else
+        cache->active = fetch->next;
+    if (fetch->next != NULL)
+        fetch->next->prev = fetch->prev;
+}
+
+// Completion callback of the cache's fetch engine
+static void robotsDone(FetchEngine *engine, const char *url, struct CURLResponse *response, CURLcode result,
+                       long status, void *userdata)
+{
+    RobotsCache *cache = (RobotsCache *)fetchEngineContext(engine);
+    RobotsFetch *fetch = (RobotsFetch *)userdata;
+    (void)url;
+    (void)response;
+    activeUnlink(cache, fetch);
+    finishFetch(cache, fetch, result, status);
+}
+
+// The cache's thread: fetch the queued robots.txt, maxFetches at a time
+static void *robotsThread(void *arg)
+{
+    RobotsCache *cache = (RobotsCache *)arg;
+    pthread_mutex_lock(&cache->lock);
+    while (!cache->stop)
+    {
+        while (cache->queue != NULL && fetchEngineHasCapacity(cache->engine))
+        {
+            RobotsFetch *fetch = cache->queue;
+            cache->queue = fetch->next;
+            if (cache->queue == NULL)
+                cache->queueEnd = &cache->queue;
+            pthread_mutex_unlock(&cache->lock);
+
+            atomic_fetch_add(&cache->fetches, 1);
+            fetch->prev = NULL;
+            fetch->next = cache->active;
+            if (cache->active != NULL)
+                cache->active->prev = fetch;
+            cache->active = fetch;
+            if (fetchEngineSubmit(cache->engine, fetch->url, fetch) != 0)
+            {
+                activeUnlink(cache, fetch);
+                finishFetch(cache, fetch, CURLE_FAILED_INIT, 0);
+            }
+            pthread_mutex_lock(&cache->lock);
+        }
+        if (fetchEngineInFlight(cache->engine) == 0)
+        {
+            if (cache->queue == NULL && !cache->stop)
+                pthread_cond_wait(&cache->wake, &cache->lock);
+            continue;
+        }
+        pthread_mutex_unlock(&cache->lock);
+        fetchEngineRun(cache->engine, POLL_MS);
+        pthread_mutex_lock(&cache->lock);
+    }
+    pthread_mutex_unlock(&cache->lock);
+    return NULL;
+}
+
+// Free the hosts of the cache and anything left queued, once its thread has stopped
+static void freeCache(RobotsCache *cache)
+{
+    for (int s = 0; s < SHARDS; s++)
+    {
+        Shard *shard = &cache->shards[s];
+        if (shard->buckets == NULL)
+            continue;
+        for (size_t b = 0; b <= shard->mask; b++)
+        {
+            RobotsEntry *entry = shard->buckets[b];
+            while (entry != NULL)
+            {
+                RobotsEntry *next = entry->next;
+                while (entry->parked != NULL)
+                {
+                    Parked *parked = entry->parked;
+                    entry->parked = parked->next;
+                    free(parked);
+                }
+                robotsFree(entry->rules);
+                free(entry);
+                entry = next;
+            }
+        }
+        free(shard->buckets);
+        pthread_mutex_destroy(&shard->lock);
+    }
+    RobotsFetch *lists[] = { cache->queue, cache->active };
+    for (int i = 0; i < 2; i++)
+    {
+        while (lists[i] != NULL)
+        {
+            RobotsFetch *next = lists[i]->next;
+            free(lists[i]->body);
+            free(lists[i]);
+            lists[i] = next;
+        }
+    }
+    if (cache->engine != NULL)
+        fetchEngineDestroy(cache->engine);
+    pthread_mutex_destroy(&cache->lock);
+    pthread_cond_destroy(&cache->wake);
+    free(cache);
+}
+
+/*
+    Create a robots.txt cache and start its thread.
+
+    Preconditions:  'config' has its onRelease set; the resolver and share of config->fetch, if any, outlive the
+                    cache.
+    Postcondition:  Returns the cache, or NULL if memory allocation failed or the thread could not be started.
+*/
+RobotsCache *robotsCreate(const RobotsConfig *config)
+{
+    RobotsCache *cache = calloc(1, sizeof(RobotsCache));
+    if (cache == NULL)
+        return NULL;
+    cache->config = *config;
+    if (cache->config.agent == NULL)
+        cache->config.agent = "*";
+    if (cache->config.maxFetches < 1)
+        cache->config.maxFetches = 1;
+    cache->shardCapacity = config->maxHosts / SHARDS > 0 ? config->maxHosts / SHARDS : 1;
+    pthread_mutex_init(&cache->lock, NULL);
+    pthread_cond_init(&cache->wake, NULL);
+    cache->queueEnd = &cache->queue;
+    atomic_init(&cache->checks, 0);
+    atomic_init(&cache->hits, 0);
+    atomic_init(&cache->disallowed, 0);
+    atomic_init(&cache->parked, 0);
+    atomic_init(&cache->fetches, 0);
+    atomic_init(&cache->missing, 0);
+    atomic_init(&cache->unreachable, 0);
+    atomic_init(&cache->evictions, 0);
+    atomic_init(&cache->entries, 0);
+
+    size_t buckets = MIN_BUCKETS;
+    while (buckets < cache->shardCapacity && buckets < ((size_t)1 << 20))
+        buckets *= 2;
+    int failed = 0;
+    for (int s = 0; s < SHARDS; s++)
+    {
+        pthread_mutex_init(&cache->shards[s].lock, NULL);
+        cache->shards[s].buckets = calloc(buckets, sizeof(RobotsEntry *));
+        cache->shards[s].mask = buckets - 1;
+        failed |= cache->shards[s].buckets == NULL;
+    }
+
+    // The robots.txt go through an engine of the cache's own, with the crawl's resolver and timeouts
+    FetchConfig fetchConfig;
+    if (config->fetch != NULL)
+        fetchConfig = *config->fetch;
+    else
+        fetchConfigDefaults(&fetchConfig);
+    fetchConfig.maxInFlight = cache->config.maxFetches;
+    fetchConfig.maxRedirects = MAX_REDIRECTS;
+    fetchConfig.onDone = robotsDone;
+    fetchConfig.onChunk = robotsChunk;
+    fetchConfig.onHeader = NULL;
+    fetchConfig.onRetry = NULL;
+    fetchConfig.context = cache;
+    if (!failed)
+        cache->engine = fetchEngineCreate(&fetchConfig);
+    if (failed || cache->engine == NULL || pthread_create(&cache->thread, NULL, robotsThread, cache) != 0)
+    {
+        freeCache(cache);
+        return NULL;
+    }
+    return cache;
+}
+
+/*
+    Read the counters of a cache.
+
+    Preconditions:  'cache' was returned by robotsCreate(); 'stats' points to a valid RobotsStats structure.
+    Postcondition:  'stats' holds the counters since robotsCreate().
+*/
+void robotsStats(RobotsCache *cache, RobotsStats *stats)
+{
+    stats->checks = atomic_load(&cache->checks);
+    stats->hits = atomic_load(&cache->hits);
+    stats->disallowed = atomic_load(&cache->disallowed);
+    stats->parked = atomic_load(&cache->parked);
+    stats->fetches = atomic_load(&cache->fetches);
+    stats->missing = atomic_load(&cache->missing);
+    stats->unreachable = atomic_load(&cache->unreachable);
+    stats->evictions = atomic_load(&cache->evictions);
+    stats->entries = atomic_load(&cache->entries);
+}
+
+/*
+    Stop a cache's thread and free the cache.
+
+    Preconditions:  'cache' was returned by robotsCreate(), or is NULL to do nothing; no thread checks URLs any
+                    more.
+    Postcondition:  The robots.txt in flight are abandoned, URLs still waiting are dropped without a callback.
+*/
+void robotsDestroy(RobotsCache *cache)
+{
+    if (cache == NULL)
+        return;
+    pthread_mutex_lock(&cache->lock);
+    cache->stop = 1;
+    pthread_cond_signal(&cache->wake);
+    pthread_mutex_unlock(&cache->lock);
+    pthread_join(cache->thread, NULL);
+    freeCache(cache);
+}
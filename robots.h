@@ -0,0 +1,87 @@
+/*
+Operating Systems Spring 2024
+Final Project
+
+Robots: the robots.txt of every host fetched once, compiled into a matcher and kept in a shared cache that
+tells the workers which URLs they may fetch (RFC 9309).
+*/
+
+#ifndef ROBOTS_H
+#define ROBOTS_H
+
+#include <stddef.h>
+
+#include "fetch.h"
+
+// Answers of robotsCheck() and robotsAdmit()
+#define ROBOTS_ALLOWED 0        // The URL may be fetched
+#define ROBOTS_DISALLOWED 1     // The robots.txt of its host disallows it, or could not be fetched
+#define ROBOTS_PENDING 2        // The robots.txt of its host is being fetched
+
+// Most bytes of a robots.txt parsed, the rest is ignored (RFC 9309 asks for at least 500 KiB)
+#define ROBOTS_MAX_BYTES (512 * 1024)
+
+// Longest scheme://host:port a robots.txt is kept for
+#define ROBOTS_MAX_ORIGIN 300
+
+// The rules of the group of a robots.txt that applies to the crawler, compiled
+typedef struct RobotsRules RobotsRules;
+
+typedef struct RobotsCache RobotsCache;
+
+/*
+    Called for every URL robotsAdmit() answered ROBOTS_PENDING once the robots.txt of its host is in, with
+    'allowed' 1 if the URL may be fetched. Called on the cache's thread.
+*/
+typedef void (*RobotsReleaseCallback)(const char *url, int depth, int allowed, void *arg);
+
+/*
+    Called with the Crawl-delay of a host, in ms, once its robots.txt is in; 'url' is that of the robots.txt.
+    Called on the cache's thread, before the URLs waiting for the host are released.
+*/
+typedef void (*RobotsDelayCallback)(const char *url, long delayMs, void *arg);
+
+// Settings for robotsCreate()
+typedef struct
+{
+    const char *agent;          // Product token looked for in the User-agent lines, "*" groups apply otherwise
+    long ttl;                   // Seconds a robots.txt is used before it is fetched again
+    long failTtl;               // Seconds a host whose robots.txt could not be fetched stays disallowed
+    size_t maxHosts;            // Hosts kept; beyond, the least recently used are dropped and fetched again if needed
+    long minDelayMs;            // Crawl-delay reported at least, for a host without one too
+    long maxDelayMs;            // Crawl-delay reported at most
+    int maxFetches;             // robots.txt fetched at once
+    const FetchConfig *fetch;   // Settings of the fetches (resolver, timeouts, retries), NULL for the defaults
+    RobotsReleaseCallback onRelease;    // Takes the URLs that waited for their host's robots.txt
+    RobotsDelayCallback onDelay;        // Told of the Crawl-delay of every host, NULL to ignore them
+    void *arg;                  // Passed to the callbacks
+} RobotsConfig;
+
+// Counters of a cache since robotsCreate()
+typedef struct
+{
+    long checks;                // URLs checked
+    long hits;                  // Answered from the rules of the cache
+    long disallowed;            // Answered ROBOTS_DISALLOWED
+    long parked;                // URLs that waited for the robots.txt of their host
+    long fetches;               // robots.txt fetched, refreshes included
+    long missing;               // Answered 4xx (or redirected too often): every URL of the host allowed
+    long unreachable;           // Failed or answered 5xx: every URL of the host disallowed for failTtl
+    long evictions;             // Hosts dropped to make room for others
+    long entries;               // Hosts in the cache
+} RobotsStats;
+
+// Function prototypes
+RobotsRules *robotsParse(const char *text, size_t len, const char *agent);
+int robotsAllowed(const RobotsRules *rules, const char *path, size_t len);
+long robotsCrawlDelay(const RobotsRules *rules);
+int robotsRuleCount(const RobotsRules *rules);
+void robotsFree(RobotsRules *rules);
+void robotsConfigDefaults(RobotsConfig *config);
+RobotsCache *robotsCreate(const RobotsConfig *config);
+int robotsCheck(RobotsCache *cache, const char *url);
+int robotsAdmit(RobotsCache *cache, const char *url, int depth);
+void robotsStats(RobotsCache *cache, RobotsStats *stats);
+void robotsDestroy(RobotsCache *cache);
+
+#endif
@@ -0,0 +1,840 @@
+/*
+Operating Systems Spring 2024
+Final Project
+
+Politeness scheduler: per-host URL queues released under per-host concurrency and crawl-delay limits, adapted to
+how each host copes.
+
+Every URL is queued under its host, the lowercased host name and port of the URL. A host has at
+most maxPerHost transfers running at once, and two transfers of a host start at least its crawl
+delay apart. Within a host the shallowest link depth is served first, so each host is still
+crawled breadth-first.
+
+The hosts are spread over SHARDS shards by the hash of their name. Each shard has its own lock,
+host table and min-heap. The heap holds the hosts that may start a transfer once their delay has
+run out, ordered by that time (nextStart). A host at its concurrency limit or with nothing queued
+leaves the heap, and comes back when one of its transfers ends or a URL for it arrives. Each
+shard publishes the earliest nextStart of its heap, so a pop skips the shards with nothing ready
+without taking their lock, and tells the caller how long to wait when no host is ready.
+
+URLs are packed into blocks as a 16-bit length followed by the bytes. A host's first block is
+small, since most hosts only ever have a few URLs queued; later blocks are full size. Emptied
+blocks go to a free list of the shard for the next pushes.
+
+With 'adaptive' set, every transfer given back with schedulerDone(), and every failed attempt reported on the way
+with schedulerReport(), tells how its host coped, and the host's limit
+follows it the way TCP's congestion window does (AIMD): it is halved when the host is overloaded (429 and 5xx answers
+meaning "busy", timeouts, or answers slower than slowMs) and grows back by one transfer for every limit's worth of
+good answers, up to maxPerHost. A halving only counts transfers started after the one before, so one burst of
+failures halves the limit once. The same goes for a limit over all hosts, which only timeouts of hosts that answered
+before lower: those point at the crawler's own network being saturated rather than at one bad host.
+
+Hosts that keep failing get a circuit breaker: after breakerFailures failures in a row it opens and the host is held
+back in its shard's heap for breakerMs, doubled for every time it opened in a row. Then a single transfer probes the
+host; an answer closes the breaker and the host starts over from a limit of one, a failure opens it again. After
+breakerTrips openings in a row the host is given up: its URLs are handed out at once with SCHEDULER_GIVEN_UP, to be
+failed without a transfer, rather than keeping the crawl waiting on a host that is down.
+*/
+
+#include <ctype.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "frontier.h"
+#include "hash.h"
+#include "metrics.h"
+#include "scheduler.h"
+
+// Number of shards, a power of two
+#define SHARDS 64
+
+// Sizes of the two kinds of URL blocks, header included
+#define BLOCK_SMALL 512
+#define BLOCK_LARGE 4096
+
+// Longest host[:port] kept, including the terminating null byte
+#define MAX_HOST 264
+
+// Initial number of buckets of a shard's host table, a power of two
+#define INITIAL_BUCKETS 16
+
+// nextReady of a shard whose heap is empty
+#define NOT_READY LLONG_MAX
+
+// Fixed-point unit of the global limit, which grows by fractions of a transfer
+#define LIMIT_ONE 1024
+
+// Most doublings of breakerMs for a breaker that keeps opening
+#define MAX_BREAKER_DOUBLINGS 10
+
+// States of a host's circuit breaker
+enum { BREAKER_CLOSED, BREAKER_OPEN, BREAKER_PROBING, BREAKER_GIVEN_UP };
+
+// A block of packed URLs
+typedef struct UrlBlock
+{
+    struct UrlBlock *next;              // Next block of the queue or of a free list
+    uint32_t readOff;                   // Offset of the next URL to pop
+    uint32_t writeOff;                  // Bytes of 'data' in use
+    uint32_t capacity;                  // Bytes of 'data'
+    char data[];                        // URLs as [uint16 length][bytes], not null-terminated
+} UrlBlock;
+
+// FIFO of the URLs of one host at one depth
+typedef struct
+{
+    UrlBlock *head, *tail;
+    long count;                         // URLs queued
+} UrlQueue;
+
+struct SchedulerHost
+{
+    struct SchedulerHost *next;         // Next host in the same bucket
+    uint64_t hash;                      // hash64() of 'name'
+    const char *name;                   // host[:port], lowercased
+    int shard;                          // Shard the host belongs to
+    int active;                         // Transfers running
+    long queued;                        // URLs queued over all levels
+    long delayMs;                       // Crawl delay, -1 for the scheduler's default
+    long long nextStart;                // Earliest start of its next transfer, in microseconds
+    int heapIndex;                      // Position in the shard's heap, -1 if not in it
+    double limit;                       // Transfers it may have running, adapted to its answers; 0 for no limit
+    long long lastCut;                  // When 'limit' was last halved, in microseconds
+    long long probeStart;               // When its breaker let the probe start, in microseconds
+    int failures;                       // Failed transfers in a row
+    int trips;                          // Openings of its breaker in a row
+    int breaker;                        // BREAKER_CLOSED, BREAKER_OPEN, BREAKER_PROBING or BREAKER_GIVEN_UP
+    int answered;                       // 1 once it answered a transfer
+    UrlQueue levels[];                  // One queue per depth 0..maxDepth
+};
+
+// One lock's worth of hosts
+typedef struct
+{
+    _Alignas(64) atomic_llong nextReady;    // nextStart of the top of the heap, NOT_READY if empty
+    pthread_mutex_t lock;
+    SchedulerHost **table;              // Host table, chained
+    size_t buckets;                     // Buckets of 'table', a power of two
+    long hosts;                         // Hosts in 'table'
+    SchedulerHost **heap;               // Hosts that may start a transfer, min-heap by nextStart
+    int heapCount, heapCap;
+    UrlBlock *freeBlocks[2];            // Emptied blocks, small and large
+} Shard;
+
+struct HostScheduler
+{
+    SchedulerConfig config;
+    _Alignas(64) atomic_long size;      // URLs queued over all hosts
+    atomic_long hosts;                  // Hosts known
+    atomic_uint cursor;                 // Shard the next pop starts at
+    _Alignas(64) atomic_int running;    // Transfers handed out and not given back
+    atomic_long globalLimit;            // Limit on 'running' in LIMIT_ONE units, 0 for none
+    atomic_llong globalCut;             // When 'globalLimit' was last halved, in microseconds
+    atomic_long cuts, trips, hostsGivenUp, urlsGivenUp;   // See SchedulerStats
+    Shard shards[SHARDS];
+};
+
+// Current monotonic time in microseconds
+static long long nowUs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// Copy the lowercased host[:port] of 'url' into 'key', dropping any user info; returns its length or -1
+static int hostKey(const char *url, char *key, size_t size)
+{
+    const char *p = strstr(url, "://");
+    p = p != NULL ? p + 3 : url;                    // curl takes "host/path" for http://host/path
+    size_t len = strcspn(p, "/?#");
+    for (size_t i = len; i > 0; i--)
+    {
+        if (p[i - 1] == '@')                        // user:password@host
+        {
+            p += i;
+            len -= i;
+            break;
+        }
+    }
+    if (len == 0 || len >= size)
+        return -1;
+    for (size_t i = 0; i < len; i++)
+        key[i] = (char)tolower((unsigned char)p[i]);
+    key[len] = '\0';
+    return (int)len;
+}
+
+static void heapSet(Shard *shard, int i, SchedulerHost *host)
+{
+    shard->heap[i] = host;
+    host->heapIndex = i;
+}
+
+static void heapSiftUp(Shard *shard, int i)
+{
+    SchedulerHost *host = shard->heap[i];
+    while (i > 0)
+    {
+        int parent = (i - 1) / 2;
+        if (shard->heap[parent]->nextStart <= host->nextStart)
+            break;
+        heapSet(shard, i, shard->heap[parent]);
+        i = parent;
+    }
+    heapSet(shard, i, host);
+}
+
+static void heapSiftDown(Shard *shard, int i)
+{
+    SchedulerHost *host = shard->heap[i];
+    while (1)
+    {
+        int child = 2 * i + 1;
+        if (child >= shard->heapCount)
+            break;
+        if (child + 1 < shard->heapCount && shard->heap[child + 1]->nextStart < shard->heap[child]->nextStart)
+            child++;
+        if (shard->heap[child]->nextStart >= host->nextStart)
+            break;
+        heapSet(shard, i, shard->heap[child]);
+        i = child;
+    }
+    heapSet(shard, i, host);
+}
+
+static int heapInsert(Shard *shard, SchedulerHost *host)
+{
+    if (shard->heapCount == shard->heapCap)
+    {
+        int cap = shard->heapCap ? shard->heapCap * 2 : 16;
+        SchedulerHost **heap = realloc(shard->heap, sizeof(SchedulerHost *) * (size_t)cap);
+        if (heap == NULL)
+            return -1;
+        shard->heap = heap;
+        shard->heapCap = cap;
+    }
+    heapSet(shard, shard->heapCount++, host);
+    heapSiftUp(shard, host->heapIndex);
+    return 0;
+}
+
+static void heapRemove(Shard *shard, SchedulerHost *host)
+{
+    int i = host->heapIndex;
+    SchedulerHost *last = shard->heap[--shard->heapCount];
+    host->heapIndex = -1;
+    if (last == host)
+        return;
+    heapSet(shard, i, last);
+    heapSiftUp(shard, i);
+    heapSiftDown(shard, last->heapIndex);
+}
+
+// Transfers a host may have running now, 0 for no limit
+static int hostLimit(const HostScheduler *scheduler, const SchedulerHost *host)
+{
+    if (!scheduler->config.adaptive)
+        return scheduler->config.maxPerHost;
+    if (host->breaker == BREAKER_CLOSED)
+        return (int)host->limit;
+    return host->breaker == BREAKER_GIVEN_UP ? 0 : 1;  // A single probe once an open breaker's time is up
+}
+
+/*
+    Put a host in or out of its shard's heap after its queue, its transfers or its nextStart changed,
+    and publish the shard's earliest start. Called with the shard locked.
+*/
+static void hostUpdate(const HostScheduler *scheduler, Shard *shard, SchedulerHost *host)
+{
+    int limit = hostLimit(scheduler, host);
+    int eligible = host->queued > 0 && (limit <= 0 || host->active < limit);
+
+    if (eligible && host->heapIndex < 0)
+    {
+        heapInsert(shard, host);                    // Out of memory: the next push or schedulerDone() retries
+    }
+    else if (!eligible && host->heapIndex >= 0)
+    {
+        heapRemove(shard, host);
+    }
+    else if (eligible)
+    {
+        heapSiftUp(shard, host->heapIndex);
+        heapSiftDown(shard, host->heapIndex);
+    }
+    atomic_store(&shard->nextReady, shard->heapCount > 0 ? shard->heap[0]->nextStart : NOT_READY);
+}
+
+// Double the buckets of a shard's host table; it keeps working at its old size if memory runs out
+static void tableGrow(Shard *shard)
+{
+    size_t buckets = shard->buckets * 2;
+    SchedulerHost **table = calloc(buckets, sizeof(SchedulerHost *));
+    if (table == NULL)
+        return;
+    for (size_t b = 0; b < shard->buckets; b++)
+    {
+        while (shard->table[b] != NULL)
+        {
+            SchedulerHost *host = shard->table[b];
+            shard->table[b] = host->next;
+            host->next = table[host->hash & (buckets - 1)];
+            table[host->hash & (buckets - 1)] = host;
+        }
+    }
+    free(shard->table);
+    shard->table = table;
+    shard->buckets = buckets;
+}
+
+// Find the host named 'key', adding it if it is new; NULL if memory allocation failed. Called with the shard locked.
+static SchedulerHost *hostFind(HostScheduler *scheduler, Shard *shard, uint64_t hash, const char *key, size_t len)
+{
+    for (SchedulerHost *host = shard->table[hash & (shard->buckets - 1)]; host != NULL; host = host->next)
+        if (host->hash == hash && strcmp(host->name, key) == 0)
+            return host;
+
+    size_t levels = (size_t)(scheduler->config.maxDepth + 1);
+    SchedulerHost *host = malloc(sizeof(SchedulerHost) + sizeof(UrlQueue) * levels + len + 1);
+    if (host == NULL)
+        return NULL;
+    char *name = (char *)&host->levels[levels];
+    memcpy(name, key, len + 1);
+    host->hash = hash;
+    host->name = name;
+    host->shard = (int)(shard - scheduler->shards);
+    host->active = 0;
+    host->queued = 0;
+    host->delayMs = -1;
+    host->nextStart = 0;
+    host->heapIndex = -1;
+    host->limit = scheduler->config.maxPerHost > 0 ? scheduler->config.maxPerHost : 0;
+    host->lastCut = 0;
+    host->probeStart = 0;
+    host->failures = 0;
+    host->trips = 0;
+    host->breaker = BREAKER_CLOSED;
+    host->answered = 0;
+    for (size_t d = 0; d < levels; d++)
+        host->levels[d] = (UrlQueue){ NULL, NULL, 0 };
+
+    if ((size_t)shard->hosts >= shard->buckets)
+        tableGrow(shard);
+    host->next = shard->table[hash & (shard->buckets - 1)];
+    shard->table[hash & (shard->buckets - 1)] = host;
+    shard->hosts++;
+    atomic_fetch_add(&scheduler->hosts, 1);
+    return host;
+}
+
+// Append a URL to a queue; returns 0, or -1 if memory allocation failed
+static int queuePush(Shard *shard, UrlQueue *queue, const char *url, size_t len)
+{
+    UrlBlock *block = queue->tail;
+    if (block == NULL || block->writeOff + 2 + len > block->capacity)
+    {
+        int large = queue->head != NULL || sizeof(UrlBlock) + 2 + len > BLOCK_SMALL;
+        block = shard->freeBlocks[large];
+        if (block != NULL)
+            shard->freeBlocks[large] = block->next;
+        else if ((block = malloc(large ? BLOCK_LARGE : BLOCK_SMALL)) == NULL)
+            return -1;
+        block->next = NULL;
+        block->readOff = block->writeOff = 0;
+        block->capacity = (uint32_t)((large ? BLOCK_LARGE : BLOCK_SMALL) - sizeof(UrlBlock));
+        if (queue->tail != NULL)
+            queue->tail->next = block;
+        else
+            queue->head = block;
+        queue->tail = block;
+    }
+    uint16_t length = (uint16_t)len;
+    memcpy(block->data + block->writeOff, &length, 2);
+    memcpy(block->data + block->writeOff + 2, url, len);
+    block->writeOff += (uint32_t)(2 + len);
+    queue->count++;
+    return 0;
+}
+
+// Take the oldest URL of a non-empty queue, truncated to 'size' - 1 bytes
+static void queuePop(Shard *shard, UrlQueue *queue, char *url, size_t size)
+{
+    UrlBlock *block = queue->head;
+    uint16_t length;
+    memcpy(&length, block->data + block->readOff, 2);
+    size_t len = length < size ? length : size - 1;
+    memcpy(url, block->data + block->readOff + 2, len);
+    url[len] = '\0';
+    block->readOff += 2 + (uint32_t)length;
+    queue->count--;
+
+    if (block->readOff == block->writeOff)          // Emptied: back to the shard
+    {
+        queue->head = block->next;
+        if (queue->head == NULL)
+            queue->tail = NULL;
+        int large = block->capacity > BLOCK_SMALL;
+        block->next = shard->freeBlocks[large];
+        shard->freeBlocks[large] = block;
+    }
+}
+
+static void queueFree(UrlQueue *queue)
+{
+    while (queue->head != NULL)
+    {
+        UrlBlock *block = queue->head;
+        queue->head = block->next;
+        free(block);
+    }
+}
+
+/*
+    Settings used unless the caller changes them: no crawl delay, up to SCHEDULER_DEFAULT_PER_HOST transfers per host
+    adapted to how the host copes, and a host given up after its breaker opened 5 times in a row (after 1 + 2 + 4 + 8 s
+    held back, plus the probes' own retries).
+*/
+void schedulerConfigDefaults(SchedulerConfig *config)
+{
+    config->maxDepth = 0;
+    config->maxPerHost = SCHEDULER_DEFAULT_PER_HOST;
+    config->delayMs = 0;
+    config->adaptive = 1;
+    config->slowMs = 5000;
+    config->breakerFailures = 5;
+    config->breakerMs = 1000;
+    config->breakerTrips = 5;
+    config->maxActive = 0;
+}
+
+/*
+    Create a scheduler.
+
+    Preconditions:  'config' holds the settings, see schedulerConfigDefaults().
+    Postcondition:  Returns a new, empty scheduler, or NULL if memory allocation failed.
+*/
+HostScheduler *schedulerCreate(const SchedulerConfig *config)
+{
+    HostScheduler *scheduler = aligned_alloc(64, sizeof(HostScheduler));
+    if (scheduler == NULL)
+        return NULL;
+    scheduler->config = *config;
+    if (scheduler->config.maxDepth < 0)
+        scheduler->config.maxDepth = -1;            // Keeps nothing at all
+    atomic_init(&scheduler->size, 0);
+    atomic_init(&scheduler->hosts, 0);
+    atomic_init(&scheduler->cursor, 0);
+    atomic_init(&scheduler->running, 0);
+    atomic_init(&scheduler->globalLimit, config->maxActive > 0 ? (long)config->maxActive * LIMIT_ONE : 0);
+    atomic_init(&scheduler->globalCut, 0);
+    atomic_init(&scheduler->cuts, 0);
+    atomic_init(&scheduler->trips, 0);
+    atomic_init(&scheduler->hostsGivenUp, 0);
+    atomic_init(&scheduler->urlsGivenUp, 0);
+
+    for (int i = 0; i < SHARDS; i++)
+    {
+        Shard *shard = &scheduler->shards[i];
+        atomic_init(&shard->nextReady, NOT_READY);
+        shard->table = calloc(INITIAL_BUCKETS, sizeof(SchedulerHost *));
+        shard->buckets = INITIAL_BUCKETS;
+        shard->hosts = 0;
+        shard->heap = NULL;
+        shard->heapCount = shard->heapCap = 0;
+        shard->freeBlocks[0] = shard->freeBlocks[1] = NULL;
+        if (shard->table == NULL || pthread_mutex_init(&shard->lock, NULL) != 0)
+        {
+            free(shard->table);
+            while (--i >= 0)
+            {
+                free(scheduler->shards[i].table);
+                pthread_mutex_destroy(&scheduler->shards[i].lock);
+            }
+            free(scheduler);
+            return NULL;
+        }
+    }
+    return scheduler;
+}
+
+/*
+    Queue a URL found at link depth 'depth' under its host. Safe to call from any number of threads.
+
+    Preconditions:  'scheduler' was returned by schedulerCreate(), 'url' is a null-terminated absolute URL.
+    Postcondition:  Returns 0 and the URL is queued, 1 if it was pruned because 'depth' is beyond the
+                    scheduler's maximum depth, or -1 if it has no host, is longer than FRONTIER_MAX_URL - 1
+                    bytes or memory allocation failed.
+*/
+int schedulerPush(HostScheduler *scheduler, const char *url, int depth)
+{
+    if (depth < 0 || depth > scheduler->config.maxDepth)
+        return 1;
+
+    size_t len = strlen(url);
+    char key[MAX_HOST];
+    int keyLen = hostKey(url, key, sizeof(key));
+    if (len >= FRONTIER_MAX_URL || keyLen < 0)
+        return -1;
+
+    uint64_t hash = hash64(key, (size_t)keyLen);
+    Shard *shard = &scheduler->shards[(hash >> 32) & (SHARDS - 1)];  // High bits pick the shard, low bits the bucket
+    metricsLock(&shard->lock, METRIC_LOCK_SCHEDULER);
+    SchedulerHost *host = hostFind(scheduler, shard, hash, key, (size_t)keyLen);
+    if (host == NULL || queuePush(shard, &host->levels[depth], url, len) != 0)
+    {
+        pthread_mutex_unlock(&shard->lock);
+        return -1;
+    }
+    host->queued++;
+    atomic_fetch_add(&scheduler->size, 1);
+    hostUpdate(scheduler, shard, host);
+    pthread_mutex_unlock(&shard->lock);
+    return 0;
+}
+
+/*
+    Take a URL of a host that may start a transfer now. Safe to call from any number of threads.
+
+    Successive pops start at different shards, so the hosts that are ready take turns.
+
+    Preconditions:  'scheduler' was returned by schedulerCreate(), 'url' points to a buffer of 'size' bytes
+                    (FRONTIER_MAX_URL bytes always suffice), 'depth', 'host' and 'waitMs' to variables.
+    Postcondition:  Returns 1 with the URL copied into 'url', its link depth in 'depth' and its host in 'host';
+                    the transfer counts against the host until schedulerDone() is called with 'host'.
+                    Returns SCHEDULER_GIVEN_UP the same way for a URL of a host given up on, which is to be
+                    failed without a transfer and given back as SCHEDULER_SKIPPED.
+                    Returns 0 if no host is ready, with 'waitMs' set to the milliseconds until the crawl
+                    delay of a host runs out, or -1 if the scheduler is empty or every host with queued URLs
+                    is at its concurrency limit, or so are all hosts together.
+*/
+int schedulerPop(HostScheduler *scheduler, char *url, size_t size, int *depth, SchedulerHost **host, long *waitMs)
+{
+    *waitMs = -1;
+    if (atomic_load(&scheduler->size) <= 0)
+        return 0;
+    long globalLimit = atomic_load(&scheduler->globalLimit);
+    if (globalLimit > 0 && atomic_load(&scheduler->running) >= globalLimit / LIMIT_ONE)
+        return 0;                                   // schedulerDone() makes room
+
+    long long now = nowUs();
+    long long soonest = NOT_READY;
+    unsigned start = atomic_fetch_add(&scheduler->cursor, 1);
+
+    for (int i = 0; i < SHARDS; i++)
+    {
+        Shard *shard = &scheduler->shards[(start + (unsigned)i) % SHARDS];
+        long long ready = atomic_load(&shard->nextReady);
+        if (ready > now)                            // Nothing ready here, no need to lock
+        {
+            if (ready < soonest)
+                soonest = ready;
+            continue;
+        }
+
+        metricsLock(&shard->lock, METRIC_LOCK_SCHEDULER);
+        if (shard->heapCount == 0 || shard->heap[0]->nextStart > now)
+        {
+            if (shard->heapCount > 0 && shard->heap[0]->nextStart < soonest)
+                soonest = shard->heap[0]->nextStart;
+            pthread_mutex_unlock(&shard->lock);     // Another thread was faster
+            continue;
+        }
+
+        SchedulerHost *chosen = shard->heap[0];
+        int d = 0;
+        while (chosen->levels[d].count == 0)   // Shallowest level first
+            d++;
+        queuePop(shard, &chosen->levels[d], url, size);
+        chosen->queued--;
+        chosen->active++;
+        long delayMs = chosen->delayMs >= 0 ? chosen->delayMs : scheduler->config.delayMs;
+        int givenUp = chosen->breaker == BREAKER_GIVEN_UP;
+        if (chosen->breaker == BREAKER_OPEN)        // Held back long enough: this transfer probes the host
+        {
+            chosen->breaker = BREAKER_PROBING;
+            chosen->probeStart = now;
+        }
+        chosen->nextStart = givenUp ? now : now + (long long)delayMs * 1000;
+        atomic_fetch_sub(&scheduler->size, 1);
+        hostUpdate(scheduler, shard, chosen);
+        pthread_mutex_unlock(&shard->lock);
+
+        atomic_fetch_add(&scheduler->running, 1);
+        if (givenUp)
+            atomic_fetch_add(&scheduler->urlsGivenUp, 1);
+        *depth = d;
+        *host = chosen;
+        return givenUp ? SCHEDULER_GIVEN_UP : 1;
+    }
+
+    if (soonest != NOT_READY)
+        *waitMs = (long)((soonest - now + 999) / 1000);
+    return 0;
+}
+
+// Halve the limit of a host, unless the transfer that says so started before the last halving
+static void hostCut(HostScheduler *scheduler, SchedulerHost *host, long long started, long long now)
+{
+    if (started < host->lastCut)
+        return;
+    double base = host->limit > 0 ? host->limit : host->active + 1;   // No limit yet: what it was running
+    host->limit = base / 2 < 1 ? 1 : base / 2;
+    host->lastCut = now;
+    atomic_fetch_add(&scheduler->cuts, 1);
+    metricsCount(METRIC_LIMIT_CUTS, 1);
+}
+
+// Count a failure of a host, opening its breaker after too many in a row or when its probe failed
+static void hostFailed(HostScheduler *scheduler, SchedulerHost *host, long long started, long long now)
+{
+    host->failures++;
+    if (host->breaker == BREAKER_OPEN || host->breaker == BREAKER_GIVEN_UP ||
+        (host->breaker == BREAKER_PROBING && started < host->probeStart))
+        return;                                     // A transfer started before the breaker opened
+    if (host->breaker == BREAKER_CLOSED && host->failures < scheduler->config.breakerFailures)
+        return;
+
+    host->trips++;
+    atomic_fetch_add(&scheduler->trips, 1);
+    metricsCount(METRIC_BREAKER_TRIPS, 1);
+    if (scheduler->config.breakerTrips > 0 && host->trips >= scheduler->config.breakerTrips)
+    {
+        host->breaker = BREAKER_GIVEN_UP;
+        host->nextStart = now;                      // Its URLs go at once
+        atomic_fetch_add(&scheduler->hostsGivenUp, 1);
+        return;
+    }
+    int doublings = host->trips - 1 < MAX_BREAKER_DOUBLINGS ? host->trips - 1 : MAX_BREAKER_DOUBLINGS;
+    host->breaker = BREAKER_OPEN;
+    host->nextStart = now + scheduler->config.breakerMs * 1000 * (1LL << doublings);
+}
+
+// Adapt the limit and breaker of a host to the outcome of one of its transfers. Called with the shard locked.
+static void hostFeedback(HostScheduler *scheduler, SchedulerHost *host, SchedulerOutcome outcome, long latencyMs,
+                         long long now)
+{
+    long long started = now - (long long)latencyMs * 1000;
+    switch (outcome)
+    {
+    case SCHEDULER_OK:
+        host->answered = 1;
+        host->failures = 0;
+        if (host->breaker != BREAKER_CLOSED)        // It is back: start over from a single transfer
+        {
+            host->breaker = BREAKER_CLOSED;
+            host->trips = 0;
+            host->limit = 1;
+            host->lastCut = now;
+        }
+        if (latencyMs > scheduler->config.slowMs)
+            hostCut(scheduler, host, started, now);
+        else if (host->limit > 0)                   // One more transfer for every limit's worth of answers
+        {
+            host->limit += 1 / host->limit;
+            if (scheduler->config.maxPerHost > 0 && host->limit > scheduler->config.maxPerHost)
+                host->limit = scheduler->config.maxPerHost;
+        }
+        break;
+    case SCHEDULER_OVERLOADED:
+    case SCHEDULER_TIMEOUT:
+        hostCut(scheduler, host, started, now);
+        hostFailed(scheduler, host, started, now);
+        break;
+    case SCHEDULER_FAILED:
+        hostFailed(scheduler, host, started, now);
+        break;
+    case SCHEDULER_SKIPPED:
+        break;
+    }
+}
+
+// Adapt the limit over all hosts to the outcome of a transfer of a host that answered before
+static void globalFeedback(HostScheduler *scheduler, SchedulerOutcome outcome, long latencyMs, long long now)
+{
+    long limit = atomic_load(&scheduler->globalLimit);
+    if (outcome == SCHEDULER_TIMEOUT)
+    {
+        long long last = atomic_load(&scheduler->globalCut);
+        if (now - (long long)latencyMs * 1000 < last || !atomic_compare_exchange_strong(&scheduler->globalCut, &last, now))
+            return;                                 // Started before the last halving, or another thread halves it
+        long base = limit > 0 ? limit : (long)(atomic_load(&scheduler->running) + 1) * LIMIT_ONE;
+        atomic_store(&scheduler->globalLimit, base / 2 < LIMIT_ONE ? LIMIT_ONE : base / 2);
+        atomic_fetch_add(&scheduler->cuts, 1);
+        metricsCount(METRIC_LIMIT_CUTS, 1);
+    }
+    else if (outcome == SCHEDULER_OK && latencyMs <= scheduler->config.slowMs && limit > 0)
+    {
+        long max = (long)scheduler->config.maxActive * LIMIT_ONE;
+        long grown = limit + (long)LIMIT_ONE * LIMIT_ONE / limit;
+        if (max <= 0 || grown < max)
+            atomic_fetch_add(&scheduler->globalLimit, grown - limit);   // Racing growths both count, as they should
+        else
+            atomic_store(&scheduler->globalLimit, max);
+    }
+}
+
+// Take the outcome of an attempt into account, and give the host's transfer back if 'finished'
+static void hostOutcome(HostScheduler *scheduler, SchedulerHost *host, SchedulerOutcome outcome, long latencyMs,
+                        int finished)
+{
+    Shard *shard = &scheduler->shards[host->shard];
+    long long now = nowUs();
+    metricsLock(&shard->lock, METRIC_LOCK_SCHEDULER);
+    int answered = host->answered && host->breaker == BREAKER_CLOSED;   // A timeout of it is not the host's own fault
+    host->active -= finished;
+    if (scheduler->config.adaptive)
+        hostFeedback(scheduler, host, outcome, latencyMs, now);
+    hostUpdate(scheduler, shard, host);
+    pthread_mutex_unlock(&shard->lock);
+
+    if (finished)
+        atomic_fetch_sub(&scheduler->running, 1);
+    if (scheduler->config.adaptive && (answered || outcome == SCHEDULER_OK))
+        globalFeedback(scheduler, outcome, latencyMs, now);
+}
+
+/*
+    Tell the scheduler how an attempt of a transfer still going on went, typically one that failed and is retried.
+
+    Preconditions:  'host' was returned by schedulerPop() on 'scheduler' and not given back yet. 'outcome' tells how
+                    the attempt went and 'latencyMs' how long it took.
+    Postcondition:  With 'adaptive' set, the limits and the host's breaker have taken the outcome into account.
+*/
+void schedulerReport(HostScheduler *scheduler, SchedulerHost *host, SchedulerOutcome outcome, long latencyMs)
+{
+    hostOutcome(scheduler, host, outcome, latencyMs, 0);
+}
+
+/*
+    Give back a host whose transfer has finished, successfully or not.
+
+    Preconditions:  'host' was returned by schedulerPop() on 'scheduler' and not given back yet. 'outcome' tells how
+                    the last attempt of the transfer went and 'latencyMs' how long it took.
+    Postcondition:  The transfer no longer counts against the host's concurrency limit, and with 'adaptive' set the
+                    limits and the host's breaker have taken the outcome into account.
+*/
+void schedulerDone(HostScheduler *scheduler, SchedulerHost *host, SchedulerOutcome outcome, long latencyMs)
+{
+    hostOutcome(scheduler, host, outcome, latencyMs, 1);
+}
+
+/*
+    Set the crawl delay of the host of 'url', for instance from its robots.txt.
+
+    Preconditions:  'scheduler' was returned by schedulerCreate(), 'url' is a null-terminated absolute URL.
+    Postcondition:  Returns 0 and transfers of the host start at least 'delayMs' apart from its next one on
+                    (-1 restores the scheduler's default), or -1 if the URL has no host or memory allocation failed.
+*/
+int schedulerSetDelay(HostScheduler *scheduler, const char *url, long delayMs)
+{
+    char key[MAX_HOST];
+    int keyLen = hostKey(url, key, sizeof(key));
+    if (keyLen < 0)
+        return -1;
+
+    uint64_t hash = hash64(key, (size_t)keyLen);
+    Shard *shard = &scheduler->shards[(hash >> 32) & (SHARDS - 1)];
+    metricsLock(&shard->lock, METRIC_LOCK_SCHEDULER);
+    SchedulerHost *host = hostFind(scheduler, shard, hash, key, (size_t)keyLen);
+    if (host != NULL)
+        host->delayMs = delayMs < 0 ? -1 : delayMs;
+    pthread_mutex_unlock(&shard->lock);
+    return host != NULL ? 0 : -1;
+}
+
+/*
+    Transfers the host of 'url' may currently have running.
+
+    Preconditions:  'scheduler' was returned by schedulerCreate(), 'url' is a null-terminated absolute URL.
+    Postcondition:  Returns the limit, 0 if there is none, or -1 if no URL of the host was queued yet.
+*/
+int schedulerLimit(HostScheduler *scheduler, const char *url)
+{
+    char key[MAX_HOST];
+    int keyLen = hostKey(url, key, sizeof(key));
+    if (keyLen < 0)
+        return -1;
+
+    uint64_t hash = hash64(key, (size_t)keyLen);
+    Shard *shard = &scheduler->shards[(hash >> 32) & (SHARDS - 1)];
+    int limit = -1;
+    metricsLock(&shard->lock, METRIC_LOCK_SCHEDULER);
+    for (SchedulerHost *host = shard->table[hash & (shard->buckets - 1)]; host != NULL; host = host->next)
+    {
+        if (host->hash != hash || strcmp(host->name, key) != 0)
+            continue;
+        limit = hostLimit(scheduler, host);
+        break;
+    }
+    pthread_mutex_unlock(&shard->lock);
+    return limit;
+}
+
+// Number of URLs currently queued over all hosts (a snapshot while other threads are active)
+long schedulerSize(const HostScheduler *scheduler)
+{
+    return atomic_load(&((HostScheduler *)scheduler)->size);
+}
+
+// Number of hosts the scheduler has seen
+long schedulerHosts(const HostScheduler *scheduler)
+{
+    return atomic_load(&((HostScheduler *)scheduler)->hosts);
+}
+
+// Counters of the adaptive limits so far (a snapshot while other threads are active)
+void schedulerStats(const HostScheduler *scheduler, SchedulerStats *stats)
+{
+    HostScheduler *s = (HostScheduler *)scheduler;
+    stats->cuts = atomic_load(&s->cuts);
+    stats->trips = atomic_load(&s->trips);
+    stats->hostsGivenUp = atomic_load(&s->hostsGivenUp);
+    stats->urlsGivenUp = atomic_load(&s->urlsGivenUp);
+    stats->globalLimit = (int)(atomic_load(&s->globalLimit) / LIMIT_ONE);
+}
+
+/*
+    Destroy a scheduler.
+
+    Preconditions:  'scheduler' was returned by schedulerCreate() and no other thread uses it.
+    Postcondition:  Every queued URL, every host and all memory is released.
+*/
+void schedulerDestroy(HostScheduler *scheduler)
+{
+    if (scheduler == NULL)
+        return;
+    for (int i = 0; i < SHARDS; i++)
+    {
+        Shard *shard = &scheduler->shards[i];
+        for (size_t b = 0; b < shard->buckets; b++)
+        {
+            while (shard->table[b] != NULL)
+            {
+                SchedulerHost *host = shard->table[b];
+                shard->table[b] = host->next;
+                for (int d = 0; d <= scheduler->config.maxDepth; d++)
+                    queueFree(&host->levels[d]);
+                free(host);
+            }
+        }
+        for (int k = 0; k < 2; k++)
+        {
+            while (shard->freeBlocks[k] != NULL)
+            {
+                UrlBlock *block = shard->freeBlocks[k];
+                shard->freeBlocks[k] = block->next;
+                free(block);
+            }
+        }
+        free(shard->table);
+        free(shard->heap);
+        pthread_mutex_destroy(&shard->lock);
+    }
+    free(scheduler);
+}
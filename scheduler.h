@@ -0,0 +1,73 @@
+/*
+Operating Systems Spring 2024
+Final Project
+
+Politeness scheduler: per-host URL queues released under per-host concurrency and crawl-delay limits, adapted to
+how each host copes.
+*/
+
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <stddef.h>
+
+// Default number of transfers a host may have running at once
+#define SCHEDULER_DEFAULT_PER_HOST 8
+
+// Returned by schedulerPop() for a URL of a host given up on: fail it without a transfer
+#define SCHEDULER_GIVEN_UP 2
+
+// Outcome of a transfer, given back with schedulerDone()
+typedef enum
+{
+    SCHEDULER_OK,               // The host answered
+    SCHEDULER_OVERLOADED,       // The host answered 429, 502, 503 or 504
+    SCHEDULER_TIMEOUT,          // The host did not answer in time
+    SCHEDULER_FAILED,           // The host could not be reached: not resolved, refused or reset
+    SCHEDULER_SKIPPED           // No transfer was made
+} SchedulerOutcome;
+
+// Settings for schedulerCreate()
+typedef struct
+{
+    int maxDepth;               // Deepest link depth kept, as for frontierCreate()
+    int maxPerHost;             // Transfers running at once per host (0 = unlimited)
+    long delayMs;               // Least time between two starts on one host, unless set per host
+    int adaptive;               // 1 to adapt every host's concurrency to its answers and stop failing hosts
+    long slowMs;                // Transfers taking longer count as a sign of overload
+    int breakerFailures;        // Failures in a row that open a host's circuit breaker
+    long breakerMs;             // Time an open breaker holds its host back, doubled for every opening in a row
+    int breakerTrips;           // Openings in a row after which a host's URLs are given up (0 = never)
+    int maxActive;              // Transfers running at once over all hosts (0 = unlimited)
+} SchedulerConfig;
+
+// Counters of the adaptive limits since schedulerCreate()
+typedef struct
+{
+    long cuts;                  // Times the limit of a host, or the global one, was halved
+    long trips;                 // Times a host's circuit breaker opened
+    long hostsGivenUp;          // Hosts whose breaker opened breakerTrips times in a row
+    long urlsGivenUp;           // URLs handed out with SCHEDULER_GIVEN_UP
+    int globalLimit;            // Current limit over all hosts, 0 for none
+} SchedulerStats;
+
+typedef struct HostScheduler HostScheduler;
+
+// A host of the scheduler; handed out with every URL and given back with schedulerDone()
+typedef struct SchedulerHost SchedulerHost;
+
+// Function prototypes
+void schedulerConfigDefaults(SchedulerConfig *config);
+HostScheduler *schedulerCreate(const SchedulerConfig *config);
+int schedulerPush(HostScheduler *scheduler, const char *url, int depth);
+int schedulerPop(HostScheduler *scheduler, char *url, size_t size, int *depth, SchedulerHost **host, long *waitMs);
+void schedulerReport(HostScheduler *scheduler, SchedulerHost *host, SchedulerOutcome outcome, long latencyMs);
+void schedulerDone(HostScheduler *scheduler, SchedulerHost *host, SchedulerOutcome outcome, long latencyMs);
+int schedulerSetDelay(HostScheduler *scheduler, const char *url, long delayMs);
+int schedulerLimit(HostScheduler *scheduler, const char *url);
+long schedulerSize(const HostScheduler *scheduler);
+long schedulerHosts(const HostScheduler *scheduler);
+void schedulerStats(const HostScheduler *scheduler, SchedulerStats *stats);
+void schedulerDestroy(HostScheduler *scheduler);
+
+#endif
@@ -0,0 +1,706 @@
+/*
+Operating Systems Spring 2024
+Final Project
+
+Seed loader: the URL lists of seed files, mapped into memory or decompressed as a stream, split into lines by
+several threads while the crawl starts.
+
+A reader thread goes through the files in order. A regular file is mapped with mmap() and cut into chunks of
+about 'chunkBytes', each ending at a newline; a chunk is only a range of the mapping, so the lines are never
+copied. A file starting with the gzip magic bytes is decompressed with zlib into buffers of 'chunkBytes' (also
+from the mapping, member after member as written by gzip, pigz or bgzip), and so is stdin or any file that
+cannot be mapped, read with read(). A buffer is handed over up to its last newline; the partial line left is
+moved to the next buffer. The buffers go back to the reader once parsed, so a stream of any size needs a
+fixed number of them.
+
+Parser threads take the chunks from a bounded queue, split them into lines and pass each URL to the onUrl
+callback as a pointer into the chunk, so a URL costs no allocation here. The first URL queued is signalled
+at once, which lets the crawl start long before the last line is read.
+*/
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <zlib.h>
+
+#include "seeds.h"
+
+// Chunks waiting for the parsers at most, per parser
+#define QUEUE_PER_THREAD 2
+
+// Most compressed bytes handed to zlib at once (its counters are 32-bit)
+#define MAX_INFLATE_INPUT (1u << 30)
+
+// Part of a file handed to a parser
+typedef struct
+{
+    const char *data;
+    size_t len;
+    char *buffer;               // Buffer to give back to the reader once parsed, NULL for a range of a mapping
+} SeedChunk;
+
+// Lines of a stream collected in the reader's buffers
+typedef struct
+{
+    char *buffer;               // Buffer being filled
+    size_t len;
+    int skipping;               // 1 while dropping the rest of a line longer than a buffer
+} SeedStream;
+
+// Compressed bytes for the gzip decoder: a mapping, or a buffer refilled from a file
+typedef struct
+{
+    const unsigned char *next;  // Bytes not given to zlib yet
+    size_t left;
+    int fd;                     // File to refill 'buffer' from once 'left' runs out, -1 for none
+    unsigned char *buffer;
+    size_t size;
+} GzipInput;
+
+struct SeedLoader
+{
+    SeedConfig config;
+    const char *const *paths;
+    int *fds;
+    int count;
+    pthread_t reader;
+    pthread_t *parsers;
+    int threads;
+
+    // Chunks on their way to the parsers and the reader's buffers, under 'lock'
+    pthread_mutex_t lock;
+    pthread_cond_t ready;       // A chunk was queued, or the last one was
+    pthread_cond_t room;        // A chunk was taken or parsed
+    pthread_cond_t first;       // The first URL was queued, or the load is over
+    SeedChunk *queue;
+    int head, queued, capacity;
+    int busy;                   // Chunks being parsed
+    int ended;                  // 1 once the reader queued its last chunk
+    char **spare;               // Buffers parsed, free for the reader
+    int spareCount, buffers, maxBuffers;
+    int gotFirst, finished;
+    int failed;                 // 1 if a file could not be read to its end
+    SeedStats stats;
+};
+
+/*
+    Fill a SeedConfig with the crawler's default settings.
+
+    Preconditions:  'config' points to a valid SeedConfig structure.
+    Postcondition:  Every field is set; onUrl is NULL and must be set before seedLoadStart().
+*/
+void seedConfigDefaults(SeedConfig *config)
+{
+    config->threads = 0;
+    config->chunkBytes = 1024 * 1024;           // About 25,000 URLs, a few milliseconds of work
+    config->onUrl = NULL;
+    config->onDone = NULL;
+    config->arg = NULL;
+}
+
+// Signal the first URL queued, once
+static void signalFirst(SeedLoader *loader)
+{
+    pthread_mutex_lock(&loader->lock);
+    if (!loader->gotFirst)
+    {
+        loader->gotFirst = 1;
+        pthread_cond_broadcast(&loader->first);
+    }
+    pthread_mutex_unlock(&loader->lock);
+}
+
+// Split a chunk into lines and pass each URL to onUrl, counting the outcomes in 'counts'
+static void parseChunk(SeedLoader *loader, const SeedChunk *chunk, SeedStats *counts)
+{
+    const char *line = chunk->data;
+    const char *end = chunk->data + chunk->len;
+    while (line < end)
+    {
+        const char *newline = memchr(line, '\n', (size_t)(end - line));
+        const char *stop = newline != NULL ? newline : end;
+        const char *next = newline != NULL ? newline + 1 : end;
+        counts->lines++;
+        while (line < stop && (*line == ' ' || *line == '\t'))
+            line++;
+        while (stop > line && (unsigned char)stop[-1] <= ' ')   // The '\r' of a DOS line too
+            stop--;
+        if (line < stop && *line != '#')
+        {
+            int result = loader->config.onUrl(line, (size_t)(stop - line), loader->config.arg);
+            if (result == SEED_QUEUED && counts->queued++ == 0)
+                signalFirst(loader);            // Checked once per chunk
+            else if (result == SEED_SKIPPED)
+                counts->skipped++;
+            else if (result == SEED_INVALID)
+                counts->invalid++;
+        }
+        line = next;
+    }
+}
+
+// Take the chunks off the queue and parse them until the reader has queued its last one
+static void *parserThread(void *arg)
+{
+    SeedLoader *loader = (SeedLoader *)arg;
+    pthread_mutex_lock(&loader->lock);
+    for (;;)
+    {
+        while (loader->queued == 0 && !loader->ended)
+            pthread_cond_wait(&loader->ready, &loader->lock);
+        if (loader->queued == 0)
+            break;
+        SeedChunk chunk = loader->queue[loader->head];
+        loader->head = (loader->head + 1) % loader->capacity;
+        loader->queued--;
+        loader->busy++;
+        pthread_cond_broadcast(&loader->room);
+        pthread_mutex_unlock(&loader->lock);
+
+        SeedStats counts = { 0 };
+        parseChunk(loader, &chunk, &counts);
+        if (chunk.buffer == NULL)               // Parsed pages of a mapping need not stay resident
+        {
+            uintptr_t page = (uintptr_t)sysconf(_SC_PAGESIZE);
+            uintptr_t from = (uintptr_t)chunk.data & ~(page - 1);   // A page shared with the next chunk is read back in
+            madvise((void *)from, (uintptr_t)chunk.data + chunk.len - from, MADV_DONTNEED);
+        }
+
+        pthread_mutex_lock(&loader->lock);
+        loader->busy--;
+        loader->stats.lines += counts.lines;
+        loader->stats.queued += counts.queued;
+        loader->stats.skipped += counts.skipped;
+        loader->stats.invalid += counts.invalid;
+        if (chunk.buffer != NULL)
+            loader->spare[loader->spareCount++] = chunk.buffer;
+        pthread_cond_broadcast(&loader->room);
+    }
+    pthread_mutex_unlock(&loader->lock);
+    return NULL;
+}
+
+// Queue a chunk for the parsers, waiting while the queue is full
+static void pushChunk(SeedLoader *loader, const char *data, size_t len, char *buffer)
+{
+    pthread_mutex_lock(&loader->lock);
+    while (loader->queued == loader->capacity)
+        pthread_cond_wait(&loader->room, &loader->lock);
+    loader->queue[(loader->head + loader->queued) % loader->capacity] = (SeedChunk){ data, len, buffer };
+    loader->queued++;
+    loader->stats.bytes += (long long)len;
+    pthread_cond_signal(&loader->ready);
+    pthread_mutex_unlock(&loader->lock);
+}
+
+// Take a buffer of chunkBytes, waiting for the parsers to give one back once all are in use; NULL if out of memory
+static char *takeBuffer(SeedLoader *loader)
+{
+    char *buffer = NULL;
+    pthread_mutex_lock(&loader->lock);
+    while (loader->spareCount == 0 && loader->buffers == loader->maxBuffers)
+        pthread_cond_wait(&loader->room, &loader->lock);
+    if (loader->spareCount > 0)
+        buffer = loader->spare[--loader->spareCount];
+    else if ((buffer = malloc(loader->config.chunkBytes)) != NULL)
+        loader->buffers++;
+    pthread_mutex_unlock(&loader->lock);
+    return buffer;
+}
+
+// Give a buffer the reader will not fill back, NULL for none
+static void giveBuffer(SeedLoader *loader, char *buffer)
+{
+    if (buffer == NULL)
+        return;
+    pthread_mutex_lock(&loader->lock);
+    loader->spare[loader->spareCount++] = buffer;
+    pthread_mutex_unlock(&loader->lock);
+}
+
+// Wait until the parsers are done with every chunk queued
+static void drain(SeedLoader *loader)
+{
+    pthread_mutex_lock(&loader->lock);
+    while (loader->queued > 0 || loader->busy > 0)
+        pthread_cond_wait(&loader->room, &loader->lock);
+    pthread_mutex_unlock(&loader->lock);
+}
+
+// Queue a mapped file in chunks of about chunkBytes, each ending at a newline
+static void splitMapping(SeedLoader *loader, const char *data, size_t len)
+{
+    size_t chunkBytes = loader->config.chunkBytes;
+    size_t pos = 0;
+    while (pos < len)
+    {
+        size_t end = len;
+        if (len - pos > chunkBytes)
+        {
+            const char *newline = memchr(data + pos + chunkBytes, '\n', len - pos - chunkBytes);
+            if (newline != NULL)
+                end = (size_t)(newline - data) + 1;
+        }
+        pushChunk(loader, data + pos, end - pos, NULL);
+        pos = end;
+    }
+}
+
+/*
+    Hand the complete lines of a stream's buffer to the parsers.
+
+    Preconditions:  'stream' holds a buffer of chunkBytes.
+    Postcondition:  The lines up to the last newline are queued and the partial line left is moved to a new
+                    buffer; with 'last', everything is queued and the stream has no buffer left. A line filling a
+                    whole buffer is too long for a URL: it is dropped up to its end and counted as invalid.
+                    Returns 0, or -1 if out of memory.
+*/
+static int streamFlush(SeedLoader *loader, SeedStream *stream, int last)
+{
+    char *data = stream->buffer;
+    if (stream->skipping)                       // Drop the rest of the long line
+    {
+        char *newline = memchr(data, '\n', stream->len);
+        if (newline == NULL)
+        {
+            stream->len = 0;
+            if (!last)
+                return 0;
+        }
+        else
+        {
+            stream->len -= (size_t)(newline + 1 - data);
+            memmove(data, newline + 1, stream->len);
+            stream->skipping = 0;
+        }
+    }
+
+    size_t lines = stream->len;                 // Bytes to hand over
+    if (!last)
+    {
+        char *newline = memrchr(data, '\n', stream->len);
+        lines = newline != NULL ? (size_t)(newline + 1 - data) : 0;
+    }
+    if (lines == 0)
+    {
+        if (last)
+        {
+            giveBuffer(loader, data);
+            stream->buffer = NULL;
+        }
+        else if (stream->len == loader->config.chunkBytes)
+        {
+            stream->skipping = 1;
+            stream->len = 0;
+            pthread_mutex_lock(&loader->lock);
+            loader->stats.lines++;
+            loader->stats.invalid++;
+            pthread_mutex_unlock(&loader->lock);
+        }
+        return 0;
+    }
+
+    char *next = NULL;
+    if (!last && (next = takeBuffer(loader)) == NULL)
+        return -1;
+    if (next != NULL)
+        memcpy(next, data + lines, stream->len - lines);
+    pushChunk(loader, data, lines, data);
+    stream->buffer = next;
+    stream->len -= lines;
+    return 0;
+}
+
+// Drop the partial line at the end of a stream that broke off
+static void streamCut(SeedStream *stream)
+{
+    char *newline = memrchr(stream->buffer, '\n', stream->len);
+    stream->len = newline != NULL ? (size_t)(newline + 1 - stream->buffer) : 0;
+}
+
+// Refill a stream's buffer from a file until it is full or the file ends; 1 if data came, 0 at the end, -1 on error
+static int streamRead(SeedStream *stream, int fd, size_t size)
+{
+    ssize_t got = read(fd, stream->buffer + stream->len, size - stream->len);
+    if (got < 0)
+        return -1;
+    stream->len += (size_t)got;
+    return got > 0;
+}
+
+/*
+    Decompress gzip data into a stream.
+
+    Preconditions:  'input' holds the compressed bytes that come first; 'stream' holds a buffer.
+    Postcondition:  Every member of the gzip data is decompressed and its complete lines are queued. Returns 0, or
+                    -1 if the data is corrupt or truncated or a read fails (reported on stderr).
+*/
+static int inflateStream(SeedLoader *loader, SeedStream *stream, GzipInput *input, const char *path)
+{
+    size_t chunkBytes = loader->config.chunkBytes;
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    if (inflateInit2(&zs, 15 + 16) != Z_OK)     // gzip format only
+        return -1;
+
+    int result = 0;
+    int status = Z_OK;
+    int inMember = 0;                           // 1 while a member is not decompressed to its end
+    for (;;)
+    {
+        if (zs.avail_in == 0)
+        {
+            if (input->left == 0 && input->fd >= 0)
+            {
+                ssize_t got = read(input->fd, input->buffer, input->size);
+                if (got < 0)
+                {
+                    perror(path);
+                    result = -1;
+                    break;
+                }
+                input->next = input->buffer;
+                input->left = (size_t)got;
+            }
+            if (input->left == 0)
+                break;                          // End of the input
+            zs.next_in = (Bytef *)input->next;
+            zs.avail_in = input->left > MAX_INFLATE_INPUT ? MAX_INFLATE_INPUT : (uInt)input->left;
+            input->next += zs.avail_in;
+            input->left -= zs.avail_in;
+        }
+
+        zs.next_out = (Bytef *)stream->buffer + stream->len;
+        zs.avail_out = (uInt)(chunkBytes - stream->len);
+        status = inflate(&zs, Z_NO_FLUSH);
+        stream->len = chunkBytes - zs.avail_out;
+        if (status == Z_STREAM_END)
+        {
+            inMember = 0;
+            inflateReset(&zs);                  // Another member may follow
+        }
+        else if (status == Z_OK || status == Z_BUF_ERROR)
+        {
+            inMember = 1;
+        }
+        else
+        {
+            fprintf(stderr, "%s: corrupt gzip data\n", path);
+            result = -1;
+            break;
+        }
+        if (stream->len == chunkBytes && streamFlush(loader, stream, 0) != 0)
+        {
+            result = -1;
+            break;
+        }
+    }
+    if (result == 0 && inMember)
+    {
+        fprintf(stderr, "%s: truncated gzip data\n", path);
+        result = -1;
+    }
+    inflateEnd(&zs);
+    return result;
+}
+
+// Report a file compressed in a format with no decoder here; 1 if it is one
+static int unsupportedFormat(const unsigned char *data, size_t len, const char *path)
+{
+    if (len >= 4 && data[0] == 0x28 && data[1] == 0xb5 && data[2] == 0x2f && data[3] == 0xfd)
+    {
+        fprintf(stderr, "%s: zstd data is not supported, decompress it first "
+                "(zstd -dc FILE | crawler -S -)\n", path);
+        return 1;
+    }
+    return 0;
+}
+
+// Whether data starts with the gzip magic bytes
+static int isGzip(const unsigned char *data, size_t len)
+{
+    return len >= 2 && data[0] == 0x1f && data[1] == 0x8b;
+}
+
+// Read a file that cannot be mapped, stdin in a pipe for one: plain lines straight into the buffers, or gzip
+static int readUnmapped(SeedLoader *loader, int fd, const char *path)
+{
+    size_t chunkBytes = loader->config.chunkBytes;
+    SeedStream stream = { takeBuffer(loader), 0, 0 };
+    if (stream.buffer == NULL)
+        return -1;
+
+    int more = 1;
+    while (more > 0 && stream.len < 4)          // Enough for the magic bytes
+        more = streamRead(&stream, fd, chunkBytes);
+    int result = 0;
+    if (more < 0)
+    {
+        perror(path);
+        result = -1;
+    }
+    else if (unsupportedFormat((unsigned char *)stream.buffer, stream.len, path))
+    {
+        stream.len = 0;
+        result = -1;
+    }
+    else if (isGzip((unsigned char *)stream.buffer, stream.len))
+    {
+        // What was read is compressed: the buffer becomes the input of the decoder
+        GzipInput input = { (unsigned char *)stream.buffer, stream.len, fd, (unsigned char *)stream.buffer, chunkBytes };
+        stream.buffer = takeBuffer(loader);
+        stream.len = 0;
+        if (stream.buffer == NULL)
+            result = -1;
+        else
+            result = inflateStream(loader, &stream, &input, path);
+        giveBuffer(loader, (char *)input.buffer);
+        pthread_mutex_lock(&loader->lock);
+        loader->stats.compressed++;
+        pthread_mutex_unlock(&loader->lock);
+    }
+    else
+    {
+        while (more > 0)
+        {
+            if (stream.len == chunkBytes && streamFlush(loader, &stream, 0) != 0)
+            {
+                result = -1;
+                break;
+            }
+            more = streamRead(&stream, fd, chunkBytes);
+        }
+        if (more < 0)
+        {
+            perror(path);
+            result = -1;
+        }
+    }
+
+    if (stream.buffer != NULL && result != 0)
+        streamCut(&stream);
+    if (stream.buffer != NULL && streamFlush(loader, &stream, 1) != 0)
+        result = -1;
+    return result;
+}
+
+// Read one file: mapped if it can be, the lines of a plain one straight from the mapping
+static int readFile(SeedLoader *loader, int fd, const char *path)
+{
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size == 0)
+        return readUnmapped(loader, fd, path);
+    size_t size = (size_t)st.st_size;
+    char *data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED)
+        return readUnmapped(loader, fd, path);
+    madvise(data, size, MADV_SEQUENTIAL);       // Read ahead
+
+    int result = 0;
+    if (unsupportedFormat((unsigned char *)data, size, path))
+    {
+        result = -1;
+    }
+    else if (isGzip((unsigned char *)data, size))
+    {
+        GzipInput input = { (unsigned char *)data, size, -1, NULL, 0 };
+        SeedStream stream = { takeBuffer(loader), 0, 0 };
+        result = stream.buffer != NULL ? inflateStream(loader, &stream, &input, path) : -1;
+        if (stream.buffer != NULL && result != 0)
+            streamCut(&stream);
+        if (stream.buffer != NULL && streamFlush(loader, &stream, 1) != 0)
+            result = -1;
+        pthread_mutex_lock(&loader->lock);
+        loader->stats.compressed++;
+        pthread_mutex_unlock(&loader->lock);
+    }
+    else
+    {
+        splitMapping(loader, data, size);
+    }
+    drain(loader);                              // The parsers are done with the mapping
+    munmap(data, size);
+    return result;
+}
+
+// Read the files in order, then wait for the parsers and report the load done
+static void *readerThread(void *arg)
+{
+    SeedLoader *loader = (SeedLoader *)arg;
+    int failed = 0;
+    for (int i = 0; i < loader->count; i++)
+    {
+        if (readFile(loader, loader->fds[i], loader->paths[i]) != 0)
+            failed = 1;
+    }
+
+    pthread_mutex_lock(&loader->lock);
+    loader->failed = failed;
+    loader->ended = 1;
+    pthread_cond_broadcast(&loader->ready);
+    while (loader->queued > 0 || loader->busy > 0)
+        pthread_cond_wait(&loader->room, &loader->lock);
+    pthread_mutex_unlock(&loader->lock);
+
+    if (loader->config.onDone != NULL)
+        loader->config.onDone(loader->config.arg);
+    pthread_mutex_lock(&loader->lock);
+    loader->finished = 1;
+    pthread_cond_broadcast(&loader->first);
+    pthread_mutex_unlock(&loader->lock);
+    return NULL;
+}
+
+// Free a loader whose threads are joined, or were never started
+static void freeLoader(SeedLoader *loader)
+{
+    for (int i = 0; i < loader->count; i++)
+    {
+        if (loader->fds[i] > STDIN_FILENO)
+            close(loader->fds[i]);
+    }
+    for (int i = 0; i < loader->spareCount; i++)
+        free(loader->spare[i]);
+    pthread_mutex_destroy(&loader->lock);
+    pthread_cond_destroy(&loader->ready);
+    pthread_cond_destroy(&loader->room);
+    pthread_cond_destroy(&loader->first);
+    free(loader->spare);
+    free(loader->queue);
+    free(loader->parsers);
+    free(loader->fds);
+    free(loader);
+}
+
+// End the parsers started so far and free the loader, after a thread could not be started
+static void abortLoad(SeedLoader *loader, int started)
+{
+    pthread_mutex_lock(&loader->lock);
+    loader->ended = 1;
+    pthread_cond_broadcast(&loader->ready);
+    pthread_mutex_unlock(&loader->lock);
+    for (int i = 0; i < started; i++)
+        pthread_join(loader->parsers[i], NULL);
+    freeLoader(loader);
+}
+
+/*
+    Start loading the URLs of seed files.
+
+    Preconditions:  'paths' holds 'count' file names, "-" for stdin, and stays valid until seedLoadWait(); 'config'
+                    has its onUrl set.
+    Postcondition:  Returns the loader, its threads passing the URLs of the files in order to onUrl, and calling
+                    onDone once every line is done with. Returns NULL, with nothing loaded, if a file cannot be
+                    opened (reported on stderr) or out of memory.
+*/
+SeedLoader *seedLoadStart(const char *const *paths, int count, const SeedConfig *config)
+{
+    SeedLoader *loader = calloc(1, sizeof(SeedLoader));
+    if (loader == NULL)
+        return NULL;
+    loader->config = *config;
+    if (loader->config.chunkBytes < 4096)
+        loader->config.chunkBytes = 4096;
+    loader->paths = paths;
+    loader->threads = config->threads > 0 ? config->threads : (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (loader->threads < 1)
+        loader->threads = 1;
+    loader->capacity = loader->threads * QUEUE_PER_THREAD;
+    loader->maxBuffers = loader->capacity + loader->threads + 2;   // Queued, being parsed, and the reader's two
+    pthread_mutex_init(&loader->lock, NULL);
+    pthread_cond_init(&loader->ready, NULL);
+    pthread_cond_init(&loader->room, NULL);
+    pthread_cond_init(&loader->first, NULL);
+    loader->fds = malloc(sizeof(int) * (size_t)(count > 0 ? count : 1));
+    loader->queue = malloc(sizeof(SeedChunk) * (size_t)loader->capacity);
+    loader->spare = malloc(sizeof(char *) * (size_t)loader->maxBuffers);
+    loader->parsers = malloc(sizeof(pthread_t) * (size_t)loader->threads);
+    if (loader->fds == NULL || loader->queue == NULL || loader->spare == NULL || loader->parsers == NULL)
+    {
+        freeLoader(loader);
+        return NULL;
+    }
+
+    // Open every file first, so one that cannot be read stops the load before anything is queued
+    for (int i = 0; i < count; i++)
+    {
+        int fd = strcmp(paths[i], "-") == 0 ? STDIN_FILENO : open(paths[i], O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+        {
+            perror(paths[i]);
+            freeLoader(loader);
+            return NULL;
+        }
+        loader->fds[loader->count++] = fd;
+    }
+
+    for (int i = 0; i < loader->threads; i++)
+    {
+        if (pthread_create(&loader->parsers[i], NULL, parserThread, loader) != 0)
+        {
+            abortLoad(loader, i);
+            return NULL;
+        }
+    }
+    if (pthread_create(&loader->reader, NULL, readerThread, loader) != 0)
+    {
+        abortLoad(loader, loader->threads);
+        return NULL;
+    }
+    return loader;
+}
+
+/*
+    Wait for the first URL of a load to be queued.
+
+    Preconditions:  'loader' was returned by seedLoadStart().
+    Postcondition:  Returns 1 once onUrl has queued a URL, or 0 once the load is over with none queued (onDone has
+                    been called then).
+*/
+int seedLoadFirst(SeedLoader *loader)
+{
+    pthread_mutex_lock(&loader->lock);
+    while (!loader->gotFirst && !loader->finished)
+        pthread_cond_wait(&loader->first, &loader->lock);
+    int gotFirst = loader->gotFirst;
+    pthread_mutex_unlock(&loader->lock);
+    return gotFirst;
+}
+
+/*
+    Read the counters of a load in progress.
+
+    Preconditions:  'loader' was returned by seedLoadStart(); 'stats' points to a valid SeedStats structure.
+    Postcondition:  'stats' holds the counters of the chunks parsed so far.
+*/
+void seedLoadStats(SeedLoader *loader, SeedStats *stats)
+{
+    pthread_mutex_lock(&loader->lock);
+    *stats = loader->stats;
+    pthread_mutex_unlock(&loader->lock);
+}
+
+/*
+    Wait for a load to end and free the loader.
+
+    Preconditions:  'loader' was returned by seedLoadStart(); 'stats' points to a SeedStats structure, or is NULL.
+    Postcondition:  Every line is done with and the loader is freed, with its counters stored in 'stats'. Returns
+                    0, or -1 if a file could not be read to its end (the lines before the error were loaded).
+*/
+int seedLoadWait(SeedLoader *loader, SeedStats *stats)
+{
+    pthread_join(loader->reader, NULL);
+    for (int i = 0; i < loader->threads; i++)
+        pthread_join(loader->parsers[i], NULL);
+    if (stats != NULL)
+        *stats = loader->stats;
+    int result = loader->failed ? -1 : 0;
+    freeLoader(loader);
+    return result;
+}
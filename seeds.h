@@ -0,0 +1,56 @@
+/*
+Operating Systems Spring 2024
+Final Project
+
+Seed loader: the URL lists of seed files, mapped into memory or decompressed as a stream, split into lines by
+several threads while the crawl starts.
+*/
+
+#ifndef SEEDS_H
+#define SEEDS_H
+
+#include <stddef.h>
+
+// What the onUrl callback of a SeedConfig did with a URL
+#define SEED_QUEUED 0           // Queued (or handed to the shard owning it)
+#define SEED_SKIPPED 1          // Queued or fetched already
+#define SEED_INVALID -1         // Not a valid URL
+
+/*
+    Called for each URL of the files: 'url' points to its 'len' bytes, not null-terminated, with the spaces around
+    it stripped; blank lines and lines starting with '#' are not passed. Called from several threads at once.
+    Returns SEED_QUEUED, SEED_SKIPPED or SEED_INVALID.
+*/
+typedef int (*SeedUrlCallback)(const char *url, size_t len, void *arg);
+
+// Settings for seedLoadStart()
+typedef struct
+{
+    int threads;                // Threads splitting the lines and calling onUrl, 0 for one per CPU
+    size_t chunkBytes;          // Bytes of a file a thread takes at a time
+    SeedUrlCallback onUrl;      // Called for each URL
+    void (*onDone)(void *arg);  // Called once every line of every file is done with, NULL for nothing
+    void *arg;                  // Passed to the callbacks
+} SeedConfig;
+
+// Counters of a seed load
+typedef struct
+{
+    long lines;                 // Lines read, blank lines and comments included
+    long queued;                // URLs onUrl queued
+    long skipped;               // URLs onUrl skipped as queued or fetched already
+    long invalid;               // URLs onUrl found invalid
+    long long bytes;            // Bytes of the files, after decompression
+    long compressed;            // Files read through the gzip decoder
+} SeedStats;
+
+typedef struct SeedLoader SeedLoader;
+
+// Function prototypes
+void seedConfigDefaults(SeedConfig *config);
+SeedLoader *seedLoadStart(const char *const *paths, int count, const SeedConfig *config);
+int seedLoadFirst(SeedLoader *loader);
+void seedLoadStats(SeedLoader *loader, SeedStats *stats);
+int seedLoadWait(SeedLoader *loader, SeedStats *stats);
+
+#endif
@@ -0,0 +1,196 @@
+/*
+Operating Systems Spring 2024
+Final Project
+
+Content fingerprint: SimHash of a page's text and links, computed as the body streams in.
+
+Every feature of a page is hashed to 64 bits, and bit i of the fingerprint is set when most
+features have bit i set. Pages that share most of their features get fingerprints a few bits
+apart, so near-duplicate pages are found by comparing fingerprints rather than bodies.
+
+The features are the chunks of the page's text, markup left out, and whatever is added with
+simHashAdd(); the crawler adds the links of a page with too little text. The text is cut where
+its content says so, as in content-defined chunking: a gear hash rolls over the letters and
+digits, each shifting it by one bit and adding a random number of the byte, and a chunk ends
+where the top CHUNK_BITS bits of the hash are zero, every 8 bytes on average. The hash at the
+end of a chunk is its feature; it only depends on the last 64 letters and digits, so an edit
+changes the features near it and no others. Case, spaces and punctuation are ignored: they
+neither shift the hash nor add to it. This costs a table lookup and a few operations per byte,
+where splitting the text into words would cost a mispredicted branch per word. The text gives a
+16 KB page over a thousand features; a page that only differs from another one by its links is
+a near-duplicate. The scan keeps its state between chunks of the body, so the fingerprint does not depend on how
+the body was split up.
+
+Counting bit by bit would take 64 additions per feature. Instead, features are added to 64 counters
+of 8 bits at once, kept bit-sliced in eight words like a chain of adders: a feature costs a couple
+of word operations, and the counters are moved to 'counts' every 255 features.
+*/
+
+#include <pthread.h>
+#include <string.h>
+
+#include "hash.h"
+#include "simhash.h"
+
+// Top bits of the gear hash that must be zero at the end of a text chunk: 8 bytes per chunk on average
+#define CHUNK_BITS 3
+
+// Per byte: its random number for the gear hash, 0 for bytes that are not letters or digits
+static uint64_t gearTable[256];
+// Per byte: 1 for letters and digits, which shift the gear hash, 0 for the bytes ignored
+static uint64_t gearShift[256];
+static pthread_once_t gearOnce = PTHREAD_ONCE_INIT;
+
+// Fill the gear table; a letter gets the number of its lowercase form
+static void gearInit(void)
+{
+    for (int c = 0; c < 256; c++)
+    {
+        int lower = c >= 'A' && c <= 'Z' ? c + 'a' - 'A' : c;
+        if ((lower >= 'a' && lower <= 'z') || (lower >= '0' && lower <= '9'))
+        {
+            gearTable[c] = mix64((uint64_t)lower + 1);
+            gearShift[c] = 1;
+        }
+    }
+}
+
+// Start an empty fingerprint
+void simHashInit(SimHash *sim)
+{
+    pthread_once(&gearOnce, gearInit);
+    memset(sim->counts, 0, sizeof(sim->counts));
+    memset(sim->planes, 0, sizeof(sim->planes));
+    sim->pending = 0;
+    sim->features = 0;
+    sim->inTag = 0;
+    sim->gear = 0;
+    sim->chunk = 0;
+}
+
+// Move the bit-sliced counters to 'counts'
+static void flush(SimHash *sim)
+{
+    for (int b = 0; b < 64; b++)
+    {
+        uint32_t count = 0;
+        for (int i = 0; i < 8; i++)
+            count |= (uint32_t)((sim->planes[i] >> b) & 1) << i;
+        sim->counts[b] += count;
+    }
+    memset(sim->planes, 0, sizeof(sim->planes));
+    sim->pending = 0;
+}
+
+// Count one feature hash: add its bits to the bit-sliced counters, carrying into the next plane
+static inline void addHash(uint64_t planes[8], uint64_t h)
+{
+    uint64_t carry = h;
+    for (int i = 0; i < 8; i++)             // No early exit: that branch would be mispredicted all the time
+    {
+        uint64_t next = planes[i] & carry;
+        planes[i] ^= carry;
+        carry = next;
+    }
+}
+
+// Count one feature of 'sim'
+static void addFeature(SimHash *sim, uint64_t h)
+{
+    addHash(sim->planes, h);
+    sim->features++;
+    if (++sim->pending == 255)              // The counters cannot overflow before the next flush
+        flush(sim);
+}
+
+/*
+    Add a chunk of a page body.
+
+    Preconditions:  'sim' was set up with simHashInit(); the chunks of a body are fed in order.
+    Postcondition:  The text chunks ended in this part of the body are counted; a text chunk or tag cut off at the
+                    end is continued by the next part.
+*/
+void simHashFeed(SimHash *sim, const char *data, size_t len)
+{
+    const unsigned char *p = (const unsigned char *)data;
+    const unsigned char *end = p + len;
+    uint64_t gear = sim->gear;
+    uint32_t chunk = sim->chunk;
+    uint64_t planes[8];                     // The counters, in registers while the loop runs
+    memcpy(planes, sim->planes, sizeof(planes));
+    uint32_t pending = sim->pending;
+    while (p < end)
+    {
+        if (sim->inTag)                     // Skip to the end of the tag
+        {
+            const unsigned char *close = memchr(p, '>', (size_t)(end - p));
+            if (close == NULL)
+                break;
+            sim->inTag = 0;
+            p = close + 1;
+        }
+
+        while (p < end)                     // Text up to the next tag
+        {
+            unsigned char c = *p++;
+            if (c == '<')
+            {
+                sim->inTag = 1;
+                break;
+            }
+            uint64_t text = gearShift[c];
+            gear = (gear << text) + gearTable[c];
+            chunk += (uint32_t)text;
+            if (((gear >> (64 - CHUNK_BITS)) | (text ^ 1)) == 0)
+            {
+                addHash(planes, mix64(gear));
+                chunk = 0;
+                sim->features++;
+                if (++pending == 255)
+                {
+                    memcpy(sim->planes, planes, sizeof(planes));
+                    flush(sim);
+                    memset(planes, 0, sizeof(planes));
+                    pending = 0;
+                }
+            }
+        }
+    }
+    memcpy(sim->planes, planes, sizeof(planes));
+    sim->pending = pending;
+    sim->gear = gear;
+    sim->chunk = chunk;
+}
+
+// Add a feature of its own, such as a link of the page
+void simHashAdd(SimHash *sim, const char *feature, size_t len)
+{
+    addFeature(sim, hash64(feature, len));
+}
+
+/*
+    Complete the fingerprint.
+
+    Preconditions:  The whole body and every extra feature have been added.
+    Postcondition:  Returns the 64-bit fingerprint; sim->features tells how many features it stands for.
+*/
+uint64_t simHashFinish(SimHash *sim)
+{
+    if (sim->chunk > 0)                     // The text after the last chunk end
+    {
+        addFeature(sim, mix64(sim->gear));
+        sim->chunk = 0;
+    }
+    flush(sim);
+    uint64_t fingerprint = 0;
+    for (int b = 0; b < 64; b++)
+        if (2 * (uint64_t)sim->counts[b] > sim->features)
+            fingerprint |= 1ULL << b;
+    return fingerprint;
+}
+
+// Number of bits two fingerprints differ in
+int simHashDistance(uint64_t a, uint64_t b)
+{
+    return __builtin_popcountll(a ^ b);
+}
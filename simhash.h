@@ -0,0 +1,36 @@
+/*
+Operating Systems Spring 2024
+Final Project
+
+Content fingerprint: SimHash of a page's text, computed as the body streams in.
+*/
+
+#ifndef SIMHASH_H
+#define SIMHASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Fingerprints at most this many bits apart are near-duplicates
+#define SIMHASH_NEAR_BITS 3
+
+// Fingerprint being computed
+typedef struct
+{
+    uint32_t counts[64];        // Features with each bit set, up to the last flush
+    uint64_t planes[8];         // Bit-sliced 8-bit counters of the features since: bit b of plane i is bit i of count b
+    uint32_t pending;           // Features in 'planes'
+    uint32_t features;          // Features added
+    int inTag;                  // 1 inside markup, which is not part of the text
+    uint64_t gear;              // Rolling hash of the text read so far
+    uint32_t chunk;             // Text bytes read since the last chunk ended
+} SimHash;
+
+// Function prototypes
+void simHashInit(SimHash *sim);
+void simHashFeed(SimHash *sim, const char *data, size_t len);
+void simHashAdd(SimHash *sim, const char *feature, size_t len);
+uint64_t simHashFinish(SimHash *sim);
+int simHashDistance(uint64_t a, uint64_t b);
+
+#endif
@@ -0,0 +1,426 @@
+/*
+Operating Systems Spring 2024
+Final Project
+
+URL normalization: resolves links against the URL of their page and brings them into one canonical form.
+
+A link is resolved against its base URL as in RFC 3986, section 5.2: scheme-relative (//host/p),
+absolute-path (/p), query-only (?q) and relative-path (p, ../p) links take the parts they lack
+from the base. As in browsers, tabs and newlines inside a link are dropped, surrounding spaces are
+trimmed and backslashes before the query count as slashes.
+
+The result is in a canonical form, so every spelling of a page gives the same string and so the
+same fingerprint in the visited set:
+ - the scheme and host are lowercased and a port that is the default of the scheme is dropped;
+ - the fragment and an empty query are dropped, an empty path becomes "/";
+ - "." and ".." segments are removed from the path;
+ - percent-escapes of unreserved characters are decoded, other escapes get uppercase hex digits,
+   and bytes a URL may not contain (spaces, quotes, non-ASCII...) are escaped.
+Normalizing a normalized URL gives it back unchanged.
+
+Only http and https URLs are kept; links with other schemes (mailto:, javascript:...) are rejected.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+
+#include "url.h"
+
+// Schemes a URL may have
+enum { SCHEME_NONE, SCHEME_HTTP, SCHEME_HTTPS };
+
+// Parts of a URL or link, pointing into its text
+typedef struct
+{
+    int scheme;                 // SCHEME_NONE for a relative link
+    int hasAuthority;           // 1 if the link names a host
+    const char *authority;      // userinfo@host:port
+    size_t authorityLen;
+    const char *path;
+    size_t pathLen;
+    int hasQuery;               // 1 if there was a '?', even with nothing after it
+    const char *query;          // Query without its '?'
+    size_t queryLen;
+} UrlParts;
+
+// Bounded output; bytes beyond 'size' are counted but not stored
+typedef struct
+{
+    char *buf;
+    size_t len;
+    size_t size;
+} Output;
+
+static const char HEX[] = "0123456789ABCDEF";
+
+static void put(Output *out, char c)
+{
+    if (out->len < out->size)
+        out->buf[out->len] = c;
+    out->len++;
+}
+
+static void putBytes(Output *out, const char *s, size_t len)
+{
+    if (out->len + len <= out->size)
+        memcpy(out->buf + out->len, s, len);
+    out->len += len;
+}
+
+static void putEscape(Output *out, unsigned char c)
+{
+    put(out, '%');
+    put(out, HEX[c >> 4]);
+    put(out, HEX[c & 15]);
+}
+
+static int isAlpha(unsigned char c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+static int isDigit(unsigned char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+// Characters a URL never needs to escape (RFC 3986, section 2.3)
+static int isUnreserved(unsigned char c)
+{
+    return isAlpha(c) || isDigit(c) || c == '-' || c == '.' || c == '_' || c == '~';
+}
+
+// Bytes that may not appear in a URL as they are: controls, space, non-ASCII and a few delimiters
+static int mustEscape(unsigned char c)
+{
+    switch (c)
+    {
+    case '"': case '<': case '>': case '\\': case '^': case '`': case '{': case '|': case '}':
+        return 1;
+    default:
+        return c <= 0x20 || c >= 0x7f;
+    }
+}
+
+static int hexValue(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+// Copy a link without surrounding spaces, tabs and newlines or its fragment; returns its new length
+static size_t clean(const char *s, size_t len, char *out)
+{
+    while (len > 0 && (unsigned char)s[0] <= 0x20)
+    {
+        s++;
+        len--;
+    }
+    while (len > 0 && (unsigned char)s[len - 1] <= 0x20)
+        len--;
+
+    size_t n = 0;
+    int inQuery = 0;
+    for (size_t i = 0; i < len; i++)
+    {
+        char c = s[i];
+        if (c == '\t' || c == '\n' || c == '\r')
+            continue;
+        if (c == '#')
+            break;                                  // The fragment never reaches the server
+        if (c == '?')
+            inQuery = 1;
+        else if (c == '\\' && !inQuery)
+            c = '/';
+        out[n++] = c;
+    }
+    return n;
+}
+
+/*
+    Split a cleaned link into its parts. A link with the scheme of its base and fewer than two
+    slashes after it ("http:page") is relative, as in browsers. Returns -1 for a scheme other
+    than http and https.
+*/
+static int parse(const char *s, size_t len, int baseScheme, UrlParts *parts)
+{
+    memset(parts, 0, sizeof(*parts));
+    size_t i = 0;
+
+    if (len > 0 && isAlpha((unsigned char)s[0]))
+    {
+        size_t k = 1;
+        while (k < len && (isAlpha((unsigned char)s[k]) || isDigit((unsigned char)s[k]) ||
+                           s[k] == '+' || s[k] == '-' || s[k] == '.'))
+            k++;
+        if (k < len && s[k] == ':')
+        {
+            if (k == 4 && strncasecmp(s, "http", 4) == 0)
+                parts->scheme = SCHEME_HTTP;
+            else if (k == 5 && strncasecmp(s, "https", 5) == 0)
+                parts->scheme = SCHEME_HTTPS;
+            else
+                return -1;
+            i = k + 1;
+        }
+    }
+
+    size_t slashes = 0;
+    while (i + slashes < len && s[i + slashes] == '/')
+        slashes++;
+    if (parts->scheme != SCHEME_NONE && parts->scheme == baseScheme && slashes < 2)
+    {
+        parts->scheme = SCHEME_NONE;
+    }
+    else if (parts->scheme != SCHEME_NONE || slashes >= 2)
+    {
+        i += slashes;
+        size_t start = i;
+        while (i < len && s[i] != '/' && s[i] != '?')
+            i++;
+        parts->hasAuthority = 1;
+        parts->authority = s + start;
+        parts->authorityLen = i - start;
+    }
+
+    size_t start = i;
+    while (i < len && s[i] != '?')
+        i++;
+    parts->path = s + start;
+    parts->pathLen = i - start;
+    if (i < len)
+    {
+        parts->hasQuery = 1;
+        parts->query = s + i + 1;
+        parts->queryLen = len - i - 1;
+    }
+    return 0;
+}
+
+// Copy a path, query or userinfo with its percent-escapes in canonical form
+static void putEscaped(Output *out, const char *s, size_t len)
+{
+    for (size_t i = 0; i < len; i++)
+    {
+        size_t run = i;                             // Copy the bytes that stay as they are at once
+        while (run < len && s[run] != '%' && !mustEscape((unsigned char)s[run]))
+            run++;
+        putBytes(out, s + i, run - i);
+        if (run == len)
+            break;
+        i = run;
+
+        unsigned char c = (unsigned char)s[i];
+        if (c == '%' && i + 2 < len && hexValue(s[i + 1]) >= 0 && hexValue(s[i + 2]) >= 0)
+        {
+            unsigned char v = (unsigned char)(hexValue(s[i + 1]) * 16 + hexValue(s[i + 2]));
+            if (isUnreserved(v))
+                put(out, (char)v);
+            else
+                putEscape(out, v);
+            i += 2;
+        }
+        else
+            putEscape(out, c);
+    }
+}
+
+// Append a path that starts with '/' without its "." and ".." segments (RFC 3986, section 5.2.4)
+static void putWithoutDots(Output *out, const char *path, size_t len)
+{
+    size_t start = out->len;                        // Where the path begins in 'out'
+    size_t i = 0;
+    while (i < len && out->len <= out->size)
+    {
+        size_t end = i + 1;                         // path[i] is the '/' before the segment
+        while (end < len && path[end] != '/')
+            end++;
+        size_t segment = end - i - 1;
+
+        if (segment == 1 && path[i + 1] == '.')
+        {
+            if (end == len)
+                put(out, '/');                      // "/a/." is "/a/"
+        }
+        else if (segment == 2 && path[i + 1] == '.' && path[i + 2] == '.')
+        {
+            while (out->len > start)                // Drop the last segment written
+            {
+                out->len--;
+                if (out->buf[out->len] == '/')
+                    break;
+            }
+            if (end == len)
+                put(out, '/');                      // "/a/b/.." is "/a/"
+        }
+        else
+        {
+            putBytes(out, path + i, end - i);
+        }
+        i = end;
+    }
+}
+
+// Append an authority with its host lowercased and a default port dropped; -1 if the host or port is invalid
+static int putAuthority(Output *out, const char *s, size_t len, int scheme)
+{
+    size_t host = 0;                                // Start of the host, after the last '@'
+    for (size_t i = len; i > 0; i--)
+    {
+        if (s[i - 1] == '@')
+        {
+            host = i;
+            break;
+        }
+    }
+    if (host > 0)
+    {
+        putEscaped(out, s, host - 1);
+        put(out, '@');
+    }
+
+    size_t hostEnd = host;
+    if (host < len && s[host] == '[')               // IPv6 literal
+    {
+        while (hostEnd < len && s[hostEnd] != ']')
+            hostEnd++;
+        if (hostEnd == len)
+            return -1;
+        hostEnd++;
+    }
+    else
+    {
+        while (hostEnd < len && s[hostEnd] != ':')
+            hostEnd++;
+    }
+    if (hostEnd == host)
+        return -1;                                  // No host
+
+    for (size_t i = host; i < hostEnd; i++)
+    {
+        unsigned char c = (unsigned char)s[i];
+        if (c < 0x80 && mustEscape(c))
+            return -1;
+        put(out, (c >= 'A' && c <= 'Z') ? (char)(c - 'A' + 'a') : (char)c);
+    }
+
+    if (hostEnd < len)
+    {
+        if (s[hostEnd] != ':')
+            return -1;                              // Junk after an IPv6 literal
+        long port = 0;
+        size_t digits = 0;
+        for (size_t i = hostEnd + 1; i < len; i++, digits++)
+        {
+            if (!isDigit((unsigned char)s[i]))
+                return -1;
+            port = port * 10 + (s[i] - '0');
+            if (port > 65535)
+                return -1;
+        }
+        if (digits > 0 && port != (scheme == SCHEME_HTTPS ? 443 : 80))
+        {
+            char number[8];
+            int n = snprintf(number, sizeof(number), ":%ld", port);
+            putBytes(out, number, (size_t)n);
+        }
+    }
+    return 0;
+}
+
+/*
+    Resolve a link against its base URL and normalize the result.
+
+    Preconditions:  'href' points to 'len' bytes of a link as found in an href attribute. 'base' is the URL the
+                    link is relative to (its page, or the page's <base>), as returned by urlNormalize(), or NULL
+                    for none. 'out' points to a buffer of 'size' bytes.
+    Postcondition:  Returns the length of the normalized absolute URL stored null-terminated in 'out', or -1 if
+                    the link is not an http or https URL, is relative without a usable base, has an invalid host
+                    or port, or it or the result is too long.
+*/
+int urlNormalize(const char *base, const char *href, size_t len, char *out, size_t size)
+{
+    char link[URL_MAX_INPUT];                       // Cleaned link
+    char merged[2 * URL_MAX_INPUT];                 // Base directory followed by a relative path
+    char escaped[3 * 2 * URL_MAX_INPUT];            // Path with canonical escapes, before dot removal
+
+    if (len >= URL_MAX_INPUT || size == 0)
+        return -1;
+
+    UrlParts b, r;
+    int haveBase = 0;
+    if (base != NULL && parse(base, strlen(base), SCHEME_NONE, &b) == 0)   // Normalized, nothing to clean
+        haveBase = b.scheme != SCHEME_NONE;
+    if (parse(link, clean(href, len, link), haveBase ? b.scheme : SCHEME_NONE, &r) != 0)
+        return -1;
+
+    // Take what the link lacks from the base (RFC 3986, section 5.2.2)
+    UrlParts t = r;
+    if (r.scheme == SCHEME_NONE)
+    {
+        if (!haveBase)
+            return -1;
+        t.scheme = b.scheme;
+        if (!r.hasAuthority)
+        {
+            t.authority = b.authority;
+            t.authorityLen = b.authorityLen;
+            if (r.pathLen == 0)
+            {
+                t.path = b.path;
+                t.pathLen = b.pathLen;
+                if (!r.hasQuery)
+                {
+                    t.hasQuery = b.hasQuery;
+                    t.query = b.query;
+                    t.queryLen = b.queryLen;
+                }
+            }
+            else if (r.path[0] != '/')
+            {
+                size_t dir = b.pathLen;             // Base path up to its last slash
+                while (dir > 0 && b.path[dir - 1] != '/')
+                    dir--;
+                size_t m = 0;
+                if (dir == 0)
+                    merged[m++] = '/';
+                memcpy(merged + m, b.path, dir);
+                memcpy(merged + m + dir, r.path, r.pathLen);
+                t.path = merged;
+                t.pathLen = m + dir + r.pathLen;
+            }
+        }
+    }
+
+    Output result = { out, 0, size - 1 };
+    if (t.scheme == SCHEME_HTTPS)
+        putBytes(&result, "https://", 8);
+    else
+        putBytes(&result, "http://", 7);
+    if (putAuthority(&result, t.authority, t.authorityLen, t.scheme) != 0)
+        return -1;
+
+    Output path = { escaped, 0, sizeof(escaped) };
+    if (t.pathLen == 0)
+        put(&path, '/');
+    putEscaped(&path, t.path, t.pathLen);
+    if (path.len > path.size)
+        return -1;
+    putWithoutDots(&result, escaped, path.len);
+
+    if (t.hasQuery && t.queryLen > 0)
+    {
+        put(&result, '?');
+        putEscaped(&result, t.query, t.queryLen);
+    }
+    if (result.len > result.size)
+        return -1;
+    out[result.len] = '\0';
+    return (int)result.len;
+}
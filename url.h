@@ -0,0 +1,19 @@
+/*
+Operating Systems Spring 2024
+Final Project
+
+URL normalization: resolves links against the URL of their page and brings them into one canonical form.
+*/
+
+#ifndef URL_H
+#define URL_H
+
+#include <stddef.h>
+
+// Longest link or base URL urlNormalize() takes, in bytes
+#define URL_MAX_INPUT 4096
+
+// Function prototypes
+int urlNormalize(const char *base, const char *href, size_t len, char *out, size_t size);
+
+#endif
@@ -0,0 +1,307 @@
+/*
+Operating Systems Spring 2024
+Final Project
+
+URL table: concurrent table of interned URLs, each stored once and known by a 32-bit ID.
+
+A URL is interned once, however often it is found, and from then on is known by its ID. The
+frontier keeps those IDs instead of copies of the URLs, and the table doubles as the set of URLs
+already queued, so a link found on many pages is stored and queued only the first time.
+
+The URLs are spread over SHARDS shards by the top bits of their hash. Each shard has its own lock,
+an open-addressing hash table and the strings themselves, packed into CHUNK_BYTES chunks as a
+16-bit length, the bytes and a null byte. A slot of the hash table holds the low 32 bits of the
+hash, which pick its position and rule out most mismatches without touching the string, and the
+index of the URL in the shard. Chunks are never moved or freed before the table, so a string
+handed out by urlTableGet() stays valid without holding the lock.
+
+An ID is the index of the URL in its shard times SHARDS plus the shard.
+*/
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hash.h"
+#include "urltable.h"
+
+// Number of shards, a power of two (top 6 bits of the hash)
+#define SHARD_BITS 6
+#define SHARDS (1 << SHARD_BITS)
+
+// Size of the chunks the strings are packed into; offsets within a chunk take 16 bits
+#define CHUNK_BYTES (64 * 1024)
+
+// Most chunks and URLs per shard, so that locations and IDs fit into 32 bits
+#define MAX_CHUNKS 65536
+#define MAX_SHARD_URLS (UINT32_MAX >> SHARD_BITS)
+
+// Smallest hash table per shard
+#define MIN_SHARD_SLOTS 16
+
+typedef struct
+{
+    _Alignas(64) pthread_mutex_t lock;
+    uint64_t *slots;                        // (hash low 32 bits << 32) | (index + 1), 0 if unused
+    size_t mask;                            // Number of slots - 1
+    uint32_t *locations;                    // Per index: chunk << 16 | offset of the string
+    size_t count, capacity;                 // URLs stored and room in 'locations'
+    char **chunks;                          // String storage, the current chunk last
+    size_t chunkCount, chunkCap;
+    size_t chunkUsed;                       // Bytes used in the current chunk
+} Shard;
+
+struct UrlTable
+{
+    Shard shards[SHARDS];
+    atomic_size_t count;                    // URLs over all shards
+    atomic_size_t bytes;                    // Memory held over all shards
+};
+
+/*
+    Create an empty URL table.
+
+    Preconditions:  'expected' is the number of URLs the table should hold without growing (0 for small).
+    Postcondition:  Returns a new table, or NULL if memory allocation failed.
+*/
+UrlTable *urlTableCreate(size_t expected)
+{
+    UrlTable *table = aligned_alloc(64, sizeof(UrlTable));
+    if (table == NULL)
+        return NULL;
+
+    size_t slots = MIN_SHARD_SLOTS;                         // Three quarters full at most
+    while (slots * 3 < expected * 4 / SHARDS)
+        slots *= 2;
+
+    atomic_init(&table->count, 0);
+    atomic_init(&table->bytes, sizeof(UrlTable));
+    for (int i = 0; i < SHARDS; i++)
+    {
+        Shard *shard = &table->shards[i];
+        pthread_mutex_init(&shard->lock, NULL);
+        shard->slots = calloc(slots, sizeof(uint64_t));
+        shard->mask = slots - 1;
+        shard->locations = NULL;
+        shard->count = shard->capacity = 0;
+        shard->chunks = NULL;
+        shard->chunkCount = shard->chunkCap = shard->chunkUsed = 0;
+        if (shard->slots == NULL)
+        {
+            for (int k = 0; k <= i; k++)
+                free(table->shards[k].slots);
+            free(table);
+            return NULL;
+        }
+        atomic_fetch_add(&table->bytes, slots * sizeof(uint64_t));
+    }
+    return table;
+}
+
+// Pointer to the string stored at 'location'
+static char *stringAt(const Shard *shard, uint32_t location)
+{
+    return shard->chunks[location >> 16] + (location & 0xffff);
+}
+
+// Double the hash table of a shard; the caller holds its lock
+static int growSlots(UrlTable *table, Shard *shard)
+{
+    size_t slots = (shard->mask + 1) * 2;
+    uint64_t *fresh = calloc(slots, sizeof(uint64_t));
+    if (fresh == NULL)
+        return -1;
+    for (size_t i = 0; i <= shard->mask; i++)
+    {
+        uint64_t slot = shard->slots[i];
+        if (slot == 0)
+            continue;
+        size_t k = (size_t)(slot >> 32) & (slots - 1);
+        while (fresh[k] != 0)
+            k = (k + 1) & (slots - 1);
+        fresh[k] = slot;
+    }
+    free(shard->slots);
+    shard->slots = fresh;
+    shard->mask = slots - 1;
+    atomic_fetch_add(&table->bytes, slots / 2 * sizeof(uint64_t));
+    return 0;
+}
+
+// Copy a string into the shard's chunks; returns its location, or UINT32_MAX if memory ran out
+static uint32_t storeString(UrlTable *table, Shard *shard, const char *url, size_t len)
+{
+    size_t need = 2 + len + 1;
+    if (shard->chunkCount == 0 || shard->chunkUsed + need > CHUNK_BYTES)
+    {
+        if (shard->chunkCount == MAX_CHUNKS)
+            return UINT32_MAX;
+        if (shard->chunkCount == shard->chunkCap)
+        {
+            size_t cap = shard->chunkCap ? shard->chunkCap * 2 : 16;
+            char **chunks = realloc(shard->chunks, cap * sizeof(char *));
+            if (chunks == NULL)
+                return UINT32_MAX;
+            atomic_fetch_add(&table->bytes, (cap - shard->chunkCap) * sizeof(char *));
+            shard->chunks = chunks;
+            shard->chunkCap = cap;
+        }
+        char *chunk = malloc(CHUNK_BYTES);
+        if (chunk == NULL)
+            return UINT32_MAX;
+        atomic_fetch_add(&table->bytes, CHUNK_BYTES);
+        shard->chunks[shard->chunkCount++] = chunk;
+        shard->chunkUsed = 0;
+    }
+
+    uint32_t location = (uint32_t)((shard->chunkCount - 1) << 16 | shard->chunkUsed);
+    char *p = stringAt(shard, location);
+    uint16_t length = (uint16_t)len;
+    memcpy(p, &length, 2);
+    memcpy(p + 2, url, len);
+    p[2 + len] = '\0';
+    shard->chunkUsed += need;
+    return location;
+}
+
+/*
+    Intern a URL. Safe to call from any number of threads.
+
+    Preconditions:  'table' was returned by urlTableCreate(), 'url' points to 'len' bytes, 'id' to a uint32_t.
+    Postcondition:  Returns 1 if the URL was added, 0 if it was in the table already, with its ID stored in 'id'
+                    either way; or -1 if it is empty, longer than URL_TABLE_MAX_LENGTH or memory allocation failed.
+*/
+int urlTableIntern(UrlTable *table, const char *url, size_t len, uint32_t *id)
+{
+    if (len == 0 || len > URL_TABLE_MAX_LENGTH)
+        return -1;
+
+    uint64_t hash = hash64(url, len);
+    uint32_t shardIndex = (uint32_t)(hash >> (64 - SHARD_BITS));
+    uint64_t tag = hash & 0xffffffffu;
+    Shard *shard = &table->shards[shardIndex];
+
+    pthread_mutex_lock(&shard->lock);
+    if ((shard->count + 1) * 4 > (shard->mask + 1) * 3 && growSlots(table, shard) != 0)
+    {
+        pthread_mutex_unlock(&shard->lock);
+        return -1;
+    }
+
+    size_t i = (size_t)tag & shard->mask;
+    for (; shard->slots[i] != 0; i = (i + 1) & shard->mask)
+    {
+        if ((shard->slots[i] >> 32) != tag)
+            continue;
+        uint32_t index = (uint32_t)shard->slots[i] - 1;
+        const char *stored = stringAt(shard, shard->locations[index]);
+        uint16_t storedLen;
+        memcpy(&storedLen, stored, 2);
+        if (storedLen == len && memcmp(stored + 2, url, len) == 0)
+        {
+            pthread_mutex_unlock(&shard->lock);
+            *id = index << SHARD_BITS | shardIndex;
+            return 0;
+        }
+    }
+
+    // Not there: store it in slot 'i'
+    if (shard->count == MAX_SHARD_URLS)
+    {
+        pthread_mutex_unlock(&shard->lock);
+        return -1;
+    }
+    if (shard->count == shard->capacity)
+    {
+        size_t cap = shard->capacity ? shard->capacity * 2 : 64;
+        uint32_t *locations = realloc(shard->locations, cap * sizeof(uint32_t));
+        if (locations == NULL)
+        {
+            pthread_mutex_unlock(&shard->lock);
+            return -1;
+        }
+        atomic_fetch_add(&table->bytes, (cap - shard->capacity) * sizeof(uint32_t));
+        shard->locations = locations;
+        shard->capacity = cap;
+    }
+    uint32_t location = storeString(table, shard, url, len);
+    if (location == UINT32_MAX)
+    {
+        pthread_mutex_unlock(&shard->lock);
+        return -1;
+    }
+
+    uint32_t index = (uint32_t)shard->count++;
+    shard->locations[index] = location;
+    shard->slots[i] = tag << 32 | (index + 1);
+    pthread_mutex_unlock(&shard->lock);
+
+    atomic_fetch_add(&table->count, 1);
+    *id = index << SHARD_BITS | shardIndex;
+    return 1;
+}
+
+/*
+    Look up an interned URL by its ID. Safe to call from any number of threads.
+
+    Preconditions:  'id' was returned by urlTableIntern() on 'table'; 'len' points to a size_t or is NULL.
+    Postcondition:  Returns the null-terminated URL, valid until the table is destroyed, and stores its length in
+                    'len'; or NULL if there is no URL with that ID.
+*/
+const char *urlTableGet(UrlTable *table, uint32_t id, size_t *len)
+{
+    Shard *shard = &table->shards[id & (SHARDS - 1)];
+    uint32_t index = id >> SHARD_BITS;
+    const char *stored = NULL;
+
+    pthread_mutex_lock(&shard->lock);
+    if (index < shard->count)
+        stored = stringAt(shard, shard->locations[index]);
+    pthread_mutex_unlock(&shard->lock);
+
+    if (stored == NULL)
+        return NULL;
+    if (len != NULL)
+    {
+        uint16_t length;
+        memcpy(&length, stored, 2);
+        *len = length;
+    }
+    return stored + 2;
+}
+
+// Number of URLs in the table
+size_t urlTableCount(const UrlTable *table)
+{
+    return atomic_load(&((UrlTable *)table)->count);
+}
+
+// Bytes of memory the table holds: hash tables, locations and string chunks
+size_t urlTableBytes(const UrlTable *table)
+{
+    return atomic_load(&((UrlTable *)table)->bytes);
+}
+
+/*
+    Destroy a URL table.
+
+    Preconditions:  'table' was returned by urlTableCreate() and no other thread uses it.
+    Postcondition:  All memory is released; strings returned by urlTableGet() are no longer valid.
+*/
+void urlTableDestroy(UrlTable *table)
+{
+    if (table == NULL)
+        return;
+    for (int i = 0; i < SHARDS; i++)
+    {
+        Shard *shard = &table->shards[i];
+        for (size_t k = 0; k < shard->chunkCount; k++)
+            free(shard->chunks[k]);
+        free(shard->chunks);
+        free(shard->locations);
+        free(shard->slots);
+        pthread_mutex_destroy(&shard->lock);
+    }
+    free(table);
+}
@@ -0,0 +1,27 @@
+/*
+Operating Systems Spring 2024
+Final Project
+
+URL table: concurrent table of interned URLs, each stored once and known by a 32-bit ID.
+*/
+
+#ifndef URLTABLE_H
+#define URLTABLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Longest URL the table keeps, in bytes
+#define URL_TABLE_MAX_LENGTH 8192
+
+typedef struct UrlTable UrlTable;
+
+// Function prototypes
+UrlTable *urlTableCreate(size_t expected);
+int urlTableIntern(UrlTable *table, const char *url, size_t len, uint32_t *id);
+const char *urlTableGet(UrlTable *table, uint32_t id, size_t *len);
+size_t urlTableCount(const UrlTable *table);
+size_t urlTableBytes(const UrlTable *table);
+void urlTableDestroy(UrlTable *table);
+
+#endif
@@ -0,0 +1,263 @@
+/*
+Operating Systems Spring 2024
+Final Project
+
+Visited set: concurrent hash set of 64-bit URL fingerprints.
+
+Only the 64-bit fingerprint of a URL is stored, 8 bytes per slot, never the URL itself. The set
+is split into shards picked by the top bits of the fingerprint. Every shard is an open-addressing
+table with linear probing; slots are claimed with compare-and-swap, so test-and-insert needs no
+lock and two workers can never both win the same URL. A shard that is three quarters full is
+doubled under its own write lock, which only blocks the threads using that one shard.
+*/
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hash.h"
+#include "visited.h"
+
+// Number of shards, a power of two (top 8 bits of the fingerprint)
+#define SHARD_BITS 8
+#define SHARDS (1 << SHARD_BITS)
+
+// Smallest table per shard
+#define MIN_SHARD_SLOTS 64
+
+// Value of an unused slot; a fingerprint of 0 is stored as 1
+#define EMPTY_SLOT 0
+
+typedef struct
+{
+    _Alignas(64) pthread_rwlock_t lock;     // Read: insert/lookup, write: grow
+    _Atomic uint64_t *slots;                // Open-addressing table
+    size_t mask;                            // Number of slots - 1
+    atomic_size_t count;                    // Fingerprints stored
+} Shard;
+
+struct VisitedSet
+{
+    Shard shards[SHARDS];
+};
+
+/*
+    Compute the 64-bit fingerprint of a URL.
+
+    Preconditions:  'url' points to a valid null-terminated string.
+    Postcondition:  Returns the fingerprint; two different URLs collide with probability about 2^-64.
+*/
+uint64_t urlFingerprint(const char *url)
+{
+    return hash64(url, strlen(url));
+}
+
+static Shard *shardFor(VisitedSet *set, uint64_t fingerprint)
+{
+    return &set->shards[fingerprint >> (64 - SHARD_BITS)];
+}
+
+// Insert into a table that is not shared yet (used while growing)
+static void insertPrivate(_Atomic uint64_t *slots, size_t mask, uint64_t fingerprint)
+{
+    size_t i = (size_t)fingerprint & mask;
+    while (atomic_load_explicit(&slots[i], memory_order_relaxed) != EMPTY_SLOT)
+        i = (i + 1) & mask;
+    atomic_store_explicit(&slots[i], fingerprint, memory_order_relaxed);
+}
+
+// Double the table of a shard once it is three quarters full
+static int grow(Shard *shard)
+{
+    pthread_rwlock_wrlock(&shard->lock);
+    size_t slots = shard->mask + 1;
+    if (atomic_load(&shard->count) * 4 < slots * 3)         // Another thread grew it already
+    {
+        pthread_rwlock_unlock(&shard->lock);
+        return 0;
+    }
+
+    size_t newMask = slots * 2 - 1;
+    _Atomic uint64_t *table = calloc(slots * 2, sizeof(uint64_t));
+    if (table == NULL)
+    {
+        pthread_rwlock_unlock(&shard->lock);
+        return -1;
+    }
+    for (size_t i = 0; i < slots; i++)                      // Rehash every fingerprint
+    {
+        uint64_t fp = atomic_load_explicit(&shard->slots[i], memory_order_relaxed);
+        if (fp != EMPTY_SLOT)
+            insertPrivate(table, newMask, fp);
+    }
+    free(shard->slots);
+    shard->slots = table;
+    shard->mask = newMask;
+    pthread_rwlock_unlock(&shard->lock);
+    return 0;
+}
+
+/*
+    Create an empty visited set.
+
+    Preconditions:  'expected' is the number of URLs the crawl is expected to visit (0 if unknown);
+                    the tables are sized for it up front so they do not have to grow.
+    Postcondition:  Returns a new set, or NULL if memory allocation failed.
+*/
+VisitedSet *visitedCreate(size_t expected)
+{
+    VisitedSet *set = aligned_alloc(64, sizeof(VisitedSet));
+    if (set == NULL)
+        return NULL;
+
+    size_t perShard = MIN_SHARD_SLOTS;
+    while (perShard * 3 / 4 < expected / SHARDS + 1)        // Stay below three quarters full
+        perShard *= 2;
+
+    for (int i = 0; i < SHARDS; i++)
+    {
+        Shard *shard = &set->shards[i];
+        pthread_rwlock_init(&shard->lock, NULL);
+        shard->slots = calloc(perShard, sizeof(uint64_t));
+        shard->mask = perShard - 1;
+        atomic_init(&shard->count, 0);
+        if (shard->slots == NULL)
+        {
+            for (int j = 0; j <= i; j++)
+                free(set->shards[j].slots);
+            free(set);
+            return NULL;
+        }
+    }
+    return set;
+}
+
+/*
+    Atomically check for a fingerprint and add it if it is missing. Safe from any number of threads.
+
+    Preconditions:  'set' was returned by visitedCreate().
+    Postcondition:  Returns 1 if the fingerprint was added by this call, 0 if it was already present
+                    (the caller must not fetch the URL again), or -1 if memory allocation failed.
+*/
+int visitedTestAndInsert(VisitedSet *set, uint64_t fingerprint)
+{
+    if (fingerprint == EMPTY_SLOT)
+        fingerprint = 1;
+    Shard *shard = shardFor(set, fingerprint);
+
+    while (1)
+    {
+        pthread_rwlock_rdlock(&shard->lock);
+        size_t mask = shard->mask;
+        if (atomic_load(&shard->count) >= mask)             // Full: grow before probing
+        {
+            pthread_rwlock_unlock(&shard->lock);
+            if (grow(shard) != 0)
+                return -1;
+            continue;
+        }
+
+        size_t i = (size_t)fingerprint & mask;
+        size_t probes = 0;
+        int claimed = 0;
+        while (probes++ <= mask)
+        {
+            uint64_t current = atomic_load_explicit(&shard->slots[i], memory_order_acquire);
+            if (current == EMPTY_SLOT)
+            {
+                uint64_t expected = EMPTY_SLOT;
+                if (atomic_compare_exchange_strong(&shard->slots[i], &expected, fingerprint))
+                {
+                    claimed = 1;                            // Slot claimed
+                    break;
+                }
+                current = expected;                         // Lost the race, see who won
+            }
+            if (current == fingerprint)
+            {
+                pthread_rwlock_unlock(&shard->lock);
+                return 0;                                   // Already visited
+            }
+            i = (i + 1) & mask;
+        }
+        if (!claimed)                                       // Other threads filled the table meanwhile
+        {
+            pthread_rwlock_unlock(&shard->lock);
+            if (grow(shard) != 0)
+                return -1;
+            continue;
+        }
+
+        size_t count = atomic_fetch_add(&shard->count, 1) + 1;
+        pthread_rwlock_unlock(&shard->lock);
+        if (count * 4 >= (mask + 1) * 3)
+            grow(shard);
+        return 1;
+    }
+}
+
+/*
+    Check whether a fingerprint is in the set. Safe from any number of threads.
+
+    Preconditions:  'set' was returned by visitedCreate().
+    Postcondition:  Returns 1 if the fingerprint is present, otherwise 0.
+*/
+int visitedContains(VisitedSet *set, uint64_t fingerprint)
+{
+    if (fingerprint == EMPTY_SLOT)
+        fingerprint = 1;
+    Shard *shard = shardFor(set, fingerprint);
+    int found = 0;
+
+    pthread_rwlock_rdlock(&shard->lock);
+    size_t i = (size_t)fingerprint & shard->mask;
+    while (1)
+    {
+        uint64_t current = atomic_load_explicit(&shard->slots[i], memory_order_acquire);
+        if (current == fingerprint || current == EMPTY_SLOT)
+        {
+            found = current == fingerprint;
+            break;
+        }
+        i = (i + 1) & shard->mask;
+    }
+    pthread_rwlock_unlock(&shard->lock);
+    return found;
+}
+
+// Number of fingerprints stored
+size_t visitedCount(const VisitedSet *set)
+{
+    size_t count = 0;
+    for (int i = 0; i < SHARDS; i++)
+        count += atomic_load(&((VisitedSet *)set)->shards[i].count);
+    return count;
+}
+
+// Bytes of memory used by the set
+size_t visitedBytes(const VisitedSet *set)
+{
+    size_t bytes = sizeof(VisitedSet);
+    for (int i = 0; i < SHARDS; i++)
+        bytes += (set->shards[i].mask + 1) * sizeof(uint64_t);
+    return bytes;
+}
+
+/*
+    Destroy a visited set.
+
+    Preconditions:  'set' was returned by visitedCreate() or is NULL, and no other thread uses it.
+    Postcondition:  All memory is released.
+*/
+void visitedDestroy(VisitedSet *set)
+{
+    if (set == NULL)
+        return;
+    for (int i = 0; i < SHARDS; i++)
+    {
+        pthread_rwlock_destroy(&set->shards[i].lock);
+        free(set->shards[i].slots);
+    }
+    free(set);
+}
@@ -0,0 +1,25 @@
+/*
+Operating Systems Spring 2024
+Final Project
+
+Visited set: concurrent hash set of 64-bit URL fingerprints.
+*/
+
+#ifndef VISITED_H
+#define VISITED_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct VisitedSet VisitedSet;
+
+// Function prototypes
+VisitedSet *visitedCreate(size_t expected);
+uint64_t urlFingerprint(const char *url);
+int visitedTestAndInsert(VisitedSet *set, uint64_t fingerprint);
+int visitedContains(VisitedSet *set, uint64_t fingerprint);
+size_t visitedCount(const VisitedSet *set);
+size_t visitedBytes(const VisitedSet *set);
+void visitedDestroy(VisitedSet *set);
+
+#endif